@@ -31,4 +31,16 @@
 
 #define HAVE_LIBUUID 1
 
+//  thread_local needs Visual Studio 2015
+#if _MSC_VER >= 1900
+#define HAVE_THREAD_LOCAL 1
+#endif
+
+//  TraceLogging, for the ETW tracepoints, comes with the Windows 10 SDK
+#if _MSC_VER >= 1900
+#define HAVE_TRACELOGGING 1
+#endif
+
+#define HAVE_UNORDERED_MAP 1
+
 #endif
@@ -64,7 +64,7 @@ std::ostringstream& Log<T>::Get(TLogLevel level)
 template <typename T>
 Log<T>::~Log()
 {
-    os << std::endl;
+    os << '\n'; /* FNCS: the output flushes the line, not std::endl */
     T::Output(os.str());
 }
 
@@ -0,0 +1,16 @@
+# FNCS_CXX_THREAD_LOCAL
+# ---------------------
+# Check whether CXX supports thread_local, which a broker hosting many
+# federations needs, and define HAVE_THREAD_LOCAL if so.
+AC_DEFUN([FNCS_CXX_THREAD_LOCAL], [
+AC_LANG_ASSERT([C++])
+AC_CACHE_CHECK([for C++ thread_local],
+    [fncs_cv_cxx_thread_local],
+    [AC_LINK_IFELSE(
+        [AC_LANG_PROGRAM([[static thread_local int counter = 0;]], [[++counter;]])],
+        [fncs_cv_cxx_thread_local=yes],
+        [fncs_cv_cxx_thread_local=no])])
+AS_IF([test "x$fncs_cv_cxx_thread_local" = xyes],
+    [AC_DEFINE([HAVE_THREAD_LOCAL], [1],
+        [Define to 1 if the C++ compiler supports thread_local])])
+])# FNCS_CXX_THREAD_LOCAL
@@ -0,0 +1,94 @@
+function fncs_bench(broker, calls)
+%FNCS_BENCH Time the FNCS MEX functions per call.
+%   FNCS_BENCH starts fncs_broker for one sim that subscribes to the keys
+%   it publishes, then prints the microseconds per call of fncs_publish,
+%   fncs_get_value, fncs_get_values, fncs_get_events, fncs_get_double and
+%   fncs_get_doubles, next to the numbers of fncs_microbench for C++ and
+%   C and of python/bench.py. Build the MEX files with build.sh first.
+%
+%   FNCS_BENCH(BROKER, CALLS) takes the path of fncs_broker (default
+%   'fncs_broker') and the number of calls of each benchmark (default
+%   10000). MATLAB does not count allocations; the MEX files' own are
+%   those of the C++ calls they make.
+
+if nargin < 1
+    broker = 'fncs_broker';
+end
+if nargin < 2
+    calls = 10000;
+end
+
+n_keys = 100;
+endpoint = 'tcp://127.0.0.1:5597';
+
+% fncs_initialize takes its config from FNCS_CONFIG_FILE
+config = [tempname '.zpl'];
+fid = fopen(config, 'w');
+fprintf(fid, 'name = mexbench\ntime_delta = 1ns\nbroker = %s\nvalues\n', endpoint);
+for k = 0:n_keys-1
+    fprintf(fid, '    t%d\n        topic = mexbench/k%d\n        default = 0\n', k, k);
+end
+fclose(fid);
+setenv('FNCS_CONFIG_FILE', config);
+setenv('FNCS_BROKER', endpoint);
+system([broker ' 1 &']);
+
+fncs_initialize();
+if ~fncs_is_initialized()
+    error('MATLAB:fncs:bench', 'could not connect to the broker');
+end
+granted = 0;
+fprintf('%-36s%12s%12s\n', '# benchmark', 'calls', 'us/call');
+
+tic;
+for i = 1:calls
+    fncs_publish('k0', '1.25');
+end
+report('fncs_publish', calls, toc);
+granted = fncs_time_request(granted + 1);
+
+% every key now has a value from the last step
+for k = 0:n_keys-1
+    fncs_publish(sprintf('k%d', k), '1.25');
+end
+granted = fncs_time_request(granted + 1);
+
+tic;
+for i = 1:calls
+    fncs_get_value('t7');
+end
+report('fncs_get_value', calls, toc);
+
+tic;
+for i = 1:calls
+    fncs_get_values('t7');
+end
+report('fncs_get_values', calls, toc);
+
+tic;
+for i = 1:calls
+    fncs_get_double('t7');
+end
+report('fncs_get_double', calls, toc);
+
+names = arrayfun(@(k) sprintf('t%d', k), 0:n_keys-1, 'UniformOutput', false);
+rounds = max(floor(calls / n_keys), 1);
+tic;
+for i = 1:rounds
+    fncs_get_doubles(names);
+end
+report('fncs_get_doubles, per value', rounds * n_keys, toc);
+
+tic;
+for i = 1:rounds
+    fncs_get_events();
+end
+report('fncs_get_events, 100 keys', rounds, toc);
+
+fncs_finalize();
+delete(config);
+end
+
+function report(name, calls, elapsed)
+fprintf('%-36s%12d%12.3f\n', name, calls, elapsed * 1e6 / calls);
+end
@@ -0,0 +1,47 @@
+#include "mex.h"
+
+#include <fncs.hpp>
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[] )
+{
+    /* Check for proper number of arguments. */
+    if(nrhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_array:nrhs",
+                "This function takes one string.");
+    }
+    if(nlhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_array:nlhs",
+                "This function has one output argument.");
+    }
+
+    /* input must be a string */
+    if (!mxIsChar(prhs[0])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_array:inputNotString",
+                "Input 1 must be a string.");
+    }
+
+    /* copy the string data from prhs into a C string */
+    char *key = mxArrayToString(prhs[0]);
+    if (key == NULL) {
+        mexErrMsgIdAndTxt("MATLAB:fncs:get_array:conversionFailed",
+                "Could not convert input to string.");
+    }
+
+    /* Call the fncs::get_array subroutine, once for the size and once
+     * to copy the values straight into the column vector. */
+    size_t size = fncs::get_array(key, NULL, 0);
+    mxArray *array = mxCreateDoubleMatrix(size, 1, mxREAL);
+    if (array == NULL) {
+        mexErrMsgIdAndTxt("MATLAB:fncs:get_array:mxCreateDoubleMatrix",
+                "Unable to create double matrix.");
+    }
+    fncs::get_array(key, mxGetPr(array), size);
+
+    /* Allocate return value. */
+    plhs[0] = array;
+
+    /* clean up temporary strings */
+    mxFree(key);
+}
+
@@ -0,0 +1,41 @@
+#include "mex.h"
+
+#include <fncs.hpp>
+
+/* value = fncs_get_double(key)
+ *
+ * The value of the key as a double scalar, parsed in C++ once per update
+ * or converted from a typed value, rather than str2double of
+ * fncs_get_value's string in MATLAB. */
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[] )
+{
+    /* Check for proper number of arguments. */
+    if(nrhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_double:nrhs",
+                "This function takes one string.");
+    }
+    if(nlhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_double:nlhs",
+                "This function has one output argument.");
+    }
+
+    /* input must be a string */
+    if (!mxIsChar(prhs[0])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_double:inputNotString",
+                "Input 1 must be a string.");
+    }
+
+    /* copy the string data from prhs into a C string */
+    char *key = mxArrayToString(prhs[0]);
+    if (key == NULL) {
+        mexErrMsgIdAndTxt("MATLAB:fncs:get_double:conversionFailed",
+                "Could not convert input to string.");
+    }
+
+    /* Call the fncs::get_double subroutine. */
+    plhs[0] = mxCreateDoubleScalar(fncs::get_double(key));
+
+    /* clean up temporary strings */
+    mxFree(key);
+}
@@ -0,0 +1,63 @@
+#include "mex.h"
+
+#include <vector>
+
+using namespace std;
+
+#include <fncs.hpp>
+
+/* values = fncs_get_doubles(keys)
+ *
+ * The values of the keys, a cell array of strings, as a column vector of
+ * doubles read with fncs::get_double in one MEX call, rather than
+ * str2double of each value in MATLAB. */
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[] )
+{
+    /* Check for proper number of arguments. */
+    if(nrhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_doubles:nrhs",
+                "This function takes one cell array.");
+    }
+    if(nlhs!=1) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_doubles:nlhs",
+                "This function has one output argument.");
+    }
+
+    /* input must be a cell array */
+    if (!mxIsEmpty(prhs[0]) && !mxIsCell(prhs[0])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:get_doubles:inputNotCell",
+                "Input 1 must be a cell array of keys.");
+    }
+
+    /* look every key up before reading any */
+    mwSize size = mxIsEmpty(prhs[0]) ? 0 : mxGetNumberOfElements(prhs[0]);
+    vector<fncs::Key> keys(size);
+    for (mwIndex i=0; i<size; ++i) {
+        const mxArray *key_array = mxGetCell(prhs[0], i);
+        if (!key_array || !mxIsChar(key_array)) {
+            mexErrMsgIdAndTxt( "MATLAB:fncs:get_doubles:inputNotString",
+                    "Keys must be strings.");
+        }
+        char *key = mxArrayToString(key_array);
+        if (key == NULL) {
+            mexErrMsgIdAndTxt("MATLAB:fncs:get_doubles:conversionFailed",
+                    "Could not convert key to string.");
+        }
+        keys[i] = fncs::lookup_key(key);
+        mxFree(key);
+    }
+
+    mxArray *array = mxCreateDoubleMatrix(size, 1, mxREAL);
+    if (array == NULL) {
+        mexErrMsgIdAndTxt("MATLAB:fncs:get_doubles:mxCreateDoubleMatrix",
+                "Unable to create double matrix.");
+    }
+    double *out = mxGetPr(array);
+    for (mwIndex i=0; i<size; ++i) {
+        out[i] = fncs::get_double(keys[i]);
+    }
+
+    /* Allocate return value. */
+    plhs[0] = array;
+}
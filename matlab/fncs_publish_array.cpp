@@ -0,0 +1,42 @@
+#include "mex.h"
+
+#include <fncs.hpp>
+
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[] )
+{
+    /* Check for proper number of arguments. */
+    if(nrhs!=2) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:publish_array:nrhs",
+                "This function takes a string and a numeric array.");
+    }
+    if(nlhs!=0) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:publish_array:nlhs",
+                "This function does not have output arguments.");
+    }
+
+    /* input 1 must be a string, input 2 a real double matrix */
+    if (!mxIsChar(prhs[0])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:publish_array:inputNotString",
+                "Input 1 must be a string.");
+    }
+    if (!mxIsDouble(prhs[1]) || mxIsComplex(prhs[1])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:publish_array:inputNotDouble",
+                "Input 2 must be a real double array.");
+    }
+
+    /* copy the string data from prhs into a C string */
+    char *key = mxArrayToString(prhs[0]);
+    if (key == NULL) {
+        mexErrMsgIdAndTxt("MATLAB:fncs:publish_array:conversionFailed",
+                "Could not convert input to string.");
+    }
+
+    /* Call the fncs::publish_array subroutine; the matrix is sent in
+     * column major order straight from MATLAB's storage. */
+    fncs::publish_array(key, mxGetPr(prhs[1]), mxGetNumberOfElements(prhs[1]));
+
+    /* clean up temporary strings */
+    mxFree(key);
+}
+
@@ -0,0 +1,152 @@
+#include "mex.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include <fncs.hpp>
+#include "to_fncs_time.hpp"
+
+/* MATLAB field names are letters, digits and underscores, starting with
+ * a letter, and at most 63 characters long */
+static string to_field_name(const string &key)
+{
+    string name;
+    for (size_t i=0; i<key.size(); ++i) {
+        char c = key[i];
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || c == '_';
+        if (name.empty() && !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+            name += 'x';
+        }
+        name += valid ? c : '_';
+    }
+    if (name.empty()) {
+        name = "x";
+    }
+    return name.substr(0, 63);
+}
+
+/* [time, values, numbers] = fncs_step(time, publishes, keys)
+ *
+ * One MEX transition per time step. publishes is an N-by-2 cell array of
+ * keys and values; a string value is published as is, a real double
+ * scalar with fncs::publish_double and any other real double array with
+ * fncs::publish_array. The time request follows, then the keys, a cell
+ * array of strings, are read: values is a struct with one field per key,
+ * named after the key with invalid characters replaced by '_', holding
+ * its string value, and the optional numbers a column vector of the
+ * values read with fncs::get_double. The keys must not be lists. */
+void mexFunction( int nlhs, mxArray *plhs[],
+        int nrhs, const mxArray *prhs[] )
+{
+    fncs::time time_requested;
+    fncs::time time_response;
+
+    /* Check for proper number of arguments. */
+    if(nrhs!=3) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:step:nrhs",
+                "This function takes a time and two cell arrays.");
+    }
+    if(nlhs>3) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:step:nlhs",
+                "This function has at most three output arguments.");
+    }
+
+    /* Convert input arguments. */
+    to_fncs_time(time_requested, prhs[0]);
+    if (!mxIsEmpty(prhs[1])
+            && (!mxIsCell(prhs[1]) || mxGetN(prhs[1]) != 2)) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:step:inputNotCell",
+                "Input 2 must be an N-by-2 cell array of keys and values.");
+    }
+    if (!mxIsEmpty(prhs[2]) && !mxIsCell(prhs[2])) {
+        mexErrMsgIdAndTxt( "MATLAB:fncs:step:inputNotCell",
+                "Input 3 must be a cell array of keys.");
+    }
+
+    /* Publish the values of the step that ends. */
+    mwSize n_publishes = mxIsEmpty(prhs[1]) ? 0 : mxGetM(prhs[1]);
+    for (mwIndex i=0; i<n_publishes; ++i) {
+        const mxArray *key_array = mxGetCell(prhs[1], i);
+        const mxArray *value_array = mxGetCell(prhs[1], i + n_publishes);
+        if (!key_array || !mxIsChar(key_array)) {
+            mexErrMsgIdAndTxt( "MATLAB:fncs:step:inputNotString",
+                    "Publish keys must be strings.");
+        }
+        char *key = mxArrayToString(key_array);
+        if (value_array && mxIsChar(value_array)) {
+            char *val = mxArrayToString(value_array);
+            fncs::publish(key, val);
+            mxFree(val);
+        }
+        else if (value_array && mxIsDouble(value_array) && !mxIsComplex(value_array)) {
+            if (mxGetNumberOfElements(value_array) == 1) {
+                fncs::publish_double(key, mxGetScalar(value_array));
+            }
+            else {
+                fncs::publish_array(key, mxGetPr(value_array),
+                        mxGetNumberOfElements(value_array));
+            }
+        }
+        else {
+            mxFree(key);
+            mexErrMsgIdAndTxt( "MATLAB:fncs:step:inputNotValue",
+                    "Publish values must be strings or real doubles.");
+        }
+        mxFree(key);
+    }
+
+    /* Call the fncs::time_request subroutine. */
+    time_response = fncs::time_request(time_requested);
+
+    /* Allocate return values. */
+    plhs[0] = mxCreateNumericMatrix(1, 1, mxUINT64_CLASS, mxREAL);
+    uint64_t * data = (uint64_t *) mxGetData(plhs[0]);
+    data[0] = time_response;
+
+    mwSize n_keys = mxIsEmpty(prhs[2]) ? 0 : mxGetNumberOfElements(prhs[2]);
+    mxArray *values = mxCreateStructMatrix(1, 1, 0, NULL);
+    mxArray *numbers = mxCreateDoubleMatrix(n_keys, 1, mxREAL);
+    double *number = mxGetPr(numbers);
+    for (mwIndex i=0; i<n_keys; ++i) {
+        const mxArray *key_array = mxGetCell(prhs[2], i);
+        if (!key_array || !mxIsChar(key_array)) {
+            mexErrMsgIdAndTxt( "MATLAB:fncs:step:inputNotString",
+                    "Keys to read must be strings.");
+        }
+        char *key = mxArrayToString(key_array);
+        fncs::Key handle = fncs::lookup_key(key);
+        if (nlhs > 1) {
+            string name = to_field_name(key);
+            if (mxGetFieldNumber(values, name.c_str()) >= 0) {
+                mxFree(key);
+                mexErrMsgIdAndTxt( "MATLAB:fncs:step:duplicateField",
+                        "Two keys map to the same field name.");
+            }
+            int field = mxAddField(values, name.c_str());
+            mxSetFieldByNumber(values, 0, field,
+                    mxCreateString(fncs::get_value(handle).c_str()));
+        }
+        if (nlhs > 2) {
+            number[i] = fncs::get_double(handle);
+        }
+        mxFree(key);
+    }
+
+    if (nlhs > 1) {
+        plhs[1] = values;
+    }
+    else {
+        mxDestroyArray(values);
+    }
+    if (nlhs > 2) {
+        plhs[2] = numbers;
+    }
+    else {
+        mxDestroyArray(numbers);
+    }
+}
+
@@ -0,0 +1,171 @@
+#!/usr/bin/python
+"""Times the fncs Python bindings per call, next to fncs_microbench's
+C++ and C API numbers.
+
+Starts a broker for one sim that subscribes to the keys it publishes, so
+each time request brings back a value of every key. Prints nanoseconds
+per call and, where tracemalloc exists (Python 3), the most bytes one
+call held in Python objects at once; the library's own allocations are
+fncs_microbench's.
+
+Usage: python bench.py [--broker fncs_broker] [--calls 100000]
+"""
+from __future__ import print_function
+
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+try:
+    import tracemalloc
+except ImportError:
+    tracemalloc = None
+
+import fncs
+
+N_KEYS = 100
+ENDPOINT = "tcp://127.0.0.1:5598"
+
+if hasattr(time, "perf_counter"):
+    clock = time.perf_counter
+else:
+    clock = time.time
+
+
+def config():
+    lines = ["name = pybench", "time_delta = 1ns", "broker = " + ENDPOINT, "values"]
+    for k in range(N_KEYS):
+        lines.append("    t%d" % k)
+        lines.append("        topic = pybench/k%d" % k)
+        lines.append("        default = 0")
+    return "\n".join(lines) + "\n"
+
+
+def measure(name, calls, body):
+    """Runs body(calls) and prints the cost of one of its calls."""
+    start = clock()
+    body(calls)
+    elapsed = clock() - start
+    allocated = "-"
+    if tracemalloc:
+        # one more call, traced: the most it held at once
+        tracemalloc.start()
+        before = tracemalloc.get_traced_memory()[1]
+        body(1)
+        peak = tracemalloc.get_traced_memory()[1]
+        tracemalloc.stop()
+        allocated = "%d" % (peak - before)
+    print("%-36s%12d%12.1f%12s" % (name, calls, elapsed * 1e9 / calls, allocated))
+
+
+def publish_all():
+    for k in range(N_KEYS):
+        fncs.publish(b"k%d" % k, b"1.25")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="time the fncs Python bindings")
+    parser.add_argument("--broker", default="fncs_broker")
+    parser.add_argument("--calls", type=int, default=100000)
+    args = parser.parse_args()
+    n = args.calls
+    if n < 1000:
+        parser.error("--calls must be at least 1000")
+
+    env = dict(os.environ)
+    env["FNCS_BROKER"] = ENDPOINT
+    broker = subprocess.Popen([args.broker, "1"], env=env)
+
+    fncs.initialize(config().encode())
+    if not fncs.is_initialized():
+        broker.kill()
+        sys.exit("could not connect to the broker")
+    granted = 0
+
+    print("%-36s%12s%12s%12s" % ("# benchmark", "calls", "ns/call", "peak bytes"))
+
+    keys = [b"k%d" % k for k in range(N_KEYS)]
+    names = [b"t%d" % k for k in range(N_KEYS)]
+    values = [b"1.25"] * N_KEYS
+
+    def publish(calls):
+        for i in range(calls):
+            fncs.publish(b"k0", b"1.25")
+    measure("publish", n, publish)
+    granted = fncs.time_request(granted + 1)
+
+    def publish_many(calls):
+        for i in range(max(calls // N_KEYS, 1)):
+            fncs.publish_many(keys, values)
+    measure("publish_many, per value", n // N_KEYS * N_KEYS, publish_many)
+    granted = fncs.time_request(granted + 1)
+
+    # every key now has a value from the last step
+    publish_all()
+    granted = fncs.time_request(granted + 1)
+
+    def get_value(calls):
+        for i in range(calls):
+            fncs.get_value(b"t7")
+    measure("get_value", n, get_value)
+
+    def get_many(calls):
+        for i in range(max(calls // N_KEYS, 1)):
+            fncs.get_many(names)
+    measure("get_many, per value", n // N_KEYS * N_KEYS, get_many)
+
+    def get_many_numeric(calls):
+        for i in range(max(calls // N_KEYS, 1)):
+            fncs.get_many(names, True)
+    measure("get_many numeric, per value", n // N_KEYS * N_KEYS, get_many_numeric)
+
+    handles = [fncs.lookup_key(name) for name in names]
+
+    def get_doubles(calls):
+        for i in range(max(calls // N_KEYS, 1)):
+            fncs.get_doubles(handles)
+    measure("get_doubles, per value", n // N_KEYS * N_KEYS, get_doubles)
+
+    def get_values(calls):
+        for i in range(calls):
+            fncs.get_values(b"t7")
+    measure("get_values", n, get_values)
+
+    rounds = n // 100
+
+    def get_events(calls):
+        for i in range(calls):
+            fncs.get_events()
+    measure("get_events, 100 keys", rounds, get_events)
+
+    def get_updates(calls):
+        for i in range(calls):
+            fncs.get_updates()
+    measure("get_updates, 100 keys", rounds, get_updates)
+
+    def changed_keys(calls):
+        for i in range(calls):
+            fncs.changed_keys()
+    measure("changed_keys, 100 keys", rounds, changed_keys)
+
+    def snapshot(calls):
+        for i in range(calls):
+            fncs.snapshot(True)
+    measure("snapshot changed, 100 keys", rounds, snapshot)
+
+    clock_time = [granted]
+
+    def round_trip(calls):
+        for i in range(calls):
+            publish_all()
+            clock_time[0] = fncs.time_request(clock_time[0] + 1)
+    measure("time_request, 100 values", rounds // 10, round_trip)
+
+    fncs.finalize()
+    broker.wait()
+
+
+if __name__ == "__main__":
+    main()
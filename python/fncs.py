@@ -1,3 +1,4 @@
+import array
 import ctypes
 import platform
 
@@ -31,10 +32,32 @@ _is_initialized.restype = ctypes.c_int
 def is_initialized():
     return 1 == _is_initialized()
 
+# ctypes releases the GIL for the duration of each call, so other
+# Python threads run during the synchronization wait
 time_request = _lib.fncs_time_request
 time_request.argtypes = [ctypes.c_ulonglong]
 time_request.restype = ctypes.c_ulonglong
 
+time_request_async = _lib.fncs_time_request_async
+time_request_async.argtypes = [ctypes.c_ulonglong]
+time_request_async.restype = None
+
+_time_request_poll = _lib.fncs_time_request_poll
+_time_request_poll.argtypes = []
+_time_request_poll.restype = ctypes.c_int
+
+def time_request_poll():
+    return 1 == _time_request_poll()
+
+time_request_wait = _lib.fncs_time_request_wait
+time_request_wait.argtypes = []
+time_request_wait.restype = ctypes.c_ulonglong
+
+# edge triggered; see fncs_asyncio for how to wait on it
+get_fd = _lib.fncs_get_fd
+get_fd.argtypes = []
+get_fd.restype = ctypes.c_int
+
 _publish = _lib.fncs_publish
 _publish.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
 _publish.restype = None
@@ -49,6 +72,31 @@ _publish_anon.restype = None
 def publish_anon(key, value):
     _publish_anon(str(key), str(value))
 
+_publish_at = _lib.fncs_publish_at
+_publish_at.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_ulonglong]
+_publish_at.restype = None
+
+def publish_at(key, value, delivery):
+    _publish_at(str(key), str(value), delivery)
+
+_publish_array = _lib.fncs_publish_array
+_publish_array.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_double), ctypes.c_size_t]
+_publish_array.restype = None
+
+def _double_buffer(values):
+    # buffers of doubles, e.g. array.array('d') or float64 numpy arrays,
+    # are passed without copying; other sequences are converted
+    size = len(values)
+    try:
+        if memoryview(values).format == 'd':
+            return (ctypes.c_double * size).from_buffer(values)
+    except (TypeError, ValueError):
+        pass
+    return (ctypes.c_double * size)(*values)
+
+def publish_array(key, values):
+    _publish_array(str(key), _double_buffer(values), len(values))
+
 route = _lib.fncs_route
 route.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
 route.restype = None
@@ -99,6 +147,123 @@ def get_value(key):
     _lib._fncs_free_char_p(cast)
     return string
 
+_get_array = _lib.fncs_get_array
+_get_array.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_double), ctypes.c_size_t]
+_get_array.restype = ctypes.c_size_t
+
+def get_array(key):
+    # an array.array('d'); numpy.frombuffer() wraps it without copying
+    size = _get_array(key, None, 0)
+    values = array.array('d', [0.0]) * size
+    if size:
+        _get_array(key, (ctypes.c_double * size).from_buffer(values), size)
+    return values
+
+lookup_key = _lib.fncs_lookup_key
+lookup_key.argtypes = [ctypes.c_char_p]
+lookup_key.restype = ctypes.c_size_t
+
+_changed_keys = _lib.fncs_changed_keys
+_changed_keys.argtypes = [ctypes.POINTER(ctypes.c_size_t)]
+_changed_keys.restype = ctypes.c_void_p
+
+def changed_keys():
+    # the handles updated by the last time_request, each once and
+    # ascending, as a memoryview valid until the next time_request
+    size = ctypes.c_size_t(0)
+    data = _changed_keys(ctypes.byref(size))
+    if not size.value:
+        return memoryview((ctypes.c_size_t * 0)())
+    return memoryview((ctypes.c_size_t * size.value).from_address(data))
+
+version = _lib.fncs_version_by_key
+version.argtypes = [ctypes.c_size_t]
+version.restype = ctypes.c_ulonglong
+
+_update_callback = ctypes.CFUNCTYPE(None, ctypes.c_size_t, ctypes.c_void_p)
+
+# the ctypes wrappers of the callbacks, kept alive for as long as fncs
+# may call them
+_listeners = []
+
+_on_update = _lib.fncs_on_update
+_on_update.argtypes = [ctypes.c_char_p, _update_callback, ctypes.c_void_p]
+_on_update.restype = None
+
+def on_update(key, callback):
+    # callback(key) runs inside time_request() for each grant that
+    # updated the key
+    wrapper = _update_callback(lambda handle, data: callback(handle))
+    _listeners.append(wrapper)
+    _on_update(key, wrapper, None)
+
+_on_any_update = _lib.fncs_on_any_update
+_on_any_update.argtypes = [_update_callback, ctypes.c_void_p]
+_on_any_update.restype = None
+
+def on_any_update(callback):
+    wrapper = _update_callback(lambda handle, data: callback(handle))
+    _listeners.append(wrapper)
+    _on_any_update(wrapper, None)
+
+_get_doubles_by_key = _lib.fncs_get_doubles_by_key
+_get_doubles_by_key.argtypes = [ctypes.POINTER(ctypes.c_size_t), ctypes.POINTER(ctypes.c_double), ctypes.c_size_t]
+_get_doubles_by_key.restype = None
+
+def get_doubles(keys):
+    # the values of the handles from lookup_key(), as an array.array('d')
+    size = len(keys)
+    handles = (ctypes.c_size_t * size)(*keys)
+    values = array.array('d', [0.0]) * size
+    if size:
+        _get_doubles_by_key(handles, (ctypes.c_double * size).from_buffer(values), size)
+    return values
+
+_peek_array_by_key = _lib.fncs_peek_array_by_key
+_peek_array_by_key.argtypes = [ctypes.c_size_t, ctypes.POINTER(ctypes.c_size_t)]
+_peek_array_by_key.restype = ctypes.POINTER(ctypes.c_double)
+
+def get_array_view(key):
+    # a memoryview over the cache itself, valid until the next
+    # time_request; numpy.frombuffer() wraps it without copying
+    size = ctypes.c_size_t(0)
+    data = _peek_array_by_key(key, ctypes.byref(size))
+    if not size.value:
+        return memoryview(array.array('d'))
+    return memoryview((ctypes.c_double * size.value).from_address(ctypes.addressof(data.contents)))
+
+_snapshot = _lib.fncs_snapshot
+_snapshot.argtypes = [ctypes.c_int]
+_snapshot.restype = ctypes.c_size_t
+
+_snapshot_keys = _lib.fncs_snapshot_keys
+_snapshot_keys.argtypes = []
+_snapshot_keys.restype = ctypes.c_void_p
+
+_snapshot_offsets = _lib.fncs_snapshot_offsets
+_snapshot_offsets.argtypes = []
+_snapshot_offsets.restype = ctypes.c_void_p
+
+_snapshot_values = _lib.fncs_snapshot_values
+_snapshot_values.argtypes = []
+_snapshot_values.restype = ctypes.c_void_p
+
+def snapshot(changed_only=False):
+    # the keys, value offsets and values of every subscribed key, or of
+    # the changed ones, as memoryviews over one buffer reused from call
+    # to call and valid until the next; value i is
+    # values[offsets[i]:offsets[i+1]]
+    size = _snapshot(1 if changed_only else 0)
+    offsets = memoryview((ctypes.c_size_t * (size + 1)).from_address(_snapshot_offsets()))
+    if not size:
+        return offsets[:0], offsets, memoryview(b'')
+    keys = memoryview((ctypes.c_size_t * size).from_address(_snapshot_keys()))
+    n_bytes = offsets[size]
+    if not n_bytes:
+        return keys, offsets, memoryview(b'')
+    values = memoryview((ctypes.c_ubyte * n_bytes).from_address(_snapshot_values()))
+    return keys, offsets, values
+
 get_values_size = _lib.fncs_get_values_size
 get_values_size.argtypes = [ctypes.c_char_p]
 get_values_size.restype = ctypes.c_size_t
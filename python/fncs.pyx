@@ -3,6 +3,9 @@
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.utility cimport pair
+from cpython cimport array
+
+import array
 
 cimport fncshpp as fncs
 
@@ -16,11 +19,77 @@ def is_initialized():
     return fncs.is_initialized()
 
 def time_request(fncs.time next):
-    return fncs.time_request(next)
+    cdef fncs.time granted
+    # other Python threads run during the wait; only one may call fncs
+    with nogil:
+        granted = fncs.time_request(next)
+    return granted
+
+def time_request_async(fncs.time next):
+    with nogil:
+        fncs.time_request_async(next)
+
+def time_request_poll():
+    cdef bint ready
+    with nogil:
+        ready = fncs.time_request_poll()
+    return ready
+
+def time_request_wait():
+    cdef fncs.time granted
+    with nogil:
+        granted = fncs.time_request_wait()
+    return granted
+
+def get_fd():
+    # edge triggered; see fncs_asyncio for how to wait on it
+    return fncs.get_fd()
 
 def publish(const string &key, const string &value):
     fncs.publish(key, value)
 
+def publish_bytes(const string &key, const unsigned char[::1] value):
+    # sent as is, NUL bytes included; get_value() returns them exactly
+    cdef size_t n = value.shape[0]
+    fncs.publish(key, &value[0] if n else NULL, n)
+
+def publish_array(const string &key, const double[::1] values):
+    cdef size_t n = values.shape[0]
+    fncs.publish_array(key, &values[0] if n else NULL, n)
+
+def publish_many(keys, values):
+    # one call for a step's worth of values, published without the GIL;
+    # values are strings, or numbers in a buffer such as a numpy array,
+    # published as publish_double() does
+    cdef vector[string] c_keys = keys
+    cdef vector[string] c_values
+    cdef const double[::1] doubles
+    cdef size_t n = c_keys.size()
+    cdef size_t i
+    try:
+        doubles = values
+    except ValueError:
+        # a buffer of another type, or strided
+        doubles = array.array('d', values)
+    except TypeError:
+        doubles = None
+    if doubles is None:
+        c_values = values
+        if c_values.size() != n:
+            raise ValueError("publish_many() needs as many values as keys")
+        with nogil:
+            for i in range(n):
+                fncs.publish(c_keys[i], c_values[i])
+    else:
+        if <size_t>doubles.shape[0] != n:
+            raise ValueError("publish_many() needs as many values as keys")
+        with nogil:
+            for i in range(n):
+                fncs.publish_double(c_keys[i], doubles[i])
+
+def publish_at(const string &key, const string &value, fncs.time delivery):
+    fncs.publish_at(key, value, delivery)
+
 def route(const string &from_, const string &to, const string &key, const string &value):
     fncs.route(from_, to, key, value)
 
@@ -28,7 +97,12 @@ def die():
     fncs.die()
 
 def finalize():
-    fncs.finalize()
+    with nogil:
+        fncs.finalize()
+
+def finalize_detached():
+    with nogil:
+        fncs.finalize_detached()
 
 def update_time_delta(fncs.time delta):
     fncs.update_time_delta(delta)
@@ -39,9 +113,120 @@ def get_events():
 def get_value(const string &key):
     return fncs.get_value(key)
 
+def get_many(keys, bint numeric=False):
+    # the values of the keys in one call, as a list, or as an
+    # array.array('d') if numeric; numpy.frombuffer() wraps it
+    cdef vector[string] c_keys = keys
+    cdef vector[string] c_values
+    cdef size_t n = c_keys.size()
+    cdef size_t i
+    cdef array.array doubles
+    cdef double *out
+    if numeric:
+        doubles = array.clone(array.array('d'), n, zero=False)
+        out = doubles.data.as_doubles
+        with nogil:
+            for i in range(n):
+                out[i] = fncs.get_double(c_keys[i])
+        return doubles
+    c_values.resize(n)
+    with nogil:
+        for i in range(n):
+            c_values[i] = fncs.get_value(c_keys[i])
+    return c_values
+
+def get_updates():
+    # the keys the last time_request updated and their values, as a dict
+    cdef vector[string] keys
+    cdef vector[string] c_values
+    cdef size_t i
+    with nogil:
+        keys = fncs.get_events()
+        c_values.resize(keys.size())
+        for i in range(keys.size()):
+            c_values[i] = fncs.get_value(keys[i])
+    return dict(zip(keys, c_values))
+
 def get_values(const string &key):
     return fncs.get_values(key)
 
+def get_array(const string &key):
+    # an array.array('d'); numpy.frombuffer() wraps it without copying
+    cdef size_t n = fncs.get_array(key, NULL, 0)
+    cdef array.array values = array.clone(array.array('d'), n, zero=False)
+    if n:
+        fncs.get_array(key, values.data.as_doubles, n)
+    return values
+
+def lookup_key(const string &key):
+    return fncs.lookup_key(key)
+
+def changed_keys():
+    # the handles updated by the last time_request, each once and
+    # ascending, as a memoryview valid until the next time_request
+    cdef const vector[fncs.Key] *keys = &fncs.changed_keys()
+    if keys.empty():
+        return memoryview(array.array('Q'))
+    return memoryview(<size_t[:keys.size()]> <size_t*> keys.data())
+
+def version(fncs.Key key):
+    return fncs.version(key)
+
+# the registered callables, kept alive for as long as fncs may call them
+_listeners = []
+
+cdef void _notify(fncs.Key key, void *data) with gil:
+    (<object>data)(key)
+
+def on_update(const string &key, callback):
+    # callback(key) runs inside time_request() for each grant that
+    # updated the key
+    _listeners.append(callback)
+    fncs.on_update(key, _notify, <void*>callback)
+
+def on_any_update(callback):
+    _listeners.append(callback)
+    fncs.on_any_update(_notify, <void*>callback)
+
+def get_doubles(keys):
+    # the values of the handles from lookup_key(), as an array.array('d')
+    cdef Py_ssize_t n = len(keys)
+    cdef Py_ssize_t i
+    cdef array.array values = array.clone(array.array('d'), n, zero=False)
+    for i in range(n):
+        values.data.as_doubles[i] = fncs.get_double(<fncs.Key>keys[i])
+    return values
+
+def get_array_view(fncs.Key key):
+    # a memoryview over the cache itself, valid until the next
+    # time_request; numpy.asarray() wraps it without copying
+    cdef vector[double] *values = &fncs.get_array(key)
+    cdef double[::1] view
+    if values.empty():
+        return memoryview(array.array('d'))
+    view = <double[:values.size()]> values.data()
+    return view
+
+cdef fncs.Snapshot _snapshot
+
+def snapshot(bint changed_only=False):
+    # the keys, value offsets and values of every subscribed key, or of
+    # the changed ones, as memoryviews over one buffer reused from call
+    # to call and valid until the next; value i is
+    # values[offsets[i]:offsets[i+1]]
+    cdef size_t n_keys
+    cdef size_t n_bytes
+    fncs.snapshot(_snapshot, changed_only)
+    n_keys = _snapshot.keys.size()
+    n_bytes = _snapshot.values.size()
+    offsets = memoryview(<size_t[:n_keys + 1]> _snapshot.offsets.data())
+    keys = memoryview(<size_t[:n_keys]> _snapshot.keys.data()) if n_keys else offsets[:0]
+    if n_bytes:
+        values = memoryview(<unsigned char[:n_bytes]> <unsigned char*> _snapshot.values.data())
+    else:
+        values = memoryview(b'')
+    return keys, offsets, values
+
 def get_name():
     return fncs.get_name()
 
@@ -0,0 +1,34 @@
+"""asyncio support for the fncs module, Python 3 only.
+
+    import fncs_asyncio
+    granted = await fncs_asyncio.time_request(next)
+
+Other coroutines on the event loop keep running while the broker works
+on the grant. fncs is not thread safe; call it from the loop's thread.
+On Windows this needs a selector based event loop.
+"""
+
+import asyncio
+
+import fncs
+
+async def time_request(time_next):
+    fncs.time_request_async(time_next)
+    if not fncs.time_request_poll():
+        loop = asyncio.get_event_loop()
+        granted = loop.create_future()
+        fd = fncs.get_fd()
+
+        def on_readable():
+            # the zmq fd is edge triggered; polling drains every message
+            if not granted.done() and fncs.time_request_poll():
+                granted.set_result(None)
+
+        loop.add_reader(fd, on_readable)
+        try:
+            # messages that arrived before the reader was added left no edge
+            on_readable()
+            await granted
+        finally:
+            loop.remove_reader(fd)
+    return fncs.time_request_wait()
@@ -8,30 +8,79 @@ cdef extern from "fncs.hpp" namespace "fncs":
 
     ctypedef unsigned long long time
 
+    ctypedef size_t Key
+
     void initialize()
 
     void initialize(const string &configuration)
 
     bint is_initialized()
 
-    time time_request(time next)
+    # the synchronization waits run without the GIL
+    time time_request(time next) nogil
+
+    void time_request_async(time next) nogil
+
+    bint time_request_poll() nogil
+
+    time time_request_wait() nogil
+
+    int get_fd()
+
+    # so are the bulk loops of publish_many(), get_many() and get_updates()
+    void publish(const string &key, const string &value) nogil
 
-    void publish(const string &key, const string &value)
+    void publish(const string &key, const void *data, size_t size)
+
+    void publish_array(const string &key, const double *values, size_t n)
+
+    void publish_double(const string &key, double value) nogil
+
+    void publish_at(const string &key, const string &value, time delivery)
 
     void route(const string &from_, const string &to, const string &key, const string &value)
 
     void die()
 
-    void finalize()
+    void finalize() nogil
+
+    void finalize_detached() nogil
 
     void update_time_delta(time delta)
 
-    vector[string] get_events()
+    vector[string] get_events() nogil
 
-    string get_value(const string &key)
+    string get_value(const string &key) nogil
 
     vector[string] get_values(const string &key)
 
+    size_t get_array(const string &key, double *out, size_t n)
+
+    vector[double]& get_array(Key key)
+
+    Key lookup_key(const string &key)
+
+    const vector[Key]& changed_keys()
+
+    unsigned long long version(Key key)
+
+    ctypedef void (*UpdateCallback)(Key key, void *data)
+
+    void on_update(const string &key, UpdateCallback callback, void *data)
+
+    void on_any_update(UpdateCallback callback, void *data)
+
+    double get_double(Key key)
+
+    double get_double(const string &key) nogil
+
+    cdef cppclass Snapshot:
+        vector[Key] keys
+        vector[size_t] offsets
+        vector[char] values
+
+    void snapshot(Snapshot &out, bint changed_only)
+
     string get_name()
 
     time get_time_delta()
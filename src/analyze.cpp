@@ -0,0 +1,329 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* 3rd party headers */
+#include "czmq.h"
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "trace_writer.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_analyze [--top <n>] <FNCS_RECORD file> [output file]";
+
+
+/* one subscription of a sim, as its HELLO told the broker */
+class Subscriber {
+    public:
+        Subscriber() : sim(), topic(), list(false), time_delta(0), n_published(0) {}
+
+        string sim;
+        string topic; /* or pattern */
+        bool list; /* sees every value, not the last of a step */
+        fncs::time time_delta;
+        unsigned long long n_published; /* values of topics it matches */
+};
+
+/* what one subscriber of a topic saw of it */
+class Observer {
+    public:
+        Observer() : subscriber(0), last_step(0), n_steps(0) {}
+
+        size_t subscriber;
+        fncs::time last_step; /* of the last value, + 1 */
+        unsigned long long n_steps; /* steps in which a value arrived */
+};
+
+/* the publishes of one topic */
+class Topic {
+    public:
+        Topic() : n_published(0), bytes(0), publishers(), observers() {}
+
+        unsigned long long n_published;
+        unsigned long long bytes;
+        set<string> publishers;
+        vector<Observer> observers;
+
+        /* values at least one subscriber could tell apart */
+        unsigned long long n_observable(const vector<Subscriber> &subscribers) const {
+            unsigned long long most = 0;
+            for (size_t i=0; i<observers.size(); ++i) {
+                const Subscriber &subscriber = subscribers[observers[i].subscriber];
+                unsigned long long seen = subscriber.list || !subscriber.time_delta ?
+                    n_published : observers[i].n_steps;
+                most = max(most, seen);
+            }
+            return most;
+        }
+};
+
+typedef map<string,Topic> TopicMap;
+typedef pair<unsigned long long, string> Ranked; /* bytes, topic */
+
+
+static bool matches(const Subscriber &subscriber, const string &topic)
+{
+    return subscriber.topic == topic || (fncs::is_topic_pattern(subscriber.topic)
+            && fncs::glob_match(subscriber.topic, topic));
+}
+
+/* a new subscriber also observes the topics already published */
+static void subscribe(vector<Subscriber> &subscribers, TopicMap &topics,
+        const Subscriber &subscriber)
+{
+    size_t index = subscribers.size();
+    subscribers.push_back(subscriber);
+    for (TopicMap::iterator it=topics.begin(); it!=topics.end(); ++it) {
+        if (matches(subscriber, it->first)) {
+            Observer observer;
+            observer.subscriber = index;
+            it->second.observers.push_back(observer);
+        }
+    }
+}
+
+/* Registers the subscriptions of the HELLO in msg, taken from its config
+ * or from its manifest. */
+static void hello(zmsg_t *msg, vector<Subscriber> &subscribers, TopicMap &topics)
+{
+    zframe_t *frame = zmsg_first(msg);
+    string sim = fncs::to_string(frame);
+    frame = zmsg_next(msg); /* type */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        return;
+    }
+    fncs::Config config = fncs::parse_config(fncs::to_string(frame));
+    fncs::time time_delta = config.time_delta.empty() ?
+        fncs::parse_time("1s") : fncs::parse_time(config.time_delta);
+    vector<pair<string,bool> > entries;
+
+    for (size_t i=0; i<config.values.size(); ++i) {
+        entries.push_back(make_pair(config.values[i].topic, config.values[i].is_list()));
+    }
+    /* version, protocol, then perhaps the manifest */
+    for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+        if (zframe_streq(frame, fncs::MANIFEST)) {
+            frame = zmsg_next(msg);
+            if (frame) {
+                fncs::parse_manifest(zframe_data(frame), zframe_size(frame), entries);
+            }
+            break;
+        }
+    }
+
+    for (size_t i=0; i<entries.size(); ++i) {
+        Subscriber subscriber;
+        subscriber.sim = sim;
+        subscriber.topic = entries[i].first;
+        subscriber.list = entries[i].second;
+        subscriber.time_delta = time_delta;
+        subscribe(subscribers, topics, subscriber);
+    }
+}
+
+/* Counts one value of the topic, published in the round of the given
+ * time; a subscriber that keeps the last value sees one per step. */
+static void publish(const string &sim, const string &topic, size_t size, fncs::time time,
+        vector<Subscriber> &subscribers, TopicMap &topics)
+{
+    TopicMap::iterator it = topics.find(topic);
+    if (it == topics.end()) {
+        it = topics.insert(make_pair(topic, Topic())).first;
+        for (size_t i=0; i<subscribers.size(); ++i) {
+            if (matches(subscribers[i], topic)) {
+                Observer observer;
+                observer.subscriber = i;
+                it->second.observers.push_back(observer);
+            }
+        }
+    }
+    Topic &published = it->second;
+    ++published.n_published;
+    published.bytes += size;
+    published.publishers.insert(sim);
+    for (size_t i=0; i<published.observers.size(); ++i) {
+        Observer &observer = published.observers[i];
+        Subscriber &subscriber = subscribers[observer.subscriber];
+        fncs::time step = subscriber.time_delta ?
+            (time + subscriber.time_delta - 1) / subscriber.time_delta + 1 : time + 1;
+        if (step != observer.last_step) {
+            observer.last_step = step;
+            ++observer.n_steps;
+        }
+        ++subscriber.n_published;
+    }
+}
+
+static string publishers_of(const Topic &topic)
+{
+    string names;
+    for (set<string>::const_iterator it=topic.publishers.begin();
+            it!=topic.publishers.end(); ++it) {
+        names += (names.empty() ? "" : ",") + *it;
+    }
+    return names;
+}
+
+
+/* Reads the messages a broker recorded with FNCS_RECORD: the HELLOs tell
+ * who subscribes to what at which time delta, the PUBLISHes what was
+ * sent, and reports the message volume that could be saved, largest
+ * first: values nobody subscribes to, subscriptions nothing publishes,
+ * and values published more often than any subscriber's time delta lets
+ * it tell apart. */
+int main(int argc, char **argv)
+{
+    size_t top = 20;
+    vector<string> params;
+    fncs::TraceReader reader;
+    fncs::TraceRecord record;
+    ofstream fout;
+    ostream out(cout.rdbuf()); /* share cout's stream buffer */
+    vector<Subscriber> subscribers;
+    TopicMap topics;
+    unsigned long long n_messages = 0;
+    unsigned long long n_by_id = 0; /* topics sent by ID, not resolved */
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--top") && i+1 < argc) {
+            top = strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            params.push_back(argv[i]);
+        }
+    }
+
+    if (params.empty() || params.size() > 2) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!reader.open(params[0])) {
+        cerr << "'" << params[0] << "' is not a FNCS binary trace." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (params.size() == 2) {
+        fout.open(params[1].c_str());
+        if (!fout) {
+            cerr << "Could not open output file '" << params[1] << "'." << endl;
+            exit(EXIT_FAILURE);
+        }
+        out.rdbuf(fout.rdbuf()); /* redirect out to use file buffer */
+    }
+
+    while (reader.next(record)) {
+        if (fncs::TRACE_MESSAGE != record.type || record.frames.size() < 2) {
+            continue;
+        }
+        ++n_messages;
+        zmsg_t *msg = zmsg_new();
+        for (size_t i=0; i<record.frames.size(); ++i) {
+            zmsg_addmem(msg, record.frames[i].data(), record.frames[i].size());
+        }
+        zframe_t *frame = zmsg_first(msg);
+        const string &sim = record.frames[0];
+        frame = zmsg_next(msg);
+        fncs::MessageType type = fncs::to_type(frame);
+        size_t id = 0;
+
+        if (fncs::MSG_HELLO == type) {
+            hello(msg, subscribers, topics);
+        }
+        else if (fncs::MSG_PUBLISH == type || fncs::MSG_PUBLISH_BATCH == type) {
+            /* topic and value pairs */
+            for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                zframe_t *value = zmsg_next(msg);
+                if (!value) {
+                    break;
+                }
+                if (fncs::decode_topic_id(zframe_data(frame), zframe_size(frame), id)) {
+                    ++n_by_id;
+                    continue;
+                }
+                publish(sim, fncs::to_string(frame), zframe_size(value), record.time,
+                        subscribers, topics);
+                if (fncs::MSG_PUBLISH == type) {
+                    break;
+                }
+            }
+        }
+        zmsg_destroy(&msg);
+    }
+    if (reader.corrupt()) {
+        cerr << "truncated or corrupt record after "
+            << n_messages << " messages" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (n_by_id) {
+        cerr << n_by_id << " values were sent by topic ID and are not counted;"
+            << " record with a broker of this release" << endl;
+    }
+
+    vector<Ranked> unread;
+    vector<Ranked> oversampled;
+    unsigned long long bytes_unread = 0;
+    unsigned long long bytes_oversampled = 0;
+    for (TopicMap::iterator it=topics.begin(); it!=topics.end(); ++it) {
+        const Topic &topic = it->second;
+        if (topic.observers.empty()) {
+            unread.push_back(make_pair(topic.bytes, it->first));
+            bytes_unread += topic.bytes;
+            continue;
+        }
+        unsigned long long observable = topic.n_observable(subscribers);
+        if (observable < topic.n_published) {
+            unsigned long long excess = (topic.n_published - observable)
+                * (topic.bytes / topic.n_published);
+            oversampled.push_back(make_pair(excess, it->first));
+            bytes_oversampled += excess;
+        }
+    }
+    sort(unread.rbegin(), unread.rend());
+    sort(oversampled.rbegin(), oversampled.rend());
+
+    out << "# published, subscribed by nobody: " << unread.size()
+        << " topics, " << bytes_unread << " bytes" << '\n';
+    out << "#bytes\tvalues\ttopic\tpublishers" << '\n';
+    for (size_t i=0; i<unread.size() && i<top; ++i) {
+        const Topic &topic = topics[unread[i].second];
+        out << topic.bytes << '\t' << topic.n_published << '\t'
+            << unread[i].second << '\t' << publishers_of(topic) << '\n';
+    }
+
+    out << '\n' << "# published more often than any subscriber's time delta tells apart: "
+        << oversampled.size() << " topics, " << bytes_oversampled << " bytes" << '\n';
+    out << "#excess bytes\tvalues\tobservable\ttopic\tpublishers" << '\n';
+    for (size_t i=0; i<oversampled.size() && i<top; ++i) {
+        const Topic &topic = topics[oversampled[i].second];
+        out << oversampled[i].first << '\t' << topic.n_published << '\t'
+            << topic.n_observable(subscribers) << '\t'
+            << oversampled[i].second << '\t' << publishers_of(topic) << '\n';
+    }
+
+    out << '\n' << "# subscribed, never published" << '\n';
+    out << "#sim\ttopic" << '\n';
+    for (size_t i=0; i<subscribers.size(); ++i) {
+        if (!subscribers[i].n_published) {
+            out << subscribers[i].sim << '\t' << subscribers[i].topic << '\n';
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,533 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !(defined WIN32 || defined _WIN32)
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_bench [--sims <n>] [--topology fanin|fanout|all]\n"
+    "                  [--ticks <ratio>[,<ratio>]...] [--payload <bytes>]\n"
+    "                  [--rate <values per step>] [--rounds <n>]\n"
+    "                  [--broker <fncs_broker path>] [--endpoint <endpoint>]\n"
+    "                  [--soak <phases>]\n"
+    "                  [--save <file>] [--baseline <file>] [--tolerance <percent>]";
+
+/* what the federates are told to do */
+class Options {
+    public:
+        Options()
+            : n_sims(4)
+            , topology("all")
+            , ticks(1, 1)
+            , payload(8)
+            , rate(1)
+            , rounds(1000)
+            , broker("fncs_broker")
+            , endpoint("tcp://127.0.0.1:5599")
+            , save()
+            , baseline()
+            , tolerance(10.0)
+            , soak(0)
+            , broker_pid(0)
+        {}
+
+        size_t n_sims;
+        string topology;
+        vector<fncs::time> ticks; /* as multiples of the smallest step */
+        size_t payload;
+        size_t rate;
+        fncs::time rounds; /* steps of a federate of tick 1 */
+        string broker;
+        string endpoint;
+        string save;
+        string baseline;
+        double tolerance;
+        size_t soak; /* phases of a soak run, the first warms up; 0 if none */
+        long broker_pid; /* whose memory sim 0 samples in a soak run */
+};
+
+/* what a federate reports back */
+class Report {
+    public:
+        Report()
+            : sent(0), received(0), wall(0.0)
+            , rss_growth(0), held_growth(0), broker_rss_growth(0), latencies() {}
+
+        unsigned long long sent;
+        unsigned long long received;
+        double wall; /* seconds between the first and the last request */
+        long rss_growth; /* KiB of resident memory gained after warming up */
+        long held_growth; /* bytes the client counts held, see fncs::Stats */
+        long broker_rss_growth; /* KiB, sampled by sim 0 only */
+        vector<double> latencies; /* seconds each time request blocked */
+};
+
+static string sim_name(size_t i)
+{
+    ostringstream oss;
+    oss << "bench" << i;
+    return oss.str();
+}
+
+static fncs::time tick_of(const Options &options, size_t i)
+{
+    return options.ticks[i % options.ticks.size()];
+}
+
+/* whether sim i subscribes to what sim j publishes */
+static bool subscribes(const Options &options, size_t i, size_t j)
+{
+    if (i == j) {
+        return false;
+    }
+    if (options.topology == "fanin") {
+        return i == 0;
+    }
+    if (options.topology == "fanout") {
+        return j == 0;
+    }
+    return true;
+}
+
+/* each publisher is subscribed to as a list, so every value counts */
+static string sim_config(const Options &options, size_t i)
+{
+    ostringstream oss;
+    oss << "name = " << sim_name(i) << "\n"
+        << "time_delta = 1ns\n"
+        << "broker = " << options.endpoint << "\n";
+    bool first = true;
+    for (size_t j=0; j<options.n_sims; ++j) {
+        if (!subscribes(options, i, j)) {
+            continue;
+        }
+        if (first) {
+            oss << "values\n";
+            first = false;
+        }
+        oss << "    from" << j << "\n"
+            << "        topic = " << sim_name(j) << "/value\n"
+            << "        list = true\n";
+    }
+    return oss.str();
+}
+
+#if !(defined WIN32 || defined _WIN32)
+
+/* the resident memory of a process in KiB, 0 if unknown */
+static long resident_kb(long pid)
+{
+    ostringstream path;
+    path << "/proc/" << pid << "/statm";
+    ifstream fin(path.str().c_str());
+    long size = 0;
+    long resident = 0;
+    if (!(fin >> size >> resident)) {
+        return 0;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long held_bytes()
+{
+    fncs::Stats stats = fncs::get_stats();
+    return static_cast<long>(stats.bytes_cache + stats.bytes_lists + stats.bytes_pending);
+}
+
+/* one synthetic federate, in a child process */
+static void run_sim(const Options &options, size_t i, int out)
+{
+    fncs::time tick = tick_of(options, i);
+    fncs::time stop = options.rounds;
+    fncs::time granted = 0;
+    string value(options.payload, 'x');
+    Report report;
+    /* a soak run samples memory once the first phase warmed up, and at
+     * the end; what grew in between is kept past its use */
+    fncs::time warm = options.soak ? stop / options.soak : stop;
+    bool warmed = false;
+    long rss = 0;
+    long held = 0;
+    long broker_rss = 0;
+
+    fncs::initialize(sim_config(options, i));
+    if (!fncs::is_initialized()) {
+        _exit(EXIT_FAILURE);
+    }
+    fncs::Key key = fncs::lookup_publish_key("value");
+    report.latencies.reserve(static_cast<size_t>(stop / tick) + 1);
+
+    double start = fncs::timer();
+    while (granted < stop) {
+        for (size_t r=0; r<options.rate; ++r) {
+            fncs::publish(key, value);
+        }
+        if (key != fncs::INVALID_KEY) {
+            report.sent += options.rate;
+        }
+        fncs::time next = granted + tick < stop ? granted + tick : stop;
+        double before = fncs::timer();
+        granted = fncs::time_request(next);
+        report.latencies.push_back(fncs::timer() - before);
+        for (fncs::EventIterator it=fncs::events_begin(); it!=fncs::events_end(); ++it) {
+            report.received += fncs::get_values(*it).size();
+        }
+        if (options.soak && !warmed && granted >= warm) {
+            warmed = true;
+            rss = resident_kb(getpid());
+            held = held_bytes();
+            broker_rss = i == 0 ? resident_kb(options.broker_pid) : 0;
+        }
+    }
+    report.wall = fncs::timer() - start;
+    if (warmed) {
+        report.rss_growth = resident_kb(getpid()) - rss;
+        report.held_growth = held_bytes() - held;
+        report.broker_rss_growth = i == 0 ? resident_kb(options.broker_pid) - broker_rss : 0;
+    }
+    fncs::finalize();
+
+    ostringstream oss;
+    oss << report.sent << ' ' << report.received << ' ' << report.wall << ' '
+        << report.rss_growth << ' ' << report.held_growth << ' '
+        << report.broker_rss_growth << '\n';
+    for (size_t l=0; l<report.latencies.size(); ++l) {
+        oss << report.latencies[l] << '\n';
+    }
+    string text = oss.str();
+    for (size_t offset=0; offset<text.size(); ) {
+        ssize_t n = write(out, text.data() + offset, text.size() - offset);
+        if (n <= 0) {
+            _exit(EXIT_FAILURE);
+        }
+        offset += n;
+    }
+    close(out);
+    _exit(EXIT_SUCCESS);
+}
+
+static bool read_report(int in, Report &report)
+{
+    string text;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, n);
+    }
+    close(in);
+    istringstream iss(text);
+    double latency;
+    if (!(iss >> report.sent >> report.received >> report.wall >> report.rss_growth
+                >> report.held_growth >> report.broker_rss_growth)) {
+        return false;
+    }
+    while (iss >> latency) {
+        report.latencies.push_back(latency);
+    }
+    return true;
+}
+
+#endif
+
+/* the distinct times any federate is granted, i.e. the broker rounds */
+static unsigned long long count_rounds(const Options &options)
+{
+    vector<bool> granted(static_cast<size_t>(options.rounds) + 1, false);
+    unsigned long long n = 0;
+    for (size_t i=0; i<options.n_sims; ++i) {
+        fncs::time tick = tick_of(options, i);
+        for (fncs::time t=tick; ; t+=tick) {
+            fncs::time at = t < options.rounds ? t : options.rounds;
+            if (!granted[at]) {
+                granted[at] = true;
+                ++n;
+            }
+            if (at == options.rounds) {
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+static double percentile(vector<double> &values, double fraction)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t at = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    nth_element(values.begin(), values.begin() + at, values.end());
+    return values[at];
+}
+
+/* Compares with a saved run. Rates regress when they drop, times when
+ * they grow, by more than the tolerance; returns how many did. */
+static int compare(const map<string,double> &results, const string &file, double tolerance)
+{
+    ifstream fin(file.c_str());
+    if (!fin) {
+        cerr << "Could not open baseline file '" << file << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+    int n_regressions = 0;
+    string name;
+    double before;
+    while (fin >> name >> before) {
+        map<string,double>::const_iterator it = results.find(name);
+        if (it == results.end() || before <= 0.0) {
+            continue;
+        }
+        bool is_rate = name.find("_per_second") != string::npos;
+        double change = 100.0 * (it->second - before) / before;
+        bool regressed = is_rate ? change < -tolerance : change > tolerance;
+        cout << name << ": " << before << " -> " << it->second
+            << " (" << (change >= 0 ? "+" : "") << change << "%)"
+            << (regressed ? " REGRESSION" : "") << endl;
+        if (regressed) {
+            ++n_regressions;
+        }
+    }
+    return n_regressions;
+}
+
+static unsigned long parse_count(const char *option, const char *text)
+{
+    char *end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (*end != '\0' || value == 0) {
+        cerr << option << " needs a positive number, not '" << text << "'" << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i=1; i<argc; ++i) {
+        string arg = argv[i];
+        if (i+1 == argc) {
+            cerr << "Missing value of " << arg << "." << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+        const char *value = argv[++i];
+        if (arg == "--sims") {
+            options.n_sims = parse_count("--sims", value);
+        }
+        else if (arg == "--topology") {
+            options.topology = value;
+            if (options.topology != "fanin" && options.topology != "fanout"
+                    && options.topology != "all") {
+                cerr << "Unknown topology '" << value << "'." << endl;
+                cerr << usage << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--ticks") {
+            istringstream iss(value);
+            string ratio;
+            options.ticks.clear();
+            while (getline(iss, ratio, ',')) {
+                options.ticks.push_back(parse_count("--ticks", ratio.c_str()));
+            }
+        }
+        else if (arg == "--payload") {
+            options.payload = strtoul(value, NULL, 10);
+        }
+        else if (arg == "--rate") {
+            options.rate = parse_count("--rate", value);
+        }
+        else if (arg == "--rounds") {
+            options.rounds = parse_count("--rounds", value);
+        }
+        else if (arg == "--broker") {
+            options.broker = value;
+        }
+        else if (arg == "--endpoint") {
+            options.endpoint = value;
+        }
+        else if (arg == "--soak") {
+            options.soak = parse_count("--soak", value);
+        }
+        else if (arg == "--save") {
+            options.save = value;
+        }
+        else if (arg == "--baseline") {
+            options.baseline = value;
+        }
+        else if (arg == "--tolerance") {
+            options.tolerance = strtod(value, NULL);
+        }
+        else {
+            cerr << "Unknown option '" << arg << "'." << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (options.n_sims < 2) {
+        cerr << "--sims must be at least 2." << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (options.soak == 1) {
+        cerr << "--soak needs at least 2 phases, one to warm up." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+#if (defined WIN32 || defined _WIN32)
+    cerr << "fncs_bench starts the broker and federates as processes, "
+        "which it does not support on Windows." << endl;
+    return EXIT_FAILURE;
+#else
+    /* the broker, on the benchmark's own endpoint */
+    ostringstream n_sims;
+    n_sims << options.n_sims;
+    pid_t broker = fork();
+    if (broker < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (broker == 0) {
+        setenv("FNCS_BROKER", options.endpoint.c_str(), 1);
+        execlp(options.broker.c_str(), options.broker.c_str(),
+                n_sims.str().c_str(), (char*)NULL);
+        perror(options.broker.c_str());
+        _exit(EXIT_FAILURE);
+    }
+
+    options.broker_pid = broker;
+
+    /* the federates, each reporting on a pipe */
+    vector<pid_t> sims;
+    vector<int> pipes;
+    for (size_t i=0; i<options.n_sims; ++i) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            kill(broker, SIGTERM);
+            exit(EXIT_FAILURE);
+        }
+        pid_t sim = fork();
+        if (sim < 0) {
+            perror("fork");
+            kill(broker, SIGTERM);
+            exit(EXIT_FAILURE);
+        }
+        if (sim == 0) {
+            close(fds[0]);
+            run_sim(options, i, fds[1]);
+        }
+        close(fds[1]);
+        sims.push_back(sim);
+        pipes.push_back(fds[0]);
+    }
+
+    vector<double> latencies;
+    unsigned long long sent = 0;
+    unsigned long long received = 0;
+    double wall = 0.0;
+    long rss_growth = 0;
+    long held_growth = 0;
+    long broker_rss_growth = 0;
+    bool failed = false;
+    for (size_t i=0; i<options.n_sims; ++i) {
+        Report report;
+        int status = 0;
+        if (!read_report(pipes[i], report)) {
+            cerr << sim_name(i) << " did not finish" << endl;
+            failed = true;
+        }
+        waitpid(sims[i], &status, 0);
+        sent += report.sent;
+        received += report.received;
+        wall = max(wall, report.wall);
+        rss_growth = max(rss_growth, report.rss_growth);
+        held_growth = max(held_growth, report.held_growth);
+        broker_rss_growth = max(broker_rss_growth, report.broker_rss_growth);
+        latencies.insert(latencies.end(), report.latencies.begin(), report.latencies.end());
+    }
+
+    int status = 0;
+    struct rusage broker_usage;
+    if (wait4(broker, &status, 0, &broker_usage) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        cerr << "the broker did not exit cleanly" << endl;
+        failed = true;
+    }
+    if (failed) {
+        return EXIT_FAILURE;
+    }
+    double broker_cpu = broker_usage.ru_utime.tv_sec + broker_usage.ru_utime.tv_usec / 1e6
+        + broker_usage.ru_stime.tv_sec + broker_usage.ru_stime.tv_usec / 1e6;
+
+    map<string,double> results;
+    results["rounds_per_second"] = count_rounds(options) / wall;
+    results["messages_per_second"] = sent / wall;
+    results["received_per_second"] = received / wall;
+    results["grant_p50_us"] = percentile(latencies, 0.50) * 1e6;
+    results["grant_p99_us"] = percentile(latencies, 0.99) * 1e6;
+    results["broker_cpu_seconds"] = broker_cpu;
+    results["wall_seconds"] = wall;
+    if (options.soak) {
+        /* growth is a time-like result: more of it regresses */
+        results["soak_sim_rss_growth_kb"] = rss_growth;
+        results["soak_sim_held_growth_bytes"] = held_growth;
+        results["soak_broker_rss_growth_kb"] = broker_rss_growth;
+        results["broker_max_rss_kb"] = broker_usage.ru_maxrss;
+    }
+
+    cout << "# " << options.n_sims << " sims, " << options.topology
+        << ", payload " << options.payload << ", rate " << options.rate
+        << ", rounds " << options.rounds;
+    if (options.soak) {
+        cout << ", soak " << options.soak << " phases";
+    }
+    cout << endl;
+    for (map<string,double>::iterator it=results.begin(); it!=results.end(); ++it) {
+        cout << it->first << ' ' << it->second << endl;
+    }
+
+    if (!options.save.empty()) {
+        ofstream fout(options.save.c_str());
+        for (map<string,double>::iterator it=results.begin(); it!=results.end(); ++it) {
+            fout << it->first << ' ' << it->second << '\n';
+        }
+        if (!fout) {
+            cerr << "Could not write '" << options.save << "'." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!options.baseline.empty()
+            && compare(results, options.baseline, options.tolerance) > 0) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+#endif
+}
@@ -4,16 +4,33 @@
 /* C++ standard headers */
 #include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <deque>
 #include <map>
+#include <queue>
 #include <set>
 #include <string>
 #include <sstream>
 #include <vector>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 /* 3rd party headers */
 #include "czmq.h"
 
@@ -21,9 +38,278 @@
 #include "log.hpp"
 #include "fncs.hpp"
 #include "fncs_internal.hpp"
+#include "broker_metrics.hpp"
+#include "grant_queue.hpp"
+#include "hash_map.hpp"
+#include "probes.hpp"
+#include "topic_filter.hpp"
+#include "topic_intern.hpp"
+#include "topic_router.hpp"
+#include "trace_writer.hpp"
+#include "value_dictionary.hpp"
 
 using namespace ::std;
 
+/* The broker's state outside broker_run() is kept per thread if the
+ * compiler can, so that a tenant host runs many brokers in one process,
+ * see tenant_host(). */
+#if HAVE_THREAD_LOCAL
+#define BROKER_LOCAL thread_local
+#else
+#define BROKER_LOCAL
+#endif
+
+/* the string values numbered for the federation, see dictionary_learn() */
+static BROKER_LOCAL fncs::ValueDictionary coded_values;
+
+/* whether the payload is a typed value, a record or a coded value,
+ * which peers speaking strings get as the text made of it */
+static bool binary_text(const void *data, size_t size, string &text)
+{
+    const string *coded = coded_values.lookup(data, size);
+    if (coded) {
+        text = *coded;
+        return true;
+    }
+    fncs::TypedValue typed;
+    if (fncs::decode_typed(data, size, typed)) {
+        text = fncs::format_typed(typed);
+        return true;
+    }
+    if (fncs::record_frame(data, size)) {
+        text = fncs::format_record(data, size);
+        return true;
+    }
+    return false;
+}
+
+/* whether the payload is a number, a typed double or integer or text
+ * that parses as a whole, and if so which */
+static bool to_number(const char *data, size_t size, double &number)
+{
+    fncs::TypedValue typed;
+    if (fncs::decode_typed(data, size, typed)) {
+        if (fncs::VALUE_DOUBLE == typed.type || fncs::VALUE_INT64 == typed.type) {
+            number = typed.as_double();
+            return true;
+        }
+        return false;
+    }
+    string text(data, size);
+    char *end = NULL;
+    number = strtod(text.c_str(), &end);
+    return !text.empty() && end == text.c_str() + text.size();
+}
+
+/* Drops the values of a subscription that did not move: a number is
+ * forwarded only when it is more than the deadband away from the last
+ * one forwarded, any other value only when it differs from it. A
+ * downsampled subscription, by_value false unless it also has a
+ * deadband, is only forwarded every nth value published and no sooner
+ * than min_interval after the last one forwarded. */
+class ValueFilter {
+    public:
+        explicit ValueFilter(double deadband=0.0, bool by_value=true,
+                fncs::time min_interval=0, unsigned long every_nth=0)
+            : deadband(deadband)
+            , by_value(by_value)
+            , min_interval(min_interval)
+            , every_nth(every_nth)
+            , n_seen(0)
+            , forwarded(false)
+            , last_is_number(false)
+            , last()
+            , last_number(0.0)
+            , last_time(0)
+        {}
+
+        /* whether to forward the value published at the given time,
+         * remembering it if so */
+        bool accept(zframe_t *value, fncs::time time) {
+            if (every_nth && n_seen++ % every_nth) {
+                return false;
+            }
+            if (forwarded && min_interval && time < last_time + min_interval) {
+                return false;
+            }
+            const char *data = reinterpret_cast<const char*>(zframe_data(value));
+            size_t size = zframe_size(value);
+            double number = 0.0;
+            bool is_number = to_number(data, size, number);
+            if (forwarded && by_value) {
+                if (is_number && last_is_number) {
+                    if (fabs(number - last_number) <= deadband) {
+                        return false;
+                    }
+                }
+                else if (last.size() == size && 0 == memcmp(last.data(), data, size)) {
+                    return false;
+                }
+            }
+            forwarded = true;
+            last.assign(data, size);
+            last_number = number;
+            last_is_number = is_number;
+            last_time = time;
+            return true;
+        }
+
+    private:
+        double deadband;
+        bool by_value; /* deadband and on_change apply */
+        fncs::time min_interval;
+        unsigned long every_nth;
+        unsigned long n_seen; /* values published, forwarded or not */
+        bool forwarded;
+        bool last_is_number;
+        string last; /* the payload last forwarded */
+        double last_number;
+        fncs::time last_time; /* when it was published */
+};
+
+typedef map<string,ValueFilter> FilterMap;
+
+/* whether a subscription filter asks for its values to be pulled, see
+ * fncs::PULL */
+static bool filter_pulls(const string &spec)
+{
+    istringstream in(spec);
+    string field;
+    getline(in, field, ';');
+    while (getline(in, field, ';')) {
+        if (field == "pull") {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Parse a subscription filter, see fncs::Subscription::filter(): the
+ * deadband, if any, then ";min_interval=<time>" and ";every_nth=<n>"
+ * if downsampled. A list subscriber wants every value that moved, so
+ * only the downsampling applies to it. False if there is nothing to
+ * filter or the filter is invalid. */
+static bool parse_filter(const string &spec, bool is_list,
+        const string &sender, const string &topic, ValueFilter &filter)
+{
+    istringstream in(spec);
+    string field;
+    double deadband = 0.0;
+    fncs::time min_interval = 0;
+    unsigned long every_nth = 0;
+    bool by_value = false;
+
+    getline(in, field, ';');
+    if (!field.empty()) {
+        char *end = NULL;
+        deadband = strtod(field.c_str(), &end);
+        if (*end != '\0' || deadband < 0.0) {
+            LWARNING << "ignoring invalid deadband '" << field
+                << "' of " << sender << " for " << topic;
+            return false;
+        }
+        by_value = !is_list;
+    }
+    while (getline(in, field, ';')) {
+        size_t eq = field.find('=');
+        string name = field.substr(0, eq);
+        string value = eq == string::npos ? string() : field.substr(eq+1);
+        if (name == "min_interval" && !value.empty()) {
+            min_interval = fncs::parse_time(value);
+        }
+        else if (name == "every_nth" && !value.empty()
+                && value.find_first_not_of("0123456789") == string::npos) {
+            every_nth = strtoul(value.c_str(), NULL, 10);
+        }
+        else if (name == "pull" && value.empty()) {
+            continue; /* see filter_pulls() */
+        }
+        else {
+            LWARNING << "ignoring invalid filter '" << field
+                << "' of " << sender << " for " << topic;
+        }
+    }
+    if (every_nth == 1) {
+        every_nth = 0;
+    }
+    if (!by_value && !min_interval && !every_nth) {
+        return false;
+    }
+    LDEBUG4C(logCONFIG) << sender << " filters " << topic << ": " << spec;
+    filter = ValueFilter(deadband, by_value, min_interval, every_nth);
+    return true;
+}
+
+/* A value the broker holds until the subscriber's first grant at or
+ * after its delivery time, see fncs::publish_at(). */
+class Delayed {
+    public:
+        Delayed(fncs::time time, unsigned long long order,
+                const string &topic, zframe_t *value)
+            : time(time)
+            , order(order)
+            , topic(topic)
+            , value(reinterpret_cast<const char*>(zframe_data(value)), zframe_size(value))
+        {}
+
+        /* earliest first, in the order they were published */
+        bool operator>(const Delayed &that) const {
+            return time > that.time || (time == that.time && order > that.order);
+        }
+
+        fncs::time time;
+        unsigned long long order;
+        string topic;
+        string value;
+};
+
+typedef priority_queue<Delayed, vector<Delayed>, greater<Delayed> > DelayQueue;
+
+/* A link of FNCS_LINKS: what the values of one sim take to reach
+ * another, see link_arrival(). */
+class Link {
+    public:
+        Link(const string &from, const string &to, fncs::time latency,
+                double bandwidth, fncs::time jitter)
+            : from(from)
+            , to(to)
+            , latency(latency)
+            , bandwidth(bandwidth)
+            , jitter(jitter)
+            , busy_until(0)
+            , seed(0x9e3779b97f4a7c15ULL)
+        {}
+
+        string from;
+        string to;
+        fncs::time latency; /* ns */
+        double bandwidth; /* bits per second, 0 if unlimited */
+        fncs::time jitter; /* up to this much later, ns */
+        fncs::time busy_until; /* when the values queued on it are sent */
+        unsigned long long seed; /* of its jitter, the same every run */
+};
+
+/* A value published to a sim of an optimistic federation, kept until the
+ * GVT passes it in case a rollback undoes it, see FNCS_OPTIMISTIC. */
+class Sent {
+    public:
+        Sent(fncs::time time, size_t sender, const string &topic, zframe_t *value)
+            : time(time)
+            , grant(0)
+            , sender(sender)
+            , topic(topic)
+            , value(reinterpret_cast<const char*>(zframe_data(value)), zframe_size(value))
+        {}
+
+        fncs::time time; /* of the sender's step that published it */
+        fncs::time grant; /* the receiver's grant it came with, once delivered */
+        size_t sender;
+        string topic;
+        string value;
+};
+
+typedef vector<Sent> SentVec;
+
 class SimulatorState {
     public:
         SimulatorState()
@@ -31,210 +317,4992 @@ class SimulatorState {
             , time_requested(0)
             , time_delta(0)
             , time_last_processed(0)
+            , time_current(0)
+            , lookahead(0)
+            , lookahead_floor(0)
+            , time_period(0)
+            , time_next_publish(0)
+            , time_peer(0)
+            , time_join(0)
+            , cluster(0)
+            , cluster_pos(0)
             , processing(true)
             , messages_pending(false)
+            , departed(false)
+            , detached(false)
+            , negotiated(false)
+            , manifest(false)
+            , binary(false)
+            , zstd(false)
+            , dictionary(false)
+            , delta(false)
+            , optimistic(false)
+            , grant_batch(false)
+            , topic_ids(false)
+            , grant_casts(false)
+            , cast_index(0)
+            , cast_ready(false)
+            , unicast_due(false)
+            , cast_due(false)
+            , direct_endpoint()
+            , direct_relayed(false)
+            , direct_expected(0)
+            , direct_fenced(0)
+            , data_channel(false)
+            , data_ready(false)
+            , data(false)
+            , pull(false)
+            , anon_filter(false)
+            , stale(false)
+            , rollback_due(false)
+            , rollback_to(0)
+            , load(false)
+            , load_grants(0)
+            , load_wall(0)
+            , load_round(0)
+            , load_blocking(0)
+            , load_blocked(0)
+            , identity(NULL)
         {}
 
         string name;
         fncs::time time_requested;
         fncs::time time_delta;
         fncs::time time_last_processed;
+        fncs::time time_current; /* time of the most recent grant */
+        fncs::time lookahead; /* publishes take effect this much later */
+        fncs::time lookahead_floor; /* promised before lookahead shrank */
+        fncs::time time_period; /* standing request, see MSG_PERIODIC */
+        fncs::time time_next_publish; /* declared with the last request, 0 if not */
+        fncs::time time_peer; /* last sent to it, see time_peers() */
+        fncs::time time_join; /* federation time when admitted late */
+        size_t cluster; /* index of the cluster this sim belongs to */
+        size_t cluster_pos; /* index of this sim within its cluster */
         bool processing;
         bool messages_pending;
-        set<string> subscription_values;
+        bool departed; /* sent BYE */
+        bool detached; /* ... and was answered at once, see DETACH */
+        bool negotiated; /* client sent a protocol frame in HELLO */
+        bool manifest; /* subscriptions and ACK keys travel packed */
+        bool binary; /* binary wire protocol selected during HELLO/ACK */
+        bool zstd; /* reads zstd compressed values */
+        bool dictionary; /* reads coded values, see FNCS_DICTIONARY */
+        bool delta; /* decodes delta encoded list values */
+        bool optimistic; /* saves and restores its state, see FNCS_OPTIMISTIC */
+        bool grant_batch; /* reads queued values that come with its grant */
+        bool topic_ids; /* reads and sends topic IDs, see fncs::TOPIC_IDS */
+        bool grant_casts; /* reads grant casts, see fncs::GRANT_CAST ... */
+        size_t cast_index; /* ... its bit in them ... */
+        bool cast_ready; /* ... once it subscribed to them */
+        bool unicast_due; /* was sent something since its last grant ... */
+        bool cast_due; /* ... or cast something, see FNCS_CAST_TOPICS */
+        string direct_endpoint; /* takes values directly there, see fncs::DIRECT */
+        bool direct_relayed; /* declared a lookahead, so sends none directly */
+        unsigned long long direct_expected; /* values sent to it directly or
+                                               on the data channel ... */
+        unsigned long long direct_fenced; /* ... as of its last DIRECT_FENCE */
+        bool data_channel; /* may take values on FNCS_DATA_CHANNEL ... */
+        bool data_ready; /* ... connected to it ... */
+        bool data; /* ... and was granted since, see values_to() */
+        bool pull; /* may FETCH the values it pulls, see fncs::PULL */
+        bool anon_filter; /* drops unsubscribed values, see fncs::SUBSCRIBED */
+        bool stale; /* computing a step a rollback undoes */
+        bool rollback_due; /* to be sent a ROLLBACK ... */
+        fncs::time rollback_to; /* ... to the state of this grant */
+        bool load; /* reads load summaries, see FNCS_LOAD_FEEDBACK ... */
+        unsigned long long load_grants; /* ... grants since the last one ... */
+        fncs::time load_wall; /* ... wall time of its last grant ... */
+        fncs::time load_round; /* ... and between the two before ... */
+        fncs::time load_blocking; /* ... metrics.time_blocking ... */
+        fncs::time load_blocked; /* ... and load_blocked_total when it was sent */
+        zframe_t *identity; /* routing frame, destroyed with the broker */
+        vector<zframe_t*> outbox; /* topic and value frames of its next PUBLISH_BATCH */
+        vector<fncs::time> grants; /* past the GVT, ascending */
+        SentVec inbox; /* values for its next grant */
+        SentVec consumed; /* values delivered at a grant past the GVT */
+        vector<size_t> subscription_values; /* topic IDs, ascending */
+        vector<size_t> runtime_values; /* ... of those since its ACK, see MSG_SUBSCRIBE */
+        vector<size_t> subscription_ids; /* as listed, if it reads topic IDs */
+        vector<pair<size_t,size_t> > aliases; /* published and subscribed topic IDs, ascending */
+        vector<pair<size_t,size_t> > links; /* subscriber index and position in links, ascending */
+        vector<size_t> list_values; /* topic IDs of those that keep every value */
+        vector<string> list_patterns; /* pattern ones among them */
+        vector<size_t> passive_values; /* topic IDs of those that never wake it */
+        vector<string> passive_patterns; /* pattern ones among them */
+        vector<size_t> priority_values; /* topic IDs of those sent ahead of the rest */
+        vector<string> priority_patterns; /* pattern ones among them */
+        vector<string> members; /* sims behind this one, if a sub-broker */
+        vector<string> compound; /* logical sims it stands in for, see Config::members */
+        FilterMap filters; /* subscriptions with a deadband or on_change */
+        vector<pair<string,ValueFilter> > filter_patterns; /* pattern and its filter */
+        DelayQueue delayed; /* values held for a later grant */
+        vector<size_t> aggregates_due; /* positions in aggregates, see send_aggregates() */
+        fncs::SimMetrics metrics; /* updated only if metrics are enabled */
+        fncs::TimelineTrack track; /* updated only if a timeline is recorded */
 };
 
-typedef map<string,size_t> SimIndex;
-typedef vector<SimulatorState> SimVec;
-typedef vector<size_t> IndexVec;
-typedef vector<fncs::time> TimeVec;
-typedef map<string,IndexVec> TopicMap;
-typedef map<string,set<string> > SimKeyMap;
-typedef map<string,TimeVec> SimTimeMap;
+/* whether a value of the topic published at the given time goes to the
+ * sim, see ValueFilter */
+static bool filter_accepts(SimulatorState &state, const string &topic,
+        zframe_t *value, fncs::time time)
+{
+    if (state.filters.empty() && state.filter_patterns.empty()) {
+        return true;
+    }
+    FilterMap::iterator it = state.filters.find(topic);
+    if (it == state.filters.end()) {
+        /* each topic a pattern matches is filtered on its own */
+        for (size_t i=0; i<state.filter_patterns.size(); ++i) {
+            if (fncs::glob_match(state.filter_patterns[i].first, topic)) {
+                it = state.filters.insert(make_pair(topic,
+                            state.filter_patterns[i].second)).first;
+                break;
+            }
+        }
+    }
+    return it == state.filters.end() || it->second.accept(value, time);
+}
 
-static fncs::time time_real_start;
-static fncs::time time_real;
-static ofstream trace; /* the trace stream, if requested */
+/* whether the sim subscribed to the topic, of the given ID, as a list */
+static bool keeps_every_value(const SimulatorState &state, size_t id, const string &topic)
+{
+    if (binary_search(state.list_values.begin(), state.list_values.end(), id)) {
+        return true;
+    }
+    for (size_t i=0; i<state.list_patterns.size(); ++i) {
+        if (fncs::glob_match(state.list_patterns[i], topic)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-static void broker_die(const SimVec &simulators, zsock_t *server) {
-    /* repeat the fatal die to all connected sims */
-    for (size_t i=0; i<simulators.size(); ++i) {
-        zstr_sendm(server, simulators[i].name.c_str());
-        zstr_send(server, fncs::DIE);
+/* whether a value of the topic, of the given ID, wakes the sim; the
+ * values of a passive subscription wait for its next grant */
+static bool wakes_on(const SimulatorState &state, size_t id, const string &topic)
+{
+    if (binary_search(state.passive_values.begin(), state.passive_values.end(), id)) {
+        return false;
     }
-    zsock_destroy(&server);
-    zsys_shutdown(); /* without this, Windows will assert */
-    if (trace.is_open()) {
-        trace.close();
+    for (size_t i=0; i<state.passive_patterns.size(); ++i) {
+        if (fncs::glob_match(state.passive_patterns[i], topic)) {
+            return false;
+        }
     }
-    exit(EXIT_FAILURE);
+    return true;
 }
 
-static void time_real_update(void)
+/* whether a value of the topic, of the given ID, overtakes the values
+ * of the sim's other subscriptions, see Subscription::prioritized() */
+static bool prioritized_on(const SimulatorState &state, size_t id, const string &topic)
 {
-    time_real = fncs::timer_ft() - time_real_start;
+    if (binary_search(state.priority_values.begin(), state.priority_values.end(), id)) {
+        return true;
+    }
+    for (size_t i=0; i<state.priority_patterns.size(); ++i) {
+        if (fncs::glob_match(state.priority_patterns[i], topic)) {
+            return true;
+        }
+    }
+    return false;
 }
 
+static bool has_priorities(const SimulatorState &state)
+{
+    return !state.priority_values.empty() || !state.priority_patterns.empty();
+}
 
+typedef fncs::HashMap<string,size_t>::type SimIndex;
+typedef vector<SimulatorState> SimVec;
+typedef vector<size_t> IndexVec;
+typedef vector<fncs::time> TimeVec;
+typedef map<string,set<string> > SimKeyMap;
 
+/* A subscriber a PUBLISH of the topic is sent to, with what sending
+ * it needs of the sim's state. */
+class Send {
+    public:
+        Send(size_t index, bool binary, bool with_time,
+                bool filtered, bool batched, bool wakes, bool by_id, size_t alias)
+            : index(index)
+            , binary(binary)
+            , with_time(with_time)
+            , filtered(filtered)
+            , batched(batched)
+            , wakes(wakes)
+            , by_id(by_id)
+            , alias(alias)
+        {}
 
-int main(int argc, char **argv)
-{
-    /* declare all variables */
-    unsigned int n_sims = 0;    /* how many sims will connect */
-    set<string> byes;           /* which sims have disconnected */
-    int n_processing = 0;       /* how many sims are processing a time step */
-    const char *endpoint = NULL;/* broker location */
-    SimVec simulators;          /* vector of connected simulator state */
-    SimIndex name_to_index;     /* quickly lookup sim state index */
-    TopicMap topic_to_indexes;  /* quickly lookup subscribed sims */
-    SimKeyMap name_to_keys;     /* summary of topics per sim name */
-    SimKeyMap name_to_peers;    /* summary of peers per sim name */
-    SimTimeMap name_to_peertimes; /* summary of peer deltas */
-    fncs::time time_granted = 0;/* global clock */
-    zsock_t *server = NULL;     /* the broker socket */
-    bool do_trace = false;      /* whether to dump all received messages */
-    fncs::time realtime_interval = 0;
+        size_t index;
+        bool binary;
+        bool with_time; /* a sub-broker, whose members lack the time */
+        bool filtered; /* by a deadband or on change */
+        bool batched; /* queued for a PUBLISH_BATCH, see queue_publish(),
+                         never if prioritized */
+        bool wakes; /* the value makes the sim actionable, see wakes_on() */
+        bool by_id; /* sent the topic's ID, which it was told in its ACK */
+        size_t alias; /* ID of the name it subscribed to the topic by, or npos */
+};
 
-    fncs::start_logging();
-    fncs::replicate_logging(FNCSLog::ReportingLevel(),
-            Output2Tee::Stream1(), Output2Tee::Stream2());
+/* FNCS_DELIVERY_BATCH, the most pairs queued for a sim before they are
+ * sent as one PUBLISH_BATCH; 0 sends every PUBLISH on its own */
+static BROKER_LOCAL size_t delivery_batch = 0;
 
-    /* how many simulators are connecting? */
-    if (argc > 3) {
-        LERROR << "too many command line args";
-        exit(EXIT_FAILURE);
-    }
-    if (argc < 2) {
-        LERROR << "missing command line arg for number of simulators";
-        exit(EXIT_FAILURE);
-    }
-    if (argc >= 2) {
-        int n_sims_signed = 0;
-        istringstream iss(argv[1]);
-        iss >> n_sims_signed;
-        LDEBUG4 << "n_sims_signed = " << n_sims_signed;
-        if (n_sims_signed <= 0) {
-            LERROR << "number of simulators arg must be >= 1";
-            exit(EXIT_FAILURE);
-        }
-        n_sims = static_cast<unsigned int>(n_sims_signed);
-    }
-    if (argc == 3) {
-        realtime_interval = fncs::parse_time(argv[2]);
-        LDEBUG4 << "realtime_interval = " << realtime_interval << " ns";
-    }
+/* the most pairs queued for a sim with prioritized subscriptions if
+ * FNCS_DELIVERY_BATCH is 0: its other values are held back this far so
+ * that a prioritized one overtakes them */
+static const size_t PRIORITY_HOLD = 1024;
 
-    {
-        const char *env_do_trace = getenv("FNCS_TRACE");
-        if (env_do_trace) {
-            if (env_do_trace[0] == 'Y'
-                    || env_do_trace[0] == 'y'
-                    || env_do_trace[0] == 'T'
-                    || env_do_trace[0] == 't') {
-                do_trace = true;
+/* the most messages held in the per sender queues of FNCS_INGRESS_FAIR,
+ * unless FNCS_RECV_BATCH is larger */
+static const size_t INGRESS_HOLD = 1024;
+
+/* queueing a value copies it, so a larger one is sent by reference */
+static const size_t DELIVERY_BATCH_VALUE_MAX = 4096;
+
+/* bumped when a sim leaves, which outdates every send list */
+static BROKER_LOCAL unsigned long long send_lists_generation = 1;
+
+/* The subscribers of a topic, routed once they were matched against
+ * the pattern subscriptions, and the send list built from them. */
+class Route {
+    public:
+        Route() : indexes(), routed(false), sends(), sends_generation(0)
+                  , last_value(), has_last_value(false), last_time(0)
+                  , prior_value(), has_prior_value(false), pulled(false) {}
+
+        void add(size_t index) {
+            if (find(indexes.begin(), indexes.end(), index) == indexes.end()) {
+                indexes.push_back(index);
+                sends_generation = 0;
             }
         }
-    }
 
-    if (do_trace) {
-        LDEBUG4 << "tracing of all published messages enabled";
-        trace.open("broker_trace.txt");
-        if (!trace) {
-            LERROR << "Could not open trace file 'broker_trace.txt'";
-            exit(EXIT_FAILURE);
+        void remove(size_t index) {
+            indexes.erase(std::remove(indexes.begin(), indexes.end(), index), indexes.end());
+            sends_generation = 0;
         }
-        trace << "#nanoseconds\ttopic\tvalue" << endl;
-    }
 
-    /* broker endpoint may come from env var */
-    endpoint = getenv("FNCS_BROKER");
-    if (!endpoint) {
-        endpoint = "tcp://*:5570";
-    }
+        IndexVec indexes;
+        bool routed;
+        vector<Send> sends; /* of the subscribers still connected */
+        unsigned long long sends_generation; /* 0 until built */
+        string last_value; /* the latest published, see FNCS_LAST_VALUES ... */
+        bool has_last_value; /* ... unless none or only a delta was ... */
+        fncs::time last_time; /* ... at this time */
+        string prior_value; /* the latest published before last_time ... */
+        bool has_prior_value; /* ... if any, see fetch_value() */
+        bool pulled; /* a sim fetches its values, see fncs::PULL */
+};
 
-    server = zsock_new_router(endpoint);
-    if (!server) {
-        LERROR << "socket creation failed";
-        exit(EXIT_FAILURE);
-    }
-    if (!(zsock_resolve(server) != server)) {
-        LERROR << "socket failed to resolve";
-        exit(EXIT_FAILURE);
-    }
-    LDEBUG4 << "broker socket bound to " << endpoint;
+typedef vector<Route> TopicMap; /* by topic ID */
 
-    /* begin event loop */
-    zmq_pollitem_t items[] = { { zsock_resolve(server), 0, ZMQ_POLLIN, 0 } };
-    while (true) {
-        int rc = 0;
-        
-        LDEBUG4 << "entering blocking poll";
-        rc = zmq_poll(items, 1, -1);
-        if (rc == -1) {
-            LERROR << "broker polling error: " << strerror(errno);
-            broker_die(simulators, server); /* interrupted */
+/* Every topic and key the broker knows of, each stored once; the sims,
+ * the routes and the ACK keys refer to them by ID. */
+static BROKER_LOCAL fncs::TopicIntern topics;
+
+/* The keys other sims subscribed to of one publishing sim, as IDs in
+ * topics, kept ready as each HELLO arrives so the ACK barrier only sends
+ * them, as a frame per key or in the packed manifest. A key's list flag
+ * may be raised by a later subscriber. */
+class AckKeys {
+    public:
+        AckKeys() : index(), keys(), lists(), whole() {}
+
+        /* delta: the subscriber decodes delta encoded list values */
+        void add(size_t key, bool is_list, bool delta=false) {
+            fncs::HashMap<size_t,size_t>::type::iterator it = index.find(key);
+            if (it == index.end()) {
+                it = index.insert(make_pair(key, keys.size())).first;
+                keys.push_back(key);
+                lists.push_back(false);
+                whole.push_back(false);
+            }
+            if (is_list) {
+                lists[it->second] = true;
+            }
+            if (!delta) {
+                whole[it->second] = true;
+            }
         }
 
-        if (items[0].revents & ZMQ_POLLIN) {
-            zmsg_t *msg = NULL;
-            zframe_t *frame = NULL;
-            string sender;
-            string message_type;
+        void add(const string &key, bool is_list, bool delta=false) {
+            add(topics.intern(key), is_list, delta);
+        }
 
-            LDEBUG4 << "incoming message";
-            msg = zmsg_recv(server);
-            if (!msg) {
-                LERROR << "null message received";
-                broker_die(simulators, server);
+        bool has(const string &key) const {
+            size_t id = topics.find(key);
+            return id != fncs::TopicIntern::npos() && index.count(id);
+        }
+
+        bool is_list(size_t i) const {
+            return lists[i];
+        }
+
+        /* every subscriber may be sent deltas */
+        bool is_delta(size_t i) const {
+            return !whole[i];
+        }
+
+        /* the keys packed as in a manifest */
+        string manifest() const {
+            string packed;
+            for (size_t i=0; i<keys.size(); ++i) {
+                fncs::append_manifest(packed, topics.str(keys[i]), lists[i]);
             }
+            return packed;
+        }
 
-            /* first frame is sender */
-            frame = zmsg_first(msg);
-            if (!frame) {
-                LERROR << "message missing sender";
-                broker_die(simulators, server);
+        fncs::HashMap<size_t,size_t>::type index; /* key to position in keys */
+        vector<size_t> keys; /* in the order they were learned */
+        vector<bool> lists; /* some subscriber keeps every value */
+        vector<bool> whole; /* some subscriber needs every value whole */
+};
+
+typedef map<string,AckKeys> SimAckMap;
+
+/* A subscription whose publisher name is a pattern, e.g. '*' or
+ * 'feeder?/voltage'. Which sims publish it is only known once they
+ * connect, so each is told as it is ACKed. */
+class NamePattern {
+    public:
+        NamePattern(const string &subscriber, const string &prefix,
+                bool is_list, bool delta)
+            : subscriber(subscriber), prefix(prefix), is_list(is_list), delta(delta) {}
+
+        string subscriber;
+        string prefix; /* literal start of the pattern, within the name */
+        bool is_list;
+        bool delta;
+};
+
+typedef vector<NamePattern> NamePatternVec;
+
+/* A topic of FNCS_AGGREGATES, "topic=op:glob", reduced by the broker
+ * over the last value of each topic matching the glob, see
+ * aggregate_update(). Its subscribers are sent one value per grant. */
+class Aggregate {
+    public:
+        enum Op { SUM, MEAN, MIN, MAX, COUNT };
+
+        Aggregate(const string &topic, Op op, const string &glob)
+            : topic(topic), op(op), glob(glob), inputs(), ordered(), sum(0.0) {}
+
+        /* the input's new value, replacing its last */
+        void update(size_t id, double value) {
+            map<size_t,double>::iterator it = inputs.find(id);
+            if (it != inputs.end()) {
+                sum -= it->second;
+                ordered.erase(ordered.find(it->second));
+                it->second = value;
             }
-            sender = fncs::to_string(frame);
+            else {
+                inputs.insert(make_pair(id, value));
+            }
+            sum += value;
+            ordered.insert(value);
+        }
 
-            /* next frame is message type identifier */
-            frame = zmsg_next(msg);
-            if (!frame) {
-                LERROR << "message missing type identifier";
-                broker_die(simulators, server);
+        /* false if there is nothing to reduce yet */
+        bool reduce(fncs::TypedValue &value) const {
+            if (inputs.empty()) {
+                return false;
             }
-            message_type = fncs::to_string(frame);
-            
-            /* dispatcher */
-            if (fncs::HELLO == message_type) {
-                SimulatorState state;
-                string config_string;
-                fncs::Config config;
-                string time_delta;
-                size_t index = 0;
+            value.type = fncs::VALUE_DOUBLE;
+            switch (op) {
+                case SUM: value.real = sum; break;
+                case MEAN: value.real = sum / inputs.size(); break;
+                case MIN: value.real = *ordered.begin(); break;
+                case MAX: value.real = *ordered.rbegin(); break;
+                case COUNT:
+                    value.type = fncs::VALUE_INT64;
+                    value.integer = static_cast<long long>(inputs.size());
+                    break;
+            }
+            return true;
+        }
 
-                LDEBUG4 << "HELLO received";
+        string topic;
+        Op op;
+        string glob; /* of the input topics */
+        map<size_t,double> inputs; /* last value by topic ID */
+        multiset<double> ordered; /* the same values, for MIN and MAX */
+        double sum;
+};
 
-                /* check for duplicate sims */
-                if (name_to_index.count(sender) != 0) {
-                    LERROR << "simulator '" << sender << "' already connected";
-                    broker_die(simulators, server);
-                }
-                index = simulators.size();
-                LDEBUG4 << "registering client '" << sender << "'";
+typedef vector<Aggregate> AggregateVec;
 
-                /* next frame is config chunk */
-                frame = zmsg_next(msg);
-                if (!frame) {
-                    LERROR << "HELLO message missing config frame";
-                    broker_die(simulators, server);
-                }
+/* Tell the sim about the name patterns its name may match; it then
+ * publishes all its keys, which the broker routes by topic. The
+ * subscribers become its peers as if they named it. */
+static void resolve_name_patterns(
+        const NamePatternVec &name_patterns,
+        const SimVec &simulators,
+        size_t index,
+        SimAckMap &name_to_keys,
+        SimKeyMap &name_to_peers,
+        SimKeyMap &name_to_subscribers)
+{
+    const SimulatorState &state = simulators[index];
+    for (size_t i=0; i<name_patterns.size(); ++i) {
+        const NamePattern &pattern = name_patterns[i];
+        if (pattern.subscriber == state.name) {
+            continue;
+        }
+        if (0 == state.name.compare(0, pattern.prefix.size(), pattern.prefix)) {
+            name_to_keys[state.name].add("*", pattern.is_list, pattern.delta);
+            name_to_peers[pattern.subscriber].insert(state.name);
+            name_to_subscribers[state.name].insert(pattern.subscriber);
+        }
+        /* its members publish under their own names, so it sends them all */
+        for (size_t j=0; j<state.compound.size(); ++j) {
+            const string &member = state.compound[j];
+            if (0 == member.compare(0, pattern.prefix.size(), pattern.prefix)) {
+                name_to_keys[state.name].add("*", pattern.is_list, pattern.delta);
+                name_to_peers[pattern.subscriber].insert(member);
+                name_to_subscribers[member].insert(pattern.subscriber);
+            }
+        }
+    }
+}
 
-                /* copy config frame into chunk */
-                config_string = fncs::to_string(frame);
-                LDEBUG2 << "-- recv configuration as follows --" << endl << config_string;
+static void sort_unique(IndexVec &iv)
+{
+    sort(iv.begin(), iv.end());
+    iv.erase(unique(iv.begin(), iv.end()), iv.end());
+}
 
-                /* next frame is FNCS library version */
+/* route() of a topic known by its ID, as a sim reading topic IDs sends
+ * it in place of the topic */
+static size_t route(
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        size_t id)
+{
+    if (id >= topic_to_indexes.size()) {
+        topic_to_indexes.resize(topics.size());
+    }
+    Route &subscribers = topic_to_indexes[id];
+    if (!subscribers.routed) {
+        subscribers.routed = true;
+        if (!router.empty()) {
+            router.match(topics.str(id), subscribers.indexes);
+        }
+    }
+    return id;
+}
+
+/* The ID of a topic, to look up its subscribers with, or npos() if
+ * it has none. Once there are pattern subscriptions, a topic seen for
+ * the first time is matched through the router and its subscribers,
+ * possibly none, are kept under it, so the trie is walked once per
+ * concrete topic. */
+static size_t route(
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        const string &topic)
+{
+    size_t id = topics.find(topic);
+    if (id == fncs::TopicIntern::npos()) {
+        if (router.empty()) {
+            return id;
+        }
+        id = topics.intern(topic);
+    }
+    return route(topic_to_indexes, router, id);
+}
+
+/* file the sim under the topic, or under the pattern and every topic
+ * already routed that it matches */
+static void subscribe(
+        TopicMap &topic_to_indexes,
+        fncs::TopicRouter &router,
+        const string &topic,
+        size_t index)
+{
+    if (fncs::is_topic_pattern(topic)) {
+        string routed;
+        router.add(topic, index);
+        for (size_t id=0; id<topic_to_indexes.size(); ++id) {
+            if (!topic_to_indexes[id].routed) {
+                continue;
+            }
+            routed.assign(topics.data(id), topics.length(id));
+            if (fncs::glob_match(topic, routed)) {
+                topic_to_indexes[id].add(index);
+            }
+        }
+        return;
+    }
+    topics.intern(topic);
+    topic_to_indexes[route(topic_to_indexes, router, topic)].add(index);
+}
+
+/* whether any of the topic and value pairs sent to the sim wakes it;
+ * topic is scratch space */
+static bool pairs_wake(const SimulatorState &state,
+        const vector<zframe_t*> &pairs, string &topic)
+{
+    if (state.passive_values.empty() && state.passive_patterns.empty()) {
+        return true;
+    }
+    for (size_t j=0; j<pairs.size(); j+=2) {
+        fncs::to_string(pairs[j], topic);
+        if (wakes_on(state, topics.find(topic), topic)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The ID of the alias the sim subscribed to the topic of the given ID
+ * by, see FNCS_ALIASES, or npos. */
+static size_t alias_of(const SimulatorState &state, size_t id)
+{
+    vector<pair<size_t,size_t> >::const_iterator it = lower_bound(
+            state.aliases.begin(), state.aliases.end(), make_pair(id, size_t(0)));
+    return it != state.aliases.end() && it->first == id ?
+        it->second : fncs::TopicIntern::npos();
+}
+
+/* the name the sim subscribed to the topic by */
+static string subscribed_name(const SimulatorState &state, const string &topic)
+{
+    if (state.aliases.empty()) {
+        return topic;
+    }
+    size_t alias = alias_of(state, topics.find(topic));
+    return alias == fncs::TopicIntern::npos() ? topic : topics.str(alias);
+}
+
+/* The topic and value pairs to send the sim, renamed in renamed to the
+ * aliases it subscribed by, if any; the new topic frames go to owned. */
+static const vector<zframe_t*>& aliased(const SimulatorState &state,
+        const vector<zframe_t*> &pairs, vector<zframe_t*> &renamed,
+        vector<zframe_t*> &owned)
+{
+    if (state.aliases.empty()) {
+        return pairs;
+    }
+    string topic;
+    renamed = pairs;
+    for (size_t j=0; j<pairs.size(); j+=2) {
+        fncs::to_string(pairs[j], topic);
+        size_t alias = alias_of(state, topics.find(topic));
+        if (alias != fncs::TopicIntern::npos()) {
+            renamed[j] = zframe_new(topics.data(alias), topics.length(alias));
+            owned.push_back(renamed[j]);
+        }
+    }
+    return renamed;
+}
+
+/* Move the topic and value pairs of the sim's prioritized topics ahead
+ * of the others, each keeping its order, using rest as scratch; the
+ * number of frames moved. */
+static size_t prioritize_pairs(const SimulatorState &state,
+        vector<zframe_t*> &pairs, vector<zframe_t*> &rest)
+{
+    string topic;
+    size_t n = 0;
+    rest.clear();
+    for (size_t j=0; j<pairs.size(); j+=2) {
+        fncs::to_string(pairs[j], topic);
+        if (prioritized_on(state, topics.find(topic), topic)) {
+            pairs[n++] = pairs[j];
+            pairs[n++] = pairs[j+1];
+        }
+        else {
+            rest.push_back(pairs[j]);
+            rest.push_back(pairs[j+1]);
+        }
+    }
+    copy(rest.begin(), rest.end(), pairs.begin() + n);
+    return n;
+}
+
+/* The subscribers a PUBLISH of the route's topic is sent to, built
+ * when first needed after its subscribers changed, so the fan-out does
+ * not look back into their states. */
+static const vector<Send>& send_list(const SimVec &simulators,
+        Route &route, size_t id)
+{
+    if (route.sends_generation != send_lists_generation) {
+        string topic(topics.data(id), topics.length(id));
+        route.sends.clear();
+        for (size_t j=0; j<route.indexes.size(); ++j) {
+            const SimulatorState &state = simulators[route.indexes[j]];
+            if (!state.departed) {
+                bool by_id = state.topic_ids && binary_search(state.subscription_values.begin(),
+                        state.subscription_values.end(), id);
+                route.sends.push_back(Send(route.indexes[j], state.binary, !state.members.empty(),
+                            !state.filters.empty() || !state.filter_patterns.empty(),
+                            (delivery_batch || has_priorities(state))
+                                && state.negotiated && state.members.empty()
+                                && !prioritized_on(state, id, topic),
+                            wakes_on(state, id, topic), by_id,
+                            /* its ACK told it the ID stands for the alias */
+                            by_id ? fncs::TopicIntern::npos() : alias_of(state, id)));
+            }
+        }
+        route.sends_generation = send_lists_generation;
+    }
+    return route.sends;
+}
+
+typedef vector<set<size_t> > SimGraph;
+
+/* A topic's last value in a PUBLISH_BATCH, and whether its first pair
+ * of the batch was gathered, stamped with the batch so that it never
+ * needs to be cleared. */
+class Coalesced {
+    public:
+        Coalesced() : value(NULL), batch(0) {}
+
+        /* whether this is the first of the topic's pairs in the batch */
+        bool first(unsigned long long n_batch) {
+            if (batch == n_batch) {
+                return false;
+            }
+            batch = n_batch;
+            return true;
+        }
+
+        zframe_t *value;
+        unsigned long long batch;
+};
+
+/* What the dispatcher needs per message, kept across messages so that,
+ * once their capacity suffices, forwarding a value allocates nothing. */
+class DispatchBuffers {
+    public:
+        DispatchBuffers()
+            : sender()
+            , topic()
+            , body()
+            , text_body()
+            , id_body()
+            , alias_body()
+            , owned()
+            , ids()
+            , dests()
+            , pairs()
+            , coalesced()
+            , cast_bitmap()
+            , n_batches(0)
+        {}
+
+        Coalesced& coalesce(size_t id) {
+            if (id >= coalesced.size()) {
+                coalesced.resize(topics.size());
+            }
+            return coalesced[id];
+        }
+
+        vector<zframe_t*>& pairs_of(size_t index) {
+            if (index >= pairs.size()) {
+                pairs.resize(index+1);
+            }
+            return pairs[index];
+        }
+
+        string sender;
+        string topic;
+        vector<zframe_t*> body;
+        vector<zframe_t*> text_body;
+        vector<zframe_t*> id_body; /* with the topic's ID, see fncs::TOPIC_IDS */
+        vector<zframe_t*> alias_body; /* with the name a sim subscribed by, see alias_of() */
+        vector<zframe_t*> owned;
+        IndexVec ids;
+        IndexVec dests;
+        vector<vector<zframe_t*> > pairs; /* by subscriber */
+        vector<Coalesced> coalesced; /* by topic ID */
+        string cast_bitmap; /* see FNCS_CAST_TOPICS */
+        unsigned long long n_batches;
+};
+
+/* A group of sims connected through their subscriptions. Clusters never
+ * exchange messages, so each keeps its own clock and grants a new time
+ * once its own members have all reported. */
+class Cluster {
+    public:
+        Cluster()
+            : members()
+            , schedule()
+            , n_processing(0)
+            , time_granted(0)
+        {}
+
+        IndexVec members;
+        fncs::GrantQueue schedule; /* keyed by position in members */
+        int n_processing;
+        fncs::time time_granted;
+};
+
+typedef vector<Cluster> ClusterVec;
+
+/* how the broker decides when to grant */
+enum Barrier {
+    BARRIER_GLOBAL,  /* one clock, every sim reports before a grant */
+    BARRIER_CLUSTER, /* one clock per connected component */
+    BARRIER_PARTIAL  /* per sim, as dependencies allow */
+};
+
+/* what realtime mode does once a grant missed its deadline */
+enum CatchUp {
+    CATCHUP_BURST, /* release the late grants back to back until caught up */
+    CATCHUP_SKIP,  /* shift the later deadlines by the lateness instead */
+    CATCHUP_ABORT  /* end the federation */
+};
+
+/* lateness histogram buckets, decades from below 1 us to 1 s and above */
+static const size_t REALTIME_BUCKETS = 8;
+
+static BROKER_LOCAL fncs::time time_real_start; /* realtime_now() when all sims joined */
+static BROKER_LOCAL double realtime_scale = 1.0; /* FNCS_REALTIME_SCALE, sim per wall time */
+static BROKER_LOCAL CatchUp realtime_policy = CATCHUP_BURST; /* FNCS_REALTIME_POLICY */
+static BROKER_LOCAL fncs::time realtime_tolerance = 1000000; /* FNCS_REALTIME_TOLERANCE */
+static BROKER_LOCAL fncs::time realtime_rounds = 0; /* grants paced against the clock */
+static BROKER_LOCAL fncs::time realtime_late_rounds = 0; /* ... released after deadline + tolerance */
+static BROKER_LOCAL fncs::time realtime_lateness_total = 0;
+static BROKER_LOCAL fncs::time realtime_lateness_max = 0;
+static BROKER_LOCAL fncs::time realtime_skipped = 0; /* wall time CATCHUP_SKIP gave up */
+static BROKER_LOCAL unsigned long long realtime_histogram[REALTIME_BUCKETS];
+static BROKER_LOCAL ofstream trace; /* the trace stream, if requested */
+static BROKER_LOCAL fncs::TraceWriter *trace_writer = NULL; /* binary trace, if requested */
+static BROKER_LOCAL fncs::TraceWriter *recorder = NULL; /* FNCS_RECORD, every inbound message ... */
+static BROKER_LOCAL unsigned long long round_count = 0; /* ... with the number of grant times so far ... */
+static BROKER_LOCAL fncs::time round_time = 0; /* ... and the last of them */
+static BROKER_LOCAL fncs::TraceReader *replay = NULL; /* FNCS_REPLAY, a record re-driving one sim ... */
+static BROKER_LOCAL string replay_sim; /* ... FNCS_REPLAY_SIM, the one connected ... */
+static BROKER_LOCAL zmsg_t *replay_next = NULL; /* ... and the next message of the record */
+static BROKER_LOCAL fncs::BrokerMetrics *broker_metrics = NULL; /* if requested */
+static BROKER_LOCAL fncs::Timeline *timeline = NULL; /* if requested */
+static BROKER_LOCAL fncs::SimMetrics *straggler = NULL; /* sim whose report is granting */
+static BROKER_LOCAL bool straggler_released = false; /* its report released another sim */
+static BROKER_LOCAL unsigned long long load_interval = 0; /* FNCS_LOAD_FEEDBACK, grants per summary */
+static BROKER_LOCAL double load_round_mean = 0; /* wall time between grants of any sim, averaged */
+static BROKER_LOCAL fncs::time load_blocked_total = 0; /* waited by sims on another's report */
+static BROKER_LOCAL bool lookahead_declared = false; /* some sim declared a lookahead */
+static BROKER_LOCAL bool publish_declared = false; /* some sim declared a next publish time */
+static BROKER_LOCAL bool lease = false; /* FNCS_LEASE, see grant_lease() */
+static BROKER_LOCAL zsock_t *root = NULL; /* the root broker, if running as a sub-broker */
+static BROKER_LOCAL bool root_binary = false; /* protocol negotiated with the root */
+static BROKER_LOCAL fncs::time root_time = 0; /* time last granted by the root */
+static BROKER_LOCAL bool compression = false; /* every sim reads compressed values */
+static BROKER_LOCAL bool dictionary_wanted = false; /* FNCS_DICTIONARY or FNCS_DICTIONARY_LEARN ... */
+static BROKER_LOCAL bool dictionary = false; /* ... and every sim reads coded values */
+static BROKER_LOCAL unsigned long dictionary_repeats = 0; /* coded once published this often, 0 never ... */
+static BROKER_LOCAL fncs::HashMap<string,unsigned long>::type dictionary_seen; /* ... counted until then */
+static BROKER_LOCAL unsigned long long delayed_order = 0; /* delayed values so far */
+static BROKER_LOCAL const char *broker_file = NULL; /* where the endpoint is shared */
+static BROKER_LOCAL bool embedded = false; /* on a thread of the application, see fncs::Broker */
+static BROKER_LOCAL const char *tenant = NULL; /* the namespace hosted, see tenant_host() */
+static BROKER_LOCAL bool optimistic = false; /* FNCS_OPTIMISTIC, see optimistic_advance() */
+static BROKER_LOCAL zsock_t *grant_cast = NULL; /* FNCS_GRANT_CAST, see grant_cast_flush() */
+static BROKER_LOCAL const char *grant_cast_endpoint = NULL; /* ... as told in the ACK */
+static BROKER_LOCAL zsock_t *data_server = NULL; /* FNCS_DATA_CHANNEL, see values_to() */
+static BROKER_LOCAL const char *data_endpoint = NULL; /* ... as told in the ACK */
+static BROKER_LOCAL unsigned long long sends_stalled = 0; /* sims at their HWM, see send_identity() */
+static BROKER_LOCAL fncs::time send_stall_time = 0; /* ... waited for them to read */
+static BROKER_LOCAL unsigned long long sends_unroutable = 0; /* sims no longer connected */
+static BROKER_LOCAL map<fncs::time,string> grant_cast_bitmaps; /* bitmap of the sims per time */
+static BROKER_LOCAL unsigned long long grant_cast_seq = 0; /* of the last message cast */
+static BROKER_LOCAL set<string> cast_topics; /* FNCS_CAST_TOPICS, values cast as grants are */
+static BROKER_LOCAL map<size_t,IndexVec> direct_subscribers; /* by topic ID, see plan_direct() */
+static BROKER_LOCAL bool last_values = false; /* FNCS_LAST_VALUES, see keep_last_value() */
+static BROKER_LOCAL bool pulled_values = false; /* some sim pulls some, see fncs::PULL */
+static BROKER_LOCAL AggregateVec aggregates; /* FNCS_AGGREGATES, see aggregate_update() */
+static BROKER_LOCAL map<size_t,IndexVec> aggregate_inputs; /* aggregates by input topic ID */
+static BROKER_LOCAL map<string,string> aliases; /* FNCS_ALIASES, the topic each stands for */
+static BROKER_LOCAL vector<Link> links; /* FNCS_LINKS, see link_arrival() */
+
+/* marks the list of sims behind a sub-broker in its HELLO */
+static const char * const MEMBERS = "members";
+
+/* record one published value in whichever trace is open */
+static void trace_publish(fncs::time time, const string &topic, zframe_t *value)
+{
+    if (trace_writer) {
+        /* a code would mean nothing to whoever reads the trace */
+        const string *coded = value ?
+            coded_values.lookup(zframe_data(value), zframe_size(value)) : NULL;
+        if (coded) {
+            trace_writer->publish(time, topic, coded->data(), coded->size());
+        }
+        else {
+            trace_writer->publish(time, topic,
+                    value ? zframe_data(value) : NULL,
+                    value ? zframe_size(value) : 0);
+        }
+    }
+    else if (trace.is_open()) {
+        /* no endl; flushing every record halves broker throughput */
+        trace << time << '\t' << topic << '\t';
+        if (value) {
+            string text;
+            if (binary_text(zframe_data(value), zframe_size(value), text)) {
+                trace << text;
+            }
+            else {
+                trace.write((const char*)zframe_data(value), zframe_size(value));
+            }
+        }
+        trace << '\n';
+    }
+}
+
+/* the writer thread must be joined before zsys_shutdown() */
+static void trace_close()
+{
+    if (trace_writer) {
+        trace_writer->close();
+        delete trace_writer;
+        trace_writer = NULL;
+    }
+    if (recorder) {
+        recorder->close();
+        delete recorder;
+        recorder = NULL;
+    }
+    delete replay;
+    replay = NULL;
+    zmsg_destroy(&replay_next);
+    if (trace.is_open()) {
+        trace.close();
+    }
+}
+
+static fncs::SimMetricsVec sim_metrics(const SimVec &simulators)
+{
+    fncs::SimMetricsVec sims;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        sims.push_back(make_pair(simulators[i].name, simulators[i].metrics));
+    }
+    return sims;
+}
+
+static size_t string_bytes(const string &s)
+{
+    return sizeof(s) + s.capacity();
+}
+
+/* the bytes held in the routes, the values kept of each topic and the
+ * values queued for the sims, see fncs::BrokerMemory */
+static fncs::BrokerMemory memory_count(const SimVec &simulators,
+        const TopicMap &topic_to_indexes)
+{
+    fncs::BrokerMemory memory;
+    memory.bytes_routing = topics.bytes()
+        + topic_to_indexes.capacity() * sizeof(Route);
+    for (size_t i=0; i<topic_to_indexes.size(); ++i) {
+        const Route &route = topic_to_indexes[i];
+        memory.bytes_routing += route.indexes.capacity() * sizeof(route.indexes[0])
+            + route.sends.capacity() * sizeof(Send);
+        memory.bytes_values += route.last_value.capacity()
+            + route.prior_value.capacity();
+    }
+    for (size_t i=0; i<simulators.size(); ++i) {
+        const SimulatorState &state = simulators[i];
+        memory.bytes_routing += state.subscription_values.capacity() * sizeof(size_t)
+            + state.subscription_ids.capacity() * sizeof(size_t)
+            + state.list_values.capacity() * sizeof(size_t)
+            + state.passive_values.capacity() * sizeof(size_t)
+            + state.priority_values.capacity() * sizeof(size_t);
+        for (size_t j=0; j<state.outbox.size(); ++j) {
+            memory.bytes_pending += zframe_size(state.outbox[j]);
+        }
+        for (size_t j=0; j<state.inbox.size(); ++j) {
+            memory.bytes_pending += string_bytes(state.inbox[j].topic)
+                + string_bytes(state.inbox[j].value);
+        }
+        for (size_t j=0; j<state.consumed.size(); ++j) {
+            memory.bytes_pending += string_bytes(state.consumed[j].topic)
+                + string_bytes(state.consumed[j].value);
+        }
+        /* a priority_queue hides its values, so each counts at its size */
+        memory.bytes_pending += state.delayed.size() * sizeof(Delayed);
+    }
+    return memory;
+}
+
+/* publish and log a metrics snapshot */
+static void metrics_report(const SimVec &simulators, const TopicMap &topic_to_indexes)
+{
+    broker_metrics->report(fncs::timer_ft(), sim_metrics(simulators),
+            memory_count(simulators, topic_to_indexes));
+}
+
+static void metrics_close()
+{
+    if (broker_metrics) {
+        broker_metrics->close();
+        delete broker_metrics;
+        broker_metrics = NULL;
+    }
+    if (timeline) {
+        timeline->close();
+        delete timeline;
+        timeline = NULL;
+    }
+}
+
+
+/* Share the tcp:// endpoint the broker bound, as connectable from other
+ * hosts, for sims that know no broker host, e.g. the ranks of an mpirun
+ * on a shared file system. A wildcard host is shared as
+ * FNCS_BROKER_ADVERTISE or else this host's name; an interface name, as
+ * tcp://ib0:5570, only as FNCS_BROKER_ADVERTISE, since the host's name
+ * may resolve to another network. Anything else is not written. */
+static void broker_file_write(zsock_t *server, const string &endpoints,
+        const char *advertise)
+{
+    static const string TCP("tcp://");
+    string shared;
+    size_t begin = 0;
+
+    while (begin <= endpoints.size()) {
+        size_t end = endpoints.find(',', begin);
+        if (end == string::npos) {
+            end = endpoints.size();
+        }
+        string endpoint = endpoints.substr(begin, end - begin);
+        if (!endpoint.empty() && (endpoint[0] == '@' || endpoint[0] == '>')) {
+            endpoint.erase(0, 1);
+        }
+        if (endpoint.compare(0, TCP.size(), TCP) == 0) {
+            shared = endpoint;
+            if (end == endpoints.size()) {
+                /* bound last, so zmq knows the port it picked */
+                char last[256] = "";
+                size_t size = sizeof(last);
+                zmq_getsockopt(zsock_resolve(server), ZMQ_LAST_ENDPOINT, last, &size);
+                shared = last;
+            }
+            break;
+        }
+        begin = end + 1;
+    }
+    size_t colon = shared.rfind(':');
+    if (shared.empty() || colon == string::npos || colon < TCP.size()) {
+        LERROR << "FNCS_BROKER_FILE needs a tcp:// endpoint in FNCS_BROKER '"
+               << endpoints << "'";
+        exit(EXIT_FAILURE);
+    }
+    string host = shared.substr(TCP.size(), colon - TCP.size());
+    string port = shared.substr(colon + 1);
+    if (port.empty() || port.find_first_not_of("0123456789") != string::npos) {
+        LERROR << "FNCS_BROKER_FILE cannot share the port of '" << shared
+               << "', which zmq picks; bind it last in FNCS_BROKER or name it";
+        exit(EXIT_FAILURE);
+    }
+    if (advertise && *advertise) {
+        host = advertise;
+    }
+    else if (host == "*" || host == "0.0.0.0" || host == "[::]" || host == "::") {
+        char name[256] = "";
+        if (0 != gethostname(name, sizeof(name) - 1) || !*name) {
+            LERROR << "FNCS_BROKER_FILE cannot share the wildcard '" << shared
+                   << "' without the host's name; set FNCS_BROKER_ADVERTISE";
+            exit(EXIT_FAILURE);
+        }
+        host = name;
+    }
+#ifndef _WIN32
+    else if (if_nametoindex(host.c_str())) {
+        LERROR << "FNCS_BROKER_FILE cannot share '" << shared
+               << "', which names the interface " << host
+               << "; set FNCS_BROKER_ADVERTISE to its address";
+        exit(EXIT_FAILURE);
+    }
+#endif
+    shared = TCP + host + ":" + port;
+
+    string tmp = string(broker_file) + ".tmp";
+    ofstream out(tmp.c_str());
+    out << shared << '\n';
+    out.close();
+    remove(broker_file);
+    if (!out || 0 != rename(tmp.c_str(), broker_file)) {
+        LERROR << "could not write FNCS_BROKER_FILE '" << broker_file << "'";
+        exit(EXIT_FAILURE);
+    }
+    LDEBUG4C(logCONFIG) << "shared " << shared << " in " << broker_file;
+}
+
+/* a later run must not find the endpoint of this one */
+static void broker_file_remove()
+{
+    if (broker_file) {
+        remove(broker_file);
+    }
+}
+
+static void broker_die(const SimVec &simulators, zsock_t *server) {
+    /* repeat the fatal die to all connected sims, not waiting long on
+     * one that stopped reading */
+    if (server) {
+        zsock_set_sndtimeo(server, 1000);
+        for (size_t i=0; i<simulators.size(); ++i) {
+            zstr_sendm(server, simulators[i].name.c_str());
+            fncs::send_type(server, fncs::MSG_DIE, simulators[i].binary, false);
+        }
+    }
+    if (root) {
+        fncs::send_type(root, fncs::MSG_DIE, root_binary, false);
+        zsock_destroy(&root);
+    }
+    zsock_destroy(&grant_cast);
+    zsock_destroy(&data_server);
+    zsock_destroy(&server);
+    broker_file_remove();
+    trace_close();
+    metrics_close();
+    if (!embedded) {
+        fncs::stop_async_logging();
+        zsys_shutdown(); /* without this, Windows will assert */
+    }
+    exit(EXIT_FAILURE);
+}
+
+/* a time frame of a sim or of the root; a malformed one is fatal to
+ * the federation, which is told so */
+static fncs::time frame_time(
+        const SimVec &simulators,
+        zsock_t *server,
+        zframe_t *frame,
+        bool binary)
+{
+    fncs::time value = 0;
+    if (!fncs::try_to_time(frame, binary, value)) {
+        broker_die(simulators, server);
+    }
+    return value;
+}
+
+/* the state a previous run in this process left behind */
+static void globals_reset()
+{
+    time_real_start = 0;
+    realtime_rounds = 0;
+    realtime_late_rounds = 0;
+    realtime_lateness_total = 0;
+    realtime_lateness_max = 0;
+    realtime_scale = 1.0;
+    realtime_policy = CATCHUP_BURST;
+    realtime_tolerance = 1000000;
+    realtime_skipped = 0;
+    for (size_t i=0; i<REALTIME_BUCKETS; ++i) {
+        realtime_histogram[i] = 0;
+    }
+    straggler = NULL;
+    straggler_released = false;
+    lookahead_declared = false;
+    publish_declared = false;
+    lease = false;
+    root = NULL;
+    root_binary = false;
+    root_time = 0;
+    compression = false;
+    dictionary_wanted = false;
+    dictionary = false;
+    coded_values = fncs::ValueDictionary();
+    dictionary_repeats = 0;
+    dictionary_seen.clear();
+    delayed_order = 0;
+    broker_file = NULL;
+    tenant = NULL;
+    optimistic = false;
+    grant_cast = NULL;
+    grant_cast_endpoint = NULL;
+    data_server = NULL;
+    data_endpoint = NULL;
+    sends_stalled = 0;
+    send_stall_time = 0;
+    sends_unroutable = 0;
+    grant_cast_bitmaps.clear();
+    grant_cast_seq = 0;
+    cast_topics.clear();
+    direct_subscribers.clear();
+    last_values = false;
+    pulled_values = false;
+    aggregates.clear();
+    aggregate_inputs.clear();
+    aliases.clear();
+    links.clear();
+    round_count = 0;
+    round_time = 0;
+    replay_sim.clear();
+    topics.clear();
+    send_lists_generation = 1;
+    delivery_batch = 0;
+    load_interval = 0;
+    load_round_mean = 0;
+    load_blocked_total = 0;
+}
+
+/* Read the next message of the record into replay_next, which is NULL
+ * once the record ends; any values it traced are skipped. */
+static void replay_advance()
+{
+    fncs::TraceRecord record;
+    bool found = false;
+
+    zmsg_destroy(&replay_next);
+    while (replay && !found && replay->next(record)) {
+        found = fncs::TRACE_MESSAGE == record.type;
+    }
+    if (!found) {
+        if (replay && replay->corrupt()) {
+            LERROR << "replay: the record is truncated or corrupt";
+        }
+        delete replay;
+        replay = NULL;
+        return;
+    }
+    replay_next = zmsg_new();
+    for (size_t i=0; i<record.frames.size(); ++i) {
+        zmsg_addmem(replay_next, record.frames[i].data(), record.frames[i].size());
+    }
+}
+
+/* Open a record of FNCS_RECORD to re-drive replay_sim with. */
+static bool replay_open(const char *filename)
+{
+    replay = new fncs::TraceReader;
+    if (!replay->open(filename)) {
+        LERROR << "'" << filename << "' is not a FNCS record";
+        delete replay;
+        replay = NULL;
+        return false;
+    }
+    replay_advance();
+    return true;
+}
+
+/* whether the identity is the replayed sim's, or its FETCH DEALER's */
+static bool replay_live(const string &sender)
+{
+    return 0 == sender.compare(0, replay_sim.size(), replay_sim)
+        && (sender.size() == replay_sim.size() || sender[replay_sim.size()] == '/');
+}
+
+/* The next message of the record if a stubbed sim sent it, which is
+ * then handled as if it had just arrived; NULL if the replayed sim's
+ * comes first, or the record ended. */
+static zmsg_t* replay_take()
+{
+    if (!replay_next || replay_live(fncs::to_string(zmsg_first(replay_next)))) {
+        return NULL;
+    }
+    zmsg_t *msg = replay_next;
+    replay_next = NULL;
+    replay_advance();
+    return msg;
+}
+
+/* The replayed sim sends its messages in the order they were recorded,
+ * unless it no longer behaves as it did; note where that happens. */
+static void replay_check(zmsg_t *msg)
+{
+    if (!replay_next) {
+        return;
+    }
+    zframe_t *sender = zmsg_first(msg);
+    zframe_t *type = zmsg_next(msg);
+    zframe_t *recorded_sender = zmsg_first(replay_next);
+    zframe_t *recorded_type = zmsg_next(replay_next);
+    if (!zframe_eq(sender, recorded_sender)
+            || (type && recorded_type && fncs::to_type(type) != fncs::to_type(recorded_type))) {
+        LWARNING << "replay diverges: " << fncs::to_string(sender) << " sent "
+            << (type ? fncs::to_string(fncs::to_type(type)) : "nothing")
+            << " where the record has " << fncs::to_string(recorded_sender) << " send "
+            << (recorded_type ? fncs::to_string(fncs::to_type(recorded_type)) : "nothing");
+    }
+    replay_advance();
+}
+
+static const char * const CHECKPOINT_FILE = "broker_checkpoint.txt";
+
+/* Write the time about to be granted and the time state of every sim,
+ * one tab separated line each, replacing any earlier checkpoint only
+ * once the new one is complete. Nothing else is in flight: at a grant
+ * boundary every publish has already been forwarded and is held by its
+ * subscriber until the grant. */
+static bool checkpoint_write(fncs::time time_granted, const SimVec &simulators)
+{
+    string tmp = string(CHECKPOINT_FILE) + ".tmp";
+    ofstream out(tmp.c_str());
+    out << "#fncs broker checkpoint" << '\n';
+    out << time_granted << '\n';
+    for (size_t i=0; i<simulators.size(); ++i) {
+        const SimulatorState &state = simulators[i];
+        if (!state.delayed.empty()) {
+            LWARNING << "values held for " << state.name << " are not in the checkpoint";
+        }
+        out << state.name
+            << '\t' << state.time_delta
+            << '\t' << state.time_requested
+            << '\t' << state.time_last_processed
+            << '\t' << state.time_current
+            << '\t' << state.lookahead_floor
+            << '\t' << state.messages_pending
+            << '\t' << state.departed
+            << '\n';
+    }
+    out.close();
+    if (!out) {
+        LERROR << "could not write checkpoint '" << tmp << "'";
+        return false;
+    }
+    remove(CHECKPOINT_FILE);
+    if (0 != rename(tmp.c_str(), CHECKPOINT_FILE)) {
+        LERROR << "could not rename checkpoint to '" << CHECKPOINT_FILE << "'";
+        return false;
+    }
+    return true;
+}
+
+/* Read the checkpoint checkpoint_write() left; states are keyed by sim
+ * name with only the fields it writes filled in. */
+static bool checkpoint_read(fncs::time &time_granted, map<string,SimulatorState> &states)
+{
+    ifstream in(CHECKPOINT_FILE);
+    string line;
+
+    if (!getline(in, line) || line != "#fncs broker checkpoint"
+            || !getline(in, line)) {
+        LERROR << "'" << CHECKPOINT_FILE << "' is not a broker checkpoint";
+        return false;
+    }
+    istringstream(line) >> time_granted;
+    while (getline(in, line)) {
+        SimulatorState state;
+        istringstream fields(line);
+        if (!getline(fields, state.name, '\t')
+                || !(fields >> state.time_delta >> state.time_requested
+                    >> state.time_last_processed >> state.time_current
+                    >> state.lookahead_floor >> state.messages_pending
+                    >> state.departed)) {
+            LERROR << "malformed checkpoint line '" << line << "'";
+            return false;
+        }
+        states[state.name] = state;
+    }
+    return true;
+}
+
+/* a size in messages or bytes from the environment, -1 if not given */
+static int env_size(const char *name)
+{
+    const char *env = getenv(name);
+    if (!env) {
+        return -1;
+    }
+    char *end = NULL;
+    long size = strtol(env, &end, 10);
+    if (end == env || *end || size < 0 || size > INT_MAX) {
+        LERROR << name << " must be a size, not '" << env << "'";
+        exit(EXIT_FAILURE);
+    }
+    return static_cast<int>(size);
+}
+
+/* Size a ROUTER the broker sends to the sims on before it binds: its
+ * high water marks, in messages, 0 for none, and its kernel buffers, in
+ * bytes, from FNCS_SNDHWM, FNCS_RCVHWM, FNCS_SNDBUF and FNCS_RCVBUF
+ * where given, the sending one overridden by sndhwm unless negative. */
+static void router_options(zsock_t *sock, int sndhwm)
+{
+    int rcvhwm = env_size("FNCS_RCVHWM");
+    int sndbuf = env_size("FNCS_SNDBUF");
+    int rcvbuf = env_size("FNCS_RCVBUF");
+    if (sndhwm < 0) {
+        sndhwm = env_size("FNCS_SNDHWM");
+    }
+    if (sndhwm >= 0) {
+        zsock_set_sndhwm(sock, sndhwm);
+    }
+    if (rcvhwm >= 0) {
+        zsock_set_rcvhwm(sock, rcvhwm);
+    }
+    if (sndbuf >= 0) {
+        zsock_set_sndbuf(sock, sndbuf);
+    }
+    if (rcvbuf >= 0) {
+        zsock_set_rcvbuf(sock, rcvbuf);
+    }
+    /* a sim at its high water mark is waited for, see send_identity() */
+    zsock_set_router_mandatory(sock, 1);
+}
+
+/* Start a message to the sim on a ROUTER of the broker. The ROUTERs are
+ * set to ZMQ_ROUTER_MANDATORY, so a sim whose queue is at its high water
+ * mark is not dropped from, but waited for; meanwhile the broker reads
+ * nothing more from the publishers, whose own queues fill up in turn.
+ * Returns -1 if the sim is no longer connected. */
+static int send_identity(zsock_t *sock, const SimulatorState &state)
+{
+    zframe_t *identity = state.identity;
+    int rc = zframe_send(&identity, sock, ZFRAME_REUSE | ZFRAME_MORE | ZFRAME_DONTWAIT);
+    if (rc == -1 && errno == EAGAIN) {
+        fncs::time stalled = fncs::timer_ft();
+        ++sends_stalled;
+        LDEBUG4C(logPUBLISH) << "waiting for " << state.name << " to read";
+        rc = zframe_send(&identity, sock, ZFRAME_REUSE | ZFRAME_MORE);
+        send_stall_time += fncs::timer_ft() - stalled;
+    }
+    if (rc == -1 && errno == EHOSTUNREACH) {
+        ++sends_unroutable;
+        LERROR << state.name << " is no longer connected";
+    }
+    return rc == -1 ? -1 : 0;
+}
+
+/* Tell the first n sims the federation is over, except those that were
+ * answered their BYE when they detached. */
+static void send_byes(zsock_t *server, const SimVec &simulators, size_t n)
+{
+    for (size_t i=0; i<n; ++i) {
+        if (simulators[i].detached) {
+            continue;
+        }
+        send_identity(server, simulators[i]);
+        fncs::send_type(server, fncs::MSG_BYE, simulators[i].binary, false);
+        LDEBUG4 << "BYE sent to '" << simulators[i].name;
+    }
+}
+
+/* The socket a message of values goes to the sim on: the data channel
+ * once it reads it, whose messages the fence of the next grant counts,
+ * see fncs::DATA, or the socket of the grants. */
+static zsock_t* values_to(zsock_t *server, SimulatorState &state)
+{
+    if (!state.data) {
+        return server;
+    }
+    ++state.direct_expected;
+    return data_server;
+}
+
+/* send the frames queued for the sim as the last ones of a message */
+static void send_outbox(zsock_t *server, SimulatorState &state)
+{
+    bool failed = false;
+    for (size_t j=0; j<state.outbox.size(); ++j) {
+        /* a frame sent is destroyed with it, the rest are here */
+        if (!failed && zframe_send(&state.outbox[j], server,
+                    j+1 < state.outbox.size() ? ZFRAME_MORE : 0)) {
+            failed = true;
+        }
+        zframe_destroy(&state.outbox[j]);
+    }
+    state.outbox.clear();
+    state.unicast_due = true;
+    if (failed) {
+        LERROR << "failed to send pub batch to " << state.name;
+    }
+}
+
+/* Send the PUBLISHes queued for the sim as one PUBLISH_BATCH. Anything
+ * else sent to it goes after, so it sees them in the order they came. */
+static void flush_outbox(zsock_t *server, SimulatorState &state)
+{
+    if (state.outbox.empty()) {
+        return;
+    }
+    LDEBUG4C(logPUBLISH) << "batch of " << state.outbox.size()/2
+        << " pub(s) to " << state.name;
+    zsock_t *out = values_to(server, state);
+    send_identity(out, state);
+    fncs::send_type(out, fncs::MSG_PUBLISH_BATCH, state.binary, true);
+    send_outbox(out, state);
+}
+
+/* Queue the topic and value frames of a PUBLISH for the sim, flushed
+ * once FNCS_DELIVERY_BATCH pairs are held and at the latest with its
+ * next grant. A large value is not queued: the queue is flushed so that
+ * the value follows it, and false tells the caller to send it. */
+static bool queue_publish(zsock_t *server, SimulatorState &state,
+        const vector<zframe_t*> &body)
+{
+    if (body.size() != 2 || zframe_size(body[1]) > DELIVERY_BATCH_VALUE_MAX) {
+        flush_outbox(server, state);
+        return false;
+    }
+    state.outbox.push_back(zframe_dup(body[0]));
+    state.outbox.push_back(zframe_dup(body[1]));
+    if (state.outbox.size() >= 2*(delivery_batch ? delivery_batch : PRIORITY_HOLD)) {
+        flush_outbox(server, state);
+    }
+    return true;
+}
+
+/* Checkpoint before granting time_granted and tell the sims, which may
+ * snapshot themselves before they process that time. */
+static void checkpoint(
+        zsock_t *server,
+        SimVec &simulators,
+        fncs::time time_granted)
+{
+    if (!checkpoint_write(time_granted, simulators)) {
+        broker_die(simulators, server);
+    }
+    LINFO << "checkpoint taken before granting " << time_granted;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        SimulatorState &state = simulators[i];
+        if (state.departed) {
+            continue;
+        }
+        /* older clients do not know the message */
+        if (!state.negotiated) {
+            LWARNING << state.name << " is too old to be told of the checkpoint";
+            continue;
+        }
+        /* the values due before it are part of the state it saves */
+        flush_outbox(server, state);
+        state.unicast_due = true;
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_CHECKPOINT, state.binary, true);
+        fncs::send_time(server, time_granted, state.binary, false);
+    }
+}
+
+/* the time at which an idle sim should next be granted: its request,
+ * or sooner for a value delivered to it */
+static fncs::time time_actionable(const SimulatorState &state)
+{
+    fncs::time time = state.time_requested;
+    if (state.messages_pending) {
+        time = state.time_last_processed + state.time_delta;
+    }
+    if (!state.delayed.empty()) {
+        /* its first step at or after the delivery */
+        fncs::time delivery = state.delayed.top().time;
+        fncs::time step = (delivery / state.time_delta) * state.time_delta;
+        if (step < delivery) {
+            step += state.time_delta;
+        }
+        if (step <= state.time_current) {
+            step = state.time_current + state.time_delta;
+        }
+        time = min(time, step);
+    }
+    return time;
+}
+
+/* Fast forward time last processed of an idle sim to the last multiple
+ * of its delta not beyond the granted time. This used to happen for
+ * every sim after every grant, but repeated fast forwards collapse into
+ * the last one, so it is deferred until a PUBLISH makes the sim
+ * actionable again. Most sims are only a step or two behind, which
+ * needs no 64-bit division. */
+static void fast_forward(SimulatorState &state, fncs::time time_granted)
+{
+    if (time_granted <= state.time_last_processed) {
+        return;
+    }
+    fncs::time gap = time_granted - state.time_last_processed;
+    if (gap < state.time_delta) {
+        return;
+    }
+    if (gap < 2 * state.time_delta) {
+        state.time_last_processed += state.time_delta;
+    }
+    else if (gap < 3 * state.time_delta) {
+        state.time_last_processed += 2 * state.time_delta;
+    }
+    else {
+        state.time_last_processed += state.time_delta * (gap / state.time_delta);
+    }
+}
+
+/* nanoseconds on the clock realtime_sleep_until() sleeps against */
+static fncs::time realtime_now()
+{
+#if defined(_WIN32) || defined(__MACH__)
+    return fncs::timer_ft();
+#else
+    struct timespec ts;
+    long retval = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(0 == retval);
+    return fncs::time(ts.tv_sec)*1000000000UL + ts.tv_nsec;
+#endif
+}
+
+/* Sleep until realtime_now() reaches the absolute deadline. Sleeping to
+ * an absolute time does not accumulate drift across wake-ups and, unlike
+ * the SIGALRM ticker this replaces, does not interrupt zmq's syscalls. */
+static void realtime_sleep_until(fncs::time deadline)
+{
+#if defined(_WIN32)
+    /* waitable timers fire on the scheduler tick, so wake a little early
+     * and yield the rest of the way */
+    static const fncs::time SPIN = 2000000; /* 2 ms */
+    fncs::time now = realtime_now();
+    if (deadline > now + SPIN) {
+        HANDLE timer = CreateWaitableTimer(NULL, TRUE, NULL);
+        if (timer) {
+            LARGE_INTEGER due;
+            /* negative means relative, in 100 ns units */
+            due.QuadPart = -static_cast<LONGLONG>((deadline - now - SPIN) / 100);
+            if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+            }
+            CloseHandle(timer);
+        }
+    }
+    while (realtime_now() < deadline) {
+        SwitchToThread();
+    }
+#elif defined(__MACH__)
+    /* no clock_nanosleep, sleep the remainder until it has passed */
+    fncs::time now = realtime_now();
+    while (now < deadline) {
+        struct timespec ts;
+        ts.tv_sec = (deadline - now) / 1000000000UL;
+        ts.tv_nsec = (deadline - now) % 1000000000UL;
+        nanosleep(&ts, NULL);
+        now = realtime_now();
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000UL;
+    ts.tv_nsec = deadline % 1000000000UL;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+    }
+#endif
+}
+
+/* Pin the calling thread, the broker's, to the given core. */
+static bool pin_to_cpu(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (0 != sched_setaffinity(0, sizeof(set), &set)) {
+        LERROR << "could not pin the broker to cpu " << cpu << ": " << strerror(errno);
+        return false;
+    }
+    return true;
+#elif defined(_WIN32)
+    if (cpu >= static_cast<int>(8 * sizeof(DWORD_PTR))
+            || !SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu)) {
+        LERROR << "could not pin the broker to cpu " << cpu;
+        return false;
+    }
+    return true;
+#else
+    LWARNING << "pinning is not supported on this platform, FNCS_BROKER_CPU ignored";
+    return true;
+#endif
+}
+
+/* Block until the realtime clock catches up with the granted time. Grants
+ * are released on the first multiple of the realtime interval at or after
+ * the granted time, as with the old interval timer, but on that exact
+ * instant instead of whenever the next tick was noticed. With a scale of
+ * k the clock runs k times as fast as the wall. A grant released more than
+ * the tolerance after its deadline missed it, and the catch-up policy
+ * says what happens next; returns false if the federation must end. */
+static bool realtime_wait(fncs::time time_granted, fncs::time realtime_interval)
+{
+    fncs::time ticks = (time_granted + realtime_interval - 1) / realtime_interval;
+    fncs::time deadline = time_real_start + static_cast<fncs::time>(
+            static_cast<double>(ticks * realtime_interval) / realtime_scale);
+    fncs::time lateness = 0;
+    fncs::time now = 0;
+    size_t bucket = 0;
+
+    realtime_sleep_until(deadline);
+
+    now = realtime_now();
+    if (now > deadline) {
+        lateness = now - deadline;
+    }
+    ++realtime_rounds;
+    realtime_lateness_total += lateness;
+    if (lateness > realtime_lateness_max) {
+        realtime_lateness_max = lateness;
+    }
+    for (fncs::time ns = lateness / 1000; ns && bucket < REALTIME_BUCKETS-1; ns /= 10) {
+        ++bucket;
+    }
+    ++realtime_histogram[bucket];
+    LDEBUG4C(logTIME) << "realtime grant " << time_granted
+        << " released " << lateness << " ns after its deadline";
+
+    if (lateness > realtime_tolerance) {
+        ++realtime_late_rounds;
+        if (CATCHUP_ABORT == realtime_policy) {
+            LERROR << "realtime grant " << time_granted << " missed its deadline by "
+                << lateness << " ns, more than FNCS_REALTIME_TOLERANCE allows";
+            return false;
+        }
+        if (CATCHUP_SKIP == realtime_policy) {
+            /* the rounds that follow keep their spacing from now */
+            time_real_start += lateness;
+            realtime_skipped += lateness;
+        }
+    }
+    return true;
+}
+
+/* Send the values held for the sim that are due by the granted time, or
+ * queue them to come with the grant. */
+static void deliver_delayed(zsock_t *server, SimulatorState &state, fncs::time time_granted)
+{
+    while (!state.delayed.empty() && state.delayed.top().time <= time_granted) {
+        const Delayed &held = state.delayed.top();
+        zframe_t *value = zframe_new(held.value.data(), held.value.size());
+        string text;
+        if (!state.binary && binary_text(held.value.data(), held.value.size(), text)) {
+            zframe_reset(value, text.data(), text.size());
+        }
+        if (filter_accepts(state, held.topic, value, held.time)) {
+            LDEBUG4C(logPUBLISH) << "delivering '" << held.topic << "' held for "
+                << held.time << " to " << state.name;
+            string topic = subscribed_name(state, held.topic);
+            if (state.grant_batch) {
+                state.outbox.push_back(zframe_new(topic.data(), topic.size()));
+                state.outbox.push_back(value);
+                value = NULL;
+                state.delayed.pop();
+                continue;
+            }
+            state.unicast_due = true;
+            zsock_t *out = values_to(server, state);
+            send_identity(out, state);
+            fncs::send_type(out, fncs::MSG_PUBLISH, state.binary, true);
+            zstr_sendm(out, topic.c_str());
+            zframe_send(&value, out, 0);
+        }
+        zframe_destroy(&value);
+        state.delayed.pop();
+    }
+}
+
+/* Send the sim the value of each aggregate due to it, as reduced at its
+ * grant, the way deliver_delayed() sends held values. */
+static void send_aggregates(zsock_t *server, SimulatorState &state, fncs::time time_granted)
+{
+    for (size_t j=0; j<state.aggregates_due.size(); ++j) {
+        const Aggregate &aggregate = aggregates[state.aggregates_due[j]];
+        fncs::TypedValue typed;
+        if (!aggregate.reduce(typed)) {
+            continue;
+        }
+        string payload = state.binary ?
+            fncs::encode_typed(typed) : fncs::format_typed(typed);
+        zframe_t *value = zframe_new(payload.data(), payload.size());
+        if (!filter_accepts(state, aggregate.topic, value, time_granted)) {
+            zframe_destroy(&value);
+            continue;
+        }
+        LDEBUG4C(logPUBLISH) << "sending aggregate '" << aggregate.topic
+            << "' to " << state.name;
+        if (state.grant_batch) {
+            state.outbox.push_back(zframe_new(aggregate.topic.data(), aggregate.topic.size()));
+            state.outbox.push_back(value);
+            continue;
+        }
+        state.unicast_due = true;
+        zsock_t *out = values_to(server, state);
+        send_identity(out, state);
+        fncs::send_type(out, fncs::MSG_PUBLISH, state.binary, true);
+        zstr_sendm(out, aggregate.topic.c_str());
+        zframe_send(&value, out, 0);
+    }
+    state.aggregates_due.clear();
+}
+
+/* The subscribers the publisher sent the topic's values to directly,
+ * which the broker does not forward them to, NULL if none. Only the
+ * topics of its own keys are, see plan_direct(). */
+static const IndexVec* direct_sends(
+        const SimulatorState &publisher,
+        size_t id,
+        const string &topic)
+{
+    if (direct_subscribers.empty() || publisher.direct_relayed
+            || topic.size() <= publisher.name.size()
+            || topic.compare(0, publisher.name.size(), publisher.name)
+            || topic[publisher.name.size()] != '/') {
+        return NULL;
+    }
+    map<size_t,IndexVec>::const_iterator it = direct_subscribers.find(id);
+    return it == direct_subscribers.end() ? NULL : &it->second;
+}
+
+/* set the sim's bit in a bitmap of a message cast, see fncs::GRANT_CAST */
+static void cast_set(string &bitmap, size_t index)
+{
+    if (bitmap.size() <= index / 8) {
+        bitmap.resize(index / 8 + 1, '\0');
+    }
+    bitmap[index / 8] |= static_cast<char>(1 << (index % 8));
+}
+
+/* Tell the sim how the federation is doing just before its grant: the
+ * wall time between its last two grants, that of any sim on average,
+ * the values that were queued for it, and its share of the time the
+ * others waited on a report since the last summary, see
+ * fncs::get_federation_load(). */
+static void send_load(zsock_t *server, SimulatorState &state,
+        unsigned long long n_queued)
+{
+    fncs::time blocking = state.metrics.time_blocking - state.load_blocking;
+    fncs::time blocked = load_blocked_total - state.load_blocked;
+    double share = blocked ? static_cast<double>(blocking) / blocked : 0.0;
+    state.load_grants = 0;
+    state.load_blocking = state.metrics.time_blocking;
+    state.load_blocked = load_blocked_total;
+    send_identity(server, state);
+    fncs::send_type(server, fncs::MSG_LOAD, state.binary, true);
+    zstr_sendfm(server, "%llu", (unsigned long long)state.load_round);
+    zstr_sendfm(server, "%llu", (unsigned long long)load_round_mean);
+    zstr_sendfm(server, "%llu", n_queued);
+    zstr_sendf(server, "%.4f", share > 1.0 ? 1.0 : share);
+}
+
+/* Send the go-ahead for the given time to an idle sim. A nonzero window
+ * lets the sim advance that far on its own before requesting again. */
+static void grant(
+        zsock_t *server,
+        SimulatorState &state,
+        fncs::time time_granted,
+        fncs::time window)
+{
+    LDEBUG4C(logTIME) << "granting " << time_granted << " to " << state.name;
+    FNCS_PROBE2(broker_grant, state.name.c_str(), time_granted);
+    if (recorder && (!round_count || time_granted != round_time)) {
+        ++round_count;
+        round_time = time_granted;
+    }
+    /* what piled up for it while it computed */
+    unsigned long long n_queued = state.outbox.size()/2 + state.delayed.size();
+    if (!state.grant_batch) {
+        flush_outbox(server, state);
+    }
+    deliver_delayed(server, state, time_granted);
+    if (!state.aggregates_due.empty()) {
+        send_aggregates(server, state, time_granted);
+    }
+    /* values sent from now on follow this grant on the data channel */
+    if (state.data_ready) {
+        state.data = true;
+    }
+    state.processing = true;
+    state.messages_pending = false;
+    state.time_current = time_granted;
+    if (broker_metrics || load_interval) {
+        fncs::time waited = state.metrics.granted(fncs::timer_ft());
+        if (straggler && straggler != &state.metrics) {
+            straggler->blocked(waited);
+            straggler_released = true;
+            load_blocked_total += waited;
+        }
+    }
+    bool load_due = false;
+    if (state.load) {
+        fncs::time now = fncs::timer_ft();
+        if (state.load_wall) {
+            state.load_round = now - state.load_wall;
+            /* over the last few dozen grants of any sim */
+            load_round_mean = load_round_mean
+                ? load_round_mean + (state.load_round - load_round_mean) / 32
+                : state.load_round;
+        }
+        state.load_wall = now;
+        load_due = ++state.load_grants >= load_interval;
+    }
+    if (timeline) {
+        timeline->granted(state.track, state.name, fncs::timer_ft(), time_granted);
+    }
+    /* a plain grant goes out with the others of its time, unless
+     * something sent to it since may not have arrived yet; one that
+     * does not says what it follows of what was cast */
+    bool unicast_due = state.unicast_due || load_due;
+    bool cast_due = state.cast_due;
+    bool direct_due = state.direct_expected != state.direct_fenced;
+    state.unicast_due = false;
+    state.cast_due = false;
+    if (grant_cast && state.cast_ready && !unicast_due && !direct_due
+            && !window && state.outbox.empty()) {
+        cast_set(grant_cast_bitmaps[time_granted], state.cast_index);
+        return;
+    }
+    if (cast_due) {
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_CAST_FENCE, state.binary, true);
+        zstr_sendf(server, "%llu", grant_cast_seq);
+    }
+    /* and how many values its publishers sent it directly */
+    if (direct_due) {
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_DIRECT_FENCE, state.binary, true);
+        zstr_sendf(server, "%llu", state.direct_expected);
+        state.direct_fenced = state.direct_expected;
+    }
+    if (load_due) {
+        send_load(server, state, n_queued);
+    }
+    send_identity(server, state);
+    fncs::send_type(server, fncs::MSG_TIME_REQUEST, state.binary, true);
+    /* the values queued for it follow a count, see GRANT_BATCH */
+    if (state.grant_batch) {
+        LDEBUG4C(logTIME) << "with " << state.outbox.size()/2 << " value(s)";
+        fncs::send_time(server, time_granted, state.binary, true);
+        fncs::send_time(server, window, state.binary, true);
+        if (state.outbox.empty()) {
+            zstr_sendf(server, "%llu", 0ULL);
+        }
+        else {
+            zstr_sendfm(server, "%llu", (unsigned long long)state.outbox.size()/2);
+            send_outbox(server, state);
+        }
+    }
+    /* older clients and sub-brokers do not expect a window */
+    else if (window && state.negotiated && state.members.empty()) {
+        LDEBUG4C(logTIME) << "with a window of " << window;
+        fncs::send_time(server, time_granted, state.binary, true);
+        fncs::send_time(server, window, state.binary, false);
+    }
+    else {
+        fncs::send_time(server, time_granted, state.binary, false);
+    }
+}
+
+/* Publish the grants collected by grant(), one message per time granted
+ * whatever the number of sims it goes to. Nothing is collected without
+ * FNCS_GRANT_CAST. */
+static void grant_cast_flush()
+{
+    for (map<fncs::time,string>::iterator it=grant_cast_bitmaps.begin();
+            it!=grant_cast_bitmaps.end(); ++it) {
+        LDEBUG4C(logTIME) << "casting grant of " << it->first;
+        zstr_sendm(grant_cast, fncs::GRANT_CAST);
+        zstr_sendfm(grant_cast, "%llu", ++grant_cast_seq);
+        zstr_sendm(grant_cast, fncs::TIME_REQUEST);
+        zstr_sendfm(grant_cast, "%llu", (unsigned long long)it->first);
+        zmq_send(zsock_resolve(grant_cast), it->second.data(), it->second.size(), 0);
+    }
+    grant_cast_bitmaps.clear();
+}
+
+/* requeue an idle sim within its cluster */
+static void reschedule(ClusterVec &clusters, const SimulatorState &state)
+{
+    clusters[state.cluster].schedule.update(
+            state.cluster_pos, time_actionable(state));
+}
+
+/* The step of an optimistic sim that a value published at the time
+ * belongs to: its first multiple of delta after the time, where the
+ * value would have woken it in a conservative federation. */
+static fncs::time time_woken(const SimulatorState &state, fncs::time time)
+{
+    return (time / state.time_delta + 1) * state.time_delta;
+}
+
+/* The time an idle optimistic sim is granted next: its request, or the
+ * grant whose state its due rollback restores, or sooner for a value it
+ * is to be sent. */
+static fncs::time time_optimistic(const SimulatorState &state)
+{
+    fncs::time time = state.rollback_due ? state.rollback_to : state.time_requested;
+    for (size_t i=0; i<state.inbox.size(); ++i) {
+        time = min(time, time_woken(state, state.inbox[i].time));
+    }
+    if (state.rollback_due) {
+        for (size_t i=0; i<state.consumed.size(); ++i) {
+            if (state.consumed[i].grant >= state.rollback_to) {
+                time = min(time, time_woken(state, state.consumed[i].time));
+            }
+        }
+    }
+    return time;
+}
+
+/* The global virtual time: nothing is published before it any more, so
+ * no sim is rolled back to a grant at or before it. */
+static fncs::time optimistic_gvt(const SimVec &simulators)
+{
+    fncs::time gvt = ULLONG_MAX;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        const SimulatorState &state = simulators[i];
+        if (state.departed) {
+            continue;
+        }
+        if (state.processing && !state.rollback_due) {
+            gvt = min(gvt, state.time_current);
+        }
+        else {
+            gvt = min(gvt, time_optimistic(state));
+        }
+    }
+    return gvt;
+}
+
+/* Roll an optimistic sim back to the state of one of its grants, and
+ * undo what it published from then on: values not yet delivered are
+ * dropped, delivered ones roll their receivers back in turn to the grant
+ * they came with. A sim in the middle of a step is told at its next
+ * request, and what it publishes until then is dropped. */
+static void rollback(SimVec &simulators, size_t index, fncs::time time)
+{
+    vector<pair<size_t,fncs::time> > work(1, make_pair(index, time));
+
+    while (!work.empty()) {
+        size_t sender = work.back().first;
+        fncs::time to = work.back().second;
+        SimulatorState &state = simulators[sender];
+        work.pop_back();
+        if (state.rollback_due && state.rollback_to <= to) {
+            continue; /* its values from then on are undone already */
+        }
+        if (state.departed) {
+            LWARNING << state.name << " left before it could redo its step at "
+                << to << " ns, its results from then on are not consistent";
+            continue;
+        }
+        LDEBUG4C(logTIME) << "rolling back " << state.name << " to " << to;
+        state.rollback_due = true;
+        state.rollback_to = to;
+        state.stale = state.processing;
+        for (size_t r=0; r<simulators.size(); ++r) {
+            SentVec &inbox = simulators[r].inbox;
+            SentVec &consumed = simulators[r].consumed;
+            size_t kept = 0;
+            for (size_t i=0; i<inbox.size(); ++i) {
+                if (inbox[i].sender != sender || inbox[i].time < to) {
+                    if (kept != i) {
+                        inbox[kept] = inbox[i];
+                    }
+                    ++kept;
+                }
+            }
+            inbox.erase(inbox.begin() + kept, inbox.end());
+            kept = 0;
+            for (size_t i=0; i<consumed.size(); ++i) {
+                if (consumed[i].sender == sender && consumed[i].time >= to) {
+                    work.push_back(make_pair(r, consumed[i].grant));
+                }
+                else {
+                    if (kept != i) {
+                        consumed[kept] = consumed[i];
+                    }
+                    ++kept;
+                }
+            }
+            consumed.erase(consumed.begin() + kept, consumed.end());
+        }
+    }
+}
+
+/* File a value for an optimistic subscriber. One published before the
+ * subscriber's last grant is a straggler, which rolls it back to its
+ * first grant after the value's time. Returns whether the subscriber
+ * was idle, as its next grant may have changed. */
+static bool optimistic_publish(
+        SimVec &simulators,
+        size_t publisher,
+        size_t index,
+        const string &topic,
+        zframe_t *value)
+{
+    SimulatorState &state = simulators[index];
+    fncs::time time = simulators[publisher].time_current;
+    bool idle = !state.processing;
+
+    if (time < state.time_current) {
+        LDEBUG4C(logTIME) << "straggler '" << topic << "' of " << time
+            << " ns for " << state.name << " at " << state.time_current << " ns";
+        rollback(simulators, index,
+                *upper_bound(state.grants.begin(), state.grants.end(), time));
+        idle = true; /* its rollback may be due now */
+    }
+    /* named as it subscribed, for every resend after a rollback */
+    state.inbox.push_back(Sent(time, publisher, subscribed_name(state, topic), value));
+    return idle;
+}
+
+/* Send an optimistic sim the values of its inbox due by the grant, and
+ * the grant, or the ROLLBACK standing in for it. */
+static void optimistic_grant(zsock_t *server, SimulatorState &state)
+{
+    fncs::time time_granted = time_optimistic(state);
+    fncs::time restored = state.rollback_to;
+    bool rolled_back = state.rollback_due;
+    size_t kept = 0;
+
+    if (rolled_back) {
+        /* redone steps receive their values again */
+        SentVec redo;
+        for (size_t i=0; i<state.consumed.size(); ++i) {
+            if (state.consumed[i].grant >= restored) {
+                redo.push_back(state.consumed[i]);
+            }
+            else {
+                if (kept != i) {
+                    state.consumed[kept] = state.consumed[i];
+                }
+                ++kept;
+            }
+        }
+        state.consumed.erase(state.consumed.begin() + kept, state.consumed.end());
+        state.inbox.insert(state.inbox.begin(), redo.begin(), redo.end());
+        state.grants.erase(lower_bound(state.grants.begin(), state.grants.end(),
+                    restored), state.grants.end());
+        state.rollback_due = false;
+        state.stale = false;
+    }
+
+    kept = 0;
+    for (size_t i=0; i<state.inbox.size(); ++i) {
+        Sent &sent = state.inbox[i];
+        if (sent.time >= time_granted) {
+            if (kept != i) {
+                state.inbox[kept] = sent;
+            }
+            ++kept;
+            continue;
+        }
+        zframe_t *value = zframe_new(sent.value.data(), sent.value.size());
+        string text;
+        if (!state.binary && binary_text(sent.value.data(), sent.value.size(), text)) {
+            zframe_reset(value, text.data(), text.size());
+        }
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_PUBLISH, state.binary, true);
+        zstr_sendm(server, sent.topic.c_str());
+        zframe_send(&value, server, 0);
+        sent.grant = time_granted;
+        state.consumed.push_back(sent);
+    }
+    state.inbox.erase(state.inbox.begin() + kept, state.inbox.end());
+    state.grants.push_back(time_granted);
+
+    if (!rolled_back) {
+        grant(server, state, time_granted, 0);
+        return;
+    }
+    LDEBUG4C(logTIME) << "rolling back " << state.name << " to the state at "
+        << restored << ", granting " << time_granted;
+    state.processing = true;
+    state.time_current = time_granted;
+    if (broker_metrics || load_interval) {
+        state.metrics.granted(fncs::timer_ft());
+    }
+    if (timeline) {
+        timeline->granted(state.track, state.name, fncs::timer_ft(), time_granted);
+    }
+    send_identity(server, state);
+    fncs::send_type(server, fncs::MSG_ROLLBACK, state.binary, true);
+    fncs::send_time(server, restored, state.binary, true);
+    fncs::send_time(server, time_granted, state.binary, false);
+}
+
+/* Grant what the idle sims of an optimistic federation wait for: a due
+ * rollback at once, a request once it is no further than the window past
+ * the GVT, if there is a window. A GVT that advanced is sent to the sims
+ * with states it releases, and what no rollback can reach is forgotten. */
+static void optimistic_advance(
+        zsock_t *server,
+        SimVec &simulators,
+        fncs::time window,
+        fncs::time &gvt)
+{
+    fncs::time now = optimistic_gvt(simulators);
+
+    for (size_t i=0; i<simulators.size(); ++i) {
+        SimulatorState &state = simulators[i];
+        if (state.departed || state.processing) {
+            continue;
+        }
+        if (state.rollback_due || !window || time_optimistic(state) - now <= window) {
+            optimistic_grant(server, state);
+        }
+    }
+
+    if (now == ULLONG_MAX || now <= gvt) {
+        return;
+    }
+    gvt = now;
+    LDEBUG4C(logTIME) << "GVT " << gvt;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        SimulatorState &state = simulators[i];
+        if (state.departed || state.grants.empty() || state.grants.front() > gvt) {
+            continue;
+        }
+        state.grants.erase(state.grants.begin(),
+                upper_bound(state.grants.begin(), state.grants.end(), gvt));
+        size_t kept = 0;
+        for (size_t c=0; c<state.consumed.size(); ++c) {
+            if (state.consumed[c].grant > gvt) {
+                if (kept != c) {
+                    state.consumed[kept] = state.consumed[c];
+                }
+                ++kept;
+            }
+        }
+        state.consumed.erase(state.consumed.begin() + kept, state.consumed.end());
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_GVT, state.binary, true);
+        fncs::send_time(server, gvt, state.binary, false);
+    }
+}
+
+static size_t find_root(IndexVec &parent, size_t i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Partition sims into the connected components of the subscription
+ * graph, ignoring edge direction. With one_cluster set, every sim is
+ * placed into the same cluster, which is the global barrier. */
+static void assign_clusters(
+        SimVec &simulators,
+        const SimGraph &downstream,
+        bool one_cluster,
+        ClusterVec &clusters)
+{
+    size_t n = simulators.size();
+    IndexVec parent(n);
+    map<size_t,size_t> root_to_cluster;
+
+    for (size_t i=0; i<n; ++i) {
+        parent[i] = one_cluster ? 0 : i;
+    }
+    for (size_t i=0; i<n && !one_cluster; ++i) {
+        for (set<size_t>::const_iterator it=downstream[i].begin();
+                it!=downstream[i].end(); ++it) {
+            size_t a = find_root(parent, i);
+            size_t b = find_root(parent, *it);
+            if (a != b) {
+                parent[b] = a;
+            }
+        }
+    }
+
+    clusters.clear();
+    for (size_t i=0; i<n; ++i) {
+        size_t root = find_root(parent, i);
+        map<size_t,size_t>::iterator it = root_to_cluster.find(root);
+        if (it == root_to_cluster.end()) {
+            it = root_to_cluster.insert(make_pair(root, clusters.size())).first;
+            clusters.push_back(Cluster());
+        }
+        Cluster &cluster = clusters[it->second];
+        simulators[i].cluster = it->second;
+        simulators[i].cluster_pos = cluster.members.size();
+        cluster.members.push_back(i);
+    }
+    for (size_t c=0; c<clusters.size(); ++c) {
+        clusters[c].schedule.resize(clusters[c].members.size());
+        clusters[c].n_processing = clusters[c].members.size();
+    }
+}
+
+static fncs::time gcd(fncs::time a, fncs::time b)
+{
+    while (b) {
+        fncs::time t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* The delta a sub-broker reports to the root. Every member time is a
+ * multiple of the gcd of the member deltas, so the root never wakes the
+ * sub-broker later than it would have woken any of its members. */
+static fncs::time members_delta(const SimVec &simulators)
+{
+    fncs::time delta = 0;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        delta = gcd(delta, simulators[i].time_delta);
+    }
+    return delta ? delta : 1;
+}
+
+/* Register with the root broker on behalf of all local sims, the same
+ * way a sim registers with a broker. The local sims' subscriptions to
+ * topics published outside this node are subscribed to in the root as
+ * this sub-broker's own. Returns the topics of local sims that the root
+ * wants forwarded, as 'name/key'. */
+static set<string> root_connect(
+        const char *root_endpoint,
+        const string &name,
+        const SimVec &simulators,
+        const SimIndex &name_to_index,
+        zsock_t *server,
+        set<size_t> &list_topics)
+{
+    fncs::Config config;
+    set<string> remote_topics;
+    set<string> upstream_topics;
+    ostringstream delta;
+    zmsg_t *msg = NULL;
+    zframe_t *frame = NULL;
+    int rc = 0;
+
+    root = zsock_new(ZMQ_DEALER);
+    if (!root) {
+        LERROR << "root socket creation failed";
+        broker_die(simulators, server);
+    }
+    rc = zmq_setsockopt(zsock_resolve(root), ZMQ_IDENTITY, name.c_str(), name.size());
+    if (rc) {
+        LERROR << "root socket identity failed";
+        broker_die(simulators, server);
+    }
+    /* the root waits for it to read, as a client's broker does */
+    zsock_set_sndhwm(root, 0);
+    rc = zsock_attach(root, fncs::resolve_endpoints(root_endpoint).c_str(), false);
+    if (rc) {
+        LERROR << "root socket connection to " << root_endpoint << " failed";
+        broker_die(simulators, server);
+    }
+
+    /* subscriptions to topics no local sim publishes go upstream */
+    for (size_t i=0; i<simulators.size(); ++i) {
+        const vector<size_t> &values = simulators[i].subscription_values;
+        for (size_t v=0; v<values.size(); ++v) {
+            string topic = topics.str(values[v]);
+            size_t loc = topic.find('/');
+            if (loc != string::npos && 0 == name_to_index.count(topic.substr(0,loc))) {
+                upstream_topics.insert(topic);
+            }
+        }
+    }
+    delta << members_delta(simulators) << "ns";
+    config.name = name;
+    config.time_delta = delta.str();
+    for (set<string>::iterator it=upstream_topics.begin();
+            it!=upstream_topics.end(); ++it) {
+        fncs::Subscription sub;
+        sub.key = *it;
+        sub.topic = *it;
+        if (list_topics.count(topics.find(*it))) {
+            sub.list = "true";
+        }
+        config.values.push_back(sub);
+    }
+
+    msg = zmsg_new();
+    zmsg_addstr(msg, fncs::HELLO);
+    zmsg_addstr(msg, config.to_string().c_str());
+    zmsg_addstrf(msg, "%d.%d.%d", FNCS_VERSION_MAJOR, FNCS_VERSION_MINOR, FNCS_VERSION_PATCH);
+    zmsg_addstr(msg, fncs::PROTOCOL_BINARY);
+    /* values are forwarded as they are, so the members decide */
+    bool zstd = true;
+    for (size_t i=0; i<simulators.size(); ++i) {
+        zstd = zstd && simulators[i].zstd && simulators[i].binary;
+    }
+    if (zstd) {
+        zmsg_addstr(msg, fncs::ZSTD);
+    }
+    zmsg_addstr(msg, MEMBERS);
+    for (size_t i=0; i<simulators.size(); ++i) {
+        zmsg_addstr(msg, simulators[i].name.c_str());
+        /* and those of a sub-broker below, so brokers may form a tree */
+        const vector<string> &members = simulators[i].members;
+        for (size_t m=0; m<members.size(); ++m) {
+            zmsg_addstr(msg, members[m].c_str());
+        }
+    }
+    LDEBUG2C(logCONFIG) << "sending HELLO to root as " << name;
+    if (zmsg_send(&msg, root)) {
+        LERROR << "failed to send HELLO to root";
+        broker_die(simulators, server);
+    }
+
+    /* ACK carries the 'name/key' topics the root wants from us */
+    msg = zmsg_recv(root);
+    if (!msg) {
+        LERROR << "null message received from root";
+        broker_die(simulators, server);
+    }
+    frame = zmsg_first(msg);
+    if (!zframe_streq(frame, fncs::ACK)) {
+        LERROR << "ACK expected from root, got " << frame;
+        broker_die(simulators, server);
+    }
+    zmsg_next(msg); /* order ID */
+    zmsg_next(msg); /* n_sims */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LERROR << "ACK from root missing n_keys";
+        broker_die(simulators, server);
+    }
+    int n_keys = atoi(fncs::to_string(frame).c_str());
+    for (int i=0; i<n_keys; ++i) {
+        frame = zmsg_next(msg);
+        if (!frame) {
+            LERROR << "ACK from root missing key " << i;
+            broker_die(simulators, server);
+        }
+        remote_topics.insert(fncs::to_string(frame));
+    }
+    zmsg_next(msg); /* time peer */
+    zmsg_next(msg); /* version */
+    frame = zmsg_next(msg);
+    root_binary = frame && zframe_streq(frame, fncs::PROTOCOL_BINARY);
+    frame = zmsg_next(msg);
+    compression = frame && zframe_streq(frame, fncs::ZSTD);
+    if (compression) {
+        frame = zmsg_next(msg);
+    }
+    if (frame && zframe_streq(frame, fncs::LIST_KEYS)) {
+        for (frame = zmsg_next(msg); frame && !zframe_streq(frame, fncs::ACK)
+                && !zframe_streq(frame, fncs::DELTA_KEYS); frame = zmsg_next(msg)) {
+            list_topics.insert(topics.intern(fncs::to_string(frame)));
+        }
+    }
+    zmsg_destroy(&msg);
+    LDEBUG2C(logCONFIG) << "root expects " << remote_topics.size() << " topic(s)";
+
+    return remote_topics;
+}
+
+/* A sub-broker does not grant on its own. Once its sims are idle it asks
+ * the root for the smallest time any of them can use. */
+static void root_request(const Cluster &cluster)
+{
+    fncs::time time_next = cluster.schedule.top_key();
+    LDEBUG4C(logTIME) << "requesting " << time_next << " from root";
+    fncs::send_type(root, fncs::MSG_TIME_REQUEST, root_binary, true);
+    fncs::send_time(root, time_next, root_binary, true);
+    fncs::send_time(root, root_time, root_binary, false);
+}
+
+/* the earliest time a sim may publish: the time it is processing, or
+ * the time it will next be granted */
+static fncs::time time_frontier(const SimulatorState &state)
+{
+    return state.processing ? state.time_current : time_actionable(state);
+}
+
+/* the earliest time a sim may publish unless a value wakes it: its
+ * frontier, or the next publish time it declared while idle */
+static fncs::time time_publish_next(const SimulatorState &state)
+{
+    fncs::time frontier = time_frontier(state);
+    if (state.processing || state.messages_pending) {
+        return frontier;
+    }
+    return max(frontier, state.time_next_publish);
+}
+
+/* the earliest time a value the sim publishes at the given time may
+ * take effect, given the lookahead it promised */
+static fncs::time time_effective(const SimulatorState &state, fncs::time time)
+{
+    fncs::time effective = time;
+    if (time >= ULLONG_MAX - state.lookahead) {
+        return ULLONG_MAX;
+    }
+    effective += state.lookahead;
+    return max(effective, state.lookahead_floor);
+}
+
+/* A publish reached sim i, so it has messages pending. An idle sim
+ * becomes actionable sooner, relative to the time of the publish, but
+ * not before the publish takes effect and never later than its own
+ * request. */
+static void note_delivery(
+        SimVec &simulators,
+        ClusterVec &clusters,
+        size_t i,
+        fncs::time time_publish,
+        fncs::time time_effect)
+{
+    SimulatorState &state = simulators[i];
+    if (!state.processing && !state.messages_pending) {
+        fncs::time horizon = time_publish;
+        if (time_effect > time_publish) {
+            /* first step at or after the effect */
+            horizon = time_effect - 1;
+            if (state.time_requested >= state.time_delta
+                    && state.time_requested - state.time_delta < horizon) {
+                horizon = state.time_requested - state.time_delta;
+            }
+            horizon = max(horizon, time_publish);
+        }
+        fast_forward(state, horizon);
+        state.messages_pending = true;
+        reschedule(clusters, state);
+    }
+    state.messages_pending = true;
+}
+
+/* Lower bound of the time at which any input may next take effect at
+ * each sim, ULLONG_MAX if none can. An upstream publisher publishes no
+ * earlier than its frontier or declared next publish, or than its own
+ * inputs may wake it, and
+ * its values take effect its lookahead later; shortest paths over the
+ * subscription graph with lookahead as the edge weight. */
+static void input_bounds(
+        const SimVec &simulators,
+        const SimGraph &downstream,
+        TimeVec &bound)
+{
+    typedef pair<fncs::time,size_t> Entry;
+    priority_queue<Entry,vector<Entry>,greater<Entry> > queue;
+    size_t n = simulators.size();
+
+    bound.assign(n, ULLONG_MAX);
+    for (size_t p=0; p<n; ++p) {
+        if (simulators[p].departed) {
+            continue;
+        }
+        fncs::time effect = time_effective(simulators[p],
+                time_publish_next(simulators[p]));
+        for (set<size_t>::const_iterator it=downstream[p].begin();
+                it!=downstream[p].end(); ++it) {
+            if (effect < bound[*it]) {
+                bound[*it] = effect;
+                queue.push(Entry(effect, *it));
+            }
+        }
+    }
+    while (!queue.empty()) {
+        Entry top = queue.top();
+        size_t p = top.second;
+        queue.pop();
+        if (top.first != bound[p] || simulators[p].departed) {
+            continue;
+        }
+        fncs::time effect = time_effective(simulators[p], top.first);
+        for (set<size_t>::const_iterator it=downstream[p].begin();
+                it!=downstream[p].end(); ++it) {
+            if (effect < bound[*it]) {
+                bound[*it] = effect;
+                queue.push(Entry(effect, *it));
+            }
+        }
+    }
+}
+
+/* how far a sim granted the given time may advance on its own */
+static fncs::time grant_window(const TimeVec &bound, size_t i, fncs::time time)
+{
+    if (bound.empty() || bound[i] == ULLONG_MAX || bound[i] <= time) {
+        return 0;
+    }
+    return bound[i] - time;
+}
+
+/* How far a sim granted the given time may advance on its own with
+ * FNCS_LEASE: until an input may take effect, a value held back for it
+ * is due, or a value it publishes on its own steps could reach a direct
+ * subscriber at a grant earlier than the value takes effect. A
+ * subscriber granted now or computing is next granted a step on from
+ * its frontier; an idle one may be granted as early as its frontier. */
+static fncs::time grant_lease(
+        const SimVec &simulators,
+        const SimGraph &downstream,
+        const TimeVec &bound,
+        const vector<char> &granting,
+        size_t i,
+        fncs::time time)
+{
+    const SimulatorState &state = simulators[i];
+    fncs::time end = bound.empty() ? ULLONG_MAX : bound[i];
+    if (!state.delayed.empty()) {
+        end = min(end, state.delayed.top().time);
+    }
+    for (set<size_t>::const_iterator it=downstream[i].begin();
+            it!=downstream[i].end(); ++it) {
+        const SimulatorState &sub = simulators[*it];
+        if (sub.departed) {
+            continue;
+        }
+        fncs::time next = time_frontier(sub);
+        if (granting[*it] || sub.processing) {
+            next += sub.time_delta;
+        }
+        /* a value of step t takes effect no sooner than t + lookahead */
+        if (next + 1 <= state.lookahead) {
+            return 0;
+        }
+        end = min(end, next + 1 - state.lookahead);
+    }
+    /* a sim nothing reaches or hears from is not leased: a subscription
+     * at runtime or a late join may yet connect it */
+    if (end == ULLONG_MAX || end <= time) {
+        return 0;
+    }
+    return end - time;
+}
+
+/* Barriers other than the global one rely on the subscription graph;
+ * an anonymous publish may take a route the graph does not have. */
+static void check_route(
+        const SimVec &simulators,
+        Barrier barrier,
+        SimGraph &downstream,
+        size_t publisher,
+        size_t i)
+{
+    if (BARRIER_CLUSTER == barrier
+            && simulators[i].cluster != simulators[publisher].cluster) {
+        /* clusters were formed from the subscriptions, an anonymous
+         * publish may still cross them */
+        LWARNING << "PUBLISH from " << simulators[publisher].name
+            << " crosses into the cluster of " << simulators[i].name;
+    }
+    if (BARRIER_PARTIAL == barrier && i != publisher
+            && 0 == downstream[publisher].count(i)) {
+        /* anonymous publish; the edge was not known when this sim was
+         * last granted */
+        LWARNING << "partial barrier learned edge "
+            << simulators[publisher].name << " -> " << simulators[i].name;
+        downstream[publisher].insert(i);
+    }
+}
+
+/* Send shared frames by reference, flagging more after the last one if
+ * the caller appends further frames. */
+static int send_body(zsock_t *sock, const vector<zframe_t*> &body, bool more)
+{
+    for (size_t j=0; j<body.size(); ++j) {
+        zframe_t *shared = body[j];
+        int flags = ZFRAME_REUSE;
+        if (more || j+1 < body.size()) {
+            flags |= ZFRAME_MORE;
+        }
+        if (zframe_send(&shared, sock, flags)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Peers speaking the string protocol cannot read typed values or
+ * records, so the body of topic and value frames they get has each one
+ * replaced by its text. The new frames are kept in owned, see
+ * destroy_frames(). Returns false, leaving body as is, if it holds no
+ * typed value. */
+static bool format_typed_values(vector<zframe_t*> &body, vector<zframe_t*> &owned)
+{
+    bool changed = false;
+    for (size_t j=1; j<body.size(); j+=2) {
+        string text;
+        if (binary_text(zframe_data(body[j]), zframe_size(body[j]), text)) {
+            body[j] = zframe_new(text.data(), text.size());
+            owned.push_back(body[j]);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* The frames of a PUBLISH to forward to a subscriber: naming the topic
+ * by its ID, id_body, made from body when first needed, by the alias it
+ * subscribed by, alias_body, made anew per such subscriber, as text for
+ * a peer speaking strings, or as they came. */
+static const vector<zframe_t*>& body_for(
+        const Send &send,
+        size_t id,
+        const vector<zframe_t*> &body,
+        const vector<zframe_t*> &text_body,
+        vector<zframe_t*> &id_body,
+        vector<zframe_t*> &alias_body,
+        vector<zframe_t*> &owned)
+{
+    if (send.by_id && !body.empty()) {
+        if (id_body.empty()) {
+            string frame = fncs::encode_topic_id(id);
+            id_body = body;
+            id_body[0] = zframe_new(frame.data(), frame.size());
+            owned.push_back(id_body[0]);
+        }
+        return id_body;
+    }
+    if (send.alias != fncs::TopicIntern::npos() && !body.empty()) {
+        alias_body = send.binary || text_body.empty() ? body : text_body;
+        alias_body[0] = zframe_new(topics.data(send.alias), topics.length(send.alias));
+        owned.push_back(alias_body[0]);
+        return alias_body;
+    }
+    return send.binary || text_body.empty() ? body : text_body;
+}
+
+static void destroy_frames(vector<zframe_t*> &frames)
+{
+    for (size_t j=0; j<frames.size(); ++j) {
+        zframe_destroy(&frames[j]);
+    }
+    frames.clear();
+}
+
+/* Keep the value published at the given time as the topic's last, for
+ * sims that subscribe after it was published, see send_last_values(),
+ * or that fetch it, see fetch_value(). A delta means nothing without the
+ * values before it, so the topic then has none. */
+static void keep_last_value(Route &route, zframe_t *value, fncs::time time)
+{
+    const char *data = reinterpret_cast<const char*>(zframe_data(value));
+    size_t size = zframe_size(value);
+    if (size >= 2 && data[0] == '\0' && data[1] == fncs::VALUE_DELTA) {
+        route.has_last_value = false;
+        route.last_value.clear();
+        route.has_prior_value = false;
+        route.prior_value.clear();
+        return;
+    }
+    if (route.has_last_value && time > route.last_time) {
+        route.prior_value.swap(route.last_value);
+        route.has_prior_value = true;
+    }
+    route.last_value.assign(data, size);
+    route.has_last_value = true;
+    route.last_time = time;
+}
+
+/* The value of a pulled topic a sim at the given time reads, which its
+ * publishers may be computing concurrently: the latest published before
+ * then. Under the global barrier no sim is behind the last publish
+ * time, so the value before it is the only other one needed. NULL if
+ * there is none. */
+static const string* fetch_value(const Route &route, fncs::time time)
+{
+    if (route.has_last_value && route.last_time < time) {
+        return &route.last_value;
+    }
+    if (route.has_prior_value) {
+        return &route.prior_value;
+    }
+    return NULL;
+}
+
+/* Send a sim that joined late the last value of each topic it
+ * subscribes to, ahead of its first grant, as a PUBLISH_BATCH or, to an
+ * older client, one PUBLISH per topic. */
+static void send_last_values(
+        zsock_t *server,
+        SimulatorState &state,
+        size_t index,
+        const TopicMap &topic_to_indexes)
+{
+    vector<zframe_t*> pairs;
+    vector<zframe_t*> owned;
+    for (size_t id=0; id<topic_to_indexes.size(); ++id) {
+        const Route &route = topic_to_indexes[id];
+        if (!route.has_last_value || find(route.indexes.begin(),
+                    route.indexes.end(), index) == route.indexes.end()) {
+            continue;
+        }
+        zframe_t *topic = zframe_new(topics.data(id), topics.length(id));
+        zframe_t *value = zframe_new(route.last_value.data(), route.last_value.size());
+        owned.push_back(topic);
+        owned.push_back(value);
+        if (filter_accepts(state, topics.str(id), value, state.time_join)) {
+            pairs.push_back(topic);
+            pairs.push_back(value);
+        }
+    }
+    if (pairs.empty()) {
+        return;
+    }
+    LDEBUG4C(logPUBLISH) << "sending " << pairs.size()/2 << " last value(s) to " << state.name;
+    if (!state.binary) {
+        format_typed_values(pairs, owned);
+    }
+    if (!state.aliases.empty()) {
+        vector<zframe_t*> renamed;
+        pairs = aliased(state, pairs, renamed, owned);
+    }
+    if (state.negotiated) {
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_PUBLISH_BATCH, state.binary, true);
+        send_body(server, pairs, false);
+    }
+    else {
+        for (size_t j=0; j<pairs.size(); j+=2) {
+            vector<zframe_t*> body(pairs.begin()+j, pairs.begin()+j+2);
+            send_identity(server, state);
+            fncs::send_type(server, fncs::MSG_PUBLISH, state.binary, true);
+            send_body(server, body, false);
+        }
+    }
+    state.unicast_due = true;
+    destroy_frames(owned);
+}
+
+/* Parse FNCS_AGGREGATES, "topic=op:glob" separated by ';', op being
+ * one of sum, mean, min, max or count. */
+static AggregateVec parse_aggregates(const string &spec)
+{
+    AggregateVec parsed;
+    istringstream in(spec);
+    string entry;
+    while (getline(in, entry, ';')) {
+        if (entry.empty()) {
+            continue;
+        }
+        size_t eq = entry.find('=');
+        size_t colon = eq == string::npos ? eq : entry.find(':', eq);
+        if (colon == string::npos || eq == 0 || colon + 1 == entry.size()) {
+            LWARNING << "ignoring invalid aggregate '" << entry << "'";
+            continue;
+        }
+        string topic = entry.substr(0, eq);
+        string op = entry.substr(eq+1, colon-eq-1);
+        string glob = entry.substr(colon+1);
+        Aggregate::Op code = Aggregate::SUM;
+        if (op == "mean") {
+            code = Aggregate::MEAN;
+        }
+        else if (op == "min") {
+            code = Aggregate::MIN;
+        }
+        else if (op == "max") {
+            code = Aggregate::MAX;
+        }
+        else if (op == "count") {
+            code = Aggregate::COUNT;
+        }
+        else if (op != "sum") {
+            LWARNING << "ignoring aggregate '" << topic << "' of unknown op '" << op << "'";
+            continue;
+        }
+        if (glob.find('/') == string::npos) {
+            LWARNING << "ignoring aggregate '" << topic << "' of invalid topic '" << glob << "'";
+            continue;
+        }
+        LDEBUG4C(logCONFIG) << "aggregate " << topic << " = " << op << " of " << glob;
+        parsed.push_back(Aggregate(topic, code, glob));
+    }
+    return parsed;
+}
+
+/* Parse FNCS_ALIASES, "alias=topic" separated by ';': a subscription
+ * to the alias is one to the topic, sent to the subscriber under the
+ * alias's name. */
+static map<string,string> parse_aliases(const string &spec)
+{
+    map<string,string> parsed;
+    istringstream in(spec);
+    string entry;
+    while (getline(in, entry, ';')) {
+        if (entry.empty()) {
+            continue;
+        }
+        size_t eq = entry.find('=');
+        if (eq == string::npos || eq == 0 || eq + 1 == entry.size()) {
+            LWARNING << "ignoring invalid alias '" << entry << "'";
+            continue;
+        }
+        string alias = entry.substr(0, eq);
+        string topic = entry.substr(eq+1);
+        if (fncs::is_topic_pattern(alias) || fncs::is_topic_pattern(topic)
+                || alias.find('/') == string::npos || topic.find('/') == string::npos) {
+            LWARNING << "ignoring alias '" << alias << "' of '" << topic
+                << "', both must be topics, not patterns";
+            continue;
+        }
+        LDEBUG4C(logCONFIG) << "alias " << alias << " = " << topic;
+        parsed[alias] = topic;
+    }
+    /* one resolution reaches the published topic */
+    for (map<string,string>::iterator it=parsed.begin(); it!=parsed.end(); ) {
+        if (parsed.count(it->second) || it->first == it->second) {
+            LWARNING << "ignoring alias '" << it->first << "' of '" << it->second
+                << "', itself an alias";
+            parsed.erase(it++);
+        }
+        else {
+            ++it;
+        }
+    }
+    return parsed;
+}
+
+/* Parse FNCS_LINKS, "from>to=latency[:bandwidth[:jitter]]" separated by
+ * ';', from and to being sims, latency and jitter times, e.g. 10ms, and
+ * bandwidth in bits per second. */
+static vector<Link> parse_links(const string &spec)
+{
+    vector<Link> parsed;
+    istringstream in(spec);
+    string entry;
+    while (getline(in, entry, ';')) {
+        if (entry.empty()) {
+            continue;
+        }
+        size_t gt = entry.find('>');
+        size_t eq = gt == string::npos ? gt : entry.find('=', gt);
+        if (eq == string::npos || gt == 0 || eq == gt + 1 || eq + 1 == entry.size()) {
+            LWARNING << "ignoring invalid link '" << entry << "'";
+            continue;
+        }
+        vector<string> params;
+        istringstream fields(entry.substr(eq+1));
+        string field;
+        while (getline(fields, field, ':')) {
+            params.push_back(field);
+        }
+        fncs::time latency = 0;
+        fncs::time jitter = 0;
+        char *end = NULL;
+        double bandwidth = params.size() > 1 ? strtod(params[1].c_str(), &end) : 0.0;
+        if (params.size() > 3 || !fncs::try_parse_time(params[0].c_str(), latency)
+                || (params.size() > 1 && (*end || bandwidth < 0.0))
+                || (params.size() > 2 && !fncs::try_parse_time(params[2].c_str(), jitter))) {
+            LWARNING << "ignoring invalid link '" << entry << "'";
+            continue;
+        }
+        LDEBUG4C(logCONFIG) << "link " << entry.substr(0, eq) << " latency " << latency
+            << " ns, " << bandwidth << " bit/s, jitter " << jitter << " ns";
+        parsed.push_back(Link(entry.substr(0, gt), entry.substr(gt+1, eq-gt-1),
+                    latency, bandwidth, jitter));
+    }
+    return parsed;
+}
+
+/* Index the links between the sim that joined at the given index and
+ * those that joined before it. */
+static void connect_links(SimVec &simulators, const SimIndex &name_to_index, size_t index)
+{
+    const string &name = simulators[index].name;
+    for (size_t k=0; k<links.size(); ++k) {
+        SimIndex::const_iterator from = name_to_index.find(links[k].from);
+        SimIndex::const_iterator to = name_to_index.find(links[k].to);
+        if (from == name_to_index.end() || to == name_to_index.end()
+                || (links[k].from != name && links[k].to != name)) {
+            continue;
+        }
+        vector<pair<size_t,size_t> > &out = simulators[from->second].links;
+        out.insert(upper_bound(out.begin(), out.end(), make_pair(to->second, k)),
+                make_pair(to->second, k));
+    }
+}
+
+/* The link from the sim to the subscriber of the given index, or NULL. */
+static Link* link_to(const SimulatorState &state, size_t index)
+{
+    if (state.links.empty()) {
+        return NULL;
+    }
+    vector<pair<size_t,size_t> >::const_iterator it = lower_bound(
+            state.links.begin(), state.links.end(), make_pair(index, size_t(0)));
+    return it != state.links.end() && it->first == index ? &links[it->second] : NULL;
+}
+
+/* The time a value of the given size sent over the link at the given
+ * time arrives: once the values ahead of it and it are sent at its
+ * bandwidth, after its latency and some of its jitter. */
+static fncs::time link_arrival(Link &link, fncs::time time, size_t size)
+{
+    fncs::time start = max(time, link.busy_until);
+    fncs::time sending = link.bandwidth > 0.0 ?
+        static_cast<fncs::time>(size * 8 * 1e9 / link.bandwidth) : 0;
+    fncs::time jitter = 0;
+    link.busy_until = start + sending;
+    if (link.jitter) {
+        /* xorshift64 */
+        link.seed ^= link.seed << 13;
+        link.seed ^= link.seed >> 7;
+        link.seed ^= link.seed << 17;
+        jitter = link.seed % (link.jitter + 1);
+    }
+    return link.busy_until + link.latency + jitter;
+}
+
+/* Hold a value sent over the link for the subscriber until it arrives,
+ * see link_arrival(), to be delivered as one published for then is. */
+static void hold_on_link(ClusterVec &clusters, SimulatorState &state, Link &link,
+        fncs::time time, const string &topic, zframe_t *value)
+{
+    fncs::time arrival = link_arrival(link, time, zframe_size(value));
+    LDEBUG4C(logPUBLISH) << "'" << topic << "' reaches " << state.name << " at " << arrival;
+    state.delayed.push(Delayed(arrival, delayed_order++, topic, value));
+    if (!state.processing) {
+        reschedule(clusters, state);
+    }
+}
+
+/* Tell the sim to publish the keys of its that are aggregated, as if
+ * the broker subscribed to them, "*" if a key is a pattern. The
+ * subscribers of an aggregate become peers of the sims of its inputs,
+ * as if they named them. */
+static void resolve_aggregate_inputs(
+        const SimVec &simulators,
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        size_t index,
+        SimAckMap &name_to_keys,
+        SimKeyMap &name_to_peers,
+        SimKeyMap &name_to_subscribers)
+{
+    const SimulatorState &state = simulators[index];
+    for (size_t a=0; a<aggregates.size(); ++a) {
+        const string &glob = aggregates[a].glob;
+        size_t loc = glob.find('/');
+        string name_glob = glob.substr(0,loc);
+        size_t id = route(topic_to_indexes, router, aggregates[a].topic);
+        IndexVec subscribers;
+        if (id != fncs::TopicIntern::npos()) {
+            subscribers = topic_to_indexes[id].indexes;
+        }
+        if (fncs::glob_match(name_glob, state.name)) {
+            string key = glob.substr(loc+1);
+            name_to_keys[state.name].add(fncs::is_topic_pattern(key) ? "*" : key, false);
+            for (size_t j=0; j<subscribers.size(); ++j) {
+                name_to_peers[simulators[subscribers[j]].name].insert(state.name);
+                name_to_subscribers[state.name].insert(simulators[subscribers[j]].name);
+            }
+        }
+        if (find(subscribers.begin(), subscribers.end(), index) != subscribers.end()) {
+            for (size_t p=0; p<simulators.size(); ++p) {
+                if (fncs::glob_match(name_glob, simulators[p].name)) {
+                    name_to_peers[state.name].insert(simulators[p].name);
+                    name_to_subscribers[simulators[p].name].insert(state.name);
+                }
+            }
+        }
+    }
+}
+
+/* the aggregates the topic is an input of, matched once per topic */
+static const IndexVec& aggregates_of(size_t id)
+{
+    map<size_t,IndexVec>::iterator it = aggregate_inputs.find(id);
+    if (it == aggregate_inputs.end()) {
+        IndexVec matched;
+        string topic = topics.str(id);
+        for (size_t a=0; a<aggregates.size(); ++a) {
+            if (topic != aggregates[a].topic && fncs::glob_match(aggregates[a].glob, topic)) {
+                matched.push_back(a);
+            }
+        }
+        it = aggregate_inputs.insert(make_pair(id, matched)).first;
+    }
+    return it->second;
+}
+
+/* Fold a value the publisher sent into the aggregates its topic is an
+ * input of, each then due to its subscribers at their next grant. A
+ * value that is not a number leaves them as they were. Returns whether
+ * the topic is an input of any. */
+static bool aggregate_update(
+        SimVec &simulators,
+        ClusterVec &clusters,
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        size_t publisher,
+        size_t id,
+        zframe_t *value)
+{
+    const IndexVec &matched = aggregates_of(id);
+    double number = 0.0;
+    if (matched.empty()) {
+        return false;
+    }
+    if (!to_number(reinterpret_cast<const char*>(zframe_data(value)),
+                zframe_size(value), number)) {
+        LDEBUG4C(logPUBLISH) << "not aggregating '" << topics.str(id) << "', not a number";
+        return true;
+    }
+    const SimulatorState &from = simulators[publisher];
+    for (size_t m=0; m<matched.size(); ++m) {
+        size_t a = matched[m];
+        aggregates[a].update(id, number);
+        size_t out = route(topic_to_indexes, router, aggregates[a].topic);
+        if (out == fncs::TopicIntern::npos()) {
+            continue;
+        }
+        const IndexVec &iv = topic_to_indexes[out].indexes;
+        for (size_t j=0; j<iv.size(); ++j) {
+            SimulatorState &state = simulators[iv[j]];
+            /* a sub-broker would need the time of every input */
+            if (state.departed || !state.members.empty()) {
+                continue;
+            }
+            if (find(state.aggregates_due.begin(), state.aggregates_due.end(), a)
+                    == state.aggregates_due.end()) {
+                state.aggregates_due.push_back(a);
+            }
+            if (wakes_on(state, out, aggregates[a].topic)) {
+                note_delivery(simulators, clusters, iv[j], from.time_current,
+                        time_effective(from, from.time_current));
+            }
+        }
+    }
+    return true;
+}
+
+/* Grant the cluster's time to each of its sims actionable at that time.
+ * Only the granted sims leave the queue; the rest are fast forwarded
+ * lazily, see fast_forward(). Returns the number of sims granted. */
+static int grant_cluster(
+        zsock_t *server,
+        SimVec &simulators,
+        const SimGraph &downstream,
+        Cluster &cluster)
+{
+    int n_granted = 0;
+    TimeVec bound;
+    /* a sub-broker cannot see publishers behind the root */
+    if ((lookahead_declared || publish_declared || lease) && !root) {
+        input_bounds(simulators, downstream, bound);
+    }
+    if (lease && !root) {
+        /* a lease depends on which subscribers are granted with it */
+        IndexVec granted;
+        vector<char> granting(simulators.size(), 0);
+        while (!cluster.schedule.empty()
+                && cluster.schedule.top_key() == cluster.time_granted) {
+            size_t i = cluster.members[cluster.schedule.pop()];
+            if (!simulators[i].departed) {
+                granted.push_back(i);
+                granting[i] = 1;
+            }
+        }
+        for (size_t g=0; g<granted.size(); ++g) {
+            size_t i = granted[g];
+            grant(server, simulators[i], cluster.time_granted,
+                    grant_lease(simulators, downstream, bound, granting, i,
+                        cluster.time_granted));
+        }
+        n_granted = static_cast<int>(granted.size());
+    }
+    while (!cluster.schedule.empty()
+            && cluster.schedule.top_key() == cluster.time_granted) {
+        size_t i = cluster.members[cluster.schedule.pop()];
+        if (simulators[i].departed) {
+            /* the whole cluster has left */
+            continue;
+        }
+        ++n_granted;
+        grant(server, simulators[i], cluster.time_granted,
+                grant_window(bound, i, cluster.time_granted));
+    }
+    grant_cast_flush();
+    cluster.n_processing += n_granted;
+    if (broker_metrics && n_granted) {
+        broker_metrics->round(fncs::timer_ft());
+    }
+    if (timeline && n_granted) {
+        timeline->round(fncs::timer_ft(), n_granted);
+    }
+    return n_granted;
+}
+
+/* Partial barrier. Instead of waiting for every sim to report, an idle
+ * sim is granted as soon as nothing can still reach it from its past:
+ * no transitive upstream publisher may be behind its actionable time,
+ * and no direct subscriber may be behind it either, otherwise that
+ * subscriber would see a value from its future. Subscribers sharing the
+ * same actionable time are granted together, as the global barrier
+ * would. Returns the number of sims granted. */
+static int grant_partial(
+        zsock_t *server,
+        SimVec &simulators,
+        const SimGraph &downstream,
+        fncs::time realtime_interval)
+{
+    /* the fields read below are gathered once into contiguous arrays of
+     * plain bytes and times, so the passes over them do not walk the
+     * much larger SimulatorStates */
+    size_t n = simulators.size();
+    TimeVec frontier(n);
+    TimeVec upstream_min(n, ULLONG_MAX);
+    vector<char> expanded(n, 0);
+    vector<char> departed(n, 0);
+    vector<char> processing(n, 0);
+    vector<char> candidate(n, 0);
+    vector<pair<fncs::time,size_t> > order(n);
+    vector<pair<fncs::time,size_t> > sources(n);
+    TimeVec bound;
+    int n_granted = 0;
+
+    for (size_t i=0; i<n; ++i) {
+        const SimulatorState &state = simulators[i];
+        departed[i] = state.departed;
+        processing[i] = state.processing;
+        if (departed[i]) {
+            frontier[i] = ULLONG_MAX;
+            sources[i] = make_pair(ULLONG_MAX, i);
+        }
+        else {
+            /* time_publish_next() without recomputing the frontier */
+            frontier[i] = time_frontier(state);
+            sources[i] = make_pair(state.processing || state.messages_pending
+                    ? frontier[i] : max(frontier[i], state.time_next_publish), i);
+        }
+        order[i] = make_pair(frontier[i], i);
+    }
+
+    /* sweeping sources in the order they may next publish, the first
+     * sweep to reach a sim carries the earliest publish among its strict
+     * ancestors */
+    sort(order.begin(), order.end());
+    sort(sources.begin(), sources.end());
+    for (size_t o=0; o<n; ++o) {
+        size_t source = sources[o].second;
+        vector<size_t> stack;
+        if (expanded[source]) {
+            continue;
+        }
+        expanded[source] = true;
+        stack.push_back(source);
+        while (!stack.empty()) {
+            size_t i = stack.back();
+            stack.pop_back();
+            for (set<size_t>::const_iterator it=downstream[i].begin();
+                    it!=downstream[i].end(); ++it) {
+                if (upstream_min[*it] == ULLONG_MAX) {
+                    upstream_min[*it] = sources[o].first;
+                }
+                if (!expanded[*it]) {
+                    expanded[*it] = true;
+                    stack.push_back(*it);
+                }
+            }
+        }
+    }
+
+    /* idle sims that no upstream publisher can still reach */
+    for (size_t i=0; i<n; ++i) {
+        candidate[i] = !departed[i] & !processing[i]
+            & (upstream_min[i] >= frontier[i]);
+    }
+
+    /* drop candidates with a subscriber behind them, until stable */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i=0; i<n; ++i) {
+            if (!candidate[i]) {
+                continue;
+            }
+            for (set<size_t>::const_iterator it=downstream[i].begin();
+                    it!=downstream[i].end(); ++it) {
+                size_t d = *it;
+                bool ok = true;
+                if (d == i || departed[d]) {
+                    continue;
+                }
+                if (processing[d]) {
+                    ok = frontier[d] >= frontier[i];
+                }
+                else if (frontier[d] == frontier[i]) {
+                    ok = candidate[d];
+                }
+                else {
+                    ok = frontier[d] > frontier[i]
+                        && upstream_min[d] >= frontier[i];
+                }
+                if (!ok) {
+                    candidate[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (lookahead_declared || publish_declared || lease) {
+        input_bounds(simulators, downstream, bound);
+    }
+    for (size_t o=0; o<n; ++o) {
+        size_t i = order[o].second;
+        if (candidate[i]) {
+            if (realtime_interval) {
+                grant_cast_flush(); /* those of an earlier time */
+                if (!realtime_wait(frontier[i], realtime_interval)) {
+                    broker_die(simulators, server);
+                }
+            }
+            grant(server, simulators[i], frontier[i], lease
+                    ? grant_lease(simulators, downstream, bound, candidate, i, frontier[i])
+                    : grant_window(bound, i, frontier[i]));
+            ++n_granted;
+        }
+    }
+    grant_cast_flush();
+    if (broker_metrics && n_granted) {
+        broker_metrics->round(fncs::timer_ft());
+    }
+    if (timeline && n_granted) {
+        timeline->round(fncs::timer_ft(), n_granted);
+    }
+
+    return n_granted;
+}
+
+
+
+
+/* a topic ID as packed in the ACK, see fncs::TOPIC_IDS */
+static void append_topic_id(string &ids, size_t id)
+{
+    for (int i=0; i<4; ++i) {
+        ids.append(1, static_cast<char>(id >> (8*i)));
+    }
+}
+
+/* The subscribers the sim sends the values of its keys to directly, as
+ * told in its ACK: a line per subscriber, "P <index> <endpoint>", then a
+ * line per key, "K <key index> <relay> <index>...", relay being 1 if
+ * others still get the key's values through the broker. A subscriber
+ * takes them directly if it bound an endpoint and reads them as they
+ * are published, the broker neither filtering nor stamping them; the
+ * values of a cast topic are cast as before. The subscribers are kept in direct_subscribers, so that the
+ * counts the sim reports stand for the values the broker forwards. */
+/* Every topic some sim subscribes to or pulls, the patterns subscribed
+ * to and the inputs of the aggregates, packed for the ACK, see
+ * fncs::SUBSCRIBED. */
+static string pack_subscribed(
+        const TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        size_t max_exact)
+{
+    vector<string> exact;
+    vector<string> patterns;
+
+    for (size_t id=0; id<topic_to_indexes.size(); ++id) {
+        if (!topic_to_indexes[id].indexes.empty() || topic_to_indexes[id].pulled) {
+            exact.push_back(topics.str(id));
+        }
+    }
+    for (size_t i=0; i<router.size(); ++i) {
+        patterns.push_back(router.pattern(i));
+    }
+    for (size_t a=0; a<aggregates.size(); ++a) {
+        patterns.push_back(aggregates[a].glob);
+    }
+    return fncs::TopicFilter::pack(exact, patterns, max_exact);
+}
+
+static string plan_direct(
+        const SimVec &simulators,
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router,
+        size_t i,
+        const AckKeys &ack)
+{
+    const SimulatorState &state = simulators[i];
+    set<size_t> peers;
+    ostringstream keys;
+    if (state.direct_endpoint.empty() || !state.topic_ids || !state.members.empty()) {
+        return string();
+    }
+    for (size_t k=0; k<ack.keys.size(); ++k) {
+        string topic = state.name + '/' + topics.str(ack.keys[k]);
+        if (fncs::is_topic_pattern(topic) || cast_topics.count(topic)) {
+            continue;
+        }
+        size_t id = route(topic_to_indexes, router, topic);
+        const vector<Send> &sends = send_list(simulators, topic_to_indexes[id], id);
+        bool relay = topic_to_indexes[id].pulled
+            || (!aggregates.empty() && !aggregates_of(id).empty());
+        IndexVec direct;
+        for (size_t d=0; d<sends.size(); ++d) {
+            const Send &send = sends[d];
+            if (send.index != i && send.binary && !send.with_time && !send.filtered
+                    && alias_of(simulators[send.index], id) == fncs::TopicIntern::npos()
+                    && !link_to(state, send.index)
+                    && !simulators[send.index].direct_endpoint.empty()) {
+                direct.push_back(send.index);
+            }
+            else {
+                relay = true;
+            }
+        }
+        if (direct.empty()) {
+            continue;
+        }
+        sort(direct.begin(), direct.end());
+        keys << "K " << k << ' ' << relay;
+        for (size_t d=0; d<direct.size(); ++d) {
+            keys << ' ' << direct[d];
+            peers.insert(direct[d]);
+        }
+        keys << '\n';
+        direct_subscribers[id].swap(direct);
+    }
+    ostringstream plan;
+    for (set<size_t>::iterator it=peers.begin(); it!=peers.end(); ++it) {
+        plan << "P " << *it << ' ' << simulators[*it].direct_endpoint << '\n';
+    }
+    plan << keys.str();
+    return plan.str();
+}
+
+/* Send the ACK that lets a sim start: its index, the federation size,
+ * the keys others subscribe to, its time_peer, the broker version and,
+ * if negotiated, the protocol and the keys with list subscribers. */
+static void send_ack(
+        zsock_t *server,
+        const SimulatorState &state,
+        size_t index,
+        size_t n_sims,
+        const AckKeys &ack,
+        fncs::time time_peer,
+        const string &direct=string(),
+        const string &subscribed=string())
+{
+    void *socket = zsock_resolve(server);
+
+    LDEBUG4C(logCONFIG) << "sending first ACK to " << state.name;
+    send_identity(server, state);
+    zstr_sendm(server, fncs::ACK);
+    zstr_sendfm(server, "%llu", (unsigned long long)index);
+    zstr_sendfm(server, "%llu", (unsigned long long)n_sims);
+    if (state.manifest) {
+        zstr_sendm(server, "0"); /* keys follow packed */
+    }
+    else {
+        zstr_sendfm(server, "%llu", (unsigned long long)ack.keys.size());
+        for (size_t k=0; k<ack.keys.size(); ++k) {
+            zmq_send(socket, topics.data(ack.keys[k]), topics.length(ack.keys[k]), ZMQ_SNDMORE);
+        }
+    }
+    /* smallest delta of any clients */
+    LDEBUG4C(logCONFIG) << "time_peer = " << time_peer;
+    LDEBUG4C(logCONFIG) << "time_delta= " << state.time_delta;
+    zstr_sendfm(server, "%llu", (unsigned long long)time_peer);
+    zstr_sendfm(server, "%d.%d.%d", FNCS_VERSION_MAJOR, FNCS_VERSION_MINOR, FNCS_VERSION_PATCH);
+    if (state.negotiated) {
+        zstr_sendm(server, state.binary ?
+                fncs::PROTOCOL_BINARY : fncs::PROTOCOL_STRING);
+        if (compression && state.zstd) {
+            zstr_sendm(server, fncs::ZSTD);
+        }
+        if (dictionary && state.dictionary) {
+            string packed = coded_values.pack();
+            zstr_sendm(server, fncs::DICTIONARY);
+            zmq_send(socket, packed.data(), packed.size(), ZMQ_SNDMORE);
+        }
+        if (optimistic) {
+            zstr_sendm(server, fncs::OPTIMISTIC);
+        }
+        /* values of keys without a list subscriber may be coalesced by
+         * the publisher */
+        if (state.manifest) {
+            string manifest = ack.manifest();
+            zstr_sendm(server, fncs::MANIFEST);
+            zmq_send(socket, manifest.data(), manifest.size(), ZMQ_SNDMORE);
+        }
+        else {
+            zstr_sendm(server, fncs::LIST_KEYS);
+            for (size_t k=0; k<ack.keys.size(); ++k) {
+                if (ack.is_list(k)) {
+                    zmq_send(socket, topics.data(ack.keys[k]), topics.length(ack.keys[k]),
+                            ZMQ_SNDMORE);
+                }
+            }
+        }
+        /* keys whose subscribers all keep every value in a list and
+         * follow deltas from one value to the next */
+        if (state.delta) {
+            zstr_sendm(server, fncs::DELTA_KEYS);
+            for (size_t k=0; k<ack.keys.size(); ++k) {
+                if (ack.is_delta(k)) {
+                    zmq_send(socket, topics.data(ack.keys[k]), topics.length(ack.keys[k]),
+                            ZMQ_SNDMORE);
+                }
+            }
+        }
+        /* the IDs of the topics it publishes, then of its subscriptions */
+        if (state.topic_ids) {
+            string ids;
+            for (size_t k=0; k<ack.keys.size(); ++k) {
+                string key(topics.data(ack.keys[k]), topics.length(ack.keys[k]));
+                append_topic_id(ids, fncs::is_topic_pattern(key) ?
+                        fncs::NO_TOPIC_ID : topics.intern(state.name + '/' + key));
+            }
+            for (size_t k=0; k<state.subscription_ids.size(); ++k) {
+                append_topic_id(ids, state.subscription_ids[k]);
+            }
+            zstr_sendm(server, fncs::TOPIC_IDS);
+            zmq_send(socket, ids.data(), ids.size(), ZMQ_SNDMORE);
+        }
+        if (state.grant_casts) {
+            zstr_sendm(server, fncs::GRANT_CAST);
+            zstr_sendm(server, grant_cast_endpoint);
+        }
+        if (!state.direct_endpoint.empty()) {
+            zstr_sendm(server, fncs::DIRECT);
+            zmq_send(socket, direct.data(), direct.size(), ZMQ_SNDMORE);
+        }
+        if (state.data_channel) {
+            zstr_sendm(server, fncs::DATA);
+            zstr_sendm(server, data_endpoint);
+        }
+        if (state.pull) {
+            zstr_sendm(server, fncs::PULL);
+        }
+        if (state.anon_filter && !subscribed.empty()) {
+            zstr_sendm(server, fncs::SUBSCRIBED);
+            zmq_send(socket, subscribed.data(), subscribed.size(), ZMQ_SNDMORE);
+        }
+    }
+    zstr_send(server, fncs::ACK);
+    LDEBUG4C(logCONFIG) << "ACK sent to '" << state.name;
+}
+
+/* lower the peer time to the given one, the first time simply setting it */
+static void lower_peer(fncs::time &peer, fncs::time time)
+{
+    if (!peer || time < peer) {
+        peer = time;
+    }
+}
+
+/* The time_peer of every sim: the smallest delta of its publishers and
+ * subscribers in the dependency graph, and its own if it subscribes to
+ * itself, 0 if it has none. Values reach it only on their steps, and it
+ * may not publish ahead of its subscribers, so a sim of a larger delta
+ * steps on its own up to the next multiple of it, see the client's time
+ * window. Sims further away only reach it through these, on their steps
+ * as well, so they do not narrow the window. */
+static TimeVec time_peers(
+        const SimVec &simulators,
+        const SimGraph &downstream,
+        SimKeyMap &name_to_peers)
+{
+    TimeVec peers(simulators.size(), 0);
+
+    for (size_t p=0; p<downstream.size(); ++p) {
+        for (set<size_t>::const_iterator it=downstream[p].begin();
+                it!=downstream[p].end(); ++it) {
+            lower_peer(peers[*it], simulators[p].time_delta);
+            lower_peer(peers[p], simulators[*it].time_delta);
+        }
+        if (name_to_peers[simulators[p].name].count(simulators[p].name)) {
+            lower_peer(peers[p], simulators[p].time_delta);
+        }
+    }
+    return peers;
+}
+
+/* Send the sims whose time_peer changed, as a delta did, the new one. */
+static void push_time_peers(
+        zsock_t *server,
+        SimVec &simulators,
+        const SimGraph &downstream,
+        SimKeyMap &name_to_peers)
+{
+    TimeVec peers = time_peers(simulators, downstream, name_to_peers);
+
+    for (size_t i=0; i<downstream.size(); ++i) {
+        SimulatorState &state = simulators[i];
+        if (peers[i] == state.time_peer || state.departed) {
+            continue;
+        }
+        state.time_peer = peers[i];
+        /* older clients and sub-brokers do not expect it */
+        if (!state.negotiated || !state.members.empty()) {
+            continue;
+        }
+        LDEBUG4C(logTIME) << "time_peer of " << state.name << " is now " << peers[i];
+        state.unicast_due = true;
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_TIME_DELTA, state.binary, true);
+        fncs::send_time(server, peers[i], state.binary, false);
+    }
+}
+
+/* Count a published string value toward FNCS_DICTIONARY_LEARN. Once it
+ * was published that often it is numbered and every sim told at once,
+ * before its publisher may send the code instead; a sim yet to be ACKed
+ * gets the whole dictionary with its ACK. Values already coded, typed,
+ * numbers and long ones are not worth it. */
+static void dictionary_learn(
+        zsock_t *server,
+        SimVec &simulators,
+        const IndexVec &joining,
+        const void *data,
+        size_t size)
+{
+    static const size_t VALUE_MAX = 4096; /* bytes in a value coded */
+    static const size_t SEEN_MAX = 65536; /* values counted at once */
+    static const size_t CODES_MAX = 1 << 20; /* values coded in all */
+    const char *bytes = static_cast<const char*>(data);
+    double number = 0.0;
+
+    if (!dictionary || !dictionary_repeats || 0 == size || size > VALUE_MAX
+            || '\0' == bytes[0] || coded_values.size() >= CODES_MAX) {
+        return;
+    }
+    string value(bytes, size);
+    if (dictionary_seen.size() >= SEEN_MAX && !dictionary_seen.count(value)) {
+        dictionary_seen.clear(); /* values that came and went */
+    }
+    /* a number stays counted past the limit, never to be checked again */
+    if (++dictionary_seen[value] != dictionary_repeats
+            || to_number(bytes, size, number) || coded_values.frame(value)) {
+        return;
+    }
+    dictionary_seen.erase(value);
+    size_t code = coded_values.add(value);
+    LDEBUG4C(logPUBLISH) << "value coded " << code << " after "
+        << dictionary_repeats << " publishes";
+    for (size_t i=0; i<simulators.size(); ++i) {
+        SimulatorState &state = simulators[i];
+        if (state.departed || find(joining.begin(), joining.end(), i) != joining.end()) {
+            continue;
+        }
+        state.unicast_due = true;
+        send_identity(server, state);
+        fncs::send_type(server, fncs::MSG_DICTIONARY, state.binary, true);
+        zstr_sendfm(server, "%llu", (unsigned long long)code);
+        zmq_send(zsock_resolve(server), value.data(), value.size(), 0);
+    }
+}
+
+/* Admit the sims that said HELLO after the federation started, at the
+ * boundary where the cluster is about to be granted time_granted. They
+ * join the cluster as if processing their first step, so the next
+ * grant waits for their first TIME_REQUEST. Their subscriptions and
+ * graph edges are added now, not when they connected, so no publish
+ * reaches a sim still waiting on its ACK. Returns the number admitted. */
+static int admit_joins(
+        zsock_t *server,
+        SimVec &simulators,
+        IndexVec &joining,
+        const SimIndex &name_to_index,
+        TopicMap &topic_to_indexes,
+        fncs::TopicRouter &router,
+        const NamePatternVec &name_patterns,
+        SimAckMap &name_to_keys,
+        SimKeyMap &name_to_peers,
+        SimKeyMap &name_to_subscribers,
+        SimGraph &downstream,
+        Cluster &cluster,
+        size_t cluster_index)
+{
+    size_t n_sims = simulators.size(); /* the joiners come last */
+    int n_admitted = static_cast<int>(joining.size());
+
+    downstream.resize(n_sims);
+    for (size_t j=0; j<joining.size(); ++j) {
+        size_t i = joining[j];
+        SimulatorState &state = simulators[i];
+        const vector<size_t> &values = state.subscription_values;
+        for (size_t v=0; v<values.size(); ++v) {
+            subscribe(topic_to_indexes, router, topics.str(values[v]), i);
+        }
+        resolve_name_patterns(name_patterns, simulators, i,
+                name_to_keys, name_to_peers, name_to_subscribers);
+        resolve_aggregate_inputs(simulators, topic_to_indexes, router, i,
+                name_to_keys, name_to_peers, name_to_subscribers);
+        set<string> &peers = name_to_peers[state.name];
+        for (set<string>::iterator it=peers.begin(); it!=peers.end(); ++it) {
+            SimIndex::const_iterator simit = name_to_index.find(*it);
+            if (simit != name_to_index.end() && simit->second != i) {
+                downstream[simit->second].insert(i);
+            }
+        }
+        for (size_t m=0; m<=state.compound.size(); ++m) {
+            const string &name = m ? state.compound[m-1] : state.name;
+            set<string> &subscribers = name_to_subscribers[name];
+            for (set<string>::iterator it=subscribers.begin(); it!=subscribers.end(); ++it) {
+                SimIndex::const_iterator simit = name_to_index.find(*it);
+                if (simit != name_to_index.end() && simit->second != i) {
+                    downstream[i].insert(simit->second);
+                }
+            }
+        }
+        state.time_join = cluster.time_granted;
+        state.time_last_processed = 0;
+        fast_forward(state, cluster.time_granted);
+        state.processing = true;
+        state.cluster = cluster_index;
+        state.cluster_pos = cluster.members.size();
+        cluster.members.push_back(i);
+        if (broker_metrics || load_interval) {
+            state.metrics.granted(fncs::timer_ft());
+        }
+        if (timeline) {
+            timeline->granted(state.track, state.name, fncs::timer_ft(), cluster.time_granted);
+        }
+        LDEBUG4C(logCONFIG) << state.name << " joins at " << cluster.time_granted;
+        state.time_peer = time_peers(simulators, downstream, name_to_peers)[i];
+        send_ack(server, state, i, n_sims, name_to_keys[state.name], state.time_peer);
+        if (last_values) {
+            send_last_values(server, state, i, topic_to_indexes);
+        }
+    }
+    /* the sims they subscribe to and that subscribe to them */
+    push_time_peers(server, simulators, downstream, name_to_peers);
+    cluster.schedule.resize(cluster.members.size());
+    cluster.n_processing += n_admitted;
+    joining.clear();
+    return n_admitted;
+}
+
+/* insert the ID into the ascending vector, unless it is there */
+static void insert_sorted(IndexVec &iv, size_t id)
+{
+    IndexVec::iterator it = lower_bound(iv.begin(), iv.end(), id);
+    if (it == iv.end() || *it != id) {
+        iv.insert(it, id);
+    }
+}
+
+static void erase_sorted(IndexVec &iv, size_t id)
+{
+    IndexVec::iterator it = lower_bound(iv.begin(), iv.end(), id);
+    if (it != iv.end() && *it == id) {
+        iv.erase(it);
+    }
+}
+
+/* A subscription made once the sim was ACKed, see fncs::subscribe(). Its
+ * route takes it from now on, so values published from here reach it at
+ * its next grant; the publisher is told the key, which it publishes
+ * from its own next grant on, and the dependency graph gains the edge.
+ * Returns whether the edge is new. */
+static bool subscribe_runtime(
+        zsock_t *server,
+        SimVec &simulators,
+        size_t index,
+        const string &subscribed,
+        bool is_list,
+        bool wakes,
+        TopicMap &topic_to_indexes,
+        fncs::TopicRouter &router,
+        const SimIndex &name_to_index,
+        SimAckMap &name_to_keys,
+        SimKeyMap &name_to_peers,
+        SimKeyMap &name_to_subscribers,
+        SimGraph &downstream)
+{
+    SimulatorState &state = simulators[index];
+    map<string,string>::const_iterator alias = aliases.find(subscribed);
+    const string &topic = alias == aliases.end() ? subscribed : alias->second;
+    size_t loc = topic.find('/');
+
+    if (fncs::is_topic_pattern(topic) || loc == string::npos) {
+        LWARNING << state.name << " subscribed to '" << topic
+            << "' at runtime, where only an exact topic is";
+        return false;
+    }
+    size_t id = topics.intern(topic);
+    LDEBUG4C(logCONFIG) << state.name << " subscribes to '" << topic << "' at runtime";
+    if (alias != aliases.end()
+            && alias_of(state, id) == fncs::TopicIntern::npos()) {
+        state.aliases.push_back(make_pair(id, topics.intern(alias->first)));
+        sort(state.aliases.begin(), state.aliases.end());
+    }
+    /* its ACK gave no ID for it, so it is sent by name */
+    if (!binary_search(state.subscription_values.begin(),
+                state.subscription_values.end(), id)) {
+        insert_sorted(state.runtime_values, id);
+    }
+    if (is_list) {
+        insert_sorted(state.list_values, id);
+    }
+    if (wakes) {
+        erase_sorted(state.passive_values, id);
+    }
+    else {
+        insert_sorted(state.passive_values, id);
+    }
+    subscribe(topic_to_indexes, router, topic, index);
+    ++send_lists_generation;
+
+    string name = topic.substr(0, loc);
+    string key = topic.substr(loc+1);
+    size_t key_id = topics.intern(key);
+    AckKeys &keys = name_to_keys[name];
+    size_t before = keys.keys.size();
+    size_t k = keys.index.count(key_id) ? keys.index[key_id] : before;
+    bool was_list = k < before && keys.is_list(k);
+    bool was_delta = k < before && keys.is_delta(k);
+    keys.add(key_id, is_list, is_list && state.delta);
+    k = keys.index[key_id];
+    name_to_peers[state.name].insert(name);
+    name_to_subscribers[name].insert(state.name);
+
+    /* one joining later is told in its ACK */
+    SimIndex::const_iterator publisher = name_to_index.find(name);
+    if (publisher == name_to_index.end()) {
+        return false;
+    }
+    size_t p = publisher->second;
+    bool edge = p != index && downstream[p].insert(index).second;
+    SimulatorState &pub = simulators[p];
+    if (k < before && was_list == keys.is_list(k) && was_delta == keys.is_delta(k)) {
+        return edge;
+    }
+    if (pub.name != name) {
+        /* a compound federate publishes for its members by topic */
+        if (!pub.members.empty()) {
+            LWARNING << state.name << " subscribed to '" << topic
+                << "', which " << name << " was not told to publish";
+        }
+        return edge;
+    }
+    if (!pub.negotiated || pub.departed) {
+        LWARNING << state.name << " subscribed to '" << topic
+            << "', which " << name << " was not told to publish";
+        return edge;
+    }
+    pub.unicast_due = true;
+    send_identity(server, pub);
+    fncs::send_type(server, fncs::MSG_SUBSCRIBE, pub.binary, true);
+    zstr_sendm(server, key.c_str());
+    zstr_sendm(server, keys.is_list(k) ? "1" : "0");
+    zstr_send(server, keys.is_delta(k) ? "1" : "0");
+    return edge;
+}
+
+/* The end of a subscription, see fncs::unsubscribe(). Only its route
+ * changes: the publisher keeps publishing the key, which others may
+ * want, and the broker drops what nobody is routed. */
+static void unsubscribe_runtime(
+        SimVec &simulators,
+        size_t index,
+        const string &subscribed,
+        TopicMap &topic_to_indexes,
+        const fncs::TopicRouter &router)
+{
+    SimulatorState &state = simulators[index];
+    map<string,string>::const_iterator alias = aliases.find(subscribed);
+    const string &topic = alias == aliases.end() ? subscribed : alias->second;
+    size_t id = topics.find(topic);
+
+    if (id == fncs::TopicIntern::npos() || id >= topic_to_indexes.size()) {
+        LWARNING << state.name << " unsubscribed from '" << topic
+            << "', which it did not subscribe to";
+        return;
+    }
+    LDEBUG4C(logCONFIG) << state.name << " unsubscribes from '" << topic << "'";
+    /* a pattern it subscribed to keeps routing the topic to it */
+    IndexVec matched;
+    router.match(topic, matched);
+    if (!binary_search(matched.begin(), matched.end(), index)) {
+        topic_to_indexes[id].remove(index);
+    }
+    /* a later subscribe() is sent by name, as it was not in the ACK */
+    erase_sorted(state.subscription_values, id);
+    erase_sorted(state.runtime_values, id);
+    ++send_lists_generation;
+}
+
+/* A message taken off the server socket ahead of its turn, with the
+ * configuration of a HELLO already parsed, see hello_prefetch(). */
+class Inbound {
+    public:
+        Inbound() : msg(NULL), parsed(false), config() {}
+
+        zmsg_t *msg;
+        bool parsed;
+        fncs::Config config;
+};
+
+/* the HELLO configurations one parser thread parses: every stride-th,
+ * from first on */
+class HelloParse {
+    public:
+        HelloParse() : inbound(NULL), first(0), stride(1) {}
+
+        deque<Inbound> *inbound;
+        size_t first;
+        size_t stride;
+};
+
+static void hello_parse(HelloParse &work)
+{
+    deque<Inbound> &inbound = *work.inbound;
+    for (size_t i=work.first; i<inbound.size(); i+=work.stride) {
+        if (!inbound[i].parsed) {
+            continue;
+        }
+        /* sender, type, then the config */
+        zframe_t *frame = zmsg_first(inbound[i].msg);
+        frame = zmsg_next(inbound[i].msg);
+        frame = zmsg_next(inbound[i].msg);
+        inbound[i].config = fncs::parse_config(fncs::to_string(frame));
+    }
+}
+
+static void hello_parser(zsock_t *pipe, void *args)
+{
+    zsock_signal(pipe, 0);
+    hello_parse(*static_cast<HelloParse*>(args));
+    char *command = zstr_recv(pipe); /* $TERM, once joined */
+    zstr_free(&command);
+}
+
+/* cores of the node, the default of FNCS_HELLO_THREADS */
+static int cpu_count()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<int>(info.dwNumberOfProcessors);
+#else
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return n_cpus > 0 ? static_cast<int>(n_cpus) : 1;
+#endif
+}
+
+/* Take up to max_messages messages already waiting on the server into
+ * the inbound queue without polling for each, so that the dispatcher
+ * works through a burst with one poll; the other sockets are polled
+ * again once it is through. */
+static void recv_drain(zsock_t *server, deque<Inbound> &inbound, size_t max_messages)
+{
+    zsock_set_rcvtimeo(server, 0);
+    for (size_t n=0; n<max_messages; ++n) {
+        zmsg_t *msg = zmsg_recv(server);
+        if (!msg) {
+            break;
+        }
+        inbound.push_back(Inbound());
+        inbound.back().msg = msg;
+    }
+    zsock_set_rcvtimeo(server, -1);
+}
+
+/* Messages taken off the server into a queue per sender, see
+ * FNCS_INGRESS_FAIR. A sender's messages keep their order; across
+ * senders, a sender whose next message is a control message, e.g. a
+ * TIME_REQUEST, is served before any PUBLISH, and the publishes of the
+ * rest are served round robin, up to quantum messages per sender per
+ * turn. A sim flooding PUBLISHes then delays the others' time requests
+ * by at most the messages already dispatched, not by its whole burst. */
+class IngressQueues {
+    public:
+        IngressQueues() : quantum(0), held(0), served(0), queues(), turns() {}
+
+        ~IngressQueues() {
+            for (map<string, deque<zmsg_t*> >::iterator it=queues.begin();
+                    it!=queues.end(); ++it) {
+                for (size_t i=0; i<it->second.size(); ++i) {
+                    zmsg_destroy(&it->second[i]);
+                }
+            }
+        }
+
+        bool enabled() const { return quantum > 0; }
+
+        bool empty() const { return held == 0; }
+
+        /* everything waiting on the server, while fewer than max_held
+         * messages are held */
+        void take(zsock_t *server, size_t max_held) {
+            zsock_set_rcvtimeo(server, 0);
+            while (held < max_held) {
+                zmsg_t *msg = zmsg_recv(server);
+                if (!msg) {
+                    break;
+                }
+                string sender;
+                zframe_t *frame = zmsg_first(msg);
+                if (frame) {
+                    fncs::to_string(frame, sender);
+                }
+                deque<zmsg_t*> &queue = queues[sender];
+                if (queue.empty()) {
+                    turns.push_back(sender);
+                }
+                queue.push_back(msg);
+                ++held;
+            }
+            zsock_set_rcvtimeo(server, -1);
+        }
+
+        /* the next message to dispatch, NULL if none is held */
+        zmsg_t* next() {
+            if (!held) {
+                return NULL;
+            }
+            /* control messages first, from whichever sender has one next */
+            for (size_t i=0; i<turns.size(); ++i) {
+                deque<zmsg_t*> &queue = queues[turns[i]];
+                if (is_control(queue.front())) {
+                    return pop(turns.begin() + i, queue);
+                }
+            }
+            /* then a publish of the sender whose turn it is */
+            deque<zmsg_t*> &queue = queues[turns.front()];
+            ++served;
+            bool last = queue.size() == 1;
+            zmsg_t *msg = pop(turns.begin(), queue);
+            if (!last && served >= quantum) {
+                turns.push_back(turns.front());
+                turns.pop_front();
+                served = 0;
+            }
+            return msg;
+        }
+
+        size_t quantum;     /* FNCS_INGRESS_FAIR, publishes per turn */
+
+    private:
+        /* the message at the front of the queue of the sender at it,
+         * the sender losing its turn once its queue is empty */
+        zmsg_t* pop(deque<string>::iterator it, deque<zmsg_t*> &queue) {
+            zmsg_t *msg = queue.front();
+            queue.pop_front();
+            --held;
+            if (queue.empty()) {
+                if (it == turns.begin()) {
+                    served = 0;
+                }
+                queues.erase(*it);
+                turns.erase(it);
+            }
+            return msg;
+        }
+
+        /* anything but the values a sim publishes or fetches */
+        static bool is_control(zmsg_t *msg) {
+            zframe_t *frame = zmsg_first(msg);
+            frame = frame ? zmsg_next(msg) : NULL;
+            if (!frame) {
+                return true; /* the dispatcher reports it */
+            }
+            switch (fncs::to_type(frame)) {
+                case fncs::MSG_PUBLISH:
+                case fncs::MSG_PUBLISH_BATCH:
+                case fncs::MSG_PUBLISH_AT:
+                case fncs::MSG_FETCH:
+                case fncs::MSG_DICTIONARY:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+        size_t held;        /* messages in all queues */
+        size_t served;      /* publishes of the sender at the front this turn */
+        map<string, deque<zmsg_t*> > queues; /* by sender identity */
+        deque<string> turns; /* senders with messages, in round robin order */
+};
+
+/* Take every message already waiting on the server, up to one per sim,
+ * into the inbound queue and parse the configurations of the HELLOs
+ * among them on up to n_threads threads, the broker's own one of them.
+ * When many sims start together their configurations, which are
+ * independent of each other, are parsed at once; they are then indexed
+ * in the order the HELLOs came, as if they had been read one by one. */
+static void hello_prefetch(zsock_t *server, deque<Inbound> &inbound,
+        size_t max_messages, int n_threads)
+{
+    zmq_pollitem_t item = { zsock_resolve(server), 0, ZMQ_POLLIN, 0 };
+    size_t n_hellos = 0;
+
+    while (inbound.size() < max_messages
+            && 1 == zmq_poll(&item, 1, 0) && (item.revents & ZMQ_POLLIN)) {
+        zmsg_t *msg = zmsg_recv(server);
+        if (!msg) {
+            break;
+        }
+        inbound.push_back(Inbound());
+        inbound.back().msg = msg;
+        /* the flag marks HELLOs with a config until they are parsed */
+        zframe_t *frame = zmsg_first(msg);
+        frame = frame ? zmsg_next(msg) : NULL;
+        if (frame && fncs::MSG_HELLO == fncs::to_type(frame) && zmsg_next(msg)) {
+            inbound.back().parsed = true;
+            ++n_hellos;
+        }
+    }
+    if (n_hellos < 2) {
+        /* not worth a thread, the dispatcher parses it */
+        for (size_t i=0; i<inbound.size(); ++i) {
+            inbound[i].parsed = false;
+        }
+        return;
+    }
+
+    size_t stride = min(static_cast<size_t>(n_threads), n_hellos);
+    vector<HelloParse> work(stride);
+    vector<zactor_t*> parsers;
+    for (size_t t=0; t<stride; ++t) {
+        work[t].inbound = &inbound;
+        work[t].first = t;
+        work[t].stride = stride;
+        if (t) {
+            parsers.push_back(zactor_new(hello_parser, &work[t]));
+        }
+    }
+    hello_parse(work[0]);
+    for (size_t t=0; t<parsers.size(); ++t) {
+        zactor_destroy(&parsers[t]);
+    }
+    LDEBUG4C(logCONFIG) << "parsed " << n_hellos << " HELLO configs on "
+        << stride << " threads";
+}
+
+class fncs::BrokerState {
+    public:
+        BrokerState() : endpoint(), args(), actor(NULL), tenant(), bound() {}
+
+        string endpoint;
+        vector<string> args; /* as fncs_broker's command line */
+        zactor_t *actor;
+        string tenant; /* the namespace, if run by a tenant host */
+        string bound; /* ... and the endpoint it bound, told the host */
+};
+
+
+/* The options a tenant ignores: the files and endpoints of a broker,
+ * which the tenants of a host would share, and those of the root. */
+static const char *tenant_ignored[] = {
+    "FNCS_BROKER_CPU",
+    "FNCS_BROKER_FILE",
+    "FNCS_CHECKPOINT",
+    "FNCS_DATA_CHANNEL",
+    "FNCS_GRANT_CAST",
+    "FNCS_METRICS",
+    "FNCS_RECORD",
+    "FNCS_REPLAY",
+    "FNCS_RESTART",
+    "FNCS_ROOT_BROKER",
+    "FNCS_TIMELINE",
+    "FNCS_TRACE",
+    NULL
+};
+
+/* getenv, except for what a tenant ignores */
+static const char* broker_getenv(const char *name)
+{
+    const char *value = getenv(name);
+    if (value && tenant) {
+        for (size_t i=0; tenant_ignored[i]; ++i) {
+            if (0 == strcmp(name, tenant_ignored[i])) {
+                LWARNING << "tenant '" << tenant << "' ignores " << name;
+                return NULL;
+            }
+        }
+    }
+    return value;
+}
+
+
+/* The broker, binding the given endpoint rather than FNCS_BROKER's if
+ * any, and signaling the actor pipe, if any, once bound. The state of a
+ * tenant is told the endpoint bound before, and the pipe TENANT once the
+ * federation ended, see tenant_host(). */
+static int broker_run(int argc, char **argv, const char *bind_endpoint, zsock_t *pipe,
+        fncs::BrokerState *state=NULL)
+{
+    /* declare all variables */
+    unsigned int n_sims = 0;    /* how many sims will connect */
+    set<string> byes;           /* which sims have disconnected */
+    int n_processing = 0;       /* how many sims are processing a time step */
+    const char *endpoint = NULL;/* broker location */
+    SimVec simulators;          /* vector of connected simulator state */
+    SimIndex name_to_index;     /* quickly lookup sim state index */
+    TopicMap topic_to_indexes;  /* quickly lookup subscribed sims */
+    DispatchBuffers buffers;    /* reused by every message */
+    deque<Inbound> inbound;     /* messages taken early, see hello_prefetch() */
+    int hello_threads = cpu_count(); /* FNCS_HELLO_THREADS */
+    fncs::Config hello_config;  /* of the HELLO taken from inbound */
+    fncs::TopicRouter router;   /* pattern subscriptions */
+    NamePatternVec name_patterns; /* of any publisher name */
+    SimAckMap name_to_keys;     /* ACK keys per sim name */
+    SimKeyMap name_to_peers;    /* summary of peers per sim name */
+    SimKeyMap name_to_subscribers; /* sims subscribed to each sim name */
+    ClusterVec clusters;        /* per cluster clock and grant queue */
+    unsigned long long fanout_bytes_avoided = 0; /* payload not duplicated */
+    zsock_t *server = NULL;     /* the broker socket */
+    bool do_trace = false;      /* whether to dump all received messages */
+    bool do_trace_binary = false; /* binary trace through a writer thread */
+    bool trace_compress = false; /* zstd chunks of binary traces */
+    bool allow_binary = true;   /* whether binary protocol may be selected */
+    Barrier barrier = BARRIER_GLOBAL; /* when to grant */
+    SimGraph downstream;        /* subscriber indexes per publisher index */
+    fncs::time realtime_interval = 0;
+    int io_threads = 0;         /* --io-threads, 0 keeps zmq's default */
+    fncs::time poll_spin = 0;   /* FNCS_POLL, busy polling before blocking */
+    size_t recv_batch = 1;      /* FNCS_RECV_BATCH, see recv_drain() */
+    IngressQueues ingress;      /* FNCS_INGRESS_FAIR, per sender queues */
+    const char *root_endpoint = NULL; /* root broker, when a sub-broker */
+    string subbroker_name;      /* identity presented to the root */
+    set<string> remote_topics;  /* local topics the root wants forwarded */
+    set<size_t> list_topics;    /* IDs of topics with at least one list subscriber */
+    bool root_bye_sent = false; /* all local sims left, waiting on root */
+    bool late_join = false;     /* sims may connect after the start */
+    bool started = false;       /* the first n_sims sims were ACKed */
+    IndexVec joining;           /* connected late, awaiting a boundary */
+    bool checkpoint_due = false; /* checkpoint at the first grant ... */
+    fncs::time checkpoint_time = 0; /* ... at or after this time */
+    bool restart = false;       /* resume from the last checkpoint */
+    fncs::time time_restart = 0; /* time the checkpoint was taken before */
+    map<string,SimulatorState> restored; /* sim states of the checkpoint */
+    fncs::time optimism_window = 0; /* how far past the GVT sims run, 0 if unbounded */
+    fncs::time gvt = 0;         /* of an optimistic federation */
+    vector<char*> args;         /* positional command line args */
+
+    globals_reset();
+    embedded = pipe != NULL;
+    if (state && !state->tenant.empty()) {
+        tenant = state->tenant.c_str();
+    }
+    if (!embedded) {
+        fncs::start_logging();
+        fncs::replicate_logging(FNCSLog::ReportingLevel(),
+                Output2Tee::Stream1(), Output2Tee::Stream2(), Output2Tee::Async(),
+                Output2Tee::Categories());
+    }
+
+    /* pull options out of the command line, leaving positional args */
+    for (int i=0; i<argc; ++i) {
+        string arg(argv[i]);
+        string value;
+        if (arg == "--io-threads") {
+            if (i+1 >= argc) {
+                LERROR << "--io-threads requires a value";
+                broker_die(simulators, server);
+            }
+            value = argv[++i];
+        }
+        else if (arg.compare(0, 13, "--io-threads=") == 0) {
+            value = arg.substr(13);
+        }
+        else {
+            args.push_back(argv[i]);
+            continue;
+        }
+        char *end = NULL;
+        long threads = strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end || threads < 1 || threads > 1024) {
+            LERROR << "--io-threads must be a number of threads, not '" << value << "'";
+            broker_die(simulators, server);
+        }
+        io_threads = static_cast<int>(threads);
+        LDEBUG4C(logCONFIG) << "io_threads = " << io_threads;
+    }
+    argc = static_cast<int>(args.size());
+    args.push_back(NULL);
+    argv = &args[0];
+
+    /* how many simulators are connecting? */
+    if (argc > 3) {
+        LERROR << "too many command line args";
+        exit(EXIT_FAILURE);
+    }
+    if (argc < 2) {
+        LERROR << "missing command line arg for number of simulators";
+        exit(EXIT_FAILURE);
+    }
+    if (argc >= 2) {
+        int n_sims_signed = 0;
+        istringstream iss(argv[1]);
+        iss >> n_sims_signed;
+        LDEBUG4C(logCONFIG) << "n_sims_signed = " << n_sims_signed;
+        if (n_sims_signed <= 0) {
+            LERROR << "number of simulators arg must be >= 1";
+            exit(EXIT_FAILURE);
+        }
+        n_sims = static_cast<unsigned int>(n_sims_signed);
+    }
+    if (argc == 3) {
+        realtime_interval = fncs::parse_time(argv[2]);
+        LDEBUG4C(logCONFIG) << "realtime_interval = " << realtime_interval << " ns";
+    }
+
+    /* pacing and deadline handling of realtime mode */
+    {
+        const char *env_scale = getenv("FNCS_REALTIME_SCALE");
+        if (env_scale) {
+            char *end = NULL;
+            realtime_scale = strtod(env_scale, &end);
+            if (end == env_scale || *end || !(realtime_scale > 0)) {
+                LERROR << "FNCS_REALTIME_SCALE must be a positive factor, not '"
+                    << env_scale << "'";
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "realtime_scale = " << realtime_scale;
+        }
+        const char *env_policy = getenv("FNCS_REALTIME_POLICY");
+        if (env_policy) {
+            string policy(env_policy);
+            if (policy == "burst") {
+                realtime_policy = CATCHUP_BURST;
+            }
+            else if (policy == "skip") {
+                realtime_policy = CATCHUP_SKIP;
+            }
+            else if (policy == "abort") {
+                realtime_policy = CATCHUP_ABORT;
+            }
+            else {
+                LERROR << "FNCS_REALTIME_POLICY must be burst, skip or abort, not '"
+                    << env_policy << "'";
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "realtime_policy = " << policy;
+        }
+        const char *env_tolerance = getenv("FNCS_REALTIME_TOLERANCE");
+        if (env_tolerance && !fncs::try_parse_time(env_tolerance, realtime_tolerance)) {
+            LERROR << "FNCS_REALTIME_TOLERANCE must be a time, not '"
+                << env_tolerance << "'";
+            exit(EXIT_FAILURE);
+        }
+        LDEBUG4C(logCONFIG) << "realtime_tolerance = " << realtime_tolerance << " ns";
+    }
+
+    {
+        const char *env_do_trace = broker_getenv("FNCS_TRACE");
+        if (env_do_trace) {
+            if (env_do_trace[0] == 'Y'
+                    || env_do_trace[0] == 'y'
+                    || env_do_trace[0] == 'T'
+                    || env_do_trace[0] == 't') {
+                do_trace = true;
+            }
+        }
+        const char *env_trace_format = getenv("FNCS_TRACE_FORMAT");
+        if (env_trace_format) {
+            if (string(env_trace_format) == "binary") {
+                do_trace_binary = true;
+            }
+            else if (string(env_trace_format) != "text") {
+                LWARNING << "ignoring invalid FNCS_TRACE_FORMAT '" << env_trace_format << "'";
+            }
+        }
+        const char *env_trace_compress = getenv("FNCS_TRACE_COMPRESS");
+        if (env_trace_compress) {
+            if (env_trace_compress[0] == 'Y'
+                    || env_trace_compress[0] == 'y'
+                    || env_trace_compress[0] == 'T'
+                    || env_trace_compress[0] == 't') {
+                trace_compress = true;
+            }
+        }
+    }
+
+    {
+        const char *env_protocol = getenv("FNCS_PROTOCOL");
+        if (env_protocol && fncs::PROTOCOL_STRING == string(env_protocol)) {
+            LDEBUG4C(logCONFIG) << "binary protocol disabled by FNCS_PROTOCOL";
+            allow_binary = false;
+        }
+    }
+
+    {
+        const char *env_barrier = getenv("FNCS_BARRIER");
+        if (env_barrier) {
+            if (string(env_barrier) == "partial") {
+                barrier = BARRIER_PARTIAL;
+            }
+            else if (string(env_barrier) == "cluster") {
+                barrier = BARRIER_CLUSTER;
+            }
+            else if (string(env_barrier) != "global") {
+                LWARNING << "ignoring invalid FNCS_BARRIER '" << env_barrier << "'";
+            }
+        }
+        LDEBUG4C(logCONFIG) << "using "
+            << (BARRIER_PARTIAL == barrier ? "partial" :
+                    BARRIER_CLUSTER == barrier ? "cluster" : "global")
+            << " barrier";
+    }
+
+    if (do_trace && do_trace_binary) {
+        LDEBUG4C(logCONFIG) << "binary tracing of all published messages enabled";
+        trace_writer = new fncs::TraceWriter;
+        if (!trace_writer->open("broker_trace.bin", trace_compress)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (do_trace) {
+        LDEBUG4C(logCONFIG) << "tracing of all published messages enabled";
+        trace.open("broker_trace.txt");
+        if (!trace) {
+            LERROR << "Could not open trace file 'broker_trace.txt'";
+            exit(EXIT_FAILURE);
+        }
+        trace << "#nanoseconds\ttopic\tvalue" << endl;
+    }
+
+    /* metrics are gathered if either is set */
+    {
+        const char *env_metrics = broker_getenv("FNCS_METRICS");
+        const char *env_interval = getenv("FNCS_METRICS_INTERVAL");
+        if (env_metrics || env_interval) {
+            fncs::time interval = fncs::parse_time(env_interval ? env_interval : "10s");
+            if (0 == interval) {
+                LERROR << "FNCS_METRICS_INTERVAL must be > 0";
+                exit(EXIT_FAILURE);
+            }
+            int top = env_size("FNCS_METRICS_TOP");
+            broker_metrics = new fncs::BrokerMetrics;
+            if (!broker_metrics->open(env_metrics, interval, top < 0 ? 10 : top)) {
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "metrics reported every " << interval << " ns";
+        }
+    }
+
+    /* compute and wait spans of every sim, for a timeline viewer */
+    {
+        const char *env_timeline = broker_getenv("FNCS_TIMELINE");
+        if (env_timeline) {
+            timeline = new fncs::Timeline;
+            if (!timeline->open(env_timeline)) {
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "timeline recorded in " << env_timeline;
+        }
+    }
+
+    /* spin before blocking, and on which core, for latency bound rounds */
+    {
+        const char *env_poll = getenv("FNCS_POLL");
+        if (env_poll && !fncs::parse_poll(env_poll, poll_spin)) {
+            LERROR << "FNCS_POLL must be 'block' or 'spin:<time>', not '" << env_poll << "'";
+            exit(EXIT_FAILURE);
+        }
+        if (poll_spin) {
+            LDEBUG4C(logCONFIG) << "spinning " << poll_spin << " ns before blocking";
+        }
+        const char *env_cpu = broker_getenv("FNCS_BROKER_CPU");
+        if (env_cpu) {
+            char *end = NULL;
+            long cpu = strtol(env_cpu, &end, 10);
+            if (end == env_cpu || *end || cpu < 0) {
+                LERROR << "FNCS_BROKER_CPU must be a core number, not '" << env_cpu << "'";
+                exit(EXIT_FAILURE);
+            }
+            if (!pin_to_cpu(static_cast<int>(cpu))) {
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "broker pinned to cpu " << cpu;
+        }
+    }
+
+    /* threads parsing the configs of sims starting together */
+    {
+        const char *env_threads = getenv("FNCS_HELLO_THREADS");
+        if (env_threads) {
+            char *end = NULL;
+            long threads = strtol(env_threads, &end, 10);
+            if (end == env_threads || *end || threads < 1) {
+                LERROR << "FNCS_HELLO_THREADS must be a number of threads, not '"
+                    << env_threads << "'";
+                exit(EXIT_FAILURE);
+            }
+            hello_threads = static_cast<int>(threads);
+        }
+        LDEBUG4C(logCONFIG) << "hello_threads = " << hello_threads;
+    }
+
+    /* messages taken off the server per poll */
+    {
+        const char *env_recv = getenv("FNCS_RECV_BATCH");
+        if (env_recv) {
+            char *end = NULL;
+            long messages = strtol(env_recv, &end, 10);
+            if (end == env_recv || *end || messages < 1) {
+                LERROR << "FNCS_RECV_BATCH must be a number of messages, not '"
+                    << env_recv << "'";
+                exit(EXIT_FAILURE);
+            }
+            recv_batch = static_cast<size_t>(messages);
+            LDEBUG4C(logCONFIG) << "up to " << recv_batch << " messages read per poll";
+        }
+    }
+
+    /* control messages ahead of other senders' PUBLISH floods */
+    {
+        const char *env_fair = getenv("FNCS_INGRESS_FAIR");
+        if (env_fair) {
+            char *end = NULL;
+            long quantum = strtol(env_fair, &end, 10);
+            if (end == env_fair || *end || quantum < 0) {
+                LERROR << "FNCS_INGRESS_FAIR must be a number of messages, not '"
+                    << env_fair << "'";
+                exit(EXIT_FAILURE);
+            }
+            ingress.quantum = static_cast<size_t>(quantum);
+            LDEBUG4C(logCONFIG) << "fair ingress, " << ingress.quantum
+                << " publishes per sender per turn";
+        }
+    }
+
+    /* PUBLISHes to one sim sent together, fewer messages per round */
+    {
+        const char *env_batch = getenv("FNCS_DELIVERY_BATCH");
+        if (env_batch) {
+            char *end = NULL;
+            long pairs = strtol(env_batch, &end, 10);
+            if (end == env_batch || *end || pairs < 0) {
+                LERROR << "FNCS_DELIVERY_BATCH must be a number of values, not '"
+                    << env_batch << "'";
+                exit(EXIT_FAILURE);
+            }
+            delivery_batch = static_cast<size_t>(pairs);
+            if (delivery_batch) {
+                LDEBUG4C(logCONFIG) << "up to " << delivery_batch
+                    << " values sent to a sim per PUBLISH_BATCH";
+            }
+        }
+    }
+
+    /* load summaries for federates that throttle themselves */
+    {
+        const char *env_load = getenv("FNCS_LOAD_FEEDBACK");
+        if (env_load) {
+            char *end = NULL;
+            long grants = strtol(env_load, &end, 10);
+            if (end == env_load || *end || grants < 0) {
+                LERROR << "FNCS_LOAD_FEEDBACK must be a number of grants, not '"
+                    << env_load << "'";
+                exit(EXIT_FAILURE);
+            }
+            load_interval = static_cast<unsigned long long>(grants);
+            if (load_interval) {
+                LDEBUG4C(logCONFIG) << "load summary sent every " << load_interval
+                    << " grant(s) of a sim";
+            }
+        }
+    }
+
+    /* broker endpoint may come from env var */
+    endpoint = bind_endpoint ? bind_endpoint : getenv("FNCS_BROKER");
+    if (!endpoint) {
+        endpoint = "tcp://*:5570";
+    }
+
+    /* a sub-broker aggregates the sims of one node for a root broker */
+    root_endpoint = broker_getenv("FNCS_ROOT_BROKER");
+    if (root_endpoint) {
+        const char *env_name = getenv("FNCS_SUBBROKER_NAME");
+        if (env_name) {
+            subbroker_name = env_name;
+        }
+        else {
+            char *hostname = zsys_hostname();
+            subbroker_name = string("subbroker@") + (hostname ? hostname : "localhost");
+            zstr_free(&hostname);
+        }
+        if (BARRIER_GLOBAL != barrier) {
+            LWARNING << "sub-broker follows the root clock, ignoring FNCS_BARRIER";
+            barrier = BARRIER_GLOBAL;
+        }
+        LDEBUG4C(logCONFIG) << "sub-broker '" << subbroker_name << "' of " << root_endpoint;
+    }
+
+    /* the number of sims is then only how many start the federation */
+    {
+        const char *env_late_join = getenv("FNCS_LATE_JOIN");
+        if (env_late_join) {
+            char fc = env_late_join[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                late_join = true;
+            }
+        }
+        if (late_join && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_LATE_JOIN";
+            late_join = false;
+        }
+        if (late_join && BARRIER_GLOBAL != barrier) {
+            LWARNING << "late joins need the global barrier, ignoring FNCS_BARRIER";
+            barrier = BARRIER_GLOBAL;
+        }
+        if (late_join) {
+            LDEBUG4C(logCONFIG) << "sims may join after the first " << n_sims;
+        }
+        /* a sim that joins is sent the values published before */
+        const char *env_last_values = getenv("FNCS_LAST_VALUES");
+        if (env_last_values) {
+            char fc = env_last_values[0];
+            last_values = fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't';
+        }
+        if (last_values && !late_join) {
+            LWARNING << "FNCS_LAST_VALUES only serves FNCS_LATE_JOIN, ignored";
+            last_values = false;
+        }
+    }
+
+    /* checkpoints are taken where every sim has reported */
+    {
+        const char *env_checkpoint = broker_getenv("FNCS_CHECKPOINT");
+        if (env_checkpoint) {
+            checkpoint_time = fncs::parse_time(env_checkpoint);
+            checkpoint_due = true;
+        }
+        const char *env_restart = broker_getenv("FNCS_RESTART");
+        if (env_restart) {
+            char fc = env_restart[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                restart = true;
+            }
+        }
+        if ((checkpoint_due || restart) && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_CHECKPOINT and FNCS_RESTART";
+            checkpoint_due = false;
+            restart = false;
+        }
+        if ((checkpoint_due || restart) && BARRIER_GLOBAL != barrier) {
+            LWARNING << "checkpoints need the global barrier, ignoring FNCS_BARRIER";
+            barrier = BARRIER_GLOBAL;
+        }
+        if (checkpoint_due) {
+            LDEBUG4C(logCONFIG) << "checkpoint at " << checkpoint_time << " ns";
+        }
+        if (restart) {
+            if (!checkpoint_read(time_restart, restored)) {
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "restarting at " << time_restart << " ns";
+        }
+    }
+
+    /* sims run ahead of the others and are rolled back when a value
+     * reaches them too late, see optimistic_advance() */
+    {
+        const char *env_optimistic = getenv("FNCS_OPTIMISTIC");
+        if (env_optimistic) {
+            char fc = env_optimistic[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                optimistic = true;
+            }
+        }
+        if (optimistic && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_OPTIMISTIC";
+            optimistic = false;
+        }
+        if (optimistic) {
+            if (BARRIER_GLOBAL != barrier) {
+                LWARNING << "optimistic sims are not held at a barrier, ignoring FNCS_BARRIER";
+                barrier = BARRIER_GLOBAL;
+            }
+            if (late_join) {
+                LWARNING << "sims cannot join an optimistic federation, ignoring FNCS_LATE_JOIN";
+                late_join = false;
+            }
+            if (checkpoint_due || restart) {
+                LWARNING << "optimistic sims keep their own states, ignoring FNCS_CHECKPOINT and FNCS_RESTART";
+                checkpoint_due = false;
+                restart = false;
+            }
+            if (realtime_interval) {
+                LWARNING << "optimistic sims are not paced, ignoring the realtime interval";
+                realtime_interval = 0;
+            }
+            const char *env_window = getenv("FNCS_OPTIMISM_WINDOW");
+            if (env_window) {
+                optimism_window = fncs::parse_time(env_window);
+            }
+            LDEBUG4C(logCONFIG) << "optimistic, window of " << optimism_window << " ns";
+        }
+    }
+
+    /* topics the broker reduces from the values of others */
+    {
+        const char *env_aggregates = getenv("FNCS_AGGREGATES");
+        if (env_aggregates) {
+            aggregates = parse_aggregates(env_aggregates);
+        }
+        if (!aggregates.empty() && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_AGGREGATES";
+            aggregates.clear();
+        }
+        if (!aggregates.empty() && optimistic) {
+            LWARNING << "a rollback would not undo an aggregate, ignoring FNCS_AGGREGATES";
+            aggregates.clear();
+        }
+        /* their inputs are not edges of the subscription graph */
+        if (!aggregates.empty() && BARRIER_GLOBAL != barrier) {
+            LWARNING << "aggregates need the global barrier, ignoring FNCS_BARRIER";
+            barrier = BARRIER_GLOBAL;
+        }
+    }
+
+    /* grants of an interval a sim steps through without asking, see
+     * grant_lease() */
+    {
+        const char *env_lease = getenv("FNCS_LEASE");
+        if (env_lease) {
+            char fc = env_lease[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                lease = true;
+            }
+        }
+        if (lease && (root_endpoint || optimistic)) {
+            LWARNING << "a sub-broker or optimistic sim is not leased, ignoring FNCS_LEASE";
+            lease = false;
+        }
+        /* a joiner or an aggregate reaches sims off the graph, and a
+         * checkpoint needs every sim at its time */
+        if (lease && (late_join || checkpoint_due || !aggregates.empty())) {
+            LWARNING << "leases cannot be kept with FNCS_LATE_JOIN, FNCS_CHECKPOINT"
+                << " or FNCS_AGGREGATES, ignoring FNCS_LEASE";
+            lease = false;
+        }
+        if (lease) {
+            LDEBUG4C(logCONFIG) << "sims leased the steps no value can reach";
+        }
+    }
+
+    /* names that subscribers may use for the topics of others */
+    {
+        const char *env_aliases = getenv("FNCS_ALIASES");
+        if (env_aliases) {
+            aliases = parse_aliases(env_aliases);
+        }
+    }
+
+    /* what values take from one sim to another, in place of a network sim */
+    {
+        const char *env_links = getenv("FNCS_LINKS");
+        if (env_links) {
+            links = parse_links(env_links);
+        }
+        if (!links.empty() && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_LINKS";
+            links.clear();
+        }
+        if (!links.empty() && optimistic) {
+            LWARNING << "a rollback would not undo a link's queue, ignoring FNCS_LINKS";
+            links.clear();
+        }
+    }
+
+    /* every inbound message is recorded, or a record re-drives one sim
+     * whose peers and broker are stood in for by the record */
+    {
+        const char *env_record = broker_getenv("FNCS_RECORD");
+        const char *env_replay = broker_getenv("FNCS_REPLAY");
+        if ((env_record || env_replay) && root_endpoint) {
+            LWARNING << "sub-broker follows the root, ignoring FNCS_RECORD and FNCS_REPLAY";
+        }
+        else if (env_replay) {
+            const char *env_sim = getenv("FNCS_REPLAY_SIM");
+            if (!env_sim || !*env_sim) {
+                LERROR << "FNCS_REPLAY needs FNCS_REPLAY_SIM, the sim to replay";
+                exit(EXIT_FAILURE);
+            }
+            if (env_record) {
+                LWARNING << "a replay is not recorded, ignoring FNCS_RECORD";
+            }
+            replay_sim = env_sim;
+            if (!replay_open(env_replay)) {
+                exit(EXIT_FAILURE);
+            }
+            /* the stubbed sims take no time at all */
+            realtime_interval = 0;
+            LDEBUG4C(logCONFIG) << "replaying " << replay_sim << " from " << env_replay;
+        }
+        else if (env_record) {
+            recorder = new fncs::TraceWriter;
+            if (!recorder->open(env_record, trace_compress)) {
+                exit(EXIT_FAILURE);
+            }
+            LDEBUG4C(logCONFIG) << "recording to " << env_record;
+        }
+    }
+
+    /* Only the framing and network I/O of the connections spread over
+     * libzmq's I/O threads; dispatch and fan-out stay on this thread.
+     * An embedded broker shares the application's zmq context, whose
+     * I/O threads were fixed when its first socket was made. */
+    if (io_threads && !embedded) {
+        zsys_set_io_threads(io_threads);
+    }
+
+    server = zsock_new(ZMQ_ROUTER);
+    if (!server) {
+        LERROR << "socket creation failed";
+        exit(EXIT_FAILURE);
+    }
+    router_options(server, -1);
+    /* the stubbed sims are not there to be sent anything */
+    if (replay) {
+        zsock_set_router_mandatory(server, 0);
+    }
+    if (zsock_attach(server, fncs::resolve_endpoints(endpoint).c_str(), true)) {
+        LERROR << "could not bind '" << endpoint << "'";
+        exit(EXIT_FAILURE);
+    }
+    if (!(zsock_resolve(server) != server)) {
+        LERROR << "socket failed to resolve";
+        exit(EXIT_FAILURE);
+    }
+    LDEBUG4C(logCONFIG) << "broker socket bound to " << endpoint;
+    broker_file = broker_getenv("FNCS_BROKER_FILE");
+    if (broker_file) {
+        broker_file_write(server, fncs::resolve_endpoints(endpoint),
+                broker_getenv("FNCS_BROKER_ADVERTISE"));
+    }
+
+    /* Grants shared by many sims go out once on an XPUB, whose
+     * subscriptions tell which sims are listening, see grant_cast_flush().
+     * Sims connect to the same endpoint, so it must name an interface
+     * rather than a wildcard. */
+    grant_cast_endpoint = broker_getenv("FNCS_GRANT_CAST");
+    if (grant_cast_endpoint && !optimistic && !replay) {
+        grant_cast = zsock_new(ZMQ_XPUB);
+        if (!grant_cast || zsock_attach(grant_cast,
+                    fncs::resolve_endpoints(grant_cast_endpoint).c_str(), true)) {
+            LERROR << "could not bind FNCS_GRANT_CAST '" << grant_cast_endpoint << "'";
+            exit(EXIT_FAILURE);
+        }
+        /* a casting broker never drops what a busy sim has yet to read */
+        zsock_set_sndhwm(grant_cast, 0);
+        {
+            const char *env_topics = getenv("FNCS_CAST_TOPICS");
+            string list = env_topics ? env_topics : "";
+            size_t begin = 0;
+            while (begin < list.size()) {
+                size_t end = list.find(',', begin);
+                if (end == string::npos) {
+                    end = list.size();
+                }
+                if (end > begin) {
+                    cast_topics.insert(list.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+            if (!cast_topics.empty()) {
+                LDEBUG4C(logCONFIG) << cast_topics.size() << " topic(s) cast";
+            }
+        }
+        LDEBUG4C(logCONFIG) << "grants cast on " << grant_cast_endpoint;
+    }
+    else if (grant_cast_endpoint) {
+        LWARNING << "FNCS_GRANT_CAST is ignored by an optimistic federation and a replay";
+    }
+
+    /* Values go to the sims on a ROUTER of their own, so that a grant
+     * never waits behind them in a queue, see values_to(). It queues
+     * them without bound unless FNCS_DATA_SNDHWM says otherwise, while
+     * the grants keep the high water mark of the first. Checkpoints and
+     * rollbacks rely on values and grants coming in one order, so not
+     * with those. */
+    data_endpoint = broker_getenv("FNCS_DATA_CHANNEL");
+    if (data_endpoint && !optimistic && !checkpoint_due && !restart && !replay) {
+        int data_sndhwm = env_size("FNCS_DATA_SNDHWM");
+        data_server = zsock_new(ZMQ_ROUTER);
+        if (data_server) {
+            router_options(data_server, data_sndhwm < 0 ? 0 : data_sndhwm);
+        }
+        if (!data_server || zsock_attach(data_server,
+                    fncs::resolve_endpoints(data_endpoint).c_str(), true)) {
+            LERROR << "could not bind FNCS_DATA_CHANNEL '" << data_endpoint << "'";
+            exit(EXIT_FAILURE);
+        }
+        LDEBUG4C(logCONFIG) << "values sent on " << data_endpoint;
+    }
+    else if (data_endpoint) {
+        LWARNING << "FNCS_DATA_CHANNEL is ignored with FNCS_OPTIMISTIC,"
+            << " FNCS_CHECKPOINT, FNCS_RESTART or FNCS_REPLAY";
+    }
+
+    /* Repeated string values travel as codes, numbered from a file of
+     * them, one per line, and once published FNCS_DICTIONARY_LEARN times,
+     * see dictionary_learn(). A code means nothing outside this run nor
+     * to a sim told it on another socket, so not with those. */
+    {
+        const char *env_dictionary = getenv("FNCS_DICTIONARY");
+        const char *env_learn = getenv("FNCS_DICTIONARY_LEARN");
+        if (env_learn) {
+            dictionary_repeats = strtoul(env_learn, NULL, 10);
+        }
+        if (env_dictionary && *env_dictionary) {
+            ifstream seeds(env_dictionary);
+            if (!seeds) {
+                LERROR << "could not open FNCS_DICTIONARY '" << env_dictionary << "'";
+                exit(EXIT_FAILURE);
+            }
+            string line;
+            while (getline(seeds, line)) {
+                double number = 0.0;
+                if (!line.empty() && line[line.size()-1] == '\r') {
+                    line.erase(line.size()-1);
+                }
+                /* a number is left for the filters to compare */
+                if (!line.empty() && !to_number(line.data(), line.size(), number)) {
+                    coded_values.add(line);
+                }
+            }
+        }
+        dictionary_wanted = !coded_values.empty() || dictionary_repeats;
+        if (dictionary_wanted && (root_endpoint || checkpoint_due || restart
+                    || recorder || replay || grant_cast || data_server)) {
+            LWARNING << "FNCS_DICTIONARY is ignored by a sub-broker and with FNCS_CHECKPOINT,"
+                << " FNCS_RESTART, FNCS_RECORD, FNCS_REPLAY, FNCS_GRANT_CAST"
+                << " or FNCS_DATA_CHANNEL";
+            dictionary_wanted = false;
+        }
+        else if (dictionary_wanted) {
+            LDEBUG4C(logCONFIG) << coded_values.size() << " value(s) coded, more after "
+                << dictionary_repeats << " publishes";
+        }
+    }
+
+    if (tenant) {
+        char last[256] = "";
+        size_t size = sizeof(last);
+        zmq_getsockopt(zsock_resolve(server), ZMQ_LAST_ENDPOINT, last, &size);
+        state->bound = last;
+    }
+    if (pipe) {
+        zsock_signal(pipe, 0); /* federates may connect */
+    }
+
+    /* a sim's state is copied in as it connects, but never moved again
+     * until late joiners outgrow this */
+    simulators.reserve(n_sims);
+
+    /* begin event loop */
+    zmq_pollitem_t items[] = {
+        { zsock_resolve(server), 0, ZMQ_POLLIN, 0 },
+        { NULL, 0, 0, 0 }, /* root broker, once connected */
+        { grant_cast ? zsock_resolve(grant_cast) : NULL, 0,
+            static_cast<short>(grant_cast ? ZMQ_POLLIN : 0), 0 },
+        { data_server ? zsock_resolve(data_server) : NULL, 0, ZMQ_POLLIN, 0 }
+    };
+    int n_items = data_server ? 4 : grant_cast ? 3 : 1;
+    while (true) {
+        int rc = 0;
+        /* a replay hands over the stubbed sims' messages in their order */
+        zmsg_t *replayed = replay_take();
+
+        if (replayed || !inbound.empty()) {
+            items[0].revents = ZMQ_POLLIN;
+            for (int i=1; i<n_items; ++i) {
+                items[i].revents = 0;
+            }
+        }
+        else if (!ingress.empty()) {
+            /* the other sockets are not starved by a held burst */
+            rc = zmq_poll(items, n_items, 0);
+            items[0].revents = ZMQ_POLLIN;
+        }
+        else {
+            LDEBUG4 << "entering blocking poll";
+            rc = fncs::spin_poll(items, n_items, broker_metrics ?
+                    broker_metrics->timeout(fncs::timer_ft()) : -1, poll_spin);
+        }
+        if (rc == -1) {
+            LERROR << "broker polling error: " << strerror(errno);
+            broker_die(simulators, server); /* interrupted */
+        }
+
+        if (broker_metrics && broker_metrics->due(fncs::timer_ft())) {
+            metrics_report(simulators, topic_to_indexes);
+        }
+
+        if (items[0].revents & ZMQ_POLLIN) {
+            zmsg_t *msg = NULL;
+            zframe_t *frame = NULL;
+            string &sender = buffers.sender;
+            SimIndex::iterator sender_it;
+            fncs::MessageType message_type;
+            bool hello_parsed = false; /* hello_config holds its config */
+
+            LDEBUG4 << "incoming message";
+            /* sims starting together have their HELLOs parsed at once */
+            if (!replayed && inbound.empty() && !started && hello_threads > 1) {
+                hello_prefetch(server, inbound, n_sims - simulators.size(), hello_threads);
+            }
+            if (replayed) {
+                msg = replayed;
+            }
+            else if (!inbound.empty()) {
+                msg = inbound.front().msg;
+                hello_parsed = inbound.front().parsed;
+                if (hello_parsed) {
+                    hello_config = inbound.front().config;
+                }
+                inbound.pop_front();
+            }
+            else if (started && ingress.enabled()) {
+                /* whatever waits is queued by sender, then the fairest
+                 * message is dispatched */
+                ingress.take(server, max(recv_batch, INGRESS_HOLD));
+                msg = ingress.next();
+                if (!msg) {
+                    msg = zmsg_recv(server);
+                }
+            }
+            else {
+                msg = zmsg_recv(server);
+                /* the rest of a burst waits its turn in inbound */
+                if (msg && started && recv_batch > 1) {
+                    recv_drain(server, inbound, recv_batch - 1);
+                }
+            }
+            if (!msg) {
+                LERROR << "null message received";
+                broker_die(simulators, server);
+            }
+            if (recorder) {
+                recorder->message(round_count, round_time, msg);
+            }
+            else if (replay && !replayed) {
+                replay_check(msg);
+            }
+
+            /* first frame is sender */
+            frame = zmsg_first(msg);
+            if (!frame) {
+                LERROR << "message missing sender";
+                broker_die(simulators, server);
+            }
+            fncs::to_string(frame, sender);
+
+            /* resolve the sender once; the index is its integer ID for
+             * all further state lookups */
+            sender_it = name_to_index.find(sender);
+
+            /* next frame is message type identifier */
+            frame = zmsg_next(msg);
+            if (!frame) {
+                LERROR << "message missing type identifier";
+                broker_die(simulators, server);
+            }
+            message_type = fncs::to_type(frame);
+            FNCS_PROBE1(broker_dispatch, static_cast<int>(message_type));
+
+            /* dispatcher */
+            if (fncs::MSG_HELLO == message_type) {
+                SimulatorState state;
+                string config_string;
+                fncs::Config config;
+                string time_delta;
+                size_t index = 0;
+
+                LDEBUG4C(logCONFIG) << "HELLO received";
+
+                /* check for duplicate sims */
+                if (sender_it != name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' already connected";
+                    broker_die(simulators, server);
+                }
+                if (started && !late_join) {
+                    LERROR << "simulator '" << sender << "' connected after all "
+                        << n_sims << " simulators, see FNCS_LATE_JOIN";
+                    broker_die(simulators, server);
+                }
+                index = simulators.size();
+                LDEBUG4C(logCONFIG) << "registering client '" << sender << "'";
+
+                /* next frame is config chunk */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "HELLO message missing config frame";
+                    broker_die(simulators, server);
+                }
+
+                /* copy config frame into chunk */
+                config_string = fncs::to_string(frame);
+                LDEBUG2C(logCONFIG) << "-- recv configuration as follows --" << endl << config_string;
+
+                /* next frame is FNCS library version */
                 frame = zmsg_next(msg);
                 if (!frame) {
                     LWARNING << "HELLO message from '" << sender << "' missing FNCS library version";
@@ -260,8 +5328,141 @@ int main(int argc, char **argv)
                     }
                 }
 
-                /* parse config chunk */
-                config = fncs::parse_config(config_string);
+                /* next frame is the requested wire protocol; older
+                 * clients do not send it and only speak strings */
+                frame = zmsg_next(msg);
+                if (frame) {
+                    state.negotiated = true;
+                    state.binary = allow_binary
+                        && zframe_streq(frame, fncs::PROTOCOL_BINARY);
+                    frame = zmsg_next(msg);
+                }
+
+                /* subscriptions may come packed instead of in the config,
+                 * and are then indexed without any text parsing */
+                vector<pair<string,bool> > subscriptions;
+                vector<string> filters; /* of each subscription */
+                vector<bool> wakes; /* of each subscription */
+                vector<bool> priorities; /* of each subscription */
+                if (frame && zframe_streq(frame, fncs::MANIFEST)) {
+                    frame = zmsg_next(msg);
+                    if (!frame || !fncs::parse_manifest(zframe_data(frame),
+                                zframe_size(frame), subscriptions, filters, wakes,
+                                priorities)) {
+                        LERROR << "HELLO message from '" << sender << "' has a malformed manifest";
+                        broker_die(simulators, server);
+                    }
+                    state.manifest = true;
+                    frame = zmsg_next(msg);
+                }
+
+                /* whether it reads compressed values */
+                if (frame && zframe_streq(frame, fncs::ZSTD)) {
+                    state.zstd = true;
+                    frame = zmsg_next(msg);
+                }
+                /* and coded ones */
+                if (frame && zframe_streq(frame, fncs::DICTIONARY)) {
+                    state.dictionary = true;
+                    frame = zmsg_next(msg);
+                }
+                /* a rollback would break the chain of deltas */
+                if (frame && zframe_streq(frame, fncs::DELTA)) {
+                    state.delta = state.binary && !optimistic;
+                    frame = zmsg_next(msg);
+                }
+                if (frame && zframe_streq(frame, fncs::OPTIMISTIC)) {
+                    state.optimistic = true;
+                    frame = zmsg_next(msg);
+                }
+                /* only worth it if values are queued at all */
+                if (frame && zframe_streq(frame, fncs::GRANT_BATCH)) {
+                    state.grant_batch = delivery_batch != 0;
+                    frame = zmsg_next(msg);
+                }
+                /* an optimistic federation keeps the values sent by topic,
+                 * as does a record, so that fncs_analyze can read them */
+                if (frame && zframe_streq(frame, fncs::TOPIC_IDS)) {
+                    state.topic_ids = state.binary && !optimistic && !recorder;
+                    frame = zmsg_next(msg);
+                }
+                if (frame && zframe_streq(frame, fncs::GRANT_CAST)) {
+                    state.grant_casts = grant_cast && !optimistic;
+                    frame = zmsg_next(msg);
+                }
+                /* where it takes values directly from its publishers */
+                if (frame && zframe_streq(frame, fncs::DIRECT)) {
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        LERROR << "HELLO message missing direct endpoint";
+                        broker_die(simulators, server);
+                    }
+                    if (!optimistic) {
+                        state.direct_endpoint = fncs::to_string(frame);
+                    }
+                    frame = zmsg_next(msg);
+                }
+                /* values queued for its grants come with them instead */
+                if (frame && zframe_streq(frame, fncs::DATA)) {
+                    state.data_channel = data_server && !state.grant_batch;
+                    frame = zmsg_next(msg);
+                }
+                /* a rollback would not undo a fetch, and only the global
+                 * barrier holds every publisher within a step of it */
+                if (frame && zframe_streq(frame, fncs::PULL)) {
+                    state.pull = !optimistic && !root_endpoint && BARRIER_GLOBAL == barrier;
+                    if (!state.pull) {
+                        LWARNING << sender << " is sent the values it would pull";
+                    }
+                    frame = zmsg_next(msg);
+                }
+                if (frame && zframe_streq(frame, fncs::SUBSCRIBED)) {
+                    state.anon_filter = true;
+                    frame = zmsg_next(msg);
+                }
+                /* it takes load summaries with its grants */
+                if (frame && zframe_streq(frame, fncs::LOAD)) {
+                    state.load = load_interval != 0;
+                    frame = zmsg_next(msg);
+                }
+                if (optimistic && !state.optimistic) {
+                    LERROR << sender << " cannot roll back, which FNCS_OPTIMISTIC needs"
+                        << " of every sim, see fncs::set_rollback()";
+                    broker_die(simulators, server);
+                }
+                if (started && compression && !(state.zstd && state.binary)) {
+                    LERROR << sender << " cannot read the compressed values of the others";
+                    broker_die(simulators, server);
+                }
+                if (started && dictionary && !(state.dictionary && state.binary)) {
+                    LERROR << sender << " cannot read the coded values of the others";
+                    broker_die(simulators, server);
+                }
+
+                /* a sub-broker lists the sims it stands in for */
+                if (frame && zframe_streq(frame, MEMBERS)) {
+                    for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                        string member = fncs::to_string(frame);
+                        if (name_to_index.count(member) != 0) {
+                            LERROR << "simulator '" << member << "' already connected";
+                            broker_die(simulators, server);
+                        }
+                        name_to_index[member] = index;
+                        state.members.push_back(member);
+                    }
+                    LDEBUG4C(logCONFIG) << sender << " is a sub-broker of "
+                        << state.members.size() << " sim(s)";
+                    if (started) {
+                        LERROR << "sub-broker '" << sender << "' cannot join late";
+                        broker_die(simulators, server);
+                    }
+                }
+                LDEBUG4C(logCONFIG) << sender << " using "
+                    << (state.binary ? fncs::PROTOCOL_BINARY : fncs::PROTOCOL_STRING)
+                    << " protocol";
+
+                /* parse config chunk, unless that was done already */
+                config = hello_parsed ? hello_config : fncs::parse_config(config_string);
 
                 /* get time delta from config */
                 time_delta = config.time_delta;
@@ -270,414 +5471,1687 @@ int main(int argc, char **argv)
                     LWARNING << sender << " time_delta defaulting to 1s";
                     time_delta = "1s";
                 }
-                state.time_delta = fncs::parse_time(time_delta);
+                state.time_delta = fncs::parse_time(time_delta);
+
+                /* a compound federate publishes for logical sims sharing
+                 * its clock, which subscribers name like any other sim */
+                if (!config.members.empty()) {
+                    if (!fncs::expand_members(config.members, state.compound)) {
+                        LERROR << sender << " has invalid members '" << config.members << "'";
+                        broker_die(simulators, server);
+                    }
+                    for (size_t i=0; i<state.compound.size(); ++i) {
+                        const string &member = state.compound[i];
+                        if (name_to_index.count(member) != 0) {
+                            LERROR << "simulator '" << member << "' already connected";
+                            broker_die(simulators, server);
+                        }
+                        name_to_index[member] = index;
+                    }
+                    LDEBUG4C(logCONFIG) << sender << " is a compound federate of "
+                        << state.compound.size() << " sim(s)";
+                }
+
+                /* optional promise about when its publishes take effect */
+                if (!config.lookahead.empty()) {
+                    state.lookahead = fncs::parse_time(config.lookahead);
+                    LDEBUG4C(logCONFIG) << sender << " lookahead = " << state.lookahead;
+                    if (state.lookahead) {
+                        lookahead_declared = true;
+                    }
+                }
+
+                /* parse subscription values */
+                for (size_t i=0; i<config.values.size(); ++i) {
+                    subscriptions.push_back(make_pair(
+                                config.values[i].topic, config.values[i].is_list()));
+                    filters.push_back(config.values[i].filter());
+                    wakes.push_back(config.values[i].wakes());
+                    priorities.push_back(config.values[i].prioritized());
+                }
+                if (!subscriptions.empty()) {
+                    set<string> peers;
+                    set<size_t> listed; /* topic IDs, by any name */
+                    set<size_t> by_alias; /* ... by an alias */
+                    for (size_t i=0; i<subscriptions.size(); ++i) {
+                        /* an alias is routed as the topic it stands for */
+                        map<string,string>::const_iterator alias =
+                            aliases.find(subscriptions[i].first);
+                        const string &topic = alias == aliases.end() ?
+                            subscriptions[i].first : alias->second;
+                        size_t id = topics.intern(topic);
+                        LDEBUG4C(logCONFIG) << "adding value '" << topic << "'";
+                        if (alias != aliases.end()) {
+                            LDEBUG4C(logCONFIG) << "as its alias '" << alias->first << "'";
+                            state.aliases.push_back(make_pair(id, topics.intern(alias->first)));
+                        }
+                        if (!listed.insert(id).second
+                                && (alias != aliases.end() || by_alias.count(id))) {
+                            LWARNING << sender << " subscribed to '" << topic
+                                << "' by more than one name, its values come by one of them";
+                        }
+                        if (alias != aliases.end()) {
+                            by_alias.insert(id);
+                        }
+                        /* a pulled value is kept for it rather than sent */
+                        bool pulled = state.pull && !subscriptions[i].second
+                            && !fncs::is_topic_pattern(topic) && filter_pulls(filters[i]);
+                        if (pulled) {
+                            if (id >= topic_to_indexes.size()) {
+                                topic_to_indexes.resize(topics.size());
+                            }
+                            topic_to_indexes[id].pulled = true;
+                            pulled_values = true;
+                        }
+                        else {
+                            state.subscription_values.push_back(id);
+                        }
+                        if (state.topic_ids) {
+                            state.subscription_ids.push_back(
+                                    fncs::is_topic_pattern(topic) ? fncs::NO_TOPIC_ID : id);
+                        }
+                        /* passive values are cached for the next grant */
+                        if (!wakes[i]) {
+                            state.passive_values.push_back(id);
+                            if (fncs::is_topic_pattern(topic)) {
+                                state.passive_patterns.push_back(topic);
+                            }
+                        }
+                        /* prioritized values overtake the others queued */
+                        if (priorities[i]) {
+                            state.priority_values.push_back(id);
+                            if (fncs::is_topic_pattern(topic)) {
+                                state.priority_patterns.push_back(topic);
+                            }
+                        }
+                        if (subscriptions[i].second) {
+                            state.list_values.push_back(id);
+                            list_topics.insert(id);
+                            if (fncs::is_topic_pattern(topic)) {
+                                state.list_patterns.push_back(topic);
+                            }
+                        }
+                        ValueFilter filter;
+                        if (!pulled && !filters[i].empty() && parse_filter(filters[i],
+                                    subscriptions[i].second, sender, topic, filter)) {
+                            if (fncs::is_topic_pattern(topic)) {
+                                state.filter_patterns.push_back(make_pair(topic, filter));
+                            }
+                            else {
+                                state.filters[topic] = filter;
+                            }
+                        }
+                        /* a late joiner is indexed once admitted */
+                        if (!started && !pulled) {
+                            subscribe(topic_to_indexes, router, topic, index);
+                        }
+                        size_t loc = topic.find('/');
+                        if (fncs::is_topic_pattern(topic.substr(0,loc))) {
+                            /* the sims are told when they are ACKed */
+                            if (started) {
+                                LWARNING << sender << " subscribed to '" << topic
+                                    << "', which only sims joining later are told to publish";
+                            }
+                            name_patterns.push_back(NamePattern(sender,
+                                        topic.substr(0, topic.find_first_of("*?")),
+                                        subscriptions[i].second,
+                                        subscriptions[i].second && state.delta));
+                        }
+                        else if (loc == string::npos) {
+                            LWARNING << "invalid topic: " << topic;
+                        }
+                        else {
+                            string name = topic.substr(0,loc);
+                            string key = topic.substr(loc+1);
+                            /* publishers only send the keys in their ACK */
+                            if (started && name_to_index.count(name)
+                                    && !name_to_keys[name].has(key)) {
+                                LWARNING << sender << " subscribed to '" << topic
+                                    << "', which " << name << " was not told to publish";
+                            }
+                            name_to_keys[name].add(key, subscriptions[i].second,
+                                    subscriptions[i].second && state.delta);
+                            LDEBUG4C(logCONFIG) << "name_to_keys[" << name << "]=" << key;
+                            peers.insert(name);
+                        }
+                    }
+                    for (set<string>::iterator it=peers.begin();
+                            it!=peers.end(); ++it) {
+                        name_to_subscribers[*it].insert(sender);
+                    }
+                    name_to_peers[sender] = peers;
+                    sort_unique(state.subscription_values);
+                    sort(state.aliases.begin(), state.aliases.end());
+                    sort_unique(state.list_values);
+                    sort_unique(state.passive_values);
+                    sort_unique(state.priority_values);
+                }
+                else {
+                    LDEBUG4C(logCONFIG) << "no subscription values";
+                }
+
+                /* populate sim state object */
+                state.name = sender;
+                /*state.time_delta = fncs::parse_time(time_delta);*/ /*above*/
+                state.time_requested = 0;
+                state.time_last_processed = 0;
+                state.processing = false;
+                state.messages_pending = false;
+                name_to_index[sender] = index;
+                simulators.push_back(state);
+                simulators.back().identity = zframe_new(sender.data(), sender.size());
+                connect_links(simulators, name_to_index, index);
+
+                LDEBUG4C(logCONFIG) << "simulators.size() = " << simulators.size();
+
+                if (started) {
+                    LDEBUG4C(logCONFIG) << sender << " joins at the next grant";
+                    joining.push_back(index);
+                }
+                /* if all sims have connected, send the go-ahead */
+                else if (simulators.size() == n_sims) {
+                    started = true;
+                    time_real_start = realtime_now();
+                    /* easier to keep a counter than iterating over states */
+                    n_processing = n_sims;
+                    for (size_t i=0; i<n_sims; ++i) {
+                        resolve_name_patterns(name_patterns, simulators,
+                                i, name_to_keys, name_to_peers,
+                                name_to_subscribers);
+                        resolve_aggregate_inputs(simulators, topic_to_indexes,
+                                router, i, name_to_keys, name_to_peers,
+                                name_to_subscribers);
+                    }
+                    /* dependency graph from the subscriptions */
+                    downstream.assign(n_sims, set<size_t>());
+                    for (size_t i=0; i<n_sims; ++i) {
+                        set<string> &peers = name_to_peers[simulators[i].name];
+                        for (set<string>::iterator it=peers.begin();
+                                it!=peers.end(); ++it) {
+                            SimIndex::iterator simit = name_to_index.find(*it);
+                            if (simit != name_to_index.end()
+                                    && simit->second != i) {
+                                downstream[simit->second].insert(i);
+                            }
+                        }
+                    }
+                    assign_clusters(simulators, downstream,
+                            barrier != BARRIER_CLUSTER, clusters);
+                    LDEBUG4C(logCONFIG) << clusters.size() << " cluster(s)";
+                    /* restarted sims count from zero again, so they are
+                     * treated as joining at the checkpoint */
+                    if (restart) {
+                        clusters[0].time_granted = time_restart;
+                        for (size_t i=0; i<n_sims; ++i) {
+                            SimulatorState &state = simulators[i];
+                            map<string,SimulatorState>::iterator it =
+                                restored.find(state.name);
+                            if (it == restored.end()) {
+                                LWARNING << state.name << " is not in the checkpoint";
+                                fast_forward(state, time_restart);
+                            }
+                            else {
+                                state.time_last_processed = it->second.time_last_processed;
+                                state.lookahead_floor = it->second.lookahead_floor;
+                                state.messages_pending = it->second.messages_pending;
+                            }
+                            state.time_join = time_restart;
+                        }
+                    }
+                    /* a sub-broker learns from the root which local
+                     * topics are wanted elsewhere before it can ACK */
+                    if (root_endpoint) {
+                        remote_topics = root_connect(root_endpoint,
+                                subbroker_name, simulators, name_to_index, server,
+                                list_topics);
+                        for (set<string>::iterator it=remote_topics.begin();
+                                it!=remote_topics.end(); ++it) {
+                            size_t loc = it->find('/');
+                            if (loc != string::npos) {
+                                name_to_keys[it->substr(0,loc)].add(it->substr(loc+1),
+                                        list_topics.count(topics.find(*it)) > 0);
+                            }
+                        }
+                        items[1].socket = zsock_resolve(root);
+                        items[1].events = ZMQ_POLLIN;
+                        n_items = max(n_items, 2);
+                    }
+                    /* a sub-broker was told by the root */
+                    if (!root_endpoint) {
+                        compression = true;
+                        for (size_t i=0; i<n_sims; ++i) {
+                            compression = compression
+                                && simulators[i].zstd && simulators[i].binary;
+                        }
+                    }
+                    if (dictionary_wanted) {
+                        dictionary = true;
+                        for (size_t i=0; i<n_sims; ++i) {
+                            dictionary = dictionary
+                                && simulators[i].dictionary && simulators[i].binary;
+                        }
+                        if (!dictionary) {
+                            LWARNING << "not every sim reads coded values, FNCS_DICTIONARY ignored";
+                        }
+                    }
+                    /* send ACK to all registered sims */
+                    TimeVec peers = time_peers(simulators, downstream, name_to_peers);
+                    /* with no one to join later and no one reading every
+                     * value, unsubscribed values may be dropped at once */
+                    string subscribed;
+                    if (!late_join && !root_endpoint && !do_trace) {
+                        int max_exact = env_size("FNCS_SUBSCRIBED_EXACT");
+                        subscribed = pack_subscribed(topic_to_indexes, router,
+                                max_exact < 0 ? 4096 : max_exact);
+                    }
+                    for (size_t i=0; i<n_sims; ++i) {
+                        AckKeys merged;
+                        const AckKeys *ack = &name_to_keys[simulators[i].name];
+                        /* a sub-broker gets the keys of all its members */
+                        const vector<string> &members = simulators[i].members;
+                        if (!members.empty()) {
+                            merged = *ack;
+                            for (size_t m=0; m<members.size(); ++m) {
+                                const AckKeys &member = name_to_keys[members[m]];
+                                for (size_t k=0; k<member.keys.size(); ++k) {
+                                    merged.add(members[m] + '/' + topics.str(member.keys[k]),
+                                            member.is_list(k));
+                                }
+                            }
+                            ack = &merged;
+                        }
+                        simulators[i].processing = true;
+                        if (broker_metrics || load_interval) {
+                            simulators[i].metrics.granted(fncs::timer_ft());
+                        }
+                        if (timeline) {
+                            timeline->granted(simulators[i].track,
+                                    simulators[i].name, fncs::timer_ft(), 0);
+                        }
+                        simulators[i].time_peer = peers[i];
+                        /* values a late joiner, the root, the trace, a
+                         * record or a checkpoint would miss go through
+                         * the broker */
+                        string direct;
+                        if (!late_join && !root_endpoint && !do_trace
+                                && !recorder && !replay
+                                && !checkpoint_due && !restart) {
+                            direct = plan_direct(simulators, topic_to_indexes,
+                                    router, i, *ack);
+                        }
+                        send_ack(server, simulators[i], i, n_sims, *ack, peers[i],
+                                direct, subscribed);
+                    }
+                }
+            }
+            else if (optimistic && (fncs::MSG_TIME_REQUEST == message_type
+                        || fncs::MSG_BYE == message_type)) {
+                /* not held at a barrier, see optimistic_advance() */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+                SimulatorState &state = simulators[sender_it->second];
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << fncs::to_string(message_type) << " message missing time frame";
+                    broker_die(simulators, server);
+                }
+                if (broker_metrics || load_interval) {
+                    state.metrics.reported(fncs::timer_ft());
+                }
+                if (timeline) {
+                    timeline->reported(state.track, fncs::timer_ft());
+                }
+                state.processing = false;
+                if (fncs::MSG_BYE == message_type) {
+                    LDEBUG4 << "BYE received";
+                    if (state.rollback_due) {
+                        LWARNING << sender << " left before it could redo its step at "
+                            << state.rollback_to << " ns, its results from then on are not consistent";
+                    }
+                    byes.insert(sender);
+                    state.departed = true;
+                    frame = zmsg_next(msg);
+                    if (frame && zframe_streq(frame, fncs::DETACH) && !state.detached) {
+                        send_identity(server, state);
+                        fncs::send_type(server, fncs::MSG_BYE, state.binary, false);
+                        state.detached = true;
+                        LDEBUG4 << sender << " detached";
+                    }
+                    state.rollback_due = false;
+                    state.stale = false;
+                    state.inbox.clear();
+                    destroy_frames(state.outbox);
+                    if (byes.size() == n_sims) {
+                        send_byes(server, simulators, simulators.size());
+                        zmsg_destroy(&msg);
+                        break;
+                    }
+                }
+                else {
+                    /* a stale request is answered by the rollback */
+                    state.time_requested = frame_time(simulators, server, frame, state.binary);
+                    state.time_last_processed = state.time_current;
+                    LDEBUG4C(logTIME) << "TIME_REQUEST " << sender << " requested "
+                        << state.time_requested;
+                }
+                optimistic_advance(server, simulators, optimism_window, gvt);
+            }
+            else if (optimistic && (fncs::MSG_PUBLISH == message_type
+                        || fncs::MSG_PUBLISH_BATCH == message_type)) {
+                /* held for the subscribers' grants, see optimistic_publish() */
+                bool idle = false;
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+                size_t publisher = sender_it->second;
+                if (simulators[publisher].stale) {
+                    LDEBUG4C(logPUBLISH) << "dropping " << fncs::to_string(message_type)
+                        << " of a step " << sender << " redoes";
+                    zmsg_destroy(&msg);
+                    continue;
+                }
+                for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                    zframe_t *value = zmsg_next(msg);
+                    string topic = fncs::to_string(frame);
+                    if (!value) {
+                        LERROR << fncs::to_string(message_type)
+                            << " message missing value for " << topic;
+                        broker_die(simulators, server);
+                    }
+                    if (broker_metrics) {
+                        simulators[publisher].metrics.published(zframe_size(value));
+                    }
+                    if (do_trace) {
+                        trace_publish(simulators[publisher].time_current, topic, value);
+                    }
+                    if (dictionary) {
+                        dictionary_learn(server, simulators, joining,
+                                zframe_data(value), zframe_size(value));
+                    }
+                    size_t id = route(topic_to_indexes, router, topic);
+                    if (id == fncs::TopicIntern::npos()) {
+                        if (broker_metrics) {
+                            broker_metrics->topic(topic, zframe_size(value), 0);
+                        }
+                        continue;
+                    }
+                    IndexVec &iv = topic_to_indexes[id].indexes;
+                    size_t n_delivered = 0;
+                    for (IndexVec::iterator index=iv.begin(); index!=iv.end(); ++index) {
+                        if (!simulators[*index].departed) {
+                            if (broker_metrics) {
+                                simulators[*index].metrics.received(zframe_size(value));
+                                broker_metrics->delivered(publisher, *index,
+                                        zframe_size(value));
+                                ++n_delivered;
+                            }
+                            idle = optimistic_publish(simulators, publisher, *index,
+                                    topic, value) || idle;
+                        }
+                    }
+                    if (broker_metrics) {
+                        broker_metrics->topic(topic, zframe_size(value), n_delivered);
+                    }
+                }
+                if (idle) {
+                    optimistic_advance(server, simulators, optimism_window, gvt);
+                }
+            }
+            else if (optimistic && fncs::MSG_PUBLISH_AT == message_type) {
+                LWARNING << "dropping PUBLISH_AT from " << sender
+                    << ", values cannot be held for later grants of optimistic sims";
+            }
+            else if (fncs::MSG_TIME_REQUEST == message_type
+                    || fncs::MSG_BYE == message_type) {
+                size_t index = 0; /* index of sim state */
+                fncs::time time_requested;
+                fncs::time time_last;
+
+                if (fncs::MSG_TIME_REQUEST == message_type) {
+                    LDEBUG4C(logTIME) << "TIME_REQUEST received from " << sender;
+                }
+                else if (fncs::MSG_BYE == message_type) {
+                    LDEBUG4 << "BYE received";
+                }
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                /* index of sim state */
+                index = sender_it->second;
+                if (broker_metrics || load_interval) {
+                    simulators[index].metrics.reported(fncs::timer_ft());
+                }
+                if (timeline) {
+                    timeline->reported(simulators[index].track, fncs::timer_ft());
+                }
+
+                if (fncs::MSG_BYE == message_type) {
+                    /* next frame is time last processed */
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        LERROR << "BYE message missing time last frame";
+                        broker_die(simulators, server);
+                    }
+                    /* convert time frame */
+                    time_last = frame_time(simulators, server, frame, simulators[index].binary);
+
+                    /* soft error if muliple byes received */
+                    if (byes.count(sender)) {
+                        LWARNING << "duplicate BYE from '" << sender << "'";
+                    }
+
+                    /* add sender to list of leaving sims */
+                    byes.insert(sender);
+                    simulators[index].departed = true;
+
+                    /* one that detaches is let go now rather than at the end */
+                    frame = zmsg_next(msg);
+                    if (frame && zframe_streq(frame, fncs::DETACH)
+                            && !simulators[index].detached) {
+                        send_identity(server, simulators[index]);
+                        fncs::send_type(server, fncs::MSG_BYE, simulators[index].binary, false);
+                        simulators[index].detached = true;
+                        LDEBUG4 << sender << " detached";
+                    }
+
+                    /* a departed sim no longer costs anything in fan-out */
+                    {
+                        vector<size_t> values = simulators[index].subscription_values;
+                        values.insert(values.end(), simulators[index].runtime_values.begin(),
+                                simulators[index].runtime_values.end());
+                        for (size_t v=0; v<values.size(); ++v) {
+                            if (values[v] < topic_to_indexes.size()) {
+                                topic_to_indexes[values[v]].remove(index);
+                            }
+                        }
+                        ++send_lists_generation;
+                    }
+
+                    /* if all byes received, then exit */
+                    if (byes.size() == n_sims && root) {
+                        /* the root decides when everyone is finished */
+                        LDEBUG4 << "sending BYE to root";
+                        fncs::send_type(root, fncs::MSG_BYE, root_binary, true);
+                        fncs::send_time(root, root_time, root_binary, false);
+                        root_bye_sent = true;
+                        zmsg_destroy(&msg);
+                        continue;
+                    }
+                    else if (byes.size() == n_sims) {
+                        if (!joining.empty()) {
+                            LWARNING << joining.size() << " sim(s) connected too late to join";
+                        }
+                        /* let all sims know that globally we are finished */
+                        send_byes(server, simulators, simulators.size());
+                        /* need to delete msg since we are breaking from loop */
+                        zmsg_destroy(&msg);
+                        break;
+                    }
+
+                    /* update sim state; a departed sim is never granted */
+                    simulators[index].time_requested = ULLONG_MAX;
+                    simulators[index].messages_pending = false;
+                }
+                else if (fncs::MSG_TIME_REQUEST == message_type
+                        && zmsg_size(msg) == 2 && simulators[index].time_period) {
+                    /* a bare request stands for the next period */
+                    SimulatorState &state = simulators[index];
+                    state.time_requested = state.time_current + state.time_period;
+                    state.time_next_publish = 0;
+                    time_last = state.time_current;
+
+                    LDEBUG4C(logTIME) << "TIME_REQUEST " << sender
+                        << " requested " << state.time_requested << " (periodic)";
+                }
+                else if (fncs::MSG_TIME_REQUEST == message_type) {
+                    /* next frame is time requested */
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        LERROR << "TIME_REQUEST message missing time request frame";
+                        broker_die(simulators, server);
+                    }
+                    /* convert time frame */
+                    time_requested = frame_time(simulators, server, frame, simulators[index].binary);
+                    /* next frame is time last processed */
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        LERROR << "TIME_REQUEST message missing time last frame";
+                        broker_die(simulators, server);
+                    }
+                    /* convert time frame */
+                    time_last = frame_time(simulators, server, frame, simulators[index].binary);
+                    /* optional frame is the next time it will publish */
+                    frame = zmsg_next(msg);
+                    simulators[index].time_next_publish = frame ?
+                        frame_time(simulators, server, frame, simulators[index].binary) : 0;
+                    if (simulators[index].time_next_publish) {
+                        publish_declared = true;
+                    }
+
+                    /* a late joiner counts from zero, but starts at
+                     * the federation time it was admitted at */
+                    if (time_requested < simulators[index].time_join) {
+                        fncs::time delta = simulators[index].time_delta;
+                        time_requested = (simulators[index].time_join + delta - 1)
+                            / delta * delta;
+                    }
+                    if (time_last < simulators[index].time_join) {
+                        time_last = simulators[index].time_last_processed;
+                    }
+
+                    /* update sim state */
+                    simulators[index].time_requested = time_requested;
+
+                    LDEBUG4C(logTIME) << "TIME_REQUEST " << sender << " requested " << time_requested;
+                }
+
+                /* update sim state */
+                simulators[index].time_last_processed = time_last;
+                simulators[index].processing = false;
+                reschedule(clusters, simulators[index]);
+
+                --n_processing;
+
+                /* sims granted below were waiting on this one */
+                if (broker_metrics || load_interval) {
+                    straggler = &simulators[index].metrics;
+                    straggler_released = false;
+                }
+
+                /* grant whichever sims no longer depend on others */
+                if (BARRIER_PARTIAL == barrier) {
+                    n_processing += grant_partial(server, simulators,
+                            downstream, realtime_interval);
+                }
+                /* if all sims of the cluster are done, determine its
+                 * next time step */
+                else if (0 == --clusters[simulators[index].cluster].n_processing) {
+                    Cluster &cluster = clusters[simulators[index].cluster];
+                    if (root) {
+                        root_request(cluster);
+                    }
+                    else {
+                        cluster.time_granted = cluster.schedule.top_key();
+                        LDEBUG4C(logTIME) << "time_granted = " << cluster.time_granted;
+                        FNCS_PROBE1(broker_round, cluster.time_granted);
+                        if (realtime_interval
+                                && !realtime_wait(cluster.time_granted, realtime_interval)) {
+                            broker_die(simulators, server);
+                        }
+                        if (!joining.empty()) {
+                            n_processing += admit_joins(server, simulators, joining,
+                                    name_to_index, topic_to_indexes, router,
+                                    name_patterns, name_to_keys,
+                                    name_to_peers, name_to_subscribers,
+                                    downstream, cluster,
+                                    simulators[index].cluster);
+                            n_sims = simulators.size();
+                        }
+                        if (checkpoint_due && cluster.time_granted >= checkpoint_time) {
+                            checkpoint(server, simulators, cluster.time_granted);
+                            checkpoint_due = false;
+                        }
+                        n_processing += grant_cluster(server, simulators, downstream, cluster);
+                    }
+                }
+
+                if (straggler) {
+                    if (straggler_released) {
+                        ++straggler->n_last;
+                    }
+                    straggler = NULL;
+                }
+            }
+            else if (fncs::MSG_PUBLISH_AT == message_type) {
+                size_t publisher = 0;
+                zframe_t *topic_frame = NULL;
+                zframe_t *value = NULL;
+
+                LDEBUG4C(logPUBLISH) << "PUBLISH_AT received";
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+                publisher = sender_it->second;
+
+                /* topic, value and delivery time frames */
+                topic_frame = zmsg_next(msg);
+                value = topic_frame ? zmsg_next(msg) : NULL;
+                frame = value ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "PUBLISH_AT message missing frames";
+                    broker_die(simulators, server);
+                }
+                string topic = fncs::to_string(topic_frame);
+                fncs::time time_delivery = frame_time(simulators, server, frame,
+                        simulators[publisher].binary);
+                if (broker_metrics) {
+                    simulators[publisher].metrics.published(zframe_size(value));
+                }
+                if (do_trace) {
+                    trace_publish(simulators[publisher].time_current, topic, value);
+                }
+                if (dictionary) {
+                    dictionary_learn(server, simulators, joining,
+                            zframe_data(value), zframe_size(value));
+                }
+                if (root && remote_topics.count(topic)) {
+                    LWARNING << "'" << topic << "' held for " << time_delivery
+                        << " is only delivered to local subscribers";
+                }
 
-                /* parse subscription values */
-                set<string> subscription_values;
-                if (!config.values.empty()) {
-                    vector<fncs::Subscription> &subs = config.values;
-                    set<string> peers;
-                    for (size_t i=0; i<subs.size(); ++i) {
-                        string topic = subs[i].topic;
-                        LDEBUG4 << "adding value '" << topic << "'";
-                        subscription_values.insert(topic);
-                        TopicMap::iterator it = topic_to_indexes.find(topic);
-                        if (it != topic_to_indexes.end()) {
-                            it->second.push_back(index);
+                /* held per subscriber, which becomes actionable by then */
+                size_t id = route(topic_to_indexes, router, topic);
+                size_t n_held = 0;
+                if (id != fncs::TopicIntern::npos()) {
+                    IndexVec &iv = topic_to_indexes[id].indexes;
+                    for (IndexVec::iterator index=iv.begin(); index!=iv.end(); ++index) {
+                        SimulatorState &state = simulators[*index];
+                        if (state.departed) {
+                            continue;
                         }
-                        else {
-                            topic_to_indexes[topic] = IndexVec(1,index);
+                        if (!state.members.empty()) {
+                            LWARNING << "'" << topic << "' held for " << time_delivery
+                                << " is not delivered through sub-broker " << state.name;
+                            continue;
                         }
-                        size_t loc = topic.find('/');
-                        if (loc == string::npos) {
-                            LWARNING << "invalid topic: " << topic;
+                        state.delayed.push(Delayed(time_delivery, delayed_order++, topic, value));
+                        if (!state.processing) {
+                            reschedule(clusters, state);
                         }
-                        else {
-                            string name = topic.substr(0,loc);
-                            string key = topic.substr(loc+1);
-                            name_to_keys[name].insert(key);
-                            LDEBUG4 << "name_to_keys[" << name << "]=" << key;
-                            peers.insert(name);
+                        if (broker_metrics) {
+                            broker_metrics->delivered(publisher, *index, zframe_size(value));
+                            ++n_held;
                         }
                     }
-                    for (set<string>::iterator it=peers.begin();
-                            it!=peers.end(); ++it) {
-                        SimTimeMap::iterator stm = name_to_peertimes.find(*it);
-                        if (stm == name_to_peertimes.end()) {
-                            name_to_peertimes[*it] = TimeVec(1, state.time_delta);
-                        }
-                        else {
-                            name_to_peertimes[*it].push_back(state.time_delta);
-                        }
+                }
+                if (broker_metrics) {
+                    broker_metrics->topic(topic, zframe_size(value), n_held);
+                }
+            }
+            else if (fncs::MSG_PUBLISH == message_type) {
+                string &topic = buffers.topic;
+                bool found_one = false;
+                size_t publisher = 0;
+                size_t sent_id = fncs::TopicIntern::npos(); /* if sent by ID */
+
+                LDEBUG4C(logPUBLISH) << "PUBLISH received";
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                /* next frame is topic, or its ID */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "PUBLISH message missing topic";
+                    broker_die(simulators, server);
+                }
+                if (fncs::decode_topic_id(zframe_data(frame), zframe_size(frame), sent_id)) {
+                    if (sent_id >= topics.size()) {
+                        LERROR << "PUBLISH message has unknown topic ID " << sent_id;
+                        broker_die(simulators, server);
                     }
-                    name_to_peers[sender] = peers;
+                    topic.assign(topics.data(sent_id), topics.length(sent_id));
                 }
                 else {
-                    LDEBUG4 << "no subscription values";
+                    fncs::to_string(frame, topic);
                 }
+                publisher = sender_it->second;
 
-                /* populate sim state object */
-                state.name = sender;
-                /*state.time_delta = fncs::parse_time(time_delta);*/ /*above*/
-                state.time_requested = 0;
-                state.time_last_processed = 0;
-                state.processing = false;
-                state.messages_pending = false;
-                state.subscription_values = subscription_values;
-                name_to_index[sender] = index;
-                simulators.push_back(state);
+                LDEBUG4C(logPUBLISH) << "PUBLISH received topic " << topic;
 
-                LDEBUG4 << "simulators.size() = " << simulators.size();
+                if (do_trace) {
+                    /* next frame is value payload */
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        LERROR << "PUBLISH message missing value";
+                        broker_die(simulators, server);
+                    }
+                    trace_publish(simulators[publisher].time_current, topic, frame);
+                }
 
-                /* if all sims have connected, send the go-ahead */
-                if (simulators.size() == n_sims) {
-                    time_real_start = fncs::timer_ft();
-                    time_real = 0;
-                    if (realtime_interval) {
-#ifdef _WIN32
-                        cerr << "realtime clock not yet supported on WIN32" << endl;
-                        exit(EXIT_FAILURE);
+                /* send the message to subscribed sims */
+#if 0
+                for (size_t i=0; i<n_sims; ++i) {
+                    bool found = false;
+                    if (binary_search(simulators[i].subscription_values.begin(),
+                                simulators[i].subscription_values.end(),
+                                topics.find(topic))) {
+                        found = true;
+                    }
+                    if (found) {
+                        zmsg_t *msg_copy = zmsg_dup(msg);
+                        if (!msg_copy) {
+                            LERROR << "failed to copy pub message";
+                            broker_die(simulators, server);
+                        }
+                        /* swap out original sender with new destiation */
+                        zframe_reset(zmsg_first(msg_copy),
+                                simulators[i].name.c_str(),
+                                simulators[i].name.size());
+                        /* send it on */
+                        zmsg_send(&msg_copy, server);
+                        found_one = true;
+                        simulators[i].messages_pending = true;
+                        simulators[i].unicast_due = true;
+                        LDEBUG4C(logPUBLISH) << "pub to " << simulators[i].name;
+                    }
+                }
 #else
-                        struct itimerval it_val;  /* for setting itimer */
-
-                        /* setitimer call needs seconds and useconds */
-                        if (signal(SIGALRM, (void (*)(int)) time_real_update) == SIG_ERR) {
-                            perror("Unable to catch SIGALRM");
-                            exit(EXIT_FAILURE);
-                        }
-                        it_val.it_value.tv_sec = realtime_interval/1000000000UL;
-                        LDEBUG4 << "realtime_sec = " << it_val.it_value.tv_sec;
-                        it_val.it_value.tv_usec = realtime_interval/1000 % 1000000;
-                        LDEBUG4 << "realtime_usec = " << it_val.it_value.tv_usec;
-                        it_val.it_interval = it_val.it_value;
-                        if (setitimer(ITIMER_REAL, &it_val, NULL) == -1) {
+                {
+                    size_t id = sent_id != fncs::TopicIntern::npos() ?
+                        route(topic_to_indexes, router, sent_id)
+                        : route(topic_to_indexes, router, topic);
+                    vector<zframe_t*> &body = buffers.body;
+                    vector<zframe_t*> &text_body = buffers.text_body; /* for string peers */
+                    vector<zframe_t*> &id_body = buffers.id_body; /* for sims reading IDs */
+                    vector<zframe_t*> &alias_body = buffers.alias_body; /* for sims by an alias */
+                    vector<zframe_t*> &owned = buffers.owned;
+                    size_t body_size = 0;
+                    size_t value_size = 0;
+                    size_t n_delivered = 0; /* for the hot topics */
+
+                    /* frames after sender and type are forwarded by
+                     * reference; zmq refcounts the payload instead of
+                     * copying it once per subscriber */
+                    zmsg_first(msg);
+                    zmsg_next(msg);
+                    body.clear();
+                    for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                        body.push_back(frame);
+                        body_size += zframe_size(frame);
+                    }
+                    if (broker_metrics) {
+                        value_size = body.size() > 1 ? zframe_size(body[1]) : 0;
+                        simulators[publisher].metrics.published(value_size);
+                    }
+                    /* body names the topic, id_body is made once needed */
+                    id_body.clear();
+                    if (sent_id != fncs::TopicIntern::npos()) {
+                        id_body = body;
+                        body[0] = zframe_new(topic.data(), topic.size());
+                        owned.push_back(body[0]);
+                    }
+                    text_body = body;
+                    if (!format_typed_values(text_body, owned)) {
+                        text_body.clear();
+                    }
+                    if (dictionary && body.size() > 1) {
+                        dictionary_learn(server, simulators, joining,
+                                zframe_data(body[1]), zframe_size(body[1]));
+                    }
+                    /* kept for later subscribers even if none yet */
+                    if (last_values && body.size() > 1) {
+                        if (id == fncs::TopicIntern::npos()) {
+                            id = route(topic_to_indexes, router, topics.intern(topic));
+                        }
+                        keep_last_value(topic_to_indexes[id], body[1],
+                                simulators[publisher].time_current);
+                    }
+                    /* and for the sims that pull it */
+                    else if (pulled_values && body.size() > 1
+                            && id != fncs::TopicIntern::npos()
+                            && topic_to_indexes[id].pulled) {
+                        keep_last_value(topic_to_indexes[id], body[1],
+                                simulators[publisher].time_current);
+                        found_one = true;
+                    }
+                    if (!aggregates.empty() && body.size() > 1) {
+                        size_t input = id != fncs::TopicIntern::npos() ?
+                            id : topics.intern(topic);
+                        found_one = aggregate_update(simulators, clusters,
+                                topic_to_indexes, router, publisher, input, body[1])
+                            || found_one;
+                    }
+
+                    /* a sub-broker passes topics wanted elsewhere up */
+                    if (root && remote_topics.count(topic)) {
+                        fncs::send_type(root, fncs::MSG_PUBLISH,
+                                root_binary, !body.empty());
+                        if (send_body(root, root_binary || text_body.empty() ?
+                                    body : text_body, false)) {
+                            LERROR << "failed to forward pub message to root";
                             broker_die(simulators, server);
                         }
-#endif
+                        found_one = true;
                     }
-                    /* easier to keep a counter than iterating over states */
-                    n_processing = n_sims;
-                    /* send ACK to all registered sims */
-                    for (size_t i=0; i<n_sims; ++i) {
-                        set<string> &keys = name_to_keys[simulators[i].name];
-                        simulators[i].processing = true;
-                        LDEBUG4 << "sending first ACK to " << simulators[i].name;
-                        zstr_sendm(server, simulators[i].name.c_str());
-                        zstr_sendm(server, fncs::ACK);
-                        zstr_sendfm(server, "%llu", (unsigned long long)i);
-                        zstr_sendfm(server, "%llu", (unsigned long long)n_sims);
-                        zstr_sendfm(server, "%llu", (unsigned long long)keys.size());
-                        for (set<string>::iterator it=keys.begin(); it!=keys.end(); ++it) {
-                            zstr_sendm(server, it->c_str());
-                        }
-                        /* smallest delta of any clients */
-                        {
-                            fncs::time time_peer = 0;
-                            TimeVec &peertimes = name_to_peertimes[simulators[i].name];
-                            set<string> &peers = name_to_peers[simulators[i].name];
-                            for (set<string>::iterator it=peers.begin();
-                                    it!=peers.end(); ++it) {
-                                SimIndex::iterator simit = name_to_index.find(*it);
-                                if (simit != name_to_index.end()) {
-                                    size_t index = simit->second;
-                                    peertimes.push_back(simulators[index].time_delta);
+
+                    if (id != fncs::TopicIntern::npos()) {
+                        const vector<Send> &sends = send_list(simulators,
+                                topic_to_indexes[id], id);
+                        IndexVec &delivered = buffers.dests; /* positions in sends */
+
+                        size_t n_queued = 0;
+                        size_t n_held = 0; /* over a link, see FNCS_LINKS */
+                        /* a value of a cast topic goes out once for the
+                         * sims that read it as it is */
+                        string &cast_bitmap = buffers.cast_bitmap;
+                        bool cast = grant_cast && body.size() == 2
+                            && !cast_topics.empty() && cast_topics.count(topic);
+                        /* some may have been sent it by the publisher */
+                        const IndexVec *direct = direct_sends(simulators[publisher], id, topic);
+
+                        cast_bitmap.clear();
+                        delivered.clear();
+                        for (size_t d=0; d<sends.size(); ++d) {
+                            const Send &send = sends[d];
+                            if (direct && binary_search(direct->begin(), direct->end(),
+                                        send.index)) {
+                                continue;
+                            }
+                            /* held until it is through the link */
+                            Link *link = send.with_time || body.size() != 2 ?
+                                NULL : link_to(simulators[publisher], send.index);
+                            if (link) {
+                                hold_on_link(clusters, simulators[send.index], *link,
+                                        simulators[publisher].time_current, topic, body[1]);
+                                if (broker_metrics) {
+                                    broker_metrics->delivered(publisher, send.index, value_size);
                                 }
+                                found_one = true;
+                                ++n_held;
+                                continue;
+                            }
+                            if (send.filtered && body.size() > 1
+                                    && !filter_accepts(simulators[send.index], topic, body[1],
+                                        simulators[publisher].time_current)) {
+                                continue;
+                            }
+                            if (cast && send.binary && !send.with_time && !send.filtered
+                                    && alias_of(simulators[send.index], id)
+                                        == fncs::TopicIntern::npos()
+                                    && simulators[send.index].cast_ready
+                                    && simulators[send.index].outbox.empty()) {
+                                cast_set(cast_bitmap, simulators[send.index].cast_index);
+                                simulators[send.index].cast_due = true;
+                                delivered.push_back(d);
+                                ++n_queued;
+                                continue;
                             }
-                            if (!peertimes.empty()) {
-                                time_peer = *min_element(
-                                        peertimes.begin(),
-                                        peertimes.end());
+                            const vector<zframe_t*> &out = body_for(send, id,
+                                    body, text_body, id_body, alias_body, owned);
+                            if (send.batched && queue_publish(server,
+                                        simulators[send.index], out)) {
+                                delivered.push_back(d);
+                                ++n_queued;
+                                continue;
                             }
-                            LDEBUG4 << "time_peer = " << time_peer;
-                            LDEBUG4 << "time_delta= " << simulators[i].time_delta;
-                            zstr_sendfm(server, "%llu", (unsigned long long)time_peer);
+                            /* new destination replaces original sender */
+                            zsock_t *dest = values_to(server, simulators[send.index]);
+                            send_identity(dest, simulators[send.index]);
+                            /* type frame must match the subscriber's protocol */
+                            fncs::send_type(dest, fncs::MSG_PUBLISH, send.binary,
+                                    send.with_time || !body.empty());
+                            /* a sub-broker also needs the time of the
+                             * publish, which its own members lack */
+                            if (send_body(dest, out, send.with_time)) {
+                                LERROR << "failed to forward pub message";
+                                broker_die(simulators, server);
+                            }
+                            if (send.with_time) {
+                                fncs::send_time(dest, simulators[publisher].time_current,
+                                        send.binary, false);
+                            }
+                            simulators[send.index].unicast_due = true;
+                            delivered.push_back(d);
+                        }
+                        if (!cast_bitmap.empty()) {
+                            LDEBUG4C(logPUBLISH) << "casting '" << topic << "'";
+                            zstr_sendm(grant_cast, fncs::GRANT_CAST);
+                            zstr_sendfm(grant_cast, "%llu", ++grant_cast_seq);
+                            zstr_sendm(grant_cast, fncs::PUBLISH);
+                            zframe_send(&body[0], grant_cast, ZFRAME_REUSE | ZFRAME_MORE);
+                            zframe_send(&body[1], grant_cast, ZFRAME_REUSE | ZFRAME_MORE);
+                            zmq_send(zsock_resolve(grant_cast), cast_bitmap.data(),
+                                    cast_bitmap.size(), 0);
+                        }
+                        fanout_bytes_avoided += body_size * (delivered.size() - n_queued);
+                        found_one = found_one || !delivered.empty();
+                        n_delivered = delivered.size() + n_held;
+                        FNCS_PROBE3(broker_fanout, static_cast<const void*>(topic.data()),
+                                topic.size(), n_delivered);
+
+                        /* the subscribers' states once the sends are out */
+                        for (size_t d=0; d<delivered.size(); ++d) {
+                            const Send &send = sends[delivered[d]];
+                            size_t i = send.index;
+                            if (broker_metrics) {
+                                simulators[i].metrics.received(value_size);
+                                broker_metrics->delivered(publisher, i, value_size);
+                            }
+                            check_route(simulators, barrier, downstream, publisher, i);
+                            if (send.wakes) {
+                                note_delivery(simulators, clusters, i,
+                                        simulators[publisher].time_current,
+                                        time_effective(simulators[publisher],
+                                            simulators[publisher].time_current));
+                            }
+                            LDEBUG4C(logPUBLISH) << "pub to " << simulators[i].name;
                         }
-                        zstr_sendfm(server, "%d.%d.%d", FNCS_VERSION_MAJOR, FNCS_VERSION_MINOR, FNCS_VERSION_PATCH);
-                        zstr_send(server, fncs::ACK);
-                        LDEBUG4 << "ACK sent to '" << simulators[i].name;
                     }
+                    if (broker_metrics) {
+                        broker_metrics->topic(topic, value_size, n_delivered);
+                    }
+                    destroy_frames(owned);
+                }
+#endif
+                if (!found_one) {
+                    LDEBUG4C(logPUBLISH) << "dropping PUBLISH message '" << topic << "'";
                 }
             }
-            else if (fncs::TIME_REQUEST == message_type
-                    || fncs::BYE == message_type) {
-                size_t index = 0; /* index of sim state */
-                fncs::time time_requested;
-                fncs::time time_last;
+            else if (fncs::MSG_PUBLISH_BATCH == message_type) {
+                size_t publisher = 0;
+                fncs::time time_publish = 0;
+                string &topic = buffers.topic;
+                vector<zframe_t*> &upstream = buffers.body; /* pairs wanted by the root */
+                vector<zframe_t*> &batch = buffers.text_body; /* topic and value of each pair */
+                vector<zframe_t*> &owned = buffers.owned; /* typed values formatted as text */
+                IndexVec &ids = buffers.ids; /* topic of each pair */
+                IndexVec &dests = buffers.dests; /* subscribers with pairs */
+                size_t n_pairs = 0;
 
-                if (fncs::TIME_REQUEST == message_type) {
-                    LDEBUG4 << "TIME_REQUEST received from " << sender;
-                }
-                else if (fncs::BYE == message_type) {
-                    LDEBUG4 << "BYE received";
-                }
+                LDEBUG4C(logPUBLISH) << "PUBLISH_BATCH received";
 
                 /* did we receive message from a connected sim? */
-                if (name_to_index.count(sender) == 0) {
+                if (sender_it == name_to_index.end()) {
                     LERROR << "simulator '" << sender << "' not connected";
                     broker_die(simulators, server);
                 }
+                publisher = sender_it->second;
+                time_publish = simulators[publisher].time_current;
 
-                /* index of sim state */
-                index = name_to_index[sender];
-
-                if (fncs::BYE == message_type) {
-                    /* next frame is time last processed */
+                /* the last value of each topic, which is all that a
+                 * subscriber that does not keep a list is sent */
+                ++buffers.n_batches;
+                upstream.clear();
+                batch.clear();
+                ids.clear();
+                for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                    zframe_t *topic_frame = frame;
+                    size_t sent_id = 0;
+                    /* the pairs are passed on by name */
+                    if (fncs::decode_topic_id(zframe_data(frame), zframe_size(frame), sent_id)) {
+                        if (sent_id >= topics.size()) {
+                            LERROR << "PUBLISH_BATCH message has unknown topic ID " << sent_id;
+                            broker_die(simulators, server);
+                        }
+                        topic.assign(topics.data(sent_id), topics.length(sent_id));
+                        topic_frame = zframe_new(topic.data(), topic.size());
+                        owned.push_back(topic_frame);
+                    }
+                    else {
+                        fncs::to_string(frame, topic);
+                    }
                     frame = zmsg_next(msg);
                     if (!frame) {
-                        LERROR << "BYE message missing time last frame";
+                        LERROR << "PUBLISH_BATCH message missing value for " << topic;
                         broker_die(simulators, server);
                     }
-                    /* convert time string */
-                    {
-                        istringstream iss(fncs::to_string(frame));
-                        iss >> time_last;
+                    ++n_pairs;
+                    if (broker_metrics) {
+                        simulators[publisher].metrics.published(zframe_size(frame));
                     }
-
-                    /* soft error if muliple byes received */
-                    if (byes.count(sender)) {
-                        LWARNING << "duplicate BYE from '" << sender << "'";
+                    if (do_trace) {
+                        trace_publish(time_publish, topic, frame);
                     }
-
-                    /* add sender to list of leaving sims */
-                    byes.insert(sender);
-
-                    /* if all byes received, then exit */
-                    if (byes.size() == n_sims) {
-                        /* let all sims know that globally we are finished */
-                        for (size_t i=0; i<n_sims; ++i) {
-                            zstr_sendm(server, simulators[i].name.c_str());
-                            zstr_send(server, fncs::BYE);
-                            LDEBUG4 << "BYE sent to '" << simulators[i].name;
+                    if (dictionary) {
+                        dictionary_learn(server, simulators, joining,
+                                zframe_data(frame), zframe_size(frame));
+                    }
+                    if (root && remote_topics.count(topic)) {
+                        upstream.push_back(topic_frame);
+                        upstream.push_back(frame);
+                    }
+                    size_t id = route(topic_to_indexes, router, topic);
+                    if (last_values) {
+                        if (id == fncs::TopicIntern::npos()) {
+                            id = route(topic_to_indexes, router, topics.intern(topic));
                         }
-                        /* need to delete msg since we are breaking from loop */
-                        zmsg_destroy(&msg);
-                        break;
+                        keep_last_value(topic_to_indexes[id], frame, time_publish);
+                    }
+                    else if (pulled_values && id != fncs::TopicIntern::npos()
+                            && topic_to_indexes[id].pulled) {
+                        keep_last_value(topic_to_indexes[id], frame, time_publish);
                     }
+                    if (!aggregates.empty()) {
+                        aggregate_update(simulators, clusters, topic_to_indexes, router,
+                                publisher, id != fncs::TopicIntern::npos() ?
+                                id : topics.intern(topic), frame);
+                    }
+                    if (id == fncs::TopicIntern::npos()) {
+                        LDEBUG4C(logPUBLISH) << "dropping PUBLISH message '" << topic << "'";
+                        if (broker_metrics) {
+                            broker_metrics->topic(topic, zframe_size(frame), 0);
+                        }
+                        continue;
+                    }
+                    buffers.coalesce(id).value = frame;
+                    ids.push_back(id);
+                    batch.push_back(topic_frame);
+                    batch.push_back(frame);
+                }
 
-                    /* update sim state */
-                    simulators[index].time_requested = ULLONG_MAX;
+                /* one pass over the routed pairs gathers the pairs of
+                 * each subscriber, a non-list one's at the position of
+                 * the topic's first value */
+                dests.clear();
+                for (size_t j=0; j<batch.size(); j+=2) {
+                    size_t id = ids[j/2];
+                    Coalesced &coalesced = buffers.coalesce(id);
+                    fncs::to_string(batch[j], topic);
+                    bool first = coalesced.first(buffers.n_batches);
+                    IndexVec &iv = topic_to_indexes[id].indexes;
+                    const IndexVec *direct = direct_sends(simulators[publisher], id, topic);
+                    size_t n_delivered = 0;
+                    for (IndexVec::iterator index=iv.begin(); index!=iv.end(); ++index) {
+                        if (simulators[*index].departed) {
+                            continue;
+                        }
+                        if (direct && binary_search(direct->begin(), direct->end(), *index)) {
+                            continue;
+                        }
+                        /* every value goes through a link, held until it is */
+                        Link *link = simulators[*index].members.empty() ?
+                            link_to(simulators[publisher], *index) : NULL;
+                        if (link) {
+                            hold_on_link(clusters, simulators[*index], *link,
+                                    time_publish, topic, batch[j+1]);
+                            if (broker_metrics) {
+                                broker_metrics->delivered(publisher, *index,
+                                        zframe_size(batch[j+1]));
+                            }
+                            ++n_delivered;
+                            continue;
+                        }
+                        zframe_t *value = batch[j+1];
+                        if (!keeps_every_value(simulators[*index], id, topic)) {
+                            if (!first) {
+                                continue;
+                            }
+                            value = coalesced.value;
+                        }
+                        vector<zframe_t*> &dest = buffers.pairs_of(*index);
+                        if (dest.empty()) {
+                            dests.push_back(*index);
+                        }
+                        dest.push_back(batch[j]);
+                        dest.push_back(value);
+                        ++n_delivered;
+                    }
+                    if (broker_metrics) {
+                        broker_metrics->topic(topic, zframe_size(batch[j+1]), n_delivered);
+                    }
                 }
-                else if (fncs::TIME_REQUEST == message_type) {
-                    /* next frame is time requested */
-                    frame = zmsg_next(msg);
-                    if (!frame) {
-                        LERROR << "TIME_REQUEST message missing time request frame";
+                sort(dests.begin(), dests.end());
+                LDEBUG4C(logPUBLISH) << "PUBLISH_BATCH of " << n_pairs << " values";
+
+                if (!upstream.empty()) {
+                    if (!root_binary) {
+                        format_typed_values(upstream, owned);
+                    }
+                    fncs::send_type(root, fncs::MSG_PUBLISH_BATCH, root_binary, true);
+                    if (send_body(root, upstream, false)) {
+                        LERROR << "failed to forward pub message to root";
                         broker_die(simulators, server);
                     }
-                    /* convert time string */
-                    {
-                        istringstream iss(fncs::to_string(frame));
-                        iss >> time_requested;
+                }
+
+                /* older clients and sub-brokers get single PUBLISHes */
+                for (IndexVec::iterator it=dests.begin(); it!=dests.end(); ++it) {
+                    size_t i = *it;
+                    vector<zframe_t*> &dest = buffers.pairs[i];
+                    /* filtered after coalescing, so only the value sent
+                     * counts as the last one forwarded */
+                    if (!simulators[i].filters.empty()
+                            || !simulators[i].filter_patterns.empty()) {
+                        size_t kept = 0;
+                        for (size_t j=0; j<dest.size(); j+=2) {
+                            fncs::to_string(dest[j], topic);
+                            if (filter_accepts(simulators[i], topic, dest[j+1], time_publish)) {
+                                dest[kept++] = dest[j];
+                                dest[kept++] = dest[j+1];
+                            }
+                        }
+                        dest.resize(kept);
+                        if (dest.empty()) {
+                            continue;
+                        }
                     }
-                    /* next frame is time last processed */
-                    frame = zmsg_next(msg);
-                    if (!frame) {
-                        LERROR << "TIME_REQUEST message missing time last frame";
-                        broker_die(simulators, server);
+                    if (!simulators[i].binary) {
+                        format_typed_values(dest, owned);
                     }
-                    /* convert time string */
-                    {
-                        istringstream iss(fncs::to_string(frame));
-                        iss >> time_last;
+                    /* prioritized pairs go out first, ahead of the
+                     * values still queued for it */
+                    size_t n_first = 0;
+                    if (has_priorities(simulators[i])) {
+                        n_first = prioritize_pairs(simulators[i], dest, buffers.body);
+                    }
+                    /* named as subscribed, once filtered by the topics */
+                    const vector<zframe_t*> &sent = aliased(simulators[i], dest,
+                            buffers.alias_body, owned);
+                    if (simulators[i].negotiated && simulators[i].members.empty()) {
+                        zsock_t *out = values_to(server, simulators[i]);
+                        if (n_first) {
+                            vector<zframe_t*> &first = buffers.body;
+                            first.assign(sent.begin(), sent.begin() + n_first);
+                            send_identity(out, simulators[i]);
+                            fncs::send_type(out, fncs::MSG_PUBLISH_BATCH,
+                                    simulators[i].binary, true);
+                            if (send_body(out, first, false)) {
+                                LERROR << "failed to forward pub message";
+                                broker_die(simulators, server);
+                            }
+                        }
+                        if (n_first < sent.size()) {
+                            vector<zframe_t*> &rest = buffers.body;
+                            rest.assign(sent.begin() + n_first, sent.end());
+                            flush_outbox(server, simulators[i]);
+                            send_identity(out, simulators[i]);
+                            fncs::send_type(out, fncs::MSG_PUBLISH_BATCH,
+                                    simulators[i].binary, true);
+                            if (send_body(out, rest, false)) {
+                                LERROR << "failed to forward pub message";
+                                broker_die(simulators, server);
+                            }
+                        }
+                    }
+                    else {
+                        bool with_time = !simulators[i].members.empty();
+                        for (size_t j=0; j<sent.size(); j+=2) {
+                            vector<zframe_t*> &body = buffers.body;
+                            body.assign(sent.begin()+j, sent.begin()+j+2);
+                            send_identity(server, simulators[i]);
+                            fncs::send_type(server, fncs::MSG_PUBLISH,
+                                    simulators[i].binary, true);
+                            if (send_body(server, body, with_time)) {
+                                LERROR << "failed to forward pub message";
+                                broker_die(simulators, server);
+                            }
+                            if (with_time) {
+                                fncs::send_time(server, time_publish,
+                                        simulators[i].binary, false);
+                            }
+                        }
+                    }
+                    simulators[i].unicast_due = true;
+                    if (broker_metrics) {
+                        for (size_t j=1; j<dest.size(); j+=2) {
+                            simulators[i].metrics.received(zframe_size(dest[j]));
+                            broker_metrics->delivered(publisher, i, zframe_size(dest[j]));
+                        }
                     }
+                    check_route(simulators, barrier, downstream, publisher, i);
+                    if (pairs_wake(simulators[i], dest, topic)) {
+                        note_delivery(simulators, clusters, i, time_publish,
+                                time_effective(simulators[publisher], time_publish));
+                    }
+                    LDEBUG4C(logPUBLISH) << "pub batch to " << simulators[i].name;
+                }
+                for (IndexVec::iterator it=dests.begin(); it!=dests.end(); ++it) {
+                    buffers.pairs[*it].clear();
+                }
+                destroy_frames(owned);
+            }
+            else if (fncs::MSG_DIE == message_type) {
+                LDEBUG4 << "DIE received";
 
-                    /* update sim state */
-                    simulators[index].time_requested = time_requested;
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                broker_die(simulators, server);
+            }
+            else if (fncs::MSG_TIME_DELTA == message_type) {
+                size_t index = 0; /* index of sim state */
+                fncs::time time_delta;
+
+                LDEBUG4C(logTIME) << "TIME_DELTA received";
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                /* index of sim state */
+                index = sender_it->second;
+
+                /* next frame is time */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "TIME_DELTA message missing time frame";
+                    broker_die(simulators, server);
+                }
+                /* convert time frame */
+                time_delta = frame_time(simulators, server, frame, simulators[index].binary);
+
+                /* update sim state */
+                simulators[index].time_delta = time_delta;
+                if (!simulators[index].processing) {
+                    reschedule(clusters, simulators[index]);
+                }
+                if (started) {
+                    push_time_peers(server, simulators, downstream, name_to_peers);
+                }
+
+                /* the root wakes a sub-broker based on its members */
+                if (root) {
+                    fncs::send_type(root, fncs::MSG_TIME_DELTA, root_binary, true);
+                    fncs::send_time(root, members_delta(simulators), root_binary, false);
+                }
+            }
+            else if (fncs::MSG_LOOKAHEAD == message_type) {
+                size_t index = 0; /* index of sim state */
+                fncs::time lookahead;
+
+                LDEBUG4C(logTIME) << "LOOKAHEAD received";
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                /* index of sim state */
+                index = sender_it->second;
 
-                    LDEBUG4 << "TIME_REQUEST " << sender << " requested " << time_requested;
+                /* next frame is time */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "LOOKAHEAD message missing time frame";
+                    broker_die(simulators, server);
+                }
+                /* convert time frame */
+                lookahead = frame_time(simulators, server, frame, simulators[index].binary);
+
+                /* subscribers may already be stepping on the old
+                 * promise, which holds until it runs out */
+                SimulatorState &state = simulators[index];
+                if (lookahead < state.lookahead) {
+                    state.lookahead_floor = time_effective(state, state.time_current);
+                }
+                state.lookahead = lookahead;
+                if (lookahead) {
+                    lookahead_declared = true;
+                    /* its values are delayed, so it stopped sending
+                     * them directly */
+                    state.direct_relayed = true;
+                }
+            }
+            else if (fncs::MSG_PERIODIC == message_type) {
+                LDEBUG4C(logTIME) << "PERIODIC received";
+
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+
+                /* next frame is time */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "PERIODIC message missing time frame";
+                    broker_die(simulators, server);
                 }
+                /* convert time frame */
+                SimulatorState &state = simulators[sender_it->second];
+                state.time_period = frame_time(simulators, server, frame, state.binary);
+            }
+            else if (fncs::MSG_SUBSCRIBE == message_type) {
+                LDEBUG4C(logCONFIG) << "SUBSCRIBE received";
 
-                /* update sim state */
-                simulators[index].time_last_processed = time_last;
-                simulators[index].processing = false;
-
-                --n_processing;
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
 
-                /* if all sims are done, determine next time step */
-                if (0 == n_processing) {
-                    vector<fncs::time> time_actionable(n_sims);
-                    for (size_t i=0; i<n_sims; ++i) {
-                        if (simulators[i].messages_pending) {
-                            time_actionable[i] = 
-                                  simulators[i].time_last_processed
-                                + simulators[i].time_delta;
-                        }
-                        else {
-                            time_actionable[i] = simulators[i].time_requested;
-                        }
-                    }
-                    time_granted = *min_element(time_actionable.begin(),
-                                                time_actionable.end());
-                    LDEBUG4 << "time_granted = " << time_granted;
-                    if (realtime_interval) {
-#ifdef _WIN32
-                        cerr << "realtime clock not yet supported on WIN32" << endl;
-                        exit(EXIT_FAILURE);
-#else
-                        LDEBUG4 << "time_real = " << time_real;
-                        while (time_granted > time_real) {
-                            useconds_t u = (time_granted-time_real)/1000;
-                            LDEBUG4 << "usleep(" << u << ")";
-                            usleep(u);
-                        }
-                        LDEBUG4 << "time_real = " << time_real;
-#endif
-                    }
-                    for (size_t i=0; i<n_sims; ++i) {
-                        if (time_granted == time_actionable[i]) {
-                            LDEBUG4 << "granting " << time_granted
-                                << " to " << simulators[i].name;
-                            ++n_processing;
-                            simulators[i].processing = true;
-                            simulators[i].messages_pending = false;
-                            zstr_sendm(server, simulators[i].name.c_str());
-                            zstr_sendm(server, fncs::TIME_REQUEST);
-                            zstr_sendf(server, "%llu", time_granted);
-                        }
-                        else {
-                            /* fast forward time last processed */
-                            fncs::time jump = (time_granted - simulators[i].time_last_processed) / simulators[i].time_delta;
-                            simulators[i].time_last_processed += simulators[i].time_delta * jump;
-                        }
-                    }
+                /* next frames are the topic, then its list and wake flags */
+                zframe_t *topic_frame = zmsg_next(msg);
+                zframe_t *list_frame = topic_frame ? zmsg_next(msg) : NULL;
+                frame = list_frame ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "SUBSCRIBE message missing frames";
+                    broker_die(simulators, server);
+                }
+                /* a window already granted was computed without the new
+                 * edge, so its publisher could run past the subscriber's
+                 * next grant; the subscriber is told it was refused */
+                if (lease || lookahead_declared || publish_declared) {
+                    SimulatorState &state = simulators[sender_it->second];
+                    string topic = fncs::to_string(topic_frame);
+                    LWARNING << state.name << " subscribed to '" << topic
+                        << "' at runtime, which FNCS_LEASE and declared lookaheads"
+                        << " or publish times rule out";
+                    state.unicast_due = true;
+                    send_identity(server, state);
+                    fncs::send_type(server, fncs::MSG_UNSUBSCRIBE, state.binary, true);
+                    zstr_send(server, topic.c_str());
+                }
+                /* a new edge may narrow the time windows */
+                else if (subscribe_runtime(server, simulators, sender_it->second,
+                            fncs::to_string(topic_frame), zframe_streq(list_frame, "1"),
+                            zframe_streq(frame, "1"), topic_to_indexes, router,
+                            name_to_index, name_to_keys, name_to_peers,
+                            name_to_subscribers, downstream)) {
+                    push_time_peers(server, simulators, downstream, name_to_peers);
                 }
             }
-            else if (fncs::PUBLISH == message_type) {
-                string topic = "";
-                bool found_one = false;
-
-                LDEBUG4 << "PUBLISH received";
+            else if (fncs::MSG_UNSUBSCRIBE == message_type) {
+                LDEBUG4C(logCONFIG) << "UNSUBSCRIBE received";
 
                 /* did we receive message from a connected sim? */
-                if (name_to_index.count(sender) == 0) {
+                if (sender_it == name_to_index.end()) {
                     LERROR << "simulator '" << sender << "' not connected";
                     broker_die(simulators, server);
                 }
 
-                /* next frame is topic */
+                /* next frame is the topic */
                 frame = zmsg_next(msg);
                 if (!frame) {
-                    LERROR << "PUBLISH message missing topic";
+                    LERROR << "UNSUBSCRIBE message missing topic frame";
                     broker_die(simulators, server);
                 }
-                topic = fncs::to_string(frame);
+                unsubscribe_runtime(simulators, sender_it->second,
+                        fncs::to_string(frame), topic_to_indexes, router);
+            }
+            else if (fncs::MSG_FETCH == message_type) {
+                const size_t suffix = strlen(fncs::PULL_IDENTITY);
+                LDEBUG4C(logPUBLISH) << "FETCH received";
 
-                LDEBUG4 << "PUBLISH received topic " << topic;
+                /* from the DEALER a sim pulls values with */
+                if (sender.size() > suffix) {
+                    sender_it = name_to_index.find(sender.substr(0, sender.size()-suffix));
+                }
+                if (sender.size() <= suffix
+                        || sender.compare(sender.size()-suffix, suffix, fncs::PULL_IDENTITY)
+                        || sender_it == name_to_index.end()
+                        || !simulators[sender_it->second].pull) {
+                    LERROR << "FETCH from '" << sender << "', which pulls no values";
+                    broker_die(simulators, server);
+                }
+                SimulatorState &state = simulators[sender_it->second];
 
-                if (do_trace) {
-                    /* next frame is value payload */
-                    frame = zmsg_next(msg);
-                    if (!frame) {
-                        LERROR << "PUBLISH message missing value";
-                        broker_die(simulators, server);
-                    }
-                    string value = fncs::to_string(frame);
-                    trace << time_granted
-                        << "\t" << topic
-                        << "\t" << value
-                        << endl;
+                /* next frames are the topic and the sim's time */
+                zframe_t *topic_frame = zmsg_next(msg);
+                frame = topic_frame ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "FETCH message missing frames";
+                    broker_die(simulators, server);
                 }
+                string topic = fncs::to_string(topic_frame);
+                fncs::time time = frame_time(simulators, server, frame, state.binary);
+                map<string,string>::const_iterator alias = aliases.find(topic);
+                size_t id = topics.find(alias == aliases.end() ? topic : alias->second);
+                const string *value = NULL;
+                if (id < topic_to_indexes.size() && topic_to_indexes[id].pulled) {
+                    value = fetch_value(topic_to_indexes[id], time);
+                }
+                string text;
+                fncs::TypedValue typed;
+                if (value && !state.binary
+                        && fncs::decode_typed(value->data(), value->size(), typed)) {
+                    text = fncs::format_typed(typed);
+                    value = &text;
+                }
+                zstr_sendm(server, sender.c_str());
+                fncs::send_type(server, fncs::MSG_FETCH, state.binary, true);
+                if (value) {
+                    zstr_sendm(server, topic.c_str());
+                    zmq_send(zsock_resolve(server), value->data(), value->size(), 0);
+                }
+                else {
+                    zstr_send(server, topic.c_str());
+                }
+            }
+            else if (fncs::MSG_DIRECT_COUNTS == message_type) {
+                LDEBUG4C(logPUBLISH) << "DIRECT_COUNTS received";
 
-                /* send the message to subscribed sims */
-#if 0
-                for (size_t i=0; i<n_sims; ++i) {
-                    bool found = false;
-                    if (simulators[i].subscription_values.count(topic)) {
-                        found = true;
+                /* did we receive message from a connected sim? */
+                if (sender_it == name_to_index.end()) {
+                    LERROR << "simulator '" << sender << "' not connected";
+                    broker_die(simulators, server);
+                }
+                size_t publisher = sender_it->second;
+                SimulatorState &pub = simulators[publisher];
+
+                /* next frame is the counts, per topic ID of its keys */
+                frame = zmsg_next(msg);
+                if (!frame || zframe_size(frame) % 8) {
+                    LERROR << "DIRECT_COUNTS message has malformed counts";
+                    broker_die(simulators, server);
+                }
+                const byte *data = zframe_data(frame);
+                for (size_t j=0; j<zframe_size(frame); j+=8) {
+                    size_t id = 0;
+                    unsigned long long count = 0;
+                    for (int b=0; b<4; ++b) {
+                        id |= static_cast<size_t>(data[j+b]) << (8*b);
+                        count |= static_cast<unsigned long long>(data[j+4+b]) << (8*b);
                     }
-                    if (found) {
-                        zmsg_t *msg_copy = zmsg_dup(msg);
-                        if (!msg_copy) {
-                            LERROR << "failed to copy pub message";
-                            broker_die(simulators, server);
-                        }
-                        /* swap out original sender with new destiation */
-                        zframe_reset(zmsg_first(msg_copy),
-                                simulators[i].name.c_str(),
-                                simulators[i].name.size());
-                        /* send it on */
-                        zmsg_send(&msg_copy, server);
-                        found_one = true;
-                        simulators[i].messages_pending = true;
-                        LDEBUG4 << "pub to " << simulators[i].name;
+                    map<size_t,IndexVec>::iterator it = direct_subscribers.find(id);
+                    if (it == direct_subscribers.end() || !count) {
+                        LERROR << pub.name << " sent unknown topic ID " << id << " directly";
+                        broker_die(simulators, server);
                     }
-                }
-#else
-                {
-                    TopicMap::iterator iter = topic_to_indexes.find(topic);
-                    if (iter != topic_to_indexes.end()) {
-                        IndexVec &iv = iter->second;
-                        IndexVec::iterator index;
-                        for (index=iv.begin(); index!=iv.end(); index++) {
-                            size_t i = *index;
-							if (0 == byes.count(simulators[i].name)) {
-								zmsg_t *msg_copy = zmsg_dup(msg);
-								if (!msg_copy) {
-									LERROR << "failed to copy pub message";
-									broker_die(simulators, server);
-								}
-								/* swap out original sender with new destiation */
-								zframe_reset(zmsg_first(msg_copy),
-										simulators[i].name.c_str(),
-										simulators[i].name.size());
-								/* send it on */
-								zmsg_send(&msg_copy, server);
-								found_one = true;
-								simulators[i].messages_pending = true;
-								LDEBUG4 << "pub to " << simulators[i].name;
-							}
+                    /* the values stand for those the broker forwards */
+                    string topic = topics.str(id);
+                    const IndexVec &iv = it->second;
+                    for (size_t d=0; d<iv.size(); ++d) {
+                        size_t i = iv[d];
+                        if (simulators[i].departed) {
+                            continue;
+                        }
+                        simulators[i].direct_expected += count;
+                        check_route(simulators, barrier, downstream, publisher, i);
+                        if (wakes_on(simulators[i], id, topic)) {
+                            note_delivery(simulators, clusters, i, pub.time_current,
+                                    time_effective(pub, pub.time_current));
                         }
                     }
                 }
-#endif
-                if (!found_one) {
-                    LDEBUG4 << "dropping PUBLISH message '" << topic << "'";
+            }
+            else {
+                LERROR << "received unknown message type '"
+                    << fncs::to_string(frame) << "'";
+                broker_die(simulators, server);
+            }
+
+            zmsg_destroy(&msg);
+        }
+
+        /* a sim connected to the data channel reads its values there
+         * from its next grant on */
+        if (n_items > 3 && (items[3].revents & ZMQ_POLLIN)) {
+            zmsg_t *msg = zmsg_recv(data_server);
+            zframe_t *identity = msg ? zmsg_first(msg) : NULL;
+            zframe_t *frame = msg ? zmsg_next(msg) : NULL;
+            if (frame && zframe_streq(frame, fncs::DATA)) {
+                SimIndex::iterator it = name_to_index.find(fncs::to_string(identity));
+                if (it != name_to_index.end() && simulators[it->second].data_channel) {
+                    simulators[it->second].data_ready = true;
+                    LDEBUG4C(logPUBLISH) << it->first << " reads values on the data channel";
                 }
             }
-            else if (fncs::DIE == message_type) {
-                LDEBUG4 << "DIE received";
+            zmsg_destroy(&msg);
+        }
 
-                /* did we receive message from a connected sim? */
-                if (name_to_index.count(sender) == 0) {
-                    LERROR << "simulator '" << sender << "' not connected";
-                    broker_die(simulators, server);
+        /* a sim subscribing under its name reads its grants from now on */
+        if (n_items > 2 && (items[2].revents & ZMQ_POLLIN)) {
+            zframe_t *frame = zframe_recv(grant_cast);
+            string prefix = string(fncs::GRANT_CAST) + '/';
+            string topic = frame && zframe_size(frame) ?
+                fncs::to_string(frame).substr(1) : string();
+            if (topic.compare(0, prefix.size(), prefix) == 0) {
+                SimIndex::iterator it = name_to_index.find(topic.substr(prefix.size()));
+                if (it != name_to_index.end() && simulators[it->second].grant_casts) {
+                    SimulatorState &state = simulators[it->second];
+                    state.cast_index = it->second;
+                    state.cast_ready = zframe_data(frame)[0] == 1;
+                    LDEBUG4C(logTIME) << state.name << (state.cast_ready ?
+                            " reads" : " no longer reads") << " grant casts";
                 }
+            }
+            zframe_destroy(&frame);
+        }
+
+        if (n_items > 1 && (items[1].revents & ZMQ_POLLIN)) {
+            zmsg_t *msg = NULL;
+            zframe_t *frame = NULL;
+            fncs::MessageType message_type;
 
+            LDEBUG4 << "incoming message from root";
+            msg = zmsg_recv(root);
+            if (!msg) {
+                LERROR << "null message received from root";
                 broker_die(simulators, server);
             }
-            else if (fncs::TIME_DELTA == message_type) {
-                size_t index = 0; /* index of sim state */
-                fncs::time time_delta;
 
-                LDEBUG4 << "TIME_DELTA received";
+            /* first frame is message type identifier */
+            frame = zmsg_first(msg);
+            if (!frame) {
+                LERROR << "root message missing type identifier";
+                broker_die(simulators, server);
+            }
+            message_type = fncs::to_type(frame);
+
+            if (fncs::MSG_TIME_REQUEST == message_type) {
+                Cluster &cluster = clusters[0];
 
-                /* did we receive message from a connected sim? */
-                if (name_to_index.count(sender) == 0) {
-                    LERROR << "simulator '" << sender << "' not connected";
+                /* next frame is time granted */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "root grant missing time frame";
                     broker_die(simulators, server);
                 }
+                root_time = frame_time(simulators, server, frame, root_binary);
+                LDEBUG4C(logTIME) << "root granted " << root_time;
 
-                /* index of sim state */
-                index = name_to_index[sender];
+                if (!root_bye_sent) {
+                    cluster.time_granted = root_time;
+                    n_processing += grant_cluster(server, simulators, downstream, cluster);
+                    /* woken for a publish none of our sims act on yet */
+                    if (0 == cluster.n_processing) {
+                        root_request(cluster);
+                    }
+                }
+            }
+            else if (fncs::MSG_PUBLISH == message_type) {
+                string topic;
+                vector<zframe_t*> body;
+                vector<zframe_t*> text_body; /* for string peers */
+                vector<zframe_t*> id_body; /* for sims reading topic IDs */
+                vector<zframe_t*> alias_body; /* for sims subscribed by an alias */
+                vector<zframe_t*> owned;
+                fncs::time time_publish = 0;
 
-                /* next frame is time */
+                /* next frame is topic, the last is time of the publish */
                 frame = zmsg_next(msg);
                 if (!frame) {
-                    LERROR << "TIME_DELTA message missing time frame";
+                    LERROR << "root PUBLISH message missing topic";
                     broker_die(simulators, server);
                 }
-                /* convert time string */
-                {
-                    istringstream iss(fncs::to_string(frame));
-                    iss >> time_delta;
+                topic = fncs::to_string(frame);
+                for (; frame; frame = zmsg_next(msg)) {
+                    body.push_back(frame);
                 }
+                if (body.size() < 2) {
+                    LERROR << "root PUBLISH message missing time";
+                    broker_die(simulators, server);
+                }
+                time_publish = frame_time(simulators, server, body.back(), root_binary);
+                body.pop_back();
 
-                /* update sim state */
-                simulators[index].time_delta = time_delta;
+                if (do_trace) {
+                    trace_publish(time_publish, topic,
+                            body.size() > 1 ? body[1] : NULL);
+                }
+                text_body = body;
+                if (!format_typed_values(text_body, owned)) {
+                    text_body.clear();
+                }
+
+                size_t id = route(topic_to_indexes, router, topic);
+                if (id != fncs::TopicIntern::npos()) {
+                    const vector<Send> &sends = send_list(simulators,
+                            topic_to_indexes[id], id);
+                    IndexVec &delivered = buffers.dests; /* positions in sends */
+
+                    if (last_values && body.size() > 1) {
+                        keep_last_value(topic_to_indexes[id], body[1], time_publish);
+                    }
+                    delivered.clear();
+                    for (size_t d=0; d<sends.size(); ++d) {
+                        const Send &send = sends[d];
+                        if (send.filtered && body.size() > 1
+                                && !filter_accepts(simulators[send.index], topic, body[1],
+                                    time_publish)) {
+                            continue;
+                        }
+                        const vector<zframe_t*> &out = body_for(send, id,
+                                body, text_body, id_body, alias_body, owned);
+                        if (send.batched && queue_publish(server, simulators[send.index], out)) {
+                            delivered.push_back(d);
+                            continue;
+                        }
+                        /* a sub-broker further down needs the time too */
+                        zsock_t *dest = values_to(server, simulators[send.index]);
+                        send_identity(dest, simulators[send.index]);
+                        fncs::send_type(dest, fncs::MSG_PUBLISH, send.binary, true);
+                        if (send_body(dest, out, send.with_time)) {
+                            LERROR << "failed to forward pub message";
+                            broker_die(simulators, server);
+                        }
+                        if (send.with_time) {
+                            fncs::send_time(dest, time_publish, send.binary, false);
+                        }
+                        simulators[send.index].unicast_due = true;
+                        delivered.push_back(d);
+                    }
+                    for (size_t d=0; d<delivered.size(); ++d) {
+                        const Send &send = sends[delivered[d]];
+                        size_t i = send.index;
+                        if (broker_metrics) {
+                            simulators[i].metrics.received(
+                                    body.size() > 1 ? zframe_size(body[1]) : 0);
+                        }
+                        if (send.wakes) {
+                            note_delivery(simulators, clusters, i, time_publish,
+                                    time_publish);
+                        }
+                        LDEBUG4C(logPUBLISH) << "root pub to " << simulators[i].name;
+                    }
+                }
+                destroy_frames(owned);
+            }
+            else if (fncs::MSG_BYE == message_type) {
+                /* globally finished, let the local sims know */
+                send_byes(server, simulators, n_sims);
+                zmsg_destroy(&msg);
+                break;
+            }
+            else if (fncs::MSG_DIE == message_type) {
+                LDEBUG4 << "DIE received from root";
+                zsock_destroy(&root); /* no need to repeat it upward */
+                broker_die(simulators, server);
             }
             else {
                 LERROR << "received unknown message type '"
-                    << message_type << "'";
+                    << fncs::to_string(frame) << "' from root";
                 broker_die(simulators, server);
             }
 
@@ -685,13 +7159,320 @@ int main(int argc, char **argv)
         }
     }
 
+    LINFO << "PUBLISH fan-out avoided copying "
+        << fanout_bytes_avoided << " bytes";
+    if (sends_stalled || sends_unroutable) {
+        LINFO << "sends: " << sends_stalled << " waited "
+            << send_stall_time << " ns in all for a sim at its high water mark, "
+            << sends_unroutable << " to a sim no longer connected";
+    }
+    if (realtime_rounds) {
+        LINFO << "realtime: " << realtime_late_rounds << " of "
+            << realtime_rounds << " grants late, mean lateness "
+            << realtime_lateness_total / realtime_rounds << " ns, max "
+            << realtime_lateness_max << " ns";
+        {
+            static const char *bounds[REALTIME_BUCKETS] = {
+                "<1us", "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s"
+            };
+            ostringstream line;
+            for (size_t i=0; i<REALTIME_BUCKETS; ++i) {
+                line << (i ? " " : "") << bounds[i] << ":" << realtime_histogram[i];
+            }
+            LINFO << "realtime lateness: " << line.str();
+        }
+        if (realtime_skipped) {
+            LINFO << "realtime: skipped " << realtime_skipped
+                << " ns of wall time catching up";
+        }
+    }
+    if (broker_metrics) {
+        metrics_report(simulators, topic_to_indexes);
+        /* rank the sims by how long the rest waited on them */
+        broker_metrics->straggler_report(sim_metrics(simulators));
+        broker_metrics->traffic_report(sim_metrics(simulators));
+    }
+
+    if (root) {
+        zsock_destroy(&root);
+    }
+    for (size_t i=0; i<simulators.size(); ++i) {
+        zframe_destroy(&simulators[i].identity);
+        destroy_frames(simulators[i].outbox);
+    }
+    zsock_destroy(&grant_cast);
+    zsock_destroy(&data_server);
     zsock_destroy(&server);
-    zsys_shutdown(); /* without this, Windows will assert */
+    broker_file_remove();
+    trace_close();
+    metrics_close();
+    if (!embedded) {
+        fncs::stop_async_logging();
+        zsys_shutdown(); /* without this, Windows will assert */
+    }
+    if (tenant) {
+        zstr_send(pipe, fncs::TENANT); /* the host may reuse the namespace */
+    }
 
-    if (trace.is_open()) {
-        trace.close();
+    return 0;
+}
+
+
+static void broker_actor(zsock_t *pipe, void *args)
+{
+    fncs::BrokerState *state = static_cast<fncs::BrokerState*>(args);
+    vector<char*> argv;
+
+    for (size_t i=0; i<state->args.size(); ++i) {
+        argv.push_back(&state->args[i][0]);
+    }
+    argv.push_back(NULL);
+    broker_run(static_cast<int>(state->args.size()), &argv[0],
+            state->endpoint.c_str(), pipe, state);
+}
+
+
+#if HAVE_THREAD_LOCAL
+/* a namespace names a federation and, but for tcp, its endpoint */
+static bool tenant_name_valid(const char *name)
+{
+    if (!*name || strlen(name) > 64) {
+        return false;
+    }
+    for (const char *c=name; *c; ++c) {
+        if (!isalnum(static_cast<unsigned char>(*c))
+                && *c != '_' && *c != '-' && *c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The endpoint a tenant binds: a port the system picks on the host's
+ * interface for tcp, else the host's endpoint named after the namespace,
+ * as shm://fncs-sweep-run7. */
+static string tenant_bind(const string &host, const string &name)
+{
+    if (0 == host.compare(0, 6, "tcp://")) {
+        return host.substr(0, host.rfind(':')) + ":*";
+    }
+    return host + "-" + name;
+}
+
+/* The endpoint the host tells the sims of a tenant: the one it bound,
+ * with the wildcard address the host leaves to the sims, or the one it
+ * was given if not tcp. */
+static string tenant_told(const fncs::BrokerState *state)
+{
+    if (0 != state->bound.compare(0, 6, "tcp://")) {
+        return state->endpoint;
+    }
+    if (0 == state->endpoint.compare(0, 8, "tcp://*:")
+            || 0 == state->endpoint.compare(0, 14, "tcp://0.0.0.0:")) {
+        return "tcp://*" + state->bound.substr(state->bound.rfind(':'));
+    }
+    return state->bound;
+}
+#endif
+
+/* Hosts many small federations, each of its own namespace, as the runs
+ * of a parameter sweep, in one process: fncs_broker --tenants <n_sims>
+ * [realtime interval]. A sim with FNCS_NAMESPACE asks the host at
+ * FNCS_BROKER for the broker of its namespace before it says hello, and
+ * the host starts a broker for n_sims sims on a thread of its own if
+ * none runs the namespace yet. Tenants share the process, its zmq I/O
+ * threads and its log, while their state is their threads' own; once
+ * a federation ended, its namespace may be asked for again. */
+static int tenant_host(int argc, char **argv)
+{
+#if HAVE_THREAD_LOCAL
+    vector<string> args; /* of each tenant */
+    const char *env_endpoint = getenv("FNCS_BROKER");
+    string endpoint = env_endpoint ? env_endpoint : "tcp://*:5570";
+    string first = endpoint.substr(0, endpoint.find(','));
+    map<string,fncs::BrokerState*> tenants;
+    zsock_t *host = NULL;
+
+    fncs::start_logging();
+    fncs::replicate_logging(FNCSLog::ReportingLevel(),
+            Output2Tee::Stream1(), Output2Tee::Stream2(), Output2Tee::Async(),
+            Output2Tee::Categories());
+
+    for (int i=0; i<argc; ++i) {
+        if (0 != strcmp(argv[i], "--tenants")) {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() < 2 || args.size() > 3) {
+        LERROR << "usage: fncs_broker --tenants <n_sims> [realtime interval]";
+        exit(EXIT_FAILURE);
+    }
+
+    host = zsock_new(ZMQ_ROUTER);
+    if (!host) {
+        LERROR << "socket creation failed";
+        exit(EXIT_FAILURE);
+    }
+    if (zsock_attach(host, fncs::resolve_endpoints(endpoint).c_str(), true)) {
+        LERROR << "could not bind '" << endpoint << "'";
+        exit(EXIT_FAILURE);
+    }
+    LINFO << "hosting federations of " << args[1] << " sims at " << endpoint;
+
+    while (!zsys_interrupted) {
+        vector<zmq_pollitem_t> items;
+        vector<string> names; /* of the tenants polled, after the host */
+        zmq_pollitem_t item = { zsock_resolve(host), 0, ZMQ_POLLIN, 0 };
+
+        items.push_back(item);
+        for (map<string,fncs::BrokerState*>::iterator it=tenants.begin();
+                it!=tenants.end(); ++it) {
+            zmq_pollitem_t tenant_item = {
+                zsock_resolve(it->second->actor), 0, ZMQ_POLLIN, 0 };
+            items.push_back(tenant_item);
+            names.push_back(it->first);
+        }
+        if (zmq_poll(&items[0], static_cast<int>(items.size()), -1) < 0) {
+            break; /* interrupted */
+        }
+
+        /* a tenant tells when its federation ended */
+        for (size_t i=1; i<items.size(); ++i) {
+            if (items[i].revents & ZMQ_POLLIN) {
+                fncs::BrokerState *state = tenants[names[i-1]];
+                char *ended = zstr_recv(state->actor);
+                zstr_free(&ended);
+                zactor_destroy(&state->actor);
+                delete state;
+                tenants.erase(names[i-1]);
+                LINFO << "federation '" << names[i-1] << "' ended";
+            }
+        }
+
+        if (!(items[0].revents & ZMQ_POLLIN)) {
+            continue;
+        }
+        zmsg_t *msg = zmsg_recv(host);
+        if (!msg) {
+            break; /* interrupted */
+        }
+        zframe_t *identity = zmsg_pop(msg);
+        zframe_t *frame = zmsg_first(msg);
+        string name;
+        string told;
+        string reason;
+        if (!frame || !zframe_streq(frame, fncs::TENANT)
+                || !(frame = zmsg_next(msg))) {
+            reason = "expected TENANT and a namespace";
+        }
+        else if (!tenant_name_valid((name = fncs::to_string(frame)).c_str())) {
+            reason = "namespace must be letters, digits, '_', '-' and '.'";
+        }
+        else if (tenants.count(name)) {
+            told = tenant_told(tenants[name]);
+        }
+        else {
+            fncs::BrokerState *state = new fncs::BrokerState;
+            state->endpoint = tenant_bind(first, name);
+            state->args = args;
+            state->tenant = name;
+            /* returns once the endpoint is bound */
+            state->actor = zactor_new(broker_actor, state);
+            if (!state->actor) {
+                LERROR << "tenant thread creation failed";
+                exit(EXIT_FAILURE);
+            }
+            tenants[name] = state;
+            told = tenant_told(state);
+            LINFO << "federation '" << name << "' at " << state->bound;
+        }
+        if (!reason.empty()) {
+            LWARNING << "refused a tenant: " << reason;
+        }
+        zmsg_destroy(&msg);
+        msg = zmsg_new();
+        zmsg_append(msg, &identity);
+        zmsg_addstr(msg, fncs::TENANT);
+        zmsg_addstr(msg, told.c_str());
+        if (!reason.empty()) {
+            zmsg_addstr(msg, reason.c_str());
+        }
+        zmsg_send(&msg, host);
     }
 
+    zsock_destroy(&host);
+    if (!tenants.empty()) {
+        /* their sockets would keep zsys_shutdown() from returning */
+        LWARNING << "interrupted, abandoning " << tenants.size()
+            << " running federations";
+        fncs::stop_async_logging();
+        _Exit(EXIT_FAILURE);
+    }
+    fncs::stop_async_logging();
+    zsys_shutdown();
     return 0;
+#else
+    (void)argc;
+    (void)argv;
+    fncs::start_logging();
+    LERROR << "--tenants needs a compiler with thread_local";
+    exit(EXIT_FAILURE);
+#endif
+}
+
+
+int fncs::broker_main(int argc, char **argv)
+{
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--tenants")) {
+            return tenant_host(argc, argv);
+        }
+    }
+    return broker_run(argc, argv, NULL, NULL);
+}
+
+
+fncs::Broker::Broker(unsigned int n_sims,
+        const string &endpoint, const string &realtime_interval)
+    : state(new BrokerState)
+{
+    ostringstream oss;
+
+    oss << n_sims;
+    state->endpoint = endpoint;
+    state->args.push_back("fncs_broker");
+    state->args.push_back(oss.str());
+    if (!realtime_interval.empty()) {
+        state->args.push_back(realtime_interval);
+    }
+    fncs::embedded_broker_started();
+    /* returns once the endpoint is bound */
+    state->actor = zactor_new(broker_actor, state);
+    if (!state->actor) {
+        LERROR << "embedded broker thread creation failed";
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+fncs::Broker::~Broker()
+{
+    wait();
+    delete state;
+}
+
+
+void fncs::Broker::wait()
+{
+    if (state->actor) {
+        zactor_destroy(&state->actor); /* joins the thread */
+        fncs::embedded_broker_stopped();
+    }
+}
+
+
+const string& fncs::Broker::get_endpoint() const
+{
+    return state->endpoint;
 }
 
@@ -0,0 +1,12 @@
+/* autoconf header */
+#include "config.h"
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+/* the broker itself is in libfncs, see fncs::Broker */
+int main(int argc, char **argv)
+{
+    return fncs::broker_main(argc, argv);
+}
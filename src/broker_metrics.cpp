@@ -0,0 +1,449 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* 3rd party headers */
+#include "czmq.h"
+
+/* fncs headers */
+#include "log.hpp"
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "broker_metrics.hpp"
+
+using namespace ::std;
+
+/* names are written as JSON strings; escape what JSON requires */
+static void write_json_string(ostream &out, const string &value)
+{
+    out << '"';
+    for (size_t i=0; i<value.size(); ++i) {
+        char c = value[i];
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+
+fncs::BrokerMetrics::BrokerMetrics()
+    : pub(NULL)
+    , interval(0)
+    , time_start(0)
+    , time_next(0)
+    , time_report(0)
+    , time_round(0)
+    , n_rounds(0)
+    , n_rounds_reported(0)
+    , top(10)
+    , matrix()
+    , topics()
+{
+    for (size_t i=0; i<N_BUCKETS; ++i) {
+        histogram[i] = 0;
+    }
+}
+
+
+fncs::BrokerMetrics::~BrokerMetrics()
+{
+    close();
+}
+
+
+bool fncs::BrokerMetrics::open(const char *endpoint, fncs::time interval, size_t top)
+{
+    if (endpoint) {
+        pub = zsock_new_pub(endpoint);
+        if (!pub) {
+            LERROR << "Could not bind metrics socket to " << endpoint;
+            return false;
+        }
+        LDEBUG4 << "metrics socket bound to " << endpoint;
+    }
+    this->interval = interval;
+    this->top = top;
+    time_start = fncs::timer_ft();
+    time_report = time_start;
+    time_round = time_start;
+    time_next = time_start + interval;
+    return true;
+}
+
+
+void fncs::BrokerMetrics::round(fncs::time now)
+{
+    unsigned long long us = (now - time_round) / 1000;
+    size_t bucket = 0;
+    while (us && bucket < N_BUCKETS-1) {
+        us >>= 1;
+        ++bucket;
+    }
+    ++histogram[bucket];
+    ++n_rounds;
+    time_round = now;
+}
+
+
+typedef pair<unsigned long long, const fncs::Traffic*> PairTraffic;
+typedef pair<string, const fncs::Traffic*> TopicTraffic;
+
+
+/* rank pairs by bytes delivered, largest first */
+static bool more_delivered(const PairTraffic &a, const PairTraffic &b)
+{
+    return a.second->bytes_delivered > b.second->bytes_delivered;
+}
+
+
+/* rank topics by volume, largest first */
+static bool more_volume(const TopicTraffic &a, const TopicTraffic &b)
+{
+    return a.second->volume() > b.second->volume();
+}
+
+
+/* the matrix's pairs, most bytes first */
+template <class M>
+static vector<PairTraffic> ranked_pairs(const M &matrix)
+{
+    vector<PairTraffic> ranked;
+    ranked.reserve(matrix.size());
+    for (typename M::const_iterator it=matrix.begin(); it!=matrix.end(); ++it) {
+        ranked.push_back(make_pair(it->first, &it->second));
+    }
+    sort(ranked.begin(), ranked.end(), more_delivered);
+    return ranked;
+}
+
+
+/* the top topics by volume */
+template <class M>
+static vector<TopicTraffic> ranked_topics(const M &topics, size_t top)
+{
+    vector<TopicTraffic> ranked;
+    ranked.reserve(topics.size());
+    for (typename M::const_iterator it=topics.begin(); it!=topics.end(); ++it) {
+        ranked.push_back(make_pair(it->first, &it->second));
+    }
+    top = min(top, ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(), more_volume);
+    ranked.resize(top);
+    return ranked;
+}
+
+
+/* the name of the sim at index, if the broker still knows it */
+static const string& sim_name(const fncs::SimMetricsVec &sims, size_t index)
+{
+    static const string unknown("?");
+    return index < sims.size() ? sims[index].first : unknown;
+}
+
+
+long fncs::BrokerMetrics::timeout(fncs::time now) const
+{
+    if (now >= time_next) {
+        return 0;
+    }
+    /* round up so the poll does not wake just before the deadline */
+    return static_cast<long>((time_next - now + 999999) / 1000000);
+}
+
+
+void fncs::BrokerMetrics::report(fncs::time now, const SimMetricsVec &sims,
+        const BrokerMemory &memory)
+{
+    ostringstream json;
+    fncs::time elapsed = now - time_report;
+    double rounds_per_second = 0.0;
+    unsigned long long n_received = 0;
+    unsigned long long n_published = 0;
+
+    if (elapsed) {
+        rounds_per_second = double(n_rounds - n_rounds_reported) * 1e9 / elapsed;
+    }
+
+    json << "{\"uptime_ns\":" << now - time_start
+        << ",\"rounds\":" << n_rounds
+        << ",\"rounds_per_second\":" << rounds_per_second
+        << ",\"round_latency_us_log2\":[";
+    for (size_t i=0; i<N_BUCKETS; ++i) {
+        json << (i ? "," : "") << histogram[i];
+    }
+    json << "],\"routing_bytes\":" << memory.bytes_routing
+        << ",\"value_bytes\":" << memory.bytes_values
+        << ",\"pending_bytes\":" << memory.bytes_pending
+        << ",\"sims\":[";
+    for (size_t i=0; i<sims.size(); ++i) {
+        const SimMetrics &m = sims[i].second;
+        json << (i ? "," : "") << "{\"name\":";
+        write_json_string(json, sims[i].first);
+        json << ",\"computing_ns\":" << m.time_computing
+            << ",\"waiting_ns\":" << m.time_waiting
+            << ",\"published\":" << m.n_published
+            << ",\"published_bytes\":" << m.bytes_published
+            << ",\"received\":" << m.n_received
+            << ",\"received_bytes\":" << m.bytes_received
+            << ",\"grants\":" << m.n_grants
+            << ",\"blocking_ns\":" << m.time_blocking
+            << ",\"last_reports\":" << m.n_last
+            << "}";
+        n_published += m.n_published;
+        n_received += m.n_received;
+    }
+    json << "],\"traffic\":[";
+    vector<PairTraffic> pairs = ranked_pairs(matrix);
+    for (size_t i=0; i<pairs.size(); ++i) {
+        json << (i ? "," : "") << "{\"from\":";
+        write_json_string(json, sim_name(sims, pairs[i].first >> 32));
+        json << ",\"to\":";
+        write_json_string(json, sim_name(sims, pairs[i].first & 0xffffffffULL));
+        json << ",\"delivered\":" << pairs[i].second->n_delivered
+            << ",\"delivered_bytes\":" << pairs[i].second->bytes_delivered
+            << "}";
+    }
+    json << "],\"topics\":[";
+    vector<TopicTraffic> hot = ranked_topics(topics, top);
+    for (size_t i=0; i<hot.size(); ++i) {
+        const Traffic &t = *hot[i].second;
+        json << (i ? "," : "") << "{\"topic\":";
+        write_json_string(json, hot[i].first);
+        json << ",\"published\":" << t.n_published
+            << ",\"published_bytes\":" << t.bytes_published
+            << ",\"delivered\":" << t.n_delivered
+            << ",\"delivered_bytes\":" << t.bytes_delivered
+            << "}";
+    }
+    json << "]}";
+
+    if (pub) {
+        zstr_sendm(pub, "metrics");
+        zstr_send(pub, json.str().c_str());
+    }
+
+    LINFO << "metrics: " << n_rounds << " rounds, "
+        << rounds_per_second << " rounds/s, round latency p50 <= "
+        << percentile(0.5) << " us, p99 <= " << percentile(0.99)
+        << " us, " << n_published << " values published, "
+        << n_received << " delivered, "
+        << (memory.bytes_routing + memory.bytes_values + memory.bytes_pending) / 1024
+        << " KiB held";
+
+    n_rounds_reported = n_rounds;
+    time_report = now;
+    while (time_next <= now) {
+        time_next += interval;
+    }
+}
+
+
+/* rank sims by blocking time, largest first */
+static bool more_blocking(
+        const pair<string,fncs::SimMetrics> &a,
+        const pair<string,fncs::SimMetrics> &b)
+{
+    return a.second.time_blocking > b.second.time_blocking;
+}
+
+
+void fncs::BrokerMetrics::straggler_report(const SimMetricsVec &sims) const
+{
+    SimMetricsVec ranked(sims);
+    fncs::time total = 0;
+
+    stable_sort(ranked.begin(), ranked.end(), more_blocking);
+    for (size_t i=0; i<ranked.size(); ++i) {
+        total += ranked[i].second.time_blocking;
+    }
+
+    LINFO << "straggler report: wall time the others spent waiting on each sim";
+    for (size_t i=0; i<ranked.size(); ++i) {
+        const SimMetrics &m = ranked[i].second;
+        double share = total ? 100.0 * m.time_blocking / total : 0.0;
+        LINFO << "  " << (i+1) << ". " << ranked[i].first << ": "
+            << m.time_blocking / 1e9 << " s (" << share << "%), last to report "
+            << m.n_last << " times, computing " << m.time_computing / 1e9
+            << " s, waiting " << m.time_waiting / 1e9 << " s";
+    }
+}
+
+
+void fncs::BrokerMetrics::traffic_report(const SimMetricsVec &sims) const
+{
+    vector<PairTraffic> pairs = ranked_pairs(matrix);
+    vector<TopicTraffic> hot = ranked_topics(topics, top);
+    unsigned long long total = 0;
+
+    for (size_t i=0; i<pairs.size(); ++i) {
+        total += pairs[i].second->bytes_delivered;
+    }
+
+    LINFO << "traffic report: bytes delivered from publisher to subscriber";
+    for (size_t i=0; i<pairs.size() && i<top; ++i) {
+        const Traffic &t = *pairs[i].second;
+        double share = total ? 100.0 * t.bytes_delivered / total : 0.0;
+        LINFO << "  " << (i+1) << ". " << sim_name(sims, pairs[i].first >> 32)
+            << " -> " << sim_name(sims, pairs[i].first & 0xffffffffULL) << ": "
+            << t.bytes_delivered << " bytes (" << share << "%) in "
+            << t.n_delivered << " values";
+    }
+    LINFO << "hot topics: bytes published and delivered";
+    for (size_t i=0; i<hot.size(); ++i) {
+        const Traffic &t = *hot[i].second;
+        LINFO << "  " << (i+1) << ". " << hot[i].first << ": "
+            << t.volume() << " bytes, " << t.n_published << " published, "
+            << t.n_delivered << " delivered";
+    }
+}
+
+
+void fncs::BrokerMetrics::close()
+{
+    if (pub) {
+        zsock_destroy(&pub);
+    }
+}
+
+
+unsigned long long fncs::BrokerMetrics::percentile(double fraction) const
+{
+    unsigned long long seen = 0;
+    if (0 == n_rounds) {
+        return 0;
+    }
+    for (size_t i=0; i<N_BUCKETS; ++i) {
+        seen += histogram[i];
+        if (seen >= fraction * n_rounds) {
+            return 1ULL << i;
+        }
+    }
+    return 1ULL << (N_BUCKETS-1);
+}
+
+
+fncs::Timeline::Timeline()
+    : buffer(1024 * 1024)
+    , out()
+    , time_start(0)
+    , time_round(0)
+    , n_rounds(0)
+    , n_tracks(0)
+{
+}
+
+
+fncs::Timeline::~Timeline()
+{
+    close();
+}
+
+
+bool fncs::Timeline::open(const string &path)
+{
+    /* no flush per event, see the broker's trace */
+    out.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+    out.open(path.c_str());
+    if (!out) {
+        LERROR << "Could not open timeline file '" << path << "'";
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+        << "\"args\":{\"name\":\"broker\"}}";
+    time_start = fncs::timer_ft();
+    time_round = time_start;
+    return true;
+}
+
+
+void fncs::Timeline::granted(TimelineTrack &track, const string &name,
+        fncs::time now, fncs::time time_granted)
+{
+    if (!out.is_open()) {
+        return;
+    }
+    if (0 == track.tid) {
+        track.tid = ++n_tracks;
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << track.tid << ",\"args\":{\"name\":";
+        write_json_string(out, name);
+        out << "}}";
+    }
+    else if (!track.computing) {
+        span("wait", track.tid, track.mark, now, "granted", time_granted);
+    }
+    track.mark = now;
+    track.time_granted = time_granted;
+    track.computing = true;
+}
+
+
+void fncs::Timeline::reported(TimelineTrack &track, fncs::time now)
+{
+    if (!out.is_open() || 0 == track.tid) {
+        return;
+    }
+    if (track.computing) {
+        span("compute", track.tid, track.mark, now, "granted", track.time_granted);
+    }
+    track.mark = now;
+    track.computing = false;
+}
+
+
+void fncs::Timeline::round(fncs::time now, size_t n_granted)
+{
+    if (!out.is_open()) {
+        return;
+    }
+    ++n_rounds;
+    span("round", 0, time_round, now, "granted", n_granted);
+    time_round = now;
+}
+
+
+/* a complete event; ts and dur are microseconds, keeping the nanoseconds */
+void fncs::Timeline::span(const char *name, int tid, fncs::time begin,
+        fncs::time end, const char *arg, fncs::time value)
+{
+    char ts[64];
+    char dur[64];
+    snprintf(ts, sizeof(ts), "%llu.%03llu",
+            (unsigned long long)((begin - time_start) / 1000),
+            (unsigned long long)((begin - time_start) % 1000));
+    snprintf(dur, sizeof(dur), "%llu.%03llu",
+            (unsigned long long)((end - begin) / 1000),
+            (unsigned long long)((end - begin) % 1000));
+    out << ",\n"
+        << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << ts << ",\"dur\":" << dur
+        << ",\"args\":{\"" << arg << "\":" << value << "}}";
+}
+
+
+void fncs::Timeline::close()
+{
+    if (out.is_open()) {
+        out << "\n]}\n";
+        out.close();
+        LINFO << "timeline of " << n_rounds << " rounds and "
+            << n_tracks << " sims written";
+    }
+}
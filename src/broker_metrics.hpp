@@ -0,0 +1,254 @@
+#ifndef _BROKER_METRICS_HPP_
+#define _BROKER_METRICS_HPP_
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "czmq.h"
+
+#include "fncs.hpp"
+#include "hash_map.hpp"
+
+namespace fncs {
+
+    /** Wall clock accounting of one simulator, in fncs::timer_ft()
+     * nanoseconds. A sim is computing from the moment it is granted until
+     * its next TIME_REQUEST or BYE arrives, and waiting otherwise. When a
+     * sim's report lets the broker grant other sims, it was the last one
+     * they waited on, and their wait is charged to it as blocking time. */
+    class SimMetrics {
+        public:
+            SimMetrics()
+                : time_computing(0)
+                , time_waiting(0)
+                , n_published(0)
+                , bytes_published(0)
+                , n_received(0)
+                , bytes_received(0)
+                , n_grants(0)
+                , time_blocking(0)
+                , n_last(0)
+                , wall_mark(0)
+                , computing(false)
+            {}
+
+            /** Returns the wall time waited since the last report. */
+            fncs::time granted(fncs::time now) {
+                fncs::time waited = 0;
+                if (!computing && wall_mark) {
+                    waited = now - wall_mark;
+                    time_waiting += waited;
+                }
+                wall_mark = now;
+                computing = true;
+                ++n_grants;
+                return waited;
+            }
+
+            /** This sim's report released others that waited this long. */
+            void blocked(fncs::time waited) {
+                time_blocking += waited;
+            }
+
+            void reported(fncs::time now) {
+                if (computing) {
+                    time_computing += now - wall_mark;
+                }
+                wall_mark = now;
+                computing = false;
+            }
+
+            void published(size_t bytes) {
+                ++n_published;
+                bytes_published += bytes;
+            }
+
+            void received(size_t bytes) {
+                ++n_received;
+                bytes_received += bytes;
+            }
+
+            fncs::time time_computing;
+            fncs::time time_waiting;
+            unsigned long long n_published;
+            unsigned long long bytes_published;
+            unsigned long long n_received;
+            unsigned long long bytes_received;
+            unsigned long long n_grants;
+            fncs::time time_blocking; /* others' wait released by this sim */
+            unsigned long long n_last; /* reports that released a grant */
+
+        private:
+            fncs::time wall_mark; /* last grant or report */
+            bool computing;
+    };
+
+    typedef std::vector<std::pair<std::string,SimMetrics> > SimMetricsVec;
+
+    /** Values and bytes that went through the broker, from one publisher
+     * to one subscriber or of one topic. */
+    class Traffic {
+        public:
+            Traffic()
+                : n_published(0)
+                , bytes_published(0)
+                , n_delivered(0)
+                , bytes_delivered(0)
+            {}
+
+            /** Bytes the broker took in and sent out, by which the hot
+             * topics rank. */
+            unsigned long long volume() const {
+                return bytes_published + bytes_delivered;
+            }
+
+            unsigned long long n_published;
+            unsigned long long bytes_published;
+            unsigned long long n_delivered;
+            unsigned long long bytes_delivered;
+    };
+
+    /** Bytes the broker holds, counted from the capacity of its containers
+     * when a snapshot is taken; the queues of zmq are not included. */
+    class BrokerMemory {
+        public:
+            BrokerMemory() : bytes_routing(0), bytes_values(0), bytes_pending(0) {}
+
+            size_t bytes_routing; /* topic names, subscriber and send lists */
+            size_t bytes_values; /* last and prior values kept per topic */
+            size_t bytes_pending; /* values queued, delayed or kept for a rollback */
+    };
+
+    /** Broker wide metrics. A round is one grant decision that released at
+     * least one sim; its latency is the wall time since the previous one.
+     * Every interval a JSON snapshot is published on an optional zmq PUB
+     * socket, under the "metrics" topic, and a summary line is logged.
+     * Each snapshot also holds the traffic matrix, the values and bytes
+     * delivered from each publisher to each subscriber, and the topics of
+     * the largest volume, which show the pairs worth placing on one node
+     * and the topics worth coalescing or downsampling. */
+    class BrokerMetrics {
+        public:
+            /* round latency buckets in powers of two microseconds */
+            static const size_t N_BUCKETS = 32;
+
+            BrokerMetrics();
+
+            ~BrokerMetrics();
+
+            /** Bind the PUB socket, unless endpoint is NULL; false on
+             * error. Reports list the top topics by volume. */
+            bool open(const char *endpoint, fncs::time interval, size_t top=10);
+
+            /** Record a grant decision. */
+            void round(fncs::time now);
+
+            /** A value of bytes went from sim index from to sim index to. */
+            void delivered(size_t from, size_t to, size_t bytes) {
+                Traffic &traffic = matrix[(static_cast<unsigned long long>(from) << 32) | to];
+                ++traffic.n_delivered;
+                traffic.bytes_delivered += bytes;
+            }
+
+            /** A value of bytes was published to the topic and delivered
+             * to n_delivered sims. */
+            void topic(const std::string &topic, size_t bytes, size_t n_delivered) {
+                Traffic &traffic = topics[topic];
+                ++traffic.n_published;
+                traffic.bytes_published += bytes;
+                traffic.n_delivered += n_delivered;
+                traffic.bytes_delivered += bytes * n_delivered;
+            }
+
+            /** Milliseconds until the next report is due, for zmq_poll. */
+            long timeout(fncs::time now) const;
+
+            bool due(fncs::time now) const { return now >= time_next; }
+
+            /** Publish and log a snapshot, then schedule the next one. */
+            void report(fncs::time now, const SimMetricsVec &sims,
+                    const BrokerMemory &memory);
+
+            /** Log sims ranked by the wait time they caused others. */
+            void straggler_report(const SimMetricsVec &sims) const;
+
+            /** Log the pairs of sims and the topics of the largest volume. */
+            void traffic_report(const SimMetricsVec &sims) const;
+
+            void close();
+
+        private:
+            /* upper bound in microseconds of the bucket holding fraction */
+            unsigned long long percentile(double fraction) const;
+
+            zsock_t *pub;
+            fncs::time interval;
+            fncs::time time_start;
+            fncs::time time_next;
+            fncs::time time_report; /* time of the previous report */
+            fncs::time time_round; /* time of the previous round */
+            unsigned long long n_rounds;
+            unsigned long long n_rounds_reported;
+            unsigned long long histogram[N_BUCKETS];
+            size_t top;
+            /* by publisher index in the high 32 bits, subscriber in the low */
+            fncs::HashMap<unsigned long long,Traffic>::type matrix;
+            fncs::HashMap<std::string,Traffic>::type topics;
+    };
+
+
+    /** Where a sim is on the timeline; see Timeline. */
+    class TimelineTrack {
+        public:
+            TimelineTrack() : tid(0), mark(0), time_granted(0), computing(false) {}
+
+            int tid; /* 0 until the sim shows up on the timeline */
+            fncs::time mark; /* last grant or report */
+            fncs::time time_granted; /* sim time of the last grant */
+            bool computing;
+    };
+
+    /** Records the run as a Chrome Trace Event file, which chrome://tracing
+     * and the Perfetto UI load. Each sim is a thread of its own, whose
+     * spans alternate between computing, from a grant to its next
+     * TIME_REQUEST or BYE, and waiting, from then to the next grant. The
+     * broker's thread shows one span per round, from the previous round
+     * to the grant decision that ends it. Times are wall times relative
+     * to open(), in microseconds. */
+    class Timeline {
+        public:
+            Timeline();
+
+            ~Timeline();
+
+            /** Create the file; false on error. */
+            bool open(const std::string &path);
+
+            void granted(TimelineTrack &track, const std::string &name,
+                    fncs::time now, fncs::time time_granted);
+
+            void reported(TimelineTrack &track, fncs::time now);
+
+            /** A grant decision released n_granted sims. */
+            void round(fncs::time now, size_t n_granted);
+
+            /** Complete the file. */
+            void close();
+
+        private:
+            void span(const char *name, int tid, fncs::time begin,
+                    fncs::time end, const char *arg, fncs::time value);
+
+            std::vector<char> buffer;
+            std::ofstream out;
+            fncs::time time_start;
+            fncs::time time_round; /* of the previous round */
+            unsigned long long n_rounds;
+            int n_tracks;
+    };
+
+}
+
+#endif /* _BROKER_METRICS_HPP_ */
@@ -0,0 +1,88 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_cache_export.hpp"
+
+using namespace ::std;
+
+static void pause_briefly()
+{
+#if (defined WIN32 || defined _WIN32)
+    Sleep(10);
+#else
+    usleep(10000);
+#endif
+}
+
+/* Prints the cache a sim exports with FNCS_CACHE_EXPORT as tab separated
+ * text, once, or with --follow at every grant until the sim finalizes. */
+int main(int argc, char **argv)
+{
+    fncs::CacheReader reader;
+    fncs::CacheSnapshot snapshot;
+    bool follow = false;
+    const char *name = NULL;
+    unsigned long long printed = 0; /* grants */
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--follow")) {
+            follow = true;
+        }
+        else if (!name) {
+            name = argv[i];
+        }
+        else {
+            name = NULL;
+            break;
+        }
+    }
+    if (!name) {
+        cerr << "Usage: fncs_cache_dump [--follow] <FNCS_CACHE_EXPORT name>" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!reader.open(name)) {
+        cerr << "'" << name << "' is not a FNCS cache export." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << "#nanoseconds\tkey\tvalue" << '\n';
+    while (true) {
+        if (!reader.read(snapshot)) {
+            pause_briefly();
+            continue;
+        }
+        if (snapshot.grants != printed) {
+            printed = snapshot.grants;
+            for (size_t i=0; i<snapshot.entries.size(); ++i) {
+                cout << snapshot.time << '\t' << snapshot.entries[i].key << '\t'
+                    << snapshot.entries[i].value << '\n';
+            }
+            cout.flush();
+            if (snapshot.truncated) {
+                cerr << "the cache did not fit FNCS_CACHE_EXPORT_SIZE at "
+                    << snapshot.time << endl;
+            }
+        }
+        if (!follow || snapshot.closed) {
+            break;
+        }
+        pause_briefly();
+    }
+
+    return 0;
+}
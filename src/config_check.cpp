@@ -0,0 +1,368 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_config_check [--rate <sim|topic>=<values/s>] [--fanout <n>]\n"
+    "                         [--list-rate <values/s>] [--peer-ratio <n>] <config>...";
+
+static const double NS = 1e9;
+
+/* one federate of the scenario, as its config describes it */
+class Federate {
+    public:
+        Federate() : file(), name(), time_delta(0), time_peer(0), config(), peers() {}
+
+        string file;
+        string name;
+        fncs::time time_delta;
+        fncs::time time_peer; /* as the broker works it out, 0 if it has no peers */
+        fncs::Config config;
+        set<size_t> peers; /* its publishers and subscribers */
+};
+
+/* something costly, and the messages per simulated second it costs */
+class Finding {
+    public:
+        Finding(double rate, const string &kind, const string &sim, const string &detail)
+            : rate(rate), kind(kind), sim(sim), detail(detail) {}
+
+        bool operator<(const Finding &that) const { return rate > that.rate; }
+
+        double rate;
+        string kind;
+        string sim;
+        string detail;
+};
+
+typedef vector<pair<string,double> > RateVec; /* --rate, in the order given */
+
+static string sim_of(const string &topic)
+{
+    return topic.substr(0, topic.find('/'));
+}
+
+static string format_time(fncs::time time)
+{
+    char text[32];
+    if (time >= 1000000000ULL && time % 1000000000ULL == 0) {
+        snprintf(text, sizeof(text), "%llus", time / 1000000000ULL);
+    }
+    else if (time >= 1000000ULL && time % 1000000ULL == 0) {
+        snprintf(text, sizeof(text), "%llums", time / 1000000ULL);
+    }
+    else if (time >= 1000ULL && time % 1000ULL == 0) {
+        snprintf(text, sizeof(text), "%lluus", time / 1000ULL);
+    }
+    else {
+        snprintf(text, sizeof(text), "%lluns", time);
+    }
+    return text;
+}
+
+static string format_rate(double rate)
+{
+    char text[32];
+    snprintf(text, sizeof(text), rate < 10 ? "%.2g" : "%.0f", rate);
+    return text;
+}
+
+/* Values per simulated second a publisher sends of the topic: one per
+ * step unless --rate says otherwise for the topic or the publisher. */
+static double publish_rate(const Federate &publisher, const string &topic,
+        const RateVec &rates)
+{
+    for (size_t i=0; i<rates.size(); ++i) {
+        if (fncs::glob_match(rates[i].first, topic)
+                || fncs::glob_match(rates[i].first, publisher.name)) {
+            return rates[i].second;
+        }
+    }
+    return NS / publisher.time_delta;
+}
+
+/* What the filters of the subscription leave of rate values per second
+ * for a subscriber stepping every time_delta. A deadband or on_change
+ * drops values that cannot be told apart here, so this is the most. */
+static double delivered_rate(const fncs::Subscription &sub, double rate,
+        fncs::time time_delta)
+{
+    long nth = atol(sub.every_nth.c_str());
+    fncs::time interval = 0;
+    if (nth > 1) {
+        rate /= nth;
+    }
+    if (!sub.min_interval.empty()
+            && fncs::try_parse_time(sub.min_interval.c_str(), interval) && interval) {
+        rate = min(rate, NS / interval);
+    }
+    /* fetched at most once a step, a request and its answer */
+    if (sub.pulls() && !fncs::is_topic_pattern(sub.topic)) {
+        rate = 2 * min(rate, NS / time_delta);
+    }
+    return rate;
+}
+
+/* Loads the configs of every federate of a scenario and flags what will
+ * cost the most messages once it runs: subscriptions no federate of the
+ * scenario publishes, list subscriptions of fast topics, fine peers that
+ * keep a sim from stepping on its own, see the broker's time_peers(),
+ * and topics with many subscribers. Rates are per simulated second, a
+ * publisher sending each subscribed key once a step unless --rate says
+ * otherwise. Exits 1 if anything was found. */
+int main(int argc, char **argv)
+{
+    RateVec rates;
+    size_t fanout = 100;
+    double list_rate = 100;
+    double peer_ratio = 10;
+    vector<string> files;
+    vector<Federate> federates;
+    map<string,size_t> by_name; /* federates and their members */
+    vector<Finding> findings;
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--rate") && i+1 < argc) {
+            string spec = argv[++i];
+            size_t eq = spec.rfind('=');
+            double rate = eq == string::npos ? -1 : atof(spec.c_str() + eq + 1);
+            if (eq == string::npos || eq == 0 || rate < 0) {
+                cerr << "--rate must be <sim|topic>=<values per second>, not '"
+                    << spec << "'" << endl;
+                exit(EXIT_FAILURE);
+            }
+            rates.push_back(make_pair(spec.substr(0, eq), rate));
+        }
+        else if (0 == strcmp(argv[i], "--fanout") && i+1 < argc) {
+            fanout = strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "--list-rate") && i+1 < argc) {
+            list_rate = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "--peer-ratio") && i+1 < argc) {
+            peer_ratio = atof(argv[++i]);
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i=0; i<files.size(); ++i) {
+        Federate federate;
+        federate.file = files[i];
+        if (!fncs::load_config(files[i], federate.config)) {
+            exit(EXIT_FAILURE);
+        }
+        federate.name = federate.config.name;
+        if (federate.name.empty()) {
+            /* as FNCS_NAME would have to give it */
+            size_t slash = files[i].find_last_of("/\\");
+            federate.name = files[i].substr(slash == string::npos ? 0 : slash + 1);
+            federate.name = federate.name.substr(0, federate.name.rfind('.'));
+            cerr << files[i] << " has no name, taken to be '" << federate.name << "'" << endl;
+        }
+        const string &delta = federate.config.time_delta.empty() ?
+            string("1s") : federate.config.time_delta;
+        if (!fncs::try_parse_time(delta.c_str(), federate.time_delta)
+                || !federate.time_delta) {
+            cerr << files[i] << " has an invalid time_delta '" << delta << "'" << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (by_name.count(federate.name)) {
+            cerr << "'" << federate.name << "' of " << files[i] << " is also the name of "
+                << federates[by_name[federate.name]].file << endl;
+            exit(EXIT_FAILURE);
+        }
+        by_name[federate.name] = federates.size();
+        vector<string> members;
+        if (!federate.config.members.empty()
+                && !fncs::expand_members(federate.config.members, members)) {
+            cerr << files[i] << " has invalid members '" << federate.config.members << "'" << endl;
+            exit(EXIT_FAILURE);
+        }
+        for (size_t j=0; j<members.size(); ++j) {
+            by_name[members[j]] = federates.size();
+        }
+        federates.push_back(federate);
+    }
+
+    /* the publishers of each subscription, the graph of peers, and the
+     * subscribers of each exact topic */
+    map<string,vector<size_t> > subscribers; /* by topic */
+    vector<vector<vector<size_t> > > publishers(federates.size());
+    double values_total = 0;
+    vector<double> values_in(federates.size(), 0.0);
+    for (size_t s=0; s<federates.size(); ++s) {
+        Federate &subscriber = federates[s];
+        const vector<fncs::Subscription> &values = subscriber.config.values;
+        publishers[s].resize(values.size());
+        for (size_t v=0; v<values.size(); ++v) {
+            const fncs::Subscription &sub = values[v];
+            string name = sim_of(sub.topic);
+            vector<size_t> &found = publishers[s][v];
+            if (fncs::is_topic_pattern(name)) {
+                for (map<string,size_t>::const_iterator it=by_name.begin();
+                        it!=by_name.end(); ++it) {
+                    if (fncs::glob_match(name, it->first)) {
+                        found.push_back(it->second);
+                    }
+                }
+                sort(found.begin(), found.end());
+                found.erase(unique(found.begin(), found.end()), found.end());
+            }
+            else {
+                map<string,size_t>::const_iterator it = by_name.find(name);
+                if (it != by_name.end()) {
+                    found.push_back(it->second);
+                }
+                if (!fncs::is_topic_pattern(sub.topic)) {
+                    subscribers[sub.topic].push_back(s);
+                }
+            }
+            if (found.empty()) {
+                findings.push_back(Finding(0, "unpublished", subscriber.name,
+                            "'" + sub.topic + "' names no federate of the scenario,"
+                            " the key keeps its default"));
+                continue;
+            }
+            double rate = 0;
+            for (size_t p=0; p<found.size(); ++p) {
+                rate += publish_rate(federates[found[p]], sub.topic, rates);
+                subscriber.peers.insert(found[p]);
+                federates[found[p]].peers.insert(s);
+            }
+            rate = delivered_rate(sub, rate, subscriber.time_delta);
+            values_in[s] += rate;
+            values_total += rate;
+            if (sub.is_list() && rate >= list_rate) {
+                findings.push_back(Finding(rate, "list", subscriber.name,
+                            "list subscription of '" + sub.topic + "' keeps every value"
+                            " of a fast topic; the last value may do"));
+            }
+        }
+    }
+    /* pattern subscriptions count toward the exact topics they match */
+    for (size_t s=0; s<federates.size(); ++s) {
+        const vector<fncs::Subscription> &values = federates[s].config.values;
+        for (size_t v=0; v<values.size(); ++v) {
+            if (!fncs::is_topic_pattern(values[v].topic)) {
+                continue;
+            }
+            for (map<string,vector<size_t> >::iterator it=subscribers.begin();
+                    it!=subscribers.end(); ++it) {
+                if (fncs::glob_match(values[v].topic, it->first)) {
+                    it->second.push_back(s);
+                }
+            }
+        }
+    }
+    for (map<string,vector<size_t> >::iterator it=subscribers.begin();
+            it!=subscribers.end(); ++it) {
+        vector<size_t> &subs = it->second;
+        sort(subs.begin(), subs.end());
+        subs.erase(unique(subs.begin(), subs.end()), subs.end());
+        map<string,size_t>::const_iterator publisher = by_name.find(sim_of(it->first));
+        if (subs.size() < fanout || publisher == by_name.end()) {
+            continue;
+        }
+        double rate = publish_rate(federates[publisher->second], it->first, rates);
+        char count[32];
+        snprintf(count, sizeof(count), "%lu", (unsigned long)subs.size());
+        findings.push_back(Finding(rate * subs.size(), "fanout",
+                    federates[publisher->second].name, "'" + it->first + "' goes to "
+                    + count + " subscribers; an aggregate or FNCS_GRANT_CAST may serve them"));
+    }
+
+    /* a sim steps on its own up to the next multiple of its time_peer,
+     * the smallest delta of its peers, so one fine peer among slow ones
+     * costs it a time request every step */
+    double time_total = 0;
+    vector<double> requests(federates.size(), 0.0);
+    for (size_t s=0; s<federates.size(); ++s) {
+        Federate &federate = federates[s];
+        fncs::time finest = 0;
+        for (set<size_t>::const_iterator it=federate.peers.begin();
+                it!=federate.peers.end(); ++it) {
+            fncs::time delta = federates[*it].time_delta;
+            if (!finest || delta < finest) {
+                finest = delta;
+            }
+        }
+        federate.time_peer = finest;
+        fncs::time step = max(federate.time_delta, finest);
+        requests[s] = NS / step;
+        time_total += 2 * requests[s];
+        /* the window it would have without the finest peers */
+        fncs::time next = 0;
+        string pinned;
+        for (set<size_t>::const_iterator it=federate.peers.begin();
+                it!=federate.peers.end(); ++it) {
+            fncs::time delta = federates[*it].time_delta;
+            if (delta == finest) {
+                if (*it != s) {
+                    pinned += (pinned.empty() ? "" : ",") + federates[*it].name;
+                }
+            }
+            else if (!next || delta < next) {
+                next = delta;
+            }
+        }
+        if (pinned.empty() || !next) {
+            continue;
+        }
+        fncs::time wider = max(federate.time_delta, next);
+        if (static_cast<double>(wider) / step >= peer_ratio) {
+            findings.push_back(Finding(2 * requests[s], "time_peer", federate.name,
+                        "time_delta " + format_time(federate.time_delta) + " but "
+                        + pinned + " step every " + format_time(finest)
+                        + ", which keeps it from stepping on its own up to "
+                        + format_time(wider) + " (~" + format_rate(2 * NS / wider)
+                        + " msg/s without them)"));
+        }
+    }
+
+    stable_sort(findings.begin(), findings.end());
+    cout << "# findings: " << findings.size() << '\n';
+    cout << "#msg/s\tkind\tsim\tdetail" << '\n';
+    for (size_t i=0; i<findings.size(); ++i) {
+        cout << format_rate(findings[i].rate) << '\t' << findings[i].kind << '\t'
+            << findings[i].sim << '\t' << findings[i].detail << '\n';
+    }
+
+    cout << '\n' << "# estimated messages per simulated second" << '\n';
+    cout << "#sim\ttime_delta\ttime_peer\tvalues in\ttime messages" << '\n';
+    for (size_t s=0; s<federates.size(); ++s) {
+        cout << federates[s].name << '\t' << format_time(federates[s].time_delta) << '\t'
+            << (federates[s].time_peer ? format_time(federates[s].time_peer) : "-") << '\t'
+            << format_rate(values_in[s]) << '\t' << format_rate(2 * requests[s]) << '\n';
+    }
+    cout << "# total: " << format_rate(values_total) << " values and "
+        << format_rate(time_total) << " time messages per simulated second" << endl;
+
+    return findings.empty() ? 0 : 1;
+}
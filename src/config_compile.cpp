@@ -0,0 +1,51 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+/* Compiles a ZPL or YAML config into the binary form that
+ * fncs::initialize() loads without parsing, when FNCS_CONFIG_FILE names
+ * it. The output is only as current as its input; recompile after
+ * editing the config. */
+int main(int argc, char **argv)
+{
+    fncs::Config config;
+    string compiled;
+    ofstream fout;
+
+    if (argc != 3) {
+        cerr << "Usage: fncs_config_compile <config.zpl|config.yaml> <output file>" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!fncs::load_config(argv[1], config)) {
+        exit(EXIT_FAILURE);
+    }
+    compiled = fncs::compile_config(config);
+
+    fout.open(argv[2], ios::out | ios::binary);
+    if (!fout) {
+        cerr << "Could not open output file '" << argv[2] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+    fout.write(compiled.data(), compiled.size());
+    fout.close();
+    if (!fout) {
+        cerr << "Could not write output file '" << argv[2] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << config.values.size() << " value(s) compiled into " << argv[2] << endl;
+
+    return 0;
+}
@@ -7,277 +7,327 @@
 #include <iostream>
 #include <streambuf>
 #include <string>
+#include <vector>
+
+#include "czmq.h"
 
 #include "echo.hpp"
 
 using namespace std;
 
+namespace fncs {
+
+/* The buffer of an Echo. What fills it is written to the file and to
+ * stdout by the thread of the Echo, or by the writer thread once
+ * started; the file and the flag are changed only while it is stopped. */
+class EchoBuf : public streambuf
+{
+    public:
+        static const size_t SIZE = 65536;
+
+        EchoBuf() : file(), to_cout(false), buffer(SIZE), actor(NULL) {
+            setp(&buffer[0], &buffer[0] + buffer.size());
+        }
+
+        ~EchoBuf() {
+            drain(true);
+            stop();
+        }
+
+        /* the buffered bytes, handed to the writer thread or written */
+        void drain(bool flushed) {
+            size_t size = pptr() - pbase();
+            if (size) {
+                if (actor) {
+                    zmq_send(zsock_resolve(zactor_sock(actor)), pbase(), size, 0);
+                }
+                else {
+                    write(pbase(), size);
+                }
+                setp(&buffer[0], &buffer[0] + buffer.size());
+            }
+            if (flushed && !actor) {
+                flush();
+            }
+        }
+
+        void write(const char *data, size_t size) {
+            if (file.is_open()) {
+                file.rdbuf()->sputn(data, size);
+            }
+            if (to_cout) {
+                cout.rdbuf()->sputn(data, size);
+            }
+        }
+
+        void flush() {
+            if (file.is_open()) {
+                file.flush();
+            }
+            if (to_cout) {
+                cout.flush();
+            }
+        }
+
+        bool start();
+
+        /* joins the writer thread once it wrote what it was sent */
+        void stop() {
+            if (actor) {
+                zactor_destroy(&actor);
+            }
+        }
+
+        bool async() const { return actor != NULL; }
+
+        ofstream file;
+        bool to_cout;
+
+    protected:
+        virtual int_type overflow(int_type c) {
+            drain(false);
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        virtual int sync() {
+            drain(true);
+            return 0;
+        }
+
+    private:
+        vector<char> buffer;
+        zactor_t *actor;
+};
+
+}
+
+/* The writer thread of an Echo. Each message on the pipe is a buffer
+ * full; the streams are flushed once the pipe is drained. */
+static void echo_actor(zsock_t *pipe, void *args)
+{
+    fncs::EchoBuf *buf = static_cast<fncs::EchoBuf*>(args);
+    zmq_pollitem_t items[] = { { zsock_resolve(pipe), 0, ZMQ_POLLIN, 0 } };
+
+    zsock_signal(pipe, 0);
+
+    while (true) {
+        zframe_t *frame = zframe_recv(pipe);
+        if (!frame) {
+            break; /* interrupted */
+        }
+        if (zframe_streq(frame, "$TERM")) {
+            zframe_destroy(&frame);
+            break;
+        }
+        buf->write(reinterpret_cast<const char*>(zframe_data(frame)), zframe_size(frame));
+        zframe_destroy(&frame);
+        if (zmq_poll(items, 1, 0) == 0) {
+            buf->flush();
+        }
+    }
+
+    buf->flush();
+}
+
+bool fncs::EchoBuf::start()
+{
+    if (!actor) {
+        drain(true);
+        actor = zactor_new(echo_actor, this);
+    }
+    return actor != NULL;
+}
+
+/* Runs a change to the file or the flag with the writer thread stopped. */
+class EchoPause {
+    public:
+        explicit EchoPause(fncs::EchoBuf *buf) : buf(buf), restart(buf->async()) {
+            buf->drain(true);
+            buf->stop();
+        }
+
+        ~EchoPause() {
+            if (restart) {
+                buf->start();
+            }
+        }
+
+    private:
+        fncs::EchoBuf *buf;
+        bool restart;
+};
+
 fncs::Echo::Echo()
-    : os(), cout_enabled(false)
+    : buf(new EchoBuf), out(buf)
 {
 }
 
 fncs::Echo::Echo(const string &filename, ios_base::openmode mode)
-    : os(filename.c_str(), mode), cout_enabled(false)
+    : buf(new EchoBuf), out(buf)
 {
+    buf->file.open(filename.c_str(), mode);
 }
 
 fncs::Echo::Echo(const char *filename, ios_base::openmode mode)
-    : os(filename, mode), cout_enabled(false)
+    : buf(new EchoBuf), out(buf)
 {
+    buf->file.open(filename, mode);
 }
 
 fncs::Echo::~Echo()
 {
+    delete buf; /* writes what is left */
 }
 
 void fncs::Echo::open(const string &filename, ios_base::openmode mode) {
-    this->os.open(filename.c_str(), mode);
+    EchoPause pause(this->buf);
+    this->buf->file.open(filename.c_str(), mode);
 }
 
 void fncs::Echo::open(const char *filename, ios_base::openmode mode) {
-    this->os.open(filename, mode);
+    EchoPause pause(this->buf);
+    this->buf->file.open(filename, mode);
 }
 
 void fncs::Echo::close() {
-    this->os.close();
+    EchoPause pause(this->buf);
+    this->buf->file.close();
 }
 
 void fncs::Echo::enable_stdout() {
-    this->cout_enabled = true;
+    EchoPause pause(this->buf);
+    this->buf->to_cout = true;
 }
 
 void fncs::Echo::disable_stdout() {
-    this->cout_enabled = false;
+    EchoPause pause(this->buf);
+    this->buf->to_cout = false;
+}
+
+bool fncs::Echo::enable_async() {
+    return this->buf->start();
+}
+
+void fncs::Echo::disable_async() {
+    this->buf->drain(true);
+    this->buf->stop();
 }
 
 fncs::Echo& fncs::Echo::operator<< (bool val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (short val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (unsigned short val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (int val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (unsigned int val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (long val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (unsigned long val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (long long val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (unsigned long long val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (float val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (double val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (long double val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (void* val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (streambuf* val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (ostream& (*pf)(ostream&)) {
-    if (this->os.is_open()) {
-        pf(this->os);
-    }
-    if (this->cout_enabled) {
-        pf(cout);
-    }
+    pf(this->out);
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (ios& (*pf)(ios&)) {
-    if (this->os.is_open()) {
-        pf(this->os);
-    }
-    if (this->cout_enabled) {
-        pf(cout);
-    }
+    pf(this->out);
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (ios_base& (*pf)(ios_base&)) {
-    if (this->os.is_open()) {
-        pf(this->os);
-    }
-    if (this->cout_enabled) {
-        pf(cout);
-    }
+    pf(this->out);
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (char val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (signed char val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (unsigned char val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (const char* val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (const signed char* val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
 fncs::Echo& fncs::Echo::operator<< (const unsigned char* val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        cout << val;
-    }
+    this->out << val;
     return *this;
 }
-
@@ -20,6 +20,13 @@
 
 namespace fncs {
 
+class EchoBuf;
+
+/** Tees what is written to it to a file and, if enabled, to stdout.
+ * Values are formatted once into a large buffer which is written to both
+ * when it fills or the Echo is flushed, e.g. by std::endl, so writing a
+ * value costs no system call. With enable_async() a background thread
+ * does the writing, and a flush only hands it the buffer. */
 class FNCS_EXPORT Echo
 {
     public:
@@ -36,6 +43,10 @@ class FNCS_EXPORT Echo
         void close();
         void enable_stdout();
         void disable_stdout();
+        /** Write from a background thread; false if it did not start. */
+        bool enable_async();
+        /** Write what is buffered and stop the background thread. */
+        void disable_async();
         Echo& operator<< (bool val);
         Echo& operator<< (short val);
         Echo& operator<< (unsigned short val);
@@ -64,18 +75,17 @@ class FNCS_EXPORT Echo
         Echo& operator<< (const T &val);
 
     private:
-        std::ofstream os;
-        bool cout_enabled;
+        /* not copyable */
+        Echo(const Echo &);
+        Echo& operator=(const Echo &);
+
+        EchoBuf *buf;
+        std::ostream out; /* formats into buf */
 };
 
 template <typename T>
 Echo& Echo::operator<< (const T &val) {
-    if (this->os.is_open()) {
-        this->os << val;
-    }
-    if (this->cout_enabled) {
-        std::cout << val;
-    }
+    this->out << val;
     return *this;
 }
 
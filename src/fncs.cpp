@@ -5,8 +5,10 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <complex>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <iostream>
@@ -29,8 +31,18 @@
 #endif
 #include <assert.h>
 
+/* for the blob file names */
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 /* 3rd party headers */
 #include "czmq.h"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 /* 3rd party contrib */
 #include "yaml-cpp/yaml.h"
@@ -38,35 +50,897 @@
 /* fncs headers */
 #include "log.hpp"
 #include "fncs.hpp"
+#include "fncs_cache_export.hpp"
 #include "fncs_internal.hpp"
+#include "mutex.hpp"
+#include "probes.hpp"
+#include "topic_filter.hpp"
+#include "topic_intern.hpp"
+#include "topic_table.hpp"
+#include "value_dictionary.hpp"
+#include "work_pool.hpp"
 
 using namespace ::std;
 
-static bool is_initialized_ = false;
-static bool die_is_fatal = false;
-static string simulation_name = "";
-static int simulation_id = 0;
-static int n_sims = 0;
-static fncs::time time_delta_multiplier = 0;
-static fncs::time time_delta = 0;
-static fncs::time time_peer = 0;
-static fncs::time time_current = 0;
-static fncs::time time_window = 0;
-static zsock_t *client = NULL;
-static map<string,string> cache;
-static vector<string> events;
-static set<string> keys; /* keys that other sims subscribed to */
-static vector<string> mykeys; /* keys from the fncs config file */
 
 static const string default_broker = "tcp://localhost:5570";
 static const string default_time_delta = "1s";
 static const string default_fatal = "yes";
+static const string default_protocol = fncs::PROTOCOL_BINARY;
+
+#if HAVE_TRACELOGGING && !HAVE_SYS_SDT_H
+/* the ETW provider of the tracepoints, see probes.hpp, registered while
+ * the library is loaded */
+TRACELOGGING_DEFINE_PROVIDER(fncs_trace_provider, "FNCS",
+        (0x4906a639, 0x872a, 0x4305, 0xb8, 0xb2, 0xf8, 0x57, 0x09, 0xc8, 0x40, 0xc6));
+
+static struct TraceProviderRegistration {
+    TraceProviderRegistration() { TraceLoggingRegister(fncs_trace_provider); }
+    ~TraceProviderRegistration() { TraceLoggingUnregister(fncs_trace_provider); }
+} trace_provider_registration;
+#endif
+
+/* The cache is a dense array of slots, one per subscribed key, so that
+ * a fncs::Key handle is simply a slot index. A key subscribed as a list
+ * keeps every value received during a time step, as text, other keys
+ * keep only the last one. A typed value is formatted only when asked for
+ * as a string, and a string value parsed only when asked for a number. */
+/* large values, see FNCS_BLOB_THRESHOLD */
+static bool blob_handle(const char *data, size_t size, string &path);
+static string blob_adopt(const string &path);
+static bool blob_read(const string &path, string &value);
+
+/* the value a coded frame stands for, else NULL, see FNCS_DICTIONARY */
+static const string* value_coded(const char *data, size_t size);
+
+/* compressed values, see FNCS_COMPRESS */
+static bool value_packed(const char *data, size_t size)
+{
+    return size >= 2 && data[0] == '\0' && data[1] == fncs::VALUE_ZSTD;
+}
+
+/* the compressed frame, or empty if it would not be smaller */
+static string value_pack(const string &value)
+{
+    string packed;
+#ifdef HAVE_ZSTD
+    packed.resize(2 + ZSTD_compressBound(value.size()));
+    /* the fastest level; the point is fewer bytes through the broker */
+    size_t size = ZSTD_compress(&packed[2], packed.size() - 2,
+            value.data(), value.size(), 1);
+    if (ZSTD_isError(size) || 2 + size >= value.size()) {
+        return string();
+    }
+    packed.resize(2 + size);
+    packed[0] = '\0';
+    packed[1] = static_cast<char>(fncs::VALUE_ZSTD);
+#else
+    (void)value;
+#endif
+    return packed;
+}
+
+static bool value_unpack(const char *data, size_t size, string &value)
+{
+#ifdef HAVE_ZSTD
+    unsigned long long n = ZSTD_getFrameContentSize(data + 2, size - 2);
+    if (n != ZSTD_CONTENTSIZE_ERROR && n != ZSTD_CONTENTSIZE_UNKNOWN) {
+        value.resize(static_cast<size_t>(n));
+        size_t got = ZSTD_decompress(&value[0], value.size(), data + 2, size - 2);
+        if (!ZSTD_isError(got) && got == value.size()) {
+            return true;
+        }
+    }
+    LERROR << "could not decompress a value of " << size << " bytes";
+#else
+    (void)data;
+    LERROR << "received a compressed value of " << size
+        << " bytes without zstd support";
+#endif
+    value.clear();
+    return false;
+}
+
+/* Delta encoded list values, see FNCS_LIST_DELTA. After the tag comes a
+ * byte, 1 for a keyframe followed by the whole value, or 0 for a delta:
+ * the hash of the value it applies to, the lengths of the prefix and of
+ * the suffix kept from that value, as u64s, and the bytes in between. */
+static const size_t DELTA_HEADER = 3;
+static const size_t DELTA_FIXED = DELTA_HEADER + 3*8;
+
+static unsigned long long config_hash(const char *data, size_t size);
+static void put_u64(char *out, unsigned long long value);
+static unsigned long long get_u64(const unsigned char *data);
+
+bool fncs::delta_frame(const char *data, size_t size)
+{
+    return size >= DELTA_HEADER && data[0] == '\0' && data[1] == fncs::VALUE_DELTA;
+}
+
+string fncs::delta_encode(string &base, bool keyframe, const string &value)
+{
+    string out(DELTA_HEADER, '\0');
+    out[1] = static_cast<char>(fncs::VALUE_DELTA);
+    if (!keyframe) {
+        size_t n = min(base.size(), value.size());
+        size_t prefix = 0;
+        size_t suffix = 0;
+        while (prefix < n && base[prefix] == value[prefix]) {
+            ++prefix;
+        }
+        while (suffix < n - prefix
+                && base[base.size()-1-suffix] == value[value.size()-1-suffix]) {
+            ++suffix;
+        }
+        size_t middle = value.size() - prefix - suffix;
+        if (DELTA_FIXED + middle < DELTA_HEADER + value.size()) {
+            out.resize(DELTA_FIXED);
+            put_u64(&out[DELTA_HEADER], config_hash(base.data(), base.size()));
+            put_u64(&out[DELTA_HEADER+8], prefix);
+            put_u64(&out[DELTA_HEADER+16], suffix);
+            out.append(value, prefix, middle);
+            base = value;
+            return out;
+        }
+    }
+    out[2] = '\1';
+    out.append(value);
+    base = value;
+    return out;
+}
+
+bool fncs::delta_apply(string &base, const char *data, size_t size)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    if (!fncs::delta_frame(data, size)) {
+        return false;
+    }
+    if (data[2] == '\1') {
+        base.assign(data + DELTA_HEADER, size - DELTA_HEADER);
+        return true;
+    }
+    if (size < DELTA_FIXED) {
+        return false;
+    }
+    unsigned long long prefix = get_u64(bytes + DELTA_HEADER + 8);
+    unsigned long long suffix = get_u64(bytes + DELTA_HEADER + 16);
+    if (prefix + suffix > base.size()
+            || get_u64(bytes + DELTA_HEADER) != config_hash(base.data(), base.size())) {
+        return false;
+    }
+    string value;
+    value.reserve(prefix + (size - DELTA_FIXED) + suffix);
+    value.assign(base, 0, prefix);
+    value.append(data + DELTA_FIXED, size - DELTA_FIXED);
+    value.append(base, base.size() - suffix, suffix);
+    base.swap(value);
+    return true;
+}
+
+/* a callback registered with on_update() or on_any_update() */
+typedef pair<fncs::UpdateCallback,void*> Listener;
+
+/* one publish of an agent stepped by set_agents(), by handle or, if
+ * only a pattern matched its key, by key */
+class AgentPublish {
+    public:
+        AgentPublish(fncs::Key key, const string &name, const string &value)
+            : key(key), name(name), value(value) {}
+
+        fncs::Key key;
+        string name;
+        string value;
+};
+
+typedef vector<AgentPublish> AgentOutbox;
+
+#if HAVE_THREAD_LOCAL
+#define AGENT_LOCAL thread_local
+#else
+#define AGENT_LOCAL
+#endif
+
+/* the publishes of the agent this thread steps, see step_agents() */
+static AGENT_LOCAL AgentOutbox *agent_outbox = NULL;
+
+/* The values list subscriptions received for a grant lie one after the
+ * other in an arena, each NUL terminated, and a slot keeps the offset
+ * and length of each of its values there. The arena and the entries
+ * keep their capacity from step to step, so once they have grown to a
+ * step's traffic a list value costs no allocation. Both are emptied by
+ * the next time request, until which the values are valid. */
+class ValueArena {
+    public:
+        ValueArena() : bytes() {}
+
+        /* copy the value in; where it starts */
+        size_t append(const char *data, size_t size) {
+            size_t offset = bytes.size();
+            bytes.insert(bytes.end(), data, data + size);
+            bytes.push_back('\0');
+            return offset;
+        }
+
+        const char* at(size_t offset) const { return &bytes[offset]; }
+
+        vector<char> bytes;
+};
+
+class ListEntry {
+    public:
+        ListEntry() : offset(0), size(0) {}
+        ListEntry(size_t offset, size_t size) : offset(offset), size(size) {}
+
+        size_t offset; /* in the arena */
+        size_t size; /* without the NUL */
+};
+
+/* The last values of a key with a history, see get_history(): a ring
+ * of the values and the sim times of the grants they came with. Its
+ * strings keep their capacity as they are overwritten. */
+class HistoryRing {
+    public:
+        HistoryRing() : times(), values(), first(0), count(0) {}
+
+        void resize(size_t n) {
+            times.assign(n, 0);
+            values.assign(n, string());
+            first = 0;
+            count = 0;
+        }
+
+        void push(fncs::time time, const char *data, size_t size) {
+            size_t at = (first + count) % times.size();
+            if (count == times.size()) {
+                first = (first + 1) % times.size();
+            }
+            else {
+                ++count;
+            }
+            times[at] = time;
+            values[at].assign(data, size);
+        }
+
+        /* forget the values of grants after time, which was rolled back to */
+        void rewind(fncs::time time) {
+            while (count && times[(first + count - 1) % times.size()] > time) {
+                --count;
+            }
+        }
+
+        vector<fncs::time> times;
+        vector<string> values;
+        size_t first; /* oldest */
+        size_t count;
+};
+
+class CacheSlot {
+    public:
+        CacheSlot()
+            : key(), value(), entries(), values(), listed(true), history(), typed(), blob()
+            , json(), fields(), record(), topic(), routed(), route_split(false), is_routed(false)
+            , has_text(true), has_typed(false), packed(false), interned(NULL)
+            , in_cache(false), in_list(false), changed(false), priority(false), version(0)
+            , listeners(), pull_topic(), pulled(false), pull_time(0), unsubscribed(false) {}
+
+        /* value holds the frame payload just received; a blob handle is
+         * only linked to and a compressed value kept as is, until the
+         * value is first asked for */
+        void received() {
+            string path;
+            json.clear();
+            record.clear();
+            if (!blob.empty()) {
+                remove(blob.c_str()); /* replaced before it was read */
+                blob.clear();
+            }
+            packed = false;
+            interned = NULL;
+            if (blob_handle(value.data(), value.size(), path)) {
+                blob = blob_adopt(path);
+                value.clear();
+                has_text = blob.empty();
+                has_typed = false;
+                return;
+            }
+            if (value_packed(value.data(), value.size())) {
+                packed = true;
+                has_text = false;
+                has_typed = false;
+                return;
+            }
+            /* the dictionary's copy is used in place */
+            interned = value_coded(value.data(), value.size());
+            if (interned) {
+                has_text = false;
+                has_typed = false;
+                return;
+            }
+            /* only a keyframe can be followed without the list's values */
+            if (fncs::delta_frame(value.data(), value.size())) {
+                if (value[2] == '\1') {
+                    value.erase(0, DELTA_HEADER);
+                }
+                else {
+                    LDEBUG4C(logCACHE) << "dropped a delta for key '" << key << "'";
+                    value.clear();
+                }
+            }
+            if (fncs::bytes_frame(value.data(), value.size())) {
+                value.erase(0, 2);
+                has_typed = false;
+                has_text = true;
+                return;
+            }
+            /* read in place, see get_record(), and formatted into json */
+            if (fncs::record_frame(value.data(), value.size())) {
+                has_typed = false;
+                has_text = false;
+                return;
+            }
+            has_typed = fncs::decode_typed(value.data(), value.size(), typed);
+            has_text = !has_typed;
+        }
+
+        /* read a pending blob into value and decompress it */
+        void load() {
+            if (!blob.empty()) {
+                string path;
+                path.swap(blob);
+                if (!blob_read(path, value)) {
+                    value.clear();
+                }
+                remove(path.c_str());
+                received();
+            }
+            if (packed) {
+                string raw;
+                value_unpack(value.data(), value.size(), raw);
+                value.swap(raw);
+                received();
+            }
+        }
+
+        const string& text() {
+            load();
+            if (interned) {
+                return *interned;
+            }
+            if (!has_text && fncs::record_frame(value.data(), value.size())) {
+                if (json.empty()) {
+                    json = fncs::format_record(value.data(), value.size());
+                }
+                return json;
+            }
+            if (!has_text) {
+                value = fncs::format_typed(typed);
+                has_text = true;
+            }
+            return value;
+        }
+
+        const fncs::TypedValue& number() {
+            load();
+            if (!has_typed) {
+                fncs::parse_typed(text(), typed);
+                has_typed = true;
+            }
+            return typed;
+        }
+
+        /* the values of the step as strings, made when first asked for */
+        const vector<string>& list(const ValueArena &arena) {
+            if (!listed) {
+                values.clear();
+                for (size_t i=0; i<entries.size(); ++i) {
+                    values.push_back(string(arena.at(entries[i].offset), entries[i].size));
+                }
+                listed = true;
+            }
+            return values;
+        }
+
+        void list_clear() {
+            entries.clear();
+            values.clear();
+            listed = true;
+        }
+
+        string key;
+        string value;
+        vector<ListEntry> entries; /* of a list, in the arena */
+        vector<string> values; /* ... copied out if listed */
+        bool listed;
+        HistoryRing history; /* if kept */
+        fncs::TypedValue typed;
+        string blob; /* this sim's link to an unread blob */
+        string json; /* a record value as text, made when first asked for */
+        vector<pair<string,fncs::Record::FieldType> > fields; /* of type = record{...} ... */
+        string record; /* ... into which a text value is read, see get_record() */
+        string topic; /* as published, if other than the key */
+        fncs::Routed routed; /* the parts of a route() topic, see get_routed() ... */
+        bool route_split; /* ... once split ... */
+        bool is_routed; /* ... if it is one */
+        bool has_text; /* value is current */
+        bool has_typed; /* typed is current */
+        bool packed; /* value is still compressed */
+        const string *interned; /* the dictionary's value, if value is its code */
+        bool in_cache; /* subscribed as a single value */
+        bool in_list; /* subscribed as a list */
+        bool changed; /* updated at the last grant, see note_changes() */
+        bool priority; /* listed first among the changed, see Subscription::prioritized() */
+        unsigned long long version; /* values received since initialize() */
+        vector<Listener> listeners; /* see on_update() */
+        string pull_topic; /* fetched when read, see pull_value(), if not empty ... */
+        bool pulled; /* ... and was ... */
+        fncs::time pull_time; /* ... at this time */
+        bool unsubscribed; /* values still on their way are dropped, see fncs::unsubscribe() */
+};
+
+typedef vector<CacheSlot> cache_t;
+
+/* The cache of an optimistic sim as it was at a grant, kept until the
+ * broker's GVT passes it, see set_rollback(). */
+class SavedCache {
+    public:
+        explicit SavedCache(fncs::time time) : time(time), values() {}
+
+        fncs::time time; /* granted, in nanoseconds */
+        vector<string> values; /* per cache slot */
+};
+
+class Staging;
+
+/* A key that other sims subscribed to, with its topic built once. */
+class PublishTopic {
+    public:
+        PublishTopic(const string &topic, bool in_list, bool delta)
+            : topic(topic), frame(topic), in_list(in_list), delta(delta)
+            , base(), n_sent(0) {}
+
+        string topic; /* sim name/key */
+        string frame; /* sent as the topic: its ID, if the broker gave one */
+        bool in_list; /* a subscriber keeps it as a list, never coalesced */
+        bool delta; /* sent as deltas from one value to the next */
+        string base; /* the last value sent, if delta */
+        unsigned long n_sent; /* values sent, if delta */
+};
+
+/* The subscribers of a published key that it is sent to directly, not
+ * through the broker, see FNCS_DIRECT. */
+class DirectRoute {
+    public:
+        DirectRoute() : topic(), id(0), peers(), relay(true), n_sent(0) {}
+
+        string topic; /* sim name/key, as the subscribers are sent it */
+        size_t id; /* its topic ID, by which the broker is told the counts */
+        vector<size_t> peers; /* indexes in direct_peers */
+        bool relay; /* others still get it through the broker */
+        unsigned long n_sent; /* since the last time request */
+};
+
+/* A key pattern other sims subscribed to; each key it matches becomes a
+ * PublishTopic when first published. */
+class PublishPattern {
+    public:
+        PublishPattern(const string &key, bool in_list, bool delta)
+            : key(key), in_list(in_list), delta(delta) {}
+
+        string key;
+        bool in_list;
+        bool delta;
+};
+
+/* Everything a federate keeps between calls. The API works on the
+ * current state: the default one, unless a fncs::Context method switched
+ * to its own for the duration of the call. */
+class fncs::ClientState {
+    public:
+        ClientState()
+            : in_context(false)
+            , is_initialized_(false)
+            , die_is_fatal(false)
+            , simulation_name()
+            , replica()
+            , replica_shared()
+            , simulation_id(0)
+            , n_sims(0)
+            , time_delta_multiplier(0)
+            , time_delta(0)
+            , time_peer(0)
+            , time_current(0)
+            , time_window(0)
+            , time_next_publish(0)
+            , time_stride(0)
+            , time_stride_max(0)
+            , time_period(0)
+            , time_granted_broker(0)
+            , broker_granted(false)
+            , poll_spin(0)
+            , idle_limit(0)
+            , idle_steps(0)
+            , client(NULL)
+            , binary_protocol(false)
+            , broker_negotiated(false)
+            , publish_batching(false)
+            , publish_batch(NULL)
+            , publish_coalescing(false)
+            , coalesced()
+            , coalesced_index()
+            , publish_threads(false)
+            , threaded_mutex()
+            , threaded()
+            , threaded_keys()
+            , agent_step(NULL)
+            , agent_data(NULL)
+            , agent_time(0)
+            , agent_outboxes()
+            , agent_pool(NULL)
+            , cache_export(NULL)
+            , exported()
+            , exported_lists(false)
+            , list_keys()
+            , compress_threshold(0)
+            , compression(false)
+            , dictionary_on(false)
+            , dictionary()
+            , delta_keyframes(0)
+            , list_bases()
+            , blob_threshold(0)
+            , blob_dir()
+            , blob_count(0)
+            , blobs_written()
+            , blobs_previous()
+            , blobs_older()
+            , request_pending(false)
+            , request_ready(false)
+            , request_local(false)
+            , request_next(0)
+            , request_granted(0)
+            , request_window(0)
+            , time_checkpoint(0)
+            , load()
+            , load_due(false)
+            , rollback_save(NULL)
+            , rollback_restore(NULL)
+            , rollback_discard(NULL)
+            , rollback_data(NULL)
+            , optimistic(false)
+            , request_rollback(false)
+            , request_restore(0)
+            , snapshots()
+            , stats()
+            , received()
+            , io_actor(NULL)
+            , grant_cast(NULL)
+            , cast_seq(0)
+            , cast_fence(0)
+            , grant_held(false)
+            , direct(NULL)
+            , direct_received(0)
+            , direct_fence(0)
+            , direct_peers()
+            , direct_routes()
+            , data(NULL)
+            , pull(NULL)
+            , subscribed()
+            , anon_filtered(false)
+            , events()
+            , changed()
+            , changed_rest()
+            , prioritized(false)
+            , any_listeners()
+            , publish_slots()
+            , publish_topics()
+            , publish_patterns()
+            , mykeys()
+            , cache()
+            , arena()
+            , key_slots()
+            , topics()
+            , topic_patterns()
+            , route_nodes()
+            , route_key()
+            , members()
+            , staged(NULL)
+        {}
+
+        bool in_context; /* owned by a fncs::Context */
+        bool is_initialized_;
+        bool die_is_fatal;
+        string simulation_name;
+        string replica; /* "#r" of a replica in an ensemble, see FNCS_REPLICA */
+        set<string> replica_shared; /* sims all replicas share, FNCS_ENSEMBLE_SHARED */
+        int simulation_id;
+        int n_sims;
+        fncs::time time_delta_multiplier;
+        fncs::time time_delta;
+        fncs::time time_peer;
+        fncs::time time_current;
+        fncs::time time_window;
+        fncs::time time_next_publish; /* for the next TIME_REQUEST, 0 if none */
+        fncs::time time_stride; /* least step of an idle sim, a multiple of time_delta */
+        fncs::time time_stride_max; /* FNCS_TIME_DELTA_MAX, 0 if not adaptive */
+        fncs::time time_period; /* standing request, see set_periodic(), 0 if none */
+        fncs::time time_granted_broker; /* last granted by the broker itself ... */
+        bool broker_granted; /* ... if it granted any yet */
+        fncs::time poll_spin; /* FNCS_POLL, busy polling before blocking */
+        unsigned long idle_limit; /* steps without values before widening */
+        unsigned long idle_steps; /* such steps since the stride last changed */
+        zsock_t *client;
+        bool binary_protocol; /* negotiated during HELLO/ACK */
+        bool broker_negotiated; /* broker answered with a protocol */
+        bool publish_batching; /* gather publishes until time_request */
+        zmsg_t *publish_batch; /* topic and value frames, repeated */
+        bool publish_coalescing; /* keep only the last value per step */
+        vector<pair<string,string> > coalesced; /* held topics and values */
+        map<string,size_t> coalesced_index; /* topic to index in coalesced */
+        bool publish_threads; /* publish may be called from any thread */
+        fncs::Mutex threaded_mutex; /* guards threaded and threaded_keys */
+        vector<pair<fncs::Key,string> > threaded; /* handles and values, in order */
+        vector<pair<string,string> > threaded_keys; /* keys only a pattern matched */
+        fncs::AgentStep agent_step; /* see set_agents() */
+        void *agent_data;
+        fncs::time agent_time; /* granted, in sim units */
+        vector<AgentOutbox> agent_outboxes; /* of each agent, for the step */
+        fncs::WorkPool *agent_pool; /* NULL if they step on this thread */
+        fncs::CacheSegment *cache_export; /* FNCS_CACHE_EXPORT, see export_cache() ... */
+        string exported; /* ... the entries, built before the segment is locked ... */
+        bool exported_lists; /* ... and if they hold the values of a list */
+        set<string> list_keys; /* keys with at least one list subscriber */
+        size_t compress_threshold; /* values this large are compressed, 0 if never */
+        bool compression; /* every sim reads compressed values */
+        bool dictionary_on; /* every sim reads coded values, see FNCS_DICTIONARY ... */
+        fncs::ValueDictionary dictionary; /* ... numbered by the broker so far */
+        unsigned long delta_keyframes; /* values between keyframes, 0 if no deltas */
+        map<string,string> list_bases; /* last value of each delta list topic */
+        size_t blob_threshold; /* values this large go to a blob, 0 if never */
+        string blob_dir; /* where blob files are written */
+        unsigned long blob_count; /* blob files named so far */
+        vector<string> blobs_written; /* blob files sent since the last request */
+        vector<string> blobs_previous; /* sent before the last request */
+        vector<string> blobs_older; /* removed at the next request */
+        bool request_pending; /* time_request_async() not yet waited */
+        bool request_ready; /* its grant has arrived */
+        bool request_local; /* granted from the time window */
+        fncs::time request_next; /* requested time, in nanoseconds */
+        fncs::time request_granted; /* granted time, in nanoseconds */
+        fncs::time request_window; /* window sent with the grant */
+        fncs::time time_checkpoint; /* of the last checkpoint, in nanoseconds */
+        fncs::FederationLoad load; /* the last summary, see FNCS_LOAD_FEEDBACK ... */
+        bool load_due; /* ... received, its grant still to come */
+        fncs::RollbackCallback rollback_save; /* see set_rollback() */
+        fncs::RollbackCallback rollback_restore;
+        fncs::RollbackCallback rollback_discard;
+        void *rollback_data;
+        bool optimistic; /* the broker confirmed it in the ACK */
+        bool request_rollback; /* the grant is a ROLLBACK */
+        fncs::time request_restore; /* grant of the state it restores */
+        vector<SavedCache> snapshots; /* ascending by time */
+        fncs::Stats stats; /* see get_stats() */
+        vector<zmsg_t*> received; /* PUBLISH messages held until grant */
+        zactor_t *io_actor; /* owns the DEALER, if FNCS_IO_THREAD */
+        zsock_t *grant_cast; /* SUB for grants sent once per round, see GRANT_CAST */
+        unsigned long long cast_seq; /* the last one received on it */
+        unsigned long long cast_fence; /* sent on it before the next grant */
+        bool grant_held; /* the grant came, but not all it follows */
+        zsock_t *direct; /* PULL for PUBLISHes sent directly, see FNCS_DIRECT */
+        unsigned long long direct_received; /* on it or data so far ... */
+        unsigned long long direct_fence; /* ... and before the next grant */
+        vector<zsock_t*> direct_peers; /* PUSH to each subscriber sent directly */
+        map<string,DirectRoute> direct_routes; /* by the frame of the topic */
+        zsock_t *data; /* DEALER for the values the broker sends, see DATA */
+        zsock_t *pull; /* DEALER the values it pulls are fetched with, see PULL */
+        fncs::TopicFilter subscribed; /* topics of any sim, see SUBSCRIBED ... */
+        bool anon_filtered; /* ... if the broker sent them */
+        vector<fncs::Key> events; /* cache slots updated this step */
+        vector<fncs::Key> changed; /* of those, each once and ascending, prioritized first */
+        vector<fncs::Key> changed_rest; /* reused by note_changes() */
+        bool prioritized; /* some slot has a priority */
+        vector<Listener> any_listeners; /* see on_any_update() */
+        fncs::TopicTable publish_slots; /* published key to publish_topics index */
+        vector<PublishTopic> publish_topics; /* keys other sims subscribed to */
+        vector<PublishPattern> publish_patterns; /* key patterns they subscribed to */
+        vector<string> mykeys; /* keys from the fncs config file */
+        cache_t cache; /* one slot per subscribed key */
+        ValueArena arena; /* the list values of the step, see ValueArena */
+        fncs::TopicTable key_slots; /* key to index in cache */
+        fncs::TopicTable topics; /* subscribed topic to cache slot */
+        vector<fncs::TopicTable::Entry> topic_patterns; /* subscribed patterns */
+        fncs::TopicIntern route_nodes; /* from and to of routed keys, see get_routed() */
+        string route_key; /* built by route(), keeping its capacity */
+        vector<string> members; /* of a compound federate, ascending, see publish_member() */
+        Staging *staged; /* handed over by the I/O thread */
+};
+
+static fncs::ClientState default_state;
+static fncs::ClientState *current = &default_state;
+
+static const string* value_coded(const char *data, size_t size)
+{
+    if (!current->dictionary_on) {
+        return NULL;
+    }
+    return current->dictionary.lookup(data, size);
+}
+
+/* A value of at least FNCS_BLOB_THRESHOLD bytes is written to a file in
+ * FNCS_BLOB_DIR and only its path travels through the broker. A sim
+ * receiving the handle hard links the file under its own name, so the
+ * value outlives the publisher's copy, and reads it when the value is
+ * first asked for. The publisher removes its files two time requests
+ * after sending them, once every subscriber has been granted past them,
+ * and every sim removes what is left when it leaves. */
+static string blob_path()
+{
+    ostringstream os;
+#if defined(_WIN32)
+    os << current->blob_dir << "\\fncs-" << current->simulation_name
+        << '-' << _getpid() << '-' << current->blob_count++ << ".blob";
+#else
+    os << current->blob_dir << "/fncs-" << current->simulation_name
+        << '-' << getpid() << '-' << current->blob_count++ << ".blob";
+#endif
+    return os.str();
+}
+
+static bool blob_handle(const char *data, size_t size, string &path)
+{
+    if (size < 3 || data[0] != '\0' || data[1] != fncs::VALUE_BLOB) {
+        return false;
+    }
+    path.assign(data + 2, size - 2);
+    return true;
+}
+
+/* the handle to send in place of value, or value itself on error */
+static string blob_store(const string &value)
+{
+    string path = blob_path();
+    ofstream fout(path.c_str(), ios::out | ios::binary | ios::trunc);
+    fout.write(value.data(), value.size());
+    fout.close();
+    if (!fout) {
+        LWARNING << "could not write blob '" << path << "', sending the value";
+        remove(path.c_str());
+        return value;
+    }
+    current->blobs_written.push_back(path);
+    string handle(2, '\0');
+    handle[1] = static_cast<char>(fncs::VALUE_BLOB);
+    return handle + path;
+}
+
+/* link the publisher's file under this sim's name; empty on error */
+static string blob_adopt(const string &path)
+{
+    string own = blob_path();
+#if defined(_WIN32)
+    bool linked = (0 != CreateHardLinkA(own.c_str(), path.c_str(), NULL));
+#else
+    bool linked = (0 == link(path.c_str(), own.c_str()));
+#endif
+    if (!linked) {
+        LERROR << "could not link blob '" << path << "'";
+        return string();
+    }
+    return own;
+}
+
+static bool blob_read(const string &path, string &value)
+{
+    ifstream fin(path.c_str(), ios::in | ios::binary);
+    if (fin) {
+        fin.seekg(0, ios::end);
+        value.resize(static_cast<size_t>(fin.tellg()));
+        fin.seekg(0, ios::beg);
+        fin.read(&value[0], value.size());
+    }
+    if (!fin) {
+        LERROR << "could not read blob '" << path << "'";
+        return false;
+    }
+    return true;
+}
+
+/* drop the blob files sent two requests ago */
+static void blob_rotate()
+{
+    for (size_t i=0; i<current->blobs_older.size(); ++i) {
+        remove(current->blobs_older[i].c_str());
+    }
+    current->blobs_older.swap(current->blobs_previous);
+    current->blobs_previous.swap(current->blobs_written);
+    current->blobs_written.clear();
+}
+
+/* A received list value as text, read at once from its blob if any,
+ * decompressed, and applied to base, the topic's last value, if it is a
+ * delta. False for a delta made against another value. */
+static bool list_value(const char *data, size_t size, string &base, string &text)
+{
+    string path;
+    string value;
+    if (blob_handle(data, size, path)) {
+        blob_read(path, value);
+        return list_value(value.data(), value.size(), base, text);
+    }
+    if (value_packed(data, size)) {
+        value_unpack(data, size, value);
+        return list_value(value.data(), value.size(), base, text);
+    }
+    if (fncs::delta_frame(data, size)) {
+        if (!fncs::delta_apply(base, data, size)) {
+            return false;
+        }
+        text = fncs::value_to_string(base.data(), base.size());
+        return true;
+    }
+    text = fncs::value_to_string(data, size);
+    return true;
+}
+
+/* Append a received list value to the arena as text: a plain value as
+ * it came, others through list_value(), with the base of the topic if
+ * it is a delta. False for a delta made against another value. */
+static bool list_add(ValueArena &arena, const char *data, size_t size,
+        map<string,string> &bases, const string &topic, ListEntry &added)
+{
+    string text;
+    if (size && data[0] == '\0') {
+        const string *coded = value_coded(data, size);
+        if (coded) {
+            data = coded->data();
+            size = coded->size();
+        }
+        else if (fncs::bytes_frame(data, size)) {
+            data += 2;
+            size -= 2;
+        }
+        else if (list_value(data, size, bases[topic], text)) {
+            data = text.data();
+            size = text.size();
+        }
+        else {
+            return false;
+        }
+    }
+    added = ListEntry(arena.append(data, size), size);
+    return true;
+}
 
-typedef map<string,vector<string> > clist_t;
-static clist_t cache_list;
+/* shared by all states, as is the zmq context of czmq */
+static int n_clients = 0; /* connections open in this process */
+static bool logging_started = false;
+
+/* the slot of the given key, created on first use */
+static size_t cache_slot(const string &key)
+{
+    const fncs::TopicTable::Entry *entry = current->key_slots.find(key);
+    if (entry) {
+        return entry->slot;
+    }
+    current->key_slots.insert(key, current->cache.size(), false);
+    current->cache.push_back(CacheSlot());
+    current->cache.back().key = key;
+    return current->cache.size() - 1;
+}
+
+/* Size the kernel buffers of a socket to the broker from FNCS_SNDBUF and
+ * FNCS_RCVBUF, in bytes, as the broker sizes its own; across nodes on a
+ * fast fabric larger ones move more per system call. Before it connects. */
+static void socket_buffers(zsock_t *sock)
+{
+    const char *env_sndbuf = getenv("FNCS_SNDBUF");
+    const char *env_rcvbuf = getenv("FNCS_RCVBUF");
+    if (env_sndbuf) {
+        zsock_set_sndbuf(sock, atoi(env_sndbuf));
+    }
+    if (env_rcvbuf) {
+        zsock_set_rcvbuf(sock, atoi(env_rcvbuf));
+    }
+}
 
-typedef map<string,fncs::Subscription> sub_string_t;
-static sub_string_t subs_string;
 
 
 #if defined(_WIN32)
@@ -108,1452 +982,6866 @@ static void signal_handler_reset()
 }
 #endif
 
-#if 0
-static inline string nodetype(const YAML::Node &node) {
-    if (node.Type() == YAML::NodeType::Scalar) { return "SCALAR"; } 
-    else if (node.Type() == YAML::NodeType::Sequence) { return "SEQUENCE"; } 
-    else if (node.Type() == YAML::NodeType::Map) { return "MAP"; } 
-    else { return "ERROR"; }
-}
-#endif
-
-static inline bool EndsWith(const string& a, const string& b) {
-    if (b.size() > a.size()) return false;
-    return std::equal(a.begin() + a.size() - b.size(), a.end(), b.begin());
+/* send the value to the key's subscribers that take it directly */
+static void send_direct(DirectRoute &route, const string &value)
+{
+    for (size_t i=0; i<route.peers.size(); ++i) {
+        zsock_t *peer = current->direct_peers[route.peers[i]];
+        fncs::send_type(peer, fncs::MSG_PUBLISH, true, true);
+        zmq_send(zsock_resolve(peer), route.topic.data(), route.topic.size(), ZMQ_SNDMORE);
+        zmq_send(zsock_resolve(peer), value.data(), value.size(), 0);
+    }
+    ++route.n_sent;
 }
 
-
-void fncs::start_logging()
+/* Tell the broker how many values went to subscribers directly since the
+ * last time request, as pairs of 4 byte little-endian topic ID and count,
+ * so that it accounts for them as for the values it forwards. */
+static void send_direct_counts()
 {
-    const char *fncs_log_filename = NULL;
-    const char *fncs_log_stdout = NULL;
-    const char *fncs_log_file = NULL;
-    const char *fncs_log_level = NULL;
-    string simlog = simulation_name + ".log";
-    bool log_file = false;
-    bool log_stdout = true;
-
-    /* name for fncs log file from environment */
-    fncs_log_filename = getenv("FNCS_LOG_FILENAME");
-    if (!fncs_log_filename) {
-        if (simulation_name.empty()) {
-            /* assume it's the broker */
-            fncs_log_filename = "fncs_broker.log";
+    string counts;
+    for (map<string,DirectRoute>::iterator it=current->direct_routes.begin();
+            it!=current->direct_routes.end(); ++it) {
+        DirectRoute &route = it->second;
+        if (!route.n_sent) {
+            continue;
         }
-        else {
-            fncs_log_filename = simlog.c_str();
+        for (int j=0; j<4; ++j) {
+            counts.push_back(static_cast<char>((route.id >> (8*j)) & 0xFF));
+        }
+        for (int j=0; j<4; ++j) {
+            counts.push_back(static_cast<char>((route.n_sent >> (8*j)) & 0xFF));
         }
+        route.n_sent = 0;
     }
-
-    /* whether to echo to stdout from environment */
-    fncs_log_stdout = getenv("FNCS_LOG_STDOUT");
-    if (!fncs_log_stdout) {
-        fncs_log_stdout = "yes";
+    if (counts.empty()) {
+        return;
     }
+    fncs::send_type(current->client, fncs::MSG_DIRECT_COUNTS, current->binary_protocol, true);
+    zmq_send(zsock_resolve(current->client), counts.data(), counts.size(), 0);
+}
 
-    /* whether to enable logging at all from environment */
-    fncs_log_file = getenv("FNCS_LOG_FILE");
-    if (!fncs_log_file) {
-        fncs_log_file = "no";
+/* Connect to the subscribers the broker planned for the published keys
+ * in the ACK: a line per subscriber, "P <order ID> <endpoint>", then a
+ * line per key, "K <key index> <relay> <order ID>...", the key indexes
+ * being those of the ACK's keys and topic IDs. */
+static bool parse_direct_plan(const string &plan,
+        const vector<string> &published_keys, const vector<size_t> &topic_ids)
+{
+    istringstream lines(plan);
+    string line;
+    map<size_t,size_t> peer_of; /* order ID to index in direct_peers */
+    while (getline(lines, line)) {
+        istringstream fields(line);
+        string kind;
+        fields >> kind;
+        if ("P" == kind) {
+            size_t order = 0;
+            string endpoint;
+            if (!(fields >> order >> endpoint)) {
+                return false;
+            }
+            zsock_t *peer = zsock_new(ZMQ_PUSH);
+            if (!peer) {
+                return false;
+            }
+            /* a value is never dropped for a slow subscriber */
+            zsock_set_sndhwm(peer, 0);
+            if (zsock_attach(peer, fncs::resolve_endpoints(endpoint).c_str(), false)) {
+                zsock_destroy(&peer);
+                return false;
+            }
+            peer_of[order] = current->direct_peers.size();
+            current->direct_peers.push_back(peer);
+        }
+        else if ("K" == kind) {
+            size_t k = 0;
+            size_t order = 0;
+            DirectRoute route;
+            if (!(fields >> k >> route.relay) || k >= published_keys.size()
+                    || k >= topic_ids.size() || topic_ids[k] == fncs::NO_TOPIC_ID) {
+                return false;
+            }
+            while (fields >> order) {
+                if (!peer_of.count(order)) {
+                    return false;
+                }
+                route.peers.push_back(peer_of[order]);
+            }
+            route.topic = current->simulation_name + '/' + published_keys[k];
+            route.id = topic_ids[k];
+            current->direct_routes[fncs::encode_topic_id(route.id)] = route;
+            LDEBUG2C(logCONFIG) << route.topic << " goes to " << route.peers.size()
+                << " subscriber(s) directly";
+        }
     }
+    return true;
+}
 
-    /* whether to enable logging at all from environment */
-    fncs_log_level = getenv("FNCS_LOG_LEVEL");
-    if (!fncs_log_level) {
-        fncs_log_level = "WARNING";
+/* send one PUBLISH, or gather it into the batch if batching; the topic
+ * may be its ID, see PublishTopic */
+static void send_publish(const string &topic, const string &value)
+{
+    if (current->request_pending) {
+        /* the broker would stamp it with the previous grant */
+        LERROR << "cannot publish '" << topic << "' while a time request is pending";
+        fncs::die();
+        return;
     }
-
-    /* start our logger */
-    if (fncs_log_stdout[0] == 'N'
-            || fncs_log_stdout[0] == 'n'
-            || fncs_log_stdout[0] == 'F'
-            || fncs_log_stdout[0] == 'f') {
-        log_stdout = false;
+    string packed;
+    string handle;
+    const string *frame = &value;
+    /* a value that only looks compressed is sent as bytes */
+    if (value_packed(value.data(), value.size())) {
+        packed = fncs::encode_bytes(value.data(), value.size());
+        frame = &packed;
     }
-
-    if (fncs_log_file[0] == 'Y'
-            || fncs_log_file[0] == 'y'
-            || fncs_log_file[0] == 'T'
-            || fncs_log_file[0] == 't') {
-        log_file = true;
+    /* values sent to a peer directly may overtake the codes the broker
+     * sends it */
+    if (current->dictionary_on && !current->dictionary.empty()
+            && (current->direct_routes.empty() || !current->direct_routes.count(topic))) {
+        const string *coded = current->dictionary.frame(value);
+        if (coded) {
+            frame = coded;
+        }
     }
-
-    if (log_stdout && log_file) {
-        FILE *pFile = fopen(fncs_log_filename, "a");
-        if (!pFile) {
-            cerr << "could not open " << fncs_log_filename << endl;
+    if (current->compress_threshold && current->compression
+            && value.size() >= current->compress_threshold) {
+        string compressed = value_pack(value);
+        if (!compressed.empty()) {
+            packed.swap(compressed);
+            frame = &packed;
         }
-        Output2Tee::Stream1() = stdout;
-        Output2Tee::Stream2() = pFile;
     }
-    else if (log_stdout) {
-        Output2Tee::Stream1() = stdout;
-        Output2Tee::Stream2() = NULL;
+    /* subscribers that do not speak binary could not read a handle */
+    if (current->blob_threshold && current->binary_protocol
+            && frame->size() >= current->blob_threshold) {
+        handle = blob_store(*frame);
+        frame = &handle;
     }
-    else if (log_file) {
-        FILE *pFile = fopen(fncs_log_filename, "a");
-        if (!pFile) {
-            cerr << "could not open " << fncs_log_filename << endl;
+    FNCS_PROBE3(publish, static_cast<const void*>(topic.data()), topic.size(),
+            frame->size());
+    if (!current->direct_routes.empty()) {
+        map<string,DirectRoute>::iterator it = current->direct_routes.find(topic);
+        if (it != current->direct_routes.end()) {
+            send_direct(it->second, *frame);
+            if (!it->second.relay) {
+                return;
+            }
         }
-        Output2Tee::Stream1() = pFile;
-        Output2Tee::Stream2() = NULL;
     }
-
-    FNCSLog::ReportingLevel() = FNCSLog::FromString(fncs_log_level);
+    if (current->publish_batching) {
+        if (!current->publish_batch) {
+            current->publish_batch = zmsg_new();
+        }
+        zmsg_addmem(current->publish_batch, topic.data(), topic.size());
+        zmsg_addmem(current->publish_batch, frame->data(), frame->size());
+        return;
+    }
+    fncs::send_type(current->client, fncs::MSG_PUBLISH, current->binary_protocol, true);
+    /* a topic ID and a typed value may hold NUL bytes */
+    zmq_send(zsock_resolve(current->client), topic.data(), topic.size(), ZMQ_SNDMORE);
+    zmq_send(zsock_resolve(current->client), frame->data(), frame->size(), 0);
 }
 
-
-void fncs::replicate_logging(TLogLevel &level, FILE *& one, FILE *& two)
+/* Hold the value until the next time request, replacing any value held
+ * for the same topic. Only for keys no subscriber keeps as a list. */
+static void coalesce_publish(const string &topic, const string &value)
 {
-    level = FNCSLog::ReportingLevel();
-    one = Output2Tee::Stream1();
-    two = Output2Tee::Stream2();
+    map<string,size_t>::iterator it;
+    if (current->request_pending) {
+        /* the broker would stamp it with the previous grant */
+        LERROR << "cannot publish '" << topic << "' while a time request is pending";
+        fncs::die();
+        return;
+    }
+    it = current->coalesced_index.find(topic);
+    if (it != current->coalesced_index.end()) {
+        current->coalesced[it->second].second = value;
+        return;
+    }
+    current->coalesced_index[topic] = current->coalesced.size();
+    current->coalesced.push_back(make_pair(topic, value));
 }
 
+static void publish_now(fncs::Key key, const string &value);
+static fncs::Key pattern_key(const string &key);
 
-/* This version of initialize() checks for a config filename in the
- * environment and then defaults to a known name. */
-void fncs::initialize()
+/* send all queued, held and gathered publishes, the latter as one
+ * PUBLISH_BATCH */
+static void flush_publish_batch()
 {
-    const char *fncs_config_file = NULL;
-    zconfig_t *zconfig = NULL;
-    fncs::Config config;
-
-    /* name for fncs config file from environment */
-    fncs_config_file = getenv("FNCS_CONFIG_FILE");
-    if (!fncs_config_file) {
-        fncs_config_file = "fncs.zpl";
-    }
-
-    if (EndsWith(fncs_config_file, "zpl")) {
-        zconfig = zconfig_load(fncs_config_file);
-        if (zconfig) {
-            config = parse_config(zconfig);
-            zconfig_destroy(&zconfig);
+    blob_rotate();
+    if (current->publish_threads) {
+        vector<pair<fncs::Key,string> > queued;
+        vector<pair<string,string> > queued_keys;
+        {
+            fncs::MutexLock lock(current->threaded_mutex);
+            queued.swap(current->threaded);
+            queued_keys.swap(current->threaded_keys);
         }
-        else {
-            cerr << "could not open " << fncs_config_file << endl;
+        for (size_t i=0; i<queued.size(); ++i) {
+            publish_now(queued[i].first, queued[i].second);
+        }
+        for (size_t i=0; i<queued_keys.size(); ++i) {
+            publish_now(pattern_key(queued_keys[i].first), queued_keys[i].second);
         }
     }
-    else if (EndsWith(fncs_config_file, "yaml")) {
-        try {
-            ifstream fin(fncs_config_file);
-            YAML::Parser parser(fin);
-            YAML::Node doc;
-            parser.GetNextDocument(doc);
-            config = parse_config(doc);
-        } catch (YAML::ParserException &) {
-            cerr << "could not open " << fncs_config_file << endl;
+    if (!current->coalesced.empty()) {
+        for (size_t i=0; i<current->coalesced.size(); ++i) {
+            send_publish(current->coalesced[i].first, current->coalesced[i].second);
         }
+        current->coalesced.clear();
+        current->coalesced_index.clear();
     }
-    else {
-        cerr << "fncs config file must end in *.zpl or *.yaml" << endl;
+    if (!current->publish_batch) {
+        return;
     }
-
-    initialize(config);
+    LDEBUG4C(logPUBLISH) << "sending PUBLISH_BATCH of "
+        << zmsg_size(current->publish_batch)/2 << " values";
+    fncs::send_type(current->client, fncs::MSG_PUBLISH_BATCH, current->binary_protocol, true);
+    zmsg_send(&current->publish_batch, current->client);
 }
 
-
-/* This version of initialize() reads configuration parameters directly
- * from the given string. */
-void fncs::initialize(const string &configuration)
+/* the first subscribed pattern the topic matches, or NULL; patterns
+ * are few, and only topics no exact subscription wants are matched */
+static const fncs::TopicTable::Entry* match_pattern(
+        const vector<fncs::TopicTable::Entry> &patterns, const string &topic)
 {
-    zchunk_t *zchunk = NULL;
-    zconfig_t *zconfig = NULL;
-    fncs::Config config;
-
-    config = parse_config(configuration);
-
-    initialize(config);
+    for (size_t i=0; i<patterns.size(); ++i) {
+        if (fncs::glob_match(patterns[i].topic, topic)) {
+            return &patterns[i];
+        }
+    }
+    return NULL;
 }
 
-
-void fncs::initialize(Config config)
+/* The cache slot of a topic matched by a pattern that is not a list: it
+ * gets a key of its own, named after the topic, when first seen. */
+static size_t topic_slot(const string &topic)
 {
-    const char *env_fatal = NULL;
-    const char *env_name = NULL;
-    const char *env_broker = NULL;
-    const char *env_time_delta = NULL;
-    int rc;
-    zmsg_t *msg = NULL;
-    zchunk_t *zchunk = NULL;
-    zconfig_t *config_values = NULL;
-
-    /* name from env var overrides config file */
-    env_name = getenv("FNCS_NAME");
-    if (env_name) {
-        config.name = env_name;
-    }
-    else if (config.name.empty()) {
-        cerr << "FNCS_NAME env var not set and" << endl;
-        cerr << "fncs config does not contain 'name'" << endl;
-        die();
-        return;
+    const fncs::TopicTable::Entry *entry = current->key_slots.find(topic);
+    if (entry) {
+        return entry->slot;
     }
-    simulation_name = config.name;
-
-    fncs::start_logging();
+    size_t index = cache_slot(topic);
+    current->cache[index].in_cache = true;
+    current->mykeys.push_back(topic);
+    return index;
+}
 
-    /* whether die() should exit() */
-    env_fatal = getenv("FNCS_FATAL");
-    if (env_fatal) {
-        config.fatal = env_fatal;
-        LINFO << "fatal set by FNCS_FATAL env var";
+/* store a received topic value, taken straight from its frames, in the
+ * cache; the slot's string keeps its capacity from step to step */
+static void cache_publish(zframe_t *topic, zframe_t *value)
+{
+    const char *topic_data = reinterpret_cast<const char*>(zframe_data(topic));
+    const char *value_data = reinterpret_cast<const char*>(zframe_data(value));
+    size_t id = 0;
+    bool by_id = fncs::decode_topic_id(topic_data, zframe_size(topic), id);
+    const fncs::TopicTable::Entry *entry = by_id ? current->topics.find_id(id)
+        : current->topics.find(topic_data, zframe_size(topic));
+    string matched; /* the topic, if only a pattern wants it */
+
+    FNCS_PROBE3(receive, static_cast<const void*>(topic_data), zframe_size(topic),
+            zframe_size(value));
+    if (!entry && !by_id && !current->topic_patterns.empty()) {
+        matched.assign(topic_data, zframe_size(topic));
+        entry = match_pattern(current->topic_patterns, matched);
     }
-    else if (config.fatal.empty()) {
-        LINFO << "FNCS_FATAL env var not set and fncs config does not contain 'fatal'";
-        LINFO << "defaulting to " << default_fatal;
-        config.fatal = default_fatal;
+
+    /* if found then store in cache */
+    if (entry && matched.empty() && current->cache[entry->slot].unsubscribed) {
+        LDEBUG4C(logCACHE) << "dropping PUBLISH message of unsubscribed topic='"
+            << entry->topic << "'";
     }
-    {
-        char fc = config.fatal[0];
-        if (fc == 'N' || fc == 'n' || fc == 'F' || fc == 'f') {
-            die_is_fatal = false;
-            LINFO << "fncs::die() will not call exit()";
+    else if (entry) {
+        const string &name = matched.empty() ? entry->topic : matched;
+        size_t index = matched.empty() || entry->is_list ?
+            entry->slot : topic_slot(matched);
+        CacheSlot &slot = current->cache[index];
+        ListEntry added;
+        if (entry->is_list && !list_add(current->arena, value_data, zframe_size(value),
+                    current->list_bases, name, added)) {
+            LDEBUG4C(logCACHE) << "dropped a delta for topic '" << name
+                << "' until the next keyframe";
+            return;
         }
-        else {
-            die_is_fatal = true;
-            LINFO << "fncs::die() will call exit(EXIT_FAILURE)";
+        current->events.push_back(index);
+        if (entry->is_list) {
+            slot.entries.push_back(added);
+            slot.listed = false;
+            LDEBUG4C(logCACHE) << "updated cache_list "
+                << "key='" << slot.key << "' "
+                << "topic='" << name << "' "
+                << "value='" << current->arena.at(added.offset) << "' "
+                << "count=" << slot.entries.size();
+        } else {
+            slot.value.assign(value_data, zframe_size(value));
+            slot.received();
+            LDEBUG4C(logCACHE) << "updated cache "
+                << "key='" << slot.key << "' "
+                << "topic='" << name << "' "
+                << "value='" << slot.text() << "' ";
         }
     }
-
-    /* broker location from env var overrides config file */
-    env_broker = getenv("FNCS_BROKER");
-    if (env_broker) {
-        LINFO << "FNCS_BROKER env var sets the broker endpoint location";
-        config.broker = env_broker;
-    } else if (config.broker.empty()) {
-        LINFO << "FNCS_BROKER env var not set and fncs config does not contain 'broker'" << endl;
-        LINFO << "defaulting to " << default_broker;
-        config.broker = default_broker;
+    else {
+        LDEBUG4C(logCACHE) << "dropping PUBLISH message topic='"
+            << fncs::to_string(topic) << "'";
     }
-    LDEBUG << "broker = " << config.broker;
+}
 
-    /* time_delta from env var is tried first */
-    env_time_delta = getenv("FNCS_TIME_DELTA");
-    if (env_time_delta) {
-        LINFO << "FNCS_TIME_DELTA env var sets the time_delta";
-        config.time_delta = env_time_delta;
-    } else if (config.time_delta.empty()) {
-        LINFO << "FNCS_TIME_DELTA env var not set and fncs config does not contain 'time_delta'" << endl;
-        LINFO << "defaulting to " << default_time_delta;
-        config.time_delta = default_time_delta;
-    }
-    LDEBUG << "time_delta string = " << config.time_delta;
-    time_delta = parse_time(config.time_delta);
-    LDEBUG << "time_delta = " << time_delta;
-    time_delta_multiplier = time_unit_to_multiplier(config.time_delta);
-    LDEBUG << "time_delta_multiplier = " << time_delta_multiplier;
+/* Values received by the I/O thread for the coming grant, resolved to
+ * cache slots off the critical path. The topic table, the patterns and
+ * the slots of subscriptions are not modified after initialize(), so the
+ * I/O thread reads them without locking; the slot of a topic matched by
+ * a pattern may still have to be made, which is left to apply(). */
+class Staging {
+    public:
+        Staging(const fncs::TopicTable &topics,
+                const vector<fncs::TopicTable::Entry> &patterns,
+                map<string,string> &bases)
+            : n_messages(0), n_values(0), bytes(0)
+            , topics(&topics), patterns(&patterns), bases(&bases)
+            , values(), arena(), lists(), named(), slots() {}
+
+        void add(zframe_t *topic, zframe_t *value) {
+            ++n_values;
+            bytes += zframe_size(value);
+            const char *topic_data = reinterpret_cast<const char*>(zframe_data(topic));
+            const char *value_data = reinterpret_cast<const char*>(zframe_data(value));
+            size_t id = 0;
+            FNCS_PROBE3(receive, static_cast<const void*>(topic_data), zframe_size(topic),
+                    zframe_size(value));
+            bool by_id = fncs::decode_topic_id(topic_data, zframe_size(topic), id);
+            const fncs::TopicTable::Entry *entry = by_id ? topics->find_id(id)
+                : topics->find(topic_data, zframe_size(topic));
+            string matched;
+            if (!entry && !by_id && !patterns->empty()) {
+                matched.assign(topic_data, zframe_size(topic));
+                entry = match_pattern(*patterns, matched);
+            }
+            if (!entry) {
+                return;
+            }
+            if (entry->is_list) {
+                ListEntry added;
+                if (!list_add(arena, value_data, zframe_size(value), *bases,
+                            matched.empty() ? entry->topic : matched, added)) {
+                    return; /* until the next keyframe */
+                }
+                lists.push_back(make_pair(entry->slot, added));
+            }
+            else if (!matched.empty()) {
+                named.push_back(make_pair(matched, string(value_data, zframe_size(value))));
+                return;
+            }
+            else {
+                values[entry->slot].assign(value_data, zframe_size(value));
+            }
+            slots.push_back(entry->slot);
+        }
 
-    /* parse subscriptions */
-    {
-        vector<Subscription> subs = config.values;
-        for (size_t i=0; i<subs.size(); ++i) {
-            subs_string.insert(make_pair(subs[i].topic, subs[i]));
-            mykeys.push_back(subs[i].key);
-            LDEBUG2 << "initializing cache for '" << subs[i].key << "'='"
-                << subs[i].def << "'";
-            if (subs[i].is_list()) {
-                if (subs[i].def.empty()) {
-                    cache_list[subs[i].key] = vector<string>();
+        /* Swap the staged values into the cache. events and the lists
+         * were cleared by the time request, so swapping whole containers
+         * replaces copying their contents; the arena staged while the
+         * sim read the last step's becomes the cache's. */
+        void apply() {
+            current->stats.n_messages += n_messages;
+            current->stats.n_values += n_values;
+            current->stats.bytes_received += bytes;
+            for (map<size_t,string>::iterator it=values.begin();
+                    it!=values.end(); ++it) {
+                current->cache[it->first].value.swap(it->second);
+                current->cache[it->first].received();
+            }
+            if (!lists.empty()) {
+                vector<char> &bytes = current->arena.bytes;
+                size_t base = bytes.size();
+                if (0 == base) {
+                    bytes.swap(arena.bytes);
                 }
                 else {
-                    cache_list[subs[i].key] = vector<string>(1, subs[i].def);
+                    bytes.insert(bytes.end(), arena.bytes.begin(), arena.bytes.end());
                 }
+                for (size_t i=0; i<lists.size(); ++i) {
+                    CacheSlot &slot = current->cache[lists[i].first];
+                    slot.entries.push_back(ListEntry(
+                                base + lists[i].second.offset, lists[i].second.size));
+                    slot.listed = false;
+                }
+            }
+            if (current->events.empty()) {
+                current->events.swap(slots);
             }
             else {
-                cache[subs[i].key] = subs[i].def;
+                current->events.insert(current->events.end(), slots.begin(), slots.end());
+            }
+            for (size_t i=0; i<named.size(); ++i) {
+                size_t index = topic_slot(named[i].first);
+                current->cache[index].value.swap(named[i].second);
+                current->cache[index].received();
+                current->events.push_back(index);
             }
         }
-        if (subs.empty()) {
-            LDEBUG2 << "config did not contain any subscriptions";
+
+        bool empty() const { return slots.empty() && named.empty(); }
+
+        /* the arena grows to the last step's size at once */
+        size_t arena_size() const { return arena.bytes.size(); }
+
+        void reserve(size_t size) { arena.bytes.reserve(size); }
+
+        /* counted for the stats, whether or not a value is kept */
+        unsigned long long n_messages;
+        unsigned long long n_values;
+        unsigned long long bytes;
+
+    private:
+        const fncs::TopicTable *topics; /* of the state that started the thread */
+        const vector<fncs::TopicTable::Entry> *patterns; /* its topic_patterns */
+        map<string,string> *bases; /* its list_bases, the thread's alone */
+        map<size_t,string> values; /* last value per non-list slot */
+        ValueArena arena; /* of the list values */
+        vector<pair<size_t,ListEntry> > lists; /* list slots and values, in arrival order */
+        vector<pair<string,string> > named; /* topics and values awaiting a slot */
+        vector<fncs::Key> slots; /* becomes events */
+};
+
+
+/* marks a pipe message from the I/O thread carrying a Staging pointer */
+static const char * const STAGED = "$STAGED";
+
+/* what the I/O thread is started with; the thread reads it before it
+ * signals, so it may live on the caller's stack */
+struct IoThreadArgs {
+    zsock_t *dealer;
+    const fncs::TopicTable *topics;
+    const vector<fncs::TopicTable::Entry> *patterns;
+    map<string,string> *bases;
+    fncs::time spin; /* FNCS_POLL */
+};
+
+/* The client I/O thread. It owns the DEALER socket: messages from the
+ * pipe are sent on to the broker, and PUBLISHes from the broker are
+ * staged. Just before a grant, the staged values are handed over on the
+ * pipe; everything else is passed through unchanged. */
+static void io_thread(zsock_t *pipe, void *args)
+{
+    zsock_t *dealer = static_cast<IoThreadArgs*>(args)->dealer;
+    const fncs::TopicTable &topics = *static_cast<IoThreadArgs*>(args)->topics;
+    const vector<fncs::TopicTable::Entry> &patterns =
+        *static_cast<IoThreadArgs*>(args)->patterns;
+    map<string,string> &bases = *static_cast<IoThreadArgs*>(args)->bases;
+    fncs::time spin = static_cast<IoThreadArgs*>(args)->spin;
+    Staging *staging = new Staging(topics, patterns, bases);
+    zmq_pollitem_t items[] = {
+        { zsock_resolve(pipe), 0, ZMQ_POLLIN, 0 },
+        { zsock_resolve(dealer), 0, ZMQ_POLLIN, 0 }
+    };
+
+    zsock_signal(pipe, 0);
+
+    while (true) {
+        if (fncs::spin_poll(items, 2, -1, spin) == -1) {
+            break; /* interrupted */
+        }
+        if (items[0].revents & ZMQ_POLLIN) {
+            zmsg_t *msg = zmsg_recv(pipe);
+            if (!msg) {
+                break;
+            }
+            if (zframe_streq(zmsg_first(msg), "$TERM")) {
+                zmsg_destroy(&msg);
+                break;
+            }
+            zmsg_send(&msg, dealer);
+        }
+        if (items[1].revents & ZMQ_POLLIN) {
+            zmsg_t *msg = zmsg_recv(dealer);
+            zframe_t *frame = NULL;
+            fncs::MessageType message_type;
+            bool complete = true;
+            if (!msg) {
+                break;
+            }
+            frame = zmsg_first(msg);
+            message_type = frame ? fncs::to_type(frame) : fncs::MSG_UNKNOWN;
+            if (fncs::MSG_PUBLISH == message_type
+                    || fncs::MSG_PUBLISH_BATCH == message_type) {
+                /* check first so malformed ones reach the dispatcher */
+                size_t n_frames = zmsg_size(msg);
+                complete = n_frames >= 3 && (n_frames % 2) == 1;
+            }
+            if (complete && (fncs::MSG_PUBLISH == message_type
+                        || fncs::MSG_PUBLISH_BATCH == message_type)) {
+                ++staging->n_messages;
+                for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                    zframe_t *topic = frame;
+                    frame = zmsg_next(msg);
+                    staging->add(topic, frame);
+                }
+                zmsg_destroy(&msg);
+                continue;
+            }
+            if (fncs::MSG_TIME_REQUEST == message_type && zmsg_size(msg) > 4) {
+                /* values that came with the grant, after time, window
+                 * and count, follow those staged before it */
+                zmsg_next(msg);
+                zmsg_next(msg);
+                zmsg_next(msg);
+                ++staging->n_messages;
+                for (frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                    zframe_t *topic = frame;
+                    frame = zmsg_next(msg);
+                    if (!frame) {
+                        break;
+                    }
+                    staging->add(topic, frame);
+                }
+            }
+            if ((fncs::MSG_TIME_REQUEST == message_type
+                        || fncs::MSG_ROLLBACK == message_type) && staging->n_messages) {
+                zmsg_t *handover = zmsg_new();
+                size_t staged_size = staging->arena_size();
+                zmsg_addstr(handover, STAGED);
+                zmsg_addmem(handover, &staging, sizeof(staging));
+                zmsg_send(&handover, pipe);
+                staging = new Staging(topics, patterns, bases);
+                staging->reserve(staged_size);
+            }
+            zmsg_send(&msg, pipe);
         }
     }
 
-    /* create zmq context and client socket */
-    client = zsock_new(ZMQ_DEALER);
-    if (!client) {
-        LERROR << "socket creation failed";
-        die();
-        return;
-    }
-    if (!(zsock_resolve(client) != client)) {
-        LERROR << "socket failed to resolve";
-        die();
-        return;
+    delete staging;
+    zsock_destroy(&dealer);
+}
+
+/* An entry of the exported cache, see fncs::CacheReader. False, adding
+ * nothing, if it does not fit in size bytes. */
+static bool export_entry(string &out, size_t size, const string &key,
+        const char *value, size_t value_size, bool list)
+{
+    unsigned int sizes[2] = {
+        static_cast<unsigned int>(key.size()),
+        static_cast<unsigned int>(value_size | (list ? fncs::CACHE_EXPORT_LIST : 0))
+    };
+    if (out.size() + sizeof(sizes) + key.size() + value_size > size) {
+        return false;
     }
+    out.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    out.append(key);
+    out.append(value, value_size);
+    return true;
+}
 
-    /* reset the signal handler so it chains */
-    signal_handler_reset();
+/* Rewrite the exported cache as of the grant. The entries are built
+ * first, so readers are held off only while they are copied in, and
+ * only if a value changed or a list's values of the last step must go. */
+static void export_cache(fncs::time time_granted)
+{
+    fncs::CacheSegment &segment = *current->cache_export;
+    size_t size = segment.size - fncs::CACHE_EXPORT_HEADER;
+    bool rewrite = !current->events.empty() || current->exported_lists
+        || 0 == segment.get(32);
+    unsigned long long n_entries = segment.get(40);
+    unsigned long long flags = segment.get(56);
+
+    if (rewrite) {
+        string &out = current->exported;
+        out.clear();
+        n_entries = 0;
+        flags &= ~fncs::CACHE_EXPORT_TRUNCATED;
+        current->exported_lists = false;
+        for (size_t i=0; i<current->cache.size(); ++i) {
+            CacheSlot &slot = current->cache[i];
+            bool fits = true;
+            if (slot.in_list) {
+                for (size_t j=0; j<slot.entries.size(); ++j) {
+                    if (export_entry(out, size, slot.key,
+                                current->arena.at(slot.entries[j].offset),
+                                slot.entries[j].size, true)) {
+                        current->exported_lists = true;
+                        ++n_entries;
+                    }
+                    else {
+                        fits = false;
+                    }
+                }
+            }
+            else if (slot.in_cache) {
+                const string &value = slot.text();
+                if (export_entry(out, size, slot.key, value.data(), value.size(), false)) {
+                    ++n_entries;
+                }
+                else {
+                    fits = false;
+                }
+            }
+            if (!fits) {
+                flags |= fncs::CACHE_EXPORT_TRUNCATED;
+            }
+        }
+        if (flags & fncs::CACHE_EXPORT_TRUNCATED) {
+            LDEBUG2C(logCACHE) << "FNCS_CACHE_EXPORT_SIZE is too small for the whole cache";
+        }
+    }
 
-    /* set client identity */
-    rc = zmq_setsockopt(zsock_resolve(client), ZMQ_IDENTITY, config.name.c_str(), config.name.size());
-    if (rc) {
-        LERROR << "socket identity failed";
-        die();
-        return;
+    unsigned long long sequence = segment.sequence();
+    segment.set_sequence(sequence + 1);
+    fncs::cache_export_fence();
+    segment.put(24, time_granted);
+    segment.put(32, segment.get(32) + 1);
+    if (rewrite) {
+        if (!current->exported.empty()) {
+            memcpy(segment.data + fncs::CACHE_EXPORT_HEADER,
+                    current->exported.data(), current->exported.size());
+        }
+        segment.put(40, n_entries);
+        segment.put(48, current->exported.size());
+        segment.put(56, flags);
     }
-    /* finally connect to broker */
-    rc = zsock_attach(client, config.broker.c_str(), false);
-    if (rc) {
-        LERROR << "socket connection to broker failed";
-        die();
+    fncs::cache_export_fence();
+    segment.set_sequence(sequence + 2);
+}
+
+/* tell readers the sim is gone; the segment stays mapped by them */
+static void cache_export_close()
+{
+    fncs::CacheSegment *segment = current->cache_export;
+    if (!segment) {
         return;
     }
+    unsigned long long sequence = segment->sequence();
+    segment->set_sequence(sequence + 1);
+    fncs::cache_export_fence();
+    segment->put(56, segment->get(56) | fncs::CACHE_EXPORT_CLOSED);
+    fncs::cache_export_fence();
+    segment->set_sequence(sequence + 2);
+    delete segment;
+    current->cache_export = NULL;
+    current->exported.clear();
+    current->exported_lists = false;
+}
 
-    /* construct HELLO message; entire config goes with it */
-    msg = zmsg_new();
-    if (!msg) {
-        LERROR << "could not construct HELLO message";
-        die();
-        return;
+/* close the connection, whether or not the I/O thread owns it */
+static void client_destroy()
+{
+    if (current->client) {
+        --n_clients;
     }
-    rc = zmsg_addstr(msg, HELLO);
-    if (rc) {
-        LERROR << "failed to append HELLO to message";
-        die();
-        return;
+    if (current->io_actor) {
+        zactor_destroy(&current->io_actor); /* joins the thread */
+        current->client = NULL;
     }
-    LDEBUG2 << "-- sending configuration as follows --" << endl << config.to_string();
-    rc = zmsg_addstr(msg, config.to_string().c_str());
-    if (rc) {
-        LERROR << "failed to save config for HELLO message";
-        die();
-        return;
+    else {
+        zsock_destroy(&current->client);
     }
-    string version_string;
-    {
-        ostringstream oss;
-        oss << FNCS_VERSION_MAJOR << "." << FNCS_VERSION_MINOR << "." << FNCS_VERSION_PATCH;
-        version_string = oss.str();
+    zsock_destroy(&current->grant_cast);
+    zsock_destroy(&current->direct);
+    for (size_t i=0; i<current->direct_peers.size(); ++i) {
+        zsock_destroy(&current->direct_peers[i]);
     }
-    rc = zmsg_addstr(msg, version_string.c_str());
-    if (rc) {
-        LERROR << "failed to append version to message";
-        die();
-        return;
+    current->direct_peers.clear();
+    current->direct_routes.clear();
+    zsock_destroy(&current->data);
+    zsock_destroy(&current->pull);
+    delete current->agent_pool; /* joins the threads */
+    current->agent_pool = NULL;
+    current->agent_outboxes.clear();
+    cache_export_close();
+    /* a new broker counts from the start */
+    current->cast_seq = 0;
+    current->cast_fence = 0;
+    current->grant_held = false;
+    current->direct_received = 0;
+    current->direct_fence = 0;
+    delete current->staged;
+    current->staged = NULL;
+    for (size_t i=0; i<current->received.size(); ++i) {
+        zmsg_destroy(&current->received[i]);
     }
-    LDEBUG2 << "sending HELLO";
-    rc = zmsg_send(&msg, client);
-    if (rc) {
-        LERROR << "failed to send HELLO message";
-        die();
-        return;
+    current->received.clear();
+    /* every sim said BYE, or this one died: no blob is read again */
+    blob_rotate();
+    blob_rotate();
+    blob_rotate();
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        if (!current->cache[i].blob.empty()) {
+            remove(current->cache[i].blob.c_str());
+            current->cache[i].blob.clear();
+        }
     }
+}
 
-    /* receive ack */
-    msg = zmsg_recv(client);
-    LDEBUG4 << "called zmsg_recv";
-    if (!msg) {
-        LERROR << "null message received";
-        die();
-        return;
-    }
-    /* first frame is type identifier */
-    zframe_t *frame = zmsg_first(msg);
-    if (!zframe_streq(frame, ACK)) {
-        LERROR << "ACK expected, got " << frame;
-        die();
-        return;
-    }
-    LDEBUG2 << "received ACK";
-    /* next frame is connetion order ID */
-    frame = zmsg_next(msg);
-    if (!frame) {
-        LERROR << "ACK message missing order ID";
+#if 0
+static inline string nodetype(const YAML::Node &node) {
+    if (node.Type() == YAML::NodeType::Scalar) { return "SCALAR"; } 
+    else if (node.Type() == YAML::NodeType::Sequence) { return "SEQUENCE"; } 
+    else if (node.Type() == YAML::NodeType::Map) { return "MAP"; } 
+    else { return "ERROR"; }
+}
+#endif
+
+static inline bool EndsWith(const string& a, const string& b) {
+    if (b.size() > a.size()) return false;
+    return std::equal(a.begin() + a.size() - b.size(), a.end(), b.begin());
+}
+
+
+/* a comma separated list of category names, or "all" */
+static unsigned log_categories(const string &names)
+{
+    unsigned categories = 0;
+    istringstream in(names);
+    string name;
+    while (getline(in, name, ',')) {
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name == "all") {
+            categories |= logALL;
+        }
+        else if (name == "config") {
+            categories |= logCONFIG;
+        }
+        else if (name == "time") {
+            categories |= logTIME;
+        }
+        else if (name == "publish") {
+            categories |= logPUBLISH;
+        }
+        else if (name == "cache") {
+            categories |= logCACHE;
+        }
+        else if (!name.empty()) {
+            cerr << "unknown FNCS_LOG_CATEGORIES entry '" << name << "'" << endl;
+        }
+    }
+    return categories;
+}
+
+
+void fncs::start_logging()
+{
+    const char *fncs_log_filename = NULL;
+    const char *fncs_log_stdout = NULL;
+    const char *fncs_log_file = NULL;
+    const char *fncs_log_level = NULL;
+    const char *fncs_log_async = NULL;
+    const char *fncs_log_categories = NULL;
+    string simlog = current->simulation_name + ".log";
+    bool log_file = false;
+    bool log_stdout = true;
+
+    /* name for fncs log file from environment */
+    fncs_log_filename = getenv("FNCS_LOG_FILENAME");
+    if (!fncs_log_filename) {
+        if (current->simulation_name.empty()) {
+            /* assume it's the broker */
+            fncs_log_filename = "fncs_broker.log";
+        }
+        else {
+            fncs_log_filename = simlog.c_str();
+        }
+    }
+
+    /* whether to echo to stdout from environment */
+    fncs_log_stdout = getenv("FNCS_LOG_STDOUT");
+    if (!fncs_log_stdout) {
+        fncs_log_stdout = "yes";
+    }
+
+    /* whether to enable logging at all from environment */
+    fncs_log_file = getenv("FNCS_LOG_FILE");
+    if (!fncs_log_file) {
+        fncs_log_file = "no";
+    }
+
+    /* whether to enable logging at all from environment */
+    fncs_log_level = getenv("FNCS_LOG_LEVEL");
+    if (!fncs_log_level) {
+        fncs_log_level = "WARNING";
+    }
+
+    /* start our logger */
+    if (fncs_log_stdout[0] == 'N'
+            || fncs_log_stdout[0] == 'n'
+            || fncs_log_stdout[0] == 'F'
+            || fncs_log_stdout[0] == 'f') {
+        log_stdout = false;
+    }
+
+    if (fncs_log_file[0] == 'Y'
+            || fncs_log_file[0] == 'y'
+            || fncs_log_file[0] == 'T'
+            || fncs_log_file[0] == 't') {
+        log_file = true;
+    }
+
+    if (log_stdout && log_file) {
+        FILE *pFile = fopen(fncs_log_filename, "a");
+        if (!pFile) {
+            cerr << "could not open " << fncs_log_filename << endl;
+        }
+        Output2Tee::Stream1() = stdout;
+        Output2Tee::Stream2() = pFile;
+    }
+    else if (log_stdout) {
+        Output2Tee::Stream1() = stdout;
+        Output2Tee::Stream2() = NULL;
+    }
+    else if (log_file) {
+        FILE *pFile = fopen(fncs_log_filename, "a");
+        if (!pFile) {
+            cerr << "could not open " << fncs_log_filename << endl;
+        }
+        Output2Tee::Stream1() = pFile;
+        Output2Tee::Stream2() = NULL;
+    }
+
+    FNCSLog::ReportingLevel() = FNCSLog::FromString(fncs_log_level);
+
+    /* which categories of debug lines to log from environment */
+    fncs_log_categories = getenv("FNCS_LOG_CATEGORIES");
+    if (fncs_log_categories) {
+        Output2Tee::Categories() = log_categories(fncs_log_categories);
+    }
+
+    /* whether a background thread writes the log from environment */
+    fncs_log_async = getenv("FNCS_LOG_ASYNC");
+    if (fncs_log_async && (fncs_log_async[0] == 'Y'
+                || fncs_log_async[0] == 'y'
+                || fncs_log_async[0] == 'T'
+                || fncs_log_async[0] == 't')) {
+        fncs::start_async_logging();
+    }
+}
+
+
+void fncs::embedded_broker_started()
+{
+    if (!logging_started) {
+        fncs::start_logging();
+        logging_started = true;
+    }
+    ++n_clients;
+}
+
+
+void fncs::embedded_broker_stopped()
+{
+    --n_clients;
+    if (0 == n_clients) {
+        fncs::stop_async_logging();
+        zsys_shutdown(); /* without this, Windows will hang */
+    }
+}
+
+
+void fncs::replicate_logging(TLogLevel &level, FILE *& one, FILE *& two)
+{
+    level = FNCSLog::ReportingLevel();
+    one = Output2Tee::Stream1();
+    two = Output2Tee::Stream2();
+}
+
+
+void fncs::replicate_logging(TLogLevel &level, FILE *& one, FILE *& two,
+        void (*& sink)(const string &line), unsigned &categories)
+{
+    replicate_logging(level, one, two);
+    sink = Output2Tee::Async();
+    categories = Output2Tee::Categories();
+}
+
+
+/* This version of initialize() checks for a config filename in the
+ * environment and then defaults to a known name. */
+void fncs::initialize()
+{
+    const char *fncs_config_file = NULL;
+    fncs::Config config;
+
+    /* name for fncs config file from environment */
+    fncs_config_file = getenv("FNCS_CONFIG_FILE");
+    if (!fncs_config_file) {
+        fncs_config_file = "fncs.zpl";
+    }
+
+    load_config(fncs_config_file, config);
+
+    initialize(config);
+}
+
+
+bool fncs::load_config(const string &filename, Config &config)
+{
+    const char *fncs_config_file = filename.c_str();
+    zconfig_t *zconfig = NULL;
+
+    /* a compiled config skips parsing altogether */
+    {
+        ifstream fin(fncs_config_file, ios::in | ios::binary);
+        char magic[CONFIG_MAGIC_SIZE];
+        if (fin.read(magic, CONFIG_MAGIC_SIZE)
+                && 0 == memcmp(magic, CONFIG_MAGIC, CONFIG_MAGIC_SIZE-1)) {
+            fin.seekg(0, ios::end);
+            string data(static_cast<size_t>(fin.tellg()), '\0');
+            fin.seekg(0, ios::beg);
+            fin.read(&data[0], data.size());
+            if (!fin || !load_compiled_config(data.data(), data.size(), config)) {
+                cerr << "compiled config " << fncs_config_file
+                    << " is truncated or corrupt" << endl;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    if (EndsWith(fncs_config_file, "zpl")) {
+        zconfig = zconfig_load(fncs_config_file);
+        if (zconfig) {
+            config = parse_config(zconfig);
+            zconfig_destroy(&zconfig);
+        }
+        else {
+            cerr << "could not open " << fncs_config_file << endl;
+            return false;
+        }
+    }
+    else if (EndsWith(fncs_config_file, "yaml")) {
+        try {
+            ifstream fin(fncs_config_file);
+            YAML::Parser parser(fin);
+            YAML::Node doc;
+            parser.GetNextDocument(doc);
+            config = parse_config(doc);
+        } catch (YAML::ParserException &) {
+            cerr << "could not open " << fncs_config_file << endl;
+            return false;
+        }
+    }
+    else {
+        cerr << "fncs config file must end in *.zpl or *.yaml, or be compiled"
+            " with fncs_config_compile" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+/* FNV-1a, 64 bit */
+static unsigned long long config_hash(const char *data, size_t size)
+{
+    unsigned long long value = 14695981039346656037ULL;
+    for (size_t i=0; i<size; ++i) {
+        value ^= static_cast<unsigned char>(data[i]);
+        value *= 1099511628211ULL;
+    }
+    return value;
+}
+
+static void put_config_string(string &out, const string &value)
+{
+    for (int i=0; i<4; ++i) {
+        out.append(1, static_cast<char>(value.size() >> (8*i)));
+    }
+    out.append(value);
+}
+
+/* the next string at offset, which it advances; false if truncated */
+static bool get_config_string(const string &in, size_t &offset, string &value)
+{
+    size_t length = 0;
+    if (in.size() - offset < 4) {
+        return false;
+    }
+    for (int i=3; i>=0; --i) {
+        length = (length << 8) | static_cast<unsigned char>(in[offset+i]);
+    }
+    offset += 4;
+    if (in.size() - offset < length) {
+        return false;
+    }
+    value.assign(in, offset, length);
+    offset += length;
+    return true;
+}
+
+/* The endpoint the broker shares in the file, waiting up to a minute
+ * for a broker started alongside, e.g. by the same mpirun; empty if it
+ * never appears. */
+static string read_broker_file(const char *file)
+{
+    for (int tries=0; tries<600; ++tries) {
+        ifstream fin(file);
+        string endpoint;
+        if (getline(fin, endpoint) && !endpoint.empty()) {
+            return endpoint;
+        }
+        zclock_sleep(100);
+    }
+    return string();
+}
+
+/* The topic as a replica sees it: the sim named by its first level is
+ * the sim of the same replica unless all replicas share it, so "gld/x"
+ * of replica 3 is "gld#3/x" while "player/x" stays. A glob naming the
+ * sim matches the sims of the replica only. */
+static string replica_topic(const string &topic)
+{
+    size_t slash = topic.find('/');
+    if (current->replica.empty() || slash == string::npos
+            || current->replica_shared.count(topic.substr(0, slash))) {
+        return topic;
+    }
+    return string(topic).insert(slash, current->replica);
+}
+
+/* Asks the tenant host at broker for the broker of the namespace, see
+ * fncs_broker --tenants; empty if it refused or did not answer. The host
+ * leaves a wildcard address for the host the sim reached it at. */
+static string tenant_endpoint(const string &broker, const string &name)
+{
+    string endpoint;
+    zsock_t *host = zsock_new(ZMQ_DEALER);
+    zmsg_t *reply = NULL;
+
+    if (!host || zsock_attach(host, fncs::resolve_endpoints(broker).c_str(), false)) {
+        LERROR << "could not connect to tenant host '" << broker << "'";
+        zsock_destroy(&host);
+        return endpoint;
+    }
+    zsock_set_rcvtimeo(host, 60000);
+    zstr_sendm(host, fncs::TENANT);
+    zstr_send(host, name.c_str());
+    reply = zmsg_recv(host);
+    if (!reply) {
+        LERROR << "tenant host '" << broker << "' did not answer";
+    }
+    else {
+        zframe_t *frame = zmsg_first(reply);
+        if (frame && zframe_streq(frame, fncs::TENANT)
+                && (frame = zmsg_next(reply)) && zframe_size(frame)) {
+            endpoint = fncs::to_string(frame);
+        }
+        else {
+            frame = frame ? zmsg_next(reply) : NULL;
+            LERROR << "tenant host refused namespace '" << name << "': "
+                << (frame ? fncs::to_string(frame) : string("bad reply"));
+        }
+    }
+    zmsg_destroy(&reply);
+    zsock_destroy(&host);
+
+    size_t wildcard = endpoint.find("://*:");
+    if (wildcard != string::npos) {
+        string front = broker.substr(0, broker.find(','));
+        size_t begin = front.find("://");
+        size_t end = front.rfind(':');
+        if (begin != string::npos && end > begin + 3) {
+            endpoint.replace(wildcard + 3, 1, front.substr(begin + 3, end - begin - 3));
+        }
+    }
+    return endpoint;
+}
+
+static const char CHECKPOINT_MAGIC[] = "FNCSCKP1";
+static const size_t CHECKPOINT_MAGIC_SIZE = 8;
+
+static string checkpoint_file()
+{
+    return current->simulation_name + "_checkpoint.bin";
+}
+
+/* The library half of a checkpoint: the time about to be granted, the
+ * last value of each key and the values held for that grant, as length
+ * prefixed strings after the magic. The sim saves its own state. */
+static void checkpoint_save()
+{
+    string body;
+    vector<pair<string,string> > pending;
+    map<string,string> bases = current->list_bases; /* as the values apply */
+    size_t n_values = 0;
+
+    for (size_t i=0; i<current->received.size(); ++i) {
+        zmsg_t *msg = current->received[i];
+        zmsg_first(msg); /* message type */
+        for (zframe_t *frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+            zframe_t *topic = frame;
+            frame = zmsg_next(msg);
+            if (!frame) {
+                break;
+            }
+            string value = fncs::to_string(frame);
+            string path;
+            /* the blob will be gone by the restart */
+            if (blob_handle(value.data(), value.size(), path)) {
+                blob_read(path, value);
+            }
+            /* and a delta's base with it */
+            if (value_packed(value.data(), value.size())) {
+                string raw;
+                value_unpack(value.data(), value.size(), raw);
+                value.swap(raw);
+            }
+            if (fncs::delta_frame(value.data(), value.size())) {
+                string &base = bases[fncs::to_string(topic)];
+                if (!fncs::delta_apply(base, value.data(), value.size())) {
+                    continue;
+                }
+                value = base;
+            }
+            pending.push_back(make_pair(fncs::to_string(topic), value));
+        }
+    }
+    if (current->io_actor) {
+        LWARNING << "values the I/O thread staged are not in the checkpoint";
+    }
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        CacheSlot &slot = current->cache[i];
+        if (slot.in_cache) {
+            slot.load();
+            put_config_string(body, slot.key);
+            put_config_string(body, slot.interned ? *slot.interned : slot.value);
+            ++n_values;
+        }
+    }
+    for (size_t i=0; i<pending.size(); ++i) {
+        put_config_string(body, pending[i].first);
+        put_config_string(body, pending[i].second);
+    }
+
+    ostringstream header;
+    header << current->time_checkpoint << ' ' << n_values << ' ' << pending.size();
+    string out(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    put_config_string(out, header.str());
+    out.append(body);
+
+    string file = checkpoint_file();
+    ofstream fout(file.c_str(), ios::out | ios::binary | ios::trunc);
+    fout.write(out.data(), out.size());
+    fout.close();
+    if (!fout) {
+        LERROR << "could not write checkpoint '" << file << "'";
+        return;
+    }
+    LDEBUG2C(logTIME) << "checkpoint of " << n_values << " value(s) and "
+        << pending.size() << " pending value(s) written to " << file;
+}
+
+/* Restore what checkpoint_save() wrote; the held values arrive with the
+ * first grant, as they would have. */
+static bool checkpoint_load()
+{
+    string file = checkpoint_file();
+    ifstream fin(file.c_str(), ios::in | ios::binary);
+    string data;
+    string header;
+    size_t offset = CHECKPOINT_MAGIC_SIZE;
+    size_t n_values = 0;
+    size_t n_pending = 0;
+
+    if (fin) {
+        fin.seekg(0, ios::end);
+        data.resize(static_cast<size_t>(fin.tellg()));
+        fin.seekg(0, ios::beg);
+        fin.read(&data[0], data.size());
+    }
+    if (!fin || data.size() < CHECKPOINT_MAGIC_SIZE
+            || 0 != memcmp(data.data(), CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE)
+            || !get_config_string(data, offset, header)
+            || !(istringstream(header) >> current->time_checkpoint
+                >> n_values >> n_pending)) {
+        LERROR << "'" << file << "' is not a checkpoint";
+        return false;
+    }
+    for (size_t i=0; i<n_values; ++i) {
+        string key;
+        string value;
+        if (!get_config_string(data, offset, key)
+                || !get_config_string(data, offset, value)) {
+            LERROR << "checkpoint '" << file << "' is truncated";
+            return false;
+        }
+        const fncs::TopicTable::Entry *entry = current->key_slots.find(key);
+        if (entry) {
+            CacheSlot &slot = current->cache[entry->slot];
+            slot.value = value;
+            slot.received();
+        }
+    }
+    zmsg_t *msg = zmsg_new();
+    zmsg_addstr(msg, fncs::PUBLISH_BATCH);
+    for (size_t i=0; i<n_pending; ++i) {
+        string topic;
+        string value;
+        if (!get_config_string(data, offset, topic)
+                || !get_config_string(data, offset, value)) {
+            LERROR << "checkpoint '" << file << "' is truncated";
+            zmsg_destroy(&msg);
+            return false;
+        }
+        zmsg_addmem(msg, topic.data(), topic.size());
+        zmsg_addmem(msg, value.data(), value.size());
+    }
+    current->received.push_back(msg);
+    LDEBUG2C(logCONFIG) << "restarting from the checkpoint at "
+        << current->time_checkpoint << " ns";
+    return true;
+}
+
+
+string fncs::compile_config(const Config &config)
+{
+    string body;
+
+    put_config_string(body, config.broker);
+    put_config_string(body, config.name);
+    put_config_string(body, config.time_delta);
+    put_config_string(body, config.lookahead);
+    put_config_string(body, config.fatal);
+    for (int i=0; i<4; ++i) {
+        body.append(1, static_cast<char>(config.values.size() >> (8*i)));
+    }
+    for (size_t i=0; i<config.values.size(); ++i) {
+        const Subscription &sub = config.values[i];
+        put_config_string(body, sub.key);
+        put_config_string(body, sub.topic);
+        put_config_string(body, sub.def);
+        put_config_string(body, sub.type);
+        put_config_string(body, sub.list);
+        put_config_string(body, sub.deadband);
+        put_config_string(body, sub.on_change);
+        put_config_string(body, sub.wake);
+        put_config_string(body, sub.min_interval);
+        put_config_string(body, sub.every_nth);
+        put_config_string(body, sub.pull);
+        put_config_string(body, sub.history);
+        put_config_string(body, sub.priority);
+    }
+    put_config_string(body, config.members);
+
+    string out(CONFIG_MAGIC, CONFIG_MAGIC_SIZE);
+    unsigned long long hash = config_hash(body.data(), body.size());
+    for (int i=0; i<8; ++i) {
+        out.append(1, static_cast<char>(hash >> (8*i)));
+    }
+    out.append(body);
+    return out;
+}
+
+
+bool fncs::load_compiled_config(const void *data, size_t size, Config &config)
+{
+    const char *bytes = static_cast<const char*>(data);
+    const size_t header = CONFIG_MAGIC_SIZE + 8;
+    unsigned long long hash = 0;
+
+    /* the version is the last byte of the magic */
+    if (size < header || 0 != memcmp(bytes, CONFIG_MAGIC, CONFIG_MAGIC_SIZE-1)
+            || bytes[CONFIG_MAGIC_SIZE-1] < '1'
+            || bytes[CONFIG_MAGIC_SIZE-1] > CONFIG_MAGIC[CONFIG_MAGIC_SIZE-1]) {
+        return false;
+    }
+    char version = bytes[CONFIG_MAGIC_SIZE-1];
+    for (int i=7; i>=0; --i) {
+        hash = (hash << 8) | static_cast<unsigned char>(bytes[CONFIG_MAGIC_SIZE+i]);
+    }
+    if (hash != config_hash(bytes + header, size - header)) {
+        return false;
+    }
+
+    string body(bytes + header, size - header);
+    size_t offset = 0;
+    size_t count = 0;
+    Config loaded;
+    if (!get_config_string(body, offset, loaded.broker)
+            || !get_config_string(body, offset, loaded.name)
+            || !get_config_string(body, offset, loaded.time_delta)
+            || !get_config_string(body, offset, loaded.lookahead)
+            || !get_config_string(body, offset, loaded.fatal)
+            || body.size() - offset < 4) {
+        return false;
+    }
+    for (int i=3; i>=0; --i) {
+        count = (count << 8) | static_cast<unsigned char>(body[offset+i]);
+    }
+    offset += 4;
+    if (count > (body.size() - offset) / 32) {
+        return false; /* each value takes at least eight lengths */
+    }
+    loaded.values.resize(count);
+    for (size_t i=0; i<count; ++i) {
+        Subscription &sub = loaded.values[i];
+        if (!get_config_string(body, offset, sub.key)
+                || !get_config_string(body, offset, sub.topic)
+                || !get_config_string(body, offset, sub.def)
+                || !get_config_string(body, offset, sub.type)
+                || !get_config_string(body, offset, sub.list)
+                || !get_config_string(body, offset, sub.deadband)
+                || !get_config_string(body, offset, sub.on_change)
+                || !get_config_string(body, offset, sub.wake)) {
+            return false;
+        }
+        if (version >= '2' && (!get_config_string(body, offset, sub.min_interval)
+                    || !get_config_string(body, offset, sub.every_nth))) {
+            return false;
+        }
+        if (version >= '3' && !get_config_string(body, offset, sub.pull)) {
+            return false;
+        }
+        if (version >= '4' && !get_config_string(body, offset, sub.history)) {
+            return false;
+        }
+        if (version >= '6' && !get_config_string(body, offset, sub.priority)) {
+            return false;
+        }
+    }
+    if (version >= '5' && !get_config_string(body, offset, loaded.members)) {
+        return false;
+    }
+    config = loaded;
+    return true;
+}
+
+
+/* This version of initialize() reads configuration parameters directly
+ * from the given string. */
+void fncs::initialize(const string &configuration)
+{
+    zchunk_t *zchunk = NULL;
+    zconfig_t *zconfig = NULL;
+    fncs::Config config;
+
+    config = parse_config(configuration);
+
+    initialize(config);
+}
+
+
+void fncs::initialize(Config config)
+{
+    const char *env_fatal = NULL;
+    const char *env_name = NULL;
+    const char *env_broker = NULL;
+    const char *env_namespace = NULL;
+    const char *env_replica = NULL;
+    const char *env_time_delta = NULL;
+    int rc;
+    zmsg_t *msg = NULL;
+    zchunk_t *zchunk = NULL;
+    zconfig_t *config_values = NULL;
+
+    /* name from env var overrides config file, except for a
+     * fncs::Context, as its federates share the environment */
+    env_name = getenv("FNCS_NAME");
+    if (env_name && !(current->in_context && !config.name.empty())) {
+        config.name = env_name;
+    }
+    else if (config.name.empty()) {
+        cerr << "FNCS_NAME env var not set and" << endl;
+        cerr << "fncs config does not contain 'name'" << endl;
+        die();
+        return;
+    }
+
+    /* a replica of an ensemble runs under a name of its own, and so do
+     * the other replicated sims it names */
+    env_replica = getenv("FNCS_REPLICA");
+    if (env_replica) {
+        istringstream shared(getenv("FNCS_ENSEMBLE_SHARED")
+                ? getenv("FNCS_ENSEMBLE_SHARED") : "");
+        string name;
+        current->replica = string("#") + env_replica;
+        current->replica_shared.clear();
+        while (getline(shared, name, ',')) {
+            if (!name.empty()) {
+                current->replica_shared.insert(name);
+            }
+        }
+        config.name += current->replica;
+        for (size_t i=0; i<config.values.size(); ++i) {
+            config.values[i].topic = replica_topic(config.values[i].topic);
+        }
+    }
+    current->simulation_name = config.name;
+
+    if (!logging_started) {
+        fncs::start_logging();
+        logging_started = true;
+    }
+
+    /* whether die() should exit() */
+    env_fatal = getenv("FNCS_FATAL");
+    if (env_fatal) {
+        config.fatal = env_fatal;
+        LINFO << "fatal set by FNCS_FATAL env var";
+    }
+    else if (config.fatal.empty()) {
+        LINFO << "FNCS_FATAL env var not set and fncs config does not contain 'fatal'";
+        LINFO << "defaulting to " << default_fatal;
+        config.fatal = default_fatal;
+    }
+    {
+        char fc = config.fatal[0];
+        if (fc == 'N' || fc == 'n' || fc == 'F' || fc == 'f') {
+            current->die_is_fatal = false;
+            LINFO << "fncs::die() will not call exit()";
+        }
+        else {
+            current->die_is_fatal = true;
+            LINFO << "fncs::die() will call exit(EXIT_FAILURE)";
+        }
+    }
+
+    /* a compound federate publishes for logical sims of its own */
+    if (!config.members.empty()) {
+        if (!expand_members(config.members, current->members)) {
+            LERROR << "invalid members '" << config.members << "'";
+            die();
+            return;
+        }
+        sort(current->members.begin(), current->members.end());
+        LDEBUG2C(logCONFIG) << "compound federate of "
+            << current->members.size() << " members";
+    }
+
+    /* broker location from env var overrides config file */
+    env_broker = getenv("FNCS_BROKER");
+    if (env_broker) {
+        LINFO << "FNCS_BROKER env var sets the broker endpoint location";
+        config.broker = env_broker;
+    } else if (config.broker.empty() && getenv("FNCS_BROKER_FILE")) {
+        config.broker = read_broker_file(getenv("FNCS_BROKER_FILE"));
+        if (config.broker.empty()) {
+            LERROR << "no broker endpoint in FNCS_BROKER_FILE '"
+                << getenv("FNCS_BROKER_FILE") << "'";
+            die();
+            return;
+        }
+    } else if (config.broker.empty()) {
+        LINFO << "FNCS_BROKER env var not set and fncs config does not contain 'broker'" << endl;
+        LINFO << "defaulting to " << default_broker;
+        config.broker = default_broker;
+    }
+    /* a tenant host hands out the broker of the sim's namespace */
+    env_namespace = getenv("FNCS_NAMESPACE");
+    if (env_namespace) {
+        LINFO << "FNCS_NAMESPACE env var asks for the broker of '"
+            << env_namespace << "'";
+        config.broker = tenant_endpoint(config.broker, env_namespace);
+        if (config.broker.empty()) {
+            die();
+            return;
+        }
+    }
+    LDEBUGC(logCONFIG) << "broker = " << config.broker;
+
+    /* time_delta from env var is tried first */
+    env_time_delta = getenv("FNCS_TIME_DELTA");
+    if (env_time_delta) {
+        LINFO << "FNCS_TIME_DELTA env var sets the time_delta";
+        config.time_delta = env_time_delta;
+    } else if (config.time_delta.empty()) {
+        LINFO << "FNCS_TIME_DELTA env var not set and fncs config does not contain 'time_delta'" << endl;
+        LINFO << "defaulting to " << default_time_delta;
+        config.time_delta = default_time_delta;
+    }
+    LDEBUGC(logCONFIG) << "time_delta string = " << config.time_delta;
+    current->time_delta = parse_time(config.time_delta);
+    LDEBUGC(logCONFIG) << "time_delta = " << current->time_delta;
+    current->time_delta_multiplier = time_unit_to_multiplier(config.time_delta);
+    LDEBUGC(logCONFIG) << "time_delta_multiplier = " << current->time_delta_multiplier;
+
+    /* the steps of a sim that receives nothing are stretched up to this,
+     * see time_request_async() */
+    current->time_stride = current->time_delta;
+    current->time_stride_max = 0;
+    current->idle_steps = 0;
+    {
+        const char *env_max = getenv("FNCS_TIME_DELTA_MAX");
+        if (env_max) {
+            current->time_stride_max = parse_time(env_max);
+            if (current->time_stride_max < 2 * current->time_delta) {
+                LWARNING << "FNCS_TIME_DELTA_MAX is less than twice the time delta, ignored";
+                current->time_stride_max = 0;
+            }
+        }
+        const char *env_idle = getenv("FNCS_TIME_DELTA_IDLE");
+        current->idle_limit = env_idle ? strtoul(env_idle, NULL, 10) : 10;
+        if (!current->idle_limit) {
+            current->idle_limit = 1;
+        }
+        if (current->time_stride_max) {
+            LDEBUGC(logCONFIG) << "steps stretch up to " << current->time_stride_max
+                << " ns after " << current->idle_limit << " idle step(s)";
+        }
+    }
+
+    /* how long to busy poll for the grant before blocking */
+    current->poll_spin = 0;
+    {
+        const char *env_poll = getenv("FNCS_POLL");
+        if (env_poll && !parse_poll(env_poll, current->poll_spin)) {
+            LERROR << "FNCS_POLL must be 'block' or 'spin:<time>', not '" << env_poll << "'";
+            die();
+            return;
+        }
+        if (current->poll_spin) {
+            LDEBUGC(logCONFIG) << "spinning " << current->poll_spin << " ns before blocking";
+        }
+    }
+
+    /* lookahead from env var overrides config file */
+    {
+        const char *env_lookahead = getenv("FNCS_LOOKAHEAD");
+        if (env_lookahead) {
+            LINFO << "FNCS_LOOKAHEAD env var sets the lookahead";
+            config.lookahead = env_lookahead;
+        }
+        LDEBUGC(logCONFIG) << "lookahead string = " << config.lookahead;
+    }
+
+    /* parse subscriptions */
+    {
+        vector<Subscription> subs = config.values;
+        vector<pair<string,Record::FieldType> > fields;
+        for (size_t i=0; i<subs.size(); ++i) {
+            bool is_pattern = fncs::is_topic_pattern(subs[i].topic);
+            fncs::TopicTable::Entry pattern;
+            pattern.topic = subs[i].topic;
+            pattern.is_list = subs[i].is_list();
+            pattern.used = true;
+            /* a list collects every topic it matches under its key,
+             * otherwise each topic becomes a key, see topic_slot() */
+            if (is_pattern && !pattern.is_list) {
+                LDEBUG2C(logCONFIG) << "keys of '" << subs[i].topic
+                    << "' are made as its topics arrive";
+                if (!subs[i].history.empty()) {
+                    LWARNING << "no history is kept for the keys of '"
+                        << subs[i].topic << "'";
+                }
+                if (fncs::parse_record_type(subs[i].type, fields)) {
+                    LWARNING << "record fields are not read from text for the keys of '"
+                        << subs[i].topic << "'";
+                }
+                current->topic_patterns.push_back(pattern);
+                continue;
+            }
+            size_t index = cache_slot(subs[i].key);
+            if (is_pattern) {
+                pattern.slot = index;
+                current->topic_patterns.push_back(pattern);
+            }
+            else {
+                current->topics.insert(subs[i].topic, index, subs[i].is_list());
+                if (subs[i].topic != subs[i].key) {
+                    current->cache[index].topic = subs[i].topic;
+                }
+            }
+            current->mykeys.push_back(subs[i].key);
+            LDEBUG2C(logCONFIG) << "initializing cache for '" << subs[i].key << "'='"
+                << subs[i].def << "'";
+            CacheSlot &slot = current->cache[index];
+            if (subs[i].is_list()) {
+                slot.in_list = true;
+                slot.list_clear();
+                if (!subs[i].def.empty()) {
+                    slot.entries.push_back(ListEntry(current->arena.append(
+                                    subs[i].def.data(), subs[i].def.size()),
+                                subs[i].def.size()));
+                    slot.listed = false;
+                }
+            }
+            else {
+                slot.in_cache = true;
+                slot.value = subs[i].def;
+                if (subs[i].pulls() && !is_pattern) {
+                    slot.pull_topic = subs[i].topic;
+                }
+            }
+            if (!subs[i].history.empty()) {
+                long n = atol(subs[i].history.c_str());
+                if (n <= 0) {
+                    LERROR << "history of '" << subs[i].key << "' must be a positive count";
+                    die();
+                    return;
+                }
+                slot.history.resize(n);
+            }
+            if (subs[i].prioritized()) {
+                slot.priority = true;
+                current->prioritized = true;
+            }
+            if (subs[i].type.compare(0, 7, "record{") == 0
+                    && !fncs::parse_record_type(subs[i].type, slot.fields)) {
+                LERROR << "type of '" << subs[i].key << "' must be record{name:type,...}"
+                    << " with types double, int64 or string";
+                die();
+                return;
+            }
+        }
+        if (subs.empty()) {
+            LDEBUG2C(logCONFIG) << "config did not contain any subscriptions";
+        }
+    }
+
+    /* create zmq context and client socket */
+    current->client = zsock_new(ZMQ_DEALER);
+    if (!current->client) {
+        LERROR << "socket creation failed";
+        die();
+        return;
+    }
+    ++n_clients;
+    if (!(zsock_resolve(current->client) != current->client)) {
+        LERROR << "socket failed to resolve";
+        die();
+        return;
+    }
+
+    /* reset the signal handler so it chains */
+    signal_handler_reset();
+
+    /* set client identity */
+    rc = zmq_setsockopt(zsock_resolve(current->client), ZMQ_IDENTITY, config.name.c_str(), config.name.size());
+    if (rc) {
+        LERROR << "socket identity failed";
+        die();
+        return;
+    }
+    /* The broker waits for a sim that stopped reading rather than drop
+     * what it sends, and reads nothing meanwhile; a sim blocked sending
+     * to it would never read again. */
+    zsock_set_sndhwm(current->client, 0);
+    socket_buffers(current->client);
+    /* finally connect to broker */
+    rc = zsock_attach(current->client, resolve_endpoints(config.broker).c_str(), false);
+    if (rc) {
+        LERROR << "socket connection to broker failed";
+        die();
+        return;
+    }
+
+    /* construct HELLO message; entire config goes with it */
+    msg = zmsg_new();
+    if (!msg) {
+        LERROR << "could not construct HELLO message";
+        die();
+        return;
+    }
+    rc = zmsg_addstr(msg, HELLO);
+    if (rc) {
+        LERROR << "failed to append HELLO to message";
+        die();
+        return;
+    }
+    /* with a manifest the values travel packed, not in the config text */
+    bool send_manifest = false;
+    {
+        const char *env_manifest = getenv("FNCS_MANIFEST");
+        if (env_manifest) {
+            char fc = env_manifest[0];
+            send_manifest = (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't');
+        }
+    }
+    vector<fncs::Subscription> manifest_values;
+    if (send_manifest) {
+        manifest_values.swap(config.values);
+    }
+    LDEBUG2C(logCONFIG) << "-- sending configuration as follows --" << endl << config.to_string();
+    rc = zmsg_addstr(msg, config.to_string().c_str());
+    if (rc) {
+        LERROR << "failed to save config for HELLO message";
+        die();
+        return;
+    }
+    string version_string;
+    {
+        ostringstream oss;
+        oss << FNCS_VERSION_MAJOR << "." << FNCS_VERSION_MINOR << "." << FNCS_VERSION_PATCH;
+        version_string = oss.str();
+    }
+    rc = zmsg_addstr(msg, version_string.c_str());
+    if (rc) {
+        LERROR << "failed to append version to message";
+        die();
+        return;
+    }
+    /* requested wire protocol; older brokers ignore this frame */
+    {
+        const char *env_protocol = getenv("FNCS_PROTOCOL");
+        string protocol = env_protocol ? env_protocol : default_protocol;
+        if (protocol != PROTOCOL_BINARY && protocol != PROTOCOL_STRING) {
+            LWARNING << "unrecognized FNCS_PROTOCOL '" << protocol << "'";
+            LWARNING << "defaulting to " << default_protocol;
+            protocol = default_protocol;
+        }
+        LDEBUG2C(logCONFIG) << "requesting protocol " << protocol;
+        const char *env_batch = getenv("FNCS_PUBLISH_BATCH");
+        if (env_batch) {
+            char fc = env_batch[0];
+            current->publish_batching = (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't');
+        }
+        LDEBUG2C(logCONFIG) << "publish batching " << (current->publish_batching ? "on" : "off");
+        const char *env_coalesce = getenv("FNCS_PUBLISH_COALESCE");
+        if (env_coalesce) {
+            char fc = env_coalesce[0];
+            current->publish_coalescing = (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't');
+        }
+        LDEBUG2C(logCONFIG) << "publish coalescing " << (current->publish_coalescing ? "on" : "off");
+        const char *env_threads = getenv("FNCS_PUBLISH_THREADS");
+        if (env_threads) {
+            char fc = env_threads[0];
+            current->publish_threads = (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't');
+        }
+        LDEBUG2C(logCONFIG) << "publish from threads " << (current->publish_threads ? "on" : "off");
+        const char *env_compress = getenv("FNCS_COMPRESS");
+        if (env_compress) {
+            current->compress_threshold = strtoul(env_compress, NULL, 10);
+#ifndef HAVE_ZSTD
+            LWARNING << "FNCS_COMPRESS is set but fncs was built without zstd";
+            current->compress_threshold = 0;
+#endif
+        }
+        const char *env_delta = getenv("FNCS_LIST_DELTA");
+        if (env_delta) {
+            current->delta_keyframes = strtoul(env_delta, NULL, 10);
+            LDEBUG2C(logCONFIG) << "list values as deltas, a keyframe every "
+                << current->delta_keyframes;
+        }
+        const char *env_blob = getenv("FNCS_BLOB_THRESHOLD");
+        if (env_blob) {
+            current->blob_threshold = strtoul(env_blob, NULL, 10);
+            const char *env_blob_dir = getenv("FNCS_BLOB_DIR");
+#if defined(_WIN32)
+            const char *tmpdir = getenv("TEMP");
+            current->blob_dir = env_blob_dir ? env_blob_dir : (tmpdir ? tmpdir : ".");
+#else
+            const char *tmpdir = getenv("TMPDIR");
+            current->blob_dir = env_blob_dir ? env_blob_dir : (tmpdir ? tmpdir : "/tmp");
+#endif
+            LDEBUG2C(logCONFIG) << "values of " << current->blob_threshold
+                << " bytes or more go to blobs in " << current->blob_dir;
+        }
+        rc = zmsg_addstr(msg, protocol.c_str());
+        if (rc) {
+            LERROR << "failed to append protocol to message";
+            die();
+            return;
+        }
+    }
+    if (send_manifest) {
+        string manifest;
+        for (size_t i=0; i<manifest_values.size(); ++i) {
+            append_manifest(manifest, manifest_values[i].topic,
+                    manifest_values[i].is_list(), manifest_values[i].filter(),
+                    manifest_values[i].wakes(), manifest_values[i].prioritized());
+        }
+        LDEBUG2C(logCONFIG) << "sending manifest of "
+            << manifest_values.size() << " subscription(s)";
+        zmsg_addstr(msg, MANIFEST);
+        rc = zmsg_addmem(msg, manifest.data(), manifest.size());
+        if (rc) {
+            LERROR << "failed to append manifest to message";
+            die();
+            return;
+        }
+        manifest_values.swap(config.values);
+    }
+    /* older brokers ignore these frames */
+#ifdef HAVE_ZSTD
+    zmsg_addstr(msg, ZSTD);
+#endif
+    /* not with an I/O thread, which stages list values while the codes
+     * they use may still be on their way to this one */
+    {
+        const char *env_io_thread = getenv("FNCS_IO_THREAD");
+        if (!(env_io_thread && (env_io_thread[0] == 'Y' || env_io_thread[0] == 'y'
+                        || env_io_thread[0] == 'T' || env_io_thread[0] == 't'))) {
+            zmsg_addstr(msg, DICTIONARY);
+        }
+    }
+    zmsg_addstr(msg, DELTA);
+    if (current->rollback_save) {
+        zmsg_addstr(msg, OPTIMISTIC);
+    }
+    zmsg_addstr(msg, GRANT_BATCH);
+    zmsg_addstr(msg, TOPIC_IDS);
+    zmsg_addstr(msg, GRANT_CAST);
+    /* Publishers may send it values directly where it listens. Not with
+     * an I/O thread, which would have to own that socket too, nor when
+     * it may roll back, which the broker undoes by the values it sent. */
+    {
+        const char *env_direct = getenv("FNCS_DIRECT");
+        const char *env_io_thread = getenv("FNCS_IO_THREAD");
+        bool io_thread = env_io_thread && (env_io_thread[0] == 'Y'
+                || env_io_thread[0] == 'y' || env_io_thread[0] == 'T'
+                || env_io_thread[0] == 't');
+        if (env_direct && *env_direct && !io_thread && !current->rollback_save) {
+            current->direct = zsock_new(ZMQ_PULL);
+            if (current->direct) {
+                zsock_set_rcvhwm(current->direct, 0);
+            }
+            if (!current->direct
+                    || zsock_attach(current->direct,
+                        resolve_endpoints(env_direct).c_str(), true)) {
+                LWARNING << "could not bind FNCS_DIRECT '" << env_direct
+                    << "', values come through the broker";
+                zsock_destroy(&current->direct);
+            }
+            else {
+                /* as bound, so an ephemeral port is told as chosen */
+                zmsg_addstr(msg, DIRECT);
+                zmsg_addstr(msg, zsock_endpoint(current->direct));
+            }
+        }
+    }
+    /* values may come apart from the grants, see DATA */
+    zmsg_addstr(msg, DATA);
+    /* some values are fetched once read, see PULL */
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        if (!current->cache[i].pull_topic.empty()) {
+            zmsg_addstr(msg, PULL);
+            break;
+        }
+    }
+    /* anonymous values nobody reads are dropped here, see SUBSCRIBED */
+    zmsg_addstr(msg, SUBSCRIBED);
+    zmsg_addstr(msg, LOAD);
+    LDEBUG2C(logCONFIG) << "sending HELLO";
+    rc = zmsg_send(&msg, current->client);
+    if (rc) {
+        LERROR << "failed to send HELLO message";
+        die();
+        return;
+    }
+
+    /* receive ack */
+    msg = zmsg_recv(current->client);
+    LDEBUG4C(logCONFIG) << "called zmsg_recv";
+    if (!msg) {
+        LERROR << "null message received";
+        die();
+        return;
+    }
+    /* first frame is type identifier */
+    zframe_t *frame = zmsg_first(msg);
+    if (!zframe_streq(frame, ACK)) {
+        LERROR << "ACK expected, got " << frame;
+        die();
+        return;
+    }
+    LDEBUG2C(logCONFIG) << "received ACK";
+    /* next frame is connetion order ID */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LERROR << "ACK message missing order ID";
+        die();
+        return;
+    }
+    current->simulation_id = atoi(fncs::to_string(frame).c_str());
+    LDEBUG2C(logCONFIG) << "connection order ID is " << current->simulation_id;
+
+    /* next frame is n_sims */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LERROR << "ACK message missing n_sims";
+        die();
+        return;
+    }
+    current->n_sims = atoi(fncs::to_string(frame).c_str());
+    LDEBUG2C(logCONFIG) << "n_sims is " << current->n_sims;
+
+    /* next frame is number of subscription keys */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LERROR << "ACK message missing n_keys";
+        die();
+        return;
+    }
+    int n_keys = atoi(fncs::to_string(frame).c_str());
+    LDEBUG2C(logCONFIG) << "n_keys is " << n_keys;
+
+    /* next frames are the keys; their topics are built once list
+     * subscribers are known */
+    vector<string> published_keys;
+    for (int i=0; i<n_keys; ++i) {
+        frame = zmsg_next(msg);
+        if (!frame) {
+            LERROR << "ACK message missing key " << i;
+            die();
+            return;
+        }
+        string key = fncs::to_string(frame);
+        published_keys.push_back(key);
+        LDEBUG2C(logCONFIG) << "key is " << key;
+    }
+
+    /* next frame is peer time */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LERROR << "ACK message missing peer time";
+        die();
+        return;
+    }
+    long time_peer_long = atol(fncs::to_string(frame).c_str());
+    LDEBUG2C(logCONFIG) << "time_peer_long is " << time_peer_long;
+    current->time_peer = time_peer_long;
+
+    /* next frame is FNCS library version */
+    frame = zmsg_next(msg);
+    if (!frame) {
+        LWARNING << "HELLO message from broker missing FNCS library version";
+    }
+    else {
+        string version_string = fncs::to_string(frame);
+        int result[3];
+        std::istringstream parser(version_string);
+        parser >> result[0];
+        for(int idx = 1; idx < 3; idx++) {
+            parser.get(); //Skip period
+            parser >> result[idx];
+        }
+        if (FNCS_VERSION_MAJOR != result[0]
+                || FNCS_VERSION_MINOR != result[1]
+                || FNCS_VERSION_PATCH != result[2]) {
+            LWARNING << "FNCS library version mismatch, client="
+                << FNCS_VERSION_MAJOR << "."
+                << FNCS_VERSION_MINOR << "."
+                << FNCS_VERSION_PATCH
+                << " broker="
+                << version_string;
+        }
+    }
+
+    /* next frame is the negotiated protocol, unless the broker is older
+     * and does not know about protocols, in which case it is the last ACK */
+    frame = zmsg_next(msg);
+    current->binary_protocol = false;
+    current->broker_negotiated = false;
+    if (frame && !zframe_streq(frame, ACK)) {
+        current->binary_protocol = zframe_streq(frame, PROTOCOL_BINARY);
+        current->broker_negotiated = true;
+        frame = zmsg_next(msg);
+    }
+
+    /* compressed values are only sent if every sim reads them */
+    current->compression = frame && zframe_streq(frame, ZSTD);
+    if (current->compression) {
+        frame = zmsg_next(msg);
+    }
+    if (current->compress_threshold && !current->compression) {
+        LWARNING << "not every sim reads compressed values, compression disabled";
+    }
+    else if (current->publish_batching) {
+        LWARNING << "broker does not support PUBLISH_BATCH, batching disabled";
+        current->publish_batching = false;
+    }
+
+    /* string values the broker numbered, followed by the values, if
+     * every sim reads them coded */
+    current->dictionary_on = frame && zframe_streq(frame, DICTIONARY);
+    if (current->dictionary_on) {
+        frame = zmsg_next(msg);
+        if (!frame || !current->dictionary.unpack(zframe_data(frame), zframe_size(frame))) {
+            LERROR << "ACK message has a malformed dictionary";
+            die();
+            return;
+        }
+        LDEBUG2C(logCONFIG) << "values coded, " << current->dictionary.size() << " so far";
+        frame = zmsg_next(msg);
+    }
+
+    /* a sim that can roll back still runs conservatively, unless the
+     * broker runs the federation optimistically */
+    current->optimistic = frame && zframe_streq(frame, OPTIMISTIC);
+    if (current->optimistic) {
+        LDEBUG2C(logCONFIG) << "running optimistically";
+        frame = zmsg_next(msg);
+    }
+
+    /* next frames are the keys with a list subscriber; without them we
+     * cannot tell which values are safe to coalesce. A broker that got a
+     * manifest answers with one instead, flagging the listed keys. */
+    current->list_keys.clear();
+    vector<pair<string,bool> > manifest_keys;
+    if (frame && zframe_streq(frame, MANIFEST)) {
+        frame = zmsg_next(msg);
+        if (!frame || !parse_manifest(zframe_data(frame), zframe_size(frame), manifest_keys)) {
+            LERROR << "ACK message has a malformed manifest";
+            die();
+            return;
+        }
+        LDEBUG2C(logCONFIG) << "received manifest of " << manifest_keys.size() << " key(s)";
+        frame = zmsg_next(msg);
+    }
+    else if (frame && zframe_streq(frame, LIST_KEYS)) {
+        for (frame = zmsg_next(msg); frame && !zframe_streq(frame, ACK)
+                && !zframe_streq(frame, DELTA_KEYS)
+                && !zframe_streq(frame, TOPIC_IDS)
+                && !zframe_streq(frame, GRANT_CAST)
+                && !zframe_streq(frame, DIRECT)
+                && !zframe_streq(frame, DATA)
+                && !zframe_streq(frame, PULL)
+                && !zframe_streq(frame, SUBSCRIBED); frame = zmsg_next(msg)) {
+            current->list_keys.insert(fncs::to_string(frame));
+        }
+    }
+    else if (current->publish_coalescing) {
+        LWARNING << "broker does not report list subscribers, coalescing disabled";
+        current->publish_coalescing = false;
+    }
+
+    /* next frames are the keys that may be sent as deltas */
+    set<string> delta_keys;
+    if (frame && zframe_streq(frame, DELTA_KEYS)) {
+        for (frame = zmsg_next(msg); frame && !zframe_streq(frame, ACK)
+                && !zframe_streq(frame, TOPIC_IDS)
+                && !zframe_streq(frame, GRANT_CAST)
+                && !zframe_streq(frame, DIRECT)
+                && !zframe_streq(frame, DATA)
+                && !zframe_streq(frame, PULL)
+                && !zframe_streq(frame, SUBSCRIBED); frame = zmsg_next(msg)) {
+            delta_keys.insert(fncs::to_string(frame));
+        }
+    }
+
+    /* next frame is the topic IDs of the published keys and then of the
+     * subscriptions, which PUBLISH messages may carry in place of topics */
+    vector<size_t> topic_ids;
+    if (frame && zframe_streq(frame, TOPIC_IDS)) {
+        frame = zmsg_next(msg);
+        if (!frame || zframe_size(frame) % 4) {
+            LERROR << "ACK message has malformed topic IDs";
+            die();
+            return;
+        }
+        const unsigned char *bytes = zframe_data(frame);
+        topic_ids.resize(zframe_size(frame) / 4);
+        for (size_t i=0; i<topic_ids.size(); ++i) {
+            size_t id = 0;
+            for (int j=3; j>=0; --j) {
+                id = (id << 8) | bytes[4*i+j];
+            }
+            topic_ids[i] = id;
+        }
+        LDEBUG2C(logCONFIG) << "received " << topic_ids.size() << " topic ID(s)";
+        frame = zmsg_next(msg);
+    }
+
+    /* next frame is where grants shared by many sims are published */
+    string grant_cast_endpoint;
+    if (frame && zframe_streq(frame, GRANT_CAST)) {
+        frame = zmsg_next(msg);
+        if (!frame) {
+            LERROR << "ACK message missing grant cast endpoint";
+            die();
+            return;
+        }
+        grant_cast_endpoint = fncs::to_string(frame);
+        frame = zmsg_next(msg);
+    }
+
+    /* next frame is which subscribers it sends values to directly */
+    string direct_plan;
+    if (frame && zframe_streq(frame, DIRECT)) {
+        frame = zmsg_next(msg);
+        if (!frame) {
+            LERROR << "ACK message missing direct subscribers";
+            die();
+            return;
+        }
+        direct_plan = fncs::to_string(frame);
+        frame = zmsg_next(msg);
+    }
+
+    /* next frame is where the broker sends values apart from grants */
+    string data_endpoint;
+    if (frame && zframe_streq(frame, DATA)) {
+        frame = zmsg_next(msg);
+        if (!frame) {
+            LERROR << "ACK message missing data endpoint";
+            die();
+            return;
+        }
+        data_endpoint = fncs::to_string(frame);
+        frame = zmsg_next(msg);
+    }
+
+    /* next frame is whether the broker keeps the values it pulls */
+    bool pull = false;
+    if (frame && zframe_streq(frame, PULL)) {
+        pull = true;
+        frame = zmsg_next(msg);
+    }
+
+    /* next frame is every topic subscribed to, for publish_anon() */
+    current->anon_filtered = false;
+    if (frame && zframe_streq(frame, SUBSCRIBED)) {
+        frame = zmsg_next(msg);
+        if (!frame || !current->subscribed.unpack(zframe_data(frame), zframe_size(frame))) {
+            LERROR << "ACK message has malformed subscribed topics";
+            die();
+            return;
+        }
+        current->anon_filtered = true;
+        frame = zmsg_next(msg);
+    }
+    current->publish_slots.clear();
+    current->publish_topics.clear();
+    current->publish_patterns.clear();
+    vector<bool> published_lists;
+    for (size_t i=0; i<published_keys.size(); ++i) {
+        published_lists.push_back(current->list_keys.count(published_keys[i]) > 0);
+    }
+    for (size_t i=0; i<manifest_keys.size(); ++i) {
+        published_keys.push_back(string());
+        published_keys.back().swap(manifest_keys[i].first);
+        published_lists.push_back(manifest_keys[i].second);
+    }
+    for (size_t i=0; i<published_keys.size(); ++i) {
+        const string &key = published_keys[i];
+        bool in_list = published_lists[i];
+        bool delta = current->delta_keyframes && delta_keys.count(key) > 0;
+        if (fncs::is_topic_pattern(key)) {
+            current->publish_patterns.push_back(PublishPattern(key, in_list, delta));
+            continue;
+        }
+        current->publish_slots.insert(key, current->publish_topics.size(), in_list);
+        if (current->publish_topics.size() < current->publish_slots.size()) {
+            current->publish_topics.push_back(
+                    PublishTopic(current->simulation_name + '/' + key, in_list, delta));
+            if (i < topic_ids.size() && topic_ids[i] != NO_TOPIC_ID) {
+                current->publish_topics.back().frame = encode_topic_id(topic_ids[i]);
+            }
+        }
+    }
+    for (size_t i=published_keys.size(); i<topic_ids.size(); ++i) {
+        size_t j = i - published_keys.size();
+        if (j < config.values.size() && topic_ids[i] != NO_TOPIC_ID) {
+            current->topics.set_id(topic_ids[i], config.values[j].topic);
+        }
+    }
+    if (!direct_plan.empty() && !parse_direct_plan(direct_plan, published_keys, topic_ids)) {
+        LERROR << "ACK message has malformed direct subscribers";
+        die();
+        return;
+    }
+    LDEBUG2C(logCONFIG) << "using " << (current->binary_protocol ? PROTOCOL_BINARY : PROTOCOL_STRING) << " protocol";
+
+    /* last frame is second ACK */
+    if (!frame || !zframe_streq(frame, ACK)) {
+        LERROR << "ACK expected, got " << frame;
+        die();
+        return;
+    }
+    LDEBUG2C(logCONFIG) << "received second ACK";
+    zmsg_destroy(&msg);
+
+    /* from here on an I/O thread may own the socket; the API talks to
+     * it over the actor pipe, which takes the place of the socket */
+    {
+        const char *env_io_thread = getenv("FNCS_IO_THREAD");
+        if (env_io_thread) {
+            char fc = env_io_thread[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                IoThreadArgs args = { current->client, &current->topics,
+                    &current->topic_patterns, &current->list_bases,
+                    current->poll_spin };
+                current->io_actor = zactor_new(io_thread, &args);
+                if (!current->io_actor) {
+                    LERROR << "could not start client I/O thread";
+                    die();
+                    return;
+                }
+                current->client = zactor_sock(current->io_actor);
+                LDEBUG2C(logCONFIG) << "client I/O thread started";
+            }
+        }
+    }
+
+    /* The broker publishes a grant once for every sim it goes to, but
+     * only to a sim it saw subscribe under its own name, which follows
+     * the subscription to the grants themselves. Until then, and with an
+     * I/O thread, which orders grants after the values it stages, every
+     * grant comes on the DEALER. */
+    if (!grant_cast_endpoint.empty() && !current->io_actor) {
+        current->grant_cast = zsock_new(ZMQ_SUB);
+        if (!current->grant_cast
+                || zsock_attach(current->grant_cast,
+                    resolve_endpoints(grant_cast_endpoint).c_str(), false)) {
+            LWARNING << "could not connect to grant cast endpoint '"
+                << grant_cast_endpoint << "', grants come one by one";
+            zsock_destroy(&current->grant_cast);
+        }
+        else {
+            /* nothing cast may be dropped while the sim computes */
+            zsock_set_rcvhwm(current->grant_cast, 0);
+            zsock_set_subscribe(current->grant_cast, GRANT_CAST);
+            zsock_set_subscribe(current->grant_cast,
+                    (string(GRANT_CAST) + '/' + current->simulation_name).c_str());
+            LDEBUG2C(logCONFIG) << "grants shared with other sims come from "
+                << grant_cast_endpoint;
+        }
+    }
+
+    /* The broker sends values on a DEALER of their own once told it is
+     * connected, with the same identity as the first, so that no grant
+     * waits behind them. Not with an I/O thread, which stages values
+     * and grants in the order they came on one socket. */
+    if (!data_endpoint.empty() && !current->io_actor) {
+        current->data = zsock_new(ZMQ_DEALER);
+        if (current->data) {
+            /* nothing is dropped while the sim computes */
+            zsock_set_rcvhwm(current->data, 0);
+            socket_buffers(current->data);
+            rc = zmq_setsockopt(zsock_resolve(current->data), ZMQ_IDENTITY,
+                    current->simulation_name.c_str(), current->simulation_name.size());
+        }
+        if (!current->data || rc
+                || zsock_attach(current->data, resolve_endpoints(data_endpoint).c_str(), false)
+                || zstr_send(current->data, DATA)) {
+            LWARNING << "could not connect to data endpoint '" << data_endpoint
+                << "', values come with the grants";
+            zsock_destroy(&current->data);
+        }
+        else {
+            LDEBUG2C(logCONFIG) << "values come from " << data_endpoint;
+        }
+    }
+
+    /* Pulled values are fetched on a DEALER of their own, so that the
+     * replies wait behind nothing sent for the next grant. A broker that
+     * does not keep them sends them as any other. */
+    if (pull) {
+        string identity = current->simulation_name + PULL_IDENTITY;
+        current->pull = zsock_new(ZMQ_DEALER);
+        if (current->pull) {
+            rc = zmq_setsockopt(zsock_resolve(current->pull), ZMQ_IDENTITY,
+                    identity.data(), identity.size());
+        }
+        if (!current->pull || rc
+                || zsock_attach(current->pull, resolve_endpoints(config.broker).c_str(), false)) {
+            LERROR << "could not connect to the broker for pulled values";
+            die();
+            return;
+        }
+        LDEBUG2C(logCONFIG) << "pulled values are fetched when read";
+    }
+    else {
+        for (size_t i=0; i<current->cache.size(); ++i) {
+            current->cache[i].pull_topic.clear();
+        }
+    }
+
+    /* resume from this sim's part of the broker's last checkpoint */
+    {
+        const char *env_restart = getenv("FNCS_RESTART");
+        if (env_restart) {
+            char fc = env_restart[0];
+            if (fc == 'Y' || fc == 'y' || fc == 'T' || fc == 't') {
+                if (!checkpoint_load()) {
+                    die();
+                    return;
+                }
+            }
+        }
+    }
+
+    /* co-located readers map the cache instead of subscribing again */
+    {
+        const char *env_export = getenv("FNCS_CACHE_EXPORT");
+        if (env_export && *env_export) {
+            const char *env_size = getenv("FNCS_CACHE_EXPORT_SIZE");
+            size_t size = env_size ? strtoul(env_size, NULL, 10) : 4 << 20;
+            cache_export_close();
+            current->cache_export = new fncs::CacheSegment;
+            if (!current->cache_export->create(env_export, size)) {
+                LERROR << "could not create the FNCS_CACHE_EXPORT segment '"
+                    << env_export << "' of " << size << " bytes";
+                delete current->cache_export;
+                current->cache_export = NULL;
+                die();
+                return;
+            }
+            LDEBUG2C(logCONFIG) << "cache exported to '" << env_export << "'";
+        }
+    }
+
+    current->time_current = 0;
+    current->time_window = 0;
+    current->time_period = 0;
+    current->broker_granted = false;
+    current->request_rollback = false;
+    current->snapshots.clear();
+    current->stats = fncs::Stats();
+    current->is_initialized_ = true;
+}
+
+
+bool fncs::is_initialized()
+{
+    return current->is_initialized_;
+}
+
+
+/* tell the sim a state it saved is not restored again */
+static void snapshot_discard(fncs::time time)
+{
+    if (current->rollback_discard) {
+        current->rollback_discard(fncs::convert_broker_to_sim_time(time),
+                current->rollback_data);
+    }
+}
+
+/* Save the cache and have the sim save its state at the grant. */
+static void snapshot_save(fncs::time time)
+{
+    current->snapshots.push_back(SavedCache(time));
+    vector<string> &values = current->snapshots.back().values;
+    values.resize(current->cache.size());
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        current->cache[i].load();
+        values[i] = current->cache[i].value;
+    }
+    current->rollback_save(fncs::convert_broker_to_sim_time(time), current->rollback_data);
+}
+
+/* Go back to the state saved at the grant of time restored, dropping the
+ * later ones. When the step is redone from an earlier time granted, the
+ * state is saved again under that time. */
+static bool snapshot_restore(fncs::time restored, fncs::time granted)
+{
+    vector<SavedCache> &snapshots = current->snapshots;
+
+    LDEBUG2C(logTIME) << "rolling back to the state at " << restored
+        << " ns, granted " << granted << " ns";
+    while (!snapshots.empty() && snapshots.back().time > restored) {
+        snapshot_discard(snapshots.back().time);
+        snapshots.pop_back();
+    }
+    if (snapshots.empty() || snapshots.back().time != restored) {
+        LERROR << "no state saved at " << restored << " ns to roll back to";
+        return false;
+    }
+    SavedCache &snapshot = snapshots.back();
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        CacheSlot &slot = current->cache[i];
+        /* a slot made afterwards for a pattern had no value yet */
+        slot.value = i < snapshot.values.size() ? snapshot.values[i] : string();
+        slot.received();
+        if (!slot.history.times.empty()) {
+            slot.history.rewind(fncs::convert_broker_to_sim_time(restored));
+        }
+    }
+    current->rollback_restore(fncs::convert_broker_to_sim_time(restored),
+            current->rollback_data);
+    if (granted != restored) {
+        snapshot_discard(restored);
+        snapshot.time = granted;
+        current->rollback_save(fncs::convert_broker_to_sim_time(granted),
+                current->rollback_data);
+    }
+    return true;
+}
+
+/* drop the states no rollback can reach, those at or before the GVT */
+static void snapshot_collect(fncs::time gvt)
+{
+    vector<SavedCache> &snapshots = current->snapshots;
+    size_t n = 0;
+
+    while (n < snapshots.size() && snapshots[n].time <= gvt) {
+        snapshot_discard(snapshots[n].time);
+        ++n;
+    }
+    snapshots.erase(snapshots.begin(), snapshots.begin() + n);
+    LDEBUG4C(logTIME) << "GVT " << gvt << " ns, " << snapshots.size() << " state(s) kept";
+}
+
+
+/* A key another sim subscribed to at runtime, see fncs::subscribe(),
+ * published from now on as if its ACK had listed it. */
+static void publish_learned(const string &key, bool in_list, bool delta)
+{
+    const fncs::TopicTable::Entry *entry = current->publish_slots.find(key);
+    if (entry) {
+        /* a list subscriber wants every value, none coalesced */
+        current->publish_topics[entry->slot].in_list |= in_list;
+        return;
+    }
+    LDEBUG2C(logCONFIG) << "publishing '" << key << "' from now on";
+    current->publish_slots.insert(key, current->publish_topics.size(), in_list);
+    current->publish_topics.push_back(PublishTopic(
+                current->simulation_name + '/' + key, in_list, delta));
+}
+
+
+/* Adds the wall time of its scope to a total of the stats. */
+class RequestTimer {
+    public:
+        explicit RequestTimer(fncs::time &total) : total(total), start(fncs::timer_ft()) {}
+        ~RequestTimer() { total += fncs::timer_ft() - start; }
+
+    private:
+        fncs::time &total;
+        fncs::time start;
+};
+
+
+/* Process messages until the grant of the pending time request arrives
+ * or the timeout, in milliseconds as for zmq_poll, runs out. Values
+ * received meanwhile are held until the grant so that the sim never
+ * sees a partly updated cache. Returns true once the grant is ready. */
+/* whether all that the broker said the grant follows has arrived on
+ * the other sockets, see CAST_FENCE and DIRECT_FENCE */
+static bool grant_follows()
+{
+    return current->cast_seq >= current->cast_fence
+        && current->direct_received >= current->direct_fence;
+}
+
+static bool receive_grant(long timeout)
+{
+    using namespace fncs;
+
+    RequestTimer timer(current->stats.time_dispatching);
+    zmq_pollitem_t items[] = {
+        { zsock_resolve(current->client), 0, ZMQ_POLLIN, 0 },
+        { current->grant_cast ? zsock_resolve(current->grant_cast) : NULL, 0,
+            static_cast<short>(current->grant_cast ? ZMQ_POLLIN : 0), 0 },
+        { current->direct ? zsock_resolve(current->direct) : NULL, 0,
+            static_cast<short>(current->direct ? ZMQ_POLLIN : 0), 0 },
+        { current->data ? zsock_resolve(current->data) : NULL, 0, ZMQ_POLLIN, 0 }
+    };
+    int n_items = current->data ? 4 : current->direct ? 3 : current->grant_cast ? 2 : 1;
+    while (!current->request_ready) {
+        int rc = 0;
+
+        LDEBUG4C(logTIME) << "entering poll";
+        {
+            /* the dispatching time is what remains */
+            fncs::time blocked = timer_ft();
+            rc = spin_poll(items, n_items, timeout, current->poll_spin);
+            blocked = timer_ft() - blocked;
+            current->stats.time_blocked += blocked;
+            current->stats.time_dispatching -= blocked;
+        }
+        if (rc == -1) {
+            LERROR << "client polling error: " << strerror(errno);
+            die(); /* interrupted */
+            current->request_granted = current->request_next;
+            current->request_ready = true;
+            break;
+        }
+        if (rc == 0) {
+            break; /* timed out */
+        }
+
+        /* a grant or value shared with other sims, most of them for others */
+        if (n_items > 1 && (items[1].revents & ZMQ_POLLIN)) {
+            zmsg_t *msg = zmsg_recv(current->grant_cast);
+            zframe_t *seq = msg ? zmsg_next(msg) : NULL;
+            zframe_t *type = seq ? zmsg_next(msg) : NULL;
+            zframe_t *payload = type ? zmsg_next(msg) : NULL;
+            zframe_t *bitmap = msg ? zmsg_last(msg) : NULL;
+            size_t bit = current->simulation_id;
+            if (!payload || zmsg_size(msg) < 5) {
+                LERROR << "malformed grant cast message";
+                die();
+                current->request_granted = current->request_next;
+                current->request_ready = true;
+                zmsg_destroy(&msg);
+                break;
+            }
+            current->cast_seq = strtoull(fncs::to_string(seq).c_str(), NULL, 10);
+            if (bit / 8 < zframe_size(bitmap)
+                    && (zframe_data(bitmap)[bit / 8] & (1 << (bit % 8)))) {
+                if (MSG_TIME_REQUEST == fncs::to_type(type)) {
+                    LDEBUG4C(logTIME) << "TIME_REQUEST received on grant cast";
+                    current->request_granted = strtoull(
+                            fncs::to_string(payload).c_str(), NULL, 10);
+                    current->request_window = 0;
+                    current->request_ready = true;
+                }
+                else {
+                    LDEBUG4C(logPUBLISH) << "PUBLISH received on grant cast";
+                    /* kept as a PUBLISH is, the type then the pair */
+                    zmsg_remove(msg, bitmap);
+                    zframe_destroy(&bitmap);
+                    for (int j=0; j<2; ++j) {
+                        zframe_t *frame = zmsg_pop(msg);
+                        zframe_destroy(&frame);
+                    }
+                    ++current->stats.n_messages;
+                    current->received.push_back(msg);
+                    msg = NULL;
+                }
+            }
+            if (current->grant_held && grant_follows()) {
+                current->grant_held = false;
+                current->request_ready = true;
+            }
+            zmsg_destroy(&msg);
+            continue;
+        }
+
+        /* a value its publisher sent directly, or values the broker sent
+         * on the data channel: the type, then topic and value pairs */
+        zsock_t *values = NULL;
+        if (n_items > 2 && (items[2].revents & ZMQ_POLLIN)) {
+            values = current->direct;
+        }
+        else if (n_items > 3 && (items[3].revents & ZMQ_POLLIN)) {
+            values = current->data;
+        }
+        if (values) {
+            zmsg_t *msg = zmsg_recv(values);
+            if (!msg || zmsg_size(msg) < 3 || zmsg_size(msg) % 2 == 0) {
+                LERROR << "malformed PUBLISH message on the data sockets";
+                die();
+                current->request_granted = current->request_next;
+                current->request_ready = true;
+                zmsg_destroy(&msg);
+                break;
+            }
+            LDEBUG4C(logPUBLISH) << "PUBLISH received on the data sockets";
+            ++current->direct_received;
+            ++current->stats.n_messages;
+            current->received.push_back(msg);
+            if (current->grant_held && grant_follows()) {
+                current->grant_held = false;
+                current->request_ready = true;
+            }
+            continue;
+        }
+
+        if (items[0].revents & ZMQ_POLLIN) {
+            zmsg_t *msg = NULL;
+            zframe_t *frame = NULL;
+            MessageType message_type;
+
+            LDEBUG4C(logTIME) << "incoming message";
+            msg = zmsg_recv(current->client);
+            if (!msg) {
+                LERROR << "null message received";
+                die();
+                current->request_granted = current->request_next;
+                current->request_ready = true;
+                break;
+            }
+
+            /* first frame is message type identifier */
+            frame = zmsg_first(msg);
+            if (!frame) {
+                LERROR << "message missing type identifier";
+                die();
+                current->request_granted = current->request_next;
+                current->request_ready = true;
+                zmsg_destroy(&msg);
+                break;
+            }
+            message_type = fncs::to_type(frame);
+
+            /* dispatcher */
+            if (current->io_actor && zframe_streq(frame, STAGED)) {
+                /* values the I/O thread received for this grant */
+                frame = zmsg_next(msg);
+                if (frame && zframe_size(frame) == sizeof(current->staged)) {
+                    delete current->staged;
+                    memcpy(&current->staged, zframe_data(frame), sizeof(current->staged));
+                }
+            }
+            else if (MSG_TIME_REQUEST == message_type) {
+                LDEBUG4C(logTIME) << "TIME_REQUEST received";
+
+                /* time_next frame is time */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing time";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                /* convert time frame to nanoseconds */
+                current->request_granted = fncs::to_time(frame, current->binary_protocol);
+
+                /* a newer broker may add how far this sim can advance
+                 * before any input can reach it */
+                current->request_window = 0;
+                frame = zmsg_next(msg);
+                if (frame) {
+                    current->request_window = fncs::to_time(frame, current->binary_protocol);
+                    frame = zmsg_next(msg);
+                }
+
+                /* then the values queued for it, after their count; the
+                 * I/O thread has staged them already */
+                if (frame && !current->io_actor) {
+                    size_t n_values = strtoul(fncs::to_string(frame).c_str(), NULL, 10);
+                    if (zmsg_size(msg) != 4 + 2*n_values) {
+                        LERROR << "grant is missing some of its " << n_values << " value(s)";
+                        die();
+                    }
+                    else if (n_values) {
+                        current->events.reserve(n_values);
+                        /* kept as a PUBLISH_BATCH is, the type then pairs */
+                        zframe_t *type = zmsg_pop(msg);
+                        for (int j=0; j<3; ++j) {
+                            frame = zmsg_pop(msg);
+                            zframe_destroy(&frame);
+                        }
+                        zmsg_prepend(msg, &type);
+                        ++current->stats.n_messages;
+                        current->received.push_back(msg);
+                        msg = NULL;
+                    }
+                }
+                /* what it follows may come on the other sockets */
+                current->grant_held = !grant_follows();
+                current->request_ready = !current->grant_held;
+            }
+            else if (MSG_CAST_FENCE == message_type) {
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing sequence number";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->cast_fence = strtoull(fncs::to_string(frame).c_str(), NULL, 10);
+            }
+            else if (MSG_DIRECT_FENCE == message_type) {
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing count";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->direct_fence = strtoull(fncs::to_string(frame).c_str(), NULL, 10);
+            }
+            else if (MSG_ROLLBACK == message_type) {
+                LDEBUG4C(logTIME) << "ROLLBACK received";
+
+                /* the grant of the state to restore, then the time
+                 * granted instead of the one requested */
+                zframe_t *restore = zmsg_next(msg);
+                frame = restore ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "message missing time";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->request_restore = fncs::to_time(restore, current->binary_protocol);
+                current->request_granted = fncs::to_time(frame, current->binary_protocol);
+                current->request_window = 0;
+                current->request_rollback = true;
+                current->request_ready = true;
+            }
+            else if (MSG_GVT == message_type) {
+                LDEBUG4C(logTIME) << "GVT received";
+
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing time";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                snapshot_collect(fncs::to_time(frame, current->binary_protocol));
+            }
+            else if (MSG_TIME_DELTA == message_type) {
+                LDEBUG4C(logTIME) << "TIME_DELTA received";
+
+                /* a peer's delta changed; the window uses it from the
+                 * next grant on */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing time";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->time_peer = fncs::to_time(frame, current->binary_protocol);
+                LDEBUG2C(logCONFIG) << "time_peer is now " << current->time_peer;
+            }
+            else if (MSG_SUBSCRIBE == message_type) {
+                LDEBUG4C(logCONFIG) << "SUBSCRIBE received";
+
+                /* a sim subscribed to one of its keys at runtime; the
+                 * key, then whether it is kept as a list and as deltas */
+                zframe_t *key = zmsg_next(msg);
+                zframe_t *list = key ? zmsg_next(msg) : NULL;
+                frame = list ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "message missing key";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                publish_learned(fncs::to_string(key), zframe_streq(list, "1"),
+                        current->delta_keyframes && zframe_streq(frame, "1"));
+            }
+            else if (MSG_UNSUBSCRIBE == message_type) {
+                LDEBUG4C(logCONFIG) << "UNSUBSCRIBE received";
+
+                /* the broker refused a subscription made at runtime */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing topic";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                string topic = fncs::to_string(frame);
+                LWARNING << "broker refused the subscription to '" << topic
+                    << "', FNCS_LEASE or a declared lookahead or publish time grants"
+                    << " time windows";
+                const TopicTable::Entry *entry = current->topics.find(topic);
+                if (entry) {
+                    current->cache[entry->slot].unsubscribed = true;
+                }
+            }
+            else if (MSG_LOAD == message_type) {
+                LDEBUG4C(logTIME) << "LOAD received";
+
+                /* the round times, values queued and share waited on it */
+                zframe_t *round = zmsg_next(msg);
+                zframe_t *mean = round ? zmsg_next(msg) : NULL;
+                zframe_t *queued = mean ? zmsg_next(msg) : NULL;
+                frame = queued ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "LOAD message missing frames";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->load.time_round = strtoull(fncs::to_string(round).c_str(), NULL, 10);
+                current->load.time_round_mean = strtoull(fncs::to_string(mean).c_str(), NULL, 10);
+                current->load.n_queued = strtoull(fncs::to_string(queued).c_str(), NULL, 10);
+                current->load.waiting_share = atof(fncs::to_string(frame).c_str());
+                current->load_due = true;
+            }
+            else if (MSG_DICTIONARY == message_type) {
+                LDEBUG4C(logCONFIG) << "DICTIONARY received";
+
+                /* a value the broker numbered, told before anyone may
+                 * send its code; the code, then the value */
+                zframe_t *code = zmsg_next(msg);
+                frame = code ? zmsg_next(msg) : NULL;
+                if (!frame) {
+                    LERROR << "message missing value";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                size_t added = current->dictionary.add(fncs::to_string(frame));
+                if (added != strtoul(fncs::to_string(code).c_str(), NULL, 10)) {
+                    LERROR << "value coded " << fncs::to_string(code)
+                        << " by the broker is " << added << " here";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+            }
+            else if (MSG_PUBLISH == message_type) {
+                LDEBUG4C(logPUBLISH) << "PUBLISH received";
+
+                /* next frame is topic */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing topic";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+
+                /* next frame is value payload */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing value";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+
+                /* the frames are read in place once the grant arrives */
+                ++current->stats.n_messages;
+                current->received.push_back(msg);
+                msg = NULL;
+            }
+            else if (MSG_CHECKPOINT == message_type) {
+                LDEBUG4C(logTIME) << "CHECKPOINT received";
+
+                /* next frame is the time about to be granted */
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    LERROR << "message missing time";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                    zmsg_destroy(&msg);
+                    break;
+                }
+                current->time_checkpoint = fncs::to_time(frame, current->binary_protocol);
+                checkpoint_save();
+            }
+            else if (MSG_PUBLISH_BATCH == message_type) {
+                LDEBUG4C(logPUBLISH) << "PUBLISH_BATCH received";
+
+                /* remaining frames are topic and value pairs */
+                if (zmsg_size(msg) % 2 == 0) {
+                    LERROR << "message missing value for the last topic";
+                    die();
+                    current->request_granted = current->request_next;
+                    current->request_ready = true;
+                }
+                else {
+                    ++current->stats.n_messages;
+                    current->received.push_back(msg);
+                    msg = NULL;
+                }
+            }
+            else {
+                LERROR << "unrecognized message type";
+                die();
+                current->request_granted = current->request_next;
+                current->request_ready = true;
+            }
+
+            zmsg_destroy(&msg);
+        }
+    }
+
+    return current->request_ready;
+}
+
+
+fncs::time fncs::time_request(fncs::time time_next)
+{
+    LDEBUG4C(logTIME) << "fncs::time_request(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return time_next;
+    }
+
+    time_request_async(time_next);
+    return time_request_wait();
+}
+
+
+void fncs::time_request_async(fncs::time time_next)
+{
+    LDEBUG4C(logTIME) << "fncs::time_request_async(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    RequestTimer timer(current->stats.time_requesting);
+    FNCS_PROBE1(time_request, time_next);
+
+    if (current->request_pending) {
+        LERROR << "time request already pending";
+        die();
+        return;
+    }
+
+    fncs::time time_passed;
+    /* the promise covers this request only */
+    fncs::time time_next_publish = current->time_next_publish;
+    current->time_next_publish = 0;
+
+    /* send TIME_REQUEST */
+    LDEBUG2C(logTIME) << "sending TIME_REQUEST of " << time_next << " in sim units";
+    time_next *= current->time_delta_multiplier;
+
+    /* on error the request completes at once with the requested time */
+    current->request_pending = true;
+    current->request_ready = true;
+    current->request_local = true;
+    current->request_next = time_next;
+    current->request_granted = time_next;
+    current->request_window = 0;
+
+    if (time_next % current->time_delta != 0) {
+        LERROR << "time request "
+            << time_next
+            << " ns is not a multiple of time delta ("
+            << current->time_delta
+            << " ns)!";
+        die();
+        return;
+    }
+
+    if (time_next < current->time_current) {
+        LERROR << "time request "
+            << time_next
+            << " ns is smaller than the current time ("
+            << current->time_current
+            << " ns)!";
+        die();
+        return;
+    }
+
+    /* an idle sim steps no finer than its stride; the broker still wakes
+     * it on its own delta for a value */
+    if (current->time_stride > current->time_delta) {
+        fncs::time step = (current->time_current / current->time_stride + 1)
+            * current->time_stride;
+        if (time_next < step) {
+            LDEBUG2C(logTIME) << "idle, requesting " << step << " ns instead";
+            time_next = step;
+            current->request_next = time_next;
+            current->request_granted = time_next;
+        }
+    }
+
+    time_passed = time_next - current->time_current;
+    LDEBUG2C(logTIME) << "time advanced " << time_passed << " ns since last request";
+
+    /* sending of the time request implies we are done with the cache
+     * list, but the other cache remains as a last value cache */
+    /* only clear the vectors associated with cache list keys because
+     * the keys should remain valid i.e. empty lists are meaningful */
+    current->events.clear();
+    current->changed.clear();
+    for (cache_t::iterator it=current->cache.begin(); it!=current->cache.end(); ++it) {
+        it->list_clear();
+        it->changed = false;
+    }
+    current->arena.bytes.clear();
+
+    if (time_passed < current->time_window) {
+        current->time_window -= time_passed;
+        LDEBUG1C(logTIME) << "there are " << current->time_window << " nanoseconds left in the window";
+        ++current->stats.n_local;
+        return;
+    }
+    else {
+        LDEBUG1C(logTIME) << "time_window expired";
+        current->time_window = 0;
+    }
+
+    /* gathered publishes must reach the broker before the request */
+    flush_publish_batch();
+    send_direct_counts();
+
+    LDEBUG1C(logTIME) << "sending TIME_REQUEST of " << time_next << " nanoseconds";
+    if (current->time_period && !time_next_publish && current->broker_granted
+            && current->time_current == current->time_granted_broker
+            && time_next == current->time_granted_broker + current->time_period) {
+        /* the standing request stands for it, see set_periodic() */
+        send_type(current->client, MSG_TIME_REQUEST, current->binary_protocol, false);
+    }
+    else {
+        send_type(current->client, MSG_TIME_REQUEST, current->binary_protocol, true);
+        send_time(current->client, time_next, current->binary_protocol, true);
+        if (time_next_publish) {
+            send_time(current->client, current->time_current, current->binary_protocol, true);
+            send_time(current->client, time_next_publish, current->binary_protocol, false);
+        }
+        else {
+            send_time(current->client, current->time_current, current->binary_protocol, false);
+        }
+    }
+
+    current->request_ready = false;
+    current->request_local = false;
+    ++current->stats.n_requests;
+}
+
+
+bool fncs::time_request_poll()
+{
+    LDEBUG4C(logTIME) << "fncs::time_request_poll()";
+
+    if (!current->request_pending) {
+        LWARNING << "no time request pending";
+        return false;
+    }
+
+    RequestTimer timer(current->stats.time_requesting);
+    return receive_grant(0);
+}
+
+
+/* Count every update of the grant against its slot and list each slot
+ * updated once, so that readers do not dedupe the events themselves. */
+static void note_changes()
+{
+    vector<fncs::Key> &changed = current->changed;
+    for (size_t i=0; i<current->events.size(); ++i) {
+        fncs::Key key = current->events[i];
+        CacheSlot &slot = current->cache[key];
+        ++slot.version;
+        if (!slot.changed) {
+            slot.changed = true;
+            changed.push_back(key);
+        }
+    }
+    sort(changed.begin(), changed.end());
+    /* prioritized keys are read and called back first */
+    if (current->prioritized) {
+        vector<fncs::Key> &rest = current->changed_rest;
+        size_t n = 0;
+        rest.clear();
+        for (size_t i=0; i<changed.size(); ++i) {
+            if (current->cache[changed[i]].priority) {
+                changed[n++] = changed[i];
+            }
+            else {
+                rest.push_back(changed[i]);
+            }
+        }
+        copy(rest.begin(), rest.end(), changed.begin() + n);
+    }
+    for (size_t i=0; i<changed.size(); ++i) {
+        CacheSlot &slot = current->cache[changed[i]];
+        if (slot.history.times.empty()) {
+            continue;
+        }
+        /* the last value of the step, or each value of a list */
+        fncs::time time = fncs::convert_broker_to_sim_time(current->time_current);
+        if (slot.in_list) {
+            for (size_t j=0; j<slot.entries.size(); ++j) {
+                slot.history.push(time, current->arena.at(slot.entries[j].offset),
+                        slot.entries[j].size);
+            }
+        }
+        else {
+            const string &value = slot.text();
+            slot.history.push(time, value.data(), value.size());
+        }
+    }
+}
+
+
+/* Call back for the keys updated at the grant, once the state is that
+ * of the new step. Indexes, not iterators: a callback may register
+ * another one. */
+static void notify_updates()
+{
+    for (size_t i=0; i<current->changed.size(); ++i) {
+        fncs::Key key = current->changed[i];
+        for (size_t j=0; j<current->cache[key].listeners.size(); ++j) {
+            const Listener &listener = current->cache[key].listeners[j];
+            listener.first(key, listener.second);
+        }
+        for (size_t j=0; j<current->any_listeners.size(); ++j) {
+            const Listener &listener = current->any_listeners[j];
+            listener.first(key, listener.second);
+        }
+    }
+}
+
+
+static void publish_value(fncs::Key key, const string &value);
+static void publish_value(const string &key, const string &value);
+
+/* run by a thread of the pool, or this one */
+static void step_agent(size_t agent, void *)
+{
+    agent_outbox = &current->agent_outboxes[agent];
+    current->agent_step(agent, current->agent_time, current->agent_data);
+    agent_outbox = NULL;
+}
+
+/* Step the agents of set_agents() for the grant, then send what they
+ * published in order of agent, whichever thread stepped them. */
+static void step_agents(fncs::time time_granted)
+{
+    vector<AgentOutbox> &outboxes = current->agent_outboxes;
+    if (outboxes.empty()) {
+        return;
+    }
+    current->agent_time = time_granted;
+    if (current->agent_pool) {
+        current->agent_pool->run(outboxes.size(), step_agent, NULL);
+    }
+    else {
+        for (size_t i=0; i<outboxes.size(); ++i) {
+            step_agent(i, NULL);
+        }
+    }
+    for (size_t i=0; i<outboxes.size(); ++i) {
+        for (size_t j=0; j<outboxes[i].size(); ++j) {
+            const AgentPublish &published = outboxes[i][j];
+            if (published.key != fncs::INVALID_KEY) {
+                publish_value(published.key, published.value);
+            }
+            else {
+                publish_value(published.name, published.value);
+            }
+        }
+        outboxes[i].clear();
+    }
+}
+
+
+fncs::time fncs::time_request_wait()
+{
+    LDEBUG4C(logTIME) << "fncs::time_request_wait()";
+
+    if (!current->request_pending) {
+        LWARNING << "no time request pending";
+        return convert_broker_to_sim_time(current->time_current);
+    }
+
+    RequestTimer timer(current->stats.time_requesting);
+    receive_grant(-1);
+    current->request_pending = false;
+
+    fncs::time time_granted = current->request_granted;
+
+    FNCS_PROBE1(grant, time_granted);
+    if (current->load_due) {
+        current->load.time_granted = convert_broker_to_sim_time(time_granted);
+        current->load_due = false;
+    }
+    LDEBUG1C(logTIME) << "time_granted " << time_granted << " nanoseonds";
+
+    current->time_current = time_granted;
+    if (!current->request_local) {
+        current->time_granted_broker = time_granted;
+        current->broker_granted = true;
+    }
+
+    /* the state this step starts from, before its values apply */
+    if (current->optimistic) {
+        if (current->request_rollback) {
+            current->request_rollback = false;
+            if (!snapshot_restore(current->request_restore, time_granted)) {
+                die();
+            }
+        }
+        else {
+            snapshot_save(time_granted);
+        }
+    }
+
+    /* values that arrived with the grant become visible together */
+    {
+        RequestTimer dispatching(current->stats.time_dispatching);
+        for (size_t i=0; i<current->received.size(); ++i) {
+            zmsg_t *msg = current->received[i];
+            zmsg_first(msg); /* message type */
+            for (zframe_t *frame = zmsg_next(msg); frame; frame = zmsg_next(msg)) {
+                zframe_t *topic = frame;
+                frame = zmsg_next(msg);
+                if (!frame) {
+                    break; /* a PUBLISH with trailing frames */
+                }
+                ++current->stats.n_values;
+                current->stats.bytes_received += zframe_size(frame);
+                cache_publish(topic, frame);
+            }
+            zmsg_destroy(&msg);
+        }
+        current->received.clear();
+        if (current->staged) {
+            current->staged->apply();
+            delete current->staged;
+            current->staged = NULL;
+        }
+        note_changes();
+    }
+    if (current->cache_export) {
+        export_cache(time_granted);
+    }
+
+    /* the stride doubles every idle_limit steps without values, and
+     * falls back to the delta with the first one */
+    if (current->time_stride_max) {
+        if (!current->events.empty()) {
+            if (current->time_stride > current->time_delta) {
+                LDEBUG2C(logTIME) << "values received, stepping by the time delta again";
+            }
+            current->time_stride = current->time_delta;
+            current->idle_steps = 0;
+        }
+        else if (++current->idle_steps >= current->idle_limit
+                && current->time_stride * 2 <= current->time_stride_max) {
+            current->time_stride *= 2;
+            current->idle_steps = 0;
+            LDEBUG2C(logTIME) << "idle, stepping by " << current->time_stride << " ns";
+        }
+    }
+
+    /* a step inside the time window keeps the window it had; an
+     * optimistic sim has none, it is not held back anyway */
+    if (!current->request_local && !current->optimistic) {
+        /* the peers this sim interacts with have a larger 'tick' */
+        if (current->time_peer > current->time_delta) {
+            /* If we were granted a time that is evenly divisible by our
+             * peer time, we can't create a time window just yet -- if the
+             * peer published we wouldn't get the message until after the
+             * window expired which would be too late. */
+            if (current->time_current % current->time_peer != 0) {
+                /* how much time is left before reaching the peers' time? */
+                current->time_window = current->time_peer - (current->time_current % current->time_peer);
+                LDEBUG1C(logTIME) << "new time_window of " << current->time_window << " nanoseconds";
+            }
+        }
+
+        /* the broker knows the lookahead of our publishers */
+        if (current->request_window > current->time_window) {
+            current->time_window = current->request_window;
+            LDEBUG1C(logTIME) << "granted time_window of " << current->time_window << " nanoseconds";
+        }
+    }
+
+    notify_updates();
+
+    /* convert nanoseonds to sim's time unit */
+    time_granted = convert_broker_to_sim_time(time_granted);
+    LDEBUG2C(logTIME) << "time_granted " << time_granted << " in sim units";
+
+    step_agents(time_granted);
+
+    return time_granted;
+}
+
+
+/* publish a string or an encoded typed value under its prebuilt topic */
+static void publish_now(fncs::Key key, const string &value)
+{
+    PublishTopic &published = current->publish_topics[key];
+    if (published.delta) {
+        bool keyframe = (0 == published.n_sent++ % current->delta_keyframes);
+        send_publish(published.frame, fncs::delta_encode(published.base, keyframe, value));
+    }
+    else if (current->publish_coalescing && !published.in_list) {
+        coalesce_publish(published.frame, value);
+    }
+    else {
+        send_publish(published.frame, value);
+    }
+    LDEBUG4C(logPUBLISH) << "sent PUBLISH '" << published.topic << "'='"
+        << fncs::value_to_string(value.data(), value.size()) << "'";
+}
+
+/* Worker threads may publish when FNCS_PUBLISH_THREADS is set: values
+ * are queued under a lock, which keeps each thread's order, and the
+ * thread calling time_request() sends them. Nothing else in the state
+ * is written, and the key table is then not modified after initialize(),
+ * see pattern_key(). An agent's values wait in its outbox instead. */
+static void publish_value(fncs::Key key, const string &value)
+{
+    if (agent_outbox) {
+        agent_outbox->push_back(AgentPublish(key, string(), value));
+        return;
+    }
+    if (current->publish_threads) {
+        fncs::MutexLock lock(current->threaded_mutex);
+        current->threaded.push_back(make_pair(key, value));
+        return;
+    }
+    publish_now(key, value);
+}
+
+/* the first key pattern other sims subscribed to that the key matches */
+static const PublishPattern* match_publish_pattern(const string &key)
+{
+    for (size_t i=0; i<current->publish_patterns.size(); ++i) {
+        if (fncs::glob_match(current->publish_patterns[i].key, key)) {
+            return &current->publish_patterns[i];
+        }
+    }
+    return NULL;
+}
+
+/* The handle of a key, which a key matched only by a pattern is given
+ * when first published, so it is matched once; INVALID_KEY if nobody
+ * subscribed to it. Adds to the key table, so it is called only by the
+ * thread calling time_request(). */
+static fncs::Key pattern_key(const string &key)
+{
+    const fncs::TopicTable::Entry *entry = current->publish_slots.find(key);
+    if (entry) {
+        return entry->slot;
+    }
+    const PublishPattern *pattern = match_publish_pattern(key);
+    if (!pattern) {
+        return fncs::INVALID_KEY;
+    }
+    fncs::Key slot = current->publish_topics.size();
+    current->publish_slots.insert(key, slot, pattern->in_list);
+    current->publish_topics.push_back(PublishTopic(
+                current->simulation_name + '/' + key, pattern->in_list, pattern->delta));
+    return slot;
+}
+
+/* the handle of a key, when the key table may be added to */
+static fncs::Key publish_key(const string &key)
+{
+    if (current->publish_threads || agent_outbox) {
+        const fncs::TopicTable::Entry *entry = current->publish_slots.find(key);
+        return entry ? entry->slot : fncs::INVALID_KEY;
+    }
+    return pattern_key(key);
+}
+
+/* the value is dropped when no other sim subscribed to the key */
+static void publish_value(const string &key, const string &value)
+{
+    const fncs::TopicTable::Entry *entry = current->publish_slots.find(key);
+    if (entry) {
+        publish_value(entry->slot, value);
+    }
+    else if (current->publish_patterns.empty()) {
+        LDEBUG4C(logPUBLISH) << "dropped " << key;
+    }
+    else if (current->publish_threads || agent_outbox) {
+        /* given its handle by the thread that sends it */
+        if (!match_publish_pattern(key)) {
+            LDEBUG4C(logPUBLISH) << "dropped " << key;
+        }
+        else if (agent_outbox) {
+            agent_outbox->push_back(AgentPublish(fncs::INVALID_KEY, key, value));
+        }
+        else {
+            fncs::MutexLock lock(current->threaded_mutex);
+            current->threaded_keys.push_back(make_pair(key, value));
+        }
+    }
+    else {
+        fncs::Key slot = pattern_key(key);
+        if (slot == fncs::INVALID_KEY) {
+            LDEBUG4C(logPUBLISH) << "dropped " << key;
+            return;
+        }
+        publish_now(slot, value);
+    }
+}
+
+/* typed values go out as binary frames, or as text to a broker that
+ * did not negotiate the binary protocol */
+static void publish_typed(const string &key, const fncs::TypedValue &value)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (current->binary_protocol) {
+        publish_value(key, fncs::encode_typed(value));
+    }
+    else {
+        publish_value(key, fncs::format_typed(value));
+    }
+}
+
+
+/* publish_typed() by handle, see fncs::publish(Key, const string&) */
+static void publish_typed(fncs::Key key, const fncs::TypedValue &value)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (key >= current->publish_topics.size()) {
+        LDEBUG4C(logPUBLISH) << "dropped key handle " << key;
+        return;
+    }
+    if (current->binary_protocol) {
+        publish_value(key, fncs::encode_typed(value));
+    }
+    else {
+        publish_value(key, fncs::format_typed(value));
+    }
+}
+
+
+void fncs::publish(const string &key, const string &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish(string,string)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    publish_value(key, value);
+}
+
+
+fncs::Key fncs::lookup_publish_key(const string &key)
+{
+    return publish_key(key);
+}
+
+
+void fncs::publish(Key key, const string &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish(Key,string)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (key >= current->publish_topics.size()) {
+        LDEBUG4C(logPUBLISH) << "dropped key handle " << key;
+        return;
+    }
+    publish_value(key, value);
+}
+
+
+void fncs::publish(const string &key, const void *data, size_t size)
+{
+    publish(key, encode_bytes(data, size));
+}
+
+
+void fncs::publish(Key key, const void *data, size_t size)
+{
+    publish(key, encode_bytes(data, size));
+}
+
+
+void fncs::publish_double(const string &key, double value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_double(string,double)";
+
+    TypedValue typed;
+    typed.type = VALUE_DOUBLE;
+    typed.real = value;
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_int64(const string &key, long long value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_int64(string,long long)";
+
+    TypedValue typed;
+    typed.type = VALUE_INT64;
+    typed.integer = value;
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_complex(const string &key, const complex<double> &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_complex(string,complex<double>)";
+
+    TypedValue typed;
+    typed.type = VALUE_COMPLEX;
+    typed.real = value.real();
+    typed.imag = value.imag();
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_array(const string &key, const double *values, size_t n)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_array(string,double*," << n << ")";
+
+    TypedValue typed;
+    typed.type = VALUE_ARRAY;
+    typed.array.assign(values, values + n);
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_double(Key key, double value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_double(Key,double)";
+
+    TypedValue typed;
+    typed.type = VALUE_DOUBLE;
+    typed.real = value;
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_int64(Key key, long long value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_int64(Key,long long)";
+
+    TypedValue typed;
+    typed.type = VALUE_INT64;
+    typed.integer = value;
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_complex(Key key, const complex<double> &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_complex(Key,complex<double>)";
+
+    TypedValue typed;
+    typed.type = VALUE_COMPLEX;
+    typed.real = value.real();
+    typed.imag = value.imag();
+    publish_typed(key, typed);
+}
+
+
+void fncs::publish_array(Key key, const double *values, size_t n)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_array(Key,double*," << n << ")";
+
+    TypedValue typed;
+    typed.type = VALUE_ARRAY;
+    typed.array.assign(values, values + n);
+    publish_typed(key, typed);
+}
+
+
+/* the payload of a record, or its JSON for the string protocol */
+static string record_payload(const fncs::RecordBuilder &record)
+{
+    string payload;
+    record.encode(payload);
+    if (!current->binary_protocol) {
+        return fncs::format_record(payload.data(), payload.size());
+    }
+    return payload;
+}
+
+
+void fncs::publish_record(const string &key, const RecordBuilder &record)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_record(string,RecordBuilder)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    publish_value(key, record_payload(record));
+}
+
+
+void fncs::publish_record(Key key, const RecordBuilder &record)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_record(Key,RecordBuilder)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (key >= current->publish_topics.size()) {
+        LDEBUG4C(logPUBLISH) << "dropped key handle " << key;
+        return;
+    }
+    publish_value(key, record_payload(record));
+}
+
+
+void fncs::publish_at(const string &key, const string &value, fncs::time delivery)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_at(string,string,time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    Key slot = publish_key(key);
+    if (slot == INVALID_KEY) {
+        LDEBUG4C(logPUBLISH) << "dropped " << key;
+        return;
+    }
+
+    delivery *= current->time_delta_multiplier;
+    if (delivery <= current->time_current) {
+        publish_value(slot, value);
+        return;
+    }
+
+    if (!current->broker_negotiated) {
+        LERROR << "broker does not support publish_at";
+        die();
+        return;
+    }
+    if (current->request_pending) {
+        /* the broker would hold it against the previous grant */
+        LERROR << "cannot publish '" << key << "' while a time request is pending";
+        die();
+        return;
+    }
+
+    const string &topic = current->publish_topics[slot].topic;
+    send_type(current->client, MSG_PUBLISH_AT, current->binary_protocol, true);
+    zstr_sendm(current->client, topic.c_str());
+    zmq_send(zsock_resolve(current->client), value.data(), value.size(), ZMQ_SNDMORE);
+    send_time(current->client, delivery, current->binary_protocol, false);
+    LDEBUG4C(logPUBLISH) << "sent PUBLISH_AT '" << topic << "'='" << value
+        << "' for " << delivery << " ns";
+}
+
+
+void fncs::publish_anon(const string &key, const string &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_anon(string,string)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    const string &topic = current->replica.empty() ? key : replica_topic(key);
+    if (current->anon_filtered && !current->subscribed.may_match(topic)) {
+        LDEBUG4C(logPUBLISH) << "dropped anon " << topic;
+        return;
+    }
+    send_publish(topic, value);
+    LDEBUG4C(logPUBLISH) << "sent PUBLISH anon '" << topic << "'='" << value << "'";
+}
+
+
+void fncs::publish_anon(const string &key, const void *data, size_t size)
+{
+    publish_anon(key, encode_bytes(data, size));
+}
+
+
+void fncs::publish_member(const string &member, const string &key, const string &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::publish_member(string,string,string)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (!binary_search(current->members.begin(), current->members.end(), member)) {
+        LERROR << "'" << member << "' is not a member of " << current->simulation_name;
+        die();
+        return;
+    }
+    /* built in place of the last one, allocating only to grow */
+    string &topic = current->route_key;
+    topic.assign(member).append(1, '/').append(key);
+    if (current->anon_filtered && !current->subscribed.may_match(topic)) {
+        LDEBUG4C(logPUBLISH) << "dropped " << topic;
+        return;
+    }
+    send_publish(topic, value);
+    LDEBUG4C(logPUBLISH) << "sent PUBLISH '" << topic << "'='" << value << "'";
+}
+
+
+void fncs::publish_member(const string &member, const string &key,
+        const void *data, size_t size)
+{
+    publish_member(member, key, encode_bytes(data, size));
+}
+
+
+void fncs::route(
+        const string &from,
+        const string &to,
+        const string &key,
+        const string &value)
+{
+    LDEBUG4C(logPUBLISH) << "fncs::route(string,string,string,string)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    /* built in place of the last one, allocating only to grow */
+    string &new_key = current->route_key;
+    new_key.assign(current->simulation_name).append(1, '/').append(from)
+        .append(1, '@').append(to).append(1, '/').append(key);
+    if (current->anon_filtered && !current->subscribed.may_match(new_key)) {
+        LDEBUG4C(logPUBLISH) << "dropped " << new_key;
+        return;
+    }
+    send_publish(new_key, value);
+    LDEBUG4C(logPUBLISH) << "sent PUBLISH '" << new_key << "'='" << value << "'";
+}
+
+
+void fncs::route(
+        const string &from,
+        const string &to,
+        const string &key,
+        const void *data,
+        size_t size)
+{
+    route(from, to, key, encode_bytes(data, size));
+}
+
+
+void fncs::die()
+{
+    LDEBUG4 << "fncs::die()";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+    }
+
+    if (current->publish_batch) {
+        zmsg_destroy(&current->publish_batch);
+    }
+    current->coalesced.clear();
+    current->coalesced_index.clear();
+    {
+        fncs::MutexLock lock(current->threaded_mutex);
+        current->threaded.clear();
+        current->threaded_keys.clear();
+    }
+
+    if (current->client) {
+        send_type(current->client, MSG_DIE, current->binary_protocol, false);
+        client_destroy();
+        if (0 == n_clients) {
+            fncs::stop_async_logging();
+            zsys_shutdown(); /* without this, Windows will hang */
+        }
+    }
+
+    current->is_initialized_ = false;
+
+    if (current->die_is_fatal) {
+        fncs::stop_async_logging();
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* append the stats to FNCS_STATS_FILE, if set, one sim per line */
+static size_t string_bytes(const string &text)
+{
+    return sizeof(string) + text.capacity();
+}
+
+/* Count the bytes the client holds into stats. Capacities are counted,
+ * not sizes, since that is what a long run keeps. */
+static void memory_count(fncs::Stats &stats)
+{
+    unsigned long long cache = current->cache.capacity() * sizeof(CacheSlot);
+    unsigned long long lists = current->arena.bytes.capacity();
+    unsigned long long pending = 0;
+
+    for (size_t i=0; i<current->cache.size(); ++i) {
+        const CacheSlot &slot = current->cache[i];
+        cache += slot.key.capacity() + slot.value.capacity() + slot.blob.capacity()
+            + slot.json.capacity() + slot.record.capacity() + slot.topic.capacity();
+        cache += slot.history.times.capacity() * sizeof(fncs::time);
+        for (size_t h=0; h<slot.history.values.size(); ++h) {
+            cache += string_bytes(slot.history.values[h]);
+        }
+        lists += slot.entries.capacity() * sizeof(ListEntry);
+        for (size_t v=0; v<slot.values.size(); ++v) {
+            lists += string_bytes(slot.values[v]);
+        }
+    }
+    for (size_t i=0; i<current->snapshots.size(); ++i) {
+        const vector<string> &values = current->snapshots[i].values;
+        for (size_t v=0; v<values.size(); ++v) {
+            cache += string_bytes(values[v]);
+        }
+    }
+    for (map<string,string>::const_iterator it=current->list_bases.begin();
+            it!=current->list_bases.end(); ++it) {
+        lists += string_bytes(it->first) + string_bytes(it->second);
+    }
+    for (size_t i=0; i<current->coalesced.size(); ++i) {
+        pending += string_bytes(current->coalesced[i].first)
+            + string_bytes(current->coalesced[i].second);
+    }
+    if (current->publish_batch) {
+        pending += zmsg_content_size(current->publish_batch);
+    }
+    for (size_t i=0; i<current->publish_topics.size(); ++i) {
+        pending += current->publish_topics[i].base.capacity();
+    }
+    cache += current->route_nodes.bytes();
+    stats.bytes_cache = cache;
+    stats.bytes_lists = lists;
+    stats.bytes_pending = pending;
+}
+
+static void stats_write()
+{
+    const char *env_stats_file = getenv("FNCS_STATS_FILE");
+    fncs::Stats stats = current->stats;
+
+    if (!env_stats_file) {
+        return;
+    }
+    memory_count(stats);
+    ofstream out(env_stats_file, ios::app);
+    out << "{\"name\":\"";
+    for (size_t i=0; i<current->simulation_name.size(); ++i) {
+        char c = current->simulation_name[i];
+        if (c == '"' || c == '\\') {
+            out << '\\';
+        }
+        out << c;
+    }
+    out << "\",\"requests\":" << stats.n_requests
+        << ",\"local\":" << stats.n_local
+        << ",\"requesting_ns\":" << stats.time_requesting
+        << ",\"blocked_ns\":" << stats.time_blocked
+        << ",\"dispatching_ns\":" << stats.time_dispatching
+        << ",\"messages\":" << stats.n_messages
+        << ",\"values\":" << stats.n_values
+        << ",\"bytes\":" << stats.bytes_received
+        << ",\"cache_bytes\":" << stats.bytes_cache
+        << ",\"list_bytes\":" << stats.bytes_lists
+        << ",\"pending_bytes\":" << stats.bytes_pending
+        << "}\n";
+    out.close();
+    if (!out) {
+        LWARNING << "could not write FNCS_STATS_FILE '" << env_stats_file << "'";
+    }
+}
+
+
+static void finalize_client(bool detach);
+
+void fncs::finalize()
+{
+    LDEBUG4 << "fncs::finalize()";
+
+    finalize_client(false);
+}
+
+
+void fncs::finalize_detached()
+{
+    LDEBUG4 << "fncs::finalize_detached()";
+
+    finalize_client(true);
+}
+
+
+/* Say BYE and wait for the broker's, which comes once every sim said
+ * BYE, or at once when detaching, then release the client. */
+static void finalize_client(bool detach)
+{
+    using namespace fncs;
+	bool recBye = false;
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    zmsg_t *msg = NULL;
+    zframe_t *frame = NULL;
+
+    flush_publish_batch();
+    send_direct_counts();
+    send_type(current->client, MSG_BYE, current->binary_protocol, true);
+    send_time(current->client, current->time_current, current->binary_protocol, detach);
+    if (detach) {
+        zstr_send(current->client, DETACH);
+    }
+
+    /* receive BYE and perhaps other message types */
+    zmq_pollitem_t items[] = { { zsock_resolve(current->client), 0, ZMQ_POLLIN, 0 } };
+    while(!recBye){
+		/* receive BYE back */
+    	int rc = 0;
+
+		LDEBUG4 << "entering blocking poll";
+		rc = zmq_poll(items, 1, -1);
+		if (rc == -1) {
+			LERROR << "client polling error: " << strerror(errno);
+			die(); /* interrupted */
+			return;
+		}
+        if (items[0].revents & ZMQ_POLLIN) {
+            zmsg_t *msg = NULL;
+            zframe_t *frame = NULL;
+            MessageType message_type;
+
+            LDEBUG4 << "incoming message";
+            msg = zmsg_recv(current->client);
+            if (!msg) {
+                LERROR << "null message received";
+                die();
+                return;
+            }
+
+            /* first frame is message type identifier */
+            frame = zmsg_first(msg);
+            if (!frame) {
+                LERROR << "message missing type identifier";
+                die();
+                return;
+            }
+            message_type = fncs::to_type(frame);
+
+            if (MSG_TIME_REQUEST == message_type) {
+                LERROR << "TIME_REQUEST received. Calling die.";
+                die();
+                return;
+            }
+            else if (MSG_PUBLISH == message_type
+                    || MSG_PUBLISH_BATCH == message_type) {
+                LDEBUG2 << "PUBLISH received and ignored.";
+            }
+            else if (MSG_GVT == message_type) {
+                LDEBUG4 << "GVT received and ignored.";
+            }
+            else if (MSG_TIME_DELTA == message_type) {
+                LDEBUG4 << "TIME_DELTA received and ignored.";
+            }
+            else if (MSG_SUBSCRIBE == message_type) {
+                LDEBUG4 << "SUBSCRIBE received and ignored.";
+            }
+            else if (MSG_UNSUBSCRIBE == message_type) {
+                LDEBUG4 << "UNSUBSCRIBE received and ignored.";
+            }
+            else if (MSG_DICTIONARY == message_type) {
+                LDEBUG4 << "DICTIONARY received and ignored.";
+            }
+            else if (MSG_LOAD == message_type) {
+                LDEBUG4 << "LOAD received and ignored.";
+            }
+            else if(MSG_DIE == message_type){
+                LERROR << "DIE received.";
+                die();
+                return;
+            }
+            else if(MSG_BYE == message_type){
+            	LDEBUG4 << "BYE received.";
+            	recBye = true;
+            }
+            else{
+            	LERROR << "Unknown message type received! Sending DIE.";
+            	die();
+            	return;
+            }
+
+            zmsg_destroy(&msg);
+        }
+    }
+
+    stats_write();
+    client_destroy();
+    if (0 == n_clients) {
+        fncs::stop_async_logging();
+        zsys_shutdown(); /* without this, Windows will hang */
+    }
+
+    current->is_initialized_ = false;
+}
+
+
+void fncs::update_time_delta(fncs::time delta)
+{
+    LDEBUG4C(logTIME) << "fncs::update_time_delta(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    /* send TIME_DELTA */
+    LDEBUG4C(logTIME) << "sending TIME_DELTA of " << delta << " in sim units";
+    delta *= current->time_delta_multiplier;
+    LDEBUG4C(logTIME) << "sending TIME_DELTA of " << delta << " nanoseconds";
+    send_type(current->client, MSG_TIME_DELTA, current->binary_protocol, true);
+    send_time(current->client, delta, current->binary_protocol, false);
+}
+
+
+void fncs::set_lookahead(fncs::time lookahead)
+{
+    LDEBUG4C(logTIME) << "fncs::set_lookahead(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (!current->broker_negotiated) {
+        LWARNING << "broker does not support lookahead, ignored";
+        return;
+    }
+
+    /* values that take effect later are held by the broker until
+     * then, so from now on they all go through it */
+    if (lookahead && !current->direct_routes.empty()) {
+        send_direct_counts();
+        current->direct_routes.clear();
+    }
+
+    /* send LOOKAHEAD */
+    LDEBUG4C(logTIME) << "sending LOOKAHEAD of " << lookahead << " in sim units";
+    lookahead *= current->time_delta_multiplier;
+    LDEBUG4C(logTIME) << "sending LOOKAHEAD of " << lookahead << " nanoseconds";
+    send_type(current->client, MSG_LOOKAHEAD, current->binary_protocol, true);
+    send_time(current->client, lookahead, current->binary_protocol, false);
+}
+
+
+void fncs::set_periodic(fncs::time period)
+{
+    LDEBUG4C(logTIME) << "fncs::set_periodic(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (!current->broker_negotiated || current->optimistic) {
+        LWARNING << "broker does not support standing requests, ignored";
+        return;
+    }
+
+    if (current->request_pending) {
+        LERROR << "cannot change the period while a time request is pending";
+        die();
+        return;
+    }
+
+    period *= current->time_delta_multiplier;
+    if (period % current->time_delta != 0) {
+        LERROR << "period " << period
+            << " ns is not a multiple of time delta ("
+            << current->time_delta << " ns)!";
+        die();
+        return;
+    }
+
+    /* send PERIODIC */
+    LDEBUG4C(logTIME) << "sending PERIODIC of " << period << " nanoseconds";
+    send_type(current->client, MSG_PERIODIC, current->binary_protocol, true);
+    send_time(current->client, period, current->binary_protocol, false);
+    current->time_period = period;
+}
+
+
+void fncs::set_rollback(RollbackCallback save, RollbackCallback restore,
+        RollbackCallback discard, void *data)
+{
+    LDEBUG4C(logTIME) << "fncs::set_rollback(...)";
+
+    if (current->is_initialized_) {
+        LWARNING << "set_rollback() must be called before initialize(), ignored";
+        return;
+    }
+
+    if (!save || !restore) {
+        LWARNING << "set_rollback() needs a save and a restore callback, ignored";
+        return;
+    }
+
+    current->rollback_save = save;
+    current->rollback_restore = restore;
+    current->rollback_discard = discard;
+    current->rollback_data = data;
+}
+
+
+void fncs::set_next_publish(fncs::time next)
+{
+    LDEBUG4C(logTIME) << "fncs::set_next_publish(fncs::time)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    /* older brokers ignore the extra TIME_REQUEST frame */
+    current->time_next_publish = next * current->time_delta_multiplier;
+    LDEBUG4C(logTIME) << "next publish at " << current->time_next_publish << " nanoseconds";
+}
+
+
+ostream& operator << (ostream& os, zframe_t *self) {
+    assert (self);
+    assert (zframe_is (self));
+
+    byte *data = zframe_data (self);
+    size_t size = zframe_size (self);
+
+    //  Probe data to check if it looks like unprintable binary
+    int is_bin = 0;
+    uint char_nbr;
+    for (char_nbr = 0; char_nbr < size; char_nbr++)
+        if (data [char_nbr] < 9 || data [char_nbr] > 127)
+            is_bin = 1;
+
+    size_t buffer_size = 31;
+    buffer_size += is_bin? size*2 : size;
+    char *buffer = (char*)zmalloc(buffer_size);
+    snprintf (buffer, 30, "[%03d] ", (int) size);
+    for (char_nbr = 0; char_nbr < size; char_nbr++) {
+        if (is_bin)
+            sprintf (buffer + strlen (buffer), "%02X", (unsigned char) data [char_nbr]);
+        else
+            sprintf (buffer + strlen (buffer), "%c", data [char_nbr]);
+    }
+
+    os << buffer;
+
+    return os;
+}
+
+
+/* A time unit by name, and how many nanoseconds it is. */
+struct TimeUnit {
+    const char *name;
+    fncs::time multiplier;
+};
+
+static const fncs::time NS_PER_S = 1000000000ULL;
+
+static const TimeUnit TIME_UNITS[] = {
+    {"d", 24ULL * 60ULL * 60ULL * NS_PER_S},
+    {"day", 24ULL * 60ULL * 60ULL * NS_PER_S},
+    {"days", 24ULL * 60ULL * 60ULL * NS_PER_S},
+    {"h", 60ULL * 60ULL * NS_PER_S},
+    {"hour", 60ULL * 60ULL * NS_PER_S},
+    {"hours", 60ULL * 60ULL * NS_PER_S},
+    {"m", 60ULL * NS_PER_S},
+    {"min", 60ULL * NS_PER_S},
+    {"minute", 60ULL * NS_PER_S},
+    {"minutes", 60ULL * NS_PER_S},
+    {"s", NS_PER_S},
+    {"sec", NS_PER_S},
+    {"second", NS_PER_S},
+    {"seconds", NS_PER_S},
+    {"ms", 1000000ULL},
+    {"msec", 1000000ULL},
+    {"millisec", 1000000ULL},
+    {"millisecond", 1000000ULL},
+    {"milliseconds", 1000000ULL},
+    {"us", 1000ULL},
+    {"usec", 1000ULL},
+    {"microsec", 1000ULL},
+    {"microsecond", 1000ULL},
+    {"microseconds", 1000ULL},
+    {"ns", 1ULL},
+    {"nsec", 1ULL},
+    {"nanosec", 1ULL},
+    {"nanosecond", 1ULL},
+    {"nanoseconds", 1ULL}
+};
+
+/* Sends every name of TIME_UNITS to its own slot of 64, so that a unit
+ * is found with a single comparison; check the table when adding one. */
+static size_t time_unit_hash(const char *name, size_t size)
+{
+    size_t third = size > 2 ? static_cast<unsigned char>(name[2]) : 0;
+    return (size*7 + static_cast<unsigned char>(name[0])*21 + third
+            + static_cast<unsigned char>(name[size-1])) & 63;
+}
+
+class TimeUnitTable {
+    public:
+        TimeUnitTable() {
+            for (size_t i=0; i<64; ++i) {
+                slots[i] = NULL;
+            }
+            for (size_t i=0; i<sizeof(TIME_UNITS)/sizeof(TIME_UNITS[0]); ++i) {
+                const char *name = TIME_UNITS[i].name;
+                size_t slot = time_unit_hash(name, strlen(name));
+                assert(!slots[slot]);
+                slots[slot] = &TIME_UNITS[i];
+            }
+        }
+
+        const TimeUnit* find(const char *name, size_t size) const {
+            const TimeUnit *unit = slots[time_unit_hash(name, size)];
+            if (unit && 0 == strncmp(unit->name, name, size) && !unit->name[size]) {
+                return unit;
+            }
+            return NULL;
+        }
+
+    private:
+        const TimeUnit *slots[64];
+};
+
+static const TimeUnitTable time_units;
+
+/* Read a number and the unit after it, with or without space between
+ * them, as the time parsers take them. Anything after the unit is
+ * ignored. */
+static bool split_time(const char *text, fncs::time &value, const TimeUnit *&unit)
+{
+    const fncs::time max = static_cast<fncs::time>(-1);
+    const char *p = text;
+
+    while (isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    if (!isdigit(static_cast<unsigned char>(*p))) {
+        return false;
+    }
+    value = 0;
+    for (; isdigit(static_cast<unsigned char>(*p)); ++p) {
+        fncs::time digit = *p - '0';
+        if (value > (max - digit) / 10) {
+            return false;
+        }
+        value = value*10 + digit;
+    }
+    while (isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    const char *name = p;
+    while (*p && !isspace(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    if (p == name) {
+        return false;
+    }
+    unit = time_units.find(name, p - name);
+    return unit != NULL;
+}
+
+
+bool fncs::try_parse_time(const char *text, fncs::time &out)
+{
+    fncs::time value = 0;
+    const TimeUnit *unit = NULL;
+
+    if (!split_time(text, value, unit)) {
+        return false;
+    }
+    if (value && unit->multiplier > static_cast<fncs::time>(-1) / value) {
+        return false;
+    }
+    out = value * unit->multiplier;
+    return true;
+}
+
+
+bool fncs::try_time_unit(const char *text, fncs::time &out)
+{
+    fncs::time value = 0;
+    const TimeUnit *unit = NULL;
+
+    if (!split_time(text, value, unit)) {
+        return false;
+    }
+    out = unit->multiplier;
+    return true;
+}
+
+
+fncs::time fncs::time_unit_to_multiplier(const string &value)
+{
+    LDEBUG4C(logCONFIG) << "fncs::time_unit_to_multiplier(string)";
+
+    fncs::time retval = 0;
+
+    if (!try_time_unit(value.c_str(), retval)) {
+        LERROR << "could not parse the time unit of '" << value << "'";
+        die();
+    }
+
+    return retval;
+}
+
+
+bool fncs::glob_match(const string &pattern, const string &text)
+{
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = string::npos; /* pattern index after the last '*' */
+    size_t resume = 0; /* text index that '*' matched up to */
+
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        }
+        else if (p < pattern.size() && pattern[p] == '*') {
+            star = ++p;
+            resume = t;
+        }
+        else if (star != string::npos) {
+            /* let the last '*' take one more character */
+            p = star;
+            t = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+
+bool fncs::is_topic_pattern(const string &topic)
+{
+    return topic.find_first_of("*?") != string::npos;
+}
+
+
+fncs::time fncs::parse_time(const string &value)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_time(string)";
+
+    fncs::time retval = 0;
+
+    if (!try_parse_time(value.c_str(), retval)) {
+        LERROR << "could not parse time '" << value << "'";
+        die();
+    }
+
+    return retval;
+}
+
+
+fncs::Config fncs::parse_config(const string &configuration)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_config(string)";
+
+    zchunk_t *zchunk = NULL;
+    zconfig_t *zconfig = NULL;
+    fncs::Config config;
+    bool is_zpl = false;
+
+    /* if we detect '=' in the first line, we assume zpl */
+    {
+        istringstream is(configuration);
+        string line;
+        getline(is, line);
+        is_zpl = (line.find('=') != string::npos);
+    }
+
+    if (is_zpl) {
+        /* create a zchunk for parsing */
+        zchunk = zchunk_new(configuration.c_str(), configuration.size());
+        /* open and parse fncs configuration */
+        zconfig = zconfig_chunk_load(zchunk);
+        if (!zconfig) {
+            cerr << "could not load ZPL configuration string" << endl;
+            cerr << "-- configuration was as follows --" << endl;
+            cerr << configuration << endl;
+        }
+        else {
+            zchunk_destroy(&zchunk);
+            config = parse_config(zconfig);
+            zconfig_destroy(&zconfig);
+        }
+    }
+    else {
+        /* attempt to load as a YAML document */
+        try {
+            istringstream sin(configuration);
+            YAML::Parser parser(sin);
+            YAML::Node doc;
+            parser.GetNextDocument(doc);
+            config = parse_config(doc);
+        } catch (YAML::ParserException &) {
+            cerr << "could not load YAML configuration string" << endl;
+            cerr << "-- configuration was as follows --" << endl;
+            cerr << configuration << endl;
+        }
+    }
+
+    return config;
+}
+
+
+fncs::Config fncs::parse_config(const YAML::Node &doc)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_config(YAML::Node)";
+
+    fncs::Config config;
+
+    if (const YAML::Node *node = doc.FindValue("name")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'name' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.name;
+        }
+    }
+
+    if (const YAML::Node *node = doc.FindValue("broker")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'broker' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.broker;
+        }
+    }
+
+    if (const YAML::Node *node = doc.FindValue("time_delta")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'time_delta' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.time_delta;
+        }
+    }
+
+    if (const YAML::Node *node = doc.FindValue("lookahead")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'lookahead' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.lookahead;
+        }
+    }
+
+    if (const YAML::Node *node = doc.FindValue("fatal")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'fatal' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.fatal;
+        }
+    }
+
+    if (const YAML::Node *node = doc.FindValue("members")) {
+        if (node->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'members' must be a Scalar" << endl;
+        }
+        else {
+            *node >> config.members;
+        }
+    }
+
+    /* parse subscriptions */
+    if (const YAML::Node *node = doc.FindValue("values")) {
+        config.values = parse_values(*node);
+    }
+
+    return config;
+}
+
+
+fncs::Config fncs::parse_config(zconfig_t *zconfig)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_config(zconfig_t*)";
+
+    fncs::Config config;
+    zconfig_t *config_values = NULL;
+
+    /* read sim name from zconfig */
+    config.name = zconfig_resolve(zconfig, "/name", "");
+
+    /* read broker location from config */
+    config.broker = zconfig_resolve(zconfig, "/broker", "");
+
+    /* read time delta from config */
+    config.time_delta = zconfig_resolve(zconfig, "/time_delta", "");
+
+    /* read lookahead from config */
+    config.lookahead = zconfig_resolve(zconfig, "/lookahead", "");
+
+    /* read whether die() is fatal from zconfig */
+    config.fatal = zconfig_resolve(zconfig, "/fatal", "");
+
+    /* read the members of a compound federate from zconfig */
+    config.members = zconfig_resolve(zconfig, "/members", "");
+
+    /* parse subscriptions */
+    config_values = zconfig_locate(zconfig, "/values");
+    if (config_values) {
+        config.values = parse_values(config_values);
+    }
+
+    return config;
+}
+
+
+fncs::Subscription fncs::parse_value(const YAML::Node &node)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_value(YAML::Node)";
+
+    /* a "value" block for a FNCS subscription looks like this
+    foo:                    # lookup key, optional topic
+        topic:  some_topic  # required iff topic did not appear earlier
+        default:  10        # optional; default value
+        type:  int          # optional; currently unused; data type
+        list:  false        # optional; defaults to "false"
+        deadband:  0.001    # optional; broker drops smaller changes
+        on_change:  false   # optional; broker drops repeated values
+        wake:  true         # optional; false caches values without waking
+        min_interval:  1s   # optional; broker forwards at most one value per interval
+        every_nth:  10      # optional; broker forwards every nth value
+        pull:  false        # optional; value fetched from the broker when read
+        priority:  high     # optional; values sent and called back first
+    */
+
+    fncs::Subscription sub;
+
+    if (const YAML::Node *child = node.FindValue("topic")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'topic' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.topic;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("default")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'default' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.def;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("type")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'type' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.type;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("list")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'list' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.list;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("deadband")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'deadband' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.deadband;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("on_change")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'on_change' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.on_change;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("wake")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'wake' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.wake;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("min_interval")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'min_interval' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.min_interval;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("every_nth")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'every_nth' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.every_nth;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("pull")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'pull' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.pull;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("history")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'history' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.history;
+        }
+    }
+
+    if (const YAML::Node *child = node.FindValue("priority")) {
+        if (child->Type() != YAML::NodeType::Scalar) {
+            cerr << "YAML 'priority' must be a Scalar" << endl;
+        }
+        else {
+            *child >> sub.priority;
+        }
+    }
+
+    return sub;
+}
+
+
+fncs::Subscription fncs::parse_value(zconfig_t *config)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_value(zconfig_t*)";
+
+    /* a "value" block for a FNCS subscription looks like this
+    foo [ = some_topic ]    # lookup key, optional topic
+        topic = some_topic  # required iff topic did not appear earlier
+        default = 10        # optional; default value
+        type = int          # optional; currently unused; data type
+        list = false        # optional; defaults to "false"
+        deadband = 0.001    # optional; broker drops smaller changes
+        on_change = false   # optional; broker drops repeated values
+        wake = true         # optional; false caches values without waking
+        min_interval = 1s   # optional; broker forwards at most one value per interval
+        every_nth = 10      # optional; broker forwards every nth value
+        pull = false        # optional; value fetched from the broker when read
+        priority = high     # optional; values sent and called back first
+    */
+
+    fncs::Subscription sub;
+    const char *value = NULL;
+
+    sub.key = zconfig_name(config);
+    LDEBUG4C(logCONFIG) << "parsing value with key '" << sub.key << "'";
+
+    /* check for topic attached to short key */
+    value = zconfig_value(config);
+    if (!value || 0 == strlen(value)) {
+        LDEBUG4C(logCONFIG) << "key did not have topic attached";
+        /* check for a 'topic' subheading */
+        value = zconfig_resolve(config, "topic", NULL);
+    }
+    if (!value || 0 == strlen(value)) {
+        LDEBUG4C(logCONFIG) << "key did not have 'topic' subheading";
+        /* default is to use short key as subscription */
+        sub.topic = sub.key;
+    }
+    else {
+        sub.topic = value;
+    }
+    LDEBUG4C(logCONFIG) << "parsing key '" << sub.key << "' topic '" << sub.topic << "'";
+
+    value = zconfig_resolve(config, "default", NULL);
+    if (!value) {
+        LDEBUG4C(logCONFIG) << "parsing value '" << sub.key << "', missing 'default'";
+    }
+    sub.def = value? value : "";
+
+    value = zconfig_resolve(config, "type", NULL);
+    if (!value) {
+        LDEBUG4C(logCONFIG) << "parsing value '" << sub.key << "', missing 'type'";
+    }
+    sub.type = value? value : "";
+
+    value = zconfig_resolve(config, "list", NULL);
+    if (!value) {
+        LDEBUG4C(logCONFIG) << "parsing value '" << sub.key << "', missing 'list'";
+    }
+    sub.list = value? value : "";
+
+    value = zconfig_resolve(config, "deadband", NULL);
+    sub.deadband = value? value : "";
+
+    value = zconfig_resolve(config, "on_change", NULL);
+    sub.on_change = value? value : "";
+
+    value = zconfig_resolve(config, "wake", NULL);
+    sub.wake = value? value : "";
+
+    value = zconfig_resolve(config, "min_interval", NULL);
+    sub.min_interval = value? value : "";
+
+    value = zconfig_resolve(config, "every_nth", NULL);
+    sub.every_nth = value? value : "";
+
+    value = zconfig_resolve(config, "pull", NULL);
+    sub.pull = value? value : "";
+
+    value = zconfig_resolve(config, "history", NULL);
+    sub.history = value? value : "";
+
+    value = zconfig_resolve(config, "priority", NULL);
+    sub.priority = value? value : "";
+
+    return sub;
+}
+
+
+vector<fncs::Subscription> fncs::parse_values(const YAML::Node &node)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_values(YAML::Node)";
+
+    vector<fncs::Subscription> subs;
+
+    if (YAML::NodeType::Sequence == node.Type()) {
+        for (YAML::Iterator it=node.begin(); it!=node.end(); ++it) {
+            fncs::Subscription sub;
+            const YAML::Node &child = *it;
+            if (YAML::NodeType::Scalar == child.Type()) {
+                child >> sub.key;
+                child >> sub.topic;
+            }
+            else if (YAML::NodeType::Map == child.Type()) {
+                for (YAML::Iterator it2=child.begin();
+                        it2!=child.end(); ++it2) {
+                    if (YAML::NodeType::Scalar == it2.second().Type()) {
+                        it2.first() >> sub.key;
+                        it2.second() >> sub.topic;
+                    }
+                    else if (YAML::NodeType::Map == it2.second().Type()) {
+                        sub = parse_value(it2.second());
+                        it2.first() >> sub.key;
+                    }
+                }
+            }
+            subs.push_back(sub);
+        }
+    }
+    else if (YAML::NodeType::Map == node.Type()) {
+        for (YAML::Iterator it=node.begin(); it!=node.end(); ++it) {
+            fncs::Subscription sub;
+            if (YAML::NodeType::Scalar == it.second().Type()) {
+                it.first() >> sub.key;
+                it.second() >> sub.topic;
+            }
+            if (YAML::NodeType::Map == it.second().Type()) {
+                sub = parse_value(it.second());
+                it.first() >> sub.key;
+            }
+            subs.push_back(sub);
+        }
+    }
+
+    return subs;
+}
+
+
+vector<fncs::Subscription> fncs::parse_values(zconfig_t *config)
+{
+    LDEBUG4C(logCONFIG) << "fncs::parse_values(zconfig_t*)";
+
+    vector<fncs::Subscription> subs;
+    string name;
+    zconfig_t *child = NULL;
+
+    name = zconfig_name(config);
+    if (name != "values") {
+        LERROR << "error parsing 'values', wrong config object '" << name << "'";
+        die();
+        return subs;
+    }
+
+    child = zconfig_child(config);
+    while (child) {
+        subs.push_back(parse_value(child));
+        child = zconfig_next(child);
+    }
+
+    return subs;
+}
+
+
+string fncs::to_string(zframe_t *frame)
+{
+    return string((const char *)zframe_data(frame), zframe_size(frame));
+}
+
+
+void fncs::to_string(zframe_t *frame, string &out)
+{
+    out.assign((const char *)zframe_data(frame), zframe_size(frame));
+}
+
+
+const char * fncs::to_string(fncs::MessageType type)
+{
+    switch (type) {
+        case MSG_HELLO:         return HELLO;
+        case MSG_ACK:           return ACK;
+        case MSG_TIME_REQUEST:  return TIME_REQUEST;
+        case MSG_PUBLISH:       return PUBLISH;
+        case MSG_DIE:           return DIE;
+        case MSG_BYE:           return BYE;
+        case MSG_TIME_DELTA:    return TIME_DELTA;
+        case MSG_PUBLISH_BATCH: return PUBLISH_BATCH;
+        case MSG_LOOKAHEAD:     return LOOKAHEAD;
+        case MSG_CHECKPOINT:    return CHECKPOINT;
+        case MSG_PUBLISH_AT:    return PUBLISH_AT;
+        case MSG_ROLLBACK:      return ROLLBACK;
+        case MSG_GVT:           return GVT;
+        case MSG_PERIODIC:      return PERIODIC;
+        case MSG_CAST_FENCE:    return CAST_FENCE;
+        case MSG_DIRECT_COUNTS: return DIRECT_COUNTS;
+        case MSG_DIRECT_FENCE:  return DIRECT_FENCE;
+        case MSG_FETCH:         return FETCH;
+        case MSG_SUBSCRIBE:     return SUBSCRIBE;
+        case MSG_UNSUBSCRIBE:   return UNSUBSCRIBE;
+        case MSG_DICTIONARY:    return DICTIONARY;
+        case MSG_LOAD:          return LOAD;
+        default:                return "unknown";
+    }
+}
+
+
+fncs::MessageType fncs::to_type(zframe_t *frame)
+{
+    size_t size = zframe_size(frame);
+    const char *data = (const char *)zframe_data(frame);
+
+    if (1 == size) {
+        /* binary protocol sends the identifier as a single byte */
+        unsigned char code = static_cast<unsigned char>(data[0]);
+        if (code >= MSG_HELLO && code <= MSG_LAST) {
+            return static_cast<MessageType>(code);
+        }
+        return MSG_UNKNOWN;
+    }
+
+    /* string protocol; compare in place to avoid a temporary string */
+    for (int code=MSG_HELLO; code<=MSG_LAST; ++code) {
+        const char *name = to_string(static_cast<MessageType>(code));
+        if (strlen(name) == size && 0 == memcmp(name, data, size)) {
+            return static_cast<MessageType>(code);
+        }
+    }
+
+    return MSG_UNKNOWN;
+}
+
+
+bool fncs::try_to_time(zframe_t *frame, bool binary, fncs::time &value)
+{
+    size_t size = zframe_size(frame);
+    const unsigned char *data = zframe_data(frame);
+
+    value = 0;
+    if (binary) {
+        if (size != 8) {
+            LERROR << "binary time frame must be 8 bytes, got " << size;
+            return false;
+        }
+        for (int i=7; i>=0; --i) {
+            value = (value << 8) | data[i];
+        }
+    }
+    else {
+        /* decimal text, not necessarily NUL terminated */
+        for (size_t i=0; i<size; ++i) {
+            if (data[i] < '0' || data[i] > '9') {
+                LERROR << "invalid time frame '" << fncs::to_string(frame) << "'";
+                value = 0;
+                return false;
+            }
+            value = value * 10 + (data[i] - '0');
+        }
+    }
+
+    return true;
+}
+
+
+fncs::time fncs::to_time(zframe_t *frame, bool binary)
+{
+    fncs::time value = 0;
+
+    if (!try_to_time(frame, binary, value)) {
+        die();
+    }
+
+    return value;
+}
+
+
+int fncs::send_type(zsock_t *sock, fncs::MessageType type, bool binary, bool more)
+{
+    if (binary) {
+        unsigned char code = static_cast<unsigned char>(type);
+        return zmq_send(zsock_resolve(sock), &code, 1, more ? ZMQ_SNDMORE : 0) == 1 ? 0 : -1;
+    }
+
+    if (more) {
+        return zstr_sendm(sock, to_string(type));
+    }
+    return zstr_send(sock, to_string(type));
+}
+
+
+int fncs::send_time(zsock_t *sock, fncs::time value, bool binary, bool more)
+{
+    if (binary) {
+        unsigned char data[8];
+        for (int i=0; i<8; ++i) {
+            data[i] = static_cast<unsigned char>(value >> (8*i));
+        }
+        return zmq_send(zsock_resolve(sock), data, 8, more ? ZMQ_SNDMORE : 0) == 8 ? 0 : -1;
+    }
+
+    if (more) {
+        return zstr_sendfm(sock, "%llu", (unsigned long long)value);
+    }
+    return zstr_sendf(sock, "%llu", (unsigned long long)value);
+}
+
+
+static void put_u64(char *out, unsigned long long value)
+{
+    for (int i=0; i<8; ++i) {
+        out[i] = static_cast<char>(value >> (8*i));
+    }
+}
+
+static unsigned long long get_u64(const unsigned char *data)
+{
+    unsigned long long value = 0;
+    for (int i=7; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/* the bit patterns of doubles travel as little-endian integers */
+static unsigned long long double_bits(double value)
+{
+    unsigned long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(unsigned long long bits)
+{
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* shortest of %.15g to %.17g that reads back as the same double */
+static string format_double(double value)
+{
+    char buffer[32];
+    for (int precision=15; precision<17; ++precision) {
+        snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (strtod(buffer, NULL) == value) {
+            return buffer;
+        }
+    }
+    snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return buffer;
+}
+
+
+string fncs::encode_typed(const fncs::TypedValue &value)
+{
+    string out;
+    switch (value.type) {
+        case VALUE_DOUBLE:
+            out.resize(10);
+            put_u64(&out[2], double_bits(value.real));
+            break;
+        case VALUE_INT64:
+            out.resize(10);
+            put_u64(&out[2], static_cast<unsigned long long>(value.integer));
+            break;
+        case VALUE_COMPLEX:
+            out.resize(18);
+            put_u64(&out[2], double_bits(value.real));
+            put_u64(&out[10], double_bits(value.imag));
+            break;
+        case VALUE_ARRAY:
+            out.resize(2 + 8*value.array.size());
+            for (size_t i=0; i<value.array.size(); ++i) {
+                put_u64(&out[2+8*i], double_bits(value.array[i]));
+            }
+            break;
+        default:
+            return format_typed(value);
+    }
+    out[0] = '\0';
+    out[1] = static_cast<char>(value.type);
+    return out;
+}
+
+
+string fncs::encode_bytes(const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char*>(data);
+    if (0 == size || bytes[0] != '\0') {
+        return string(bytes, size);
+    }
+    string out(2, '\0');
+    out[1] = static_cast<char>(VALUE_BYTES);
+    out.append(bytes, size);
+    return out;
+}
+
+
+bool fncs::decode_typed(const void *data, size_t size, fncs::TypedValue &value)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+    value.type = VALUE_STRING;
+    if (size < 2 || bytes[0] != 0) {
+        return false;
+    }
+    if (VALUE_DOUBLE == bytes[1] && 10 == size) {
+        value.real = bits_double(get_u64(bytes+2));
+        value.imag = 0.0;
+    }
+    else if (VALUE_INT64 == bytes[1] && 10 == size) {
+        value.integer = static_cast<long long>(get_u64(bytes+2));
+    }
+    else if (VALUE_COMPLEX == bytes[1] && 18 == size) {
+        value.real = bits_double(get_u64(bytes+2));
+        value.imag = bits_double(get_u64(bytes+10));
+    }
+    else if (VALUE_ARRAY == bytes[1] && 0 == (size-2) % 8) {
+        value.array.resize((size-2) / 8);
+        for (size_t i=0; i<value.array.size(); ++i) {
+            value.array[i] = bits_double(get_u64(bytes+2+8*i));
+        }
+        value.real = value.array.empty() ? 0.0 : value.array[0];
+        value.imag = 0.0;
+    }
+    else {
+        return false;
+    }
+    value.type = static_cast<ValueType>(bytes[1]);
+    return true;
+}
+
+
+string fncs::format_typed(const fncs::TypedValue &value)
+{
+    ostringstream os;
+    switch (value.type) {
+        case VALUE_INT64:
+            os << value.integer;
+            break;
+        case VALUE_COMPLEX:
+            os << format_double(value.real);
+            if (!(value.imag < 0.0)) {
+                os << '+';
+            }
+            os << format_double(value.imag) << 'j';
+            break;
+        case VALUE_ARRAY:
+            for (size_t i=0; i<value.array.size(); ++i) {
+                os << (i ? "," : "") << format_double(value.array[i]);
+            }
+            break;
+        default:
+            os << format_double(value.real);
+            break;
+    }
+    return os.str();
+}
+
+
+void fncs::parse_typed(const string &text, fncs::TypedValue &value)
+{
+    istringstream real_in(text);
+    istringstream integer_in(text);
+    char rest = 0;
+
+    value.type = VALUE_STRING;
+    value.real = 0.0;
+    value.imag = 0.0;
+    value.integer = 0;
+
+    /* a complex is real+imagj or real+imagi */
+    if (real_in >> value.real) {
+        if (!(real_in >> value.imag)) {
+            value.imag = 0.0;
+        }
+    }
+
+    /* integers beyond 2^53 do not survive a trip through double */
+    if (!(integer_in >> value.integer) || (integer_in >> rest)) {
+        value.integer = static_cast<long long>(value.real);
+    }
+
+    /* the comma separated fields, as other sims joined arrays */
+    value.array.clear();
+    for (size_t begin=0; begin<text.size(); ) {
+        size_t end = text.find(',', begin);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        value.array.push_back(strtod(text.substr(begin, end-begin).c_str(), NULL));
+        begin = end + 1;
+    }
+}
+
+
+string fncs::value_to_string(const void *data, size_t size)
+{
+    fncs::TypedValue value;
+    if (decode_typed(data, size, value)) {
+        return format_typed(value);
+    }
+    if (bytes_frame(data, size)) {
+        return string(static_cast<const char*>(data) + 2, size - 2);
+    }
+    if (record_frame(data, size)) {
+        return format_record(data, size);
+    }
+    return string(static_cast<const char*>(data), size);
+}
+
+
+string fncs::encode_topic_id(size_t id)
+{
+    char frame[TOPIC_ID_SIZE];
+    frame[0] = '\0';
+    for (int i=0; i<4; ++i) {
+        frame[1+i] = static_cast<char>(id >> (8*i));
+    }
+    return string(frame, TOPIC_ID_SIZE);
+}
+
+
+bool fncs::decode_topic_id(const void *data, size_t size, size_t &id)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+    if (size != TOPIC_ID_SIZE || bytes[0] != 0) {
+        return false;
+    }
+    id = 0;
+    for (int i=3; i>=0; --i) {
+        id = (id << 8) | bytes[1+i];
+    }
+    return true;
+}
+
+
+void fncs::append_manifest(string &manifest, const string &name,
+        bool is_list, const string &filter, bool wakes, bool priority)
+{
+    put_config_string(manifest, name);
+    manifest.append(1, static_cast<char>((is_list ? 1 : 0)
+                | (filter.empty() ? 0 : 2) | (wakes ? 0 : 4) | (priority ? 8 : 0)));
+    if (!filter.empty()) {
+        put_config_string(manifest, filter);
+    }
+}
+
+
+/* the length prefixed string at offset, which it advances */
+static bool get_manifest_string(const unsigned char *bytes, size_t size,
+        size_t &offset, string &value)
+{
+    size_t length = 0;
+    if (size - offset < 4) {
+        return false;
+    }
+    for (int i=3; i>=0; --i) {
+        length = (length << 8) | bytes[offset+i];
+    }
+    offset += 4;
+    if (size - offset < length) {
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(bytes + offset), length);
+    offset += length;
+    return true;
+}
+
+
+bool fncs::expand_members(const string &spec, vector<string> &members)
+{
+    istringstream in(spec);
+    string item;
+    members.clear();
+    while (getline(in, item, ',')) {
+        size_t begin = item.find_first_not_of(" \t");
+        size_t end = item.find_last_not_of(" \t");
+        if (begin == string::npos) {
+            continue;
+        }
+        item = item.substr(begin, end - begin + 1);
+        size_t open = item.find('[');
+        if (open == string::npos) {
+            if (item.find_first_of("]/*?") != string::npos) {
+                return false;
+            }
+            members.push_back(item);
+            continue;
+        }
+        /* prefix[first-last] */
+        unsigned long first = 0;
+        unsigned long last = 0;
+        char close = '\0';
+        char extra = '\0';
+        string prefix = item.substr(0, open);
+        if (prefix.find_first_of("]/*?") != string::npos
+                || 3 != sscanf(item.c_str() + open, "[%lu-%lu%c%c",
+                    &first, &last, &close, &extra) || close != ']' || first > last) {
+            return false;
+        }
+        for (unsigned long n=first; n<=last; ++n) {
+            ostringstream name;
+            name << prefix << n;
+            members.push_back(name.str());
+        }
+    }
+    return true;
+}
+
+
+string fncs::resolve_endpoints(const string &endpoints)
+{
+    static const string SHM("shm://");
+    string resolved;
+    size_t begin = 0;
+
+    while (begin <= endpoints.size()) {
+        size_t end = endpoints.find(',', begin);
+        if (end == string::npos) {
+            end = endpoints.size();
+        }
+        string endpoint = endpoints.substr(begin, end - begin);
+        /* czmq's bind and connect prefixes */
+        size_t scheme = (!endpoint.empty()
+                && (endpoint[0] == '@' || endpoint[0] == '>')) ? 1 : 0;
+        if (endpoint.compare(scheme, SHM.size(), SHM) == 0) {
+            string name = endpoint.substr(scheme + SHM.size());
+            string path;
+            if (!name.empty() && name[0] == '/') {
+                path = name;
+            }
+            else {
+#if defined(_WIN32)
+                const char *tmpdir = getenv("TEMP");
+                path = string(tmpdir ? tmpdir : ".") + "\\fncs-" + name + ".ipc";
+#else
+                const char *tmpdir = getenv("TMPDIR");
+                path = string(tmpdir ? tmpdir : "/tmp") + "/fncs-" + name + ".ipc";
+#endif
+            }
+            endpoint = endpoint.substr(0, scheme) + "ipc://" + path;
+        }
+        if (!resolved.empty()) {
+            resolved += ',';
+        }
+        resolved += endpoint;
+        begin = end + 1;
+    }
+    return resolved;
+}
+
+
+bool fncs::parse_manifest(const void *data, size_t size,
+        vector<pair<string,bool> > &entries)
+{
+    vector<string> filters;
+    return parse_manifest(data, size, entries, filters);
+}
+
+
+bool fncs::parse_manifest(const void *data, size_t size,
+        vector<pair<string,bool> > &entries, vector<string> &filters)
+{
+    vector<bool> wakes;
+    return parse_manifest(data, size, entries, filters, wakes);
+}
+
+
+bool fncs::parse_manifest(const void *data, size_t size,
+        vector<pair<string,bool> > &entries, vector<string> &filters,
+        vector<bool> &wakes)
+{
+    vector<bool> priorities;
+    return parse_manifest(data, size, entries, filters, wakes, priorities);
+}
+
+
+bool fncs::parse_manifest(const void *data, size_t size,
+        vector<pair<string,bool> > &entries, vector<string> &filters,
+        vector<bool> &wakes, vector<bool> &priorities)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    size_t offset = 0;
+    while (offset < size) {
+        string name;
+        if (!get_manifest_string(bytes, size, offset, name) || offset == size) {
+            return false;
+        }
+        unsigned char flags = bytes[offset++];
+        entries.push_back(make_pair(string(), (flags & 1) != 0));
+        entries.back().first.swap(name);
+        wakes.push_back((flags & 4) == 0);
+        priorities.push_back((flags & 8) != 0);
+        filters.push_back(string());
+        if ((flags & 2) && !get_manifest_string(bytes, size, offset, filters.back())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+vector<string> fncs::get_events()
+{
+    LDEBUG4C(logCACHE) << "fncs::get_events() [" << current->events.size() << "]";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return vector<string>();
+    }
+
+    /* names are materialized only for callers of this copying API */
+    vector<string> event_keys;
+    event_keys.reserve(current->events.size());
+    for (size_t i=0; i<current->events.size(); ++i) {
+        event_keys.push_back(current->cache[current->events[i]].key);
+    }
+    return event_keys;
+}
+
+
+fncs::EventIterator fncs::events_begin()
+{
+    return current->events.begin();
+}
+
+
+fncs::EventIterator fncs::events_end()
+{
+    return current->events.end();
+}
+
+
+const string& fncs::get_key(fncs::Key key)
+{
+    static const string empty;
+
+    if (key >= current->cache.size()) {
+        LERROR << "key handle " << key << " not found in cache";
+        die();
+        return empty;
+    }
+
+    return current->cache[key].key;
+}
+
+
+/* Split the slot's topic, sim/from@to/key as route() makes it, into
+ * its routed parts. False if it is not of that form. */
+static bool split_route(CacheSlot &slot)
+{
+    const string &topic = slot.topic.empty() ? slot.key : slot.topic;
+    size_t sim = topic.find('/');
+    size_t at = sim == string::npos ? sim : topic.find('@', sim+1);
+    size_t key = at == string::npos ? at : topic.find('/', at+1);
+    if (key == string::npos) {
+        return false;
+    }
+    fncs::Routed &routed = slot.routed;
+    routed.sim.assign(topic, 0, sim);
+    routed.from.assign(topic, sim+1, at-sim-1);
+    routed.to.assign(topic, at+1, key-at-1);
+    routed.key.assign(topic, key+1, string::npos);
+    routed.from_id = current->route_nodes.intern(routed.from);
+    routed.to_id = current->route_nodes.intern(routed.to);
+    return true;
+}
+
+
+const fncs::Routed* fncs::get_routed(fncs::Key key)
+{
+    if (key >= current->cache.size()) {
+        LERROR << "key handle " << key << " not found in cache";
+        die();
+        return NULL;
+    }
+
+    CacheSlot &slot = current->cache[key];
+    if (!slot.route_split) {
+        slot.route_split = true;
+        slot.is_routed = split_route(slot);
+    }
+    return slot.is_routed ? &slot.routed : NULL;
+}
+
+
+string fncs::get_route_node(size_t id)
+{
+    if (id >= current->route_nodes.size()) {
+        return string();
+    }
+    return current->route_nodes.str(id);
+}
+
+
+size_t fncs::get_route_node_count()
+{
+    return current->route_nodes.size();
+}
+
+
+/* Fetch the value of a pulled subscription from the broker the first
+ * time it is read in a step, see fncs::PULL. It keeps its value if none
+ * was published before this step. */
+static void pull_value(CacheSlot &slot)
+{
+    if (slot.pull_topic.empty() || !current->pull
+            || (slot.pulled && slot.pull_time == current->time_current)) {
+        return;
+    }
+    LDEBUG4C(logCACHE) << "fetching '" << slot.pull_topic << "'";
+    fncs::send_type(current->pull, fncs::MSG_FETCH, current->binary_protocol, true);
+    zstr_sendm(current->pull, slot.pull_topic.c_str());
+    fncs::send_time(current->pull, current->time_current, current->binary_protocol, false);
+    zmsg_t *msg = zmsg_recv(current->pull);
+    zframe_t *type = msg ? zmsg_first(msg) : NULL;
+    zframe_t *topic = type ? zmsg_next(msg) : NULL;
+    if (!topic || fncs::MSG_FETCH != fncs::to_type(type)) {
+        LERROR << "malformed FETCH reply for '" << slot.pull_topic << "'";
+        zmsg_destroy(&msg);
+        fncs::die();
+        return;
+    }
+    zframe_t *value = zmsg_next(msg);
+    if (value) {
+        slot.value.assign(reinterpret_cast<const char*>(zframe_data(value)), zframe_size(value));
+        slot.received();
+    }
+    slot.pulled = true;
+    slot.pull_time = current->time_current;
+    ++current->stats.n_messages;
+    zmsg_destroy(&msg);
+}
+
+
+string fncs::get_value(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_value(" << key << ")";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return "";
+    }
+
+    const TopicTable::Entry *entry = current->key_slots.find(key);
+    if (!entry || !current->cache[entry->slot].in_cache) {
+        LERROR << "key '" << key << "' not found in cache";
+        die();
+        return "";
+    }
+
+    pull_value(current->cache[entry->slot]);
+    return current->cache[entry->slot].text();
+}
+
+
+vector<string> fncs::get_values(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_values(" << key << ")";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return vector<string>();
+    }
+
+    vector<string> values;
+
+    const TopicTable::Entry *entry = current->key_slots.find(key);
+    if (!entry || !current->cache[entry->slot].in_list) {
+        LERROR << "key '" << key << "' not found in cache list";
+        die();
+        return values;
+    }
+
+    values = current->cache[entry->slot].list(current->arena);
+    LDEBUG4C(logCACHE) << "key '" << key << "' has " << values.size() << " values";
+    return values;
+}
+
+
+void fncs::on_update(const string &key, fncs::UpdateCallback callback, void *data)
+{
+    LDEBUG4C(logCACHE) << "fncs::on_update(" << key << ", ...)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "on_update() must be called after initialize(), ignored";
+        return;
+    }
+
+    const TopicTable::Entry *entry = current->key_slots.find(key);
+    if (!entry) {
+        LERROR << "key '" << key << "' not found in cache";
         die();
         return;
     }
-    simulation_id = atoi(fncs::to_string(frame).c_str());
-    LDEBUG2 << "connection order ID is " << simulation_id;
 
-    /* next frame is n_sims */
-    frame = zmsg_next(msg);
-    if (!frame) {
-        LERROR << "ACK message missing n_sims";
-        die();
+    current->cache[entry->slot].listeners.push_back(Listener(callback, data));
+}
+
+
+void fncs::set_agents(size_t n, fncs::AgentStep step, void *data)
+{
+    LDEBUG4 << "fncs::set_agents(" << n << ", ...)";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    delete current->agent_pool; /* joins the threads */
+    current->agent_pool = NULL;
+    current->agent_step = step;
+    current->agent_data = data;
+    current->agent_outboxes.assign(step ? n : 0, AgentOutbox());
+    size_t n_threads = 1;
+#if HAVE_THREAD_LOCAL
+    const char *env_threads = getenv("FNCS_AGENT_THREADS");
+    n_threads = env_threads ? strtoul(env_threads, NULL, 10) : fncs::processor_count();
+    n_threads = max(size_t(1), min(n_threads, current->agent_outboxes.size()));
+    if (n_threads > 1) {
+        current->agent_pool = new fncs::WorkPool(n_threads - 1);
+        n_threads = current->agent_pool->size();
+    }
+#else
+    if (n > 1) {
+        LWARNING << "agents step on one thread, built without thread_local";
+    }
+#endif
+    LDEBUG2C(logCONFIG) << current->agent_outboxes.size() << " agents on "
+        << n_threads << " thread(s)";
+}
+
+
+/* whether the subscriptions may change now, see fncs::subscribe() */
+static bool can_resubscribe(const string &topic)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return false;
+    }
+    if (!current->broker_negotiated) {
+        LWARNING << "broker does not support subscribing at runtime, '" << topic << "' ignored";
+        return false;
+    }
+    if (fncs::is_topic_pattern(topic) || topic.find('/') == string::npos) {
+        LWARNING << "only an exact topic is subscribed at runtime, '" << topic << "' ignored";
+        return false;
+    }
+    /* the I/O thread reads the topic table, a rollback restores every slot */
+    if (current->io_actor || current->rollback_save) {
+        LWARNING << "subscriptions are fixed with FNCS_IO_THREAD or rollback, '"
+            << topic << "' ignored";
+        return false;
+    }
+    if (current->request_pending) {
+        LERROR << "cannot change subscriptions while a time request is pending";
+        fncs::die();
+        return false;
+    }
+    return true;
+}
+
+
+fncs::Key fncs::subscribe(const string &topic, const fncs::SubscribeOptions &options)
+{
+    LDEBUG4C(logCONFIG) << "fncs::subscribe(" << topic << ", ...)";
+
+    if (!can_resubscribe(topic)) {
+        return INVALID_KEY;
+    }
+
+    const fncs::TopicTable::Entry *entry = current->topics.find(topic);
+    size_t index = 0;
+    if (entry) {
+        /* subscribed before, which decided how it is kept */
+        index = entry->slot;
+        if (!current->cache[index].unsubscribed) {
+            return index;
+        }
+        if (entry->is_list != options.list) {
+            LWARNING << "'" << topic << "' is kept as it was first subscribed";
+        }
+        current->cache[index].unsubscribed = false;
+    }
+    else {
+        const string &key = options.key.empty() ? topic : options.key;
+        if (!current->key_slots.find(key)) {
+            current->mykeys.push_back(key);
+        }
+        index = cache_slot(key);
+        current->topics.insert(topic, index, options.list);
+        CacheSlot &slot = current->cache[index];
+        if (topic != key) {
+            slot.topic = topic;
+        }
+        if (options.list) {
+            slot.in_list = true;
+            slot.list_clear();
+            if (!options.def.empty()) {
+                slot.entries.push_back(ListEntry(current->arena.append(
+                                options.def.data(), options.def.size()),
+                            options.def.size()));
+                slot.listed = false;
+            }
+        }
+        else {
+            slot.in_cache = true;
+            slot.value = options.def;
+            slot.received();
+        }
+    }
+
+    /* the broker routes it from the next grant on */
+    LDEBUG2C(logCONFIG) << "subscribing to '" << topic << "' as '" << current->cache[index].key << "'";
+    send_type(current->client, MSG_SUBSCRIBE, current->binary_protocol, true);
+    zstr_sendm(current->client, topic.c_str());
+    zstr_sendm(current->client, options.list ? "1" : "0");
+    zstr_send(current->client, options.wake ? "1" : "0");
+    return index;
+}
+
+
+void fncs::unsubscribe(const string &topic)
+{
+    LDEBUG4C(logCONFIG) << "fncs::unsubscribe(" << topic << ")";
+
+    if (!can_resubscribe(topic)) {
+        return;
+    }
+
+    const fncs::TopicTable::Entry *entry = current->topics.find(topic);
+    if (!entry || current->cache[entry->slot].unsubscribed) {
+        LWARNING << "'" << topic << "' is not subscribed";
         return;
     }
-    n_sims = atoi(fncs::to_string(frame).c_str());
-    LDEBUG2 << "n_sims is " << n_sims;
+    current->cache[entry->slot].unsubscribed = true;
 
-    /* next frame is number of subscription keys */
-    frame = zmsg_next(msg);
-    if (!frame) {
-        LERROR << "ACK message missing n_keys";
+    LDEBUG2C(logCONFIG) << "unsubscribing from '" << topic << "'";
+    send_type(current->client, MSG_UNSUBSCRIBE, current->binary_protocol, true);
+    zstr_send(current->client, topic.c_str());
+}
+
+
+void fncs::on_any_update(fncs::UpdateCallback callback, void *data)
+{
+    LDEBUG4C(logCACHE) << "fncs::on_any_update(...)";
+
+    current->any_listeners.push_back(Listener(callback, data));
+}
+
+
+const vector<fncs::Key>& fncs::changed_keys()
+{
+    return current->changed;
+}
+
+
+unsigned long long fncs::version(fncs::Key key)
+{
+    if (key >= current->cache.size()) {
+        LERROR << "key handle " << key << " not found in cache";
         die();
-        return;
+        return 0;
     }
-    int n_keys = atoi(fncs::to_string(frame).c_str());
-    LDEBUG2 << "n_keys is " << n_keys;
 
-    /* next frames are the keys */
-    for (int i=0; i<n_keys; ++i) {
-        frame = zmsg_next(msg);
-        if (!frame) {
-            LERROR << "ACK message missing key " << i;
-            die();
-            return;
-        }
-        string key = fncs::to_string(frame);
-        keys.insert(key);
-        LDEBUG2 << "key is " << key;
+    return current->cache[key].version;
+}
+
+
+fncs::Key fncs::lookup_key(const string &key)
+{
+    return lookup_key(key.c_str());
+}
+
+
+fncs::Key fncs::lookup_key(const char *key)
+{
+    LDEBUG4C(logCACHE) << "fncs::lookup_key(" << key << ")";
+
+    const TopicTable::Entry *entry = current->key_slots.find(key, strlen(key));
+    if (!entry) {
+        LERROR << "key '" << key << "' not found in cache";
+        die();
+        return INVALID_KEY;
     }
 
-    /* next frame is peer time */
-    frame = zmsg_next(msg);
-    if (!frame) {
-        LERROR << "ACK message missing peer time";
+    return entry->slot;
+}
+
+
+const string& fncs::get_value(fncs::Key key)
+{
+    static const string empty;
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return empty;
+    }
+
+    if (key >= current->cache.size() || !current->cache[key].in_cache) {
+        LERROR << "key handle " << key << " not found in cache";
         die();
-        return;
+        return empty;
     }
-    long time_peer_long = atol(fncs::to_string(frame).c_str());
-    LDEBUG2 << "time_peer_long is " << time_peer_long;
-    time_peer = time_peer_long;
 
-    /* next frame is FNCS library version */
-    frame = zmsg_next(msg);
-    if (!frame) {
-        LWARNING << "HELLO message from broker missing FNCS library version";
+    pull_value(current->cache[key]);
+    return current->cache[key].text();
+}
+
+
+const vector<string>& fncs::get_values(fncs::Key key)
+{
+    static const vector<string> empty;
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return empty;
     }
-    else {
-        string version_string = fncs::to_string(frame);
-        int result[3];
-        std::istringstream parser(version_string);
-        parser >> result[0];
-        for(int idx = 1; idx < 3; idx++) {
-            parser.get(); //Skip period
-            parser >> result[idx];
+
+    if (key >= current->cache.size() || !current->cache[key].in_list) {
+        LERROR << "key handle " << key << " not found in cache list";
+        die();
+        return empty;
+    }
+
+    return current->cache[key].list(current->arena);
+}
+
+
+/* the slot of a list subscription, or NULL after dying */
+static CacheSlot* list_slot(fncs::Key key)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return NULL;
+    }
+
+    if (key >= current->cache.size() || !current->cache[key].in_list) {
+        LERROR << "key handle " << key << " not found in cache list";
+        fncs::die();
+        return NULL;
+    }
+
+    return &current->cache[key];
+}
+
+
+size_t fncs::get_values_size(fncs::Key key)
+{
+    CacheSlot *slot = list_slot(key);
+    return slot ? slot->entries.size() : 0;
+}
+
+
+const char* fncs::get_values_data(fncs::Key key, size_t index, size_t *size)
+{
+    CacheSlot *slot = list_slot(key);
+    if (!slot || index >= slot->entries.size()) {
+        return NULL;
+    }
+    if (size) {
+        *size = slot->entries[index].size;
+    }
+    return current->arena.at(slot->entries[index].offset);
+}
+
+
+fncs::History fncs::get_history(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_history(" << key << ")";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return History();
+    }
+
+    const TopicTable::Entry *entry = current->key_slots.find(key);
+    if (!entry) {
+        LERROR << "key '" << key << "' not found in cache";
+        die();
+        return History();
+    }
+    return get_history(entry->slot);
+}
+
+
+fncs::History fncs::get_history(fncs::Key key)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return History();
+    }
+
+    if (key >= current->cache.size()) {
+        LERROR << "key handle " << key << " not found in cache";
+        die();
+        return History();
+    }
+
+    const HistoryRing &ring = current->cache[key].history;
+    if (0 == ring.count) {
+        return History();
+    }
+    return History(ring.count, ring.first, ring.times.size(),
+            &ring.times[0], &ring.values[0]);
+}
+
+
+static CacheSlot* value_slot(const string &key);
+static CacheSlot* value_slot(fncs::Key key);
+
+/* a record value read in place, else one read from a text value by the
+ * fields of the subscription's type */
+static fncs::Record slot_record(CacheSlot &slot)
+{
+    slot.load();
+    if (fncs::record_frame(slot.value.data(), slot.value.size())) {
+        return fncs::Record(slot.value.data(), slot.value.size());
+    }
+    if (slot.record.empty() && !slot.fields.empty()
+            && !fncs::record_from_json(slot.text(), slot.fields, slot.record)) {
+        LWARNING << "value of '" << slot.key << "' is not a JSON object, read as an empty record";
+    }
+    return fncs::Record(slot.record.data(), slot.record.size());
+}
+
+
+fncs::Record fncs::get_record(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_record(" << key << ")";
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_record(*slot) : Record();
+}
+
+
+fncs::Record fncs::get_record(fncs::Key key)
+{
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_record(*slot) : Record();
+}
+
+
+/* the slot of a single value subscription, or NULL after dying */
+static CacheSlot* value_slot(const string &key)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return NULL;
+    }
+
+    const fncs::TopicTable::Entry *entry = current->key_slots.find(key);
+    if (!entry || !current->cache[entry->slot].in_cache) {
+        LERROR << "key '" << key << "' not found in cache";
+        fncs::die();
+        return NULL;
+    }
+
+    pull_value(current->cache[entry->slot]);
+    return &current->cache[entry->slot];
+}
+
+static CacheSlot* value_slot(fncs::Key key)
+{
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return NULL;
+    }
+
+    if (key >= current->cache.size() || !current->cache[key].in_cache) {
+        LERROR << "key handle " << key << " not found in cache";
+        fncs::die();
+        return NULL;
+    }
+
+    pull_value(current->cache[key]);
+    return &current->cache[key];
+}
+
+
+static complex<double> slot_complex(CacheSlot &slot)
+{
+    const fncs::TypedValue &value = slot.number();
+    return complex<double>(value.as_double(),
+            fncs::VALUE_INT64 == value.type ? 0.0 : value.imag);
+}
+
+
+double fncs::get_double(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_double(" << key << ")";
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot->number().as_double() : 0.0;
+}
+
+
+double fncs::get_double(fncs::Key key)
+{
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot->number().as_double() : 0.0;
+}
+
+
+long long fncs::get_int64(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_int64(" << key << ")";
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot->number().as_int64() : 0;
+}
+
+
+long long fncs::get_int64(fncs::Key key)
+{
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot->number().as_int64() : 0;
+}
+
+
+complex<double> fncs::get_complex(const string &key)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_complex(" << key << ")";
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_complex(*slot) : complex<double>();
+}
+
+
+complex<double> fncs::get_complex(fncs::Key key)
+{
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_complex(*slot) : complex<double>();
+}
+
+
+/* copies up to n elements, returning how many the value holds */
+static size_t slot_array(CacheSlot &slot, double *out, size_t n)
+{
+    const vector<double> &array = slot.number().array;
+    if (n > array.size()) {
+        n = array.size();
+    }
+    if (n) {
+        memcpy(out, &array[0], n * sizeof(double));
+    }
+    return array.size();
+}
+
+
+size_t fncs::get_array(const string &key, double *out, size_t n)
+{
+    LDEBUG4C(logCACHE) << "fncs::get_array(" << key << ")";
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_array(*slot, out, n) : 0;
+}
+
+
+size_t fncs::get_array(fncs::Key key, double *out, size_t n)
+{
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot_array(*slot, out, n) : 0;
+}
+
+
+const vector<double>& fncs::get_array(fncs::Key key)
+{
+    static const vector<double> empty;
+
+    CacheSlot *slot = value_slot(key);
+    return slot ? slot->number().array : empty;
+}
+
+
+/* append the value, or the values of the step, of a cache slot */
+static void snapshot_add(fncs::Snapshot &out, fncs::Key key)
+{
+    CacheSlot &slot = current->cache[key];
+    if (slot.in_list) {
+        for (size_t j=0; j<slot.entries.size(); ++j) {
+            const char *value = current->arena.at(slot.entries[j].offset);
+            out.keys.push_back(key);
+            out.values.insert(out.values.end(), value, value + slot.entries[j].size);
+            out.offsets.push_back(out.values.size());
         }
-        if (FNCS_VERSION_MAJOR != result[0]
-                || FNCS_VERSION_MINOR != result[1]
-                || FNCS_VERSION_PATCH != result[2]) {
-            LWARNING << "FNCS library version mismatch, client="
-                << FNCS_VERSION_MAJOR << "."
-                << FNCS_VERSION_MINOR << "."
-                << FNCS_VERSION_PATCH
-                << " broker="
-                << version_string;
+    }
+    else if (slot.in_cache) {
+        const string &value = slot.text();
+        out.keys.push_back(key);
+        out.values.insert(out.values.end(), value.begin(), value.end());
+        out.offsets.push_back(out.values.size());
+    }
+}
+
+
+void fncs::snapshot(fncs::Snapshot &out, bool changed_only)
+{
+    LDEBUG4C(logCACHE) << "fncs::snapshot(Snapshot&, " << changed_only << ")";
+
+    out.keys.clear();
+    out.values.clear();
+    out.offsets.assign(1, 0);
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return;
+    }
+
+    if (changed_only) {
+        const vector<Key> &changed = current->changed;
+        for (size_t i=0; i<changed.size(); ++i) {
+            snapshot_add(out, changed[i]);
         }
     }
+    else {
+        for (size_t i=0; i<current->cache.size(); ++i) {
+            snapshot_add(out, i);
+        }
+    }
+}
 
-    /* last frame is second ACK */
-    frame = zmsg_next(msg);
-    if (!zframe_streq(frame, ACK)) {
-        LERROR << "ACK expected, got " << frame;
-        die();
-        return;
+
+vector<string> fncs::get_keys()
+{
+    LDEBUG4C(logCACHE) << "fncs::get_keys()";
+
+    if (!current->is_initialized_) {
+        LWARNING << "fncs is not initialized";
+        return vector<string>();
     }
-    LDEBUG2 << "received second ACK";
-    zmsg_destroy(&msg);
 
-    time_current = 0;
-    time_window = 0;
-    is_initialized_ = true;
+    return current->mykeys;
 }
 
 
-bool fncs::is_initialized()
+fncs::KeyIterator fncs::keys_begin()
 {
-    return is_initialized_;
+    return current->mykeys.begin();
 }
 
 
-fncs::time fncs::time_request(fncs::time time_next)
+fncs::KeyIterator fncs::keys_end()
 {
-    LDEBUG4 << "fncs::time_request(fncs::time)";
+    return current->mykeys.end();
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return time_next;
-    }
 
-    fncs::time time_granted;
-    fncs::time time_passed;
+string fncs::get_name()
+{
+    return current->simulation_name;
+}
 
-    /* send TIME_REQUEST */
-    LDEBUG2 << "sending TIME_REQUEST of " << time_next << " in sim units";
-    time_next *= time_delta_multiplier;
 
-    if (time_next % time_delta != 0) {
-        LERROR << "time request "
-            << time_next
-            << " ns is not a multiple of time delta ("
-            << time_delta
-            << " ns)!";
-        die();
-        return time_next;
-    }
+fncs::time fncs::get_time_delta()
+{
+    return convert_broker_to_sim_time(current->time_delta);
+}
 
-    if (time_next < time_current) {
-        LERROR << "time request "
-            << time_next
-            << " ns is smaller than the current time ("
-            << time_current
-            << " ns)!";
-        die();
-        return time_next;
-    }
 
-    time_passed = time_next - time_current;
-    LDEBUG2 << "time advanced " << time_passed << " ns since last request";
+int fncs::get_id()
+{
+    return current->simulation_id;
+}
 
-    /* sending of the time request implies we are done with the cache
-     * list, but the other cache remains as a last value cache */
-    /* only clear the vectors associated with cache list keys because
-     * the keys should remain valid i.e. empty lists are meaningful */
-    events.clear();
-    for (clist_t::iterator it=cache_list.begin(); it!=cache_list.end(); ++it) {
-        it->second.clear();
-    }
 
-    if (time_passed < time_window) {
-        time_window -= time_passed;
-        LDEBUG1 << "there are " << time_window << " nanoseconds left in the window";
-        LDEBUG1 << "time_granted " << time_next << " nanoseonds";
-        time_current = time_next;
-        /* convert nanoseonds to sim's time unit */
-        time_granted = convert_broker_to_sim_time(time_next);
-        LDEBUG2 << "time_granted " << time_granted << " in sim units";
-        return time_granted;
-    }
-    else {
-        LDEBUG1 << "time_window expired";
-        time_window = 0;
-    }
+int fncs::get_simulator_count()
+{
+    return current->n_sims;
+}
 
-    LDEBUG1 << "sending TIME_REQUEST of " << time_next << " nanoseconds";
-    zstr_sendm(client, fncs::TIME_REQUEST);
-    zstr_sendfm(client, "%llu", time_next);
-    zstr_sendf(client, "%llu", time_current);
 
-    /* receive TIME_REQUEST and perhaps other message types */
-    zmq_pollitem_t items[] = { { zsock_resolve(client), 0, ZMQ_POLLIN, 0 } };
-    while (true) {
-        int rc = 0;
+fncs::Stats fncs::get_stats()
+{
+    fncs::Stats stats = current->stats;
+    memory_count(stats);
+    return stats;
+}
 
-        LDEBUG4 << "entering blocking poll";
-        rc = zmq_poll(items, 1, -1);
-        if (rc == -1) {
-            LERROR << "client polling error: " << strerror(errno);
-            die(); /* interrupted */
-            return time_next;
-        }
 
-        if (items[0].revents & ZMQ_POLLIN) {
-            zmsg_t *msg = NULL;
-            zframe_t *frame = NULL;
-            string message_type;
+fncs::FederationLoad fncs::get_federation_load()
+{
+    return current->load;
+}
 
-            LDEBUG4 << "incoming message";
-            msg = zmsg_recv(client);
-            if (!msg) {
-                LERROR << "null message received";
-                die();
-                return time_next;
-            }
 
-            /* first frame is message type identifier */
-            frame = zmsg_first(msg);
-            if (!frame) {
-                LERROR << "message missing type identifier";
-                die();
-                return time_next;
-            }
-            message_type = fncs::to_string(frame);
+fncs::time fncs::get_checkpoint()
+{
+    return convert_broker_to_sim_time(current->time_checkpoint);
+}
 
-            /* dispatcher */
-            if (fncs::TIME_REQUEST == message_type) {
-                LDEBUG4 << "TIME_REQUEST received";
 
-                /* time_next frame is time */
-                frame = zmsg_next(msg);
-                if (!frame) {
-                    LERROR << "message missing time";
-                    die();
-                    return time_next;
-                }
-                /* convert time string to nanoseconds */
-                {
-                    istringstream iss(fncs::to_string(frame));
-                    iss >> time_granted;
-                }
+int fncs::get_fd()
+{
+    if (!current->is_initialized_ || !current->client) {
+        return -1;
+    }
+    /* the I/O thread's pipe when it owns the DEALER */
+    return zsock_fd(current->client);
+}
 
-                /* destroy message early since a returned TIME_REQUEST
-                 * indicates we can move on with the break */
-                zmsg_destroy(&msg);
-                break;
-            }
-            else if (fncs::PUBLISH == message_type) {
-                string topic;
-                string value;
-                sub_string_t::const_iterator sub_str_itr;
-                fncs::Subscription subscription;
-                bool found = false;
 
-                LDEBUG4 << "PUBLISH received";
+fncs::time fncs::convert_broker_to_sim_time(fncs::time value)
+{
+    return value / current->time_delta_multiplier;
+}
 
-                /* next frame is topic */
-                frame = zmsg_next(msg);
-                if (!frame) {
-                    LERROR << "message missing topic";
-                    die();
-                    return time_next;
-                }
-                topic = fncs::to_string(frame);
+fncs::time fncs::timer_ft()
+{
+#ifdef __MACH__
+    /* OS X does not have clock_gettime, use clock_get_time */
+    clock_serv_t cclock;
+    mach_timespec_t mts;
+    host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
+    clock_get_time(cclock, &mts);
+    mach_port_deallocate(mach_task_self(), cclock);
+    return mts.tv_sec*1000000000UL + mts.tv_nsec;
+#elif defined(__FreeBSD__)
+    struct timespec ts;
+    /* Works on FreeBSD */
+    long retval = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(0 == retval);
+    return ts.tv_sec*1000000000UL + ts.tv_nsec;
+#elif defined(_WIN32)
+    static LARGE_INTEGER freq, start;
+    LARGE_INTEGER count;
+    BOOL retval;
+    retval = QueryPerformanceCounter(&count);
+    assert(retval);
+    if (!freq.QuadPart) { // one time initialization
+        retval = QueryPerformanceFrequency(&freq);
+        assert(retval);
+        start = count;
+    }
+    /* split to keep nanosecond resolution without overflowing */
+    fncs::time ticks = count.QuadPart - start.QuadPart;
+    return (ticks / freq.QuadPart) * 1000000000UL
+        + (ticks % freq.QuadPart) * 1000000000UL / freq.QuadPart;
+#else
+    struct timespec ts;
+    /* Works on Linux */
+    long retval = clock_gettime(CLOCK_REALTIME, &ts);
+    assert(0 == retval);
+    return ts.tv_sec*1000000000UL + ts.tv_nsec;
+#endif
+}
 
-                /* next frame is value payload */
-                frame = zmsg_next(msg);
-                if (!frame) {
-                    LERROR << "message missing value";
-                    die();
-                    return time_next;
-                }
-                value = fncs::to_string(frame);
+double fncs::timer()
+{
+    return double(timer_ft())/1000000000.0;
+}
 
-                /* find cache short key */
-                sub_str_itr = subs_string.find(topic);
-                if (sub_str_itr != subs_string.end()) {
-                    found = true;
-                    subscription = sub_str_itr->second;
-                }
 
-                /* if found then store in cache */
-                if (found) {
-                    events.push_back(subscription.key);
-                    if (subscription.is_list()) {
-                        cache_list[subscription.key].push_back(value);
-                        LDEBUG4 << "updated cache_list "
-                            << "key='" << subscription.key << "' "
-                            << "topic='" << topic << "' "
-                            << "value='" << value << "' "
-                            << "count=" << cache_list[subscription.key].size();
-                    } else {
-                        cache[subscription.key] = value;
-                        LDEBUG4 << "updated cache "
-                            << "key='" << subscription.key << "' "
-                            << "topic='" << topic << "' "
-                            << "value='" << value << "' ";
-                    }
-                }
-                else {
-                    LDEBUG4 << "dropping PUBLISH message topic='"
-                        << topic << "'";
-                }
+bool fncs::parse_poll(const string &value, fncs::time &spin)
+{
+    if (value == "block") {
+        spin = 0;
+        return true;
+    }
+    if (0 == value.compare(0, 5, "spin:")) {
+        return try_parse_time(value.c_str() + 5, spin);
+    }
+    return false;
+}
+
+
+int fncs::spin_poll(zmq_pollitem_t *items, int n_items, long timeout, fncs::time spin)
+{
+    if (spin) {
+        fncs::time start = timer_ft();
+        fncs::time limit = spin;
+        fncs::time elapsed = 0;
+        if (timeout >= 0 && fncs::time(timeout) * 1000000UL < limit) {
+            limit = fncs::time(timeout) * 1000000UL;
+        }
+        do {
+            int rc = zmq_poll(items, n_items, 0);
+            if (rc != 0) {
+                return rc;
             }
-            else {
-                LERROR << "unrecognized message type";
-                die();
-                return time_next;
+            elapsed = timer_ft() - start;
+        } while (elapsed < limit);
+        if (timeout >= 0) {
+            /* the spin counts against the timeout */
+            timeout -= static_cast<long>(elapsed / 1000000UL);
+            if (timeout < 0) {
+                timeout = 0;
             }
-
-            zmsg_destroy(&msg);
         }
     }
+    return zmq_poll(items, n_items, timeout);
+}
 
-    LDEBUG1 << "time_granted " << time_granted << " nanoseonds";
 
-    time_current = time_granted;
+void fncs::get_version(int *major, int *minor, int *patch)
+{
+    *major = FNCS_VERSION_MAJOR;
+    *minor = FNCS_VERSION_MINOR;
+    *patch = FNCS_VERSION_PATCH;
+}
+
+
+/* makes the given state current until the end of the scope */
+class StateSwitch {
+    public:
+        explicit StateSwitch(fncs::ClientState *state) : previous(current) {
+            current = state;
+        }
+
+        ~StateSwitch() {
+            current = previous;
+        }
+
+    private:
+        fncs::ClientState *previous;
+};
+
+
+fncs::Context::Context()
+    : state(new ClientState)
+{
+    state->in_context = true;
+}
+
 
-    /* the peers this sim interacts with have a larger 'tick' */
-    if (time_peer > time_delta) {
-        /* If we were granted a time that is evenly divisible by our
-         * peer time, we can't create a time window just yet -- if the
-         * peer published we wouldn't get the message until after the
-         * window expired which would be too late. */
-        if (time_current % time_peer != 0) {
-            /* how much time is left before reaching the peers' time? */
-            time_window = time_peer - (time_current % time_peer);
-            LDEBUG1 << "new time_window of " << time_window << " nanoseconds";
+fncs::Context::~Context()
+{
+    {
+        StateSwitch use(state);
+        if (current->publish_batch) {
+            zmsg_destroy(&current->publish_batch);
         }
+        client_destroy();
     }
+    delete state;
+}
 
-    /* convert nanoseonds to sim's time unit */
-    time_granted = convert_broker_to_sim_time(time_granted);
-    LDEBUG2 << "time_granted " << time_granted << " in sim units";
 
-    return time_granted;
+void fncs::Context::initialize()
+{
+    StateSwitch use(state);
+    fncs::initialize();
 }
 
 
-void fncs::publish(const string &key, const string &value)
+void fncs::Context::initialize(const string &configuration)
 {
-    LDEBUG4 << "fncs::publish(string,string)";
+    StateSwitch use(state);
+    fncs::initialize(configuration);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return;
-    }
 
-    if (keys.count(key)) {
-        string new_key = simulation_name + '/' + key;
-        zstr_sendm(client, fncs::PUBLISH);
-        zstr_sendm(client, new_key.c_str());
-        zstr_send(client, value.c_str());
-        LDEBUG4 << "sent PUBLISH '" << new_key << "'='" << value << "'";
-    }
-    else {
-        LDEBUG4 << "dropped " << key;
-    }
+bool fncs::Context::is_initialized()
+{
+    StateSwitch use(state);
+    return fncs::is_initialized();
 }
 
 
-void fncs::publish_anon(const string &key, const string &value)
+fncs::time fncs::Context::time_request(fncs::time next)
 {
-    LDEBUG4 << "fncs::publish_anon(string,string)";
+    StateSwitch use(state);
+    return fncs::time_request(next);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return;
-    }
 
-    zstr_sendm(client, fncs::PUBLISH);
-    zstr_sendm(client, key.c_str());
-    zstr_send(client, value.c_str());
-    LDEBUG4 << "sent PUBLISH anon '" << key << "'='" << value << "'";
+void fncs::Context::time_request_async(fncs::time next)
+{
+    StateSwitch use(state);
+    fncs::time_request_async(next);
 }
 
 
-void fncs::route(
-        const string &from,
-        const string &to,
-        const string &key,
-        const string &value)
+bool fncs::Context::time_request_poll()
 {
-    LDEBUG4 << "fncs::route(string,string,string,string)";
+    StateSwitch use(state);
+    return fncs::time_request_poll();
+}
+
+
+fncs::time fncs::Context::time_request_wait()
+{
+    StateSwitch use(state);
+    return fncs::time_request_wait();
+}
+
+
+int fncs::Context::get_fd()
+{
+    StateSwitch use(state);
+    return fncs::get_fd();
+}
+
+
+void fncs::Context::publish(const string &key, const string &value)
+{
+    StateSwitch use(state);
+    fncs::publish(key, value);
+}
+
+
+fncs::Key fncs::Context::lookup_publish_key(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::lookup_publish_key(key);
+}
+
+
+void fncs::Context::publish(fncs::Key key, const string &value)
+{
+    StateSwitch use(state);
+    fncs::publish(key, value);
+}
+
+
+void fncs::Context::publish(const string &key, const void *data, size_t size)
+{
+    StateSwitch use(state);
+    fncs::publish(key, data, size);
+}
+
+
+void fncs::Context::publish(fncs::Key key, const void *data, size_t size)
+{
+    StateSwitch use(state);
+    fncs::publish(key, data, size);
+}
+
+
+void fncs::Context::publish_double(const string &key, double value)
+{
+    StateSwitch use(state);
+    fncs::publish_double(key, value);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return;
-    }
 
-    string new_key = simulation_name + '/' + from + '@' + to + '/' + key;
-    zstr_sendm(client, fncs::PUBLISH);
-    zstr_sendm(client, new_key.c_str());
-    zstr_send(client, value.c_str());
-    LDEBUG4 << "sent PUBLISH '" << new_key << "'='" << value << "'";
+void fncs::Context::publish_int64(const string &key, long long value)
+{
+    StateSwitch use(state);
+    fncs::publish_int64(key, value);
 }
 
 
-void fncs::die()
+void fncs::Context::publish_complex(const string &key, const complex<double> &value)
 {
-    LDEBUG4 << "fncs::die()";
+    StateSwitch use(state);
+    fncs::publish_complex(key, value);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-    }
 
-    if (client) {
-        zstr_send(client, fncs::DIE);
-        zsock_destroy(&client);
-        zsys_shutdown(); /* without this, Windows will hang */
-    }
+void fncs::Context::publish_array(const string &key, const double *values, size_t n)
+{
+    StateSwitch use(state);
+    fncs::publish_array(key, values, n);
+}
 
-    is_initialized_ = false;
 
-    if (die_is_fatal) {
-        exit(EXIT_FAILURE);
-    }
+void fncs::Context::publish_double(Key key, double value)
+{
+    StateSwitch use(state);
+    fncs::publish_double(key, value);
 }
 
 
-void fncs::finalize()
+void fncs::Context::publish_int64(Key key, long long value)
 {
-	bool recBye = false;
-    LDEBUG4 << "fncs::finalize()";
-
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return;
-    }
+    StateSwitch use(state);
+    fncs::publish_int64(key, value);
+}
 
-    zmsg_t *msg = NULL;
-    zframe_t *frame = NULL;
 
-    zstr_sendm(client, fncs::BYE);
-    zstr_sendf(client, "%llu", time_current);
+void fncs::Context::publish_complex(Key key, const complex<double> &value)
+{
+    StateSwitch use(state);
+    fncs::publish_complex(key, value);
+}
 
-    /* receive BYE and perhaps other message types */
-    zmq_pollitem_t items[] = { { zsock_resolve(client), 0, ZMQ_POLLIN, 0 } };
-    while(!recBye){
-		/* receive BYE back */
-    	int rc = 0;
 
-		LDEBUG4 << "entering blocking poll";
-		rc = zmq_poll(items, 1, -1);
-		if (rc == -1) {
-			LERROR << "client polling error: " << strerror(errno);
-			die(); /* interrupted */
-			return;
-		}
-        if (items[0].revents & ZMQ_POLLIN) {
-            zmsg_t *msg = NULL;
-            zframe_t *frame = NULL;
-            string message_type;
+void fncs::Context::publish_array(Key key, const double *values, size_t n)
+{
+    StateSwitch use(state);
+    fncs::publish_array(key, values, n);
+}
 
-            LDEBUG4 << "incoming message";
-            msg = zmsg_recv(client);
-            if (!msg) {
-                LERROR << "null message received";
-                die();
-                return;
-            }
 
-            /* first frame is message type identifier */
-            frame = zmsg_first(msg);
-            if (!frame) {
-                LERROR << "message missing type identifier";
-                die();
-                return;
-            }
-            message_type = fncs::to_string(frame);
+void fncs::Context::publish_record(const string &key, const RecordBuilder &record)
+{
+    StateSwitch use(state);
+    fncs::publish_record(key, record);
+}
 
-            if (fncs::TIME_REQUEST == message_type) {
-                LERROR << "TIME_REQUEST received. Calling die.";
-                die();
-                return;
-            }
-            else if (fncs::PUBLISH == message_type) {
-                LDEBUG2 << "PUBLISH received and ignored.";
-            }
-            else if(fncs::DIE == message_type){
-                LERROR << "DIE received.";
-                die();
-                return;
-            }
-            else if(fncs::BYE == message_type){
-            	LDEBUG4 << "BYE received.";
-            	recBye = true;
-            }
-            else{
-            	LERROR << "Unknown message type received! Sending DIE.";
-            	die();
-            	return;
-            }
 
-            zmsg_destroy(&msg);
-        }
-    }
+void fncs::Context::publish_record(Key key, const RecordBuilder &record)
+{
+    StateSwitch use(state);
+    fncs::publish_record(key, record);
+}
 
-    zsock_destroy(&client);
-    zsys_shutdown(); /* without this, Windows will hang */
 
-    is_initialized_ = false;
+void fncs::Context::publish_at(const string &key, const string &value, fncs::time delivery)
+{
+    StateSwitch use(state);
+    fncs::publish_at(key, value, delivery);
 }
 
 
-void fncs::update_time_delta(fncs::time delta)
+void fncs::Context::publish_anon(const string &key, const string &value)
 {
-    LDEBUG4 << "fncs::update_time_delta(fncs::time)";
+    StateSwitch use(state);
+    fncs::publish_anon(key, value);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return;
-    }
 
-    /* send TIME_DELTA */
-    LDEBUG4 << "sending TIME_DELTA of " << delta << " in sim units";
-    delta *= time_delta_multiplier;
-    LDEBUG4 << "sending TIME_DELTA of " << delta << " nanoseconds";
-    zstr_sendm(client, fncs::TIME_DELTA);
-    zstr_sendf(client, "%llu", delta);
+void fncs::Context::route(const string &from, const string &to, const string &key, const string &value)
+{
+    StateSwitch use(state);
+    fncs::route(from, to, key, value);
 }
 
 
-ostream& operator << (ostream& os, zframe_t *self) {
-    assert (self);
-    assert (zframe_is (self));
-
-    byte *data = zframe_data (self);
-    size_t size = zframe_size (self);
+void fncs::Context::publish_anon(const string &key, const void *data, size_t size)
+{
+    StateSwitch use(state);
+    fncs::publish_anon(key, data, size);
+}
 
-    //  Probe data to check if it looks like unprintable binary
-    int is_bin = 0;
-    uint char_nbr;
-    for (char_nbr = 0; char_nbr < size; char_nbr++)
-        if (data [char_nbr] < 9 || data [char_nbr] > 127)
-            is_bin = 1;
 
-    size_t buffer_size = 31;
-    buffer_size += is_bin? size*2 : size;
-    char *buffer = (char*)zmalloc(buffer_size);
-    snprintf (buffer, 30, "[%03d] ", (int) size);
-    for (char_nbr = 0; char_nbr < size; char_nbr++) {
-        if (is_bin)
-            sprintf (buffer + strlen (buffer), "%02X", (unsigned char) data [char_nbr]);
-        else
-            sprintf (buffer + strlen (buffer), "%c", data [char_nbr]);
-    }
+void fncs::Context::publish_member(const string &member, const string &key, const string &value)
+{
+    StateSwitch use(state);
+    fncs::publish_member(member, key, value);
+}
 
-    os << buffer;
 
-    return os;
+void fncs::Context::publish_member(const string &member, const string &key,
+        const void *data, size_t size)
+{
+    StateSwitch use(state);
+    fncs::publish_member(member, key, data, size);
 }
 
 
-fncs::time fncs::time_unit_to_multiplier(const string &value)
+void fncs::Context::route(const string &from, const string &to, const string &key,
+        const void *data, size_t size)
 {
-    LDEBUG4 << "fncs::time_unit_to_multiplier(string)";
+    StateSwitch use(state);
+    fncs::route(from, to, key, data, size);
+}
 
-    fncs::time retval = 0;
-    fncs::time ignore = 0;
-    string unit;
-    istringstream iss(value);
 
-    iss >> ignore;
-    if (!iss) {
-        LERROR << "could not parse time value";
-        die();
-        return retval;
-    }
-    iss >> unit;
-    if (!iss) {
-        LERROR << "could not parse time unit";
-        die();
-        return retval;
-    }
-
-    if ("d" == unit
-            || "day" == unit
-            || "days" == unit) {
-        retval = 24ULL * 60ULL * 60ULL * 1000000000ULL;
-    }
-    else if ("h" == unit
-            || "hour" == unit
-            || "hours" == unit) {
-        retval = 60ULL * 60ULL * 1000000000ULL;
-    }
-    else if ("m" == unit
-            || "min" == unit
-            || "minute" == unit
-            || "minutes" == unit) {
-        retval = 60ULL * 1000000000ULL;
-    }
-    else if ("s" == unit
-            || "sec" == unit
-            || "second" == unit
-            || "seconds" == unit) {
-        retval = 1000000000ULL;
-    }
-    else if ("ms" == unit
-            || "msec" == unit
-            || "millisec" == unit
-            || "millisecond" == unit
-            || "milliseconds" == unit) {
-        retval = 1000000ULL;
-    }
-    else if ("us" == unit
-            || "usec" == unit
-            || "microsec" == unit
-            || "microsecond" == unit
-            || "microseconds" == unit) {
-        retval = 1000ULL;
-    }
-    else if ("ns" == unit
-            || "nsec" == unit
-            || "nanosec" == unit
-            || "nanosecond" == unit
-            || "nanoseconds" == unit) {
-        retval = 1ULL;
-    }
-    else {
-        LERROR << "unrecognized time unit '" << unit << "'";
-        die();
-        return retval;
-    }
+void fncs::Context::die()
+{
+    StateSwitch use(state);
+    fncs::die();
+}
 
-    return retval;
+
+void fncs::Context::finalize()
+{
+    StateSwitch use(state);
+    fncs::finalize();
 }
 
 
-fncs::time fncs::parse_time(const string &value)
+void fncs::Context::finalize_detached()
 {
-    LDEBUG4 << "fncs::parse_time(string)";
+    StateSwitch use(state);
+    fncs::finalize_detached();
+}
 
-    fncs::time retval; 
-    string unit;
-    istringstream iss(value);
 
-    iss >> retval;
-    if (!iss) {
-        LERROR << "could not parse time value";
-        die();
-        return retval;
-    }
+void fncs::Context::update_time_delta(fncs::time delta)
+{
+    StateSwitch use(state);
+    fncs::update_time_delta(delta);
+}
 
-    retval *= fncs::time_unit_to_multiplier(value);
 
-    return retval;
+void fncs::Context::set_lookahead(fncs::time lookahead)
+{
+    StateSwitch use(state);
+    fncs::set_lookahead(lookahead);
 }
 
 
-fncs::Config fncs::parse_config(const string &configuration)
+void fncs::Context::set_periodic(fncs::time period)
 {
-    LDEBUG4 << "fncs::parse_config(string)";
+    StateSwitch use(state);
+    fncs::set_periodic(period);
+}
 
-    zchunk_t *zchunk = NULL;
-    zconfig_t *zconfig = NULL;
-    fncs::Config config;
-    bool is_zpl = false;
 
-    /* if we detect '=' in the first line, we assume zpl */
-    {
-        istringstream is(configuration);
-        string line;
-        getline(is, line);
-        is_zpl = (line.find('=') != string::npos);
-    }
+void fncs::Context::set_next_publish(fncs::time next)
+{
+    StateSwitch use(state);
+    fncs::set_next_publish(next);
+}
 
-    if (is_zpl) {
-        /* create a zchunk for parsing */
-        zchunk = zchunk_new(configuration.c_str(), configuration.size());
-        /* open and parse fncs configuration */
-        zconfig = zconfig_chunk_load(zchunk);
-        if (!zconfig) {
-            cerr << "could not load ZPL configuration string" << endl;
-            cerr << "-- configuration was as follows --" << endl;
-            cerr << configuration << endl;
-        }
-        else {
-            zchunk_destroy(&zchunk);
-            config = parse_config(zconfig);
-            zconfig_destroy(&zconfig);
-        }
-    }
-    else {
-        /* attempt to load as a YAML document */
-        try {
-            istringstream sin(configuration);
-            YAML::Parser parser(sin);
-            YAML::Node doc;
-            parser.GetNextDocument(doc);
-            config = parse_config(doc);
-        } catch (YAML::ParserException &) {
-            cerr << "could not load YAML configuration string" << endl;
-            cerr << "-- configuration was as follows --" << endl;
-            cerr << configuration << endl;
-        }
-    }
 
-    return config;
+void fncs::Context::set_rollback(RollbackCallback save, RollbackCallback restore,
+        RollbackCallback discard, void *data)
+{
+    StateSwitch use(state);
+    fncs::set_rollback(save, restore, discard, data);
 }
 
 
-fncs::Config fncs::parse_config(const YAML::Node &doc)
+vector<string> fncs::Context::get_events()
 {
-    LDEBUG4 << "fncs::parse_config(YAML::Node)";
+    StateSwitch use(state);
+    return fncs::get_events();
+}
 
-    fncs::Config config;
 
-    if (const YAML::Node *node = doc.FindValue("name")) {
-        if (node->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'name' must be a Scalar" << endl;
-        }
-        else {
-            *node >> config.name;
-        }
-    }
+fncs::EventIterator fncs::Context::events_begin()
+{
+    StateSwitch use(state);
+    return fncs::events_begin();
+}
 
-    if (const YAML::Node *node = doc.FindValue("broker")) {
-        if (node->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'broker' must be a Scalar" << endl;
-        }
-        else {
-            *node >> config.broker;
-        }
-    }
 
-    if (const YAML::Node *node = doc.FindValue("time_delta")) {
-        if (node->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'time_delta' must be a Scalar" << endl;
-        }
-        else {
-            *node >> config.time_delta;
-        }
-    }
+fncs::EventIterator fncs::Context::events_end()
+{
+    StateSwitch use(state);
+    return fncs::events_end();
+}
 
-    if (const YAML::Node *node = doc.FindValue("fatal")) {
-        if (node->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'fatal' must be a Scalar" << endl;
-        }
-        else {
-            *node >> config.fatal;
-        }
-    }
 
-    /* parse subscriptions */
-    if (const YAML::Node *node = doc.FindValue("values")) {
-        config.values = parse_values(*node);
-    }
+const string& fncs::Context::get_key(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_key(key);
+}
 
-    return config;
+
+const fncs::Routed* fncs::Context::get_routed(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_routed(key);
 }
 
 
-fncs::Config fncs::parse_config(zconfig_t *zconfig)
+string fncs::Context::get_route_node(size_t id)
 {
-    LDEBUG4 << "fncs::parse_config(zconfig_t*)";
+    StateSwitch use(state);
+    return fncs::get_route_node(id);
+}
 
-    fncs::Config config;
-    zconfig_t *config_values = NULL;
 
-    /* read sim name from zconfig */
-    config.name = zconfig_resolve(zconfig, "/name", "");
+size_t fncs::Context::get_route_node_count()
+{
+    StateSwitch use(state);
+    return fncs::get_route_node_count();
+}
 
-    /* read broker location from config */
-    config.broker = zconfig_resolve(zconfig, "/broker", "");
 
-    /* read time delta from config */
-    config.time_delta = zconfig_resolve(zconfig, "/time_delta", "");
+void fncs::Context::on_update(const string &key, fncs::UpdateCallback callback, void *data)
+{
+    StateSwitch use(state);
+    fncs::on_update(key, callback, data);
+}
 
-    /* read whether die() is fatal from zconfig */
-    config.fatal = zconfig_resolve(zconfig, "/fatal", "");
 
-    /* parse subscriptions */
-    config_values = zconfig_locate(zconfig, "/values");
-    if (config_values) {
-        config.values = parse_values(config_values);
-    }
+void fncs::Context::set_agents(size_t n, fncs::AgentStep step, void *data)
+{
+    StateSwitch use(state);
+    fncs::set_agents(n, step, data);
+}
 
-    return config;
+
+fncs::Key fncs::Context::subscribe(const string &topic, const fncs::SubscribeOptions &options)
+{
+    StateSwitch use(state);
+    return fncs::subscribe(topic, options);
 }
 
 
-fncs::Subscription fncs::parse_value(const YAML::Node &node)
+void fncs::Context::unsubscribe(const string &topic)
 {
-    LDEBUG4 << "fncs::parse_value(YAML::Node)";
+    StateSwitch use(state);
+    fncs::unsubscribe(topic);
+}
 
-    /* a "value" block for a FNCS subscription looks like this
-    foo:                    # lookup key, optional topic
-        topic:  some_topic  # required iff topic did not appear earlier
-        default:  10        # optional; default value
-        type:  int          # optional; currently unused; data type
-        list:  false        # optional; defaults to "false"
-    */
 
-    fncs::Subscription sub;
+void fncs::Context::on_any_update(fncs::UpdateCallback callback, void *data)
+{
+    StateSwitch use(state);
+    fncs::on_any_update(callback, data);
+}
 
-    if (const YAML::Node *child = node.FindValue("topic")) {
-        if (child->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'topic' must be a Scalar" << endl;
-        }
-        else {
-            *child >> sub.topic;
-        }
-    }
 
-    if (const YAML::Node *child = node.FindValue("default")) {
-        if (child->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'default' must be a Scalar" << endl;
-        }
-        else {
-            *child >> sub.def;
-        }
-    }
+const vector<fncs::Key>& fncs::Context::changed_keys()
+{
+    StateSwitch use(state);
+    return fncs::changed_keys();
+}
 
-    if (const YAML::Node *child = node.FindValue("type")) {
-        if (child->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'type' must be a Scalar" << endl;
-        }
-        else {
-            *child >> sub.type;
-        }
-    }
 
-    if (const YAML::Node *child = node.FindValue("list")) {
-        if (child->Type() != YAML::NodeType::Scalar) {
-            cerr << "YAML 'list' must be a Scalar" << endl;
-        }
-        else {
-            *child >> sub.list;
-        }
-    }
+unsigned long long fncs::Context::version(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::version(key);
+}
 
-    return sub;
+
+fncs::Key fncs::Context::lookup_key(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::lookup_key(key);
 }
 
 
-fncs::Subscription fncs::parse_value(zconfig_t *config)
+fncs::Key fncs::Context::lookup_key(const char *key)
 {
-    LDEBUG4 << "fncs::parse_value(zconfig_t*)";
+    StateSwitch use(state);
+    return fncs::lookup_key(key);
+}
 
-    /* a "value" block for a FNCS subscription looks like this
-    foo [ = some_topic ]    # lookup key, optional topic
-        topic = some_topic  # required iff topic did not appear earlier
-        default = 10        # optional; default value
-        type = int          # optional; currently unused; data type
-        list = false        # optional; defaults to "false"
-    */
 
-    fncs::Subscription sub;
-    const char *value = NULL;
+string fncs::Context::get_value(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::get_value(key);
+}
 
-    sub.key = zconfig_name(config);
-    LDEBUG4 << "parsing value with key '" << sub.key << "'";
 
-    /* check for topic attached to short key */
-    value = zconfig_value(config);
-    if (!value || 0 == strlen(value)) {
-        LDEBUG4 << "key did not have topic attached";
-        /* check for a 'topic' subheading */
-        value = zconfig_resolve(config, "topic", NULL);
-    }
-    if (!value || 0 == strlen(value)) {
-        LDEBUG4 << "key did not have 'topic' subheading";
-        /* default is to use short key as subscription */
-        sub.topic = sub.key;
-    }
-    else {
-        sub.topic = value;
-    }
-    LDEBUG4 << "parsing key '" << sub.key << "' topic '" << sub.topic << "'";
+const string& fncs::Context::get_value(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_value(key);
+}
 
-    value = zconfig_resolve(config, "default", NULL);
-    if (!value) {
-        LDEBUG4 << "parsing value '" << sub.key << "', missing 'default'";
-    }
-    sub.def = value? value : "";
 
-    value = zconfig_resolve(config, "type", NULL);
-    if (!value) {
-        LDEBUG4 << "parsing value '" << sub.key << "', missing 'type'";
-    }
-    sub.type = value? value : "";
+vector<string> fncs::Context::get_values(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::get_values(key);
+}
 
-    value = zconfig_resolve(config, "list", NULL);
-    if (!value) {
-        LDEBUG4 << "parsing value '" << sub.key << "', missing 'list'";
-    }
-    sub.list = value? value : "";
 
-    return sub;
+const vector<string>& fncs::Context::get_values(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_values(key);
 }
 
 
-vector<fncs::Subscription> fncs::parse_values(const YAML::Node &node)
+fncs::History fncs::Context::get_history(const string &key)
 {
-    LDEBUG4 << "fncs::parse_values(YAML::Node)";
+    StateSwitch use(state);
+    return fncs::get_history(key);
+}
 
-    vector<fncs::Subscription> subs;
 
-    if (YAML::NodeType::Sequence == node.Type()) {
-        for (YAML::Iterator it=node.begin(); it!=node.end(); ++it) {
-            fncs::Subscription sub;
-            const YAML::Node &child = *it;
-            if (YAML::NodeType::Scalar == child.Type()) {
-                child >> sub.key;
-                child >> sub.topic;
-            }
-            else if (YAML::NodeType::Map == child.Type()) {
-                for (YAML::Iterator it2=child.begin();
-                        it2!=child.end(); ++it2) {
-                    if (YAML::NodeType::Scalar == it2.second().Type()) {
-                        it2.first() >> sub.key;
-                        it2.second() >> sub.topic;
-                    }
-                    else if (YAML::NodeType::Map == it2.second().Type()) {
-                        sub = parse_value(it2.second());
-                        it2.first() >> sub.key;
-                    }
-                }
-            }
-            subs.push_back(sub);
-        }
-    }
-    else if (YAML::NodeType::Map == node.Type()) {
-        for (YAML::Iterator it=node.begin(); it!=node.end(); ++it) {
-            fncs::Subscription sub;
-            if (YAML::NodeType::Scalar == it.second().Type()) {
-                it.first() >> sub.key;
-                it.second() >> sub.topic;
-            }
-            if (YAML::NodeType::Map == it.second().Type()) {
-                sub = parse_value(it.second());
-                it.first() >> sub.key;
-            }
-            subs.push_back(sub);
-        }
-    }
+fncs::History fncs::Context::get_history(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_history(key);
+}
 
-    return subs;
+
+fncs::Record fncs::Context::get_record(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::get_record(key);
 }
 
 
-vector<fncs::Subscription> fncs::parse_values(zconfig_t *config)
+fncs::Record fncs::Context::get_record(fncs::Key key)
 {
-    LDEBUG4 << "fncs::parse_values(zconfig_t*)";
+    StateSwitch use(state);
+    return fncs::get_record(key);
+}
 
-    vector<fncs::Subscription> subs;
-    string name;
-    zconfig_t *child = NULL;
 
-    name = zconfig_name(config);
-    if (name != "values") {
-        LERROR << "error parsing 'values', wrong config object '" << name << "'";
-        die();
-        return subs;
-    }
+size_t fncs::Context::get_values_size(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_values_size(key);
+}
 
-    child = zconfig_child(config);
-    while (child) {
-        subs.push_back(parse_value(child));
-        child = zconfig_next(child);
-    }
 
-    return subs;
+const char* fncs::Context::get_values_data(fncs::Key key, size_t index, size_t *size)
+{
+    StateSwitch use(state);
+    return fncs::get_values_data(key, index, size);
 }
 
 
-string fncs::to_string(zframe_t *frame)
+double fncs::Context::get_double(const string &key)
 {
-    return string((const char *)zframe_data(frame), zframe_size(frame));
+    StateSwitch use(state);
+    return fncs::get_double(key);
 }
 
 
-vector<string> fncs::get_events()
+double fncs::Context::get_double(fncs::Key key)
 {
-    LDEBUG4 << "fncs::get_events() [" << events.size() << "]";
+    StateSwitch use(state);
+    return fncs::get_double(key);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return vector<string>();
-    }
 
-    return events;
+long long fncs::Context::get_int64(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::get_int64(key);
 }
 
 
-string fncs::get_value(const string &key)
+long long fncs::Context::get_int64(fncs::Key key)
 {
-    LDEBUG4 << "fncs::get_value(" << key << ")";
+    StateSwitch use(state);
+    return fncs::get_int64(key);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return "";
-    }
 
-    if (0 == cache.count(key)) {
-        LERROR << "key '" << key << "' not found in cache";
-        die();
-        return "";
-    }
+complex<double> fncs::Context::get_complex(const string &key)
+{
+    StateSwitch use(state);
+    return fncs::get_complex(key);
+}
+
 
-    return cache[key];
+complex<double> fncs::Context::get_complex(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_complex(key);
 }
 
 
-vector<string> fncs::get_values(const string &key)
+size_t fncs::Context::get_array(const string &key, double *out, size_t n)
 {
-    LDEBUG4 << "fncs::get_values(" << key << ")";
+    StateSwitch use(state);
+    return fncs::get_array(key, out, n);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return vector<string>();
-    }
 
-    vector<string> values;
+size_t fncs::Context::get_array(fncs::Key key, double *out, size_t n)
+{
+    StateSwitch use(state);
+    return fncs::get_array(key, out, n);
+}
 
-    if (0 == cache_list.count(key)) {
-        LERROR << "key '" << key << "' not found in cache list";
-        die();
-        return values;
-    }
 
-    values = cache_list[key];
-    LDEBUG4 << "key '" << key << "' has " << values.size() << " values";
-    return values;
+const vector<double>& fncs::Context::get_array(fncs::Key key)
+{
+    StateSwitch use(state);
+    return fncs::get_array(key);
 }
 
 
-vector<string> fncs::get_keys()
+void fncs::Context::snapshot(fncs::Snapshot &out, bool changed_only)
 {
-    LDEBUG4 << "fncs::get_keys()";
+    StateSwitch use(state);
+    fncs::snapshot(out, changed_only);
+}
 
-    if (!is_initialized_) {
-        LWARNING << "fncs is not initialized";
-        return vector<string>();
-    }
 
-    return mykeys;
+vector<string> fncs::Context::get_keys()
+{
+    StateSwitch use(state);
+    return fncs::get_keys();
 }
 
 
-string fncs::get_name()
+fncs::KeyIterator fncs::Context::keys_begin()
 {
-    return simulation_name;
+    StateSwitch use(state);
+    return fncs::keys_begin();
 }
 
 
-fncs::time fncs::get_time_delta()
+fncs::KeyIterator fncs::Context::keys_end()
 {
-    return convert_broker_to_sim_time(time_delta);
+    StateSwitch use(state);
+    return fncs::keys_end();
 }
 
 
-int fncs::get_id()
+string fncs::Context::get_name()
 {
-    return simulation_id;
+    StateSwitch use(state);
+    return fncs::get_name();
 }
 
 
-int fncs::get_simulator_count()
+fncs::time fncs::Context::get_time_delta()
 {
-    return n_sims;
+    StateSwitch use(state);
+    return fncs::get_time_delta();
 }
 
 
-fncs::time fncs::convert_broker_to_sim_time(fncs::time value)
+int fncs::Context::get_id()
 {
-    return value / time_delta_multiplier;
+    StateSwitch use(state);
+    return fncs::get_id();
 }
 
-fncs::time fncs::timer_ft()
+
+int fncs::Context::get_simulator_count()
 {
-#ifdef __MACH__
-    /* OS X does not have clock_gettime, use clock_get_time */
-    clock_serv_t cclock;
-    mach_timespec_t mts;
-    host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-    clock_get_time(cclock, &mts);
-    mach_port_deallocate(mach_task_self(), cclock);
-    return mts.tv_sec*1000000000UL + mts.tv_nsec;
-#elif defined(__FreeBSD__)
-    struct timespec ts;
-    /* Works on FreeBSD */
-    long retval = clock_gettime(CLOCK_MONOTONIC, &ts);
-    assert(0 == retval);
-    return ts.tv_sec*1000000000UL + ts.tv_nsec;
-#elif defined(_WIN32)
-    static LARGE_INTEGER freq, start;
-    LARGE_INTEGER count;
-    BOOL retval;
-    retval = QueryPerformanceCounter(&count);
-    assert(retval);
-    if (!freq.QuadPart) { // one time initialization
-        retval = QueryPerformanceFrequency(&freq);
-        assert(retval);
-        start = count;
-    }
-    return 1000000000UL*fncs::time(double(count.QuadPart - start.QuadPart)/freq.QuadPart);
-#else
-    struct timespec ts;
-    /* Works on Linux */
-    long retval = clock_gettime(CLOCK_REALTIME, &ts);
-    assert(0 == retval);
-    return ts.tv_sec*1000000000UL + ts.tv_nsec;
-#endif
+    StateSwitch use(state);
+    return fncs::get_simulator_count();
 }
 
-double fncs::timer()
+
+fncs::time fncs::Context::get_checkpoint()
 {
-    return double(timer_ft())/1000000000.0;
+    StateSwitch use(state);
+    return fncs::get_checkpoint();
 }
 
 
-void fncs::get_version(int *major, int *minor, int *patch)
+fncs::Stats fncs::Context::get_stats()
 {
-    *major = FNCS_VERSION_MAJOR;
-    *minor = FNCS_VERSION_MINOR;
-    *patch = FNCS_VERSION_PATCH;
+    StateSwitch use(state);
+    return fncs::get_stats();
 }
 
+
+fncs::FederationLoad fncs::Context::get_federation_load()
+{
+    StateSwitch use(state);
+    return fncs::get_federation_load();
+}
@@ -19,6 +19,41 @@ extern "C" {
 
     typedef unsigned long long fncs_time;
 
+    /** Handle of a subscribed key, see fncs_lookup_key(). */
+    typedef size_t fncs_key;
+
+    /** Called by fncs_for_each_event() with the handle and name of each
+     * updated key and the caller's data pointer. */
+    typedef void (*fncs_event_callback)(fncs_key key, const char *name, void *data);
+
+    /** Time request statistics, see fncs::Stats. */
+    typedef struct fncs_stats {
+        unsigned long long n_requests;
+        fncs_time time_requesting;
+        fncs_time time_blocked;
+        fncs_time time_dispatching;
+        unsigned long long n_messages;
+        unsigned long long n_values;
+        unsigned long long bytes_received;
+    } fncs_stats;
+
+    /** Memory the client holds, see fncs::Stats; apart from fncs_stats
+     * so that the size of that stays as it was. */
+    typedef struct fncs_memory {
+        unsigned long long bytes_cache;
+        unsigned long long bytes_lists;
+        unsigned long long bytes_pending;
+    } fncs_memory;
+
+    /** The broker's load summary, see fncs::FederationLoad. */
+    typedef struct fncs_federation_load {
+        fncs_time time_granted;
+        fncs_time time_round;
+        fncs_time time_round_mean;
+        unsigned long long n_queued;
+        double waiting_share;
+    } fncs_federation_load;
+
     /** Connect to broker and parse config file. */
     FNCS_EXPORT void fncs_initialize();
 
@@ -31,12 +66,66 @@ extern "C" {
     /** Request the next time step to process. */
     FNCS_EXPORT fncs_time fncs_time_request(fncs_time next);
 
+    /** Send the request for the next time step and return at once. */
+    FNCS_EXPORT void fncs_time_request_async(fncs_time next);
+
+    /** Process arrived messages without blocking; nonzero once the
+     * pending request is granted. */
+    FNCS_EXPORT int fncs_time_request_poll();
+
+    /** Block until the pending request is granted; the granted time. */
+    FNCS_EXPORT fncs_time fncs_time_request_wait();
+
+    /** File descriptor to watch while a request is pending; call
+     * fncs_time_request_poll() whenever it becomes readable. */
+    FNCS_EXPORT int fncs_get_fd();
+
     /** Publish value using the given key. */
     FNCS_EXPORT void fncs_publish(const char *key, const char *value);
 
+    /** Handle of a key to publish, see fncs_publish_by_key(). A key no
+     * other sim subscribed to gets (fncs_key)-1. */
+    FNCS_EXPORT fncs_key fncs_lookup_publish_key(const char *key);
+
+    /** Publish value by handle, without looking up the key. */
+    FNCS_EXPORT void fncs_publish_by_key(fncs_key key, const char *value);
+
+    /** Publish value using the given key, delivered at the given time in
+     * sim units, see fncs::publish_at(). */
+    FNCS_EXPORT void fncs_publish_at(const char *key, const char *value, fncs_time delivery);
+
+    /** Publish size bytes as the value of the given key, NUL bytes
+     * included and without a strlen(), see fncs_get_value_n(). */
+    FNCS_EXPORT void fncs_publish_n(const char *key, const void *value, size_t size);
+
+    /** Publish size bytes by handle, see fncs_publish_n(). */
+    FNCS_EXPORT void fncs_publish_by_key_n(fncs_key key, const void *value, size_t size);
+
     /** Publish value anonymously using the given key. */
     FNCS_EXPORT void fncs_publish_anon(const char *key, const char *value);
 
+    /** Publish size bytes anonymously using the given key. */
+    FNCS_EXPORT void fncs_publish_anon_n(const char *key, const void *value, size_t size);
+
+    /** Publish value on behalf of a member of a compound federate. */
+    FNCS_EXPORT void fncs_publish_member(const char *member, const char *key, const char *value);
+
+    /** Publish size bytes on behalf of a member of a compound federate. */
+    FNCS_EXPORT void fncs_publish_member_n(const char *member, const char *key,
+            const void *value, size_t size);
+
+    /** Publish a double using the given key, sent as binary. */
+    FNCS_EXPORT void fncs_publish_double(const char *key, double value);
+
+    /** Publish a 64 bit integer using the given key, sent as binary. */
+    FNCS_EXPORT void fncs_publish_int64(const char *key, long long value);
+
+    /** Publish a complex using the given key, sent as binary. */
+    FNCS_EXPORT void fncs_publish_complex(const char *key, double real, double imag);
+
+    /** Publish an array of doubles as one binary value using the given key. */
+    FNCS_EXPORT void fncs_publish_array(const char *key, const double *values, size_t n);
+
     /** Publish value using the given key, adding from:to into the key. */
     FNCS_EXPORT void fncs_route(
             const char *from,
@@ -44,16 +133,50 @@ extern "C" {
             const char *key,
             const char *value);
 
+    /** Publish size bytes using the given key, adding from:to into the key. */
+    FNCS_EXPORT void fncs_route_n(
+            const char *from,
+            const char *to,
+            const char *key,
+            const void *value,
+            size_t size);
+
     /** Tell broker of a fatal client error. */
     FNCS_EXPORT void fncs_die();
 
     /** Close the connection to the broker. */
     FNCS_EXPORT void fncs_finalize();
 
+    /** Close the connection to the broker without waiting for the other
+     * sims to finish, see fncs::finalize_detached(). */
+    FNCS_EXPORT void fncs_finalize_detached();
+
     /** Update minimum time delta after connection to broker is made.
      * Assumes time unit is not changing. */
     FNCS_EXPORT void fncs_update_time_delta(fncs_time delta);
 
+    /** Promise that nothing will be published with a time earlier than
+     * the current time plus the given lookahead, in the sim's time unit. */
+    FNCS_EXPORT void fncs_set_lookahead(fncs_time lookahead);
+
+    /** Register a standing time request for the current time plus the
+     * given period, in the sim's time unit; 0 cancels it. */
+    FNCS_EXPORT void fncs_set_periodic(fncs_time period);
+
+    /** Promise that, unless a value received wakes the sim sooner,
+     * nothing will be published before the given time, in the sim's
+     * time unit; sent with the next time request. */
+    FNCS_EXPORT void fncs_set_next_publish(fncs_time next);
+
+    /** Opt in to optimistic execution before fncs_initialize(), see
+     * fncs::set_rollback(); the callbacks get a time in the sim's time
+     * unit and the data. */
+    FNCS_EXPORT void fncs_set_rollback(
+            void (*save)(fncs_time, void*),
+            void (*restore)(fncs_time, void*),
+            void (*discard)(fncs_time, void*),
+            void *data);
+
     /** Get the number of keys for all values that were updated during
      * the last time_request. */
     FNCS_EXPORT size_t fncs_get_events_size();
@@ -62,10 +185,51 @@ extern "C" {
      * time_request. */
     FNCS_EXPORT char** fncs_get_events();
 
+    /** Call back for every value updated during the last time_request,
+     * in arrival order, without allocating. The name belongs to the
+     * cache; do not free it. */
+    FNCS_EXPORT void fncs_for_each_event(fncs_event_callback callback, void *data);
+
+    /** Borrow the handles of the keys updated during the last
+     * time_request, each once and in ascending order, and set *len to
+     * their number. The array is valid until the next time_request. */
+    FNCS_EXPORT const fncs_key* fncs_changed_keys(size_t *len);
+
+    /** Get how many values the key received since fncs_initialize(). */
+    FNCS_EXPORT unsigned long long fncs_version_by_key(fncs_key key);
+
+    /** Call back whenever the subscribed key was updated during a
+     * time_request, once per grant, see fncs::on_update(). */
+    FNCS_EXPORT void fncs_on_update(const char *key,
+            void (*callback)(fncs_key, void*), void *data);
+
+    /** Call back for every key updated at a grant, see
+     * fncs::on_any_update(). */
+    FNCS_EXPORT void fncs_on_any_update(void (*callback)(fncs_key, void*), void *data);
+
+    /** Step n agents at every grant on a pool of threads, see
+     * fncs::set_agents(). */
+    FNCS_EXPORT void fncs_set_agents(size_t n,
+            void (*step)(size_t agent, fncs_time granted, void *data), void *data);
+
+    /** Subscribe to an exact topic at runtime under the given key, the
+     * topic if NULL, as a list if list is nonzero and waking the sim if
+     * wake is; the handle of the key, see fncs::subscribe(). */
+    FNCS_EXPORT fncs_key fncs_subscribe(const char *topic, const char *key, int list, int wake);
+
+    /** Stop the values of a topic from the next grant on, see
+     * fncs::unsubscribe(). */
+    FNCS_EXPORT void fncs_unsubscribe(const char *topic);
+
     /** Get a value from the cache with the given key.
      * Will hard fault if key is not found. */
     FNCS_EXPORT char* fncs_get_value(const char *key);
 
+    /** Get a value from the cache with the given key and set *size to
+     * its length, NUL bytes included; free it as fncs_get_value()'s.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT char* fncs_get_value_n(const char *key, size_t *size);
+
     /** Get the number of values from the cache with the given key. */
     FNCS_EXPORT size_t fncs_get_values_size(const char *key);
 
@@ -73,6 +237,127 @@ extern "C" {
      * Will return an array of size 1 if only a single value exists. */
     FNCS_EXPORT char** fncs_get_values(const char *key);
 
+    /** Get the handle of a subscribed key for repeated access.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT fncs_key fncs_lookup_key(const char *key);
+
+    /** Get a value from the cache by handle. The string belongs to the
+     * cache and is valid until the next time_request; do not free it. */
+    FNCS_EXPORT const char* fncs_get_value_by_key(fncs_key key);
+
+    /** Get a value from the cache by handle and set *size to its
+     * length, NUL bytes included. It belongs to the cache, as with
+     * fncs_get_value_by_key(). */
+    FNCS_EXPORT const char* fncs_get_value_by_key_n(fncs_key key, size_t *size);
+
+    /** Borrow the from, to and key of a topic fncs_route() published, by
+     * handle, and their IDs, see fncs::get_routed(); any pointer may be
+     * NULL. The strings are valid until fncs_finalize(). Returns 0 if it
+     * is not such a topic. */
+    FNCS_EXPORT int fncs_peek_route(fncs_key key, const char **from, const char **to,
+            const char **name, size_t *from_id, size_t *to_id);
+
+    /** Get the number of values of a list subscription by handle. */
+    FNCS_EXPORT size_t fncs_get_values_size_by_key(fncs_key key);
+
+    /** Get one value of a list subscription by handle. The string
+     * belongs to the cache and is valid until the next time_request. */
+    FNCS_EXPORT const char* fncs_get_values_by_key(fncs_key key, size_t index);
+
+    /** Get one value of a list subscription by handle and set *size to
+     * its length, NUL bytes included, see fncs_get_values_by_key(). */
+    FNCS_EXPORT const char* fncs_get_values_by_key_n(fncs_key key, size_t index, size_t *size);
+
+    /** Get the number of values the history of a key holds, see
+     * fncs::get_history(). */
+    FNCS_EXPORT size_t fncs_get_history_size_by_key(fncs_key key);
+
+    /** Get value index of the history of a key, 0 the oldest, and set
+     * *time to the time it came with if time is not NULL. It belongs to
+     * the cache and is valid until the next time_request. */
+    FNCS_EXPORT const char* fncs_get_history_by_key(fncs_key key, size_t index, fncs_time *time);
+
+    /** Get a value from the cache as a double.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT double fncs_get_double(const char *key);
+
+    /** Get a value from the cache by handle as a double. */
+    FNCS_EXPORT double fncs_get_double_by_key(fncs_key key);
+
+    /** Get a value from the cache as a 64 bit integer.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT long long fncs_get_int64(const char *key);
+
+    /** Get a value from the cache by handle as a 64 bit integer. */
+    FNCS_EXPORT long long fncs_get_int64_by_key(fncs_key key);
+
+    /** Get a value from the cache as a complex.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT void fncs_get_complex(const char *key, double *real, double *imag);
+
+    /** Get a value from the cache by handle as a complex. */
+    FNCS_EXPORT void fncs_get_complex_by_key(fncs_key key, double *real, double *imag);
+
+    /** Copy up to n elements of a value into out and return how many
+     * it holds; pass n 0 to ask the size.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT size_t fncs_get_array(const char *key, double *out, size_t n);
+
+    /** Copy up to n elements of a value by handle, see fncs_get_array(). */
+    FNCS_EXPORT size_t fncs_get_array_by_key(fncs_key key, double *out, size_t n);
+
+    /** Borrow a value from the cache by handle as an array of *len
+     * doubles. The array belongs to the cache and is valid until the
+     * next time_request. */
+    FNCS_EXPORT const double* fncs_peek_array_by_key(fncs_key key, size_t *len);
+
+    /** Get the values of n keys by handle as doubles in one call. */
+    FNCS_EXPORT void fncs_get_doubles_by_key(const fncs_key *keys, double *out, size_t n);
+
+    /** Borrow a value from the cache with the given key, setting *len to
+     * its length unless len is NULL. The string belongs to the cache and
+     * is valid until the next time_request; do not free it.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT const char* fncs_peek_value(const char *key, size_t *len);
+
+    /** Borrow one value of a list subscription, see fncs_peek_value().
+     * Returns NULL if index is out of range. */
+    FNCS_EXPORT const char* fncs_peek_values(const char *key, size_t index, size_t *len);
+
+    /** Borrow the key of one value updated during the last time_request,
+     * see fncs_peek_value(). Returns NULL if index is out of range. */
+    FNCS_EXPORT const char* fncs_peek_event(size_t index, size_t *len);
+
+    /** Borrow one of the subscribed keys, valid until fncs_finalize().
+     * Returns NULL if index is out of range. */
+    FNCS_EXPORT const char* fncs_peek_key(size_t index, size_t *len);
+
+    /** Copy a value from the cache into the caller's buffer as snprintf
+     * would, truncating it to size-1 bytes and a NUL. Returns the length
+     * of the whole value. Will hard fault if key is not found. */
+    FNCS_EXPORT size_t fncs_copy_value(const char *key, char *buffer, size_t size);
+
+    /** Copy one value of a list subscription into the caller's buffer,
+     * see fncs_copy_value(). Returns 0, with an empty buffer, if index is
+     * out of range. */
+    FNCS_EXPORT size_t fncs_copy_values(const char *key, size_t index, char *buffer, size_t size);
+
+    /** Fill the snapshot of the values of every subscribed key, or if
+     * changed_only is nonzero of those updated during the last
+     * time_request, see fncs::snapshot(). Returns its number of entries;
+     * the arrays below belong to it and are valid until the next call. */
+    FNCS_EXPORT size_t fncs_snapshot(int changed_only);
+
+    /** The key handle of each entry of the snapshot, in ascending order. */
+    FNCS_EXPORT const fncs_key* fncs_snapshot_keys();
+
+    /** One more offset than entries: the value of entry i is the bytes
+     * of fncs_snapshot_values() from offset i up to offset i+1. */
+    FNCS_EXPORT const size_t* fncs_snapshot_offsets();
+
+    /** The values of the snapshot back to back, not terminated. */
+    FNCS_EXPORT const char* fncs_snapshot_values();
+
     /** Get the number of subscribed keys. */
     FNCS_EXPORT size_t fncs_get_keys_size();
 
@@ -80,6 +365,10 @@ extern "C" {
      * Will return NULL if fncs_get_keys_size() returns 0. */
     FNCS_EXPORT char** fncs_get_keys();
 
+    /** Convert a time given as text, e.g. "10ms", into nanoseconds in
+     * *out. Returns 0, leaving *out as is, if it does not parse. */
+    FNCS_EXPORT int fncs_parse_time(const char *text, fncs_time *out);
+
     /** Return the name of the simulator. */
     FNCS_EXPORT const char * fncs_get_name();
 
@@ -89,6 +378,20 @@ extern "C" {
     /** Return the number of simulators connected to the broker. */
     FNCS_EXPORT int fncs_get_simulator_count();
 
+    /** Return the time of the latest checkpoint, 0 if none, see
+     * fncs::get_checkpoint(). */
+    FNCS_EXPORT fncs_time fncs_get_checkpoint();
+
+    /** Fill stats with the time request statistics, see fncs::get_stats(). */
+    FNCS_EXPORT void fncs_get_stats(fncs_stats *stats);
+
+    /** Fill memory with the bytes the client holds, see fncs::get_stats(). */
+    FNCS_EXPORT void fncs_get_memory(fncs_memory *memory);
+
+    /** Fill load with the latest load summary of the broker, see
+     * fncs::get_federation_load(). */
+    FNCS_EXPORT void fncs_get_federation_load(fncs_federation_load *load);
+
     /** Helper, free allocated character buffer. */
     FNCS_EXPORT void _fncs_free_char_p(char * ptr);
 
@@ -1,10 +1,12 @@
 #ifndef _FNCS_HPP_
 #define _FNCS_HPP_
  
+#include <complex>
 #include <string>
 #include <utility>
 #include <vector>
 
+using ::std::complex;
 using ::std::pair;
 using ::std::string;
 using ::std::vector;
@@ -35,6 +37,26 @@ namespace fncs {
 
     typedef unsigned long long time;
 
+    /** Handle of a subscribed key, see lookup_key(). */
+    typedef size_t Key;
+
+    /** Returned by lookup_key() for a key that is not subscribed. */
+    const Key INVALID_KEY = static_cast<Key>(-1);
+
+#if __cplusplus >= 201103L
+    /** Times in nanoseconds, e.g. 10_ms, for code built as C++11 or
+     * later, after using namespace fncs::literals. */
+    namespace literals {
+        constexpr time operator"" _ns(unsigned long long value) { return value; }
+        constexpr time operator"" _us(unsigned long long value) { return value * 1000ULL; }
+        constexpr time operator"" _ms(unsigned long long value) { return value * 1000000ULL; }
+        constexpr time operator"" _s(unsigned long long value) { return value * 1000000000ULL; }
+        constexpr time operator"" _min(unsigned long long value) { return value * 60ULL * 1000000000ULL; }
+        constexpr time operator"" _h(unsigned long long value) { return value * 3600ULL * 1000000000ULL; }
+        constexpr time operator"" _d(unsigned long long value) { return value * 86400ULL * 1000000000ULL; }
+    }
+#endif
+
     /** Connect to broker and parse config file. */
     FNCS_EXPORT void initialize();
 
@@ -47,25 +69,176 @@ namespace fncs {
     /** Request the next time step to process. */
     FNCS_EXPORT time time_request(time next);
 
-    /** Publish value using the given key. */
+    /** Send the request for the next time step and return at once. The
+     * sim may prepare its next step meanwhile, but must not publish until
+     * time_request_wait() returns the granted time. */
+    FNCS_EXPORT void time_request_async(time next);
+
+    /** Process arrived messages without blocking; true once the grant of
+     * the pending time_request_async() has arrived. */
+    FNCS_EXPORT bool time_request_poll();
+
+    /** Block until the pending time_request_async() is granted and return
+     * the granted time, as time_request() would. */
+    FNCS_EXPORT time time_request_wait();
+
+    /** File descriptor that becomes readable when messages from the
+     * broker may have arrived, for registering with an event loop while
+     * a time_request_async() is pending. It is edge triggered as zmq's
+     * ZMQ_FD: on every wakeup call time_request_poll(), and call it once
+     * right after registering. -1 if not connected. */
+    FNCS_EXPORT int get_fd();
+
+    /** Publish value using the given key. With FNCS_PUBLISH_THREADS set,
+     * this and the typed publishes below may be called from several
+     * threads at once between time requests; values are sent, in each
+     * thread's order, by the next time_request(). */
     FNCS_EXPORT void publish(const string &key, const string &value);
 
+    /** Get the handle of a key to publish, for publish(Key, value). Other
+     * sims' subscriptions are known once initialize() returns, so a key
+     * nobody subscribed to gets INVALID_KEY, and publishing to it drops
+     * the value as publish() would. These handles are not those of
+     * lookup_key(); they remain valid until finalize(). A key only a
+     * pattern subscription matches has no handle if FNCS_PUBLISH_THREADS
+     * is set; publish it by name. */
+    FNCS_EXPORT Key lookup_publish_key(const string &key);
+
+    /** Publish value by handle, without looking up the key or building
+     * its topic; see lookup_publish_key(). */
+    FNCS_EXPORT void publish(Key key, const string &value);
+
+    /** Publish size bytes as the value of the given key, exactly as
+     * they are, NUL bytes included, so binary payloads need no base64;
+     * subscribers get them back from get_value() with their length. */
+    FNCS_EXPORT void publish(const string &key, const void *data, size_t size);
+
+    /** Publish size bytes by handle, see publish(const string&, const
+     * void*, size_t). */
+    FNCS_EXPORT void publish(Key key, const void *data, size_t size);
+
+    /** Publish a double using the given key. It travels as binary and
+     * subscribers reading it as a string get it formatted on demand. */
+    FNCS_EXPORT void publish_double(const string &key, double value);
+
+    /** Publish a 64 bit integer using the given key, see publish_double(). */
+    FNCS_EXPORT void publish_int64(const string &key, long long value);
+
+    /** Publish a complex using the given key, see publish_double(). It
+     * formats as real+imagj. */
+    FNCS_EXPORT void publish_complex(const string &key, const complex<double> &value);
+
+    /** Publish an array of doubles as one binary value using the given
+     * key, see publish_double(). It formats comma separated. */
+    FNCS_EXPORT void publish_array(const string &key, const double *values, size_t n);
+
+    /** Publish a double by handle, see lookup_publish_key(). */
+    FNCS_EXPORT void publish_double(Key key, double value);
+
+    /** Publish a 64 bit integer by handle. */
+    FNCS_EXPORT void publish_int64(Key key, long long value);
+
+    /** Publish a complex by handle. */
+    FNCS_EXPORT void publish_complex(Key key, const complex<double> &value);
+
+    /** Publish an array of doubles by handle. */
+    FNCS_EXPORT void publish_array(Key key, const double *values, size_t n);
+
+    class RecordBuilder;
+
+    /** Publish a record, see RecordBuilder, using the given key. It
+     * travels in its flat binary layout; subscribers reading it as a
+     * string get it formatted as a JSON object. */
+    FNCS_EXPORT void publish_record(const string &key, const RecordBuilder &record);
+
+    /** Publish a record by handle. */
+    FNCS_EXPORT void publish_record(Key key, const RecordBuilder &record);
+
+    /** Publish value using the given key, delivered at the time given in
+     * sim units, as time_request() takes it: subscribers receive it with
+     * their first grant at or after that time, which the broker holds it
+     * for. A time not after the current one publishes it at once. Call it
+     * from the thread calling time_request(). */
+    FNCS_EXPORT void publish_at(const string &key, const string &value, time delivery);
+
     /** Publish value anonymously using the given key. */
     FNCS_EXPORT void publish_anon(const string &key, const string &value);
 
-    /** Publish value using the given key, adding from:to into the key. */
+    /** Publish size bytes anonymously using the given key. */
+    FNCS_EXPORT void publish_anon(const string &key, const void *data, size_t size);
+
+    /** Publish value on behalf of one of the members of a compound
+     * federate, as that logical sim would: the topic is member/key. The
+     * member must be named by the members of the config. */
+    FNCS_EXPORT void publish_member(const string &member, const string &key, const string &value);
+
+    /** Publish size bytes on behalf of a member, see publish_member(). */
+    FNCS_EXPORT void publish_member(const string &member, const string &key,
+            const void *data, size_t size);
+
+    /** Publish value using the given key, adding from:to into the key:
+     * the topic is sim/from@to/key, which subscribers read the parts of
+     * with get_routed(). */
     FNCS_EXPORT void route(const string &from, const string &to, const string &key, const string &value);
 
+    /** Publish size bytes using the given key, adding from:to into the key. */
+    FNCS_EXPORT void route(const string &from, const string &to, const string &key,
+            const void *data, size_t size);
+
     /** Tell broker of a fatal client error. */
     FNCS_EXPORT void die();
 
     /** Close the connection to the broker. */
     FNCS_EXPORT void finalize();
 
+    /** Close the connection to the broker without waiting for the other
+     * sims to finish: the broker lets this sim go at once and routes
+     * nothing to it any more, and its resources are released before the
+     * federation ends. A broker older than this release answers only at
+     * the end, as finalize(). */
+    FNCS_EXPORT void finalize_detached();
+
     /** Update minimum time delta after connection to broker is made.
      * Assumes time unit is not changing. */
     FNCS_EXPORT void update_time_delta(time delta);
 
+    /** Promise that nothing will be published with a time earlier than
+     * the current time plus the given lookahead, in the sim's time unit.
+     * Lets the broker grant subscribers larger steps. The config key
+     * 'lookahead' sets it before the connection to the broker is made. */
+    FNCS_EXPORT void set_lookahead(time lookahead);
+
+    /** Register a standing time request for the current time plus the
+     * given period, in the sim's time unit; 0 cancels it. A time request
+     * on the period then carries no time, the broker schedules it;
+     * requesting any other time deviates from the period for that step
+     * only. */
+    FNCS_EXPORT void set_periodic(time period);
+
+    /** Promise that, unless a value it receives wakes it sooner, nothing
+     * will be published before the given time, in the sim's time unit.
+     * Sent with the next time request and kept by the broker until the
+     * one after, it lets the broker grant subscribers larger steps, as
+     * a lookahead would. A sim that knows its schedule, such as a
+     * player, declares its next publish this way. */
+    FNCS_EXPORT void set_next_publish(time next);
+
+    /** Called with a time granted, in the sim's time unit, and the data
+     * given to set_rollback(). */
+    typedef void (*RollbackCallback)(time t, void *data);
+
+    /** Opt in to optimistic execution, see FNCS_OPTIMISTIC, before
+     * initialize(). At every grant, before its values are applied, save
+     * is called with the time granted and is to save the sim's state as
+     * it was when time_request() was called. The library saves its cache
+     * alongside. When a value turns out to have reached the sim too
+     * late, time_request() calls restore for the state saved at an
+     * earlier grant and returns the time to redo, which may be earlier
+     * than that state's own. discard, which may be NULL, is called for
+     * every saved state that is never restored again. */
+    FNCS_EXPORT void set_rollback(RollbackCallback save, RollbackCallback restore,
+            RollbackCallback discard, void *data);
+
     /** Get the keys for all values that were updated during the last
      * time_request. */
     FNCS_EXPORT vector<string> get_events();
@@ -78,9 +251,371 @@ namespace fncs {
      * Will return a vector of size 1 if only a single value exists. */
     FNCS_EXPORT vector<string> get_values(const string &key);
 
+    /** Iterator over the handles of the values updated during the last
+     * time_request, in arrival order; see events_begin(). */
+    typedef vector<Key>::const_iterator EventIterator;
+
+    /** Iterate the events without copying them. The iterators are valid
+     * until the next time_request. */
+    FNCS_EXPORT EventIterator events_begin();
+
+    /** End of the events, see events_begin(). */
+    FNCS_EXPORT EventIterator events_end();
+
+    /** Get the name of a subscribed key by handle, without copying it. */
+    FNCS_EXPORT const string& get_key(Key key);
+
+    /** The parts of a topic route() published, sim/from@to/key: the
+     * publishing sim, the from and to given to route(), also as IDs this
+     * sim numbers them by from 0, the same for a name wherever it
+     * appears, and the key. */
+    class Routed {
+        public:
+            Routed() : sim(), from(), to(), key(), from_id(0), to_id(0) {}
+
+            string sim;
+            string from;
+            string to;
+            string key;
+            size_t from_id; /* see get_route_node() */
+            size_t to_id;
+    };
+
+    /** Get the parts of the topic of a key by handle, split the first
+     * time they are asked for rather than per value, e.g. for the keys a
+     * pattern like "ns3/...@house1/..." makes as values arrive. NULL if it
+     * is not a topic route() published. Valid until finalize(). Will
+     * hard fault if key is not found. */
+    FNCS_EXPORT const Routed* get_routed(Key key);
+
+    /** Get the name of a from or to ID of get_routed(), "" if unknown. */
+    FNCS_EXPORT string get_route_node(size_t id);
+
+    /** Get how many from and to names get_routed() has numbered. */
+    FNCS_EXPORT size_t get_route_node_count();
+
+    /** Get the handles of the keys updated during the last time_request,
+     * each once and in ascending order, those subscribed with priority
+     * first, without copying them. The reference is valid until the
+     * next time_request. */
+    FNCS_EXPORT const vector<Key>& changed_keys();
+
+    /** Get how many values the key received since initialize(); a value
+     * changed when this differs from what was read before. */
+    FNCS_EXPORT unsigned long long version(Key key);
+
+    /** Called for a key updated at a grant, with the data given when it
+     * was registered. Read the value by handle, e.g. with get_double(),
+     * which converts a typed value without parsing it. */
+    typedef void (*UpdateCallback)(Key key, void *data);
+
+    /** Call back, before time_request returns, whenever the subscribed
+     * key was updated during it: once per grant, however many values it
+     * received. Must be called after initialize(). A callback must not
+     * request time. Will hard fault if key is not found. */
+    FNCS_EXPORT void on_update(const string &key, UpdateCallback callback, void *data);
+
+    /** Call back for every key updated at a grant, in ascending order of
+     * handle, after the on_update() callbacks of that key. */
+    FNCS_EXPORT void on_any_update(UpdateCallback callback, void *data);
+
+    /** Steps one agent of those given to set_agents() at a grant, with
+     * the time granted in sim units. */
+    typedef void (*AgentStep)(size_t agent, time granted, void *data);
+
+    /** Step n agents at every grant, before time_request returns and
+     * after the on_update() callbacks, on the threads of a pool that
+     * steal agents from each other: FNCS_AGENT_THREADS, the calling one
+     * included, or as many as there are processors. What an agent
+     * publishes with publish() and the typed publishes is sent once all
+     * stepped, in order of agent and then of publishing, so the output
+     * does not depend on which thread ran it. A step must not request
+     * time, and may read a key other agents read at the same grant only
+     * once it was read before, e.g. in an on_update() callback, as the
+     * first read decodes it. A step of NULL or n of 0 stops. */
+    FNCS_EXPORT void set_agents(size_t n, AgentStep step, void *data);
+
+    /** How a subscription made by subscribe() is kept, as the entries
+     * of Config::values are. */
+    class SubscribeOptions {
+        public:
+            SubscribeOptions() : key(), def(), list(false), wake(true) {}
+
+            string key; /* read by, the topic if empty */
+            string def; /* the value until one arrives */
+            bool list; /* keep every value of a step */
+            bool wake; /* a value grants an earlier time step */
+    };
+
+    /** Subscribe to an exact topic, e.g. 'feeder1/voltage', after
+     * initialize(); the handle of its key. The broker routes its values
+     * from the next grant on, and tells its publisher the key, which is
+     * published from that sim's next grant on. Not while a time request
+     * is pending, nor with FNCS_IO_THREAD or rollback. */
+    FNCS_EXPORT Key subscribe(const string &topic,
+            const SubscribeOptions &options=SubscribeOptions());
+
+    /** Stop the values of a topic, from the next grant on. Its key keeps
+     * the last value received, and subscribe() takes it up again. */
+    FNCS_EXPORT void unsubscribe(const string &topic);
+
+    /** Get the handle of a subscribed key, for repeated access to its
+     * value without looking up the key each time. Handles remain valid
+     * until finalize(). */
+    FNCS_EXPORT Key lookup_key(const string &key);
+
+    /** Get the handle of a subscribed key given as a C string, without
+     * allocating. */
+    FNCS_EXPORT Key lookup_key(const char *key);
+
+    /** Get a value from the cache by handle, without copying it. The
+     * reference is valid until the next time_request. */
+    FNCS_EXPORT const string& get_value(Key key);
+
+    /** Get the values of a list subscription by handle, without copying
+     * them. The reference is valid until the next time_request. */
+    FNCS_EXPORT const vector<string>& get_values(Key key);
+
+    /** Get the number of values a list subscription received this step,
+     * by handle, without copying them. */
+    FNCS_EXPORT size_t get_values_size(Key key);
+
+    /** Get one value of a list subscription by handle where it lies in
+     * the buffer the client receives a step's list values into, NUL
+     * terminated, and set *size to its length if size is not NULL; NULL
+     * past the last value. Valid until the next time_request. */
+    FNCS_EXPORT const char* get_values_data(Key key, size_t index, size_t *size=NULL);
+
+    /** Get a value from the cache as a double. A string value is parsed
+     * once per update, a typed one converted without any parsing.
+     * Will hard fault if key is not found. */
+    FNCS_EXPORT double get_double(const string &key);
+
+    /** Get a value from the cache by handle as a double. */
+    FNCS_EXPORT double get_double(Key key);
+
+    /** Get a value from the cache as a 64 bit integer, see get_double(). */
+    FNCS_EXPORT long long get_int64(const string &key);
+
+    /** Get a value from the cache by handle as a 64 bit integer. */
+    FNCS_EXPORT long long get_int64(Key key);
+
+    /** Get a value from the cache as a complex, see get_double(). Text
+     * is read as real+imagj; a real value has no imaginary part. */
+    FNCS_EXPORT complex<double> get_complex(const string &key);
+
+    /** Get a value from the cache by handle as a complex. */
+    FNCS_EXPORT complex<double> get_complex(Key key);
+
+    /** Copy up to n elements of a value from the cache into out and
+     * return how many elements it holds; n may be 0 to ask the size. A
+     * string value is read as comma separated numbers, and a single
+     * number is an array of one. Will hard fault if key is not found. */
+    FNCS_EXPORT size_t get_array(const string &key, double *out, size_t n);
+
+    /** Copy up to n elements of a value from the cache by handle. */
+    FNCS_EXPORT size_t get_array(Key key, double *out, size_t n);
+
+    /** Get a value from the cache by handle as an array, without copying
+     * it. The reference is valid until the next time_request. */
+    FNCS_EXPORT const vector<double>& get_array(Key key);
+
+    /** The values of the subscribed keys in one buffer, filled by
+     * snapshot() and reused from step to step so that its vectors keep
+     * their capacity. Entry i is the value of keys[i] as get_value()
+     * returns it, the bytes of values from offsets[i] up to offsets[i+1];
+     * a list subscription has an entry per value of the step. */
+    class Snapshot {
+        public:
+            Snapshot() : keys(), offsets(), values() {}
+
+            /** The number of entries. */
+            size_t size() const { return keys.size(); }
+
+            /** The value of entry i, which is not terminated. */
+            const char* data(size_t i) const {
+                return values.empty() ? "" : &values[0] + offsets[i];
+            }
+
+            /** The length of the value of entry i. */
+            size_t length(size_t i) const { return offsets[i+1] - offsets[i]; }
+
+            vector<Key> keys; /* ascending */
+            vector<size_t> offsets; /* one more than the keys */
+            vector<char> values;
+    };
+
+    /** The last values of a key subscribed with history: N, oldest
+     * first, each with the time of the grant it came with in the sim's
+     * time unit: the last value of each step it was updated in, or
+     * every value of a list. A view of the client's ring, without
+     * copies, valid until the next time_request. */
+    class History {
+        public:
+            History()
+                : n(0), first(0), capacity(0), times(NULL), values(NULL) {}
+
+            History(size_t n, size_t first, size_t capacity,
+                    const time *times, const string *values)
+                : n(n), first(first), capacity(capacity)
+                , times(times), values(values) {}
+
+            /** The number of values kept, up to N. */
+            size_t size() const { return n; }
+
+            bool empty() const { return 0 == n; }
+
+            /** The time of value i, 0 the oldest. */
+            time time_at(size_t i) const { return times[(first + i) % capacity]; }
+
+            /** Value i, 0 the oldest. */
+            const string& value(size_t i) const { return values[(first + i) % capacity]; }
+
+            /** The newest value. */
+            const string& back() const { return value(n - 1); }
+
+        private:
+            size_t n;
+            size_t first;
+            size_t capacity;
+            const time *times;
+            const string *values;
+    };
+
+    /** Get the history of a key subscribed with history: N. Empty for
+     * a key without one. Will hard fault if key is not found. */
+    FNCS_EXPORT History get_history(const string &key);
+
+    /** Get the history of a key by handle. */
+    FNCS_EXPORT History get_history(Key key);
+
+    /** A structured value: named double, 64 bit integer and string
+     * fields in one flat buffer, a table of fields in front of their
+     * values, read in place without parsing or allocating, e.g.
+     * fncs::get_record("bid").get<double>("price"). A view of the buffer,
+     * valid as long as it is; that of get_record() until the next
+     * time_request. A missing field reads as 0 or "". */
+    class FNCS_EXPORT Record {
+        public:
+            /** Field types, as the value type tags number them. */
+            enum FieldType {
+                FIELD_STRING = 0,
+                FIELD_DOUBLE = 1,
+                FIELD_INT64 = 2
+            };
+
+            static const size_t npos = static_cast<size_t>(-1);
+
+            Record() : data(NULL), n_fields(0) {}
+
+            /** A view of a record's frame payload; invalid, with no
+             * fields, unless it is a well formed one. */
+            Record(const void *data, size_t size);
+
+            bool valid() const { return data != NULL; }
+
+            /** The number of fields. */
+            size_t size() const { return n_fields; }
+
+            /** The index of the named field, npos if there is none. */
+            size_t find(const char *name) const;
+
+            const char* name(size_t index) const;
+
+            FieldType type(size_t index) const;
+
+            /** A number field, converted if it is the other type. */
+            double get_double(size_t index) const;
+
+            long long get_int64(size_t index) const;
+
+            /** A string field, NUL terminated, and its length in *size
+             * if size is not NULL. */
+            const char* get_string(size_t index, size_t *size=NULL) const;
+
+            /** A field by name, of type double, long long, const char*
+             * or string, the last one copied. */
+            template <typename T> T get(const char *name) const;
+
+        private:
+            const unsigned char *field(size_t index) const;
+
+            const unsigned char *data;
+            size_t n_fields;
+    };
+
+    template <> inline double Record::get<double>(const char *name) const {
+        return get_double(find(name));
+    }
+
+    template <> inline long long Record::get<long long>(const char *name) const {
+        return get_int64(find(name));
+    }
+
+    template <> inline const char* Record::get<const char*>(const char *name) const {
+        return get_string(find(name));
+    }
+
+    template <> inline string Record::get<string>(const char *name) const {
+        size_t size = 0;
+        const char *value = get_string(find(name), &size);
+        return string(value, size);
+    }
+
+    /** Lays out the fields of a record to publish, see publish_record().
+     * The fields keep the order they were added in; a builder may be
+     * cleared and refilled each step without reallocating. */
+    class FNCS_EXPORT RecordBuilder {
+        public:
+            RecordBuilder() : names(), types(), values() {}
+
+            RecordBuilder& add_double(const string &name, double value);
+
+            RecordBuilder& add_int64(const string &name, long long value);
+
+            RecordBuilder& add_string(const string &name, const string &value);
+
+            void clear();
+
+            /** Lays the fields out into the record's frame payload. */
+            void encode(string &payload) const;
+
+        private:
+            vector<string> names;
+            string types;
+            vector<string> values; /* little-endian bits of a number */
+    };
+
+    /** Get a record from the cache, valid until the next time_request.
+     * A value that is not a record is converted, once per update, from
+     * a JSON object if the subscription declares the record's fields
+     * with type = record{name:type,...}, types being double, int64 and
+     * string; otherwise the record is invalid. Will hard fault if key
+     * is not found. */
+    FNCS_EXPORT Record get_record(const string &key);
+
+    /** Get a record from the cache by handle. */
+    FNCS_EXPORT Record get_record(Key key);
+
+    /** Fill out with the values of every subscribed key, or with
+     * changed_only of only those updated during the last time_request,
+     * in one pass over the cache instead of a lookup and a copy per key. */
+    FNCS_EXPORT void snapshot(Snapshot &out, bool changed_only=false);
+
     /** Get a vector of configured keys. */
     FNCS_EXPORT vector<string> get_keys();
 
+    /** Iterator over the configured keys, see keys_begin(). */
+    typedef vector<string>::const_iterator KeyIterator;
+
+    /** Iterate the configured keys without copying them. The iterators
+     * are valid until finalize(), or until a topic matched by a pattern
+     * subscription that is not a list adds its key. */
+    FNCS_EXPORT KeyIterator keys_begin();
+
+    /** End of the configured keys, see keys_begin(). */
+    FNCS_EXPORT KeyIterator keys_end();
+
     /** Return the name of the simulator. */
     FNCS_EXPORT string get_name();
 
@@ -93,9 +628,245 @@ namespace fncs {
     /** Return the number of simulators connected to the broker. */
     FNCS_EXPORT int get_simulator_count();
 
+    /** Return the time of the latest checkpoint, 0 if none: the time
+     * the broker was about to grant when it took one, see
+     * FNCS_CHECKPOINT, or the one restored with FNCS_RESTART. The
+     * library saves its cache itself. A sim that sees it change after a
+     * time request should save its own state and the time it had
+     * requested, and after a restart request that time first. */
+    FNCS_EXPORT time get_checkpoint();
+
+    /** Where the wall time of the sim's time requests went, in
+     * nanoseconds, and what they received, since initialize(). What
+     * remains of a step besides time_requesting is the sim's own. */
+    class Stats {
+        public:
+            Stats()
+                : n_requests(0)
+                , n_local(0)
+                , time_requesting(0)
+                , time_blocked(0)
+                , time_dispatching(0)
+                , n_messages(0)
+                , n_values(0)
+                , bytes_received(0)
+                , bytes_cache(0)
+                , bytes_lists(0)
+                , bytes_pending(0)
+            {}
+
+            unsigned long long n_requests; /* sent to the broker */
+            unsigned long long n_local; /* answered within a window or lease */
+            time time_requesting; /* inside the time_request functions */
+            time time_blocked; /* of that, in zmq_poll waiting for the broker */
+            time time_dispatching; /* of that, receiving and caching values */
+            unsigned long long n_messages; /* PUBLISH and PUBLISH_BATCH received */
+            unsigned long long n_values; /* values they carried */
+            unsigned long long bytes_received; /* of the values */
+            unsigned long long bytes_cache; /* held by the cache slots, their
+                                               values, history and snapshots */
+            unsigned long long bytes_lists; /* by the list values of the step */
+            unsigned long long bytes_pending; /* by publishes not yet sent */
+    };
+
+    /** Return the time request statistics, and the memory the client
+     * holds now as far as it keeps count, which leaves out zmq's queues
+     * and the I/O thread's staging; with FNCS_STATS_FILE set, finalize()
+     * appends them to that file as a line of JSON. */
+    FNCS_EXPORT Stats get_stats();
+
+    /** The broker's view of the federation as of a grant of this sim,
+     * for a federate that publishes less or widens its step when the
+     * others are held up. Sent with every FNCS_LOAD_FEEDBACK-th grant;
+     * times are wall clock nanoseconds. */
+    class FederationLoad {
+        public:
+            FederationLoad()
+                : time_granted(0)
+                , time_round(0)
+                , time_round_mean(0)
+                , n_queued(0)
+                , waiting_share(0)
+            {}
+
+            time time_granted; /* of the grant it came with, 0 if none came */
+            time time_round; /* between this sim's last two grants */
+            time time_round_mean; /* ... averaged over recent grants of any sim */
+            unsigned long long n_queued; /* values the broker held for this sim */
+            double waiting_share; /* of the time sims waited on another's time
+                                     request since the last one, the part
+                                     they waited on this sim, 0 to 1 */
+    };
+
+    /** Return the latest load summary; all zero unless the broker sets
+     * FNCS_LOAD_FEEDBACK. */
+    FNCS_EXPORT FederationLoad get_federation_load();
+
     /*  Run-time API version detection. */
     FNCS_EXPORT void get_version(int *major, int *minor, int *patch);
 
+    class ClientState;
+
+    /** An independent federate, for running several in one process; the
+     * free functions above act on a default one. Each Context has its own
+     * connection to the broker, cache and time, while the zmq context is
+     * shared by the process. Its methods do what the free functions of
+     * the same name do, for this federate.
+     *
+     * A Context is used from one thread at a time, and only one of its
+     * methods runs at once in the process. The federate name comes from
+     * its configuration, FNCS_NAME only being used when that has none, so
+     * pass each Context its own configuration. Call finalize() before
+     * destruction; a connected Context that is destroyed closes its
+     * connection without telling the broker. */
+    class FNCS_EXPORT Context {
+        public:
+            Context();
+
+            ~Context();
+
+            void initialize();
+            void initialize(const string &configuration);
+            bool is_initialized();
+            time time_request(time next);
+            void time_request_async(time next);
+            bool time_request_poll();
+            time time_request_wait();
+            int get_fd();
+
+            void publish(const string &key, const string &value);
+            Key lookup_publish_key(const string &key);
+            void publish(Key key, const string &value);
+            void publish(const string &key, const void *data, size_t size);
+            void publish(Key key, const void *data, size_t size);
+            void publish_double(const string &key, double value);
+            void publish_int64(const string &key, long long value);
+            void publish_complex(const string &key, const complex<double> &value);
+            void publish_array(const string &key, const double *values, size_t n);
+            void publish_double(Key key, double value);
+            void publish_int64(Key key, long long value);
+            void publish_complex(Key key, const complex<double> &value);
+            void publish_array(Key key, const double *values, size_t n);
+            void publish_record(const string &key, const RecordBuilder &record);
+            void publish_record(Key key, const RecordBuilder &record);
+            void publish_at(const string &key, const string &value, time delivery);
+            void publish_anon(const string &key, const string &value);
+            void publish_anon(const string &key, const void *data, size_t size);
+            void publish_member(const string &member, const string &key, const string &value);
+            void publish_member(const string &member, const string &key,
+                    const void *data, size_t size);
+            void route(const string &from, const string &to, const string &key, const string &value);
+            void route(const string &from, const string &to, const string &key,
+                    const void *data, size_t size);
+
+            void die();
+            void finalize();
+            void finalize_detached();
+            void update_time_delta(time delta);
+            void set_lookahead(time lookahead);
+            void set_periodic(time period);
+            void set_next_publish(time next);
+            void set_rollback(RollbackCallback save, RollbackCallback restore,
+                    RollbackCallback discard, void *data);
+
+            vector<string> get_events();
+            EventIterator events_begin();
+            EventIterator events_end();
+            const string& get_key(Key key);
+            const Routed* get_routed(Key key);
+            string get_route_node(size_t id);
+            size_t get_route_node_count();
+            const vector<Key>& changed_keys();
+            unsigned long long version(Key key);
+            void on_update(const string &key, UpdateCallback callback, void *data);
+            void on_any_update(UpdateCallback callback, void *data);
+            void set_agents(size_t n, AgentStep step, void *data);
+            Key subscribe(const string &topic,
+                    const SubscribeOptions &options=SubscribeOptions());
+            void unsubscribe(const string &topic);
+
+            Key lookup_key(const string &key);
+            Key lookup_key(const char *key);
+
+            string get_value(const string &key);
+            const string& get_value(Key key);
+            vector<string> get_values(const string &key);
+            const vector<string>& get_values(Key key);
+            History get_history(const string &key);
+            History get_history(Key key);
+            Record get_record(const string &key);
+            Record get_record(Key key);
+            size_t get_values_size(Key key);
+            const char* get_values_data(Key key, size_t index, size_t *size=NULL);
+            double get_double(const string &key);
+            double get_double(Key key);
+            long long get_int64(const string &key);
+            long long get_int64(Key key);
+            complex<double> get_complex(const string &key);
+            complex<double> get_complex(Key key);
+            size_t get_array(const string &key, double *out, size_t n);
+            size_t get_array(Key key, double *out, size_t n);
+            const vector<double>& get_array(Key key);
+            void snapshot(Snapshot &out, bool changed_only=false);
+
+            vector<string> get_keys();
+            KeyIterator keys_begin();
+            KeyIterator keys_end();
+
+            string get_name();
+            time get_time_delta();
+            int get_id();
+            int get_simulator_count();
+            time get_checkpoint();
+            Stats get_stats();
+            FederationLoad get_federation_load();
+
+        private:
+            /* not copyable */
+            Context(const Context &);
+            Context& operator=(const Context &);
+
+            ClientState *state;
+    };
+
+    class BrokerState;
+
+    /** The fncs_broker, run on a thread of this process, for federates
+     * that live in one process or are tested as one. The broker binds
+     * the endpoint before the constructor returns, so the federates can
+     * connect at once; give them the same endpoint as their broker, an
+     * inproc:// one sparing them the network. Apart from FNCS_BROKER,
+     * the FNCS_* environment variables apply as they do to fncs_broker.
+     *
+     * The federation ends when all n_sims federates said BYE, and the
+     * destructor waits for that. A fatal broker error ends the process,
+     * as die() does in a federate. One Broker runs at a time in a
+     * process, unless the library was built by a compiler with
+     * thread_local, as fncs_broker --tenants needs; construct and
+     * destroy it on the thread using fncs. */
+    class FNCS_EXPORT Broker {
+        public:
+            /** realtime_interval, e.g. '1s', paces the grants against
+             * the clock, as the second fncs_broker argument does. */
+            Broker(unsigned int n_sims,
+                    const string &endpoint="inproc://fncs_broker",
+                    const string &realtime_interval="");
+
+            ~Broker();
+
+            /** Wait until the federation has ended. */
+            void wait();
+
+            const string& get_endpoint() const;
+
+        private:
+            /* not copyable */
+            Broker(const Broker &);
+            Broker& operator=(const Broker &);
+
+            BrokerState *state;
+    };
+
 }
 
 #endif /* _FNCS_HPP_ */
@@ -0,0 +1,264 @@
+#ifndef _FNCS_AGENTS_HPP_
+#define _FNCS_AGENTS_HPP_
+
+#include "fncs.hpp"
+
+/* Only with a compiler and library of C++20 coroutines; the library
+ * itself is built without them, this header is all there is. */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace fncs {
+
+    class AgentScheduler;
+
+    /** A lightweight agent, a coroutine over the client library that
+     * waits with co_await fncs::advance(t) and co_await
+     * fncs::updated(key), e.g.
+     *
+     *   fncs::Agent house(int n) {
+     *       for (fncs::time t=0; t<86400; ) {
+     *           t = co_await fncs::advance(t + 60);
+     *           fncs::publish("house" + to_string(n), "1.5");
+     *       }
+     *   }
+     *
+     * An AgentScheduler runs any number of them in one sim. */
+    class Agent {
+        public:
+            class promise_type {
+                public:
+                    promise_type() : scheduler(nullptr), error() {}
+
+                    Agent get_return_object() {
+                        return Agent(std::coroutine_handle<promise_type>::from_promise(*this));
+                    }
+                    /* the scheduler starts it */
+                    std::suspend_always initial_suspend() noexcept { return {}; }
+                    /* the scheduler destroys it */
+                    std::suspend_always final_suspend() noexcept { return {}; }
+                    void return_void() {}
+                    void unhandled_exception() { error = std::current_exception(); }
+
+                    AgentScheduler *scheduler;
+                    std::exception_ptr error; /* rethrown by AgentScheduler::run() */
+            };
+
+            typedef std::coroutine_handle<promise_type> Handle;
+
+            Agent(Agent &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+
+            ~Agent() {
+                if (handle) {
+                    handle.destroy();
+                }
+            }
+
+            /** Give up the coroutine, see AgentScheduler::spawn(). */
+            Handle release() {
+                Handle released = handle;
+                handle = nullptr;
+                return released;
+            }
+
+        private:
+            explicit Agent(Handle handle) : handle(handle) {}
+
+            Agent(const Agent &) = delete;
+            Agent& operator=(const Agent &) = delete;
+
+            Handle handle;
+    };
+
+    /** Multiplexes agents over the single connection of this sim. Each
+     * step it resumes only the agents whose time came or a key of which
+     * was updated at the grant, then sends one time request for the
+     * earliest time any of them waits for, so a thousand agents cost the
+     * federation what one sim costs. Times are in sim units, as
+     * time_request() takes them. Call run() from the thread that calls
+     * time_request() otherwise. */
+    class AgentScheduler {
+        public:
+            AgentScheduler() : now_(0), order(0), ready(), timers(), waiters(), running(0) {}
+
+            ~AgentScheduler() {
+                for (; !ready.empty(); ready.pop_front()) {
+                    ready.front().destroy();
+                }
+                for (; !timers.empty(); timers.pop()) {
+                    timers.top().handle.destroy();
+                }
+                for (WaiterMap::iterator it=waiters.begin(); it!=waiters.end(); ++it) {
+                    for (size_t i=0; i<it->second.size(); ++i) {
+                        it->second[i].destroy();
+                    }
+                }
+            }
+
+            /** Add an agent, which first runs at the next step of run(). */
+            void spawn(Agent agent) {
+                Agent::Handle handle = agent.release();
+                handle.promise().scheduler = this;
+                ready.push_back(handle);
+                ++running;
+            }
+
+            /** Run the agents until they all returned or time_stop was
+             * granted; the time last granted. An exception an agent let
+             * escape ends it and is rethrown here. */
+            fncs::time run(fncs::time time_stop) {
+                while (running) {
+                    resume_ready();
+                    if (!running || now_ >= time_stop) {
+                        break;
+                    }
+                    /* agents waiting on keys only are woken by a value */
+                    fncs::time next = timers.empty() ? time_stop
+                        : std::min(timers.top().time, time_stop);
+                    if (timers.empty() && waiters.empty()) {
+                        break;
+                    }
+                    now_ = fncs::time_request(next);
+                    for (EventIterator it=events_begin(); it!=events_end(); ++it) {
+                        WaiterMap::iterator found = waiters.find(*it);
+                        if (found != waiters.end()) {
+                            ready.insert(ready.end(), found->second.begin(), found->second.end());
+                            waiters.erase(found);
+                        }
+                    }
+                    while (!timers.empty() && timers.top().time <= now_) {
+                        ready.push_back(timers.top().handle);
+                        timers.pop();
+                    }
+                }
+                return now_;
+            }
+
+            /** The time last granted. */
+            fncs::time now() const { return now_; }
+
+            /** How many agents have not returned yet. */
+            size_t size() const { return running; }
+
+            void wait_until(fncs::time time, Agent::Handle handle) {
+                if (time <= now_) {
+                    ready.push_back(handle);
+                }
+                else {
+                    timers.push(Timer(time, order++, handle));
+                }
+            }
+
+            void wait_for(Key key, Agent::Handle handle) {
+                waiters[key].push_back(handle);
+            }
+
+        private:
+            /* an agent waiting for its time, in order of time, then of
+             * waiting */
+            class Timer {
+                public:
+                    Timer(fncs::time time, unsigned long long order, Agent::Handle handle)
+                        : time(time), order(order), handle(handle) {}
+
+                    bool operator>(const Timer &that) const {
+                        return time != that.time ? time > that.time : order > that.order;
+                    }
+
+                    fncs::time time;
+                    unsigned long long order;
+                    Agent::Handle handle;
+            };
+
+            typedef std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > TimerQueue;
+            typedef std::map<Key, std::vector<Agent::Handle> > WaiterMap;
+
+            /* resume the agents that are due, and those they make due */
+            void resume_ready() {
+                while (!ready.empty()) {
+                    Agent::Handle handle = ready.front();
+                    ready.pop_front();
+                    handle.resume();
+                    if (handle.done()) {
+                        std::exception_ptr error = handle.promise().error;
+                        handle.destroy();
+                        --running;
+                        if (error) {
+                            std::rethrow_exception(error);
+                        }
+                    }
+                }
+            }
+
+            fncs::time now_;
+            unsigned long long order;
+            std::deque<Agent::Handle> ready;
+            TimerQueue timers;
+            WaiterMap waiters;
+            size_t running;
+    };
+
+    /** Awaited by an agent to be resumed once the given time is granted;
+     * co_await yields the time granted, as time_request() returns it. A
+     * time already granted resumes it within the same step. */
+    class Advance {
+        public:
+            explicit Advance(fncs::time time) : time(time), scheduler(nullptr) {}
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(Agent::Handle handle) {
+                scheduler = handle.promise().scheduler;
+                scheduler->wait_until(time, handle);
+            }
+
+            fncs::time await_resume() const { return scheduler->now(); }
+
+        private:
+            fncs::time time;
+            AgentScheduler *scheduler;
+    };
+
+    /** Awaited by an agent to be resumed at the next grant that updates
+     * the subscribed key; co_await yields the time granted. The key must
+     * have a handle, see lookup_key(). */
+    class Updated {
+        public:
+            explicit Updated(Key key) : key(key), scheduler(nullptr) {}
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(Agent::Handle handle) {
+                scheduler = handle.promise().scheduler;
+                scheduler->wait_for(key, handle);
+            }
+
+            fncs::time await_resume() const { return scheduler->now(); }
+
+        private:
+            Key key;
+            AgentScheduler *scheduler;
+    };
+
+    inline Advance advance(fncs::time time) { return Advance(time); }
+
+    inline Updated updated(Key key) { return Updated(key); }
+
+    inline Updated updated(const string &key) { return Updated(lookup_key(key)); }
+
+}
+
+#endif
+#endif
+
+#endif /* _FNCS_AGENTS_HPP_ */
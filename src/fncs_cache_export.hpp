@@ -0,0 +1,320 @@
+#ifndef _FNCS_CACHE_EXPORT_HPP_
+#define _FNCS_CACHE_EXPORT_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fncs.hpp"
+
+namespace fncs {
+
+    /** The cache of a sim as of its last grant, in a shared memory
+     * segment that processes on the same host map read-only, see
+     * FNCS_CACHE_EXPORT. Numbers are u64 in the host's byte order:
+     *
+     *   "FNCSCAC1", sequence, size of the segment, time granted (ns),
+     *   grants so far, entries, bytes of the entries, flags
+     *   per entry: key size (u32), value size (u32, the top bit set for
+     *              a value of a list), key, value as text
+     *
+     * A key subscribed as a list has an entry per value of the step.
+     * The sim rewrites it at each grant between two increments of the
+     * sequence, a seqlock: it is odd while the entries change, and a
+     * reader keeps a copy only if it read the same even sequence before
+     * and after copying. */
+    const char * const CACHE_EXPORT_MAGIC = "FNCSCAC1";
+    const size_t CACHE_EXPORT_HEADER = 64;
+    const unsigned long long CACHE_EXPORT_TRUNCATED = 1; /* flags: some did not fit */
+    const unsigned long long CACHE_EXPORT_CLOSED = 2; /* ... the sim finalized */
+    const unsigned long CACHE_EXPORT_LIST = 0x80000000UL;
+
+    /** A full barrier between the sequence and the entries. */
+    inline void cache_export_fence() {
+#if (defined WIN32 || defined _WIN32)
+        MemoryBarrier();
+#else
+        __sync_synchronize();
+#endif
+    }
+
+    /** One value of a CacheReader snapshot. */
+    struct CacheEntry {
+        std::string key;
+        std::string value;
+        bool list; /* one of the values of a list key */
+    };
+
+    /** The state of a CacheReader snapshot. */
+    struct CacheSnapshot {
+        CacheSnapshot() : time(0), grants(0), truncated(false), closed(false), entries() {}
+
+        fncs::time time; /* granted, in nanoseconds */
+        unsigned long long grants;
+        bool truncated; /* the segment was too small for every value */
+        bool closed; /* the sim finalized */
+        std::vector<CacheEntry> entries;
+    };
+
+    /** The mapping both sides share; only the writer creates and removes
+     * the segment. */
+    class CacheSegment {
+        public:
+            CacheSegment() : data(NULL), size(0), name(), owner(false)
+#if (defined WIN32 || defined _WIN32)
+                , mapping(NULL)
+#endif
+            {}
+
+            ~CacheSegment() { close(); }
+
+            bool is_open() const { return data != NULL; }
+
+            /** Create the segment of the given size, replacing one of
+             * the same name. A POSIX name is given a leading slash. */
+            bool create(const std::string &segment, size_t bytes) {
+                close();
+                name = shm_name(segment);
+                if (bytes < CACHE_EXPORT_HEADER) {
+                    return false;
+                }
+#if (defined WIN32 || defined _WIN32)
+                unsigned long long large = bytes;
+                mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                        static_cast<DWORD>(large >> 32), static_cast<DWORD>(large),
+                        name.c_str());
+                if (!mapping) {
+                    return false;
+                }
+                data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, bytes));
+#else
+                shm_unlink(name.c_str());
+                int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+                if (fd < 0) {
+                    return false;
+                }
+                if (ftruncate(fd, bytes) != 0) {
+                    ::close(fd);
+                    shm_unlink(name.c_str());
+                    return false;
+                }
+                void *address = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd); /* the map keeps the segment */
+                if (address == MAP_FAILED) {
+                    shm_unlink(name.c_str());
+                    return false;
+                }
+                data = static_cast<char*>(address);
+#endif
+                if (!data) {
+                    close();
+                    return false;
+                }
+                size = bytes;
+                owner = true;
+                memset(data, 0, CACHE_EXPORT_HEADER);
+                put(16, size);
+                memcpy(data, CACHE_EXPORT_MAGIC, 8);
+                return true;
+            }
+
+            /** Map an existing segment read-only. */
+            bool attach(const std::string &segment) {
+                close();
+                name = shm_name(segment);
+#if (defined WIN32 || defined _WIN32)
+                mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+                if (!mapping) {
+                    return false;
+                }
+                data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                MEMORY_BASIC_INFORMATION info;
+                if (data && VirtualQuery(data, &info, sizeof(info))) {
+                    size = info.RegionSize;
+                }
+#else
+                int fd = shm_open(name.c_str(), O_RDONLY, 0);
+                struct stat st;
+                if (fd < 0) {
+                    return false;
+                }
+                if (fstat(fd, &st) != 0) {
+                    ::close(fd);
+                    return false;
+                }
+                void *address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (address != MAP_FAILED) {
+                    data = static_cast<char*>(address);
+                    size = st.st_size;
+                }
+#endif
+                if (!data || size < CACHE_EXPORT_HEADER
+                        || 0 != memcmp(data, CACHE_EXPORT_MAGIC, 8)) {
+                    close();
+                    return false;
+                }
+                return true;
+            }
+
+            void close() {
+                if (data) {
+#if (defined WIN32 || defined _WIN32)
+                    UnmapViewOfFile(data);
+#else
+                    munmap(data, size);
+                    if (owner) {
+                        shm_unlink(name.c_str());
+                    }
+#endif
+                }
+#if (defined WIN32 || defined _WIN32)
+                if (mapping) {
+                    CloseHandle(mapping);
+                    mapping = NULL;
+                }
+#endif
+                data = NULL;
+                size = 0;
+                owner = false;
+            }
+
+            unsigned long long get(size_t at) const {
+                unsigned long long value = 0;
+                memcpy(&value, data + at, sizeof(value));
+                return value;
+            }
+
+            void put(size_t at, unsigned long long value) {
+                memcpy(data + at, &value, sizeof(value));
+            }
+
+            /* read and written through volatile so that each access
+             * happens where the fences say */
+            unsigned long long sequence() const {
+                return *reinterpret_cast<volatile const unsigned long long*>(data + 8);
+            }
+
+            void set_sequence(unsigned long long value) {
+                *reinterpret_cast<volatile unsigned long long*>(data + 8) = value;
+            }
+
+            char *data;
+            size_t size;
+
+        private:
+            /* not copyable */
+            CacheSegment(const CacheSegment &);
+            CacheSegment& operator=(const CacheSegment &);
+
+            static std::string shm_name(const std::string &segment) {
+#if (defined WIN32 || defined _WIN32)
+                return segment;
+#else
+                return segment.empty() || segment[0] != '/' ? '/' + segment : segment;
+#endif
+            }
+
+            std::string name;
+            bool owner; /* removes the segment when closed */
+#if (defined WIN32 || defined _WIN32)
+            HANDLE mapping;
+#endif
+    };
+
+    /** Reads the cache a sim exports with FNCS_CACHE_EXPORT, without
+     * being a federate, e.g.
+     * fncs::CacheReader reader; reader.open("/fncs-sim1");
+     * fncs::CacheSnapshot snapshot; if (reader.read(snapshot)) ...
+     * The segment may be opened before the sim's first grant, which is
+     * when grants becomes 1. */
+    class CacheReader {
+        public:
+            CacheReader() : segment(), copy() {}
+
+            bool open(const std::string &name) { return segment.attach(name); }
+
+            void close() { segment.close(); }
+
+            /** The last grant's snapshot; false if not open, or if the
+             * sim kept rewriting it for every one of tries attempts. */
+            bool read(CacheSnapshot &snapshot, size_t tries = 1000) {
+                if (!segment.is_open()) {
+                    return false;
+                }
+                for (size_t attempt=0; attempt<tries; ++attempt) {
+                    unsigned long long before = segment.sequence();
+                    if (before & 1) {
+                        continue;
+                    }
+                    cache_export_fence();
+                    unsigned long long used = segment.get(48);
+                    if (used > segment.size - CACHE_EXPORT_HEADER) {
+                        continue; /* torn; the sequence tells */
+                    }
+                    snapshot.time = segment.get(24);
+                    snapshot.grants = segment.get(32);
+                    unsigned long long n_entries = segment.get(40);
+                    unsigned long long flags = segment.get(56);
+                    copy.assign(segment.data + CACHE_EXPORT_HEADER,
+                            segment.data + CACHE_EXPORT_HEADER + used);
+                    cache_export_fence();
+                    if (segment.sequence() != before) {
+                        continue;
+                    }
+                    snapshot.truncated = 0 != (flags & CACHE_EXPORT_TRUNCATED);
+                    snapshot.closed = 0 != (flags & CACHE_EXPORT_CLOSED);
+                    return parse(n_entries, snapshot.entries);
+                }
+                return false;
+            }
+
+        private:
+            bool parse(unsigned long long n_entries, std::vector<CacheEntry> &entries) const {
+                const char *base = copy.empty() ? NULL : &copy[0];
+                size_t at = 0;
+                entries.resize(n_entries);
+                for (unsigned long long i=0; i<n_entries; ++i) {
+                    unsigned long key_size = 0;
+                    unsigned long value_size = 0;
+                    if (copy.size() - at < 8) {
+                        return false;
+                    }
+                    key_size = get32(at);
+                    value_size = get32(at + 4);
+                    entries[i].list = 0 != (value_size & CACHE_EXPORT_LIST);
+                    value_size &= ~CACHE_EXPORT_LIST;
+                    at += 8;
+                    if (copy.size() - at < key_size + value_size) {
+                        return false;
+                    }
+                    entries[i].key.assign(base + at, key_size);
+                    entries[i].value.assign(base + at + key_size, value_size);
+                    at += key_size + value_size;
+                }
+                return true;
+            }
+
+            unsigned long get32(size_t at) const {
+                unsigned int value = 0;
+                memcpy(&value, &copy[0] + at, sizeof(value));
+                return value;
+            }
+
+            CacheSegment segment;
+            std::vector<char> copy; /* of the entries, parsed once consistent */
+    };
+
+}
+
+#endif /* _FNCS_CACHE_EXPORT_HPP_ */
@@ -5,6 +5,7 @@
 
 #include <fncs.hpp>
 #include <fncs.h>
+#include "fncs_internal.hpp"
 
 using namespace std;
 
@@ -28,16 +29,96 @@ fncs_time fncs_time_request(fncs_time next)
     return fncs::time_request(next);
 }
 
+void fncs_time_request_async(fncs_time next)
+{
+    fncs::time_request_async(next);
+}
+
+int fncs_time_request_poll()
+{
+    return fncs::time_request_poll() ? 1 : 0;
+}
+
+fncs_time fncs_time_request_wait()
+{
+    return fncs::time_request_wait();
+}
+
+int fncs_get_fd()
+{
+    return fncs::get_fd();
+}
+
 void fncs_publish(const char *key, const char *value)
 {
     fncs::publish(key, value);
 }
 
+void fncs_publish_n(const char *key, const void *value, size_t size)
+{
+    fncs::publish(key, value, size);
+}
+
+fncs_key fncs_lookup_publish_key(const char *key)
+{
+    return fncs::lookup_publish_key(key);
+}
+
+void fncs_publish_by_key(fncs_key key, const char *value)
+{
+    fncs::publish(key, value);
+}
+
+void fncs_publish_by_key_n(fncs_key key, const void *value, size_t size)
+{
+    fncs::publish(key, value, size);
+}
+
+void fncs_publish_at(const char *key, const char *value, fncs_time delivery)
+{
+    fncs::publish_at(key, value, delivery);
+}
+
 void fncs_publish_anon(const char *key, const char *value)
 {
     fncs::publish_anon(key, value);
 }
 
+void fncs_publish_anon_n(const char *key, const void *value, size_t size)
+{
+    fncs::publish_anon(key, value, size);
+}
+
+void fncs_publish_member(const char *member, const char *key, const char *value)
+{
+    fncs::publish_member(member, key, value);
+}
+
+void fncs_publish_member_n(const char *member, const char *key, const void *value, size_t size)
+{
+    fncs::publish_member(member, key, value, size);
+}
+
+void fncs_publish_double(const char *key, double value)
+{
+    fncs::publish_double(key, value);
+}
+
+void fncs_publish_int64(const char *key, long long value)
+{
+    fncs::publish_int64(key, value);
+}
+
+void fncs_publish_complex(const char *key, double real, double imag)
+{
+    fncs::publish_complex(key, complex<double>(real, imag));
+}
+
+void fncs_publish_array(const char *key, const double *values, size_t n)
+{
+    fncs::publish_array(key, values, n);
+}
+
 void fncs_route(
             const char *from,
             const char *to,
@@ -47,6 +128,16 @@ void fncs_route(
     fncs::route(from, to, key, value);
 }
 
+void fncs_route_n(
+            const char *from,
+            const char *to,
+            const char *key,
+            const void *value,
+            size_t size)
+{
+    fncs::route(from, to, key, value, size);
+}
+
 void fncs_die()
 {
     fncs::die();
@@ -57,11 +148,40 @@ void fncs_finalize()
     fncs::finalize();
 }
 
+void fncs_finalize_detached()
+{
+    fncs::finalize_detached();
+}
+
 void fncs_update_time_delta(fncs_time delta)
 {
     fncs::update_time_delta(delta);
 }
 
+void fncs_set_lookahead(fncs_time lookahead)
+{
+    fncs::set_lookahead(lookahead);
+}
+
+void fncs_set_periodic(fncs_time period)
+{
+    fncs::set_periodic(period);
+}
+
+void fncs_set_next_publish(fncs_time next)
+{
+    fncs::set_next_publish(next);
+}
+
+void fncs_set_rollback(
+        void (*save)(fncs_time, void*),
+        void (*restore)(fncs_time, void*),
+        void (*discard)(fncs_time, void*),
+        void *data)
+{
+    fncs::set_rollback(save, restore, discard, data);
+}
+
 static char* convert(const string & the_string)
 {
     char *str = NULL;
@@ -106,7 +226,7 @@ void _fncs_free_char_pp(char ** ptr, size_t size)
 
 size_t fncs_get_events_size()
 {
-    return fncs::get_events().size();
+    return fncs::events_end() - fncs::events_begin();
 }
 
 char** fncs_get_events()
@@ -114,11 +234,74 @@ char** fncs_get_events()
     return convert(fncs::get_events());
 }
 
+void fncs_for_each_event(fncs_event_callback callback, void *data)
+{
+    for (fncs::EventIterator it=fncs::events_begin();
+            it!=fncs::events_end(); ++it) {
+        callback(*it, fncs::get_key(*it).c_str(), data);
+    }
+}
+
+const fncs_key* fncs_changed_keys(size_t *len)
+{
+    const vector<fncs::Key> &keys = fncs::changed_keys();
+    *len = keys.size();
+    return keys.empty() ? NULL : &keys[0];
+}
+
+unsigned long long fncs_version_by_key(fncs_key key)
+{
+    return fncs::version(key);
+}
+
+void fncs_on_update(const char *key, void (*callback)(fncs_key, void*), void *data)
+{
+    fncs::on_update(key, callback, data);
+}
+
+void fncs_on_any_update(void (*callback)(fncs_key, void*), void *data)
+{
+    fncs::on_any_update(callback, data);
+}
+
+void fncs_set_agents(size_t n, void (*step)(size_t, fncs_time, void*), void *data)
+{
+    fncs::set_agents(n, step, data);
+}
+
+fncs_key fncs_subscribe(const char *topic, const char *key, int list, int wake)
+{
+    fncs::SubscribeOptions options;
+    if (key) {
+        options.key = key;
+    }
+    options.list = list != 0;
+    options.wake = wake != 0;
+    return fncs::subscribe(topic, options);
+}
+
+void fncs_unsubscribe(const char *topic)
+{
+    fncs::unsubscribe(topic);
+}
+
 char* fncs_get_value(const char *key)
 {
     return convert(fncs::get_value(key));
 }
 
+char* fncs_get_value_n(const char *key, size_t *size)
+{
+    string value = fncs::get_value(key);
+    char *str = (char*)malloc(value.size()+1);
+    memcpy(str, value.data(), value.size());
+    str[value.size()] = '\0';
+    if (size) {
+        *size = value.size();
+    }
+    return str;
+}
+
 size_t fncs_get_values_size(const char *key)
 {
     return fncs::get_values(key).size();
@@ -129,9 +312,230 @@ char** fncs_get_values(const char *key)
     return convert(fncs::get_values(key));
 }
 
+fncs_key fncs_lookup_key(const char *key)
+{
+    return fncs::lookup_key(key);
+}
+
+const char* fncs_get_value_by_key(fncs_key key)
+{
+    return fncs::get_value(key).c_str();
+}
+
+const char* fncs_get_value_by_key_n(fncs_key key, size_t *size)
+{
+    const string &value = fncs::get_value(key);
+    if (size) {
+        *size = value.size();
+    }
+    return value.data();
+}
+
+int fncs_peek_route(fncs_key key, const char **from, const char **to,
+        const char **name, size_t *from_id, size_t *to_id)
+{
+    const fncs::Routed *routed = fncs::get_routed(key);
+    if (!routed) {
+        return 0;
+    }
+    if (from) {
+        *from = routed->from.c_str();
+    }
+    if (to) {
+        *to = routed->to.c_str();
+    }
+    if (name) {
+        *name = routed->key.c_str();
+    }
+    if (from_id) {
+        *from_id = routed->from_id;
+    }
+    if (to_id) {
+        *to_id = routed->to_id;
+    }
+    return 1;
+}
+
+size_t fncs_get_values_size_by_key(fncs_key key)
+{
+    return fncs::get_values_size(key);
+}
+
+const char* fncs_get_values_by_key(fncs_key key, size_t index)
+{
+    return fncs::get_values_data(key, index);
+}
+
+const char* fncs_get_values_by_key_n(fncs_key key, size_t index, size_t *size)
+{
+    return fncs::get_values_data(key, index, size);
+}
+
+size_t fncs_get_history_size_by_key(fncs_key key)
+{
+    return fncs::get_history(key).size();
+}
+
+const char* fncs_get_history_by_key(fncs_key key, size_t index, fncs_time *time)
+{
+    fncs::History history = fncs::get_history(key);
+    if (index >= history.size()) {
+        return NULL;
+    }
+    if (time) {
+        *time = history.time_at(index);
+    }
+    return history.value(index).c_str();
+}
+
+double fncs_get_double(const char *key)
+{
+    return fncs::get_double(key);
+}
+
+double fncs_get_double_by_key(fncs_key key)
+{
+    return fncs::get_double(key);
+}
+
+long long fncs_get_int64(const char *key)
+{
+    return fncs::get_int64(key);
+}
+
+long long fncs_get_int64_by_key(fncs_key key)
+{
+    return fncs::get_int64(key);
+}
+
+void fncs_get_complex(const char *key, double *real, double *imag)
+{
+    complex<double> value = fncs::get_complex(key);
+    *real = value.real();
+    *imag = value.imag();
+}
+
+void fncs_get_complex_by_key(fncs_key key, double *real, double *imag)
+{
+    complex<double> value = fncs::get_complex(key);
+    *real = value.real();
+    *imag = value.imag();
+}
+
+size_t fncs_get_array(const char *key, double *out, size_t n)
+{
+    return fncs::get_array(key, out, n);
+}
+
+size_t fncs_get_array_by_key(fncs_key key, double *out, size_t n)
+{
+    return fncs::get_array(key, out, n);
+}
+
+const double* fncs_peek_array_by_key(fncs_key key, size_t *len)
+{
+    const vector<double> &array = fncs::get_array(key);
+    *len = array.size();
+    return array.empty() ? NULL : &array[0];
+}
+
+void fncs_get_doubles_by_key(const fncs_key *keys, double *out, size_t n)
+{
+    for (size_t i=0; i<n; ++i) {
+        out[i] = fncs::get_double(keys[i]);
+    }
+}
+
+static const char* peek(const string &the_string, size_t *len)
+{
+    if (len) {
+        *len = the_string.size();
+    }
+    return the_string.c_str();
+}
+
+/* snprintf semantics, without the formatting */
+static size_t copy(const string &the_string, char *buffer, size_t size)
+{
+    if (size) {
+        size_t n = the_string.size() < size ? the_string.size() : size-1;
+        memcpy(buffer, the_string.data(), n);
+        buffer[n] = '\0';
+    }
+    return the_string.size();
+}
+
+const char* fncs_peek_value(const char *key, size_t *len)
+{
+    return peek(fncs::get_value(fncs::lookup_key(key)), len);
+}
+
+const char* fncs_peek_values(const char *key, size_t index, size_t *len)
+{
+    const vector<string> &values = fncs::get_values(fncs::lookup_key(key));
+    if (index >= values.size()) {
+        return NULL;
+    }
+    return peek(values[index], len);
+}
+
+const char* fncs_peek_event(size_t index, size_t *len)
+{
+    if (index >= size_t(fncs::events_end() - fncs::events_begin())) {
+        return NULL;
+    }
+    return peek(fncs::get_key(fncs::events_begin()[index]), len);
+}
+
+const char* fncs_peek_key(size_t index, size_t *len)
+{
+    if (index >= size_t(fncs::keys_end() - fncs::keys_begin())) {
+        return NULL;
+    }
+    return peek(fncs::keys_begin()[index], len);
+}
+
+size_t fncs_copy_value(const char *key, char *buffer, size_t size)
+{
+    return copy(fncs::get_value(fncs::lookup_key(key)), buffer, size);
+}
+
+size_t fncs_copy_values(const char *key, size_t index, char *buffer, size_t size)
+{
+    const vector<string> &values = fncs::get_values(fncs::lookup_key(key));
+    if (index >= values.size()) {
+        return copy(string(), buffer, size);
+    }
+    return copy(values[index], buffer, size);
+}
+
+/* the buffers fncs_snapshot() fills, reused from call to call */
+static fncs::Snapshot snapshot_buffer;
+
+size_t fncs_snapshot(int changed_only)
+{
+    fncs::snapshot(snapshot_buffer, changed_only != 0);
+    return snapshot_buffer.size();
+}
+
+const fncs_key* fncs_snapshot_keys()
+{
+    return snapshot_buffer.keys.empty() ? NULL : &snapshot_buffer.keys[0];
+}
+
+const size_t* fncs_snapshot_offsets()
+{
+    return snapshot_buffer.offsets.empty() ? NULL : &snapshot_buffer.offsets[0];
+}
+
+const char* fncs_snapshot_values()
+{
+    return snapshot_buffer.values.empty() ? "" : &snapshot_buffer.values[0];
+}
+
 size_t fncs_get_keys_size()
 {
-    return fncs::get_keys().size();
+    return fncs::keys_end() - fncs::keys_begin();
 }
 
 char** fncs_get_keys()
@@ -139,9 +543,22 @@ char** fncs_get_keys()
     return convert(fncs::get_keys());
 }
 
+int fncs_parse_time(const char *text, fncs_time *out)
+{
+    fncs::time parsed = 0;
+    if (!fncs::try_parse_time(text, parsed)) {
+        return 0;
+    }
+    *out = parsed;
+    return 1;
+}
+
 const char* fncs_get_name()
 {
-    return fncs::get_name().c_str();
+    /* get_name() returns a temporary, the pointer must outlive it */
+    static string name;
+    name = fncs::get_name();
+    return name.c_str();
 }
 
 int fncs_get_id()
@@ -154,6 +571,41 @@ int fncs_get_simulator_count()
     return fncs::get_simulator_count();
 }
 
+fncs_time fncs_get_checkpoint()
+{
+    return fncs::get_checkpoint();
+}
+
+void fncs_get_stats(fncs_stats *stats)
+{
+    fncs::Stats cpp = fncs::get_stats();
+    stats->n_requests = cpp.n_requests;
+    stats->time_requesting = cpp.time_requesting;
+    stats->time_blocked = cpp.time_blocked;
+    stats->time_dispatching = cpp.time_dispatching;
+    stats->n_messages = cpp.n_messages;
+    stats->n_values = cpp.n_values;
+    stats->bytes_received = cpp.bytes_received;
+}
+
+void fncs_get_memory(fncs_memory *memory)
+{
+    fncs::Stats cpp = fncs::get_stats();
+    memory->bytes_cache = cpp.bytes_cache;
+    memory->bytes_lists = cpp.bytes_lists;
+    memory->bytes_pending = cpp.bytes_pending;
+}
+
+void fncs_get_federation_load(fncs_federation_load *load)
+{
+    fncs::FederationLoad cpp = fncs::get_federation_load();
+    load->time_granted = cpp.time_granted;
+    load->time_round = cpp.time_round;
+    load->time_round_mean = cpp.time_round_mean;
+    load->n_queued = cpp.n_queued;
+    load->waiting_share = cpp.waiting_share;
+}
+
 void fncs_get_version(int *major, int *minor, int *patch)
 {
     *major = FNCS_VERSION_MAJOR;
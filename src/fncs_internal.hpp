@@ -34,6 +34,14 @@ namespace fncs {
                 , def("")
                 , type("")
                 , list("")
+                , deadband("")
+                , on_change("")
+                , wake("")
+                , min_interval("")
+                , every_nth("")
+                , pull("")
+                , history("")
+                , priority("")
             {}
 
             string key;
@@ -41,11 +49,66 @@ namespace fncs {
             string def;
             string type;
             string list;
+            string deadband; /* forward only values moving beyond it */
+            string on_change; /* forward only values that differ */
+            string wake; /* "false" if values must not wake the sim */
+            string min_interval; /* forward no value sooner than this after the last */
+            string every_nth; /* forward only every nth value published */
+            string pull; /* "true" if values are fetched when read */
+            string history; /* how many values to keep, see get_history() */
+            string priority; /* "high" if values go ahead of the others */
 
             bool is_list() const {
                 return toupper(list[0]) == 'T' || toupper(list[0]) == 'Y';
             }
 
+            /** Whether a value grants the sim an earlier time step; a
+             * passive subscription only caches it for the next grant. */
+            bool wakes() const {
+                return !(toupper(wake[0]) == 'F' || toupper(wake[0]) == 'N'
+                        || wake == "0");
+            }
+
+            /** Whether the broker sends the values ahead of those of
+             * ordinary subscriptions queued for the sim, and the sim
+             * calls back for them first. */
+            bool prioritized() const {
+                return toupper(priority[0]) == 'H' || toupper(priority[0]) == 'T'
+                    || toupper(priority[0]) == 'Y';
+            }
+
+            /** Whether the broker keeps the values of the subscription
+             * until the sim reads them rather than sending each. Only a
+             * single value of an exact topic may be pulled. */
+            bool pulls() const {
+                return (toupper(pull[0]) == 'T' || toupper(pull[0]) == 'Y')
+                    && !is_list();
+            }
+
+            /** The broker side filter of the subscription: the deadband,
+             * "0" for on_change alone, then ";min_interval=" and
+             * ";every_nth=" if downsampled and ";pull" if pulled, empty
+             * if every value is wanted. */
+            string filter() const {
+                string spec;
+                if (!deadband.empty()) {
+                    spec = deadband;
+                }
+                else if (toupper(on_change[0]) == 'T' || toupper(on_change[0]) == 'Y') {
+                    spec = "0";
+                }
+                if (!min_interval.empty()) {
+                    spec += ";min_interval=" + min_interval;
+                }
+                if (!every_nth.empty()) {
+                    spec += ";every_nth=" + every_nth;
+                }
+                if (pulls()) {
+                    spec += ";pull";
+                }
+                return spec;
+            }
+
             string to_string() {
                 const string indent("  ");
                 ostringstream os;
@@ -60,6 +123,30 @@ namespace fncs {
                 if (!list.empty()) {
                     os << indent << indent << "list: " << list << endl;
                 }
+                if (!deadband.empty()) {
+                    os << indent << indent << "deadband: " << deadband << endl;
+                }
+                if (!on_change.empty()) {
+                    os << indent << indent << "on_change: " << on_change << endl;
+                }
+                if (!wake.empty()) {
+                    os << indent << indent << "wake: " << wake << endl;
+                }
+                if (!min_interval.empty()) {
+                    os << indent << indent << "min_interval: " << min_interval << endl;
+                }
+                if (!every_nth.empty()) {
+                    os << indent << indent << "every_nth: " << every_nth << endl;
+                }
+                if (!pull.empty()) {
+                    os << indent << indent << "pull: " << pull << endl;
+                }
+                if (!history.empty()) {
+                    os << indent << indent << "history: " << history << endl;
+                }
+                if (!priority.empty()) {
+                    os << indent << indent << "priority: " << priority << endl;
+                }
                 return os.str();
             }
     };
@@ -70,14 +157,18 @@ namespace fncs {
                 : broker("")
                 , name("")
                 , time_delta("")
+                , lookahead("")
                 , fatal("")
+                , members("")
                 , values()
             {}
 
             string broker;
             string name;
             string time_delta;
+            string lookahead; /* never publishes earlier than now+lookahead */
             string fatal;
+            string members; /* logical sims sharing its clock, see expand_members() */
             vector<Subscription> values;
 
             string to_string() {
@@ -91,9 +182,15 @@ namespace fncs {
                 if (!time_delta.empty()) {
                     os << "time_delta: " << time_delta << endl;
                 }
+                if (!lookahead.empty()) {
+                    os << "lookahead: " << lookahead << endl;
+                }
                 if (!fatal.empty()) {
                     os << "fatal: " << fatal << endl;
                 }
+                if (!members.empty()) {
+                    os << "members: " << members << endl;
+                }
                 if (values.size()) {
                     os << "values:" << endl;
                     for (size_t i=0; i<values.size(); ++i) {
@@ -111,16 +208,374 @@ namespace fncs {
     const char * const DIE = "die";
     const char * const BYE = "bye";
     const char * const TIME_DELTA = "time_delta";
+    const char * const PUBLISH_BATCH = "publish_batch";
+    const char * const LOOKAHEAD = "lookahead";
+    const char * const CHECKPOINT = "checkpoint";
+    const char * const PUBLISH_AT = "publish_at";
+    const char * const ROLLBACK = "rollback";
+    const char * const GVT = "gvt";
+    const char * const PERIODIC = "periodic";
+    const char * const CAST_FENCE = "cast_fence";
+    const char * const DIRECT_COUNTS = "direct_counts";
+    const char * const DIRECT_FENCE = "direct_fence";
+    const char * const FETCH = "fetch";
+    const char * const SUBSCRIBE = "subscribe";
+    const char * const UNSUBSCRIBE = "unsubscribe";
+    const char * const DICTIONARY = "dictionary";
+
+    /* in ACK, precedes the keys that have a list subscriber */
+    const char * const LIST_KEYS = "list_keys";
+
+    /* in HELLO and ACK, precedes a frame of packed subscriptions, see
+     * append_manifest() */
+    const char * const MANIFEST = "manifest";
+
+    /* in HELLO, the sender reads zstd compressed values; in ACK, the
+     * receiver may send them, since every sim reads them */
+    const char * const ZSTD = "zstd";
+
+    /* in HELLO, the sender decodes delta encoded list values; in ACK,
+     * precedes the keys that may be sent as deltas */
+    const char * const DELTA = "delta";
+    const char * const DELTA_KEYS = "delta_keys";
+
+    /* in HELLO, the sender saves and restores its state, see
+     * set_rollback(); in ACK, the federation runs optimistically */
+    const char * const OPTIMISTIC = "optimistic";
+
+    /* in HELLO, the sender reads the values queued for it that follow a
+     * count in its TIME_REQUEST grant, see FNCS_DELIVERY_BATCH */
+    const char * const GRANT_BATCH = "grant_batch";
+
+    /* in HELLO, the sender reads and sends topic IDs in place of the
+     * topics of PUBLISH messages; in ACK, precedes a frame of the IDs,
+     * see encode_topic_id() */
+    const char * const TOPIC_IDS = "topic_ids";
+
+    /* in HELLO, the sender can take its grants from a SUB socket; in ACK,
+     * precedes the endpoint of the broker's FNCS_GRANT_CAST socket. There
+     * a grant shared by many sims goes out once, as this string, a
+     * sequence number, TIME_REQUEST and the time, both in decimal, and a
+     * bitmap of the connection order IDs granted it. A value of one of
+     * FNCS_CAST_TOPICS goes out the same way, with PUBLISH, the topic and
+     * the value in place of TIME_REQUEST and the time. */
+    const char * const GRANT_CAST = "grant_cast";
+
+    /* in HELLO, precedes the endpoint where the sender takes PUBLISHes
+     * from their publishers directly, see FNCS_DIRECT; in ACK, precedes
+     * the subscribers the receiver sends its keys to directly */
+    const char * const DIRECT = "direct";
+
+    /* in HELLO, offers a second DEALER that takes the PUBLISHes sent to
+     * the sender; in ACK, precedes the broker's endpoint for it, see
+     * FNCS_DATA_CHANNEL. The client sends it alone on that DEALER once
+     * connected, after which values go there and the grants' fences
+     * count them as values sent directly. */
+    const char * const DATA = "data";
+
+    /* in HELLO, the sender has pull subscriptions; in ACK, the broker
+     * keeps their values for it to FETCH, from a DEALER of its own whose
+     * identity is the sender's name and this suffix. A FETCH names the
+     * topic and the sim's current time, and is answered with the topic
+     * and, if one was published before that time, its latest value. */
+    const char * const PULL = "pull";
+    const char * const PULL_IDENTITY = "/pull";
+
+    /* in HELLO, the sender drops the values of publish_anon() and
+     * route() that no sim subscribes to; in ACK, precedes a frame of
+     * every subscription, see TopicFilter. Not sent when sims may still
+     * join, or when the broker itself passes on unsubscribed values. */
+    const char * const SUBSCRIBED = "subscribed";
+
+    /* in HELLO, the sender reads the summaries of this message type
+     * the broker sends before some of its grants, see FNCS_LOAD_FEEDBACK */
+    const char * const LOAD = "load";
+
+    /* sent to a tenant host, see fncs_broker --tenants, with a namespace
+     * before HELLO; answered with the endpoint of the namespace's broker,
+     * "*" standing for the host the sim reached, or with an empty one and
+     * the reason. Also what a tenant's broker tells the host at its end. */
+    const char * const TENANT = "tenant";
+
+    /* after the time of a BYE, the sender leaves without waiting for the
+     * others; the broker answers it with BYE at once and routes nothing
+     * to it any more, see fncs::finalize_detached() */
+    const char * const DETACH = "detach";
+
+    /* wire protocols negotiated during HELLO/ACK */
+    const char * const PROTOCOL_STRING = "string";
+    const char * const PROTOCOL_BINARY = "binary";
+
+    /** Message type identifiers. The binary protocol sends these as a
+     * single byte frame in place of the type strings above; a one byte
+     * frame can never be mistaken for a type string. */
+    enum MessageType {
+        MSG_UNKNOWN = 0,
+        MSG_HELLO = 1,
+        MSG_ACK = 2,
+        MSG_TIME_REQUEST = 3,
+        MSG_PUBLISH = 4,
+        MSG_DIE = 5,
+        MSG_BYE = 6,
+        MSG_TIME_DELTA = 7,
+        MSG_PUBLISH_BATCH = 8, /* topic and value frames, repeated */
+        MSG_LOOKAHEAD = 9,
+        MSG_CHECKPOINT = 10, /* time about to be granted */
+        MSG_PUBLISH_AT = 11, /* topic, value and delivery time */
+        MSG_ROLLBACK = 12, /* time of the state to restore, time granted */
+        MSG_GVT = 13, /* no state before this time is restored again */
+        MSG_PERIODIC = 14, /* standing request period, see set_periodic() */
+        MSG_CAST_FENCE = 15, /* grant cast sequence number the grant follows */
+        MSG_DIRECT_COUNTS = 16, /* values sent directly, by topic ID */
+        MSG_DIRECT_FENCE = 17, /* values sent directly the grant follows */
+        MSG_FETCH = 18, /* topic and time, see PULL */
+        MSG_SUBSCRIBE = 19, /* topic, list and wake flags, see fncs::subscribe() */
+        MSG_UNSUBSCRIBE = 20, /* topic */
+        MSG_DICTIONARY = 21, /* code, value */
+        MSG_LOAD = 22, /* see fncs::FederationLoad, before a grant */
+        MSG_LAST = MSG_LOAD
+    };
+
+    /** Value type tags. A typed value frame is a NUL byte, which a string
+     * value never starts with, the tag, then the value as little-endian
+     * binary: 8 bytes for a double or an int64, 16 for a complex and 8
+     * per element for an array of doubles. Typed
+     * frames are only sent on the binary protocol; the broker formats
+     * them as text for peers speaking strings. VALUE_BLOB tags a handle
+     * to a large value instead, see FNCS_BLOB_THRESHOLD, followed by the
+     * path of the file holding the value, VALUE_ZSTD a zstd frame of a
+     * value's payload, see FNCS_COMPRESS, and VALUE_DELTA a list value
+     * against the topic's previous one, see FNCS_LIST_DELTA, and
+     * VALUE_RECORD the fields of a Record, and VALUE_DICT the code of a
+     * string value numbered by the broker, see ValueDictionary. None is
+     * ever the type of a TypedValue. */
+    enum ValueType {
+        VALUE_STRING = 0,
+        VALUE_DOUBLE = 1,
+        VALUE_INT64 = 2,
+        VALUE_COMPLEX = 3,
+        VALUE_ARRAY = 4,
+        VALUE_BLOB = 5,
+        VALUE_ZSTD = 6,
+        VALUE_DELTA = 7,
+        VALUE_BYTES = 8,
+        VALUE_RECORD = 9,
+        VALUE_DICT = 10
+    };
+
+    /** A decoded value. A string value parsed as a number keeps type
+     * VALUE_STRING with every field filled in; its array holds the comma
+     * separated fields. An array's real is its first element. */
+    class FNCS_EXPORT TypedValue {
+        public:
+            TypedValue()
+                : type(VALUE_STRING)
+                , real(0.0)
+                , imag(0.0)
+                , integer(0)
+                , array()
+            {}
+
+            ValueType type;
+            double real; /* a double, or the real part of a complex */
+            double imag;
+            long long integer;
+            vector<double> array;
+
+            double as_double() const {
+                return VALUE_INT64 == type ? double(integer) : real;
+            }
+
+            long long as_int64() const {
+                return VALUE_DOUBLE == type || VALUE_COMPLEX == type
+                    || VALUE_ARRAY == type ?
+                    static_cast<long long>(real) : integer;
+            }
+    };
+
+    /** A topic frame may hold the topic's ID instead of the topic: a NUL
+     * byte, which a topic never starts with, then the ID as a
+     * little-endian u32. The broker assigns the IDs and tells each sim
+     * those of its publish keys and subscriptions in its ACK, as
+     * little-endian u32s packed in one frame, NO_TOPIC_ID where the
+     * name must be used. */
+    const size_t TOPIC_ID_SIZE = 5;
+    const size_t NO_TOPIC_ID = 0xFFFFFFFFUL;
+
+    /** Encodes a topic ID into the frame payload that replaces a topic. */
+    FNCS_EXPORT string encode_topic_id(size_t id);
+
+    /** Whether the topic frame payload is an ID, and if so which. */
+    FNCS_EXPORT bool decode_topic_id(const void *data, size_t size, size_t &id);
+
+    /** Encodes a typed value into its frame payload. */
+    FNCS_EXPORT string encode_typed(const TypedValue &value);
+
+    /** Encodes raw bytes into their frame payload: as they are, unless
+     * they start with a NUL byte as the encodings above do, in which
+     * case a NUL and VALUE_BYTES go in front. */
+    FNCS_EXPORT string encode_bytes(const void *data, size_t size);
+
+    /** Whether a frame payload is raw bytes put behind VALUE_BYTES,
+     * which then start two bytes into it. */
+    inline bool bytes_frame(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        return size >= 2 && 0 == bytes[0] && VALUE_BYTES == bytes[1];
+    }
+
+    /** Whether a frame payload is a delta encoded list value, see
+     * FNCS_LIST_DELTA. */
+    FNCS_EXPORT bool delta_frame(const char *data, size_t size);
+
+    /** The frame payload that turns base, the topic's previous value,
+     * into value, which becomes the new base; a keyframe carries the
+     * whole value, as does a delta that would not be smaller. */
+    FNCS_EXPORT string delta_encode(string &base, bool keyframe, const string &value);
+
+    /** Turns base into the value of a delta frame; false if the delta
+     * was made against another value, e.g. one sent before this sim
+     * joined. */
+    FNCS_EXPORT bool delta_apply(string &base, const char *data, size_t size);
+
+    /** Whether a frame payload is a record, see Record; the layout after
+     * the tag is a u32 field count, then per field a type byte, three
+     * zero bytes and u32 offsets of its NUL terminated name and of its
+     * value and the value's size, then the names and values, a number
+     * as 8 little-endian bytes and a string NUL terminated. */
+    inline bool record_frame(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        return size >= 6 && 0 == bytes[0] && VALUE_RECORD == bytes[1];
+    }
+
+    /** Formats a record frame payload as a JSON object. */
+    FNCS_EXPORT string format_record(const void *data, size_t size);
+
+    /** The fields of type = record{name:type,...}, in that order; false
+     * if the type is not a record, or is malformed. */
+    FNCS_EXPORT bool parse_record_type(const string &type,
+            vector<pair<string,Record::FieldType> > &fields);
+
+    /** Encodes the declared fields of a JSON object, a missing one as 0
+     * or "" and a nested object or array as its JSON text, into a record
+     * frame payload; false, leaving payload alone, if text is not a
+     * well-formed object. */
+    FNCS_EXPORT bool record_from_json(const string &text,
+            const vector<pair<string,Record::FieldType> > &fields, string &payload);
+
+    /** Decodes a frame payload; false, with value.type VALUE_STRING, if
+     * it is not a typed value. */
+    FNCS_EXPORT bool decode_typed(const void *data, size_t size, TypedValue &value);
+
+    /** Formats a typed value as text; doubles round trip exactly, a
+     * complex is written as real+imagj and an array comma separated. */
+    FNCS_EXPORT string format_typed(const TypedValue &value);
+
+    /** Parses text as a number, filling in every field of value. */
+    FNCS_EXPORT void parse_typed(const string &text, TypedValue &value);
+
+    /** A frame payload as text, formatting it if it is a typed value. */
+    FNCS_EXPORT string value_to_string(const void *data, size_t size);
+
+    /** Appends one entry to a subscription manifest, which replaces the
+     * text config's values in HELLO and the key frames in ACK: a
+     * little-endian u32 length, the topic or key, and a flags byte with
+     * bit 0 set for a list. Bit 1 is set when a subscription filter
+     * follows as another length and string, see Subscription::filter().
+     * Bit 2 is set for a passive subscription, see Subscription::wakes(),
+     * and bit 3 for a prioritized one, see Subscription::prioritized(). */
+    FNCS_EXPORT void append_manifest(string &manifest, const string &name,
+            bool is_list, const string &filter = string(), bool wakes = true,
+            bool priority = false);
+
+    /** Splits a manifest into names and list flags; false if malformed. */
+    FNCS_EXPORT bool parse_manifest(const void *data, size_t size,
+            vector<pair<string,bool> > &entries);
+
+    /** Also returns the filter of each entry, empty if it has none. */
+    FNCS_EXPORT bool parse_manifest(const void *data, size_t size,
+            vector<pair<string,bool> > &entries, vector<string> &filters);
+
+    /** Also returns whether the values of each entry wake the sim. */
+    FNCS_EXPORT bool parse_manifest(const void *data, size_t size,
+            vector<pair<string,bool> > &entries, vector<string> &filters,
+            vector<bool> &wakes);
+
+    /** Also returns whether each entry is prioritized. */
+    FNCS_EXPORT bool parse_manifest(const void *data, size_t size,
+            vector<pair<string,bool> > &entries, vector<string> &filters,
+            vector<bool> &wakes, vector<bool> &priorities);
+
+    /** Expands the members of a compound federate, names separated by
+     * ',', each of which may end in a range of numbers, e.g.
+     * "pump,agent[0-4999]". Returns false if one is malformed. */
+    FNCS_EXPORT bool expand_members(const string &spec, vector<string> &members);
+
+    /** Rewrites each shm://name of a comma separated endpoint list as
+     * the zmq ipc:// endpoint of that name, a Unix domain socket in the
+     * temporary directory, or at the path if the name is absolute. */
+    FNCS_EXPORT string resolve_endpoints(const string &endpoints);
 
     /** Connects to broker and parses the given config object. */
     FNCS_EXPORT void initialize(Config config);
 
+    /* A compiled config, written by fncs_config_compile, all integers
+     * little-endian:
+     *
+     *   header   "FNCSCFG6"
+     *   u64      FNV-1a hash of the body
+     *   body     broker, name, time_delta, lookahead, fatal, u32 count,
+     *            then key, topic, default, type, list, deadband,
+     *            on_change, wake, min_interval, every_nth, pull, history,
+     *            priority per value, then members
+     *
+     * where every string is a u32 length and its bytes. Older versions,
+     * "FNCSCFG1" without the last four, "FNCSCFG2" without pull,
+     * "FNCSCFG3" without history, "FNCSCFG4" without members and
+     * "FNCSCFG5" without priority, still load. */
+    const char * const CONFIG_MAGIC = "FNCSCFG6";
+    const size_t CONFIG_MAGIC_SIZE = 8;
+
+    /** Serializes a config into the compiled format. */
+    FNCS_EXPORT string compile_config(const Config &config);
+
+    /** Reads a compiled config; false if it is not one, is truncated or
+     * does not match its hash. */
+    FNCS_EXPORT bool load_compiled_config(const void *data, size_t size, Config &config);
+
+    /** Loads a config file: *.zpl, *.yaml or a compiled config, told
+     * apart by its header. False, with a message on stderr, on error. */
+    FNCS_EXPORT bool load_config(const string &filename, Config &config);
+
     /** Starts the FNCS logger. */
     FNCS_EXPORT void start_logging();
 
     /** Retrieve the internal logging streams. */
     FNCS_EXPORT void replicate_logging(TLogLevel &level, FILE *& one, FILE *& two);
 
+    /** Retrieve the internal logging streams, asynchronous sink and
+     * enabled categories. */
+    FNCS_EXPORT void replicate_logging(TLogLevel &level, FILE *& one, FILE *& two,
+            void (*& sink)(const string &line), unsigned &categories);
+
+    /** Hand log lines to a background writer thread, if FNCS_LOG_ASYNC
+     * asked for it; start_logging() calls this. */
+    FNCS_EXPORT void start_async_logging();
+
+    /** Write the queued log lines and log synchronously again. Must be
+     * called before zsys_shutdown(). */
+    FNCS_EXPORT void stop_async_logging();
+
+    /** An embedded broker holds the process's zmq context as a connection
+     * does, so that the last finalize() leaves it open while the broker
+     * runs; the broker also starts the logger if no federate has. */
+    FNCS_EXPORT void embedded_broker_started();
+
+    /** Releases the zmq context, shutting it down if nothing else holds it. */
+    FNCS_EXPORT void embedded_broker_stopped();
+
+    /** The fncs_broker program; the argv of fncs_broker. */
+    FNCS_EXPORT int broker_main(int argc, char **argv);
+
     /** Converts given time string, e.g., '1ms', into a fncs time value.
      * Ignores the value; only converts the unit into a multiplier. */
     FNCS_EXPORT fncs::time time_unit_to_multiplier(const string &value);
@@ -128,9 +583,26 @@ namespace fncs {
     /** Converts given time string, e.g., 1s, into a fncs time value. */
     FNCS_EXPORT fncs::time parse_time(const string &value);
 
+    /** Converts the time given as text, e.g. '10ms' or '1 h', into
+     * nanoseconds without allocating. Returns false, leaving out as is,
+     * for a missing number or unknown unit or a time that overflows;
+     * parse_time() dies instead. */
+    FNCS_EXPORT bool try_parse_time(const char *text, fncs::time &out);
+
+    /** Sets out to the multiplier of the unit of the time given as text,
+     * see try_parse_time(). */
+    FNCS_EXPORT bool try_time_unit(const char *text, fncs::time &out);
+
     /** Converts given time value, assumed in ns, to sim's unit. */
     FNCS_EXPORT fncs::time convert_broker_to_sim_time(fncs::time value);
 
+    /** Whether text matches the glob pattern, where '*' matches any run
+     * of characters, '/' included, and '?' any one character. */
+    FNCS_EXPORT bool glob_match(const string &pattern, const string &text);
+
+    /** Whether a topic or key is a glob pattern, i.e. holds '*' or '?'. */
+    FNCS_EXPORT bool is_topic_pattern(const string &topic);
+
     /** Parses the given configuration string. */
     FNCS_EXPORT Config parse_config(const string &configuration);
 
@@ -155,11 +627,46 @@ namespace fncs {
     /** Converts given czmq frame into a string. */
     FNCS_EXPORT string to_string(zframe_t *frame);
 
+    /** Copies given czmq frame into out, reusing its capacity, so a
+     * string kept across messages stops allocating. */
+    FNCS_EXPORT void to_string(zframe_t *frame, string &out);
+
+    /** Converts given message type identifier into its string form. */
+    FNCS_EXPORT const char * to_string(MessageType type);
+
+    /** Converts given czmq frame into a message type identifier.
+     * Accepts both the string and the binary encoding. */
+    FNCS_EXPORT MessageType to_type(zframe_t *frame);
+
+    /** Converts given czmq frame into a fncs time value.
+     * Binary frames are 8 byte little-endian, otherwise decimal text. */
+    FNCS_EXPORT fncs::time to_time(zframe_t *frame, bool binary);
+
+    /** Like to_time(), but false instead of dying on a malformed frame,
+     * for the broker, which tells its sims before it exits. */
+    FNCS_EXPORT bool try_to_time(zframe_t *frame, bool binary, fncs::time &value);
+
+    /** Sends a message type identifier using the negotiated protocol. */
+    FNCS_EXPORT int send_type(zsock_t *sock, MessageType type, bool binary, bool more);
+
+    /** Sends a fncs time value using the negotiated protocol. */
+    FNCS_EXPORT int send_time(zsock_t *sock, fncs::time value, bool binary, bool more);
+
     /** Current time in seconds with nanosecond precision. */
     FNCS_EXPORT double timer();
 
     /** Current time as a fncs::time in nanoseconds. */
     FNCS_EXPORT fncs::time timer_ft();
+
+    /** Parses an FNCS_POLL value, 'block' or 'spin:<time>', e.g.
+     * 'spin:50us', into how long to spin in nanoseconds, 0 to block at
+     * once. Returns false if it is neither. */
+    FNCS_EXPORT bool parse_poll(const string &value, fncs::time &spin);
+
+    /** zmq_poll(), busy polling without waiting for up to spin
+     * nanoseconds before blocking for what remains of the timeout, in
+     * milliseconds, -1 without one. */
+    FNCS_EXPORT int spin_poll(zmq_pollitem_t *items, int n_items, long timeout, fncs::time spin);
 }
 
 #endif /* _FNCS_INTERNAL_H_ */
@@ -0,0 +1,118 @@
+#ifndef _FNCS_TYPED_HPP_
+#define _FNCS_TYPED_HPP_
+
+#include <complex>
+#include <string>
+#include <vector>
+
+#include "fncs.hpp"
+
+namespace fncs {
+
+    /** How a value of type T is published and read by handle. It is
+     * defined for double, long long, complex<double>, vector<double> and
+     * string; a Publication or Subscription of any other type does not
+     * compile. result is what Subscription<T>::get() returns. */
+    template <typename T> struct ValueTraits;
+
+    template <> struct ValueTraits<double> {
+        typedef double result;
+        static void publish(Key key, double value) { publish_double(key, value); }
+        static result get(Key key) { return get_double(key); }
+    };
+
+    template <> struct ValueTraits<long long> {
+        typedef long long result;
+        static void publish(Key key, long long value) { publish_int64(key, value); }
+        static result get(Key key) { return get_int64(key); }
+    };
+
+    template <> struct ValueTraits<complex<double> > {
+        typedef complex<double> result;
+        static void publish(Key key, const complex<double> &value) {
+            publish_complex(key, value);
+        }
+        static result get(Key key) { return get_complex(key); }
+    };
+
+    template <> struct ValueTraits<vector<double> > {
+        typedef const vector<double>& result;
+        static void publish(Key key, const vector<double> &value) {
+            publish_array(key, value.empty() ? NULL : &value[0], value.size());
+        }
+        static result get(Key key) { return get_array(key); }
+    };
+
+    template <> struct ValueTraits<string> {
+        typedef const string& result;
+        static void publish(Key key, const string &value) {
+            fncs::publish(key, value);
+        }
+        static result get(Key key) { return get_value(key); }
+    };
+
+    /** A key this sim publishes values of type T to, e.g.
+     * fncs::Publication<double> voltage("voltage"); voltage.publish(v);
+     * It may be declared before initialize(); its handle is looked up
+     * once, with the first publish after it, and each value goes out by
+     * handle as the typed publishes do. */
+    template <typename T>
+    class Publication {
+        public:
+            explicit Publication(const string &key)
+                : key_(key), handle_(INVALID_KEY), resolved_(false) {}
+
+            void publish(const T &value) {
+                if (!resolved_ && is_initialized()) {
+                    handle_ = lookup_publish_key(key_);
+                    resolved_ = true;
+                }
+                ValueTraits<T>::publish(handle_, value);
+            }
+
+            const string& key() const { return key_; }
+
+        private:
+            string key_;
+            Key handle_;
+            bool resolved_;
+    };
+
+    /** A subscribed key read as type T, e.g.
+     * fncs::Subscription<complex<double> > load("load"); load.get();
+     * It may be declared before initialize(); its handle is looked up
+     * once, with the first get after it, which hard faults if the key is
+     * not subscribed. A typed value is read without parsing, and a text
+     * one is parsed once per update. */
+    template <typename T>
+    class Subscription {
+        public:
+            explicit Subscription(const string &key)
+                : key_(key), handle_(INVALID_KEY), seen_(0) {}
+
+            typename ValueTraits<T>::result get() {
+                seen_ = version(handle());
+                return ValueTraits<T>::get(handle_);
+            }
+
+            /** Whether a value arrived since the last get(). */
+            bool updated() { return version(handle()) != seen_; }
+
+            const string& key() const { return key_; }
+
+            Key handle() {
+                if (handle_ == INVALID_KEY) {
+                    handle_ = lookup_key(key_);
+                }
+                return handle_;
+            }
+
+        private:
+            string key_;
+            Key handle_;
+            unsigned long long seen_; /* version at the last get() */
+    };
+
+}
+
+#endif /* _FNCS_TYPED_HPP_ */
@@ -0,0 +1,146 @@
+#ifndef _GRANT_QUEUE_HPP_
+#define _GRANT_QUEUE_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "fncs.hpp"
+
+namespace fncs {
+
+    /** Indexed binary min-heap of simulator indexes keyed on the time at
+     * which each simulator becomes actionable. The broker keeps only idle
+     * simulators in the queue and updates a key whenever a TIME_REQUEST or
+     * a PUBLISH changes it, so the next grant is found in O(log n) instead
+     * of scanning every simulator each round. Simulators with the same
+     * time come out lowest index first, so grants are reproducible. */
+    class GrantQueue {
+        public:
+            GrantQueue() : heap(), pos(), key() {}
+
+            /** Reserve room for simulator indexes [0,n). */
+            void resize(size_t n) {
+                pos.resize(n, npos());
+                key.resize(n, 0);
+            }
+
+            bool empty() const { return heap.empty(); }
+
+            size_t size() const { return heap.size(); }
+
+            bool contains(size_t index) const {
+                return index < pos.size() && pos[index] != npos();
+            }
+
+            /** Smallest actionable time; queue must not be empty. */
+            fncs::time top_key() const { return key[heap[0]]; }
+
+            /** Index with the smallest actionable time. */
+            size_t top() const { return heap[0]; }
+
+            /** Insert the index, or move it if already queued. */
+            void update(size_t index, fncs::time value) {
+                if (index >= pos.size()) {
+                    resize(index+1);
+                }
+                if (pos[index] == npos()) {
+                    key[index] = value;
+                    pos[index] = heap.size();
+                    heap.push_back(index);
+                    sift_up(pos[index]);
+                }
+                else if (value < key[index]) {
+                    key[index] = value;
+                    sift_up(pos[index]);
+                }
+                else if (value > key[index]) {
+                    key[index] = value;
+                    sift_down(pos[index]);
+                }
+            }
+
+            /** Remove and return the index with the smallest time. */
+            size_t pop() {
+                size_t index = heap[0];
+                remove(index);
+                return index;
+            }
+
+            /** Remove the index if it is queued. */
+            void remove(size_t index) {
+                if (!contains(index)) {
+                    return;
+                }
+                size_t hole = pos[index];
+                size_t last = heap.size() - 1;
+                pos[index] = npos();
+                if (hole != last) {
+                    size_t moved = heap[last];
+                    heap[hole] = moved;
+                    pos[moved] = hole;
+                    heap.pop_back();
+                    sift_up(hole);
+                    sift_down(pos[moved]);
+                }
+                else {
+                    heap.pop_back();
+                }
+            }
+
+        private:
+            static size_t npos() { return static_cast<size_t>(-1); }
+
+            /* earlier time first, then lower index */
+            bool before(size_t a, size_t b) const {
+                return key[a] < key[b] || (key[a] == key[b] && a < b);
+            }
+
+            void swap(size_t a, size_t b) {
+                size_t tmp = heap[a];
+                heap[a] = heap[b];
+                heap[b] = tmp;
+                pos[heap[a]] = a;
+                pos[heap[b]] = b;
+            }
+
+            void sift_up(size_t i) {
+                while (i > 0) {
+                    size_t parent = (i - 1) / 2;
+                    if (before(heap[i], heap[parent])) {
+                        swap(i, parent);
+                        i = parent;
+                    }
+                    else {
+                        break;
+                    }
+                }
+            }
+
+            void sift_down(size_t i) {
+                size_t n = heap.size();
+                while (true) {
+                    size_t left = 2 * i + 1;
+                    size_t right = left + 1;
+                    size_t smallest = i;
+                    if (left < n && before(heap[left], heap[smallest])) {
+                        smallest = left;
+                    }
+                    if (right < n && before(heap[right], heap[smallest])) {
+                        smallest = right;
+                    }
+                    if (smallest == i) {
+                        break;
+                    }
+                    swap(i, smallest);
+                    i = smallest;
+                }
+            }
+
+            std::vector<size_t> heap; /* heap of simulator indexes */
+            std::vector<size_t> pos; /* position of each index in heap */
+            std::vector<fncs::time> key; /* actionable time per index */
+    };
+
+}
+
+#endif /* _GRANT_QUEUE_HPP_ */
@@ -0,0 +1,32 @@
+#ifndef _HASH_MAP_HPP_
+#define _HASH_MAP_HPP_
+
+#include "config.h"
+
+#if HAVE_UNORDERED_MAP
+#include <unordered_map>
+#elif HAVE_TR1_UNORDERED_MAP
+#include <tr1/unordered_map>
+#else
+#include <map>
+#endif
+
+namespace fncs {
+
+    /** Hash table from K to V, for lookups on the per-message path.
+     * Falls back to std::map when the compiler offers neither the C++11
+     * nor the TR1 unordered_map. Use as fncs::HashMap<K,V>::type. */
+    template <class K, class V>
+    struct HashMap {
+#if HAVE_UNORDERED_MAP
+        typedef std::unordered_map<K,V> type;
+#elif HAVE_TR1_UNORDERED_MAP
+        typedef std::tr1::unordered_map<K,V> type;
+#else
+        typedef std::map<K,V> type;
+#endif
+    };
+
+}
+
+#endif /* _HASH_MAP_HPP_ */
@@ -0,0 +1,857 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !(defined WIN32 || defined _WIN32)
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/* 3rd party headers */
+#include "czmq.h"
+#include "yaml-cpp/yaml.h"
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_launch [--traffic <metrics snapshot>] [--record-traffic <file>]\n"
+    "                   [--broker <fncs_broker path>] [--dry-run] <federation.yaml>";
+
+/* the local socket federates on the broker's node connect to */
+static const char *LOCAL_ENDPOINT = "shm://fncs_launch";
+
+typedef map<string,string> EnvMap;
+
+/* a machine federates run on, see the README */
+class Node {
+    public:
+        Node() : name(), host(), address(), cpus(1), numa(1), free() {}
+
+        string name;
+        string host; /* reached by ssh, unless local */
+        string address; /* others reach its broker at, if it runs one */
+        size_t cpus;
+        size_t numa; /* domains, the cpus split evenly among them */
+        vector<vector<size_t> > free; /* cpus left in each domain */
+
+        bool local() const {
+            return host.empty() || host == "localhost" || host == "127.0.0.1";
+        }
+};
+
+class Federate {
+    public:
+        Federate()
+            : name(), command(), dir(), cpus(1), env(), shared(false)
+            , group(0), node(0), domain(0), pinned()
+        {}
+
+        string name; /* its FNCS name, as in the traffic matrix */
+        string command;
+        string dir;
+        size_t cpus;
+        EnvMap env;
+        bool shared; /* by the replicas of an ensemble, not replicated */
+        size_t group; /* placed together */
+        size_t node;
+        size_t domain;
+        vector<size_t> pinned;
+};
+
+class Federation {
+    public:
+        Federation()
+            : nodes(), federates(), broker_node(0), broker_port(5570)
+            , broker_cpu(-1), broker_env(), subbrokers(false), traffic()
+        {}
+
+        vector<Node> nodes;
+        vector<Federate> federates;
+        size_t broker_node;
+        int broker_port;
+        long broker_cpu; /* -1 unless pinned */
+        EnvMap broker_env;
+        bool subbrokers; /* one per node other than the broker's */
+        string traffic; /* the metrics snapshot to place by */
+};
+
+static void die(const string &message)
+{
+    cerr << "fncs_launch: " << message << endl;
+    exit(EXIT_FAILURE);
+}
+
+
+static string scalar(const YAML::Node &node, const char *key, const string &fallback)
+{
+    string value = fallback;
+    if (const YAML::Node *found = node.FindValue(key)) {
+        if (found->Type() != YAML::NodeType::Scalar) {
+            die(string("'") + key + "' must be a Scalar");
+        }
+        *found >> value;
+    }
+    return value;
+}
+
+
+static size_t count(const YAML::Node &node, const char *key, size_t fallback)
+{
+    size_t value = fallback;
+    if (const YAML::Node *found = node.FindValue(key)) {
+        if (found->Type() != YAML::NodeType::Scalar) {
+            die(string("'") + key + "' must be a Scalar");
+        }
+        *found >> value;
+    }
+    return value;
+}
+
+
+static EnvMap environment(const YAML::Node &node)
+{
+    EnvMap env;
+    if (const YAML::Node *found = node.FindValue("env")) {
+        if (found->Type() != YAML::NodeType::Map) {
+            die("'env' must be a Map");
+        }
+        for (YAML::Iterator it=found->begin(); it!=found->end(); ++it) {
+            string key;
+            string value;
+            it.first() >> key;
+            it.second() >> value;
+            env[key] = value;
+        }
+    }
+    return env;
+}
+
+
+static string replace_all(string text, const string &from, const string &to)
+{
+    for (size_t at=text.find(from); at!=string::npos; at=text.find(from, at + to.size())) {
+        text.replace(at, from.size(), to);
+    }
+    return text;
+}
+
+
+/* The federates of an ensemble: those shared once, and the others once
+ * per replica, named and told their replica as FNCS_REPLICA has the
+ * library name them, "{replica}" in their command and dir replaced. */
+static vector<Federate> replicate(const vector<Federate> &federates, size_t replicas)
+{
+    vector<Federate> ensemble;
+    string shared;
+
+    for (size_t i=0; i<federates.size(); ++i) {
+        if (federates[i].shared) {
+            shared += (shared.empty() ? "" : ",") + federates[i].name;
+            ensemble.push_back(federates[i]);
+        }
+    }
+    for (size_t r=0; r<replicas; ++r) {
+        ostringstream replica;
+        replica << r;
+        for (size_t i=0; i<federates.size(); ++i) {
+            if (federates[i].shared) {
+                continue;
+            }
+            Federate federate = federates[i];
+            federate.name += "#" + replica.str();
+            federate.command = replace_all(federate.command, "{replica}", replica.str());
+            federate.dir = replace_all(federate.dir, "{replica}", replica.str());
+            federate.env["FNCS_REPLICA"] = replica.str();
+            federate.env["FNCS_ENSEMBLE_SHARED"] = shared;
+            ensemble.push_back(federate);
+        }
+    }
+    return ensemble;
+}
+
+
+static Federation read_federation(const string &path)
+{
+    Federation federation;
+    YAML::Node doc;
+
+    ifstream fin(path.c_str());
+    if (!fin) {
+        die("could not open '" + path + "'");
+    }
+    try {
+        YAML::Parser parser(fin);
+        parser.GetNextDocument(doc);
+    } catch (YAML::ParserException &e) {
+        die("could not parse '" + path + "': " + e.what());
+    }
+
+    if (const YAML::Node *nodes = doc.FindValue("nodes")) {
+        for (YAML::Iterator it=nodes->begin(); it!=nodes->end(); ++it) {
+            Node node;
+            node.host = scalar(*it, "host", "");
+            node.name = scalar(*it, "name", node.host.empty() ? "localhost" : node.host);
+            node.address = scalar(*it, "address", node.host);
+            node.cpus = count(*it, "cpus", 1);
+            node.numa = count(*it, "numa", 1);
+            if (0 == node.numa || node.numa > node.cpus) {
+                die("node '" + node.name + "' needs at least a cpu per NUMA domain");
+            }
+            federation.nodes.push_back(node);
+        }
+    }
+    if (federation.nodes.empty()) {
+        Node node;
+        node.name = "localhost";
+#if !(defined WIN32 || defined _WIN32)
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        node.cpus = n_cpus > 0 ? n_cpus : 1;
+#endif
+        federation.nodes.push_back(node);
+    }
+
+    if (const YAML::Node *broker = doc.FindValue("broker")) {
+        string name = scalar(*broker, "node", federation.nodes[0].name);
+        size_t i = 0;
+        while (i < federation.nodes.size() && federation.nodes[i].name != name) {
+            ++i;
+        }
+        if (i == federation.nodes.size()) {
+            die("the broker's node '" + name + "' is not among the nodes");
+        }
+        federation.broker_node = i;
+        federation.broker_port = static_cast<int>(count(*broker, "port", 5570));
+        string cpu = scalar(*broker, "cpu", "");
+        federation.broker_cpu = cpu.empty() ? -1 : atol(cpu.c_str());
+        federation.broker_env = environment(*broker);
+    }
+    federation.subbrokers = "true" == scalar(doc, "subbrokers", "false");
+    federation.traffic = scalar(doc, "traffic", "");
+
+    const YAML::Node *federates = doc.FindValue("federates");
+    if (!federates || federates->Type() != YAML::NodeType::Sequence) {
+        die("'federates' must be a Sequence");
+    }
+    for (YAML::Iterator it=federates->begin(); it!=federates->end(); ++it) {
+        Federate federate;
+        federate.name = scalar(*it, "name", "");
+        federate.command = scalar(*it, "command", "");
+        federate.dir = scalar(*it, "dir", "");
+        federate.cpus = count(*it, "cpus", 1);
+        federate.env = environment(*it);
+        federate.shared = "true" == scalar(*it, "shared", "false");
+        if (federate.name.empty() || federate.command.empty()) {
+            die("every federate needs a name and a command");
+        }
+        if (0 == federate.cpus) {
+            die("federate '" + federate.name + "' needs at least one cpu");
+        }
+        federation.federates.push_back(federate);
+    }
+    if (size_t replicas = count(doc, "ensemble", 0)) {
+        federation.federates = replicate(federation.federates, replicas);
+    }
+    return federation;
+}
+
+
+/* Bytes between each pair of federates, either way, from the "traffic"
+ * of a broker metrics snapshot; JSON is read as the YAML it also is. */
+static vector<vector<double> > read_traffic(const Federation &federation, const string &path)
+{
+    size_t n = federation.federates.size();
+    vector<vector<double> > weights(n, vector<double>(n, 0.0));
+    map<string,size_t> index;
+    YAML::Node doc;
+
+    if (path.empty()) {
+        return weights;
+    }
+    for (size_t i=0; i<n; ++i) {
+        index[federation.federates[i].name] = i;
+    }
+    ifstream fin(path.c_str());
+    if (!fin) {
+        die("could not open traffic snapshot '" + path + "'");
+    }
+    try {
+        YAML::Parser parser(fin);
+        parser.GetNextDocument(doc);
+    } catch (YAML::ParserException &e) {
+        die("could not parse traffic snapshot '" + path + "': " + e.what());
+    }
+    const YAML::Node *pairs = doc.FindValue("traffic");
+    if (!pairs) {
+        die("'" + path + "' has no traffic matrix; is it a snapshot of FNCS_METRICS?");
+    }
+    for (YAML::Iterator it=pairs->begin(); it!=pairs->end(); ++it) {
+        string from = scalar(*it, "from", "");
+        string to = scalar(*it, "to", "");
+        double bytes = 0;
+        if (const YAML::Node *found = it->FindValue("delivered_bytes")) {
+            *found >> bytes;
+        }
+        if (index.count(from) && index.count(to) && from != to) {
+            weights[index[from]][index[to]] += bytes;
+            weights[index[to]][index[from]] += bytes;
+        }
+    }
+    return weights;
+}
+
+
+/* the federates' groups, merged along the heaviest traffic first while
+ * a merged group still fits in capacity cpus */
+static void merge_groups(Federation &federation,
+        const vector<vector<double> > &weights, size_t capacity)
+{
+    vector<Federate> &feds = federation.federates;
+    map<size_t,size_t> size; /* cpus of each group */
+    map<pair<size_t,size_t>,double> between;
+    vector<pair<double,pair<size_t,size_t> > > edges;
+
+    for (size_t i=0; i<feds.size(); ++i) {
+        size[feds[i].group] += feds[i].cpus;
+        for (size_t j=0; j<feds.size(); ++j) {
+            if (feds[i].group < feds[j].group) {
+                between[make_pair(feds[i].group, feds[j].group)] += weights[i][j];
+            }
+        }
+    }
+    for (map<pair<size_t,size_t>,double>::iterator it=between.begin();
+            it!=between.end(); ++it) {
+        if (it->second > 0) {
+            edges.push_back(make_pair(it->second, it->first));
+        }
+    }
+    sort(edges.rbegin(), edges.rend());
+
+    map<size_t,size_t> parent; /* union-find over the groups */
+    for (map<size_t,size_t>::iterator it=size.begin(); it!=size.end(); ++it) {
+        parent[it->first] = it->first;
+    }
+    for (size_t e=0; e<edges.size(); ++e) {
+        size_t a = edges[e].second.first;
+        size_t b = edges[e].second.second;
+        while (parent[a] != a) {
+            a = parent[a];
+        }
+        while (parent[b] != b) {
+            b = parent[b];
+        }
+        if (a != b && size[a] + size[b] <= capacity) {
+            parent[b] = a;
+            size[a] += size[b];
+        }
+    }
+    for (size_t i=0; i<feds.size(); ++i) {
+        size_t g = feds[i].group;
+        while (parent[g] != g) {
+            g = parent[g];
+        }
+        feds[i].group = g;
+    }
+}
+
+
+/* a group's cpus and federates */
+typedef pair<size_t, vector<size_t> > Group;
+
+/* rank groups by cpus, largest first */
+static bool more_cpus(const Group &a, const Group &b)
+{
+    return a.first > b.first;
+}
+
+
+/* the groups, largest first and otherwise in the order described */
+static vector<Group> groups_of(const Federation &federation)
+{
+    map<size_t,Group> by_group;
+    vector<Group> groups;
+
+    for (size_t i=0; i<federation.federates.size(); ++i) {
+        Group &group = by_group[federation.federates[i].group];
+        group.first += federation.federates[i].cpus;
+        group.second.push_back(i);
+    }
+    for (map<size_t,Group>::iterator it=by_group.begin(); it!=by_group.end(); ++it) {
+        groups.push_back(it->second);
+    }
+    stable_sort(groups.begin(), groups.end(), more_cpus);
+    return groups;
+}
+
+
+static size_t free_cpus(const Node &node)
+{
+    size_t n = 0;
+    for (size_t d=0; d<node.free.size(); ++d) {
+        n += node.free[d].size();
+    }
+    return n;
+}
+
+
+/* The domain with the fewest free cpus that still has the given number,
+ * on the preferred node if one there does; false if none has. */
+static bool fit(const Federation &federation, size_t cpus, size_t preferred,
+        size_t &n_fit, size_t &d_fit)
+{
+    for (int pass=0; pass<2; ++pass) {
+        bool found = false;
+        for (size_t n=0; n<federation.nodes.size(); ++n) {
+            if (0 == pass && n != preferred) {
+                continue;
+            }
+            const Node &node = federation.nodes[n];
+            for (size_t d=0; d<node.free.size(); ++d) {
+                size_t left = node.free[d].size();
+                if (left >= cpus && (!found
+                            || left < federation.nodes[n_fit].free[d_fit].size())) {
+                    n_fit = n;
+                    d_fit = d;
+                    found = true;
+                }
+            }
+        }
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* pin federate i to cpus of the node's domain d */
+static void pin(Federation &federation, size_t i, size_t n, size_t d)
+{
+    Federate &federate = federation.federates[i];
+    vector<size_t> &free = federation.nodes[n].free[d];
+    federate.node = n;
+    federate.domain = d;
+    federate.pinned.assign(free.begin(), free.begin() + federate.cpus);
+    free.erase(free.begin(), free.begin() + federate.cpus);
+}
+
+
+/* Place the federates. Along the heaviest traffic first, they are grouped
+ * as long as a group fits in a NUMA domain, and those groups as long as
+ * they fit in a node. Each node group goes to the node with the most cpus
+ * left, and each of its domain groups to the fullest domain there it fits
+ * in. A group that fits in no domain is placed a federate at a time. */
+static void place(Federation &federation, const vector<vector<double> > &weights)
+{
+    size_t domain_capacity = 0;
+    size_t node_capacity = 0;
+    size_t needed = 0;
+    size_t available = 0;
+
+    for (size_t n=0; n<federation.nodes.size(); ++n) {
+        Node &node = federation.nodes[n];
+        size_t per = node.cpus / node.numa;
+        node.free.assign(node.numa, vector<size_t>());
+        for (size_t c=0; c<per*node.numa; ++c) {
+            if (n == federation.broker_node && federation.broker_cpu >= 0
+                    && c == static_cast<size_t>(federation.broker_cpu)) {
+                continue;
+            }
+            node.free[c/per].push_back(c);
+        }
+        for (size_t d=0; d<node.numa; ++d) {
+            domain_capacity = max(domain_capacity, node.free[d].size());
+        }
+        node_capacity = max(node_capacity, free_cpus(node));
+        available += free_cpus(node);
+    }
+    for (size_t i=0; i<federation.federates.size(); ++i) {
+        federation.federates[i].group = i;
+        needed += federation.federates[i].cpus;
+    }
+    if (needed > available) {
+        ostringstream oss;
+        oss << "the federates need " << needed << " cpus, the nodes have " << available;
+        die(oss.str());
+    }
+
+    merge_groups(federation, weights, domain_capacity);
+    vector<Group> domain_groups = groups_of(federation);
+    merge_groups(federation, weights, node_capacity);
+    vector<Group> node_groups = groups_of(federation);
+
+    for (size_t g=0; g<node_groups.size(); ++g) {
+        size_t node_group = federation.federates[node_groups[g].second[0]].group;
+        size_t best = federation.nodes.size();
+        for (size_t n=0; n<federation.nodes.size(); ++n) {
+            size_t left = free_cpus(federation.nodes[n]);
+            if (left >= node_groups[g].first && (best == federation.nodes.size()
+                        || left > free_cpus(federation.nodes[best]))) {
+                best = n;
+            }
+        }
+        for (size_t dg=0; dg<domain_groups.size(); ++dg) {
+            const vector<size_t> &members = domain_groups[dg].second;
+            size_t n = 0;
+            size_t d = 0;
+            if (federation.federates[members[0]].group != node_group) {
+                continue;
+            }
+            if (fit(federation, domain_groups[dg].first, best, n, d)) {
+                for (size_t j=0; j<members.size(); ++j) {
+                    pin(federation, members[j], n, d);
+                }
+                continue;
+            }
+            for (size_t j=0; j<members.size(); ++j) {
+                const Federate &federate = federation.federates[members[j]];
+                if (!fit(federation, federate.cpus, best, n, d)) {
+                    die("federate '" + federate.name + "' fits in no NUMA domain; "
+                            "lower its cpus");
+                }
+                pin(federation, members[j], n, d);
+            }
+        }
+    }
+}
+
+
+/* how much of the traffic stays within a domain, within a node, or not */
+static void report(const Federation &federation, const vector<vector<double> > &weights)
+{
+    const vector<Federate> &feds = federation.federates;
+    double domain = 0;
+    double node = 0;
+    double across = 0;
+
+    for (size_t i=0; i<feds.size(); ++i) {
+        ostringstream cpus;
+        for (size_t c=0; c<feds[i].pinned.size(); ++c) {
+            cpus << (c ? "," : "") << feds[i].pinned[c];
+        }
+        cout << feds[i].name << "\t" << federation.nodes[feds[i].node].name
+            << "\tnuma " << feds[i].domain << "\tcpus " << cpus.str() << endl;
+        for (size_t j=i+1; j<feds.size(); ++j) {
+            if (feds[i].node != feds[j].node) {
+                across += weights[i][j];
+            }
+            else if (feds[i].domain != feds[j].domain) {
+                node += weights[i][j];
+            }
+            else {
+                domain += weights[i][j];
+            }
+        }
+    }
+    double total = domain + node + across;
+    if (total > 0) {
+        cout << "traffic within a NUMA domain " << 100.0 * domain / total
+            << "%, within a node " << 100.0 * node / total
+            << "%, across nodes " << 100.0 * across / total << "%" << endl;
+    }
+}
+
+
+/* quoted for the shell */
+static string quote(const string &value)
+{
+    string quoted("'");
+    for (size_t i=0; i<value.size(); ++i) {
+        if (value[i] == '\'') {
+            quoted += "'\\''";
+        }
+        else {
+            quoted += value[i];
+        }
+    }
+    return quoted + "'";
+}
+
+
+/* the shell command running command in dir with env, pinned to cpus, if
+ * any, and the memory of domain if the node has several */
+static string shell_command(const Node &node, const string &dir, const EnvMap &env,
+        const vector<size_t> &cpus, size_t domain, const string &command)
+{
+    ostringstream oss;
+    if (!dir.empty()) {
+        oss << "cd " << quote(dir) << " && ";
+    }
+    oss << "exec env";
+    for (EnvMap::const_iterator it=env.begin(); it!=env.end(); ++it) {
+        oss << ' ' << quote(it->first + "=" + it->second);
+    }
+    if (!cpus.empty()) {
+        oss << " taskset -c ";
+        for (size_t c=0; c<cpus.size(); ++c) {
+            oss << (c ? "," : "") << cpus[c];
+        }
+    }
+    if (!cpus.empty() && node.numa > 1) {
+        oss << " numactl --membind=" << domain;
+    }
+    oss << " sh -c " << quote(command);
+    return oss.str();
+}
+
+
+#if !(defined WIN32 || defined _WIN32)
+/* one process started, to be waited on */
+class Child {
+    public:
+        Child() : pid(0), name() {}
+
+        pid_t pid;
+        string name;
+};
+
+static vector<Child> children;
+
+static void stop_children(int)
+{
+    for (size_t i=0; i<children.size(); ++i) {
+        kill(children[i].pid, SIGTERM);
+    }
+}
+
+
+/* run the command on the node, locally or over ssh */
+static void start(const Node &node, const string &name, const string &command)
+{
+    Child child;
+    child.name = name;
+    child.pid = fork();
+    if (child.pid < 0) {
+        perror("fork");
+        stop_children(0);
+        exit(EXIT_FAILURE);
+    }
+    if (child.pid == 0) {
+        if (node.local()) {
+            execlp("sh", "sh", "-c", command.c_str(), (char*)NULL);
+        }
+        else {
+            execlp("ssh", "ssh", node.host.c_str(), command.c_str(), (char*)NULL);
+        }
+        perror(name.c_str());
+        _exit(EXIT_FAILURE);
+    }
+    children.push_back(child);
+}
+#endif
+
+
+int main(int argc, char **argv)
+{
+    string param_traffic;
+    string param_record;
+    string param_broker = "fncs_broker";
+    bool dry_run = false;
+    vector<string> params;
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--traffic") && i+1 < argc) {
+            param_traffic = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--record-traffic") && i+1 < argc) {
+            param_record = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--broker") && i+1 < argc) {
+            param_broker = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "--dry-run")) {
+            dry_run = true;
+        }
+        else {
+            params.push_back(argv[i]);
+        }
+    }
+    if (params.size() != 1) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    Federation federation = read_federation(params[0]);
+    vector<vector<double> > weights = read_traffic(federation,
+            param_traffic.empty() ? federation.traffic : param_traffic);
+    place(federation, weights);
+    report(federation, weights);
+
+    /* federates on the broker's node connect locally, the others over
+     * TCP or through their node's sub-broker */
+    const Node &broker_node = federation.nodes[federation.broker_node];
+    vector<size_t> on_node(federation.nodes.size(), 0);
+    size_t n_connections = 0;
+    for (size_t i=0; i<federation.federates.size(); ++i) {
+        ++on_node[federation.federates[i].node];
+    }
+    for (size_t n=0; n<federation.nodes.size(); ++n) {
+        bool subbroker = federation.subbrokers && n != federation.broker_node
+            && on_node[n] > 1;
+        n_connections += subbroker ? 1 : on_node[n];
+        if (n != federation.broker_node && on_node[n] && broker_node.address.empty()) {
+            die("node '" + federation.nodes[n].name + "' cannot reach the broker; "
+                    "give node '" + broker_node.name + "' an address");
+        }
+    }
+    ostringstream tcp;
+    tcp << "tcp://" << (broker_node.address.empty() ? string("localhost")
+            : broker_node.address) << ":" << federation.broker_port;
+    ostringstream bind;
+    bind << "tcp://*:" << federation.broker_port << "," << LOCAL_ENDPOINT;
+    ostringstream metrics;
+    metrics << "tcp://*:" << federation.broker_port + 1;
+    ostringstream metrics_connect;
+    metrics_connect << "tcp://" << (broker_node.local() ? string("localhost")
+            : broker_node.address) << ":" << federation.broker_port + 1;
+
+    vector<pair<size_t,string> > commands; /* node and command */
+    vector<string> names;
+    {
+        EnvMap env = federation.broker_env;
+        ostringstream n;
+        n << n_connections;
+        env["FNCS_BROKER"] = bind.str();
+        if (federation.broker_cpu >= 0) {
+            ostringstream cpu;
+            cpu << federation.broker_cpu;
+            env["FNCS_BROKER_CPU"] = cpu.str();
+        }
+        if (!param_record.empty()) {
+            env["FNCS_METRICS"] = metrics.str();
+            if (!env.count("FNCS_METRICS_INTERVAL")) {
+                env["FNCS_METRICS_INTERVAL"] = "1s";
+            }
+        }
+        commands.push_back(make_pair(federation.broker_node, shell_command(broker_node,
+                        "", env, vector<size_t>(), 0, param_broker + " " + n.str())));
+        names.push_back("broker");
+    }
+    for (size_t n=0; n<federation.nodes.size(); ++n) {
+        if (federation.subbrokers && n != federation.broker_node && on_node[n] > 1) {
+            EnvMap env = federation.broker_env;
+            ostringstream count;
+            count << on_node[n];
+            env["FNCS_BROKER"] = LOCAL_ENDPOINT;
+            env["FNCS_ROOT_BROKER"] = tcp.str();
+            env.erase("FNCS_METRICS");
+            commands.push_back(make_pair(n, shell_command(federation.nodes[n], "", env,
+                            vector<size_t>(), 0, param_broker + " " + count.str())));
+            names.push_back("sub-broker on " + federation.nodes[n].name);
+        }
+    }
+    for (size_t i=0; i<federation.federates.size(); ++i) {
+        const Federate &federate = federation.federates[i];
+        size_t n = federate.node;
+        EnvMap env = federate.env;
+        bool local = n == federation.broker_node
+            || (federation.subbrokers && on_node[n] > 1);
+        env["FNCS_BROKER"] = local ? LOCAL_ENDPOINT : tcp.str();
+        commands.push_back(make_pair(n, shell_command(federation.nodes[n], federate.dir,
+                        env, federate.pinned, federate.domain, federate.command)));
+        names.push_back(federate.name);
+    }
+
+    if (dry_run) {
+        for (size_t i=0; i<commands.size(); ++i) {
+            const Node &node = federation.nodes[commands[i].first];
+            cout << (node.local() ? commands[i].second
+                    : "ssh " + node.host + " " + quote(commands[i].second)) << endl;
+        }
+        return 0;
+    }
+
+#if (defined WIN32 || defined _WIN32)
+    cerr << "fncs_launch starts the broker and federates as processes, "
+        "which it does not support on Windows." << endl;
+    return EXIT_FAILURE;
+#else
+    signal(SIGINT, stop_children);
+    signal(SIGTERM, stop_children);
+
+    /* the broker's metrics, the last snapshot kept for a later placement */
+    zsock_t *sub = NULL;
+    zpoller_t *poller = NULL;
+    string snapshot;
+    if (!param_record.empty()) {
+        sub = zsock_new_sub(metrics_connect.str().c_str(), "metrics");
+        if (!sub) {
+            die("could not connect to the broker's metrics at " + metrics_connect.str());
+        }
+        poller = zpoller_new(sub, NULL);
+    }
+
+    for (size_t i=0; i<commands.size(); ++i) {
+        start(federation.nodes[commands[i].first], names[i], commands[i].second);
+    }
+
+    bool failed = false;
+    size_t n_running = children.size();
+    while (n_running) {
+        int status = 0;
+        pid_t pid = 0;
+        if (sub) {
+            while (zpoller_wait(poller, 1000)) {
+                char *topic = zstr_recv(sub);
+                char *json = zstr_recv(sub);
+                if (json) {
+                    snapshot = json;
+                }
+                zstr_free(&topic);
+                zstr_free(&json);
+            }
+            pid = waitpid(-1, &status, WNOHANG);
+        }
+        else {
+            pid = waitpid(-1, &status, 0);
+        }
+        if (pid <= 0) {
+            continue;
+        }
+        for (size_t i=0; i<children.size(); ++i) {
+            if (children[i].pid == pid) {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+                    cerr << children[i].name << " failed" << endl;
+                    failed = true;
+                }
+                --n_running;
+            }
+        }
+    }
+
+    if (sub) {
+        zpoller_destroy(&poller);
+        zsock_destroy(&sub);
+        if (snapshot.empty()) {
+            cerr << "no metrics were received from the broker" << endl;
+            failed = true;
+        }
+        else {
+            ofstream fout(param_record.c_str());
+            fout << snapshot << endl;
+            if (!fout) {
+                die("could not write '" + param_record + "'");
+            }
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+#endif
+}
@@ -0,0 +1,490 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if !(defined WIN32 || defined _WIN32)
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_loadgen [--sims <n>] [--name <prefix>] [--topics <n>]\n"
+    "                    [--rate <values per step>] [--payload <bytes>|<min>-<max>|exp:<mean>]\n"
+    "                    [--tick <time>] [--steps <n>] [--subscribe ring|all|none]\n"
+    "                    [--endpoint <endpoint>] [--seed <n>] [--per-sim] [--save <file>]";
+
+/* what the synthetic federates are told to do */
+class Options {
+    public:
+        Options()
+            : n_sims(1)
+            , name("loadgen")
+            , n_topics(1)
+            , rate(1.0)
+            , payload_min(8)
+            , payload_max(8)
+            , payload_mean(0.0)
+            , tick(1000000000)
+            , steps(1000)
+            , subscribe("ring")
+            , endpoint()
+            , seed(1)
+            , per_sim(false)
+            , save()
+        {}
+
+        size_t n_sims;
+        string name; /* of the federates, suffixed by their index */
+        size_t n_topics; /* published by each */
+        double rate; /* values per step, of all its topics in turn */
+        size_t payload_min; /* bytes, drawn uniformly ... */
+        size_t payload_max;
+        double payload_mean; /* ... or exponentially if not 0, up to payload_max */
+        fncs::time tick; /* step, in nanoseconds */
+        fncs::time steps;
+        string subscribe; /* which of the others each subscribes to */
+        string endpoint; /* of the broker, else FNCS_BROKER */
+        unsigned long long seed;
+        bool per_sim;
+        string save;
+};
+
+/* what a federate reports back */
+class Report {
+    public:
+        Report()
+            : sent(0), bytes_sent(0), received(0), grants(0), wall(0.0), latencies() {}
+
+        unsigned long long sent;
+        unsigned long long bytes_sent;
+        unsigned long long received;
+        unsigned long long grants;
+        double wall; /* seconds between the first and the last request */
+        vector<double> latencies; /* seconds each time request blocked */
+};
+
+/* xorshift64*, so that a seed gives the same payloads on any platform */
+class Random {
+    public:
+        explicit Random(unsigned long long seed) : state(seed ? seed : 1) {}
+
+        unsigned long long next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717ULL;
+        }
+
+        /* in [0, 1) */
+        double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    private:
+        unsigned long long state;
+};
+
+static string sim_name(const Options &options, size_t i)
+{
+    ostringstream oss;
+    oss << options.name << i;
+    return oss.str();
+}
+
+/* whether sim i subscribes to what sim j publishes */
+static bool subscribes(const Options &options, size_t i, size_t j)
+{
+    if (i == j || options.subscribe == "none") {
+        return false;
+    }
+    if (options.subscribe == "ring") {
+        return j == (i + 1) % options.n_sims;
+    }
+    return true;
+}
+
+/* each topic is subscribed to as a list, so every value counts */
+static string sim_config(const Options &options, size_t i)
+{
+    ostringstream oss;
+    oss << "name = " << sim_name(options, i) << "\n"
+        << "time_delta = " << options.tick << "ns\n";
+    if (!options.endpoint.empty()) {
+        oss << "broker = " << options.endpoint << "\n";
+    }
+    bool first = true;
+    for (size_t j=0; j<options.n_sims; ++j) {
+        if (!subscribes(options, i, j)) {
+            continue;
+        }
+        for (size_t t=0; t<options.n_topics; ++t) {
+            if (first) {
+                oss << "values\n";
+                first = false;
+            }
+            oss << "    from" << j << "_" << t << "\n"
+                << "        topic = " << sim_name(options, j) << "/value" << t << "\n"
+                << "        list = true\n";
+        }
+    }
+    return oss.str();
+}
+
+static size_t payload_size(const Options &options, Random &random)
+{
+    if (options.payload_mean > 0.0) {
+        double size = -options.payload_mean * log(1.0 - random.uniform());
+        return min(options.payload_max, static_cast<size_t>(size));
+    }
+    return options.payload_min + static_cast<size_t>(
+            random.uniform() * (options.payload_max - options.payload_min + 1));
+}
+
+#if !(defined WIN32 || defined _WIN32)
+
+/* one synthetic federate, in a child process */
+static void run_sim(const Options &options, size_t i, int out)
+{
+    fncs::time stop = options.steps * options.tick;
+    fncs::time granted = 0;
+    string payload(options.payload_max, 'x');
+    string value;
+    vector<fncs::Key> keys;
+    Random random(options.seed + i);
+    double due = 0.0; /* values owed, a fraction of one carried over */
+    size_t topic = 0;
+    Report report;
+
+    fncs::initialize(sim_config(options, i));
+    if (!fncs::is_initialized()) {
+        _exit(EXIT_FAILURE);
+    }
+    for (size_t t=0; t<options.n_topics; ++t) {
+        ostringstream key;
+        key << "value" << t;
+        keys.push_back(fncs::lookup_publish_key(key.str()));
+    }
+    report.latencies.reserve(static_cast<size_t>(options.steps) + 1);
+
+    double start = fncs::timer();
+    while (granted < stop) {
+        for (due += options.rate; due >= 1.0; due -= 1.0) {
+            value.assign(payload, 0, payload_size(options, random));
+            fncs::publish(keys[topic], value);
+            if (keys[topic] != fncs::INVALID_KEY) {
+                ++report.sent;
+                report.bytes_sent += value.size();
+            }
+            topic = (topic + 1) % keys.size();
+        }
+        fncs::time next = min(granted + options.tick, stop);
+        double before = fncs::timer();
+        granted = fncs::time_request(next);
+        report.latencies.push_back(fncs::timer() - before);
+        ++report.grants;
+        for (fncs::EventIterator it=fncs::events_begin(); it!=fncs::events_end(); ++it) {
+            report.received += fncs::get_values(*it).size();
+        }
+    }
+    report.wall = fncs::timer() - start;
+    fncs::finalize();
+
+    ostringstream oss;
+    oss << report.sent << ' ' << report.bytes_sent << ' ' << report.received << ' '
+        << report.grants << ' ' << report.wall << '\n';
+    for (size_t l=0; l<report.latencies.size(); ++l) {
+        oss << report.latencies[l] << '\n';
+    }
+    string text = oss.str();
+    for (size_t offset=0; offset<text.size(); ) {
+        ssize_t n = write(out, text.data() + offset, text.size() - offset);
+        if (n <= 0) {
+            _exit(EXIT_FAILURE);
+        }
+        offset += n;
+    }
+    close(out);
+    _exit(EXIT_SUCCESS);
+}
+
+static bool read_report(int in, Report &report)
+{
+    string text;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        text.append(buffer, n);
+    }
+    close(in);
+    istringstream iss(text);
+    double latency;
+    if (!(iss >> report.sent >> report.bytes_sent >> report.received
+                >> report.grants >> report.wall)) {
+        return false;
+    }
+    while (iss >> latency) {
+        report.latencies.push_back(latency);
+    }
+    return true;
+}
+
+#endif
+
+static double percentile(vector<double> &values, double fraction)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t at = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    nth_element(values.begin(), values.begin() + at, values.end());
+    return values[at];
+}
+
+/* the throughput and grant latency of one federate or of them all */
+static void summarize(const vector<Report> &reports, map<string,double> &results)
+{
+    vector<double> latencies;
+    unsigned long long sent = 0;
+    unsigned long long bytes_sent = 0;
+    unsigned long long received = 0;
+    unsigned long long grants = 0;
+    double wall = 0.0;
+    for (size_t i=0; i<reports.size(); ++i) {
+        sent += reports[i].sent;
+        bytes_sent += reports[i].bytes_sent;
+        received += reports[i].received;
+        grants += reports[i].grants;
+        wall = max(wall, reports[i].wall);
+        latencies.insert(latencies.end(),
+                reports[i].latencies.begin(), reports[i].latencies.end());
+    }
+    if (wall <= 0.0) {
+        wall = 1e-9;
+    }
+    results["grants_per_second"] = grants / wall;
+    results["published_per_second"] = sent / wall;
+    results["published_bytes_per_second"] = bytes_sent / wall;
+    results["received_per_second"] = received / wall;
+    results["grant_p50_us"] = percentile(latencies, 0.50) * 1e6;
+    results["grant_p90_us"] = percentile(latencies, 0.90) * 1e6;
+    results["grant_p99_us"] = percentile(latencies, 0.99) * 1e6;
+    results["grant_max_us"] = latencies.empty() ? 0.0
+        : *max_element(latencies.begin(), latencies.end()) * 1e6;
+    results["wall_seconds"] = wall;
+}
+
+static unsigned long parse_count(const char *option, const char *text)
+{
+    char *end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (*end != '\0' || value == 0) {
+        cerr << option << " needs a positive number, not '" << text << "'" << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+/* <bytes>, <min>-<max> drawn uniformly, or exp:<mean> drawn
+ * exponentially and cut off at 16 times the mean */
+static void parse_payload(const string &text, Options &options)
+{
+    char *end = NULL;
+    if (text.compare(0, 4, "exp:") == 0) {
+        options.payload_mean = strtod(text.c_str() + 4, &end);
+        if (*end != '\0' || options.payload_mean <= 0.0) {
+            cerr << "--payload exp: needs a positive mean, not '" << text << "'" << endl;
+            exit(EXIT_FAILURE);
+        }
+        options.payload_min = 0;
+        options.payload_max = static_cast<size_t>(16 * options.payload_mean);
+        return;
+    }
+    options.payload_mean = 0.0;
+    options.payload_min = strtoul(text.c_str(), &end, 10);
+    options.payload_max = options.payload_min;
+    if (*end == '-') {
+        options.payload_max = strtoul(end + 1, &end, 10);
+    }
+    if (*end != '\0' || options.payload_max < options.payload_min) {
+        cerr << "--payload needs <bytes>, <min>-<max> or exp:<mean>, not '"
+            << text << "'" << endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void print_results(ostream &out, const string &prefix, const map<string,double> &results)
+{
+    for (map<string,double>::const_iterator it=results.begin(); it!=results.end(); ++it) {
+        out << prefix << it->first << ' ' << it->second << '\n';
+    }
+}
+
+/* Joins a running broker as synthetic federates that publish at a given
+ * rate and payload size, and reports the throughput and grant latency
+ * they achieved, to probe a deployment before a study. */
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int i=1; i<argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--per-sim") {
+            options.per_sim = true;
+            continue;
+        }
+        if (i+1 == argc) {
+            cerr << "Missing value of " << arg << "." << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+        const char *value = argv[++i];
+        if (arg == "--sims") {
+            options.n_sims = parse_count("--sims", value);
+        }
+        else if (arg == "--name") {
+            options.name = value;
+        }
+        else if (arg == "--topics") {
+            options.n_topics = parse_count("--topics", value);
+        }
+        else if (arg == "--rate") {
+            options.rate = strtod(value, NULL);
+            if (options.rate < 0.0) {
+                cerr << "--rate cannot be negative." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--payload") {
+            parse_payload(value, options);
+        }
+        else if (arg == "--tick") {
+            if (!fncs::try_parse_time(value, options.tick) || 0 == options.tick) {
+                cerr << "--tick needs a time such as 100ms, not '" << value << "'" << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--steps") {
+            options.steps = parse_count("--steps", value);
+        }
+        else if (arg == "--subscribe") {
+            options.subscribe = value;
+            if (options.subscribe != "ring" && options.subscribe != "all"
+                    && options.subscribe != "none") {
+                cerr << "Unknown subscription pattern '" << value << "'." << endl;
+                cerr << usage << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (arg == "--endpoint") {
+            options.endpoint = value;
+        }
+        else if (arg == "--seed") {
+            options.seed = strtoull(value, NULL, 10);
+        }
+        else if (arg == "--save") {
+            options.save = value;
+        }
+        else {
+            cerr << "Unknown option '" << arg << "'." << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+#if (defined WIN32 || defined _WIN32)
+    cerr << "fncs_loadgen runs its federates as processes, "
+        "which it does not support on Windows." << endl;
+    return EXIT_FAILURE;
+#else
+    cerr << "# joining as " << options.n_sims << " federate(s), "
+        << sim_name(options, 0) << " on; the broker must expect them" << endl;
+
+    /* the federates, each reporting on a pipe */
+    vector<pid_t> sims;
+    vector<int> pipes;
+    for (size_t i=0; i<options.n_sims; ++i) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        pid_t sim = fork();
+        if (sim < 0) {
+            perror("fork");
+            for (size_t s=0; s<sims.size(); ++s) {
+                kill(sims[s], SIGTERM);
+            }
+            exit(EXIT_FAILURE);
+        }
+        if (sim == 0) {
+            close(fds[0]);
+            run_sim(options, i, fds[1]);
+        }
+        close(fds[1]);
+        sims.push_back(sim);
+        pipes.push_back(fds[0]);
+    }
+
+    vector<Report> reports(options.n_sims);
+    bool failed = false;
+    for (size_t i=0; i<options.n_sims; ++i) {
+        int status = 0;
+        if (!read_report(pipes[i], reports[i])) {
+            cerr << sim_name(options, i) << " did not finish" << endl;
+            failed = true;
+        }
+        waitpid(sims[i], &status, 0);
+    }
+    if (failed) {
+        return EXIT_FAILURE;
+    }
+
+    map<string,double> results;
+    summarize(reports, results);
+
+    cout << "# " << options.n_sims << " sims, " << options.n_topics << " topic(s) each, "
+        << "rate " << options.rate << ", payload " << options.payload_min << "-"
+        << options.payload_max << (options.payload_mean > 0.0 ? " exp" : "")
+        << ", tick " << options.tick << "ns, steps " << options.steps
+        << ", subscribe " << options.subscribe << endl;
+    print_results(cout, "", results);
+    if (options.per_sim) {
+        for (size_t i=0; i<options.n_sims; ++i) {
+            map<string,double> own;
+            summarize(vector<Report>(1, reports[i]), own);
+            print_results(cout, sim_name(options, i) + ".", own);
+        }
+    }
+    cout.flush();
+
+    if (!options.save.empty()) {
+        ofstream fout(options.save.c_str());
+        print_results(fout, "", results);
+        if (!fout) {
+            cerr << "Could not write '" << options.save << "'." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+#endif
+}
@@ -3,6 +3,16 @@
 
 #include "log.h"
 
+/* subsystems whose debug lines can be enabled on their own, see
+ * FNCS_LOG_CATEGORIES */
+enum TLogCategory {
+    logCONFIG = 1 << 0,     /* configuration and connection setup */
+    logTIME = 1 << 1,       /* time requests, grants and windows */
+    logPUBLISH = 1 << 2,    /* values published, routed and received */
+    logCACHE = 1 << 3,      /* cache updates and reads */
+    logALL = logCONFIG | logTIME | logPUBLISH | logCACHE
+};
+
 #if (defined WIN32 || defined _WIN32)
 #   if defined LIBFNCS_STATIC
 #       define FNCS_EXPORT
@@ -18,6 +28,22 @@
 class Output2Tee
 {
 public:
+    /* when set, lines are handed to it instead, see LogWriter */
+    typedef void (*Sink)(const std::string& msg);
+
+    static Sink& Async()
+    {
+        static Sink sink = NULL;
+        return sink;
+    }
+
+    /* enabled TLogCategory bits */
+    static unsigned& Categories()
+    {
+        static unsigned categories = logALL;
+        return categories;
+    }
+
     static FILE*& Stream1()
     {
         static FILE* pStream = NULL;
@@ -31,6 +57,16 @@ public:
     }
 
     static void Output(const std::string& msg)
+    {
+        Sink sink = Async();
+        if (sink) {
+            sink(msg);
+            return;
+        }
+        Write(msg);
+    }
+
+    static void Write(const std::string& msg)
     {
         FILE* pStream1 = Stream1();
         if (!pStream1)
@@ -66,4 +102,19 @@ class FNCS_EXPORT FNCSLog : public Log<Output2Tee> {};
 #define LDEBUG3 FNCS_LOG(logDEBUG3)
 #define LDEBUG4 FNCS_LOG(logDEBUG4)
 
+/* Debug lines of a category: the category is tested first, so a
+ * disabled one costs a single branch and never builds the stream. A
+ * production build, configure --enable-production, compiles out every
+ * debug line through FNCS_LOG_MAX_LEVEL. */
+#define FNCS_CLOG(level, category) \
+    if (level > FNCS_LOG_MAX_LEVEL) ;\
+    else if (!(Output2Tee::Categories() & (category))) ; \
+    else FNCS_LOG(level)
+
+#define LDEBUGC(category) FNCS_CLOG(logDEBUG, category)
+#define LDEBUG1C(category) FNCS_CLOG(logDEBUG1, category)
+#define LDEBUG2C(category) FNCS_CLOG(logDEBUG2, category)
+#define LDEBUG3C(category) FNCS_CLOG(logDEBUG3, category)
+#define LDEBUG4C(category) FNCS_CLOG(logDEBUG4, category)
+
 #endif /* _LOG_HPP_ */
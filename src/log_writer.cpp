@@ -0,0 +1,139 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdio>
+#include <string>
+
+/* 3rd party headers */
+#include "czmq.h"
+
+/* fncs headers */
+#include "log.hpp"
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "log_writer.hpp"
+
+using namespace ::std;
+
+/* The writer thread. Each message on the pipe is one log line; "$TERM"
+ * ends the log. */
+static void log_actor(zsock_t *pipe, void *)
+{
+    FILE *one = Output2Tee::Stream1();
+    FILE *two = Output2Tee::Stream2();
+    zmq_pollitem_t items[] = { { zsock_resolve(pipe), 0, ZMQ_POLLIN, 0 } };
+
+    zsock_signal(pipe, 0);
+
+    while (true) {
+        zframe_t *frame = zframe_recv(pipe);
+        if (!frame) {
+            break; /* interrupted */
+        }
+        if (zframe_streq(frame, "$TERM")) {
+            zframe_destroy(&frame);
+            break;
+        }
+        if (one) {
+            fwrite(zframe_data(frame), 1, zframe_size(frame), one);
+        }
+        if (two) {
+            fwrite(zframe_data(frame), 1, zframe_size(frame), two);
+        }
+        zframe_destroy(&frame);
+        /* flush once the burst is written */
+        if (zmq_poll(items, 1, 0) == 0) {
+            if (one) {
+                fflush(one);
+            }
+            if (two) {
+                fflush(two);
+            }
+        }
+    }
+
+    if (one) {
+        fflush(one);
+    }
+    if (two) {
+        fflush(two);
+    }
+}
+
+
+fncs::LogWriter::LogWriter()
+    : actor(NULL)
+    , mutex()
+{
+}
+
+
+fncs::LogWriter::~LogWriter()
+{
+    close();
+}
+
+
+bool fncs::LogWriter::open()
+{
+    actor = zactor_new(log_actor, NULL);
+    return actor != NULL;
+}
+
+
+void fncs::LogWriter::write(const string &line)
+{
+    MutexLock lock(mutex);
+    if (actor) {
+        zmq_send(zsock_resolve(zactor_sock(actor)), line.data(), line.size(), 0);
+    }
+    else {
+        /* a thread still logging while the writer closed */
+        Output2Tee::Write(line);
+    }
+}
+
+
+void fncs::LogWriter::close()
+{
+    MutexLock lock(mutex);
+    if (actor) {
+        zactor_destroy(&actor); /* sends $TERM and joins the writer */
+    }
+}
+
+
+/* never deleted, so a thread racing stop_async_logging() still finds it */
+static fncs::LogWriter *log_writer = NULL;
+
+static void log_writer_sink(const string &line)
+{
+    log_writer->write(line);
+}
+
+
+void fncs::start_async_logging()
+{
+    if (Output2Tee::Async() || !Output2Tee::Stream1()) {
+        return;
+    }
+    if (!log_writer) {
+        log_writer = new LogWriter;
+    }
+    if (!log_writer->open()) {
+        LWARNING << "could not start log writer thread, logging synchronously";
+        return;
+    }
+    Output2Tee::Async() = log_writer_sink;
+}
+
+
+void fncs::stop_async_logging()
+{
+    if (!Output2Tee::Async()) {
+        return;
+    }
+    Output2Tee::Async() = NULL;
+    log_writer->close();
+}
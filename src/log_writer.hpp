@@ -0,0 +1,44 @@
+#ifndef _LOG_WRITER_HPP_
+#define _LOG_WRITER_HPP_
+
+#include <string>
+
+#include "czmq.h"
+
+#include "mutex.hpp"
+
+namespace fncs {
+
+    /** Writes log lines from a background thread. Each line is handed to
+     * the writer thread over an inproc pipe, zmq's lock-free queue, under
+     * a short lock since any thread may log; the writer writes lines as
+     * they come and flushes the streams only once the pipe is drained,
+     * so a burst of lines costs one flush. */
+    class LogWriter {
+        public:
+            LogWriter();
+
+            ~LogWriter();
+
+            /** Start the writer thread for the logging streams, see
+             * Output2Tee; false on error. */
+            bool open();
+
+            /** Queue one line. */
+            void write(const std::string &line);
+
+            /** Write every queued line and join the thread. */
+            void close();
+
+        private:
+            /* not copyable */
+            LogWriter(const LogWriter &);
+            LogWriter& operator=(const LogWriter &);
+
+            zactor_t *actor;
+            Mutex mutex; /* guards the pipe */
+    };
+
+}
+
+#endif /* _LOG_WRITER_HPP_ */
@@ -0,0 +1,539 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+/* 3rd party headers */
+#include "czmq.h"
+
+/* fncs headers */
+#include "fncs.h"
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+/* Every operator new of the process is counted, the library's included.
+ * The broker stub and the raw sims allocate through zmq and czmq, which
+ * use malloc, so only the benchmarked thread, or the embedded broker's
+ * when that is benchmarked, updates the count. */
+static unsigned long long n_allocations = 0;
+
+#if __cplusplus >= 201103L
+void* operator new(size_t size)
+#else
+void* operator new(size_t size) throw(std::bad_alloc)
+#endif
+{
+    ++n_allocations;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#if __cplusplus >= 201103L
+void operator delete(void *p) noexcept
+#else
+void operator delete(void *p) throw()
+#endif
+{
+    free(p);
+}
+
+static const char *ENDPOINT = "inproc://fncs_microbench";
+static const char *BROKER_ENDPOINT = "inproc://fncs_microbench_broker";
+static const char *usage = "Usage: fncs_microbench [iterations]";
+
+/* keys the stub tells the sim to publish, and topics it sends it */
+static const size_t N_KEYS = 100;
+static const size_t N_TOPICS = 100;
+
+/* how many PUBLISHes the stub sends before each grant; set by the
+ * benchmark between time requests, which the stub reads it after */
+static size_t stub_publishes = 0;
+
+/* Stands in for the broker: ACKs the one sim with the keys k0 to k99,
+ * grants every time request at once, after sending stub_publishes
+ * values of the topics stub/t0 to stub/t99, and drops what the sim
+ * publishes. Speaks the negotiated string protocol. */
+static void broker_stub(zsock_t *pipe, void *)
+{
+    zsock_t *router = zsock_new_router(ENDPOINT);
+    zpoller_t *poller = zpoller_new(pipe, router, NULL);
+
+    zsock_signal(pipe, 0);
+    while (zpoller_wait(poller, -1) == router) {
+        zmsg_t *msg = zmsg_recv(router);
+        if (!msg) {
+            break;
+        }
+        zframe_t *identity = zmsg_pop(msg);
+        zframe_t *type = zmsg_first(msg);
+        zmsg_t *reply = NULL;
+        if (zframe_streq(type, fncs::HELLO)) {
+            reply = zmsg_new();
+            zmsg_addstr(reply, fncs::ACK);
+            zmsg_addstr(reply, "0");
+            zmsg_addstr(reply, "1");
+            zmsg_addstrf(reply, "%d", static_cast<int>(N_KEYS));
+            for (size_t k=0; k<N_KEYS; ++k) {
+                zmsg_addstrf(reply, "k%d", static_cast<int>(k));
+            }
+            zmsg_addstr(reply, "0");
+            zmsg_addstrf(reply, "%d.%d.%d",
+                    FNCS_VERSION_MAJOR, FNCS_VERSION_MINOR, FNCS_VERSION_PATCH);
+            zmsg_addstr(reply, fncs::PROTOCOL_STRING);
+            zmsg_addstr(reply, fncs::LIST_KEYS);
+            zmsg_addstr(reply, fncs::ACK);
+        }
+        else if (zframe_streq(type, fncs::TIME_REQUEST)) {
+            for (size_t p=0; p<stub_publishes; ++p) {
+                zmsg_t *value = zmsg_new();
+                zframe_t *to = zframe_dup(identity);
+                zmsg_append(value, &to);
+                zmsg_addstr(value, fncs::PUBLISH);
+                zmsg_addstrf(value, "stub/t%d", static_cast<int>(p % N_TOPICS));
+                zmsg_addstr(value, "1.25");
+                zmsg_send(&value, router);
+            }
+            /* grant the time requested */
+            zframe_t *requested = zmsg_next(msg);
+            reply = zmsg_new();
+            zmsg_addstr(reply, fncs::TIME_REQUEST);
+            if (requested) {
+                zframe_t *granted = zframe_dup(requested);
+                zmsg_append(reply, &granted);
+            }
+        }
+        else if (zframe_streq(type, fncs::BYE)) {
+            reply = zmsg_new();
+            zmsg_addstr(reply, fncs::BYE);
+        }
+        if (reply) {
+            zmsg_prepend(reply, &identity);
+            zmsg_send(&reply, router);
+        }
+        zframe_destroy(&identity);
+        zmsg_destroy(&msg);
+    }
+
+    zpoller_destroy(&poller);
+    zsock_destroy(&router);
+}
+
+/* A sim without the library against the embedded broker: a DEALER that
+ * says HELLO with the given config in the string protocol. */
+static zsock_t* raw_sim(const string &name, const string &config)
+{
+    zsock_t *sock = zsock_new(ZMQ_DEALER);
+    zsock_set_identity(sock, name.c_str());
+    zsock_connect(sock, "%s", BROKER_ENDPOINT);
+    zmsg_t *hello = zmsg_new();
+    zmsg_addstr(hello, fncs::HELLO);
+    zmsg_addstr(hello, config.c_str());
+    zmsg_addstrf(hello, "%d.%d.%d",
+            FNCS_VERSION_MAJOR, FNCS_VERSION_MINOR, FNCS_VERSION_PATCH);
+    zmsg_addstr(hello, fncs::PROTOCOL_STRING);
+    zmsg_send(&hello, sock);
+    return sock;
+}
+
+/* drops messages until one of the type arrives */
+static void raw_wait(zsock_t *sock, const char *type)
+{
+    while (true) {
+        zmsg_t *msg = zmsg_recv(sock);
+        if (!msg) {
+            return;
+        }
+        bool done = zframe_streq(zmsg_first(msg), type);
+        zmsg_destroy(&msg);
+        if (done) {
+            return;
+        }
+    }
+}
+
+/* a TIME_REQUEST of the next step; without a time_next, the BYE from
+ * the current one */
+static void raw_request(zsock_t *sock, fncs::time time_current, fncs::time time_next=0)
+{
+    if (time_next) {
+        zstr_sendm(sock, fncs::TIME_REQUEST);
+        zstr_sendfm(sock, "%llu", static_cast<unsigned long long>(time_next));
+    }
+    else {
+        zstr_sendm(sock, fncs::BYE);
+    }
+    zstr_sendf(sock, "%llu", static_cast<unsigned long long>(time_current));
+}
+
+/* Times a loop; what it reports is per iteration. */
+class Measure {
+    public:
+        Measure(const string &name, unsigned long long n)
+            : name(name), n(n), allocations(n_allocations), start(fncs::timer_ft()) {}
+
+        ~Measure() {
+            fncs::time elapsed = fncs::timer_ft() - start;
+            unsigned long long allocated = n_allocations - allocations;
+            cout << left << setw(32) << name << right
+                << setw(12) << n
+                << setw(12) << fixed << setprecision(1) << double(elapsed) / n
+                << setw(12) << setprecision(2) << double(allocated) / n << endl;
+        }
+
+    private:
+        string name;
+        unsigned long long n;
+        unsigned long long allocations;
+        fncs::time start;
+};
+
+static string sim_config(size_t n_values, const string &name="microbench")
+{
+    ostringstream oss;
+    oss << "name = " << name << "\n"
+        << "time_delta = 1ns\n"
+        << "broker = " << ENDPOINT << "\n"
+        << "values\n";
+    for (size_t i=0; i<n_values; ++i) {
+        oss << "    t" << i << "\n"
+            << "        topic = stub/t" << i % N_TOPICS << "\n"
+            << "        default = 0\n";
+    }
+    return oss.str();
+}
+
+/* counts the events fncs_for_each_event() hands over */
+static void count_event(fncs_key, const char*, void *data)
+{
+    ++*static_cast<unsigned long long*>(data);
+}
+
+/* The C API over the default client, a second sim of the stub, next to
+ * the Context's same calls. What it returns as char* is malloc'd, which
+ * the allocations do not count: one per string, freed in the loop. */
+static void bench_capi(unsigned long long n)
+{
+    fncs_initialize_config(sim_config(N_TOPICS, "microbench_c").c_str());
+    if (!fncs_is_initialized()) {
+        cerr << "could not connect the C API to the broker stub" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    fncs_time granted = 0;
+    {
+        Measure measure("C fncs_publish", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_publish("k0", "1.25");
+        }
+    }
+    granted = fncs_time_request(granted + 1);
+    {
+        fncs_key key = fncs_lookup_publish_key("k0");
+        Measure measure("C fncs_publish_by_key", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_publish_by_key(key, "1.25");
+        }
+    }
+    /* the stub sends every topic before the grant */
+    granted = fncs_time_request(granted + 1);
+
+    {
+        Measure measure("C fncs_get_value + free", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            _fncs_free_char_p(fncs_get_value("t7"));
+        }
+    }
+    {
+        size_t len = 0;
+        Measure measure("C fncs_peek_value", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_peek_value("t7", &len);
+        }
+    }
+    {
+        char buffer[64];
+        Measure measure("C fncs_copy_value", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_copy_value("t7", buffer, sizeof(buffer));
+        }
+    }
+    {
+        fncs_key key = fncs_lookup_key("t7");
+        Measure measure("C fncs_get_value_by_key", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_get_value_by_key(key);
+        }
+    }
+    {
+        Measure measure("C fncs_get_values + free", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            _fncs_free_char_pp(fncs_get_values("t7"), fncs_get_values_size("t7"));
+        }
+    }
+    {
+        fncs_key key = fncs_lookup_key("t7");
+        Measure measure("C fncs_get_values_by_key", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            for (size_t v=0; v<fncs_get_values_size_by_key(key); ++v) {
+                fncs_get_values_by_key(key, v);
+            }
+        }
+    }
+    {
+        Measure measure("C fncs_get_double", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs_get_double("t7");
+        }
+    }
+    {
+        fncs_key keys[N_TOPICS];
+        double values[N_TOPICS];
+        for (size_t k=0; k<N_TOPICS; ++k) {
+            ostringstream oss;
+            oss << "t" << k;
+            keys[k] = fncs_lookup_key(oss.str().c_str());
+        }
+        unsigned long long rounds = n / 100;
+        Measure measure("C fncs_get_doubles_by_key, 100", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            fncs_get_doubles_by_key(keys, values, N_TOPICS);
+        }
+    }
+    {
+        unsigned long long rounds = n / 100;
+        Measure measure("C fncs_get_events + free, 100", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            _fncs_free_char_pp(fncs_get_events(), fncs_get_events_size());
+        }
+    }
+    {
+        unsigned long long rounds = n / 100;
+        unsigned long long n_events = 0;
+        Measure measure("C fncs_for_each_event, 100", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            fncs_for_each_event(count_event, &n_events);
+        }
+        if (!n_events) {
+            cerr << "no events were received through the C API" << endl;
+        }
+    }
+    {
+        unsigned long long rounds = n / 100;
+        size_t len = 0;
+        Measure measure("C fncs_peek_event, 100", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            for (size_t e=0; e<fncs_get_events_size(); ++e) {
+                fncs_peek_event(e, &len);
+            }
+        }
+    }
+
+    /* the Context is still a client, so zmq is not shut down */
+    fncs_finalize();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long n = 100000;
+    fncs::time granted = 0;
+
+    if (argc > 2) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (argc == 2) {
+        n = strtoull(argv[1], NULL, 10);
+        if (n < 1000) {
+            cerr << "iterations must be at least 1000" << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    cout << left << setw(32) << "# benchmark" << right
+        << setw(12) << "calls" << setw(12) << "ns/call" << setw(12) << "allocs" << endl;
+
+    {
+        Measure measure("parse_time", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs::parse_time("10ms");
+        }
+    }
+    {
+        Measure measure("try_parse_time", n);
+        fncs::time parsed = 0;
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs::try_parse_time("10ms", parsed);
+        }
+    }
+    {
+        Measure measure("time_unit_to_multiplier", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            fncs::time_unit_to_multiplier("1ms");
+        }
+    }
+    {
+        string large = sim_config(10000);
+        unsigned long long rounds = n / 10000;
+        Measure measure("parse_config 10000 values", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            fncs::parse_config(large);
+        }
+    }
+
+    /* the client against the stub; a Context, whose destruction does not
+     * shut down zmq, so the stub can be stopped afterwards */
+    zactor_t *stub = zactor_new(broker_stub, NULL);
+    fncs::Context *sim = new fncs::Context;
+    sim->initialize(sim_config(N_TOPICS));
+    if (!sim->is_initialized()) {
+        cerr << "could not connect to the broker stub" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    /* sent one by one to the stub, which has to keep up */
+    string value = "1.25";
+    {
+        Measure measure("publish(string)", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->publish("k0", value);
+        }
+    }
+    granted = sim->time_request(granted + 1);
+    {
+        fncs::Key key = sim->lookup_publish_key("k0");
+        Measure measure("publish(Key)", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->publish(key, value);
+        }
+    }
+    granted = sim->time_request(granted + 1);
+    {
+        Measure measure("publish(string) unsubscribed", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->publish("nobody", value);
+        }
+    }
+
+    {
+        unsigned long long rounds = n / 100;
+        Measure measure("time_request round trip", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            granted = sim->time_request(granted + 1);
+        }
+    }
+    {
+        /* per value received; includes the round trip, spread over them */
+        unsigned long long rounds = n / 1000;
+        stub_publishes = 1000;
+        Measure measure("PUBLISH dispatch, per value", rounds * stub_publishes);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            granted = sim->time_request(granted + 1);
+        }
+    }
+
+    /* the cache now holds values of every topic */
+    {
+        Measure measure("get_value(string)", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->get_value("t7");
+        }
+    }
+    {
+        fncs::Key key = sim->lookup_key("t7");
+        Measure measure("get_value(Key)", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->get_value(key);
+        }
+    }
+    {
+        Measure measure("get_values(string)", n);
+        for (unsigned long long i=0; i<n; ++i) {
+            sim->get_values("t7");
+        }
+    }
+    {
+        unsigned long long rounds = n / 100;
+        Measure measure("get_events, 100 keys", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            sim->get_events();
+        }
+    }
+    {
+        unsigned long long rounds = n / 100;
+        unsigned long long n_events = 0;
+        Measure measure("events_begin, 100 keys", rounds);
+        for (unsigned long long i=0; i<rounds; ++i) {
+            for (fncs::EventIterator it=sim->events_begin(); it!=sim->events_end(); ++it) {
+                ++n_events;
+            }
+        }
+        if (!n_events) {
+            cerr << "no events were received" << endl;
+        }
+    }
+
+    bench_capi(n);
+
+    /* closes the connection without a BYE, then stops the stub */
+    delete sim;
+    zactor_destroy(&stub);
+
+    /* the broker's dispatcher between a raw publisher of the keys k0
+     * to k99 and a raw subscriber to them; only the broker allocates */
+    {
+        ostringstream oss;
+        oss << "name = sub\n"
+            << "time_delta = 1ns\n"
+            << "values\n";
+        for (size_t k=0; k<N_KEYS; ++k) {
+            oss << "    t" << k << "\n"
+                << "        topic = pub/k" << k << "\n";
+        }
+        fncs::Broker *broker = new fncs::Broker(2, BROKER_ENDPOINT);
+        zsock_t *pub = raw_sim("pub", "name = pub\ntime_delta = 1ns\n");
+        zsock_t *sub = raw_sim("sub", oss.str());
+        raw_wait(pub, fncs::ACK);
+        raw_wait(sub, fncs::ACK);
+        unsigned long long rounds = n / 1000;
+        fncs::time time = 0;
+        Measure *measure = NULL;
+        /* the first round routes the topics */
+        for (unsigned long long i=0; i<=rounds; ++i) {
+            if (i == 1) {
+                measure = new Measure("broker PUBLISH fan-out, per value", rounds * 1000);
+            }
+            for (size_t p=0; p<1000; ++p) {
+                zstr_sendm(pub, fncs::PUBLISH);
+                zstr_sendfm(pub, "pub/k%d", static_cast<int>(p % N_KEYS));
+                zstr_send(pub, "1.25");
+            }
+            raw_request(pub, time, time + 1);
+            raw_request(sub, time, time + 1);
+            raw_wait(pub, fncs::TIME_REQUEST);
+            raw_wait(sub, fncs::TIME_REQUEST);
+            ++time;
+        }
+        delete measure;
+        raw_request(pub, time);
+        raw_request(sub, time);
+        raw_wait(pub, fncs::BYE);
+        raw_wait(sub, fncs::BYE);
+        zsock_destroy(&pub);
+        zsock_destroy(&sub);
+        delete broker;
+    }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _MUTEX_HPP_
+#define _MUTEX_HPP_
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace fncs {
+
+    /** A plain mutex over the native threads API, which czmq and zmq
+     * already link against. */
+    class Mutex {
+        public:
+#if (defined WIN32 || defined _WIN32)
+            Mutex() { InitializeCriticalSection(&native); }
+            ~Mutex() { DeleteCriticalSection(&native); }
+            void lock() { EnterCriticalSection(&native); }
+            void unlock() { LeaveCriticalSection(&native); }
+#else
+            Mutex() { pthread_mutex_init(&native, NULL); }
+            ~Mutex() { pthread_mutex_destroy(&native); }
+            void lock() { pthread_mutex_lock(&native); }
+            void unlock() { pthread_mutex_unlock(&native); }
+#endif
+
+        private:
+            friend class Condition; /* waits on native, see work_pool.hpp */
+
+            /* not copyable */
+            Mutex(const Mutex &);
+            Mutex& operator=(const Mutex &);
+
+#if (defined WIN32 || defined _WIN32)
+            CRITICAL_SECTION native;
+#else
+            pthread_mutex_t native;
+#endif
+    };
+
+    /** Holds the mutex until the end of the scope. */
+    class MutexLock {
+        public:
+            explicit MutexLock(Mutex &mutex) : mutex(mutex) { mutex.lock(); }
+            ~MutexLock() { mutex.unlock(); }
+
+        private:
+            /* not copyable */
+            MutexLock(const MutexLock &);
+            MutexLock& operator=(const MutexLock &);
+
+            Mutex &mutex;
+    };
+
+}
+
+#endif /* _MUTEX_HPP_ */
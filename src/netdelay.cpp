@@ -0,0 +1,379 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+/* xorshift64*; rand() is too coarse and too short for millions of draws */
+class Random {
+    public:
+        explicit Random(unsigned long long seed) : state(seed ? seed : 1) {}
+
+        unsigned long long next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717ULL;
+        }
+
+        /* uniform in (0,1] */
+        double real() {
+            return (static_cast<double>(next() >> 11) + 1.0) / 9007199254740992.0;
+        }
+
+    private:
+        unsigned long long state;
+};
+
+
+/* delay of one link, in sim time */
+class Delay {
+    public:
+        enum Kind { CONSTANT, UNIFORM, NORMAL, EXPONENTIAL };
+
+        Delay() : kind(CONSTANT), a(0), b(0) {}
+
+        Delay(Kind kind, fncs::time a, fncs::time b) : kind(kind), a(a), b(b) {}
+
+        fncs::time draw(Random &random) const {
+            switch (kind) {
+                case UNIFORM:
+                    return a + random.next() % (b - a + 1);
+                case NORMAL: {
+                    /* Box-Muller, cut off at zero */
+                    double u = random.real();
+                    double v = random.real();
+                    double x = static_cast<double>(a) + static_cast<double>(b)
+                        * sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+                    return x > 0 ? static_cast<fncs::time>(x + 0.5) : 0;
+                }
+                case EXPONENTIAL:
+                    return static_cast<fncs::time>(
+                            -static_cast<double>(a) * log(random.real()) + 0.5);
+                default:
+                    return a;
+            }
+        }
+
+    private:
+        Kind kind;
+        fncs::time a; /* constant, minimum or mean */
+        fncs::time b; /* maximum or standard deviation */
+};
+
+
+/* a value waiting for its delivery time; the value itself is kept in a
+ * slot so that the heap only moves these */
+class Pending {
+    public:
+        Pending(fncs::time time, unsigned long long order, size_t slot)
+            : time(time), order(order), slot(slot) {}
+
+        bool operator>(const Pending &that) const {
+            return time > that.time || (time == that.time && order > that.order);
+        }
+
+        fncs::time time;
+        unsigned long long order; /* arrival, so equal times keep their order */
+        size_t slot;
+};
+
+typedef priority_queue<Pending, vector<Pending>, greater<Pending> > EventQueue;
+
+typedef map<pair<string,string>, Delay> LinkMap;
+
+
+static fncs::time parse_delay(const string &token)
+{
+    fncs::time delay = 0;
+    if (!fncs::try_parse_time(token.c_str(), delay)) {
+        cerr << "bad delay '" << token << "'" << endl;
+        fncs::die();
+    }
+    return fncs::convert_broker_to_sim_time(delay);
+}
+
+
+/* Reads lines of "<from> <to> <distribution> <parameters>", where from
+ * and to are simulator names or '*' and the parameters are times with
+ * units, and "seed <n>" lines. */
+static void load_links(const string &file, LinkMap &links, unsigned long long &seed)
+{
+    ifstream fin(file.c_str());
+    if (!fin) {
+        cerr << "Could not open link file '" << file << "'." << endl;
+        fncs::die();
+    }
+
+    string line;
+    size_t counter = 0;
+    while (getline(fin, line)) {
+        ++counter;
+        vector<string> tokens;
+        istringstream iss(line);
+        copy(istream_iterator<string>(iss),
+                istream_iterator<string>(),
+                back_inserter(tokens));
+        if (tokens.empty() || tokens[0][0] == '#') {
+            continue;
+        }
+        if (tokens[0] == "seed" && tokens.size() == 2) {
+            seed = strtoul(tokens[1].c_str(), NULL, 10);
+            continue;
+        }
+
+        Delay delay;
+        string kind = tokens.size() > 2 ? tokens[2] : "";
+        if (kind == "constant" && tokens.size() == 4) {
+            delay = Delay(Delay::CONSTANT, parse_delay(tokens[3]), 0);
+        }
+        else if (kind == "uniform" && tokens.size() == 5) {
+            fncs::time low = parse_delay(tokens[3]);
+            fncs::time high = parse_delay(tokens[4]);
+            if (high < low) {
+                cerr << file << ":" << counter << ": uniform minimum exceeds maximum" << endl;
+                fncs::die();
+            }
+            delay = Delay(Delay::UNIFORM, low, high);
+        }
+        else if (kind == "normal" && tokens.size() == 5) {
+            delay = Delay(Delay::NORMAL, parse_delay(tokens[3]),
+                    parse_delay(tokens[4]));
+        }
+        else if (kind == "exponential" && tokens.size() == 4) {
+            delay = Delay(Delay::EXPONENTIAL, parse_delay(tokens[3]), 0);
+        }
+        else {
+            cerr << file << ":" << counter << ": bad link '" << line << "'" << endl;
+            fncs::die();
+        }
+        links[make_pair(tokens[0], tokens[1])] = delay;
+    }
+}
+
+
+/* the link from and to, else from anywhere, else to anywhere, else the
+ * "* *" link, else the default */
+static const Delay& find_link(const LinkMap &links, const Delay &fallback,
+        const string &from, const string &to)
+{
+    LinkMap::const_iterator it;
+    if ((it = links.find(make_pair(from, to))) != links.end()
+            || (it = links.find(make_pair(from, string("*")))) != links.end()
+            || (it = links.find(make_pair(string("*"), to))) != links.end()
+            || (it = links.find(make_pair(string("*"), string("*")))) != links.end()) {
+        return it->second;
+    }
+    return fallback;
+}
+
+
+int main(int argc, char **argv)
+{
+    string param_time_stop = "";
+    string param_time_delay_min = "";
+    string param_time_delay_max = "";
+    string param_link_file = "";
+    fncs::time time_granted = 0;
+    fncs::time time_stop = 0;
+    fncs::time time_delay_min = 0;
+    fncs::time time_delay_max = 0;
+    unsigned long long seed = 1;
+    LinkMap links;
+    map<string, const Delay*> label_links; /* event label to its link */
+    EventQueue events;
+    vector<pair<string,string> > slots; /* label and value of each pending event */
+    vector<size_t> free_slots;
+    unsigned long long order = 0;
+    unsigned long long n_received = 0;
+    unsigned long long n_relayed = 0;
+    unsigned long long n_skipped = 0;
+    size_t depth_max = 0;
+
+    const char * usage = "Usage: fncs_netdelay <stop time> <delaymin> <delaymax> [<link file>]";
+
+    if (argc < 2) {
+        cerr << "Missing stop time." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 3) {
+        cerr << "Missing delay min time." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 4) {
+        cerr << "Missing delay max time." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc > 5) {
+        cerr << "Too many parameters." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    param_time_stop = argv[1];
+    if (!fncs::try_parse_time(param_time_stop.c_str(), time_stop)) {
+        cerr << "Invalid stop time '" << param_time_stop << "'." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    param_time_delay_min = argv[2];
+    param_time_delay_max = argv[3];
+    if (argc > 4) {
+        param_link_file = argv[4];
+    }
+
+    {
+        int value = -1;
+        istringstream iss(param_time_delay_min);
+        iss >> value;
+        if (value < 0) {
+            cerr << "delay min must be >= 0" << endl;
+            exit(EXIT_FAILURE);
+        }
+        time_delay_min = static_cast<fncs::time>(value);
+    }
+
+    {
+        int value = -1;
+        istringstream iss(param_time_delay_max);
+        iss >> value;
+        if (value < 0) {
+            cerr << "delay max must be >= 0" << endl;
+            exit(EXIT_FAILURE);
+        }
+        time_delay_max = static_cast<fncs::time>(value);
+    }
+
+    if (time_delay_max < time_delay_min) {
+        cerr << "delay min must be <= delay max" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const Delay fallback(Delay::UNIFORM, time_delay_min, time_delay_max);
+
+    /* send the values due at a grant as one message */
+    if (!getenv("FNCS_PUBLISH_BATCH")) {
+#if (defined WIN32 || defined _WIN32)
+        _putenv("FNCS_PUBLISH_BATCH=yes");
+#else
+        setenv("FNCS_PUBLISH_BATCH", "yes", 0);
+#endif
+    }
+
+    fncs::initialize();
+
+    /* link delays are times with units, so read them once time_delta is known */
+    if (!param_link_file.empty()) {
+        load_links(param_link_file, links, seed);
+        cout << links.size() << " links read from " << param_link_file << endl;
+    }
+    Random random(seed);
+
+    cout << "stops at " << time_stop << " nanoseconds" << endl;
+    time_stop = fncs::convert_broker_to_sim_time(time_stop);
+    cout << "stops at " << time_stop << " in sim time" << endl;
+
+    time_granted = fncs::time_request(time_stop);
+
+    while (time_granted < time_stop) {
+        vector<string> event_labels = fncs::get_events();
+
+        /* delay events of labels from/to/key */
+        for (size_t i=0; i<event_labels.size(); ++i) {
+            const string &label = event_labels[i];
+            map<string, const Delay*>::iterator link = label_links.find(label);
+            if (link == label_links.end()) {
+                size_t first = label.find('/');
+                size_t second = first == string::npos ? first : label.find('/', first+1);
+                const Delay *delay = NULL;
+                if (second == string::npos || label.find('/', second+1) != string::npos) {
+                    cout << "skipping events of " << label << endl;
+                }
+                else {
+                    delay = &find_link(links, fallback,
+                            label.substr(0, first),
+                            label.substr(first+1, second-first-1));
+                }
+                link = label_links.insert(make_pair(label, delay)).first;
+            }
+            if (!link->second) {
+                ++n_skipped;
+                continue;
+            }
+
+            size_t slot;
+            if (free_slots.empty()) {
+                slot = slots.size();
+                slots.push_back(pair<string,string>());
+            }
+            else {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            slots[slot].first = label;
+            slots[slot].second = fncs::get_value(label);
+            events.push(Pending(time_granted + link->second->draw(random), order++, slot));
+            ++n_received;
+        }
+        if (events.size() > depth_max) {
+            depth_max = events.size();
+        }
+
+        /* republish the events due */
+        size_t n_due = 0;
+        while (!events.empty() && events.top().time <= time_granted) {
+            size_t slot = events.top().slot;
+            events.pop();
+            fncs::publish(slots[slot].first, slots[slot].second);
+            slots[slot].second.clear();
+            free_slots.push_back(slot);
+            ++n_due;
+        }
+        n_relayed += n_due;
+
+        if (!event_labels.empty() || n_due) {
+            cout << time_granted << ": " << event_labels.size() << " received, "
+                << n_due << " relayed, " << events.size() << " queued" << endl;
+        }
+
+        /* get next event time */
+        if (events.empty()) {
+            time_granted = fncs::time_request(time_stop);
+        }
+        else {
+            time_granted = fncs::time_request(events.top().time);
+        }
+    }
+
+    cout << "received " << n_received << ", relayed " << n_relayed
+        << ", skipped " << n_skipped << ", still queued " << events.size()
+        << ", largest queue " << depth_max << endl;
+    cout << "done" << endl;
+
+    fncs::finalize();
+
+    return 0;
+}
@@ -2,11 +2,12 @@
 #include "config.h"
 
 /* C++ standard headers */
-#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
-#include <fstream>
+#include <cstring>
+#include <functional>
 #include <iostream>
-#include <iterator>
+#include <queue>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -14,129 +15,468 @@
 
 /* 3rd party headers */
 #include "czmq.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 /* fncs headers */
 #include "fncs.hpp"
 #include "fncs_internal.hpp"
+#include "player_schedule.hpp"
+#include "trace_writer.hpp"
 
 using namespace ::std;
 
+#ifdef FNCS_ANON
+static const char *player_config =
+            "name = player_anon\n"
+            "time_delta = 1ns\n"
+            "broker = tcp://localhost:5570\n";
+#else
+static const char *player_config =
+            "name = player\n"
+            "time_delta = 1ns\n"
+            "broker = tcp://localhost:5570\n";
+#endif
+
+
+/* Reads lines from a file, gzip compressed or not if built with zlib. */
+class LineReader {
+    public:
+        LineReader() : file(NULL), buffer(65536), begin(0), end(0), eof(false) {}
+
+        ~LineReader() {
+            if (file) {
+#ifdef HAVE_ZLIB
+                gzclose(file);
+#else
+                fclose(file);
+#endif
+            }
+        }
+
+        bool open(const string &path) {
+#ifdef HAVE_ZLIB
+            file = gzopen(path.c_str(), "rb"); /* reads plain files as is */
+#else
+            file = fopen(path.c_str(), "rb");
+#endif
+            return file != NULL;
+        }
+
+        /* false at the end of the file */
+        bool getline(string &line) {
+            line.clear();
+            while (true) {
+                char *data = &buffer[0];
+                char *found = static_cast<char*>(memchr(data + begin, '\n', end - begin));
+                if (found) {
+                    line.append(data + begin, found - (data + begin));
+                    begin = found - data + 1;
+                    return true;
+                }
+                line.append(data + begin, end - begin);
+                begin = end = 0;
+                if (eof || !fill()) {
+                    eof = true;
+                    return !line.empty();
+                }
+            }
+        }
+
+    private:
+        /* not copyable */
+        LineReader(const LineReader &);
+        LineReader& operator=(const LineReader &);
+
+        bool fill() {
+#ifdef HAVE_ZLIB
+            int n = gzread(file, &buffer[0], buffer.size());
+#else
+            int n = static_cast<int>(fread(&buffer[0], 1, buffer.size(), file));
+#endif
+            end = n > 0 ? n : 0;
+            return n > 0;
+        }
+
+#ifdef HAVE_ZLIB
+        gzFile file;
+#else
+        FILE *file;
+#endif
+        vector<char> buffer;
+        size_t begin;
+        size_t end;
+        bool eof;
+};
+
+
+/* One input of the player, holding its next event. */
+class Feed {
+    public:
+        Feed() : time(0) {}
+
+        virtual ~Feed() {}
+
+        /* move to the next event; false at the end */
+        virtual bool next() = 0;
+
+        /* publish the current event */
+        virtual void publish() = 0;
+
+        /* publish the current event for delivery at its time, see --preload */
+        virtual void publish_at() = 0;
+
+        fncs::time time; /* of the current event */
+};
+
+
+/* the text format, see the README */
+class TextFeed : public Feed {
+    public:
+        explicit TextFeed(const string &path) : path(path), counter(0) {
+            if (!reader.open(path)) {
+                cerr << "Could not open input file '" << path << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        virtual bool next() {
+            fncs::time last = time;
+            while (reader.getline(line)) {
+                ++counter;
+                if (line.empty() || line[0] == '#') {
+                    continue;
+                }
+                if (!tokenize()) {
+                    cerr << path << ": bad line: " << counter << ": '" << line << "'" << endl;
+                    fncs::die();
+                }
+                if (time < last) {
+                    cerr << path << ": bad time token in line: " << counter << ": '" << line << "'" << endl;
+                    cerr << "Time value is smaller than the previous one." << endl;
+                    fncs::die();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        virtual void publish() {
+#ifdef FNCS_ANON
+            fncs::publish_anon(key, value);
+#else
+            fncs::publish(key, value);
+#endif
+        }
+
+        virtual void publish_at() {
+            fncs::publish_at(key, value, time);
+        }
+
+    private:
+        /* split the line into time, key and value in place */
+        bool tokenize() {
+            const char *space = " \t\r";
+            size_t token[3][2];
+            size_t at = 0;
+            for (int i=0; i<3; ++i) {
+                token[i][0] = line.find_first_not_of(space, at);
+                if (token[i][0] == string::npos) {
+                    return false;
+                }
+                at = line.find_first_of(space, token[i][0]);
+                token[i][1] = at == string::npos ? line.size() : at;
+            }
+            if (at != string::npos && line.find_first_not_of(space, at) != string::npos) {
+                return false;
+            }
+            time = 0;
+            for (size_t i=token[0][0]; i<token[0][1]; ++i) {
+                if (line[i] < '0' || line[i] > '9') {
+                    return false;
+                }
+                time = time * 10 + (line[i] - '0');
+            }
+            key.assign(line, token[1][0], token[1][1] - token[1][0]);
+            value.assign(line, token[2][0], token[2][1] - token[2][0]);
+            return true;
+        }
+
+        string path;
+        LineReader reader;
+        string line;
+        size_t counter;
+        string key;
+        string value;
+};
+
+
+/* a schedule compiled by fncs_player_compile, played straight from the map */
+class ScheduleFeed : public Feed {
+    public:
+        explicit ScheduleFeed(const string &path) : path(path), index(0) {
+            if (!schedule.open(path) || !schedule.key_names(keys)) {
+                cerr << "Player schedule '" << path
+                    << "' could not be mapped or is corrupt." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /* the keys resolve once fncs is initialized */
+        void resolve() {
+#ifndef FNCS_ANON
+            handles.resize(keys.size());
+            for (size_t i=0; i<keys.size(); ++i) {
+                handles[i] = fncs::lookup_publish_key(keys[i]);
+            }
+#endif
+        }
+
+        virtual bool next() {
+            if (index == schedule.events()) {
+                return false;
+            }
+            if (!schedule.event(index, event)) {
+                cerr << "Player schedule '" << path
+                    << "' is corrupt at event " << index << "." << endl;
+                fncs::die();
+            }
+            ++index;
+            time = event.time;
+            return true;
+        }
+
+        virtual void publish() {
+            value.assign(event.value, event.size); /* reuses its buffer */
+#ifdef FNCS_ANON
+            fncs::publish_anon(keys[event.key], value);
+#else
+            fncs::publish(handles[event.key], value);
+#endif
+        }
+
+        virtual void publish_at() {
+            value.assign(event.value, event.size);
+            fncs::publish_at(keys[event.key], value, time);
+        }
+
+    private:
+        string path;
+        fncs::PlayerSchedule schedule;
+        fncs::ScheduleEvent event;
+        vector<string> keys;
+        vector<fncs::Key> handles;
+        size_t index;
+        string value;
+};
+
+
+/* a binary trace of the broker or fncs_tracer, its publishes replayed */
+class TraceFeed : public Feed {
+    public:
+        explicit TraceFeed(const string &path) : path(path) {
+            if (!reader.open(path)) {
+                cerr << "Could not open binary trace '" << path << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /* whether the file starts as a binary trace of any version */
+        static bool is_trace(const string &path) {
+            char magic[7] = {0};
+            FILE *file = fopen(path.c_str(), "rb");
+            bool result = false;
+            if (file) {
+                result = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+                    && 0 == memcmp(magic, fncs::TRACE_MAGIC, sizeof(magic));
+                fclose(file);
+            }
+            return result;
+        }
+
+        virtual bool next() {
+            fncs::time last = time;
+            while (reader.next(record)) {
+                if (fncs::TRACE_PUBLISH != record.type) {
+                    continue;
+                }
+                if (record.time < last) {
+                    cerr << path << ": time " << record.time
+                        << " is smaller than the previous one." << endl;
+                    fncs::die();
+                }
+                time = record.time;
+                return true;
+            }
+            if (reader.corrupt()) {
+                cerr << path << ": truncated or corrupt trace." << endl;
+                fncs::die();
+            }
+            return false;
+        }
+
+        virtual void publish() {
+#ifdef FNCS_ANON
+            fncs::publish_anon(record.topic, record.value);
+#else
+            fncs::publish(record.topic, record.value);
+#endif
+        }
+
+        virtual void publish_at() {
+            fncs::publish_at(record.topic, record.value, time);
+        }
+
+    private:
+        string path;
+        fncs::TraceReader reader;
+        fncs::TraceRecord record;
+};
+
+
+/* next event time and feed index; equal times play in file order */
+typedef pair<fncs::time, size_t> Head;
+typedef priority_queue<Head, vector<Head>, greater<Head> > MergeQueue;
+
+
 int main(int argc, char **argv)
 {
     string param_time_stop = "";
-    string param_file_name = "";
     fncs::time time_granted = 0;
     fncs::time time_stop = 0;
-    ifstream fin;
-    string line = "";
-    size_t counter = 0;
+    fncs::time preload = 0; /* window of events handed ahead, if any */
+    int first = 1; /* argument after the options */
+    vector<Feed*> feeds;
+    vector<ScheduleFeed*> schedules;
+    MergeQueue heads;
 
 #ifdef FNCS_ANON
-    const char * usage = "Usage: fncs_player_anon <stop time> <input file>";
+    const char * usage = "Usage: fncs_player_anon <stop time> <input file>...";
 #else
-    const char * usage = "Usage: fncs_player <stop time> <input file>";
+    const char * usage = "Usage: fncs_player [--preload <window>] <stop time> <input file>...";
+
+    if (argc > 2 && 0 == strcmp(argv[1], "--preload")) {
+        if (!fncs::try_parse_time(argv[2], preload) || 0 == preload) {
+            cerr << "Invalid preload window '" << argv[2] << "'." << endl;
+            cerr << usage << endl;
+            exit(EXIT_FAILURE);
+        }
+        first = 3;
+    }
 #endif
 
-    if (argc < 3) {
+    if (argc < first + 2) {
         cerr << "Missing stop time and/or input filename parameters." << endl;
         cerr << usage << endl;
         exit(EXIT_FAILURE);
     }
-    
-    if (argc > 3) {
-        cerr << "Too many parameters." << endl;
+
+    param_time_stop = argv[first];
+    if (!fncs::try_parse_time(param_time_stop.c_str(), time_stop)) {
+        cerr << "Invalid stop time '" << param_time_stop << "'." << endl;
         cerr << usage << endl;
         exit(EXIT_FAILURE);
     }
 
-    param_time_stop = argv[1];
-    param_file_name = argv[2];
-
-    fin.open(param_file_name.c_str());
-    if (!fin) {
-        cerr << "Could not open output file '" << param_file_name << "'." << endl;
-        exit(EXIT_FAILURE);
+    for (int i=first+1; i<argc; ++i) {
+        if (fncs::PlayerSchedule::is_schedule(argv[i])) {
+            schedules.push_back(new ScheduleFeed(argv[i]));
+            feeds.push_back(schedules.back());
+        }
+        else if (TraceFeed::is_trace(argv[i])) {
+            feeds.push_back(new TraceFeed(argv[i]));
+        }
+        else {
+            feeds.push_back(new TextFeed(argv[i]));
+        }
     }
 
-    fncs::initialize(
-#ifdef FNCS_ANON
-            "name = player_anon\n"
+    /* the values published at one time go out as one message */
+    if (!getenv("FNCS_PUBLISH_BATCH")) {
+#if (defined WIN32 || defined _WIN32)
+        _putenv("FNCS_PUBLISH_BATCH=yes");
 #else
-            "name = player\n"
+        setenv("FNCS_PUBLISH_BATCH", "yes", 0);
 #endif
-            "time_delta = 1ns\n"
-            "broker = tcp://localhost:5570\n"
-            );
+    }
+
+    fncs::initialize(player_config);
 
-    time_stop = fncs::parse_time(param_time_stop);
     cout << "stops at " << time_stop << " nanoseconds" << endl;
     time_stop = fncs::convert_broker_to_sim_time(time_stop);
     cout << "stops at " << time_stop << " in sim time" << endl;
+    preload = fncs::convert_broker_to_sim_time(preload);
 
-    /* input file might start with comment(s), skip them all */
-    do {
-        getline(fin, line);
-        ++counter;
-    } while (fin.good() && line[0] == '#');
+    for (size_t i=0; i<schedules.size(); ++i) {
+        schedules[i]->resolve();
+    }
+    for (size_t i=0; i<feeds.size(); ++i) {
+        if (feeds[i]->next()) {
+            heads.push(Head(feeds[i]->time, i));
+        }
+    }
 
-    if (line.empty() || line[0] == '#') {
-        /* file was only comments */
+    if (heads.empty()) {
+        /* files were only comments */
         cerr << "Player input file missing actual data." << endl;
         fncs::die();
     }
 
-    while (fin.good() && time_granted < time_stop) {
-        fncs::time event;
-
-        /* tokenize line */
-        vector<string> tokens;
-        istringstream iss(line);
-        copy(istream_iterator<string>(iss),
-                istream_iterator<string>(),
-                back_inserter(tokens));
-        if (tokens.size() != 3) {
-            cerr << "Bad line: " << counter << ": '" << line << "'" << endl;
-            fncs::die();
-        }
-
-        /* convert first token into fncs::time */
-        {
-            istringstream iss(tokens[0]);
-            iss >> event;
-            if (!iss) {
-                cerr << "Bad time token in line: " << counter << ": '" << line << "'" << endl;
-                fncs::die();
-            }
+    /* The broker holds values published ahead for their time, so with a
+     * preload window the player hands it the events of a window at once
+     * and is granted once per window rather than once per event time.
+     * Once the events before the stop time are all handed over it
+     * detaches and is no longer waited for. */
+    while (preload && !heads.empty() && heads.top().first < time_stop) {
+        fncs::time event = heads.top().first;
+        Feed *feed = feeds[heads.top().second];
+        size_t index = heads.top().second;
+
+        if (event > time_granted && event - time_granted > preload) {
+            fncs::set_next_publish(event);
+            time_granted = fncs::time_request(event);
         }
 
-        /* sync */
-        if (event < time_granted) {
-            cerr << "Bad time token in line: " << counter << ": '" << line << "'" << endl;
-            cerr << "Time value is smaller than previously granted time." << endl;
-            fncs::die();
+        heads.pop();
+        feed->publish_at();
+        if (feed->next()) {
+            heads.push(Head(feed->time, index));
         }
+    }
+
+    while (!preload && !heads.empty() && time_granted < time_stop) {
+        fncs::time event = heads.top().first;
+        Feed *feed = feeds[heads.top().second];
+        size_t index = heads.top().second;
+
+        /* sync */
         if (event > time_granted) {
+            /* nothing is published until then, see set_next_publish() */
+            fncs::set_next_publish(event);
             time_granted = fncs::time_request(event);
         }
 
         /* create event */
-#ifdef FNCS_ANON
-        fncs::publish_anon(tokens[1], tokens[2]);
-#else
-        fncs::publish(tokens[1], tokens[2]);
-#endif
-
-        /* read next line */
-        getline(fin, line);
-        ++counter;
+        heads.pop();
+        feed->publish();
+        if (feed->next()) {
+            heads.push(Head(feed->time, index));
+        }
     }
 
     cout << "done" << endl;
 
-    fin.close();
+    for (size_t i=0; i<feeds.size(); ++i) {
+        delete feeds[i];
+    }
 
-    fncs::finalize();
+    if (preload) {
+        fncs::finalize_detached();
+    }
+    else {
+        fncs::finalize();
+    }
 
     return 0;
 }
-
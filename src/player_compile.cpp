@@ -0,0 +1,147 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "player_schedule.hpp"
+
+using namespace ::std;
+
+static void put32(string &out, unsigned long long value)
+{
+    for (int i=0; i<4; ++i) {
+        out.append(1, static_cast<char>(value >> (8*i)));
+    }
+}
+
+
+static void put64(string &out, unsigned long long value)
+{
+    put32(out, value);
+    put32(out, value >> 32);
+}
+
+
+/* Compiles a player input file into the schedule that fncs_player maps
+ * instead of parsing, see player_schedule.hpp. Values are staged in a
+ * second file next to the output, so neither file is held in memory. */
+int main(int argc, char **argv)
+{
+    ifstream fin;
+    ofstream fout;
+    fstream fvalues;
+    string values_name;
+    map<string, unsigned long long> key_ids;
+    vector<const string*> key_names;
+    string line;
+    string record;
+    size_t counter = 0;
+    unsigned long long n_events = 0;
+    unsigned long long values_size = 0;
+    fncs::time last = 0;
+
+    if (argc != 3) {
+        cerr << "Usage: fncs_player_compile <input file> <output file>" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    fin.open(argv[1]);
+    if (!fin) {
+        cerr << "Could not open input file '" << argv[1] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+    fout.open(argv[2], ios::out | ios::binary);
+    values_name = string(argv[2]) + ".values";
+    fvalues.open(values_name.c_str(), ios::in | ios::out | ios::trunc | ios::binary);
+    if (!fout || !fvalues) {
+        cerr << "Could not open output file '" << argv[2] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    /* header for now, rewritten once the counts are known */
+    fout.write(string(fncs::SCHEDULE_HEADER, '\0').data(), fncs::SCHEDULE_HEADER);
+
+    while (getline(fin, line)) {
+        string key;
+        string value;
+        fncs::time event;
+
+        ++counter;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        /* same three columns as fncs_player reads */
+        istringstream iss(line);
+        if (!(iss >> event >> key >> value) || (iss >> ws, !iss.eof())) {
+            cerr << "Bad line: " << counter << ": '" << line << "'" << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (event < last) {
+            cerr << "Bad time token in line: " << counter << ": '" << line << "'" << endl;
+            cerr << "Time value is smaller than the previous one." << endl;
+            exit(EXIT_FAILURE);
+        }
+        last = event;
+
+        map<string, unsigned long long>::iterator id = key_ids.find(key);
+        if (id == key_ids.end()) {
+            id = key_ids.insert(make_pair(key, key_names.size())).first;
+            key_names.push_back(&id->first);
+        }
+
+        record.clear();
+        put64(record, event);
+        put32(record, id->second);
+        put32(record, value.size());
+        put64(record, values_size);
+        fout.write(record.data(), record.size());
+        fvalues.write(value.data(), value.size());
+        values_size += value.size();
+        ++n_events;
+    }
+
+    /* the values, then the key table */
+    fvalues.seekg(0);
+    if (values_size) {
+        fout << fvalues.rdbuf();
+    }
+    fvalues.close();
+    remove(values_name.c_str());
+
+    record.clear();
+    for (size_t i=0; i<key_names.size(); ++i) {
+        put32(record, key_names[i]->size());
+        record.append(*key_names[i]);
+    }
+    fout.write(record.data(), record.size());
+
+    unsigned long long values_offset = fncs::SCHEDULE_HEADER + n_events * fncs::SCHEDULE_EVENT;
+    record.assign(fncs::SCHEDULE_MAGIC, fncs::SCHEDULE_MAGIC_SIZE);
+    put64(record, n_events);
+    put64(record, key_names.size());
+    put64(record, values_offset);
+    put64(record, values_offset + values_size);
+    fout.seekp(0);
+    fout.write(record.data(), record.size());
+    fout.close();
+    if (!fout) {
+        cerr << "Could not write output file '" << argv[2] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    cout << n_events << " event(s) of " << key_names.size()
+        << " key(s) compiled into " << argv[2] << endl;
+
+    return 0;
+}
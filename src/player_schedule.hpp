@@ -0,0 +1,229 @@
+#ifndef _PLAYER_SCHEDULE_HPP_
+#define _PLAYER_SCHEDULE_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fncs.hpp"
+
+namespace fncs {
+
+    /** A player schedule compiled by fncs_player_compile. All numbers are
+     * little endian:
+     *
+     *   "FNCSPLY1", events, keys, values offset, keys offset (u64 each)
+     *   per event: time (u64), key id (u32), value size (u32) and value
+     *              offset from the values offset (u64)
+     *   the values, back to back
+     *   per key: size (u32) and name
+     *
+     * Events are in time order. The player maps the file and reads events
+     * in place, so a replay allocates nothing per event. */
+    const char * const SCHEDULE_MAGIC = "FNCSPLY1";
+    const size_t SCHEDULE_MAGIC_SIZE = 8;
+    const size_t SCHEDULE_HEADER = SCHEDULE_MAGIC_SIZE + 32;
+    const size_t SCHEDULE_EVENT = 24;
+
+    /** One event of a mapped schedule. The value points into the map. */
+    struct ScheduleEvent {
+        fncs::time time;
+        size_t key;
+        const char *value;
+        size_t size;
+    };
+
+    class PlayerSchedule {
+        public:
+            PlayerSchedule()
+                : data(NULL)
+                , size(0)
+                , n_events(0)
+                , n_keys(0)
+                , values(0)
+                , keys(0)
+#if (defined WIN32 || defined _WIN32)
+                , file(INVALID_HANDLE_VALUE)
+                , mapping(NULL)
+#endif
+            {}
+
+            ~PlayerSchedule() { close(); }
+
+            /** Whether the file starts like a compiled schedule. */
+            static bool is_schedule(const std::string &path) {
+                std::ifstream fin(path.c_str(), std::ios::in | std::ios::binary);
+                char magic[SCHEDULE_MAGIC_SIZE];
+                return fin.read(magic, SCHEDULE_MAGIC_SIZE)
+                    && 0 == memcmp(magic, SCHEDULE_MAGIC, SCHEDULE_MAGIC_SIZE);
+            }
+
+            /** Map the file; false if it cannot be mapped or its header is
+             * corrupt. Events are checked as they are read. */
+            bool open(const std::string &path) {
+                close();
+                if (!map(path)) {
+                    close();
+                    return false;
+                }
+                if (size < SCHEDULE_HEADER
+                        || 0 != memcmp(data, SCHEDULE_MAGIC, SCHEDULE_MAGIC_SIZE)) {
+                    close();
+                    return false;
+                }
+                n_events = get64(SCHEDULE_MAGIC_SIZE);
+                n_keys = get64(SCHEDULE_MAGIC_SIZE + 8);
+                values = get64(SCHEDULE_MAGIC_SIZE + 16);
+                keys = get64(SCHEDULE_MAGIC_SIZE + 24);
+                if (n_events > (size - SCHEDULE_HEADER) / SCHEDULE_EVENT
+                        || values != SCHEDULE_HEADER + n_events * SCHEDULE_EVENT
+                        || keys < values || keys > size) {
+                    close();
+                    return false;
+                }
+                return true;
+            }
+
+            void close() {
+#if (defined WIN32 || defined _WIN32)
+                if (data) {
+                    UnmapViewOfFile(data);
+                }
+                if (mapping) {
+                    CloseHandle(mapping);
+                }
+                if (file != INVALID_HANDLE_VALUE) {
+                    CloseHandle(file);
+                }
+                file = INVALID_HANDLE_VALUE;
+                mapping = NULL;
+#else
+                if (data) {
+                    munmap(const_cast<char*>(data), size);
+                }
+#endif
+                data = NULL;
+                size = 0;
+                n_events = 0;
+                n_keys = 0;
+            }
+
+            size_t events() const { return static_cast<size_t>(n_events); }
+
+            /** The names of the keys, indexed by key id; false if the key
+             * table is corrupt. */
+            bool key_names(std::vector<std::string> &names) const {
+                unsigned long long at = keys;
+                names.clear();
+                for (unsigned long long i=0; i<n_keys; ++i) {
+                    if (size - at < 4) {
+                        return false;
+                    }
+                    unsigned long long length = get32(at);
+                    at += 4;
+                    if (size - at < length) {
+                        return false;
+                    }
+                    names.push_back(std::string(data + at, static_cast<size_t>(length)));
+                    at += length;
+                }
+                return true;
+            }
+
+            /** Read event i; false if it is corrupt. */
+            bool event(size_t i, ScheduleEvent &out) const {
+                unsigned long long at = SCHEDULE_HEADER + i * SCHEDULE_EVENT;
+                unsigned long long key = get32(at + 8);
+                unsigned long long length = get32(at + 12);
+                unsigned long long offset = get64(at + 16);
+                if (key >= n_keys || offset > keys - values
+                        || length > keys - values - offset) {
+                    return false;
+                }
+                out.time = get64(at);
+                out.key = static_cast<size_t>(key);
+                out.value = data + values + offset;
+                out.size = static_cast<size_t>(length);
+                return true;
+            }
+
+        private:
+            /* not copyable */
+            PlayerSchedule(const PlayerSchedule &);
+            PlayerSchedule& operator=(const PlayerSchedule &);
+
+            bool map(const std::string &path) {
+#if (defined WIN32 || defined _WIN32)
+                file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+                LARGE_INTEGER length;
+                if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length)
+                        || length.QuadPart == 0) {
+                    return false;
+                }
+                mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (!mapping) {
+                    return false;
+                }
+                data = static_cast<const char*>(
+                        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                size = static_cast<size_t>(length.QuadPart);
+                return data != NULL;
+#else
+                int fd = ::open(path.c_str(), O_RDONLY);
+                struct stat st;
+                if (fd < 0) {
+                    return false;
+                }
+                if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                    ::close(fd);
+                    return false;
+                }
+                void *address = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd); /* the map keeps the file */
+                if (address == MAP_FAILED) {
+                    return false;
+                }
+                madvise(address, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(address);
+                size = st.st_size;
+                return true;
+#endif
+            }
+
+            unsigned long long get32(unsigned long long at) const {
+                const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data + at);
+                return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16)
+                    | (static_cast<unsigned long long>(bytes[3]) << 24);
+            }
+
+            unsigned long long get64(unsigned long long at) const {
+                return get32(at) | (get32(at + 4) << 32);
+            }
+
+            const char *data;
+            size_t size;
+            unsigned long long n_events;
+            unsigned long long n_keys;
+            unsigned long long values; /* offset of the values */
+            unsigned long long keys; /* offset of the key table */
+#if (defined WIN32 || defined _WIN32)
+            HANDLE file;
+            HANDLE mapping;
+#endif
+    };
+
+}
+
+#endif /* _PLAYER_SCHEDULE_HPP_ */
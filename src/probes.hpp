@@ -0,0 +1,63 @@
+#ifndef _PROBES_HPP_
+#define _PROBES_HPP_
+
+#include "config.h"
+
+/* Static tracepoints of the provider "fncs" on the hot paths of the
+ * client and the broker. With <sys/sdt.h> they are USDT probes, a nop
+ * until perf, bpftrace or SystemTap attach to them, e.g.
+ *
+ *   bpftrace -e 'usdt:./libfncs.so:fncs:grant { @[arg0] = count(); }'
+ *
+ * On Windows they are TraceLogging events of the provider "FNCS", which
+ * cost a test of a flag unless an ETW session enabled it. Elsewhere they
+ * compile to nothing. Topics are passed as a pointer and a length, as
+ * one sent by ID holds NUL bytes and a received one is not terminated;
+ * read them with bpftrace's str(arg0, arg1). ETW records the pointer.
+ *
+ *   client:  time_request(time_next)      a time request is sent
+ *            grant(time_granted)          its grant was received
+ *            publish(topic, len, size)    a PUBLISH is sent or batched
+ *            receive(topic, len, size)    a PUBLISH is received
+ *   broker:  broker_dispatch(type)        a message is dispatched
+ *            broker_fanout(topic, len, n) a PUBLISH went to n subscribers
+ *            broker_round(time_granted)   a cluster's next time is chosen
+ *            broker_grant(sim, time_granted)  a sim is granted
+ */
+
+#if HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define FNCS_PROBE1(name, a) DTRACE_PROBE1(fncs, name, a)
+#define FNCS_PROBE2(name, a, b) DTRACE_PROBE2(fncs, name, a, b)
+#define FNCS_PROBE3(name, a, b, c) DTRACE_PROBE3(fncs, name, a, b, c)
+
+#elif HAVE_TRACELOGGING
+
+#include <windows.h>
+#include <TraceLoggingProvider.h>
+
+/* defined and registered in fncs.cpp */
+TRACELOGGING_DECLARE_PROVIDER(fncs_trace_provider);
+
+#define FNCS_PROBE1(name, a) \
+    TraceLoggingWrite(fncs_trace_provider, #name, \
+            TraceLoggingValue(a, "arg0"))
+#define FNCS_PROBE2(name, a, b) \
+    TraceLoggingWrite(fncs_trace_provider, #name, \
+            TraceLoggingValue(a, "arg0"), TraceLoggingValue(b, "arg1"))
+#define FNCS_PROBE3(name, a, b, c) \
+    TraceLoggingWrite(fncs_trace_provider, #name, \
+            TraceLoggingValue(a, "arg0"), TraceLoggingValue(b, "arg1"), \
+            TraceLoggingValue(c, "arg2"))
+
+#else
+
+#define FNCS_PROBE1(name, a) do {} while (0)
+#define FNCS_PROBE2(name, a, b) do {} while (0)
+#define FNCS_PROBE3(name, a, b, c) do {} while (0)
+
+#endif
+
+#endif /* _PROBES_HPP_ */
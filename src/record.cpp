@@ -0,0 +1,483 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* 3rd party headers */
+#include "czmq.h"
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+
+using namespace ::std;
+
+/* the tag, the field count, then a table entry per field */
+static const size_t RECORD_HEADER = 2 + 4;
+static const size_t FIELD_ENTRY = 4 + 4 + 4 + 4;
+
+static void put_u32(string &out, size_t value)
+{
+    for (int i=0; i<4; ++i) {
+        out.append(1, static_cast<char>(value >> (8*i)));
+    }
+}
+
+static void set_u32(string &out, size_t at, size_t value)
+{
+    for (int i=0; i<4; ++i) {
+        out[at+i] = static_cast<char>(value >> (8*i));
+    }
+}
+
+static size_t get_u32(const unsigned char *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16)
+        | (static_cast<size_t>(data[3]) << 24);
+}
+
+static unsigned long long get_u64(const unsigned char *data)
+{
+    unsigned long long value = 0;
+    for (int i=7; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+static string trim(const string &text)
+{
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == string::npos) {
+        return string();
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+static string number_bits(unsigned long long bits)
+{
+    string out(8, '\0');
+    for (int i=0; i<8; ++i) {
+        out[i] = static_cast<char>(bits >> (8*i));
+    }
+    return out;
+}
+
+
+const size_t fncs::Record::npos;
+
+fncs::Record::Record(const void *payload, size_t size)
+    : data(NULL), n_fields(0)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(payload);
+    if (!record_frame(payload, size)) {
+        return;
+    }
+    size_t n = get_u32(bytes + 2);
+    if (n > (size - RECORD_HEADER) / FIELD_ENTRY) {
+        return;
+    }
+    for (size_t i=0; i<n; ++i) {
+        const unsigned char *entry = bytes + RECORD_HEADER + FIELD_ENTRY*i;
+        size_t name = get_u32(entry + 4);
+        size_t value = get_u32(entry + 8);
+        size_t length = get_u32(entry + 12);
+        if (name >= size || !memchr(bytes + name, '\0', size - name) || value > size) {
+            return;
+        }
+        if (FIELD_STRING == entry[0]) {
+            /* and its NUL */
+            if (length >= size - value || bytes[value + length] != '\0') {
+                return;
+            }
+        }
+        else if ((FIELD_DOUBLE != entry[0] && FIELD_INT64 != entry[0])
+                || 8 != length || length > size - value) {
+            return;
+        }
+    }
+    data = bytes;
+    n_fields = n;
+}
+
+
+const unsigned char* fncs::Record::field(size_t index) const
+{
+    return index < n_fields ? data + RECORD_HEADER + FIELD_ENTRY*index : NULL;
+}
+
+
+size_t fncs::Record::find(const char *name) const
+{
+    for (size_t i=0; i<n_fields; ++i) {
+        if (0 == strcmp(this->name(i), name)) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+
+const char* fncs::Record::name(size_t index) const
+{
+    const unsigned char *entry = field(index);
+    return entry ? reinterpret_cast<const char*>(data + get_u32(entry + 4)) : "";
+}
+
+
+fncs::Record::FieldType fncs::Record::type(size_t index) const
+{
+    const unsigned char *entry = field(index);
+    return entry ? static_cast<FieldType>(entry[0]) : FIELD_STRING;
+}
+
+
+double fncs::Record::get_double(size_t index) const
+{
+    const unsigned char *entry = field(index);
+    if (!entry || FIELD_STRING == entry[0]) {
+        return 0.0;
+    }
+    unsigned long long bits = get_u64(data + get_u32(entry + 8));
+    if (FIELD_INT64 == entry[0]) {
+        return double(static_cast<long long>(bits));
+    }
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+long long fncs::Record::get_int64(size_t index) const
+{
+    const unsigned char *entry = field(index);
+    if (!entry || FIELD_STRING == entry[0]) {
+        return 0;
+    }
+    if (FIELD_DOUBLE == entry[0]) {
+        return static_cast<long long>(get_double(index));
+    }
+    return static_cast<long long>(get_u64(data + get_u32(entry + 8)));
+}
+
+
+const char* fncs::Record::get_string(size_t index, size_t *size) const
+{
+    const unsigned char *entry = field(index);
+    if (!entry || FIELD_STRING != entry[0]) {
+        if (size) {
+            *size = 0;
+        }
+        return "";
+    }
+    if (size) {
+        *size = get_u32(entry + 12);
+    }
+    return reinterpret_cast<const char*>(data + get_u32(entry + 8));
+}
+
+
+fncs::RecordBuilder& fncs::RecordBuilder::add_double(const string &name, double value)
+{
+    unsigned long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    names.push_back(name);
+    types.append(1, static_cast<char>(Record::FIELD_DOUBLE));
+    values.push_back(number_bits(bits));
+    return *this;
+}
+
+
+fncs::RecordBuilder& fncs::RecordBuilder::add_int64(const string &name, long long value)
+{
+    names.push_back(name);
+    types.append(1, static_cast<char>(Record::FIELD_INT64));
+    values.push_back(number_bits(static_cast<unsigned long long>(value)));
+    return *this;
+}
+
+
+fncs::RecordBuilder& fncs::RecordBuilder::add_string(const string &name, const string &value)
+{
+    names.push_back(name);
+    types.append(1, static_cast<char>(Record::FIELD_STRING));
+    values.push_back(value);
+    return *this;
+}
+
+
+void fncs::RecordBuilder::clear()
+{
+    names.clear();
+    types.clear();
+    values.clear();
+}
+
+
+void fncs::RecordBuilder::encode(string &payload) const
+{
+    size_t n = names.size();
+    payload.assign(1, '\0');
+    payload.append(1, static_cast<char>(VALUE_RECORD));
+    put_u32(payload, n);
+    payload.append(FIELD_ENTRY * n, '\0');
+    for (size_t i=0; i<n; ++i) {
+        size_t entry = RECORD_HEADER + FIELD_ENTRY*i;
+        payload[entry] = types[i];
+        set_u32(payload, entry + 4, payload.size());
+        payload.append(names[i].c_str(), names[i].size() + 1);
+        set_u32(payload, entry + 8, payload.size());
+        set_u32(payload, entry + 12, values[i].size());
+        payload.append(values[i]);
+        if (Record::FIELD_STRING == types[i]) {
+            payload.append(1, '\0');
+        }
+    }
+}
+
+
+static void write_json_string(ostream &out, const char *value, size_t size)
+{
+    out << '"';
+    for (size_t i=0; i<size; ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+
+string fncs::format_record(const void *data, size_t size)
+{
+    Record record(data, size);
+    ostringstream json;
+    json.precision(17);
+    json << '{';
+    for (size_t i=0; i<record.size(); ++i) {
+        const char *name = record.name(i);
+        json << (i ? "," : "");
+        write_json_string(json, name, strlen(name));
+        json << ':';
+        switch (record.type(i)) {
+            case Record::FIELD_DOUBLE:
+                json << record.get_double(i);
+                break;
+            case Record::FIELD_INT64:
+                json << record.get_int64(i);
+                break;
+            default: {
+                size_t length = 0;
+                const char *value = record.get_string(i, &length);
+                write_json_string(json, value, length);
+                break;
+            }
+        }
+    }
+    json << '}';
+    return json.str();
+}
+
+
+bool fncs::parse_record_type(const string &type,
+        vector<pair<string,Record::FieldType> > &fields)
+{
+    const string prefix("record{");
+    fields.clear();
+    if (type.compare(0, prefix.size(), prefix) != 0 || type[type.size()-1] != '}') {
+        return false;
+    }
+    string spec = type.substr(prefix.size(), type.size() - prefix.size() - 1);
+    istringstream iss(spec);
+    string item;
+    while (getline(iss, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == string::npos) {
+            return false;
+        }
+        string name = trim(item.substr(0, colon));
+        string kind = trim(item.substr(colon + 1));
+        Record::FieldType field_type;
+        if (kind == "double") {
+            field_type = Record::FIELD_DOUBLE;
+        }
+        else if (kind == "int64") {
+            field_type = Record::FIELD_INT64;
+        }
+        else if (kind == "string") {
+            field_type = Record::FIELD_STRING;
+        }
+        else {
+            return false;
+        }
+        if (name.empty()) {
+            return false;
+        }
+        fields.push_back(make_pair(name, field_type));
+    }
+    return !fields.empty();
+}
+
+
+/* the position after the JSON string starting at text[at], a quote,
+ * with its unescaped characters in out; npos if it does not end */
+static size_t scan_json_string(const string &text, size_t at, string &out)
+{
+    out.clear();
+    for (++at; at < text.size() && text[at] != '"'; ++at) {
+        if (text[at] == '\\' && at+1 < text.size()) {
+            char c = text[++at];
+            out += c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c;
+        }
+        else {
+            out += text[at];
+        }
+    }
+    return at < text.size() ? at + 1 : string::npos;
+}
+
+/* the position after the JSON value other than a string starting at
+ * text[at], a nested object or array skipped whole, brackets in its
+ * strings included; npos if it is empty or its brackets do not match */
+static size_t scan_json_value(const string &text, size_t at)
+{
+    string open; /* the closing brackets expected, innermost last */
+    string skipped;
+    size_t begin = at;
+    while (at < text.size()) {
+        char c = text[at];
+        if (c == '"' && !open.empty()) {
+            at = scan_json_string(text, at, skipped);
+            if (at == string::npos) {
+                return string::npos;
+            }
+            continue;
+        }
+        if (open.empty() && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+            break;
+        }
+        if (c == '{' || c == '[') {
+            open += c == '{' ? '}' : ']';
+        }
+        else if (c == '}' || c == ']' || c == ',') {
+            if (open.empty()) {
+                break;
+            }
+            if (c != ',' && c != open[open.size()-1]) {
+                return string::npos;
+            }
+            if (c != ',') {
+                open.erase(open.size()-1);
+            }
+        }
+        else if (c == '"') {
+            return string::npos;
+        }
+        ++at;
+    }
+    return open.empty() && at > begin ? at : string::npos;
+}
+
+
+bool fncs::record_from_json(const string &text,
+        const vector<pair<string,Record::FieldType> > &fields, string &payload)
+{
+    static const char *space = " \t\r\n";
+    size_t at = text.find_first_not_of(space);
+    if (at == string::npos || text[at] != '{') {
+        return false;
+    }
+    /* the values of the members of the top level object, by name; a
+     * nested object or array as its JSON text */
+    vector<pair<string,string> > members;
+    string name;
+    string value;
+    at = text.find_first_not_of(space, at + 1);
+    bool more = at == string::npos || text[at] != '}';
+    while (more) {
+        if (at == string::npos || text[at] != '"') {
+            return false;
+        }
+        at = scan_json_string(text, at, name);
+        at = text.find_first_not_of(space, at);
+        if (at == string::npos || text[at] != ':') {
+            return false;
+        }
+        at = text.find_first_not_of(space, at + 1);
+        if (at == string::npos) {
+            return false;
+        }
+        if (text[at] == '"') {
+            at = scan_json_string(text, at, value);
+        }
+        else {
+            size_t end = scan_json_value(text, at);
+            if (end != string::npos) {
+                value = trim(text.substr(at, end - at));
+            }
+            at = end;
+        }
+        members.push_back(make_pair(name, value));
+        at = text.find_first_not_of(space, at);
+        if (at == string::npos) {
+            return false;
+        }
+        if (text[at] == '}') {
+            more = false;
+        }
+        else if (text[at] == ',') {
+            at = text.find_first_not_of(space, at + 1);
+        }
+        else {
+            return false;
+        }
+    }
+    /* at is on the closing brace */
+    if (text.find_first_not_of(space, at + 1) != string::npos) {
+        return false;
+    }
+
+    RecordBuilder builder;
+    TypedValue number;
+    for (size_t i=0; i<fields.size(); ++i) {
+        string member;
+        for (size_t j=0; j<members.size(); ++j) {
+            if (members[j].first == fields[i].first) {
+                member = members[j].second;
+                break;
+            }
+        }
+        switch (fields[i].second) {
+            case Record::FIELD_DOUBLE:
+                parse_typed(member, number);
+                builder.add_double(fields[i].first, number.real);
+                break;
+            case Record::FIELD_INT64:
+                parse_typed(member, number);
+                builder.add_int64(fields[i].first, number.integer);
+                break;
+            default:
+                builder.add_string(fields[i].first, member);
+                break;
+        }
+    }
+    builder.encode(payload);
+    return true;
+}
@@ -0,0 +1,181 @@
+#ifndef _TOPIC_FILTER_HPP_
+#define _TOPIC_FILTER_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "fncs_internal.hpp"
+#include "topic_router.hpp"
+#include "topic_table.hpp"
+
+namespace fncs {
+
+    /** Every topic some sim subscribes to, which the broker packs into
+     * the ACK so that a sim drops the values of publish_anon() and
+     * route() that nobody would be sent, see fncs::SUBSCRIBED. The exact
+     * topics go as they are up to a limit, past which they go as a Bloom
+     * filter of about 1% false positives; those are still sent and then
+     * dropped by the broker. The patterns always go as they are.
+     *
+     * Packed, it is a byte, 'E' or 'B', the number of patterns and the
+     * patterns, then the exact topics up to the end or, for a Bloom
+     * filter, a byte of the number of hashes and the bits up to the
+     * end. Numbers and lengths take four bytes, least significant first,
+     * as in a manifest. */
+    class TopicFilter {
+        public:
+            TopicFilter() : patterns(), exact(), bits(), n_hashes(0), matched() {}
+
+            /** Pack the topics and patterns, the topics as a Bloom filter
+             * if there are more than max_exact of them. */
+            static std::string pack(const std::vector<std::string> &topics,
+                    const std::vector<std::string> &patterns, size_t max_exact) {
+                std::string packed(1, topics.size() > max_exact ? 'B' : 'E');
+                put(packed, patterns.size());
+                for (size_t i=0; i<patterns.size(); ++i) {
+                    put(packed, patterns[i].size());
+                    packed += patterns[i];
+                }
+                if ('E' == packed[0]) {
+                    for (size_t i=0; i<topics.size(); ++i) {
+                        put(packed, topics[i].size());
+                        packed += topics[i];
+                    }
+                    return packed;
+                }
+                /* ten bits a topic and seven hashes */
+                std::vector<unsigned char> filter((topics.size()*10 + 7) / 8, 0);
+                size_t n_bits = filter.size() * 8;
+                for (size_t i=0; i<topics.size(); ++i) {
+                    unsigned long h1 = 0, h2 = 0;
+                    hash(topics[i].data(), topics[i].size(), h1, h2);
+                    for (unsigned long k=0; k<7; ++k) {
+                        size_t bit = ((h1 + k*h2) & 0xffffffffUL) % n_bits;
+                        filter[bit/8] |= static_cast<unsigned char>(1 << (bit%8));
+                    }
+                }
+                packed.append(1, static_cast<char>(7));
+                packed.append(filter.begin(), filter.end());
+                return packed;
+            }
+
+            /** Unpack what pack() made; false if it is malformed. */
+            bool unpack(const void *data, size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char*>(data);
+                size_t offset = 1;
+                size_t n_patterns = 0;
+                std::string topic;
+
+                *this = TopicFilter();
+                if (size < 1 || (bytes[0] != 'E' && bytes[0] != 'B')
+                        || !get(bytes, size, offset, n_patterns)) {
+                    return false;
+                }
+                for (size_t i=0; i<n_patterns; ++i) {
+                    if (!get(bytes, size, offset, topic)) {
+                        return false;
+                    }
+                    patterns.add(topic, 0);
+                }
+                if ('B' == bytes[0]) {
+                    if (offset >= size) {
+                        return false;
+                    }
+                    n_hashes = bytes[offset++];
+                    bits.assign(bytes + offset, bytes + size);
+                    return true;
+                }
+                while (offset < size) {
+                    if (!get(bytes, size, offset, topic)) {
+                        return false;
+                    }
+                    exact.insert(topic, 0, false);
+                }
+                return true;
+            }
+
+            /** Whether some sim may subscribe to the topic. */
+            bool may_match(const std::string &topic) const {
+                if (exact.find(topic)) {
+                    return true;
+                }
+                if (!bits.empty()) {
+                    unsigned long h1 = 0, h2 = 0;
+                    size_t n_bits = bits.size() * 8;
+                    size_t k = 0;
+                    hash(topic.data(), topic.size(), h1, h2);
+                    for (; k<n_hashes; ++k) {
+                        size_t bit = ((h1 + k*h2) & 0xffffffffUL) % n_bits;
+                        if (!(bits[bit/8] & (1 << (bit%8)))) {
+                            break;
+                        }
+                    }
+                    if (k == n_hashes) {
+                        return true;
+                    }
+                }
+                if (patterns.empty()) {
+                    return false;
+                }
+                patterns.match(topic, matched);
+                return !matched.empty();
+            }
+
+        private:
+            /* FNV-1a, and a second hash mixed from it, both of 32 bits
+             * so that every platform sets the same bits */
+            static void hash(const char *data, size_t size,
+                    unsigned long &h1, unsigned long &h2) {
+                unsigned long value = 2166136261UL;
+                for (size_t i=0; i<size; ++i) {
+                    value ^= static_cast<unsigned char>(data[i]);
+                    value = (value * 16777619UL) & 0xffffffffUL;
+                }
+                h1 = value;
+                value ^= value >> 16;
+                value = (value * 0x85ebca6bUL) & 0xffffffffUL;
+                value ^= value >> 13;
+                h2 = value | 1;
+            }
+
+            static void put(std::string &packed, size_t value) {
+                for (int i=0; i<4; ++i) {
+                    packed.append(1, static_cast<char>((value >> (8*i)) & 0xff));
+                }
+            }
+
+            static bool get(const unsigned char *bytes, size_t size,
+                    size_t &offset, size_t &value) {
+                if (size - offset < 4) {
+                    return false;
+                }
+                value = 0;
+                for (int i=3; i>=0; --i) {
+                    value = (value << 8) | bytes[offset+i];
+                }
+                offset += 4;
+                return true;
+            }
+
+            static bool get(const unsigned char *bytes, size_t size,
+                    size_t &offset, std::string &value) {
+                size_t length = 0;
+                if (!get(bytes, size, offset, length) || size - offset < length) {
+                    return false;
+                }
+                value.assign(reinterpret_cast<const char*>(bytes + offset), length);
+                offset += length;
+                return true;
+            }
+
+            TopicRouter patterns;
+            TopicTable exact;
+            std::vector<unsigned char> bits; /* of the Bloom filter, if any */
+            size_t n_hashes;
+            mutable std::vector<size_t> matched; /* scratch for patterns */
+    };
+
+}
+
+#endif /* _TOPIC_FILTER_HPP_ */
@@ -0,0 +1,120 @@
+#ifndef _TOPIC_INTERN_HPP_
+#define _TOPIC_INTERN_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fncs {
+
+    /** Every topic, or key, of the broker stored once, its characters
+     * back to back in one arena, and numbered in the order they were
+     * added. The per-sim and routing structures keep these IDs instead
+     * of their own copies of the strings. Lookups take the name as bytes
+     * and a size, straight from a zmq frame, so they allocate nothing. */
+    class TopicIntern {
+        public:
+            TopicIntern() : arena(), spans(), slots() {}
+
+            static size_t npos() { return static_cast<size_t>(-1); }
+
+            /** The ID of the topic, which is added if it is new. */
+            size_t intern(const char *data, size_t size) {
+                if (2*(spans.size()+1) > slots.size()) {
+                    grow();
+                }
+                size_t &slot = probe(data, size);
+                if (!slot) {
+                    spans.push_back(std::make_pair(arena.size(), size));
+                    arena.insert(arena.end(), data, data+size);
+                    slot = spans.size();
+                }
+                return slot - 1;
+            }
+
+            size_t intern(const std::string &topic) {
+                return intern(topic.data(), topic.size());
+            }
+
+            /** The ID of the topic, or npos() if it was never added. */
+            size_t find(const char *data, size_t size) const {
+                if (slots.empty()) {
+                    return npos();
+                }
+                size_t slot = const_cast<TopicIntern*>(this)->probe(data, size);
+                return slot ? slot - 1 : npos();
+            }
+
+            size_t find(const std::string &topic) const {
+                return find(topic.data(), topic.size());
+            }
+
+            /** The characters of the topic, valid until the next intern(). */
+            const char* data(size_t id) const {
+                return spans[id].second ? &arena[spans[id].first] : "";
+            }
+
+            size_t length(size_t id) const { return spans[id].second; }
+
+            std::string str(size_t id) const {
+                return std::string(data(id), length(id));
+            }
+
+            size_t size() const { return spans.size(); }
+
+            /** Bytes held by the arena and the tables. */
+            size_t bytes() const {
+                return arena.capacity() + spans.capacity() * sizeof(spans[0])
+                    + slots.capacity() * sizeof(slots[0]);
+            }
+
+            void clear() {
+                arena.clear();
+                spans.clear();
+                slots.clear();
+            }
+
+        private:
+            /* FNV-1a */
+            static size_t hash(const char *data, size_t size) {
+                size_t value = 2166136261U;
+                for (size_t i=0; i<size; ++i) {
+                    value ^= static_cast<unsigned char>(data[i]);
+                    value *= 16777619U;
+                }
+                return value;
+            }
+
+            /* the slot holding the topic's ID plus one, else the empty
+             * one ending its probe sequence; the table is at most half
+             * full */
+            size_t& probe(const char *bytes, size_t size) {
+                size_t mask = slots.size() - 1;
+                size_t i = hash(bytes, size) & mask;
+                while (slots[i]) {
+                    size_t id = slots[i] - 1;
+                    if (length(id) == size && 0 == memcmp(data(id), bytes, size)) {
+                        break;
+                    }
+                    i = (i+1) & mask;
+                }
+                return slots[i];
+            }
+
+            void grow() {
+                slots.assign(slots.empty() ? 16 : 2*slots.size(), 0);
+                for (size_t id=0; id<spans.size(); ++id) {
+                    probe(data(id), length(id)) = id + 1;
+                }
+            }
+
+            std::vector<char> arena; /* the characters of every topic */
+            std::vector<std::pair<size_t,size_t> > spans; /* offset and size, by ID */
+            std::vector<size_t> slots; /* ID plus one, 0 if empty; a power of two */
+    };
+
+}
+
+#endif /* _TOPIC_INTERN_HPP_ */
@@ -0,0 +1,134 @@
+#ifndef _TOPIC_ROUTER_HPP_
+#define _TOPIC_ROUTER_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fncs_internal.hpp"
+
+namespace fncs {
+
+    /** The pattern subscriptions of the broker, e.g. 'feeder1/x*' or
+     * 'feeder?/voltage', filed in a compressed trie under the literal
+     * prefix of each pattern, the part before its first '*' or '?'. A
+     * topic walks the trie along its own characters, so only patterns
+     * whose prefix it starts with are matched with glob_match(). */
+    class TopicRouter {
+        public:
+            TopicRouter() : nodes(1), patterns(), pattern_ids() {}
+
+            bool empty() const { return patterns.empty(); }
+
+            /** The number of patterns, and each in the order added. */
+            size_t size() const { return patterns.size(); }
+
+            const std::string& pattern(size_t i) const { return patterns[i].first; }
+
+            /** Subscribe the simulator index to the pattern. */
+            void add(const std::string &pattern, size_t index) {
+                std::map<std::string,size_t>::iterator it = pattern_ids.find(pattern);
+                if (it == pattern_ids.end()) {
+                    it = pattern_ids.insert(std::make_pair(pattern, patterns.size())).first;
+                    patterns.push_back(std::make_pair(pattern, std::vector<size_t>()));
+                    size_t node = insert(pattern.substr(0, pattern.find_first_of("*?")));
+                    nodes[node].patterns.push_back(it->second);
+                }
+                std::vector<size_t> &indexes = patterns[it->second].second;
+                if (std::find(indexes.begin(), indexes.end(), index) == indexes.end()) {
+                    indexes.push_back(index);
+                }
+            }
+
+            /** The indexes subscribed to a pattern matching the topic,
+             * ascending and each once. */
+            void match(const std::string &topic, std::vector<size_t> &out) const {
+                size_t node = 0;
+                size_t pos = 0;
+                out.clear();
+                while (true) {
+                    const std::vector<size_t> &here = nodes[node].patterns;
+                    for (size_t i=0; i<here.size(); ++i) {
+                        const std::pair<std::string,std::vector<size_t> > &p = patterns[here[i]];
+                        if (glob_match(p.first, topic)) {
+                            out.insert(out.end(), p.second.begin(), p.second.end());
+                        }
+                    }
+                    size_t next = pos < topic.size() ? child(node, topic[pos]) : npos();
+                    if (next == npos() || 0 != topic.compare(
+                                pos, nodes[next].label.size(), nodes[next].label)) {
+                        break;
+                    }
+                    pos += nodes[next].label.size();
+                    node = next;
+                }
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+            }
+
+        private:
+            struct Node {
+                Node() : label(), children(), patterns() {}
+
+                std::string label; /* characters from the parent, never empty */
+                std::vector<size_t> children; /* their labels start differently */
+                std::vector<size_t> patterns; /* whose prefix ends here */
+            };
+
+            static size_t npos() { return static_cast<size_t>(-1); }
+
+            /* the child of the node whose label starts with c */
+            size_t child(size_t node, char c) const {
+                const std::vector<size_t> &children = nodes[node].children;
+                for (size_t i=0; i<children.size(); ++i) {
+                    if (nodes[children[i]].label[0] == c) {
+                        return children[i];
+                    }
+                }
+                return npos();
+            }
+
+            /* the node of the prefix, splitting a label that ends past it */
+            size_t insert(const std::string &prefix) {
+                size_t node = 0;
+                size_t pos = 0;
+                while (pos < prefix.size()) {
+                    size_t next = child(node, prefix[pos]);
+                    if (next == npos()) {
+                        nodes.push_back(Node());
+                        nodes.back().label = prefix.substr(pos);
+                        nodes[node].children.push_back(nodes.size() - 1);
+                        return nodes.size() - 1;
+                    }
+                    const std::string &label = nodes[next].label;
+                    size_t common = 0;
+                    while (common < label.size() && pos + common < prefix.size()
+                            && label[common] == prefix[pos + common]) {
+                        ++common;
+                    }
+                    if (common < label.size()) {
+                        Node tail;
+                        tail.label = label.substr(common);
+                        tail.children.swap(nodes[next].children);
+                        tail.patterns.swap(nodes[next].patterns);
+                        nodes[next].label.erase(common);
+                        nodes.push_back(tail);
+                        nodes[next].children.push_back(nodes.size() - 1);
+                    }
+                    pos += common;
+                    node = next;
+                }
+                return node;
+            }
+
+            std::vector<Node> nodes; /* the root first, with an empty label */
+            std::vector<std::pair<std::string,std::vector<size_t> > > patterns;
+            std::map<std::string,size_t> pattern_ids; /* pattern to its position */
+    };
+
+}
+
+#endif /* _TOPIC_ROUTER_HPP_ */
@@ -0,0 +1,92 @@
+#ifndef _TOPIC_TABLE_HPP_
+#define _TOPIC_TABLE_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "topic_intern.hpp"
+
+namespace fncs {
+
+    /** Table from a subscribed topic, or a key, to its cache slot,
+     * built at initialize(). The topics are numbered by a TopicIntern,
+     * whose IDs index the entries. Lookups take the name as bytes and a
+     * size, straight from a zmq frame or a C string, so they allocate
+     * nothing. Only fncs::subscribe() adds to it later, which the client
+     * I/O thread rules out, so that thread may read it without locking. */
+    class TopicTable {
+        public:
+            struct Entry {
+                Entry() : topic(), slot(0), is_list(false), used(false) {}
+
+                std::string topic;
+                size_t slot; /* index in the client cache */
+                bool is_list;
+                bool used;
+            };
+
+            TopicTable() : names(), entries(), ids() {}
+
+            /** Add a topic; the first subscription of a topic wins. */
+            void insert(const std::string &topic, size_t slot, bool is_list) {
+                size_t index = names.intern(topic);
+                if (index < entries.size()) {
+                    return;
+                }
+                entries.push_back(Entry());
+                Entry &entry = entries.back();
+                entry.topic = topic;
+                entry.slot = slot;
+                entry.is_list = is_list;
+                entry.used = true;
+            }
+
+            /** The entry of the topic, or NULL when nobody subscribed. */
+            const Entry* find(const char *data, size_t size) const {
+                size_t index = names.find(data, size);
+                return index == TopicIntern::npos() ? NULL : &entries[index];
+            }
+
+            const Entry* find(const std::string &topic) const {
+                return find(topic.data(), topic.size());
+            }
+
+            size_t size() const { return entries.size(); }
+
+            /** Also find the topic by the ID the broker gave it, see
+             * fncs::TOPIC_IDS. */
+            void set_id(size_t id, const std::string &topic) {
+                size_t index = names.find(topic);
+                if (index == TopicIntern::npos()) {
+                    return;
+                }
+                if (id >= ids.size()) {
+                    ids.resize(id+1, 0);
+                }
+                ids[id] = index + 1;
+            }
+
+            /** The entry of the topic ID, or NULL if it was not set. */
+            const Entry* find_id(size_t id) const {
+                if (id >= ids.size() || !ids[id]) {
+                    return NULL;
+                }
+                return &entries[ids[id]-1];
+            }
+
+            void clear() {
+                names.clear();
+                entries.clear();
+                ids.clear();
+            }
+
+        private:
+            TopicIntern names; /* numbers the topics */
+            std::vector<Entry> entries; /* by the topic's number */
+            std::vector<size_t> ids; /* entry index + 1 by topic ID, 0 if unset */
+    };
+
+}
+
+#endif /* _TOPIC_TABLE_HPP_ */
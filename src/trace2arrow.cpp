@@ -0,0 +1,523 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "trace_writer.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_trace2arrow [--rows <n>] [--from <time>] [--to <time>]"
+    " [--topic <glob>]... <binary trace> <output file>";
+
+/* Arrow's metadata version V5 and the members of its unions used here */
+static const unsigned METADATA_V5 = 4;
+static const unsigned HEADER_SCHEMA = 1;
+static const unsigned HEADER_RECORD_BATCH = 3;
+static const unsigned TYPE_INT = 2;
+static const unsigned TYPE_FLOAT = 3;
+static const unsigned TYPE_UTF8 = 5;
+static const unsigned PRECISION_DOUBLE = 2;
+
+/* a batch holds no more string bytes than its i32 offsets address */
+static const size_t MAX_BATCH_BYTES = 1UL << 30;
+
+/* the columns, each not nullable but number */
+static const char * const COLUMNS[] = { "time", "topic", "value", "number" };
+static const size_t N_COLUMNS = 4;
+static const size_t N_BUFFERS = 2 + 3 + 3 + 2;
+
+
+/* One field of a flatbuffer table: absent, a scalar of the given size or
+ * a reference to a table, vector or string placed after it. */
+class Slot {
+    public:
+        Slot() : size(0), value(0), ref(false) {}
+        Slot(size_t size, unsigned long long value) : size(size), value(value), ref(false) {}
+
+        static Slot reference() { Slot slot(4, 0); slot.ref = true; return slot; }
+
+        size_t size;
+        unsigned long long value;
+        bool ref;
+};
+
+/* A flatbuffer laid out front to back: a table, vector or string is
+ * appended whole and then the ones it refers to, whose offsets are
+ * patched in once they are placed, as offsets only point forward. */
+class FlatBuffer {
+    public:
+        FlatBuffer() : out() {
+            out.append(4, '\0'); /* the offset of the root table */
+        }
+
+        size_t align(size_t n) {
+            while (out.size() % n) {
+                out.append(1, '\0');
+            }
+            return out.size();
+        }
+
+        void put(size_t at, unsigned long long value, size_t size) {
+            for (size_t i=0; i<size; ++i) {
+                out[at+i] = static_cast<char>(value >> (8*i));
+            }
+        }
+
+        void patch(size_t slot, size_t target) {
+            put(slot, target - slot, 4);
+        }
+
+        /* The table of the given fields by index; refs receives the
+         * positions of the reference slots, in order. */
+        size_t table(const vector<Slot> &slots, vector<size_t> &refs) {
+            vector<size_t> offsets(slots.size(), 0);
+            size_t inline_size = 4; /* the offset to the vtable */
+            /* widest first, at their alignment from an aligned table */
+            for (size_t size=8; size>0; size/=2) {
+                for (size_t i=0; i<slots.size(); ++i) {
+                    if (slots[i].size == size) {
+                        inline_size = (inline_size + size - 1) / size * size;
+                        offsets[i] = inline_size;
+                        inline_size += size;
+                    }
+                }
+            }
+            inline_size = (inline_size + 3) / 4 * 4;
+            size_t vtable = align(2);
+            out.append(4 + 2*slots.size(), '\0');
+            put(vtable, 4 + 2*slots.size(), 2);
+            put(vtable + 2, inline_size, 2);
+            for (size_t i=0; i<slots.size(); ++i) {
+                put(vtable + 4 + 2*i, offsets[i], 2);
+            }
+            size_t table = align(8);
+            out.append(inline_size, '\0');
+            put(table, table - vtable, 4);
+            refs.clear();
+            for (size_t i=0; i<slots.size(); ++i) {
+                if (slots[i].ref) {
+                    refs.push_back(table + offsets[i]);
+                }
+                else if (slots[i].size) {
+                    put(table + offsets[i], slots[i].value, slots[i].size);
+                }
+            }
+            return table;
+        }
+
+        /* A vector of count references, the slot of element i 4*i
+         * after the first. */
+        size_t references(size_t count) {
+            size_t at = align(4);
+            out.append(4 + 4*count, '\0');
+            put(at, count, 4);
+            return at;
+        }
+
+        /* A vector of count structs of 8 byte aligned fields. */
+        size_t structs(const string &data, size_t count) {
+            while ((out.size() + 4) % 8) {
+                out.append(1, '\0');
+            }
+            size_t at = out.size();
+            out.append(4, '\0');
+            put(at, count, 4);
+            out.append(data);
+            return at;
+        }
+
+        size_t text(const string &value) {
+            size_t at = align(4);
+            out.append(4, '\0');
+            put(at, value.size(), 4);
+            out.append(value.c_str(), value.size() + 1);
+            return at;
+        }
+
+        void root(size_t table) {
+            patch(0, table);
+            align(8);
+        }
+
+        string out;
+};
+
+static void append_u64(string &out, unsigned long long value)
+{
+    for (int i=0; i<8; ++i) {
+        out.append(1, static_cast<char>(value >> (8*i)));
+    }
+}
+
+static void append_u32(string &out, unsigned long value)
+{
+    for (int i=0; i<4; ++i) {
+        out.append(1, static_cast<char>(value >> (8*i)));
+    }
+}
+
+/* The schema of the columns, as the table of a message or the footer. */
+static size_t put_schema(FlatBuffer &fb)
+{
+    vector<Slot> slots(2);
+    vector<size_t> refs;
+    slots[1] = Slot::reference(); /* fields; endianness is little */
+    size_t schema = fb.table(slots, refs);
+    size_t fields = fb.references(N_COLUMNS);
+    fb.patch(refs[0], fields);
+    for (size_t c=0; c<N_COLUMNS; ++c) {
+        unsigned type = 0 == c ? TYPE_INT : 3 == c ? TYPE_FLOAT : TYPE_UTF8;
+        vector<size_t> field_refs;
+        slots.assign(6, Slot());
+        slots[0] = Slot::reference(); /* name */
+        slots[1] = Slot(1, 3 == c); /* nullable */
+        slots[2] = Slot(1, type);
+        slots[3] = Slot::reference(); /* type */
+        slots[5] = Slot::reference(); /* children, none but required */
+        fb.patch(fields + 4 + 4*c, fb.table(slots, field_refs));
+        fb.patch(field_refs[0], fb.text(COLUMNS[c]));
+        vector<size_t> none;
+        if (TYPE_INT == type) {
+            slots.assign(2, Slot());
+            slots[0] = Slot(4, 64); /* bitWidth */
+            slots[1] = Slot(1, 1); /* is_signed */
+        }
+        else if (TYPE_FLOAT == type) {
+            slots.assign(1, Slot(2, PRECISION_DOUBLE));
+        }
+        else {
+            slots.clear();
+        }
+        fb.patch(field_refs[1], fb.table(slots, none));
+        fb.patch(field_refs[2], fb.references(0));
+    }
+    return schema;
+}
+
+/* A Message of the given header, which put_header() writes; it returns
+ * the header's table. */
+template <typename Header>
+static string message(unsigned header_type, size_t body_length, Header put_header)
+{
+    FlatBuffer fb;
+    vector<Slot> slots(4);
+    vector<size_t> refs;
+    slots[0] = Slot(2, METADATA_V5);
+    slots[1] = Slot(1, header_type);
+    slots[2] = Slot::reference();
+    slots[3] = Slot(8, body_length);
+    size_t table = fb.table(slots, refs);
+    fb.patch(refs[0], put_header(fb));
+    fb.root(table);
+    return fb.out;
+}
+
+/* The rows of one record batch, column by column. */
+class Batch {
+    public:
+        Batch() : times(), topic_offsets(), topics(), value_offsets(), values(),
+            valid(), numbers(), n_rows(0), n_null(0) {
+            clear();
+        }
+
+        void clear() {
+            times.clear();
+            topic_offsets.clear();
+            topics.clear();
+            value_offsets.clear();
+            values.clear();
+            valid.clear();
+            numbers.clear();
+            append_u32(topic_offsets, 0);
+            append_u32(value_offsets, 0);
+            n_rows = 0;
+            n_null = 0;
+        }
+
+        void add(fncs::time time, const string &topic, const string &value) {
+            fncs::TypedValue typed;
+            bool number = false;
+            if (fncs::decode_typed(value.data(), value.size(), typed)) {
+                number = fncs::VALUE_DOUBLE == typed.type || fncs::VALUE_INT64 == typed.type;
+            }
+            else if (!value.empty() && value[0] != '\0') {
+                /* a string is a number only if it is all one */
+                const char *begin = value.c_str();
+                char *end = NULL;
+                errno = 0;
+                typed.real = strtod(begin, &end);
+                number = end == begin + value.size() && 0 == errno;
+            }
+            string text = fncs::value_to_string(value.data(), value.size());
+
+            append_u64(times, time);
+            topics.append(topic);
+            append_u32(topic_offsets, topics.size());
+            values.append(text);
+            append_u32(value_offsets, values.size());
+            if (n_rows % 8 == 0) {
+                valid.append(1, '\0');
+            }
+            if (number) {
+                unsigned long long bits = 0;
+                double real = typed.as_double();
+                memcpy(&bits, &real, sizeof(bits));
+                append_u64(numbers, bits);
+                valid[n_rows / 8] |= static_cast<char>(1 << (n_rows % 8));
+            }
+            else {
+                append_u64(numbers, 0);
+                ++n_null;
+            }
+            ++n_rows;
+        }
+
+        size_t bytes() const {
+            return topics.size() + values.size();
+        }
+
+        string times;
+        string topic_offsets;
+        string topics;
+        string value_offsets;
+        string values;
+        string valid; /* of numbers, a bit a row */
+        string numbers;
+        size_t n_rows;
+        size_t n_null;
+};
+
+/* The RecordBatch of a batch whose body has the given buffer layout. */
+class PutRecordBatch {
+    public:
+        PutRecordBatch(const Batch &batch, const string &buffers)
+            : batch(batch), buffers(buffers) {}
+
+        size_t operator()(FlatBuffer &fb) const {
+            vector<Slot> slots(3);
+            vector<size_t> refs;
+            slots[0] = Slot(8, batch.n_rows);
+            slots[1] = Slot::reference();
+            slots[2] = Slot::reference();
+            size_t table = fb.table(slots, refs);
+            string nodes;
+            for (size_t c=0; c<N_COLUMNS; ++c) {
+                append_u64(nodes, batch.n_rows);
+                append_u64(nodes, 3 == c ? batch.n_null : 0);
+            }
+            fb.patch(refs[0], fb.structs(nodes, N_COLUMNS));
+            fb.patch(refs[1], fb.structs(buffers, N_BUFFERS));
+            return table;
+        }
+
+    private:
+        const Batch &batch;
+        const string &buffers;
+};
+
+class PutSchema {
+    public:
+        size_t operator()(FlatBuffer &fb) const {
+            return put_schema(fb);
+        }
+};
+
+/* The Arrow IPC file being written, and the blocks of its batches. */
+class ArrowFile {
+    public:
+        ArrowFile() : out(), offset(0), blocks(), n_batches(0) {}
+
+        bool open(const string &filename) {
+            out.open(filename.c_str(), ios::binary);
+            if (!out) {
+                return false;
+            }
+            write(string("ARROW1\0\0", 8));
+            write_message(message(HEADER_SCHEMA, 0, PutSchema()), string());
+            return true;
+        }
+
+        void write_batch(const Batch &batch) {
+            const string *columns[N_BUFFERS] = {
+                NULL, &batch.times,
+                NULL, &batch.topic_offsets, &batch.topics,
+                NULL, &batch.value_offsets, &batch.values,
+                batch.n_null ? &batch.valid : NULL, &batch.numbers
+            };
+            string buffers;
+            string body;
+            for (size_t i=0; i<N_BUFFERS; ++i) {
+                /* a column without nulls needs no validity bitmap */
+                size_t size = columns[i] ? columns[i]->size() : 0;
+                append_u64(buffers, body.size());
+                append_u64(buffers, size);
+                if (columns[i]) {
+                    body.append(*columns[i]);
+                }
+                body.append((8 - body.size() % 8) % 8, '\0');
+            }
+            string metadata = message(HEADER_RECORD_BATCH, body.size(),
+                    PutRecordBatch(batch, buffers));
+            size_t at = offset;
+            size_t metadata_size = write_message(metadata, body);
+            append_u64(blocks, at);
+            append_u32(blocks, metadata_size);
+            append_u32(blocks, 0);
+            append_u64(blocks, body.size());
+            ++n_batches;
+        }
+
+        /* the end of stream marker, the footer and its size */
+        bool close() {
+            write(string("\xFF\xFF\xFF\xFF\0\0\0\0", 8));
+            FlatBuffer fb;
+            vector<Slot> slots(4);
+            vector<size_t> refs;
+            slots[0] = Slot(2, METADATA_V5);
+            slots[1] = Slot::reference();
+            slots[2] = Slot::reference();
+            slots[3] = Slot::reference();
+            size_t footer = fb.table(slots, refs);
+            fb.patch(refs[0], put_schema(fb));
+            fb.patch(refs[1], fb.structs(string(), 0));
+            fb.patch(refs[2], fb.structs(blocks, n_batches));
+            fb.root(footer);
+            string size;
+            append_u32(size, fb.out.size());
+            write(fb.out + size + "ARROW1");
+            out.close();
+            return !out.fail();
+        }
+
+        size_t batches() const { return n_batches; }
+
+    private:
+        void write(const string &data) {
+            out.write(data.data(), data.size());
+            offset += data.size();
+        }
+
+        /* an encapsulated message: a continuation marker, the size of its
+         * metadata padded to 8 bytes, which is returned with the prefix,
+         * the metadata and the body */
+        size_t write_message(const string &metadata, const string &body) {
+            string prefix("\xFF\xFF\xFF\xFF", 4);
+            size_t padded = (metadata.size() + 7) / 8 * 8;
+            append_u32(prefix, padded);
+            write(prefix + metadata + string(padded - metadata.size(), '\0'));
+            write(body);
+            return prefix.size() + padded;
+        }
+
+        ofstream out;
+        size_t offset;
+        string blocks; /* of each batch, for the footer */
+        size_t n_batches;
+};
+
+
+/* Converts the values of a binary broker trace, or of the tracer's, into
+ * an Arrow IPC file that analytics tools load as a table without parsing
+ * text: a row per value with its time in nanoseconds, its topic, its
+ * value as text and, if it is a number, as a double. A record batch is
+ * cut at the first change of time after the given number of rows, so no
+ * grant's values straddle two batches. */
+int main(int argc, char **argv)
+{
+    size_t rows = 65536;
+    fncs::time from = 0;
+    fncs::time to = static_cast<fncs::time>(-1);
+    vector<string> globs;
+    vector<string> params;
+    fncs::TraceReader reader;
+    fncs::TraceRecord record;
+    ArrowFile file;
+    Batch batch;
+    fncs::time last = 0;
+    unsigned long n_records = 0;
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--rows") && i+1 < argc) {
+            rows = strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "--from") && i+1 < argc) {
+            if (!fncs::try_parse_time(argv[++i], from)) {
+                cerr << "Invalid time '" << argv[i] << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--to") && i+1 < argc) {
+            if (!fncs::try_parse_time(argv[++i], to)) {
+                cerr << "Invalid time '" << argv[i] << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--topic") && i+1 < argc) {
+            globs.push_back(argv[++i]);
+        }
+        else {
+            params.push_back(argv[i]);
+        }
+    }
+
+    if (params.size() != 2 || 0 == rows) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!reader.open(params[0])) {
+        cerr << "'" << params[0] << "' is not a FNCS binary trace." << endl;
+        exit(EXIT_FAILURE);
+    }
+    reader.select(from, to, globs);
+
+    if (!file.open(params[1])) {
+        cerr << "Could not open output file '" << params[1] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    while (reader.next(record)) {
+        /* the messages of FNCS_RECORD are skipped */
+        if (fncs::TRACE_PUBLISH != record.type) {
+            continue;
+        }
+        if (batch.n_rows && ((batch.n_rows >= rows && record.time != last)
+                    || batch.bytes() + record.topic.size() + record.value.size()
+                        > MAX_BATCH_BYTES)) {
+            file.write_batch(batch);
+            batch.clear();
+        }
+        batch.add(record.time, record.topic, record.value);
+        last = record.time;
+        ++n_records;
+    }
+    if (batch.n_rows) {
+        file.write_batch(batch);
+    }
+    if (!file.close()) {
+        cerr << "Could not write output file '" << params[1] << "'." << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (reader.corrupt()) {
+        cerr << "truncated or corrupt trace after "
+            << n_records << " records" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!reader.ended()) {
+        cerr << "trace ended without footer, broker may have died" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "trace_writer.hpp"
+
+using namespace ::std;
+
+/* Converts a binary broker trace back into the tab separated text the
+ * broker writes with FNCS_TRACE_FORMAT=text. */
+int main(int argc, char **argv)
+{
+    fncs::TraceReader reader;
+    fncs::TraceRecord record;
+    ofstream fout;
+    ostream out(cout.rdbuf()); /* share cout's stream buffer */
+    unsigned long n_records = 0;
+
+    if (argc < 2 || argc > 3) {
+        cerr << "Usage: fncs_trace2tsv <binary trace> [output file]" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!reader.open(argv[1])) {
+        cerr << "'" << argv[1] << "' is not a FNCS binary trace." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc == 3) {
+        fout.open(argv[2]);
+        if (!fout) {
+            cerr << "Could not open output file '" << argv[2] << "'." << endl;
+            exit(EXIT_FAILURE);
+        }
+        out.rdbuf(fout.rdbuf()); /* redirect out to use file buffer */
+    }
+
+    out << "#nanoseconds\ttopic\tvalue" << '\n';
+
+    while (reader.next(record)) {
+        /* the messages of FNCS_RECORD are skipped */
+        if (fncs::TRACE_PUBLISH != record.type) {
+            continue;
+        }
+        /* typed values are written as text, as in a text trace */
+        out << record.time << '\t' << record.topic << '\t'
+            << fncs::value_to_string(record.value.data(), record.value.size()) << '\n';
+        ++n_records;
+    }
+    if (reader.corrupt()) {
+        cerr << "truncated or corrupt trace after "
+            << n_records << " records" << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!reader.ended()) {
+        cerr << "trace ended without footer, broker may have died" << endl;
+    }
+
+    return 0;
+}
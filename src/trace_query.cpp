@@ -0,0 +1,101 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* fncs headers */
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "trace_writer.hpp"
+
+using namespace ::std;
+
+static const char *usage =
+    "Usage: fncs_trace_query [--from <time>] [--to <time>] [--topic <glob>]..."
+    " <binary trace> [output file]";
+
+
+/* Prints the values of a binary trace within a time range and of the
+ * topics matching any of the globs, as fncs_trace2tsv does. A trace that
+ * was closed is read through its chunk index, so only the chunks holding
+ * such values are read. */
+int main(int argc, char **argv)
+{
+    fncs::time from = 0;
+    fncs::time to = static_cast<fncs::time>(-1);
+    vector<string> globs;
+    vector<string> params;
+    fncs::TraceReader reader;
+    fncs::TraceRecord record;
+    ofstream fout;
+    ostream out(cout.rdbuf()); /* share cout's stream buffer */
+    unsigned long n_records = 0;
+
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--from") && i+1 < argc) {
+            if (!fncs::try_parse_time(argv[++i], from)) {
+                cerr << "Invalid time '" << argv[i] << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--to") && i+1 < argc) {
+            if (!fncs::try_parse_time(argv[++i], to)) {
+                cerr << "Invalid time '" << argv[i] << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (0 == strcmp(argv[i], "--topic") && i+1 < argc) {
+            globs.push_back(argv[++i]);
+        }
+        else {
+            params.push_back(argv[i]);
+        }
+    }
+
+    if (params.empty() || params.size() > 2) {
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (!reader.open(params[0])) {
+        cerr << "'" << params[0] << "' is not a FNCS binary trace." << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!reader.indexed()) {
+        cerr << "'" << params[0] << "' has no index, scanning all of it" << endl;
+    }
+    reader.select(from, to, globs);
+
+    if (params.size() == 2) {
+        fout.open(params[1].c_str());
+        if (!fout) {
+            cerr << "Could not open output file '" << params[1] << "'." << endl;
+            exit(EXIT_FAILURE);
+        }
+        out.rdbuf(fout.rdbuf()); /* redirect out to use file buffer */
+    }
+
+    out << "#nanoseconds\ttopic\tvalue" << '\n';
+
+    while (reader.next(record)) {
+        if (fncs::TRACE_PUBLISH != record.type) {
+            continue;
+        }
+        out << record.time << '\t' << record.topic << '\t'
+            << fncs::value_to_string(record.value.data(), record.value.size()) << '\n';
+        ++n_records;
+    }
+    if (reader.corrupt()) {
+        cerr << "truncated or corrupt trace after "
+            << n_records << " records" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,746 @@
+/* autoconf header */
+#include "config.h"
+
+/* C++ standard headers */
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* 3rd party headers */
+#include "czmq.h"
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* fncs headers */
+#include "log.hpp"
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "trace_writer.hpp"
+
+using namespace ::std;
+
+/* records are handed to the writer thread once a chunk exceeds this */
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+/* bytes of an index block: type, three times and two sizes */
+static const size_t INDEX_SIZE = 1 + 8 + 8 + 8 + 4 + 4;
+
+/* bytes of the footer: type and two offsets */
+static const size_t FOOTER_SIZE = 1 + 8 + 8;
+
+static void write_u32(FILE *file, unsigned long value)
+{
+    unsigned char data[4];
+    for (int i=0; i<4; ++i) {
+        data[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+    fwrite(data, 1, 4, file);
+}
+
+static void write_u64(FILE *file, fncs::time value)
+{
+    unsigned char data[8];
+    for (int i=0; i<8; ++i) {
+        data[i] = static_cast<unsigned char>(value >> (8*i));
+    }
+    fwrite(data, 1, 8, file);
+}
+
+static bool read_u32(FILE *file, unsigned long &value)
+{
+    unsigned char data[4];
+    if (fread(data, 1, 4, file) != 4) {
+        return false;
+    }
+    value = 0;
+    for (int i=3; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return true;
+}
+
+static bool read_u64(FILE *file, fncs::time &value)
+{
+    unsigned char data[8];
+    if (fread(data, 1, 8, file) != 8) {
+        return false;
+    }
+    value = 0;
+    for (int i=7; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return true;
+}
+
+/* a time sent over the pipe as is */
+static fncs::time frame_time(zframe_t *frame)
+{
+    fncs::time time = 0;
+    if (frame && zframe_size(frame) == sizeof(time)) {
+        memcpy(&time, zframe_data(frame), sizeof(time));
+    }
+    return time;
+}
+
+/* the file the writer thread owns, and how */
+class TraceFile {
+    public:
+        TraceFile(FILE *file, bool compress) : file(file), compress(compress) {}
+
+        FILE *file;
+        bool compress;
+};
+
+/* The writer thread. Each message on the pipe is a chunk of records,
+ * the least and greatest time of them, the IDs of the topics it
+ * publishes and the topics it defines; "$TERM" ends the trace, which
+ * then gets its chunk index, topic names and footer. */
+static void trace_actor(zsock_t *pipe, void *args)
+{
+    TraceFile *trace = static_cast<TraceFile*>(args);
+    FILE *file = trace->file;
+    fncs::time offset = fncs::TRACE_MAGIC_SIZE;
+    fncs::time last_index = 0;
+    string chunks; /* the chunk index, all but its count */
+    unsigned long n_chunks = 0;
+    string names; /* length and name of each topic, by ID */
+    unsigned long n_names = 0;
+    vector<char> packed;
+
+    zsock_signal(pipe, 0);
+
+    while (true) {
+        zmsg_t *msg = zmsg_recv(pipe);
+        if (!msg) {
+            break; /* interrupted */
+        }
+        zframe_t *frame = zmsg_first(msg);
+        if (zframe_streq(frame, "$TERM")) {
+            zmsg_destroy(&msg);
+            break;
+        }
+        fncs::time min_time = frame_time(zmsg_next(msg));
+        fncs::time max_time = frame_time(zmsg_next(msg));
+        zframe_t *ids = zmsg_next(msg);
+        zframe_t *defined = zmsg_next(msg);
+
+        const char *stored = reinterpret_cast<const char*>(zframe_data(frame));
+        size_t raw_size = zframe_size(frame);
+        size_t stored_size = raw_size;
+#ifdef HAVE_ZSTD
+        if (trace->compress) {
+            packed.resize(ZSTD_compressBound(raw_size));
+            size_t size = ZSTD_compress(&packed[0], packed.size(), stored, raw_size, 1);
+            if (!ZSTD_isError(size) && size < raw_size) {
+                stored = &packed[0];
+                stored_size = size;
+            }
+        }
+#endif
+
+        /* index block in front of the chunk */
+        fputc(fncs::TRACE_INDEX, file);
+        write_u64(file, min_time);
+        write_u64(file, max_time);
+        write_u64(file, last_index);
+        write_u32(file, static_cast<unsigned long>(raw_size));
+        write_u32(file, static_cast<unsigned long>(stored_size));
+        fwrite(stored, 1, stored_size, file);
+
+        /* and its entry in the chunk index */
+        for (int i=0; i<8; ++i) {
+            chunks.append(1, static_cast<char>(offset >> (8*i)));
+        }
+        {
+            fncs::time values[2] = { min_time, max_time };
+            for (int v=0; v<2; ++v) {
+                for (int i=0; i<8; ++i) {
+                    chunks.append(1, static_cast<char>(values[v] >> (8*i)));
+                }
+            }
+            unsigned long n_ids = ids ? static_cast<unsigned long>(zframe_size(ids) / 4) : 0;
+            for (int i=0; i<4; ++i) {
+                chunks.append(1, static_cast<char>(n_ids >> (8*i)));
+            }
+            if (n_ids) {
+                chunks.append(reinterpret_cast<const char*>(zframe_data(ids)), 4 * n_ids);
+            }
+        }
+        ++n_chunks;
+        if (defined && zframe_size(defined)) {
+            const unsigned char *bytes = zframe_data(defined);
+            size_t size = zframe_size(defined);
+            for (size_t at=0; at+4 <= size; ++n_names) {
+                unsigned long length = bytes[at] | (bytes[at+1] << 8)
+                    | (bytes[at+2] << 16) | (static_cast<unsigned long>(bytes[at+3]) << 24);
+                at += 4 + length;
+            }
+            names.append(reinterpret_cast<const char*>(bytes), size);
+        }
+
+        last_index = offset;
+        offset += INDEX_SIZE + stored_size;
+        zmsg_destroy(&msg);
+    }
+
+    fputc(fncs::TRACE_CHUNKS, file);
+    write_u32(file, n_chunks);
+    fwrite(chunks.data(), 1, chunks.size(), file);
+    fputc(fncs::TRACE_NAMES, file);
+    write_u32(file, n_names);
+    fwrite(names.data(), 1, names.size(), file);
+    fputc(fncs::TRACE_FOOTER, file);
+    write_u64(file, last_index);
+    write_u64(file, offset);
+    fclose(file);
+    delete trace;
+}
+
+
+fncs::TraceWriter::TraceWriter()
+    : actor(NULL)
+    , chunk()
+    , chunk_min(0)
+    , chunk_max(0)
+    , chunk_timed(false)
+    , chunk_topics()
+    , new_topics()
+    , n_chunks(0)
+    , topic_chunk()
+    , topic_ids()
+{
+}
+
+
+fncs::TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+
+bool fncs::TraceWriter::open(const string &filename, bool compress)
+{
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        LERROR << "Could not open trace file '" << filename << "'";
+        return false;
+    }
+#ifndef HAVE_ZSTD
+    if (compress) {
+        LWARNING << "built without zstd, trace '" << filename << "' is not compressed";
+    }
+#endif
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file);
+    chunk.reserve(CHUNK_SIZE + 1024);
+    TraceFile *trace = new TraceFile(file, compress);
+    actor = zactor_new(trace_actor, trace);
+    if (!actor) {
+        LERROR << "Could not start trace writer thread";
+        delete trace;
+        fclose(file);
+        return false;
+    }
+    return true;
+}
+
+
+void fncs::TraceWriter::publish(
+        fncs::time time,
+        const string &topic,
+        const void *value,
+        size_t size)
+{
+    unsigned long id = 0;
+    HashMap<string,unsigned long>::type::iterator it = topic_ids.find(topic);
+
+    if (!actor) {
+        return;
+    }
+
+    /* intern the topic on first use */
+    if (it == topic_ids.end()) {
+        id = static_cast<unsigned long>(topic_ids.size());
+        topic_ids[topic] = id;
+        topic_chunk.push_back(0);
+        chunk.push_back(TRACE_TOPIC);
+        put_u32(id);
+        put_u32(static_cast<unsigned long>(topic.size()));
+        chunk.insert(chunk.end(), topic.begin(), topic.end());
+        for (int i=0; i<4; ++i) {
+            new_topics.append(1, static_cast<char>(topic.size() >> (8*i)));
+        }
+        new_topics += topic;
+    }
+    else {
+        id = it->second;
+    }
+
+    /* the chunk index lists each topic once per chunk */
+    if (topic_chunk[id] != n_chunks + 1) {
+        topic_chunk[id] = n_chunks + 1;
+        for (int i=0; i<4; ++i) {
+            chunk_topics.append(1, static_cast<char>(id >> (8*i)));
+        }
+    }
+
+    timed(time);
+    chunk.push_back(TRACE_PUBLISH);
+    put_u64(time);
+    put_u32(id);
+    put_u32(static_cast<unsigned long>(size));
+    const unsigned char *bytes = static_cast<const unsigned char*>(value);
+    chunk.insert(chunk.end(), bytes, bytes + size);
+
+    if (chunk.size() >= CHUNK_SIZE) {
+        flush();
+    }
+}
+
+
+void fncs::TraceWriter::message(
+        unsigned long long round,
+        fncs::time time,
+        zmsg_t *msg)
+{
+    if (!actor) {
+        return;
+    }
+
+    timed(time);
+    chunk.push_back(TRACE_MESSAGE);
+    put_u64(static_cast<fncs::time>(round));
+    put_u64(time);
+    put_u32(static_cast<unsigned long>(zmsg_size(msg)));
+    for (zframe_t *frame = zmsg_first(msg); frame; frame = zmsg_next(msg)) {
+        put_u32(static_cast<unsigned long>(zframe_size(frame)));
+        chunk.insert(chunk.end(), zframe_data(frame), zframe_data(frame) + zframe_size(frame));
+    }
+
+    if (chunk.size() >= CHUNK_SIZE) {
+        flush();
+    }
+}
+
+
+void fncs::TraceWriter::close()
+{
+    if (!actor) {
+        return;
+    }
+    flush();
+    zactor_destroy(&actor); /* sends $TERM and joins the writer */
+}
+
+
+void fncs::TraceWriter::put_u32(unsigned long value)
+{
+    for (int i=0; i<4; ++i) {
+        chunk.push_back(static_cast<unsigned char>(value >> (8*i)));
+    }
+}
+
+
+void fncs::TraceWriter::put_u64(fncs::time value)
+{
+    for (int i=0; i<8; ++i) {
+        chunk.push_back(static_cast<unsigned char>(value >> (8*i)));
+    }
+}
+
+
+void fncs::TraceWriter::timed(fncs::time time)
+{
+    if (!chunk_timed || time < chunk_min) {
+        chunk_min = time;
+    }
+    if (!chunk_timed || time > chunk_max) {
+        chunk_max = time;
+    }
+    chunk_timed = true;
+}
+
+
+void fncs::TraceWriter::flush()
+{
+    if (chunk.empty()) {
+        return;
+    }
+    zmsg_t *msg = zmsg_new();
+    zmsg_addmem(msg, &chunk[0], chunk.size());
+    zmsg_addmem(msg, &chunk_min, sizeof(chunk_min));
+    zmsg_addmem(msg, &chunk_max, sizeof(chunk_max));
+    zmsg_addmem(msg, chunk_topics.data(), chunk_topics.size());
+    zmsg_addmem(msg, new_topics.data(), new_topics.size());
+    zmsg_send(&msg, zactor_sock(actor));
+    chunk.clear();
+    chunk_timed = false;
+    chunk_topics.clear();
+    new_topics.clear();
+    ++n_chunks;
+}
+
+
+fncs::TraceReader::TraceReader()
+    : file(NULL)
+    , version(0)
+    , broken(false)
+    , footer(false)
+    , has_index(false)
+    , chunk()
+    , at(0)
+    , chunks()
+    , next_chunk(0)
+    , topics()
+    , topic_wanted()
+    , from(0)
+    , to(static_cast<fncs::time>(-1))
+    , globs()
+{
+}
+
+
+fncs::TraceReader::~TraceReader()
+{
+    close();
+}
+
+
+bool fncs::TraceReader::open(const string &filename)
+{
+    char magic[TRACE_MAGIC_SIZE];
+
+    close();
+    file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    if (fread(magic, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE) {
+        close();
+        return false;
+    }
+    if (0 == memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE)) {
+        version = 2;
+        has_index = read_index();
+        if (!has_index) {
+            chunks.clear();
+            topics.clear();
+            fseek(file, static_cast<long>(TRACE_MAGIC_SIZE), SEEK_SET);
+        }
+    }
+    else if (0 == memcmp(magic, TRACE_MAGIC_V1, TRACE_MAGIC_SIZE)) {
+        version = 1;
+    }
+    else {
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void fncs::TraceReader::select(
+        fncs::time from,
+        fncs::time to,
+        const vector<string> &globs)
+{
+    this->from = from;
+    this->to = to;
+    this->globs = globs;
+    topic_wanted.clear();
+}
+
+
+bool fncs::TraceReader::next(TraceRecord &record)
+{
+    while (file && !broken) {
+        if (version >= 2 && at >= chunk.size()) {
+            if (!load_chunk()) {
+                return false;
+            }
+            continue;
+        }
+        char type = 0;
+        if (!take(&type, 1)) {
+            /* a version 1 trace whose writer stopped ends here */
+            broken = version >= 2;
+            return false;
+        }
+        if (TRACE_TOPIC == type) {
+            unsigned long id = 0;
+            string topic;
+            if (!take_u32(id) || !take_string(topic)) {
+                break;
+            }
+            if (id >= topics.size()) {
+                topics.resize(id + 1);
+            }
+            topics[id] = topic;
+        }
+        else if (TRACE_PUBLISH == type) {
+            unsigned long id = 0;
+            if (!take_u64(record.time) || !take_u32(id)
+                    || !take_string(record.value) || id >= topics.size()) {
+                break;
+            }
+            if (record.time >= from && record.time <= to && wanted_topic(id)) {
+                record.type = TRACE_PUBLISH;
+                record.round = 0;
+                record.topic = topics[id];
+                record.frames.clear();
+                return true;
+            }
+        }
+        else if (TRACE_MESSAGE == type) {
+            fncs::time round = 0;
+            unsigned long n_frames = 0;
+            if (!take_u64(round) || !take_u64(record.time) || !take_u32(n_frames)) {
+                break;
+            }
+            record.frames.resize(n_frames);
+            for (unsigned long i=0; i<n_frames && !broken; ++i) {
+                broken = !take_string(record.frames[i]);
+            }
+            if (!broken && record.time >= from && record.time <= to && globs.empty()) {
+                record.type = TRACE_MESSAGE;
+                record.round = round;
+                record.topic.clear();
+                record.value.clear();
+                return true;
+            }
+        }
+        else if (1 == version && TRACE_INDEX == type) {
+            fncs::time skip = 0;
+            if (!take_u64(skip) || !take_u64(skip)) {
+                break;
+            }
+        }
+        else if (1 == version && TRACE_FOOTER == type) {
+            footer = true;
+            return false;
+        }
+        else {
+            break;
+        }
+    }
+    broken = file != NULL;
+    return false;
+}
+
+
+void fncs::TraceReader::close()
+{
+    if (file) {
+        fclose(file);
+    }
+    file = NULL;
+    version = 0;
+    broken = false;
+    footer = false;
+    has_index = false;
+    chunk.clear();
+    at = 0;
+    chunks.clear();
+    next_chunk = 0;
+    topics.clear();
+    topic_wanted.clear();
+}
+
+
+/* the chunk index and topic names the footer points to */
+bool fncs::TraceReader::read_index()
+{
+    fncs::time last_index = 0;
+    fncs::time index = 0;
+    unsigned long n_chunks = 0;
+    unsigned long n_names = 0;
+
+    if (0 != fseek(file, -static_cast<long>(FOOTER_SIZE), SEEK_END)
+            || fgetc(file) != TRACE_FOOTER
+            || !read_u64(file, last_index) || !read_u64(file, index)
+            || 0 != fseek(file, static_cast<long>(index), SEEK_SET)
+            || fgetc(file) != TRACE_CHUNKS || !read_u32(file, n_chunks)) {
+        return false;
+    }
+    chunks.resize(n_chunks);
+    for (unsigned long c=0; c<n_chunks; ++c) {
+        unsigned long n_ids = 0;
+        Chunk &entry = chunks[c];
+        if (!read_u64(file, entry.offset) || !read_u64(file, entry.min_time)
+                || !read_u64(file, entry.max_time) || !read_u32(file, n_ids)) {
+            return false;
+        }
+        entry.topics.resize(n_ids);
+        for (unsigned long i=0; i<n_ids; ++i) {
+            if (!read_u32(file, entry.topics[i])) {
+                return false;
+            }
+        }
+    }
+    if (fgetc(file) != TRACE_NAMES || !read_u32(file, n_names)) {
+        return false;
+    }
+    topics.resize(n_names);
+    for (unsigned long i=0; i<n_names; ++i) {
+        unsigned long length = 0;
+        if (!read_u32(file, length)) {
+            return false;
+        }
+        topics[i].resize(length);
+        if (length && fread(&topics[i][0], 1, length, file) != length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* The next chunk holding records that may be selected, uncompressed;
+ * false at the end of the chunks. */
+bool fncs::TraceReader::load_chunk()
+{
+    fncs::time min_time = 0;
+    fncs::time max_time = 0;
+    fncs::time previous = 0;
+    unsigned long raw_size = 0;
+    unsigned long stored_size = 0;
+
+    chunk.clear();
+    at = 0;
+    /* through the index, straight to the next chunk that may be selected */
+    if (has_index) {
+        while (next_chunk < chunks.size()) {
+            const Chunk &entry = chunks[next_chunk];
+            bool wanted = entry.max_time >= from && entry.min_time <= to;
+            if (wanted && !globs.empty()) {
+                wanted = false;
+                for (size_t i=0; i<entry.topics.size() && !wanted; ++i) {
+                    wanted = entry.topics[i] < topics.size() && wanted_topic(entry.topics[i]);
+                }
+            }
+            if (wanted) {
+                break;
+            }
+            ++next_chunk;
+        }
+        if (next_chunk == chunks.size()) {
+            footer = true;
+            return false;
+        }
+        if (0 != fseek(file, static_cast<long>(chunks[next_chunk++].offset), SEEK_SET)) {
+            broken = true;
+            return false;
+        }
+    }
+    int type = fgetc(file);
+    if (EOF == type) {
+        return false; /* the writer stopped */
+    }
+    if (TRACE_CHUNKS == type) {
+        footer = true;
+        return false;
+    }
+    if (TRACE_INDEX != type || !read_u64(file, min_time) || !read_u64(file, max_time)
+            || !read_u64(file, previous) || !read_u32(file, raw_size)
+            || !read_u32(file, stored_size) || stored_size > raw_size) {
+        broken = true;
+        return false;
+    }
+
+    vector<char> stored(stored_size);
+    if (stored_size && fread(&stored[0], 1, stored_size, file) != stored_size) {
+        broken = true;
+        return false;
+    }
+    if (stored_size == raw_size) {
+        chunk.swap(stored);
+        return true;
+    }
+#ifdef HAVE_ZSTD
+    chunk.resize(raw_size);
+    size_t size = ZSTD_decompress(&chunk[0], raw_size, &stored[0], stored_size);
+    if (!ZSTD_isError(size) && size == raw_size) {
+        return true;
+    }
+#else
+    LERROR << "trace is compressed, which needs a build with zstd";
+#endif
+    chunk.clear();
+    broken = true;
+    return false;
+}
+
+
+bool fncs::TraceReader::take(void *data, size_t size)
+{
+    if (1 == version) {
+        return size == 0 || fread(data, 1, size, file) == size;
+    }
+    if (chunk.size() - at < size) {
+        return false;
+    }
+    if (size) {
+        memcpy(data, &chunk[at], size);
+    }
+    at += size;
+    return true;
+}
+
+
+bool fncs::TraceReader::take_u32(unsigned long &value)
+{
+    unsigned char data[4];
+    if (!take(data, 4)) {
+        return false;
+    }
+    value = 0;
+    for (int i=3; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return true;
+}
+
+
+bool fncs::TraceReader::take_u64(fncs::time &value)
+{
+    unsigned char data[8];
+    if (!take(data, 8)) {
+        return false;
+    }
+    value = 0;
+    for (int i=7; i>=0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return true;
+}
+
+
+bool fncs::TraceReader::take_string(string &value)
+{
+    unsigned long size = 0;
+    if (!take_u32(size)) {
+        return false;
+    }
+    value.resize(size);
+    return take(size ? &value[0] : NULL, size);
+}
+
+
+/* whether the topic passes the globs of select(), matched once per ID */
+bool fncs::TraceReader::wanted_topic(unsigned long id)
+{
+    if (globs.empty()) {
+        return true;
+    }
+    if (id >= topic_wanted.size()) {
+        topic_wanted.resize(id + 1, -1);
+    }
+    if (topic_wanted[id] < 0) {
+        topic_wanted[id] = 0;
+        for (size_t i=0; i<globs.size() && !topic_wanted[id]; ++i) {
+            topic_wanted[id] = glob_match(globs[i], topics[id]);
+        }
+    }
+    return topic_wanted[id] != 0;
+}
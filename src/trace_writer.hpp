@@ -0,0 +1,201 @@
+#ifndef _TRACE_WRITER_HPP_
+#define _TRACE_WRITER_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "czmq.h"
+
+#include "fncs.hpp"
+#include "hash_map.hpp"
+
+namespace fncs {
+
+    /* Binary trace layout, all integers little-endian:
+     *
+     *   header   "FNCSTRC2"
+     *   'I' u64 min_time u64 max_time u64 previous_index_offset
+     *       u32 raw_size u32 stored_size      index block of a chunk,
+     *                                         followed by the chunk
+     *   in a chunk:
+     *   'T' u32 topic_id u32 length bytes     defines an interned topic
+     *   'P' u64 time u32 topic_id u32 length bytes   one publish
+     *   'M' u64 round u64 time u32 n_frames, then u32 length bytes
+     *       of each frame                    one message, see FNCS_RECORD
+     *   at close:
+     *   'X' u32 n_chunks, then of each u64 index_offset u64 min_time
+     *       u64 max_time u32 n_topics u32 topic_id...   the chunk index
+     *   'N' u32 n_topics, then of each u32 length bytes  topics by ID
+     *   'F' u64 last_index_offset u64 chunk_index_offset  footer
+     *
+     * The writer thread puts an index block in front of every chunk it
+     * receives, holding the range of times the chunk's records have. A
+     * chunk stored smaller than its raw size is zstd compressed. Index
+     * blocks chain backward from the footer, and the chunk index at the
+     * end lists every chunk with its times and the topics it publishes,
+     * so a reader seeks straight to the chunks of a time range and topic
+     * without scanning the others, see TraceReader. Topic definitions
+     * always precede their first use in the same chunk or an earlier one.
+     * A record of the broker's inbound messages holds 'M' records in the
+     * order they arrived, the sender's identity the first frame.
+     *
+     * Traces of version 1, "FNCSTRC1", have no sizes in their index
+     * blocks, no compression and no chunk index; they are still read. */
+    const char * const TRACE_MAGIC = "FNCSTRC2";
+    const char * const TRACE_MAGIC_V1 = "FNCSTRC1";
+    const size_t TRACE_MAGIC_SIZE = 8;
+    const char TRACE_TOPIC = 'T';
+    const char TRACE_PUBLISH = 'P';
+    const char TRACE_MESSAGE = 'M';
+    const char TRACE_INDEX = 'I';
+    const char TRACE_CHUNKS = 'X';
+    const char TRACE_NAMES = 'N';
+    const char TRACE_FOOTER = 'F';
+
+    /** Writes broker trace records from a background thread. Records are
+     * appended to a chunk on the caller's thread; full chunks are handed
+     * to the writer thread over an inproc pipe, which is zmq's lock-free
+     * queue, so the caller never waits on the disk. */
+    class FNCS_EXPORT TraceWriter {
+        public:
+            TraceWriter();
+
+            ~TraceWriter();
+
+            /** Start the writer thread for the given file, compressing its
+             * chunks if asked and built with zstd; false on error. */
+            bool open(const std::string &filename, bool compress=false);
+
+            /** Append one PUBLISH record. */
+            void publish(fncs::time time, const std::string &topic,
+                    const void *value, size_t size);
+
+            /** Append one MESSAGE record of every frame of msg, received
+             * in the given round of grants, whose time it was. */
+            void message(unsigned long long round, fncs::time time, zmsg_t *msg);
+
+            /** Flush the last chunk, write the index and footer and join
+             * the thread. */
+            void close();
+
+        private:
+            void put_u32(unsigned long value);
+
+            void put_u64(fncs::time value);
+
+            /* note a record of the given time in the chunk */
+            void timed(fncs::time time);
+
+            void flush();
+
+            zactor_t *actor;
+            std::vector<unsigned char> chunk;
+            fncs::time chunk_min; /* times of the records in chunk ... */
+            fncs::time chunk_max;
+            bool chunk_timed; /* ... if any */
+            std::string chunk_topics; /* u32 IDs published in chunk */
+            std::string new_topics; /* u32 length and name of each new one */
+            unsigned long long n_chunks; /* flushed so far */
+            std::vector<unsigned long long> topic_chunk; /* by ID, chunk + 1
+                                                            it was last noted in */
+            fncs::HashMap<std::string,unsigned long>::type topic_ids;
+    };
+
+    /** One PUBLISH or MESSAGE record read by TraceReader. */
+    class TraceRecord {
+        public:
+            TraceRecord() : type(0), time(0), round(0), topic(), value(), frames() {}
+
+            char type; /* TRACE_PUBLISH or TRACE_MESSAGE */
+            fncs::time time;
+            unsigned long long round; /* of a message */
+            std::string topic; /* of a publish ... */
+            std::string value; /* ... and its value */
+            std::vector<std::string> frames; /* of a message */
+    };
+
+    /** Reads a binary trace in file order. With select(), a trace of
+     * version 2 that was closed is read through its chunk index: only the
+     * chunks holding records of the range and topics are read, so a
+     * query takes time in proportion to its result. Others are scanned,
+     * and their records filtered the same way. */
+    class FNCS_EXPORT TraceReader {
+        public:
+            TraceReader();
+
+            ~TraceReader();
+
+            /** Open the trace; false if it is not one. */
+            bool open(const std::string &filename);
+
+            /** Read only the records of times from to to, inclusive, and
+             * if any globs are given only the publishes of topics one of
+             * them matches. */
+            void select(fncs::time from, fncs::time to,
+                    const std::vector<std::string> &globs);
+
+            /** Read the next record; false at the end of the trace, at
+             * which corrupt() or ended() tell why. */
+            bool next(TraceRecord &record);
+
+            /** Whether the trace is corrupt or truncated. */
+            bool corrupt() const { return broken; }
+
+            /** Whether the trace ended with its footer, rather than
+             * where its writer stopped. */
+            bool ended() const { return footer; }
+
+            /** Whether it is read through its chunk index. */
+            bool indexed() const { return has_index; }
+
+            void close();
+
+        private:
+            class Chunk {
+                public:
+                    Chunk() : offset(0), min_time(0), max_time(0), topics() {}
+
+                    fncs::time offset; /* of its index block */
+                    fncs::time min_time;
+                    fncs::time max_time;
+                    std::vector<unsigned long> topics;
+            };
+
+            /* not copyable */
+            TraceReader(const TraceReader &);
+            TraceReader& operator=(const TraceReader &);
+
+            bool read_index();
+
+            bool load_chunk();
+
+            bool take(void *data, size_t size);
+
+            bool take_u32(unsigned long &value);
+
+            bool take_u64(fncs::time &value);
+
+            bool take_string(std::string &value);
+
+            bool wanted_topic(unsigned long id);
+
+            FILE *file;
+            int version;
+            bool broken;
+            bool footer;
+            bool has_index;
+            std::vector<char> chunk; /* the current chunk, uncompressed ... */
+            size_t at; /* ... read up to here */
+            std::vector<Chunk> chunks; /* the chunk index, if read */
+            size_t next_chunk; /* in it */
+            std::vector<std::string> topics; /* by ID */
+            std::vector<signed char> topic_wanted; /* by ID, -1 if not known */
+            fncs::time from;
+            fncs::time to;
+            std::vector<std::string> globs;
+    };
+
+}
+
+#endif /* _TRACE_WRITER_HPP_ */
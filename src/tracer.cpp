@@ -2,14 +2,11 @@
 #include "config.h"
 
 /* C++ standard headers */
-#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <iterator>
-#include <sstream>
 #include <string>
-#include <utility>
 #include <vector>
 
 /* 3rd party headers */
@@ -18,54 +15,119 @@
 /* fncs headers */
 #include "fncs.hpp"
 #include "fncs_internal.hpp"
+#include "trace_writer.hpp"
 
 using namespace ::std;
 
+/* the output stream's buffer; the trace is not flushed per line */
+static const size_t OUT_BUFFER_SIZE = 1024 * 1024;
+
+static const char *usage =
+    "Usage: fncs_tracer [--binary [--compress]] [--match <glob>]... <stop time> [output file]";
+
+
+/* whether the key passes the --match filters, if any */
+static bool matches(const vector<string> &globs, const string &key)
+{
+    if (globs.empty()) {
+        return true;
+    }
+    for (size_t i=0; i<globs.size(); ++i) {
+        if (fncs::glob_match(globs[i], key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 int main(int argc, char **argv)
 {
     string param_time_stop = "";
     string param_file_name = "";
+    vector<string> param_globs;
+    bool param_binary = false;
+    bool param_compress = false;
     fncs::time time_granted = 0;
     fncs::time time_stop = 0;
-    vector<string> events;
+    vector<signed char> traced; /* per key handle, whether it passes the filters */
+    vector<char> buffer(OUT_BUFFER_SIZE);
     ofstream fout;
     ostream out(cout.rdbuf()); /* share cout's stream buffer */
+    fncs::TraceWriter writer;
+    vector<string> params;
 
-    if (argc < 2) {
+    for (int i=1; i<argc; ++i) {
+        if (0 == strcmp(argv[i], "--binary")) {
+            param_binary = true;
+        }
+        else if (0 == strcmp(argv[i], "--compress")) {
+            param_compress = true;
+        }
+        else if (0 == strcmp(argv[i], "--match") && i+1 < argc) {
+            param_globs.push_back(argv[++i]);
+        }
+        else {
+            params.push_back(argv[i]);
+        }
+    }
+
+    if (params.size() < 1) {
         cerr << "Missing stop time parameter." << endl;
-        cerr << "Usage: tracer <stop time> [output file]" << endl;
+        cerr << usage << endl;
         exit(EXIT_FAILURE);
     }
 
-    if (argc > 3) {
+    if (params.size() > 2) {
         cerr << "Too many parameters." << endl;
-        cerr << "Usage: tracer <stop time> <output file>" << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (param_binary && params.size() < 2) {
+        cerr << "Binary output needs an output file." << endl;
+        cerr << usage << endl;
         exit(EXIT_FAILURE);
     }
 
-    param_time_stop = argv[1];
-    if (argc == 3) {
-        param_file_name = argv[2];
-        fout.open(param_file_name.c_str());
-        if (!fout) {
-            cerr << "Could not open output file '" << param_file_name << "'." << endl;
-            exit(EXIT_FAILURE);
+    param_time_stop = params[0];
+    if (!fncs::try_parse_time(param_time_stop.c_str(), time_stop)) {
+        cerr << "Invalid stop time '" << param_time_stop << "'." << endl;
+        cerr << usage << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (params.size() == 2) {
+        param_file_name = params[1];
+        if (param_binary) {
+            if (!writer.open(param_file_name, param_compress)) {
+                cerr << "Could not open output file '" << param_file_name << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else {
+            fout.rdbuf()->pubsetbuf(&buffer[0], buffer.size());
+            fout.open(param_file_name.c_str());
+            if (!fout) {
+                cerr << "Could not open output file '" << param_file_name << "'." << endl;
+                exit(EXIT_FAILURE);
+            }
+            out.rdbuf(fout.rdbuf()); /* redirect out to use file buffer */
         }
-        out.rdbuf(fout.rdbuf()); /* redirect out to use file buffer */
     }
 
-    out << "#time\ttopic\tvalue" << endl;
+    if (!param_binary) {
+        out << "#time\ttopic\tvalue\n";
+    }
 
     fncs::initialize();
 
     if (!fncs::is_initialized()) {
         cout << "did not connect to broker, exiting" << endl;
         fout.close();
+        writer.close();
         return EXIT_FAILURE;
     }
 
-    time_stop = fncs::parse_time(param_time_stop);
     cout << "stops at " << time_stop << " nanoseconds" << endl;
     time_stop = fncs::convert_broker_to_sim_time(time_stop);
     cout << "stops at " << time_stop << " in sim time" << endl;
@@ -73,12 +135,27 @@ int main(int argc, char **argv)
     do {
         time_granted = fncs::time_request(time_stop);
         cout << "time_granted is " << time_granted << endl;
-        events = fncs::get_events();
-        for (vector<string>::iterator it=events.begin(); it!=events.end(); ++it) {
-            out << time_granted
-                << "\t" << *it
-                << "\t" << fncs::get_value(*it)
-                << endl;
+        /* straight from the cache, nothing is copied */
+        for (fncs::EventIterator it=fncs::events_begin(); it!=fncs::events_end(); ++it) {
+            const string &key = fncs::get_key(*it);
+            /* filter once per key rather than per event; a pattern
+             * subscription adds keys as its topics arrive */
+            if (*it >= traced.size()) {
+                traced.resize(*it+1, -1);
+            }
+            if (traced[*it] < 0) {
+                traced[*it] = matches(param_globs, key);
+            }
+            if (!traced[*it]) {
+                continue;
+            }
+            const string &value = fncs::get_value(*it);
+            if (param_binary) {
+                writer.publish(time_granted, key, value.data(), value.size());
+            }
+            else {
+                out << time_granted << '\t' << key << '\t' << value << '\n';
+            }
         }
     } while (time_granted < time_stop);
     cout << "time_granted was " << time_granted << endl;
@@ -86,10 +163,11 @@ int main(int argc, char **argv)
 
     cout << "done" << endl;
 
+    out.flush();
     fout.close();
+    writer.close();
 
     fncs::finalize();
 
     return EXIT_SUCCESS;
 }
-
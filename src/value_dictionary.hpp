@@ -0,0 +1,115 @@
+#ifndef _VALUE_DICTIONARY_HPP_
+#define _VALUE_DICTIONARY_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "fncs_internal.hpp"
+#include "hash_map.hpp"
+
+namespace fncs {
+
+    /** The string values the broker numbered for the federation, see
+     * FNCS_DICTIONARY, each stored once. A value in it travels as a coded
+     * frame: a NUL byte, VALUE_DICT, then its code as a little-endian
+     * u32. Codes are only ever added, the same on every sim, so a frame
+     * means the same at any grant. The values never move, so the cache
+     * refers to them instead of copying them. */
+    class ValueDictionary {
+        public:
+            static const size_t FRAME_SIZE = 6;
+
+            ValueDictionary() : values(), frames() {}
+
+            static size_t npos() { return static_cast<size_t>(-1); }
+
+            size_t size() const { return values.size(); }
+
+            bool empty() const { return values.empty(); }
+
+            /** Number the value, unless it was; its code. */
+            size_t add(const std::string &value) {
+                FrameMap::iterator it = frames.find(value);
+                if (it != frames.end()) {
+                    return code(it->second.data(), it->second.size());
+                }
+                std::string frame(FRAME_SIZE, '\0');
+                frame[1] = static_cast<char>(VALUE_DICT);
+                for (int i=0; i<4; ++i) {
+                    frame[2+i] = static_cast<char>(values.size() >> (8*i));
+                }
+                values.push_back(value);
+                frames.insert(std::make_pair(value, frame));
+                return values.size() - 1;
+            }
+
+            /** The coded frame of the value, or NULL if it has no code. */
+            const std::string* frame(const std::string &value) const {
+                FrameMap::const_iterator it = frames.find(value);
+                return it == frames.end() ? NULL : &it->second;
+            }
+
+            /** The value a frame payload stands for, or NULL if it is not
+             * a coded frame of a known code. */
+            const std::string* lookup(const void *data, size_t size) const {
+                size_t at = code(data, size);
+                return at < values.size() ? &values[at] : NULL;
+            }
+
+            const std::string& value(size_t code) const { return values[code]; }
+
+            /** The code of a coded frame payload, else npos(). */
+            static size_t code(const void *data, size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char*>(data);
+                if (size != FRAME_SIZE || 0 != bytes[0] || VALUE_DICT != bytes[1]) {
+                    return npos();
+                }
+                return bytes[2] | (bytes[3] << 8) | (bytes[4] << 16)
+                    | (static_cast<size_t>(bytes[5]) << 24);
+            }
+
+            /** The values as sent in the ACK: each a u32 length and its
+             * bytes, little-endian. */
+            std::string pack() const {
+                std::string packed;
+                for (size_t i=0; i<values.size(); ++i) {
+                    for (int j=0; j<4; ++j) {
+                        packed.append(1, static_cast<char>(values[i].size() >> (8*j)));
+                    }
+                    packed.append(values[i]);
+                }
+                return packed;
+            }
+
+            /** Add the values of pack(); false if it is malformed. */
+            bool unpack(const void *data, size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char*>(data);
+                size_t at = 0;
+                while (at < size) {
+                    if (size - at < 4) {
+                        return false;
+                    }
+                    size_t length = bytes[at] | (bytes[at+1] << 8) | (bytes[at+2] << 16)
+                        | (static_cast<size_t>(bytes[at+3]) << 24);
+                    at += 4;
+                    if (length > size - at) {
+                        return false;
+                    }
+                    add(std::string(reinterpret_cast<const char*>(bytes + at), length));
+                    at += length;
+                }
+                return true;
+            }
+
+        private:
+            typedef HashMap<std::string,std::string>::type FrameMap;
+
+            std::deque<std::string> values; /* by code */
+            FrameMap frames; /* value to its coded frame */
+    };
+
+}
+
+#endif /* _VALUE_DICTIONARY_HPP_ */
@@ -0,0 +1,290 @@
+#ifndef _WORK_POOL_HPP_
+#define _WORK_POOL_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "mutex.hpp"
+
+namespace fncs {
+
+    /** A condition variable over the native threads API, used with a
+     * MutexLock's Mutex. */
+    class Condition {
+        public:
+#if (defined WIN32 || defined _WIN32)
+            Condition() { InitializeConditionVariable(&native); }
+            ~Condition() {}
+            void wait(Mutex &mutex) { SleepConditionVariableCS(&native, &mutex.native, INFINITE); }
+            void broadcast() { WakeAllConditionVariable(&native); }
+#else
+            Condition() { pthread_cond_init(&native, NULL); }
+            ~Condition() { pthread_cond_destroy(&native); }
+            void wait(Mutex &mutex) { pthread_cond_wait(&native, &mutex.native); }
+            void broadcast() { pthread_cond_broadcast(&native); }
+#endif
+
+        private:
+            /* not copyable */
+            Condition(const Condition &);
+            Condition& operator=(const Condition &);
+
+#if (defined WIN32 || defined _WIN32)
+            CONDITION_VARIABLE native;
+#else
+            pthread_cond_t native;
+#endif
+    };
+
+    /** The processors online, at least 1. */
+    inline size_t processor_count() {
+#if (defined WIN32 || defined _WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? static_cast<size_t>(n) : 1;
+#endif
+    }
+
+    /** Runs a task for each of n indexes on worker threads and the
+     * calling thread, returning once all ran. Each worker starts on a
+     * contiguous range of its own, taking a few indexes at a time from
+     * its front; one that runs out moves the back half of the largest
+     * range left into its own and goes on taking a few at a time, so
+     * uneven tasks keep every thread busy. The order the tasks run in is
+     * not defined. */
+    class WorkPool {
+        public:
+            typedef void (*Task)(size_t index, void *data);
+
+            /* workers besides the calling thread */
+            explicit WorkPool(size_t n_workers)
+                : ranges(new Range[n_workers + 1])
+                , n_ranges(n_workers + 1)
+                , threads()
+                , mutex()
+                , started()
+                , finished()
+                , task(NULL)
+                , data(NULL)
+                , generation(0)
+                , n_running(0)
+                , stopping(false)
+            {
+                for (size_t i=0; i<n_workers; ++i) {
+                    Start *start = new Start(this, i + 1);
+#if (defined WIN32 || defined _WIN32)
+                    HANDLE thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+                    if (!thread) {
+                        delete start;
+                        break;
+                    }
+#else
+                    pthread_t thread;
+                    if (0 != pthread_create(&thread, NULL, thread_main, start)) {
+                        delete start;
+                        break;
+                    }
+#endif
+                    threads.push_back(thread);
+                }
+            }
+
+            ~WorkPool() {
+                {
+                    MutexLock lock(mutex);
+                    stopping = true;
+                    started.broadcast();
+                }
+                for (size_t i=0; i<threads.size(); ++i) {
+#if (defined WIN32 || defined _WIN32)
+                    WaitForSingleObject(threads[i], INFINITE);
+                    CloseHandle(threads[i]);
+#else
+                    pthread_join(threads[i], NULL);
+#endif
+                }
+                delete [] ranges;
+            }
+
+            /** Threads running tasks, the calling one included. */
+            size_t size() const { return threads.size() + 1; }
+
+            void run(size_t n, Task each, void *arg) {
+                size_t n_threads = size();
+                {
+                    MutexLock lock(mutex);
+                    for (size_t i=0; i<n_threads; ++i) {
+                        MutexLock range_lock(ranges[i].mutex);
+                        ranges[i].begin = n * i / n_threads;
+                        ranges[i].end = n * (i + 1) / n_threads;
+                    }
+                    task = each;
+                    data = arg;
+                    n_running = threads.size();
+                    ++generation;
+                    started.broadcast();
+                }
+                work(0);
+                MutexLock lock(mutex);
+                while (n_running) {
+                    finished.wait(mutex);
+                }
+            }
+
+        private:
+            /* not copyable */
+            WorkPool(const WorkPool &);
+            WorkPool& operator=(const WorkPool &);
+
+            class Range {
+                public:
+                    Range() : mutex(), begin(0), end(0) {}
+
+                    Mutex mutex;
+                    size_t begin;
+                    size_t end;
+            };
+
+            class Start {
+                public:
+                    Start(WorkPool *pool, size_t worker) : pool(pool), worker(worker) {}
+
+                    WorkPool *pool;
+                    size_t worker;
+            };
+
+#if (defined WIN32 || defined _WIN32)
+            static DWORD WINAPI thread_main(LPVOID arg)
+#else
+            static void* thread_main(void *arg)
+#endif
+            {
+                Start *start = static_cast<Start*>(arg);
+                WorkPool *pool = start->pool;
+                size_t worker = start->worker;
+                unsigned long long seen = 0;
+                delete start;
+                while (true) {
+                    {
+                        MutexLock lock(pool->mutex);
+                        while (!pool->stopping && pool->generation == seen) {
+                            pool->started.wait(pool->mutex);
+                        }
+                        if (pool->stopping) {
+                            break;
+                        }
+                        seen = pool->generation;
+                    }
+                    pool->work(worker);
+                    MutexLock lock(pool->mutex);
+                    if (0 == --pool->n_running) {
+                        pool->finished.broadcast();
+                    }
+                }
+                return 0;
+            }
+
+            /* up to a few indexes from the front of the worker's range,
+             * which is refilled with the back half of the largest other
+             * once empty; false once all are taken */
+            bool take(size_t worker, size_t &begin, size_t &end) {
+                Range &own = ranges[worker];
+                while (true) {
+                    {
+                        MutexLock lock(own.mutex);
+                        if (own.begin < own.end) {
+                            size_t n = (own.end - own.begin + 7) / 8;
+                            begin = own.begin;
+                            end = own.begin + (n < 16 ? n : 16);
+                            own.begin = end;
+                            return true;
+                        }
+                    }
+                    if (!steal(worker)) {
+                        return false;
+                    }
+                }
+            }
+
+            /* moves the back half of the largest other range into the
+             * worker's empty one, where others may steal from it again;
+             * false once all are empty */
+            bool steal(size_t worker) {
+                while (true) {
+                    size_t victim = n_ranges;
+                    size_t most = 0;
+                    for (size_t i=0; i<n_ranges; ++i) {
+                        if (i == worker) {
+                            continue;
+                        }
+                        MutexLock lock(ranges[i].mutex);
+                        if (ranges[i].end - ranges[i].begin > most) {
+                            victim = i;
+                            most = ranges[i].end - ranges[i].begin;
+                        }
+                    }
+                    if (victim == n_ranges) {
+                        return false;
+                    }
+                    size_t begin = 0;
+                    size_t end = 0;
+                    {
+                        MutexLock lock(ranges[victim].mutex);
+                        Range &range = ranges[victim];
+                        if (range.begin < range.end) {
+                            begin = range.end - (range.end - range.begin + 1) / 2;
+                            end = range.end;
+                            range.end = begin;
+                        }
+                    }
+                    if (begin < end) {
+                        /* one range lock at a time, so stealers cannot
+                         * deadlock */
+                        MutexLock lock(ranges[worker].mutex);
+                        ranges[worker].begin = begin;
+                        ranges[worker].end = end;
+                        return true;
+                    }
+                }
+            }
+
+            void work(size_t worker) {
+                size_t begin = 0;
+                size_t end = 0;
+                while (take(worker, begin, end)) {
+                    for (size_t i=begin; i<end; ++i) {
+                        task(i, data);
+                    }
+                }
+            }
+
+            Range *ranges; /* of each worker, 0 the caller */
+            size_t n_ranges;
+#if (defined WIN32 || defined _WIN32)
+            std::vector<HANDLE> threads;
+#else
+            std::vector<pthread_t> threads;
+#endif
+            Mutex mutex; /* guards the members below */
+            Condition started;
+            Condition finished;
+            Task task;
+            void *data;
+            unsigned long long generation; /* of run() calls */
+            size_t n_running; /* workers not done with this run() */
+            bool stopping;
+    };
+
+}
+
+#endif /* _WORK_POOL_HPP_ */
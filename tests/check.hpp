@@ -0,0 +1,18 @@
+#ifndef _CHECK_HPP_
+#define _CHECK_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+
+/* assert() that stays in with NDEBUG, since the checks are the test;
+ * the condition is evaluated exactly once */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", \
+                    __FILE__, __LINE__, #condition); \
+            abort(); \
+        } \
+    } while (0)
+
+#endif /* _CHECK_HPP_ */
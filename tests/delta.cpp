@@ -0,0 +1,96 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "check.hpp"
+
+using std::string;
+
+/* sends the value from the sender's base to the receiver's, checking
+ * both end up at it; returns the frame's size */
+static size_t send(string &sent, string &received, bool keyframe, const string &value)
+{
+    string frame = fncs::delta_encode(sent, keyframe, value);
+    CHECK(fncs::delta_frame(frame.data(), frame.size()));
+    CHECK(sent == value);
+    CHECK(fncs::delta_apply(received, frame.data(), frame.size()));
+    CHECK(received == value);
+    return frame.size();
+}
+
+int main()
+{
+    string sent;
+    string received;
+
+    /* the first value has no base to differ from */
+    const string tail = ",\"phases\":\"ABC\",\"nominal\":7200,\"units\":\"kW\"}";
+    send(sent, received, false, "{\"state\":\"OPEN\",\"load\":1.25" + tail);
+
+    /* a change in the middle travels as that change */
+    string value = "{\"state\":\"OPEN\",\"load\":1.50" + tail;
+    CHECK(send(sent, received, false, value) < value.size());
+    value = "{\"state\":\"CLOSED\",\"load\":1.50" + tail;
+    CHECK(send(sent, received, false, value) < value.size());
+
+    /* the same value again, one shorter, one longer, one empty */
+    send(sent, received, false, value);
+    send(sent, received, false, value.substr(0, value.size() - 1));
+    send(sent, received, false, value + value);
+    send(sent, received, false, "");
+    send(sent, received, false, value);
+
+    /* values whose prefix and suffix overlap */
+    send(sent, received, false, "aaaa");
+    send(sent, received, false, "aaaaaa");
+    send(sent, received, false, "aaa");
+    send(sent, received, false, "abab");
+    send(sent, received, false, "ababab");
+
+    /* values holding NULs, as a frame of their own might */
+    send(sent, received, false, string("\0\7\0x", 4));
+    send(sent, received, false, string("\0\7\0y", 4));
+
+    /* a keyframe needs no base */
+    string late;
+    value = "keyframe " + value;
+    string frame = fncs::delta_encode(sent, true, value);
+    CHECK(fncs::delta_apply(late, frame.data(), frame.size()));
+    CHECK(late == value);
+
+    /* a delta against another base is refused and leaves it alone */
+    string other = "something else entirely, and long enough to differ";
+    string kept = other;
+    value = value + " and a little more";
+    frame = fncs::delta_encode(sent, false, value);
+    CHECK(frame.size() < value.size());
+    CHECK(!fncs::delta_apply(other, frame.data(), frame.size()));
+    CHECK(other == kept);
+
+    /* truncated frames are refused */
+    CHECK(!fncs::delta_apply(received, frame.data(), 2));
+    CHECK(!fncs::delta_apply(received, frame.data(), 10));
+    CHECK(!fncs::delta_frame("plain", 5));
+
+    /* random edits of a random value */
+    srand(1);
+    sent.clear();
+    received.clear();
+    value.assign(200, 'x');
+    for (size_t i=0; i<value.size(); ++i) {
+        value[i] = static_cast<char>(rand() % 256);
+    }
+    for (int round=0; round<1000; ++round) {
+        size_t at = rand() % (value.size() + 1);
+        size_t erased = rand() % 8;
+        value.erase(at, erased);
+        value.insert(at < value.size() ? at : value.size(),
+                string(rand() % 8, static_cast<char>(rand() % 256)));
+        send(sent, received, round % 50 == 0, value);
+    }
+
+    return 0;
+}
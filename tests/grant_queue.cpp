@@ -0,0 +1,81 @@
+#include "config.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "grant_queue.hpp"
+#include "check.hpp"
+
+using std::vector;
+
+/* pops everything, checking times never decrease and ties come out
+ * lowest index first */
+static vector<size_t> drain(fncs::GrantQueue &queue, const vector<fncs::time> &times)
+{
+    vector<size_t> order;
+    while (!queue.empty()) {
+        fncs::time top = queue.top_key();
+        size_t index = queue.pop();
+        CHECK(top == times[index]);
+        if (!order.empty()) {
+            size_t last = order.back();
+            CHECK(times[last] < top || (times[last] == top && last < index));
+        }
+        order.push_back(index);
+    }
+    return order;
+}
+
+int main()
+{
+    fncs::GrantQueue queue;
+    vector<fncs::time> times;
+
+    /* ties on one time come out by index, whatever the insert order */
+    size_t inserted[] = {4, 1, 3, 0, 2};
+    times.assign(5, 7);
+    for (size_t i=0; i<5; ++i) {
+        queue.update(inserted[i], 7);
+    }
+    vector<size_t> order = drain(queue, times);
+    CHECK(order.size() == 5);
+    for (size_t i=0; i<5; ++i) {
+        CHECK(order[i] == i);
+    }
+
+    /* updates move a queued index both ways */
+    times.assign(4, 0);
+    times[0] = 10; queue.update(0, 10);
+    times[1] = 20; queue.update(1, 20);
+    times[2] = 30; queue.update(2, 30);
+    times[3] = 40; queue.update(3, 40);
+    times[3] = 5; queue.update(3, 5);
+    times[0] = 25; queue.update(0, 25);
+    CHECK(queue.size() == 4);
+    CHECK(queue.top() == 3);
+    queue.remove(1);
+    queue.remove(1);
+    CHECK(!queue.contains(1));
+    order = drain(queue, times);
+    CHECK(order.size() == 3);
+    CHECK(order[0] == 3 && order[1] == 0 && order[2] == 2);
+
+    /* random times, many ties */
+    srand(1);
+    times.assign(1000, 0);
+    for (size_t i=0; i<times.size(); ++i) {
+        times[i] = rand() % 50;
+        queue.update(i, times[i]);
+    }
+    for (size_t i=0; i<times.size(); i+=3) {
+        times[i] = rand() % 50;
+        queue.update(i, times[i]);
+    }
+    for (size_t i=1; i<times.size(); i+=7) {
+        queue.remove(i);
+    }
+    order = drain(queue, times);
+    CHECK(order.size() == times.size() - (times.size() + 5) / 7);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "config.h"
+
+#include <string>
+
+#include "fncs.hpp"
+#include "fncs_internal.hpp"
+#include "check.hpp"
+
+/* the time the text parses to, or 0 if try_parse_time() refuses it,
+ * checking a refused time leaves the output as it was */
+static fncs::time parsed(const char *text)
+{
+    fncs::time out = 42;
+    if (!fncs::try_parse_time(text, out)) {
+        CHECK(42 == out);
+        return 0;
+    }
+    return out;
+}
+
+static fncs::time unit(const char *text)
+{
+    fncs::time out = 0;
+    return fncs::try_time_unit(text, out) ? out : 0;
+}
+
+int main()
+{
+    const fncs::time ns_per_s = 1000000000ULL;
+
+    /* every spelling of every unit */
+    const char *days[] = {"d", "day", "days"};
+    const char *hours[] = {"h", "hour", "hours"};
+    const char *minutes[] = {"m", "min", "minute", "minutes"};
+    const char *seconds[] = {"s", "sec", "second", "seconds"};
+    const char *ms[] = {"ms", "msec", "millisec", "millisecond", "milliseconds"};
+    const char *us[] = {"us", "usec", "microsec", "microsecond", "microseconds"};
+    const char *ns[] = {"ns", "nsec", "nanosec", "nanosecond", "nanoseconds"};
+    for (size_t i=0; i<3; ++i) {
+        CHECK(unit((std::string("1") + days[i]).c_str()) == 86400ULL * ns_per_s);
+        CHECK(unit((std::string("1") + hours[i]).c_str()) == 3600ULL * ns_per_s);
+    }
+    for (size_t i=0; i<4; ++i) {
+        CHECK(unit((std::string("1") + minutes[i]).c_str()) == 60ULL * ns_per_s);
+        CHECK(unit((std::string("1") + seconds[i]).c_str()) == ns_per_s);
+    }
+    for (size_t i=0; i<5; ++i) {
+        CHECK(unit((std::string("1") + ms[i]).c_str()) == 1000000ULL);
+        CHECK(unit((std::string("1") + us[i]).c_str()) == 1000ULL);
+        CHECK(unit((std::string("1") + ns[i]).c_str()) == 1ULL);
+    }
+
+    /* spaces around the number and unit, and what follows is ignored */
+    CHECK(parsed("10ms") == 10000000ULL);
+    CHECK(parsed("  1 h") == 3600ULL * ns_per_s);
+    CHECK(parsed("5s and more") == 5ULL * ns_per_s);
+    CHECK(parsed("0ns") == 0 && unit("0ns") == 1);
+
+    /* no number, no unit, or a unit that only starts like one */
+    CHECK(parsed("") == 0 && unit("") == 0);
+    CHECK(parsed("ms") == 0);
+    CHECK(parsed("10") == 0 && unit("10") == 0);
+    CHECK(parsed("10 ") == 0);
+    CHECK(parsed("10 mss") == 0);
+    CHECK(parsed("10 milli") == 0);
+    CHECK(parsed("10 M") == 0);
+    CHECK(parsed("-1s") == 0);
+
+    /* the largest time, and one past it in the number or the product */
+    CHECK(parsed("18446744073709551615ns") == 18446744073709551615ULL);
+    CHECK(parsed("18446744073709551616ns") == 0);
+    CHECK(parsed("99999999999999999999999ns") == 0);
+    CHECK(parsed("18446744073s") == 18446744073ULL * ns_per_s);
+    CHECK(parsed("18446744074s") == 0);
+    CHECK(parsed("213503d") == 213503ULL * 86400ULL * ns_per_s);
+    CHECK(parsed("213504d") == 0);
+    /* a unit is still known when the number overflows only its product */
+    CHECK(unit("18446744074s") == ns_per_s);
+
+#if __cplusplus >= 201103L
+    using namespace fncs::literals;
+    CHECK(10_ms == parsed("10ms"));
+    CHECK(1_h == parsed("1h"));
+    CHECK(2_d == parsed("2 days"));
+    CHECK(3_min + 4_s + 5_us + 6_ns == parsed("184000005006ns"));
+#endif
+
+    return 0;
+}
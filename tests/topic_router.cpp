@@ -0,0 +1,65 @@
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+#include "topic_router.hpp"
+#include "check.hpp"
+
+using std::string;
+using std::vector;
+
+/* the indexes matching the topic, as a string such as "1,3" */
+static string matched(const fncs::TopicRouter &router, const string &topic)
+{
+    vector<size_t> indexes;
+    string out;
+    router.match(topic, indexes);
+    for (size_t i=0; i<indexes.size(); ++i) {
+        if (i) {
+            out += ",";
+        }
+        out += string(1, static_cast<char>('0' + indexes[i]));
+    }
+    return out;
+}
+
+int main()
+{
+    fncs::TopicRouter router;
+    CHECK(router.empty());
+    CHECK(matched(router, "feeder1/node1/voltage") == "");
+
+    router.add("feeder1/*/voltage", 1);
+    router.add("feeder1/node1/*", 2);
+    router.add("feeder?/voltage", 3);
+    router.add("feeder1/node1/*", 2);
+    router.add("feeder1/*", 4);
+    router.add("*", 5);
+    router.add("feeder1/node1/*", 6);
+    CHECK(router.size() == 5);
+    CHECK(router.pattern(1) == "feeder1/node1/*");
+
+    /* '*' takes any segment, a literal segment only itself */
+    CHECK(matched(router, "feeder1/node1/voltage") == "1,2,4,5,6");
+    CHECK(matched(router, "feeder1/node7/voltage") == "1,4,5");
+    CHECK(matched(router, "feeder1/node10/voltage") == "1,4,5");
+    CHECK(matched(router, "feeder1/node1/current") == "2,4,5,6");
+
+    /* '*' also spans '/', '?' is exactly one character */
+    CHECK(matched(router, "feeder1/a/b/voltage") == "1,4,5");
+    CHECK(matched(router, "feeder2/voltage") == "3,5");
+    CHECK(matched(router, "feeder12/voltage") == "5");
+
+    /* a topic ending inside a label, or before the prefix ends */
+    CHECK(matched(router, "feeder") == "5");
+    CHECK(matched(router, "feeder1/node") == "4,5");
+    CHECK(matched(router, "") == "5");
+
+    /* splitting a label keeps the patterns of the node split */
+    router.add("feeder1/no*", 7);
+    CHECK(matched(router, "feeder1/node1/voltage") == "1,2,4,5,6,7");
+    CHECK(matched(router, "feeder1/nx") == "4,5");
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "value_dictionary.hpp"
+#include "check.hpp"
+
+using std::string;
+using std::vector;
+
+/* the value the dictionary holds under the frame of the given one */
+static const string* roundtrip(const fncs::ValueDictionary &dictionary, const string &value)
+{
+    const string *frame = dictionary.frame(value);
+    CHECK(frame);
+    CHECK(frame->size() == fncs::ValueDictionary::FRAME_SIZE);
+    return dictionary.lookup(frame->data(), frame->size());
+}
+
+int main()
+{
+    fncs::ValueDictionary dictionary;
+    CHECK(dictionary.empty());
+    CHECK(!dictionary.frame("OPEN"));
+
+    /* values alike but for one byte, a NUL, or their length, each get
+     * a code of their own; adding one again gives back its code */
+    const char *alike[] = {"OPEN", "OPEN ", "OPEM", "open", "", "CLOSED"};
+    for (size_t i=0; i<6; ++i) {
+        CHECK(dictionary.add(alike[i]) == i);
+    }
+    CHECK(dictionary.add(string("OPEN\0", 5)) == 6);
+    CHECK(dictionary.add(string("\0OPEN", 5)) == 7);
+    CHECK(dictionary.add("OPEN") == 0);
+    CHECK(dictionary.add("") == 4);
+    CHECK(dictionary.size() == 8);
+    for (size_t i=0; i<6; ++i) {
+        CHECK(*roundtrip(dictionary, alike[i]) == alike[i]);
+    }
+    CHECK(*roundtrip(dictionary, string("OPEN\0", 5)) == string("OPEN\0", 5));
+
+    /* only a coded frame of a known code is looked up */
+    const string *open = dictionary.frame("OPEN");
+    string unknown = *open;
+    unknown[2] = 100;
+    CHECK(!dictionary.lookup(unknown.data(), unknown.size()));
+    CHECK(!dictionary.lookup(open->data(), open->size() - 1));
+    CHECK(!dictionary.lookup("OPEN\0\0", 6));
+    CHECK(fncs::ValueDictionary::code(open->data(), open->size()) == 0);
+
+    /* growing past codes of one and two bytes keeps the values where
+     * they were, as the cache refers to them */
+    const string *closed = &dictionary.value(5);
+    char name[32];
+    for (size_t i=dictionary.size(); i<70000; ++i) {
+        sprintf(name, "state-%lu", static_cast<unsigned long>(i));
+        CHECK(dictionary.add(name) == i);
+    }
+    CHECK(closed == &dictionary.value(5));
+    CHECK(closed == roundtrip(dictionary, "CLOSED"));
+    for (size_t i=8; i<70000; i+=997) {
+        sprintf(name, "state-%lu", static_cast<unsigned long>(i));
+        const string *frame = dictionary.frame(name);
+        CHECK(fncs::ValueDictionary::code(frame->data(), frame->size()) == i);
+        CHECK(dictionary.value(i) == name);
+    }
+
+    /* the ACK gives a sim the same codes */
+    string packed = dictionary.pack();
+    fncs::ValueDictionary sim;
+    CHECK(sim.unpack(packed.data(), packed.size()));
+    CHECK(sim.size() == dictionary.size());
+    for (size_t i=0; i<dictionary.size(); i+=101) {
+        CHECK(sim.value(i) == dictionary.value(i));
+        CHECK(*sim.frame(sim.value(i)) == *dictionary.frame(dictionary.value(i)));
+    }
+
+    /* a truncated length or value is malformed */
+    fncs::ValueDictionary broken;
+    CHECK(!broken.unpack(packed.data(), 3));
+    CHECK(!broken.unpack(packed.data(), 6));
+    CHECK(broken.unpack(packed.data(), 0));
+
+    return 0;
+}